@@ -0,0 +1,387 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "filescan.h"
+#include "relation_generator.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Relation the index benchmarks read, and the relation of the insert
+ * benchmarks, which stays empty
+ */
+const std::string RELATION = "bench_rel";
+const std::string EMPTY_RELATION = "bench_empty";
+
+/**
+ * Files of the buffer manager benchmarks
+ */
+const std::string PAGES_FILE = "bench_pages";
+const std::string ALLOC_FILE = "bench_alloc";
+
+/**
+ * Record of the relations. The index is on i.
+ */
+typedef GeneratedRecord Record;
+
+/**
+ * Orders the keys of a relation or of inserts come in
+ */
+enum KeyOrder { FORWARD, BACKWARD, RANDOM };
+
+/**
+ * Settings given on the command line
+ */
+std::uint32_t poolFrames = 10000;
+std::int64_t minSize = 10000;
+std::int64_t maxSize = 1000000;
+
+BufMgr *pool = NULL;
+
+void removeFile(const std::string &name) {
+  try {
+    File::remove(name);
+  } catch (const FileNotFoundException &) {
+  }
+}
+
+/**
+ * Returns the keys 0 to size - 1 in the given order. Random orders are the
+ * same from run to run.
+ */
+std::vector<int> makeKeys(const std::int64_t size, const KeyOrder order) {
+  std::vector<int> keys(size);
+  for (std::int64_t k = 0; k < size; k++) keys[k] = (int)k;
+  if (order == BACKWARD) std::reverse(keys.begin(), keys.end());
+  if (order == RANDOM) {
+    std::mt19937 rng(42);
+    std::shuffle(keys.begin(), keys.end(), rng);
+  }
+  return keys;
+}
+
+/**
+ * Writes a relation with a record for each of the keys 0 to size - 1, in
+ * random order.
+ */
+void createRelation(const std::string &name, const std::int64_t size) {
+  removeFile(name);
+  PageFile *file = new PageFile(name, true);
+  RelationSpec spec;
+  spec.pattern = RANDOM_KEYS;
+  spec.high = (int)size;
+  spec.seed = 42;
+  RelationGenerator(spec).generate(file);
+  delete file;
+}
+
+/**
+ * The relation of the last size asked for and an index on it, kept between
+ * benchmarks of that size so that each is built once.
+ */
+class Dataset {
+ public:
+  Dataset() : size(0), index(NULL) {}
+  ~Dataset() { clear(); }
+
+  /**
+   * Returns the relation of size records, written if not already there.
+   */
+  const std::string &relation(const std::int64_t size) {
+    if (this->size != size) {
+      clear();
+      createRelation(RELATION, size);
+      this->size = size;
+    }
+    return RELATION;
+  }
+
+  /**
+   * Returns an index bulk loaded from the relation of size records.
+   */
+  BTreeIndex *indexOf(const std::int64_t size) {
+    relation(size);
+    if (index == NULL) {
+      index = new BTreeIndex(RELATION, indexName, pool, offsetof(Record, i),
+                             INTEGER, true);
+    }
+    return index;
+  }
+
+  void clear() {
+    if (index != NULL) {
+      delete index;
+      index = NULL;
+      removeFile(indexName);
+    }
+    if (size != 0) removeFile(RELATION);
+    size = 0;
+  }
+
+ private:
+  std::int64_t size;
+  BTreeIndex *index;
+  std::string indexName;
+};
+
+Dataset dataset;
+
+// -----------------------------------------------------------------------------
+// Index benchmarks
+// -----------------------------------------------------------------------------
+
+/**
+ * Inserts range(0) keys in the given order into a new index, one insertEntry()
+ * each.
+ */
+void BM_InsertEntry(benchmark::State &state, const KeyOrder order) {
+  const std::int64_t size = state.range(0);
+  const std::vector<int> keys = makeKeys(size, order);
+  for (auto _ : state) {
+    state.PauseTiming();
+    createRelation(EMPTY_RELATION, 0);
+    std::string indexName;
+    BTreeIndex *index =
+        new BTreeIndex(EMPTY_RELATION, indexName, pool, offsetof(Record, i),
+                       INTEGER, false);
+    state.ResumeTiming();
+
+    for (std::int64_t k = 0; k < size; k++) {
+      const RecordId rid = {(PageId)(k / 50 + 1), (SlotId)(k % 50 + 1), 0};
+      index->insertEntry(&keys[k], rid);
+    }
+
+    state.PauseTiming();
+    delete index;
+    removeFile(indexName);
+    removeFile(EMPTY_RELATION);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+}
+
+/**
+ * Looks up keys chosen uniformly from an index of range(0) keys, one lookup()
+ * per iteration.
+ */
+void BM_Lookup(benchmark::State &state) {
+  const std::int64_t size = state.range(0);
+  BTreeIndex *index = dataset.indexOf(size);
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> keys(0, (int)size - 1);
+  RecordId rid;
+  for (auto _ : state) {
+    const int key = keys(rng);
+    benchmark::DoNotOptimize(index->lookup(&key, rid));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * Scans ranges holding range(1) thousandths of an index of range(0) keys,
+ * starting at a uniformly chosen key, one scan per iteration.
+ */
+void BM_RangeScan(benchmark::State &state) {
+  const std::int64_t size = state.range(0);
+  const std::int64_t width =
+      std::max<std::int64_t>(1, size * state.range(1) / 1000);
+  BTreeIndex *index = dataset.indexOf(size);
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<std::int64_t> starts(0, size - width);
+  std::int64_t entries = 0;
+  RecordId rid;
+  for (auto _ : state) {
+    int low = (int)starts(rng);
+    int high = (int)(low + width);
+    try {
+      index->startScan(&low, GTE, &high, LT);
+      while (true) {
+        index->scanNext(rid);
+        entries++;
+      }
+    } catch (const IndexScanCompletedException &) {
+      index->endScan();
+    } catch (const NoSuchKeyFoundException &) {
+    }
+  }
+  state.SetItemsProcessed(entries);
+}
+
+/**
+ * Builds an index on a relation of range(0) records through FileScan, by
+ * bulk loading if range(1) is set and else by inserting the records one by
+ * one.
+ */
+void BM_IndexBuild(benchmark::State &state) {
+  const std::int64_t size = state.range(0);
+  const bool bulk = state.range(1) != 0;
+  const std::string relation = "bench_build";
+  createRelation(relation, size);
+  for (auto _ : state) {
+    std::string indexName;
+    BTreeIndex *index = new BTreeIndex(relation, indexName, pool,
+                                       offsetof(Record, i), INTEGER, bulk);
+    state.PauseTiming();
+    delete index;
+    removeFile(indexName);
+    state.ResumeTiming();
+  }
+  removeFile(relation);
+  state.SetItemsProcessed(state.iterations() * size);
+}
+
+// -----------------------------------------------------------------------------
+// Buffer manager and file benchmarks
+// -----------------------------------------------------------------------------
+
+/**
+ * Reads and unpins the pages of a file of range(0) pages in turn, one page per
+ * iteration. Every page is read once before timing starts, so a file that fits
+ * in the pool is read from it throughout; one larger than the pool has every
+ * page read from the file again.
+ */
+void BM_ReadPage(benchmark::State &state) {
+  const PageId pages = (PageId)state.range(0);
+  removeFile(PAGES_FILE);
+  PageFile *file = new PageFile(PAGES_FILE, true);
+  std::vector<PageId> pageNos(pages);
+  for (PageId i = 0; i < pages; i++) {
+    Page *page;
+    pool->allocPage(file, pageNos[i], page);
+    pool->unPinPage(file, pageNos[i], true);
+  }
+  pool->flushFile(file);
+  for (PageId i = 0; i < pages; i++) {
+    Page *page;
+    pool->readPage(file, pageNos[i], page);
+    pool->unPinPage(file, pageNos[i], false);
+  }
+
+  PageId next = 0;
+  for (auto _ : state) {
+    Page *page;
+    pool->readPage(file, pageNos[next], page);
+    pool->unPinPage(file, pageNos[next], false);
+    next = (next + 1) % pages;
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  pool->flushFile(file);
+  delete file;
+  removeFile(PAGES_FILE);
+}
+
+/**
+ * Appends a page to a file, one allocatePage() per iteration.
+ */
+void BM_AllocatePage(benchmark::State &state) {
+  removeFile(ALLOC_FILE);
+  {
+    PageFile file = PageFile::create(ALLOC_FILE);
+    PageId pageNo;
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(file.allocatePage(pageNo));
+    }
+  }
+  removeFile(ALLOC_FILE);
+  state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * Takes "--name=value" off the command line if it is there.
+ */
+bool takeFlag(int &argc, char **argv, const char *name, std::int64_t &value) {
+  const std::size_t length = strlen(name);
+  for (int a = 1; a < argc; a++) {
+    if (strncmp(argv[a], name, length) != 0 || argv[a][length] != '=') {
+      continue;
+    }
+    value = std::strtoll(argv[a] + length + 1, NULL, 10);
+    for (int b = a; b + 1 < argc; b++) argv[b] = argv[b + 1];
+    argc--;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+/**
+ * Runs the benchmarks. Besides Google Benchmark's own flags, it takes
+ * --pool_frames (frames of the buffer pool, 10000 by default), and --min_size
+ * and --max_size (the smallest and largest index or relation, by powers of
+ * ten from 10^4 to 10^6 by default, up to 10^8).
+ */
+int main(int argc, char **argv) {
+  std::int64_t frames = poolFrames;
+  takeFlag(argc, argv, "--pool_frames", frames);
+  takeFlag(argc, argv, "--min_size", minSize);
+  takeFlag(argc, argv, "--max_size", maxSize);
+  poolFrames = (std::uint32_t)frames;
+  pool = new BufMgr(poolFrames);
+
+  std::vector<std::int64_t> sizes;
+  for (std::int64_t size = minSize; size <= maxSize; size *= 10) {
+    sizes.push_back(size);
+  }
+  std::vector<std::int64_t> selectivities;
+  selectivities.push_back(1);
+  selectivities.push_back(10);
+  selectivities.push_back(100);
+  selectivities.push_back(1000);
+  std::vector<std::int64_t> modes;
+  modes.push_back(0);
+  modes.push_back(1);
+
+  const KeyOrder orders[] = {FORWARD, BACKWARD, RANDOM};
+  const char *orderNames[] = {"BM_InsertEntry/forward", "BM_InsertEntry/backward",
+                              "BM_InsertEntry/random"};
+  for (int o = 0; o < 3; o++) {
+    benchmark::RegisterBenchmark(orderNames[o], BM_InsertEntry, orders[o])
+        ->ArgsProduct({sizes})
+        ->Unit(benchmark::kMillisecond);
+  }
+  benchmark::RegisterBenchmark("BM_Lookup", BM_Lookup)->ArgsProduct({sizes});
+  benchmark::RegisterBenchmark("BM_RangeScan", BM_RangeScan)
+      ->ArgsProduct({sizes, selectivities})
+      ->Unit(benchmark::kMicrosecond);
+  benchmark::RegisterBenchmark("BM_IndexBuild", BM_IndexBuild)
+      ->ArgsProduct({sizes, modes})
+      ->Unit(benchmark::kMillisecond);
+
+  // Half the pool is hit every time, twice the pool missed every time
+  benchmark::RegisterBenchmark("BM_ReadPage/hit", BM_ReadPage)
+      ->Arg(std::max<std::int64_t>(1, poolFrames / 2));
+  benchmark::RegisterBenchmark("BM_ReadPage/miss", BM_ReadPage)
+      ->Arg(2 * (std::int64_t)poolFrames);
+  benchmark::RegisterBenchmark("BM_AllocatePage", BM_AllocatePage);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  dataset.clear();
+  delete pool;
+  return 0;
+}
@@ -26,665 +26,6100 @@
 // GIVEN IMPORTS START
 #include "btree.h"
 
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_read_only_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
+#include "file_iterator.h"
 #include "filescan.h"
+#include "page_iterator.h"
 
 // GIVEN IMPORTS END
 
 // STUDENT IMPORTS START
 #include "exceptions/page_not_pinned_exception.h"
+#include "key_search.h"
+#include "trace.h"
 // STUDENT IMPORTS END
 
 //#define DEBUG
 
 namespace badgerdb {
 
-// -----------------------------------------------------------------------------
-// BTreeIndex::BTreeIndex -- Constructor
-// -----------------------------------------------------------------------------
+namespace {
 
 /**
- * BTreeIndex Constructor.
- * Check to see if the corresponding index file exists. If so, open the file.
- * If not, create it and insert entries for every tuple in the base relation
- * using FileScan class.
- *
- * @param relationName               Name of file.
- * @param outIndexName               Return the name of index file.
- * @param bufMgrIn                   Buffer Manager Instance
- * @param attrByteOffset             Offset of attribute, over which index is to
- * be built, in the record
- * @param attrType                   Datatype of attribute over which index is
- * built
- * @throws  BadIndexInfoException    If the index file already exists for the
- * corresponding attribute, but values in metapage(relationName, attribute byte
- * offset, attribute type etc.) do not match with values received through
- * constructor parameters.
+ * Sets up a newly allocated page as a leaf with no entries and no right sibling.
  */
-BTreeIndex::BTreeIndex(const std::string &relationName,
-                       std::string &outIndexName, BufMgr *bufMgrIn,
-                       const int attrByteOffset, const Datatype attrType) {
-  // Create the file name
-  std::ostringstream idxStr;
-  idxStr << relationName << "." << attrByteOffset;
-  outIndexName = idxStr.str();  // indexName is the name of the index file
-
-  // set fields
-  this->bufMgr = bufMgrIn;
-  this->attrByteOffset = attrByteOffset;
-  this->attributeType = attrType;
-  this->leafOccupancy = INTARRAYLEAFSIZE;
-  this->nodeOccupancy = INTARRAYNONLEAFSIZE;
-  this->scanExecuting = false;
-
-  // Check to see if the corresponding index file exists
-  try {
-    // If file exists, open the file
-    this->file = new BlobFile(outIndexName, false);  // Try to open existing file
+template <class T>
+void initEmptyLeaf(Page *page) {
+  reinterpret_cast<LeafNode<T> *>(page)->init();
+}
 
-    // Read file info
-    this->headerPageNum = this->file->getFirstPageNo();
-    Page *headerPage;
-    this->bufMgr->readPage(this->file, this->headerPageNum, headerPage);
+/**
+ * Returns the number of leading bytes a and b have in common, up to n.
+ */
+int commonPrefixLength(const char *a, const char *b, const int n) {
+  int i = 0;
+  while (i < n && a[i] == b[i]) i++;
+  return i;
+}
 
-    // Get meta info from headerPage
-    IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
-    this->rootPageNum = meta->rootPageNo;
+/**
+ * Returns the length of key without its trailing zero bytes.
+ */
+int significantLength(const StringKey &key) {
+  int length = STRINGSIZE;
+  while (length > 0 && key.data[length - 1] == 0) length--;
+  return length;
+}
 
-    // Make sure that this is valid index info
-    if (relationName != meta->relationName || attrType != meta->attrType ||
-        this->attrByteOffset != meta->attrByteOffset)
-      throw BadIndexInfoException(outIndexName);
+/**
+ * Most entries a STRING leaf can hold, reached when all keys are the same.
+ */
+const int STRINGLEAFMAXKEYS = STRINGLEAFDATASIZE / sizeof(RecordId);
 
-    // Unpin page that was pinned when readPage was called
-    bufMgr->unPinPage(this->file, this->headerPageNum, false);
+/**
+ * Bytes a STRING non-leaf takes for each child: its page number and the number
+ * of entries under it.
+ */
+const int STRINGNONLEAFCHILDSIZE = sizeof(PageId) + sizeof(std::uint32_t);
 
-  } catch (FileNotFoundException &e) {
-    // If file does not exist, create it and insert entries for every tuple
-    // in the base relation using FileScan class
-    this->file = new BlobFile(outIndexName, true);  // Create new file
+/**
+ * Most keys a STRING non-leaf can hold, reached when all keys are the same.
+ */
+const int STRINGNONLEAFMAXKEYS =
+    (STRINGNONLEAFDATASIZE - STRINGNONLEAFCHILDSIZE) / STRINGNONLEAFCHILDSIZE;
 
-    // allocate pages
-    Page *headerPage;
-    this->bufMgr->allocPage(this->file, this->headerPageNum, headerPage);
+/**
+ * Returns true if a STRING leaf can hold the count sorted keys.
+ */
+bool stringLeafFits(const StringKey *keys, const int count) {
+  const int shared =
+      commonPrefixLength(keys[0].data, keys[count - 1].data, STRINGSIZE);
+  return count * (STRINGSIZE - shared + (int)sizeof(RecordId)) <=
+         STRINGLEAFDATASIZE;
+}
 
-    Page *rootPage;
-    this->bufMgr->allocPage(this->file, this->rootPageNum, rootPage);
+/**
+ * Bytes an INTEGER leaf takes for each distinct key: the key and the end of
+ * its posting list.
+ */
+const int INTLEAFGROUPSIZE = sizeof(int) + sizeof(std::uint16_t);
 
-    // Complete meta information for new pages
-    IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
-    meta->attrByteOffset = this->attrByteOffset;
-    meta->attrType = attrType;
-    meta->rootPageNo = this->rootPageNum;
-    strncpy((char *)(&(meta->relationName)), relationName.c_str(), 20);
-    meta->relationName[19] = 0;
+/**
+ * Most entries an INTEGER leaf can hold, reached when all keys are the same
+ * and the page number deltas take two bytes.
+ */
+const int INTLEAFMAXKEYS = INTLEAFDATASIZE / (2 + sizeof(SlotId));
 
-    this->initialRootPageId = this->rootPageNum;
+/**
+ * Returns the number of bytes the page number deltas of an INTEGER leaf take
+ * if its page numbers run from low to high.
+ */
+int intLeafPageBytes(const PageId low, const PageId high) {
+  return high - low <= 0xffff ? 2 : 4;
+}
 
-    // init root
-    LeafNodeInt *root = reinterpret_cast<LeafNodeInt *>(rootPage);
-    // root->rightSibPageNo = 0;
+/**
+ * Reads a RecordId stored in an INTEGER leaf relative to base.
+ */
+RecordId loadIntLeafRid(const char *at, const PageId base,
+                        const int pageBytes) {
+  RecordId rid;
+  if (pageBytes == 2) {
+    std::uint16_t delta;
+    memcpy(&delta, at, sizeof(delta));
+    rid.page_number = base + delta;
+  } else {
+    std::uint32_t delta;
+    memcpy(&delta, at, sizeof(delta));
+    rid.page_number = base + delta;
+  }
+  memcpy(&rid.slot_number, at + pageBytes, sizeof(SlotId));
+  rid.padding = 0;
+  return rid;
+}
 
-    // Unpin pages, they are no longer needed
-    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
-    this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
+/**
+ * Stores a RecordId in an INTEGER leaf relative to base.
+ */
+void storeIntLeafRid(char *at, const RecordId &rid, const PageId base,
+                     const int pageBytes) {
+  if (pageBytes == 2) {
+    const std::uint16_t delta = rid.page_number - base;
+    memcpy(at, &delta, sizeof(delta));
+  } else {
+    const std::uint32_t delta = rid.page_number - base;
+    memcpy(at, &delta, sizeof(delta));
+  }
+  memcpy(at + pageBytes, &rid.slot_number, sizeof(SlotId));
+}
 
-    // Insert entries for every tuple in the base relation using FileScan
-    FileScan fileScan(relationName, this->bufMgr);
-    RecordId rid;
+/**
+ * Returns true if an INTEGER leaf can hold the count sorted entries.
+ */
+bool intLeafFits(const int *keys, const RecordId *rids, const int count) {
+  int groups = 0;
+  PageId low = rids[0].page_number;
+  PageId high = low;
+  for (int i = 0; i < count; i++) {
+    groups += (i == 0 || keys[i] != keys[i - 1]);
+    low = std::min(low, rids[i].page_number);
+    high = std::max(high, rids[i].page_number);
+  }
+  return groups * INTLEAFGROUPSIZE +
+             count * (intLeafPageBytes(low, high) + (int)sizeof(SlotId)) <=
+         INTLEAFDATASIZE;
+}
 
-    try {
-      // Actually insert the entries in a while loop
-      while (true) {
-        fileScan.scanNext(rid);
-        std::string record = fileScan.getRecord();
-        this->insertEntry((int *)(record.c_str() + this->attrByteOffset), rid);
-      }
-    } catch (EndOfFileException &e) {
-      // Save the Index to the file
-      this->bufMgr->flushFile(this->file);
+/**
+ * Merges the entries of leaf with count sorted entries into outKeys and
+ * outRids, each new entry after the entries of the leaf with an equal key.
+ */
+template <class Leaf, class T>
+void mergeLeafEntries(const Leaf &leaf, const T *keys, const RecordId *rids,
+                      const int count, T *outKeys, RecordId *outRids) {
+  for (int i = 0, j = 0, k = 0; k < leaf.numKeys + count; k++) {
+    if (j < count && (i == leaf.numKeys || keys[j] < leaf.getKey(i))) {
+      outKeys[k] = keys[j];
+      outRids[k] = rids[j];
+      j++;
+    } else {
+      outKeys[k] = leaf.getKey(i);
+      outRids[k] = leaf.getRid(i);
+      i++;
     }
   }
 }
 
+/**
+ * Returns true if a STRING non-leaf can hold the count sorted keys and the
+ * count + 1 children between them.
+ */
+bool stringNonLeafFits(const StringKey *keys, const int count) {
+  if (count == 0) return true;
+  const int shared =
+      commonPrefixLength(keys[0].data, keys[count - 1].data, STRINGSIZE);
+  int suffixLen = 0;
+  for (int i = 0; i < count; i++) {
+    suffixLen = std::max(suffixLen, significantLength(keys[i]) - shared);
+  }
+  return count * suffixLen + (count + 1) * STRINGNONLEAFCHILDSIZE <=
+         STRINGNONLEAFDATASIZE;
+}
+
+/**
+ * Pages of an index the calling thread has read or pinned, and nodes it has
+ * passed going down to leaves, over all indexes. OpCount takes the difference
+ * across one call.
+ */
+thread_local std::uint64_t threadPagesTouched = 0;
+thread_local std::uint64_t threadDescentDepth = 0;
+
+/**
+ * Adds the pages touched and nodes descended by the calling thread while it
+ * is in scope to the counters of a method, as one call.
+ */
+class OpCount {
+ public:
+  explicit OpCount(BTreeOpCounters &counters)
+      : counters(counters),
+        pagesTouched(threadPagesTouched),
+        descentDepth(threadDescentDepth) {}
+
+  ~OpCount() {
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    counters.pagesTouched.fetch_add(threadPagesTouched - pagesTouched,
+                                    std::memory_order_relaxed);
+    counters.descentDepth.fetch_add(threadDescentDepth - descentDepth,
+                                    std::memory_order_relaxed);
+  }
+
+ private:
+  BTreeOpCounters &counters;
+  const std::uint64_t pagesTouched;
+  const std::uint64_t descentDepth;
+};
+
+}  // namespace
+
 // -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
+// NonLeafNode<StringKey>
 // -----------------------------------------------------------------------------
 
+void NonLeafNode<StringKey>::init(const int nodeLevel,
+                                  const PageId firstChild,
+                                  const std::uint32_t firstCount) {
+  level = nodeLevel;
+  numKeys = 0;
+  prefixLen = 0;
+  suffixLen = 0;
+  setChild(0, firstChild);
+  setCount(0, firstCount);
+}
+
+StringKey NonLeafNode<StringKey>::getKey(const int i) const {
+  StringKey key;
+  memset(key.data, 0, STRINGSIZE);
+  memcpy(key.data, prefix, prefixLen);
+  memcpy(key.data + prefixLen, data + i * suffixLen, suffixLen);
+  return key;
+}
+
+PageId NonLeafNode<StringKey>::getChild(const int i) const {
+  PageId child;
+  memcpy(&child,
+         data + STRINGNONLEAFDATASIZE - (i + 1) * STRINGNONLEAFCHILDSIZE,
+         sizeof(PageId));
+  return child;
+}
+
+void NonLeafNode<StringKey>::setChild(const int i, const PageId child) {
+  memcpy(data + STRINGNONLEAFDATASIZE - (i + 1) * STRINGNONLEAFCHILDSIZE,
+         &child, sizeof(PageId));
+}
+
+std::uint32_t NonLeafNode<StringKey>::getCount(const int i) const {
+  std::uint32_t count;
+  memcpy(&count,
+         data + STRINGNONLEAFDATASIZE - (i + 1) * STRINGNONLEAFCHILDSIZE +
+             sizeof(PageId),
+         sizeof(count));
+  return count;
+}
+
+void NonLeafNode<StringKey>::setCount(const int i, const std::uint32_t count) {
+  memcpy(data + STRINGNONLEAFDATASIZE - (i + 1) * STRINGNONLEAFCHILDSIZE +
+             sizeof(PageId),
+         &count, sizeof(count));
+}
+
+std::uint32_t NonLeafNode<StringKey>::totalCount() const {
+  std::uint32_t total = 0;
+  for (int i = 0; i <= numKeys; i++) total += getCount(i);
+  return total;
+}
+
+int NonLeafNode<StringKey>::lowerBound(const StringKey &key) const {
+  const int c = memcmp(key.data, prefix, prefixLen);
+  if (c < 0) return 0;
+  if (c > 0) return numKeys;
+
+  // Keys are zero after their suffix, so a key whose suffix equals that of
+  // the search key is still less than it if the search key goes on
+  const char *suffix = key.data + prefixLen;
+  bool longer = false;
+  for (int i = prefixLen + suffixLen; i < STRINGSIZE; i++) {
+    longer = longer || key.data[i] != 0;
+  }
+
+  int base = 0;
+  int n = numKeys;
+  while (n > 1) {
+    const int half = n / 2;
+    const int cmp = memcmp(data + (base + half) * suffixLen, suffix, suffixLen);
+    base = (cmp < 0 || (cmp == 0 && longer)) ? base + half : base;
+    n -= half;
+  }
+  if (n == 1) {
+    const int cmp = memcmp(data + base * suffixLen, suffix, suffixLen);
+    base += (cmp < 0 || (cmp == 0 && longer));
+  }
+  return base;
+}
+
+int NonLeafNode<StringKey>::upperBound(const StringKey &key) const {
+  const int c = memcmp(key.data, prefix, prefixLen);
+  if (c < 0) return 0;
+  if (c > 0) return numKeys;
+
+  const char *suffix = key.data + prefixLen;
+  int base = 0;
+  int n = numKeys;
+  while (n > 1) {
+    const int half = n / 2;
+    base = (memcmp(data + (base + half) * suffixLen, suffix, suffixLen) <= 0)
+               ? base + half
+               : base;
+    n -= half;
+  }
+  return base +
+         (n == 1 && memcmp(data + base * suffixLen, suffix, suffixLen) <= 0);
+}
+
+bool NonLeafNode<StringKey>::hasRoom(const StringKey &key,
+                                     const double fillFactor) const {
+  if (numKeys == 0) return true;
+  const int shared = commonPrefixLength(prefix, key.data, prefixLen);
+  const int newSuffixLen = std::max(suffixLen + prefixLen - shared,
+                                    significantLength(key) - shared);
+  return (numKeys + 1) * newSuffixLen + (numKeys + 2) * STRINGNONLEAFCHILDSIZE <=
+         STRINGNONLEAFDATASIZE * fillFactor;
+}
+
+double NonLeafNode<StringKey>::fill() const {
+  return (double)(numKeys * suffixLen + (numKeys + 1) * STRINGNONLEAFCHILDSIZE) /
+         STRINGNONLEAFDATASIZE;
+}
+
+bool NonLeafNode<StringKey>::hasRoomForAnyKey() const {
+  // Worst case is a full length key that shares nothing with the others
+  return (numKeys + 1) * STRINGSIZE + (numKeys + 2) * STRINGNONLEAFCHILDSIZE <=
+         STRINGNONLEAFDATASIZE;
+}
+
+void NonLeafNode<StringKey>::insertAt(const int pos, const StringKey &key,
+                                      const PageId child,
+                                      const std::uint32_t count) {
+  if (numKeys == 0) {
+    memcpy(prefix, key.data, STRINGSIZE);
+    prefixLen = STRINGSIZE;
+    suffixLen = 0;
+  } else {
+    const int shared = commonPrefixLength(prefix, key.data, prefixLen);
+    const int newSuffixLen = std::max(suffixLen + prefixLen - shared,
+                                      significantLength(key) - shared);
+    if (shared < prefixLen || newSuffixLen > suffixLen) {
+      widen(shared, newSuffixLen);
+    }
+  }
+
+  memmove(data + (pos + 1) * suffixLen, data + pos * suffixLen,
+          (numKeys - pos) * suffixLen);
+  memcpy(data + pos * suffixLen, key.data + prefixLen, suffixLen);
+
+  // Children after the new key move one slot further from the end
+  char *children =
+      data + STRINGNONLEAFDATASIZE - (numKeys + 1) * STRINGNONLEAFCHILDSIZE;
+  memmove(children - STRINGNONLEAFCHILDSIZE, children,
+          (numKeys - pos) * STRINGNONLEAFCHILDSIZE);
+  setChild(pos + 1, child);
+  setCount(pos + 1, count);
+  numKeys++;
+}
+
+void NonLeafNode<StringKey>::removeAt(const int pos) {
+  // The prefix and suffix length stay, the remaining keys still fit in them
+  memmove(data + pos * suffixLen, data + (pos + 1) * suffixLen,
+          (numKeys - pos - 1) * suffixLen);
+  memset(data + (numKeys - 1) * suffixLen, 0, suffixLen);
+
+  // Children after the removed one move one slot closer to the end
+  char *children =
+      data + STRINGNONLEAFDATASIZE - (numKeys + 1) * STRINGNONLEAFCHILDSIZE;
+  memmove(children + STRINGNONLEAFCHILDSIZE, children,
+          (numKeys - pos - 1) * STRINGNONLEAFCHILDSIZE);
+  memset(children, 0, STRINGNONLEAFCHILDSIZE);
+  numKeys--;
+}
+
 /**
- * BTreeIndex Destructor.
- * End any initialized scan, flush index file, after unpinning any pinned pages,
- *from the buffer manager and delete file instance thereby closing the index
- *file. Destructor should not throw any exceptions. All exceptions should be
- *caught in here itself.
- **/
-BTreeIndex::~BTreeIndex() {
-  // Ends any initialized scan, unpinning any pages pinned by it
-  try {
-    this->endScan();
-  } catch (ScanNotInitializedException &e) {
-    // No scan had been initialized so don't need to do anything
+ * Stores the keys with a shorter prefix and longer suffixes, moving the keys
+ * from the last one down so that none is overwritten before it is moved.
+ */
+void NonLeafNode<StringKey>::widen(const int newPrefixLen,
+                                   const int newSuffixLen) {
+  const int extra = prefixLen - newPrefixLen;
+  for (int i = numKeys - 1; i >= 0; i--) {
+    char *dest = data + i * newSuffixLen;
+    memmove(dest + extra, data + i * suffixLen, suffixLen);
+    memcpy(dest, prefix + newPrefixLen, extra);
+    memset(dest + extra + suffixLen, 0, newSuffixLen - extra - suffixLen);
   }
+  prefixLen = newPrefixLen;
+  suffixLen = newSuffixLen;
+}
 
-  // Flushes file, throws error
-  this->bufMgr->flushFile(this->file);
+/**
+ * Replaces the contents of the node with count sorted keys and the count + 1
+ * children around them, with their entry counts, using the longest prefix the
+ * keys share.
+ */
+void NonLeafNode<StringKey>::assign(const StringKey *keys,
+                                    const PageId *children,
+                                    const std::uint32_t *counts,
+                                    const int count) {
+  prefixLen = 0;
+  suffixLen = 0;
+  if (count > 0) {
+    prefixLen =
+        commonPrefixLength(keys[0].data, keys[count - 1].data, STRINGSIZE);
+    memcpy(prefix, keys[0].data, prefixLen);
+    for (int i = 0; i < count; i++) {
+      suffixLen = std::max(suffixLen, significantLength(keys[i]) - prefixLen);
+    }
+  }
 
-  // Deletes file if necessary
-  if (this->file != NULL) {
-    delete this->file;
-    this->file = NULL;
+  for (int i = 0; i < count; i++) {
+    memcpy(data + i * suffixLen, keys[i].data + prefixLen, suffixLen);
+  }
+  for (int i = 0; i <= count; i++) {
+    setChild(i, children[i]);
+    setCount(i, counts[i]);
+  }
+  numKeys = count;
+}
+
+void NonLeafNode<StringKey>::splitInto(NonLeafNode &right, const int pos,
+                                       const StringKey &key,
+                                       const PageId child,
+                                       const std::uint32_t childCount,
+                                       StringKey &pushup) {
+  StringKey keys[STRINGNONLEAFMAXKEYS + 1];
+  PageId children[STRINGNONLEAFMAXKEYS + 2];
+  std::uint32_t counts[STRINGNONLEAFMAXKEYS + 2];
+
+  const int total = numKeys + 1;
+  for (int i = 0, j = 0; i < total; i++) {
+    keys[i] = (i == pos) ? key : getKey(j++);
+  }
+  for (int i = 0, j = 0; i <= total; i++) {
+    if (i == pos + 1) {
+      children[i] = child;
+      counts[i] = childCount;
+    } else {
+      children[i] = getChild(j);
+      counts[i] = getCount(j++);
+    }
+  }
+
+  // Push up the middle key unless a half would not fit, which can happen when
+  // the new key shares less with the others than they share among themselves.
+  // Pushing up the new key itself always fits.
+  const int mid = total / 2;
+  int split = pos;
+  for (int d = 0; d < total; d++) {
+    if (mid - d >= 0 && stringNonLeafFits(keys, mid - d) &&
+        stringNonLeafFits(keys + mid - d + 1, total - mid + d - 1)) {
+      split = mid - d;
+      break;
+    }
+    if (mid + d < total && stringNonLeafFits(keys, mid + d) &&
+        stringNonLeafFits(keys + mid + d + 1, total - mid - d - 1)) {
+      split = mid + d;
+      break;
+    }
   }
+
+  pushup = keys[split];
+  assign(keys, children, counts, split);
+  right.assign(keys + split + 1, children + split + 1, counts + split + 1,
+               total - split - 1);
+  right.level = level;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertEntry
+// LeafNode<StringKey>
 // -----------------------------------------------------------------------------
 
+void LeafNode<StringKey>::init() {
+  numKeys = 0;
+  rightSibPageNo = Page::INVALID_NUMBER;
+  leftSibPageNo = Page::INVALID_NUMBER;
+  prefixLen = 0;
+}
+
+StringKey LeafNode<StringKey>::getKey(const int i) const {
+  const int suffixLen = STRINGSIZE - prefixLen;
+  StringKey key;
+  memcpy(key.data, prefix, prefixLen);
+  memcpy(key.data + prefixLen, data + i * suffixLen, suffixLen);
+  return key;
+}
+
+RecordId LeafNode<StringKey>::getRid(const int i) const {
+  RecordId rid;
+  memcpy(&rid, data + STRINGLEAFDATASIZE - (i + 1) * sizeof(RecordId),
+         sizeof(RecordId));
+  return rid;
+}
+
+void LeafNode<StringKey>::copyRids(const int first, const int count,
+                                   RecordId *out) const {
+  for (int i = 0; i < count; i++) out[i] = getRid(first + i);
+}
+
+void LeafNode<StringKey>::copyKeys(const int first, const int count,
+                                   StringKey *out) const {
+  for (int i = 0; i < count; i++) out[i] = getKey(first + i);
+}
+
+void LeafNode<StringKey>::setRid(const int i, const RecordId &rid) {
+  memcpy(data + STRINGLEAFDATASIZE - (i + 1) * sizeof(RecordId), &rid,
+         sizeof(RecordId));
+}
+
+int LeafNode<StringKey>::lowerBound(const StringKey &key) const {
+  const int c = memcmp(key.data, prefix, prefixLen);
+  if (c < 0) return 0;
+  if (c > 0) return numKeys;
+
+  const int suffixLen = STRINGSIZE - prefixLen;
+  const char *suffix = key.data + prefixLen;
+  int base = 0;
+  int n = numKeys;
+  while (n > 1) {
+    const int half = n / 2;
+    base = (memcmp(data + (base + half) * suffixLen, suffix, suffixLen) < 0)
+               ? base + half
+               : base;
+    n -= half;
+  }
+  return base +
+         (n == 1 && memcmp(data + base * suffixLen, suffix, suffixLen) < 0);
+}
+
+int LeafNode<StringKey>::upperBound(const StringKey &key) const {
+  const int c = memcmp(key.data, prefix, prefixLen);
+  if (c < 0) return 0;
+  if (c > 0) return numKeys;
+
+  const int suffixLen = STRINGSIZE - prefixLen;
+  const char *suffix = key.data + prefixLen;
+  int base = 0;
+  int n = numKeys;
+  while (n > 1) {
+    const int half = n / 2;
+    base = (memcmp(data + (base + half) * suffixLen, suffix, suffixLen) <= 0)
+               ? base + half
+               : base;
+    n -= half;
+  }
+  return base +
+         (n == 1 && memcmp(data + base * suffixLen, suffix, suffixLen) <= 0);
+}
+
+double LeafNode<StringKey>::fill() const {
+  if (numKeys == 0) return 0;
+  return (double)(numKeys * (STRINGSIZE - prefixLen + (int)sizeof(RecordId))) /
+         STRINGLEAFDATASIZE;
+}
+
+bool LeafNode<StringKey>::hasRoom(const StringKey &key, const RecordId &,
+                                  const double fillFactor) const {
+  if (numKeys == 0) return true;
+  const int shared = commonPrefixLength(prefix, key.data, prefixLen);
+  return (numKeys + 1) * (STRINGSIZE - shared + (int)sizeof(RecordId)) <=
+         STRINGLEAFDATASIZE * fillFactor;
+}
+
+void LeafNode<StringKey>::insertAt(const int pos, const StringKey &key,
+                                   const RecordId &rid) {
+  if (numKeys == 0) {
+    memcpy(prefix, key.data, STRINGSIZE);
+    prefixLen = STRINGSIZE;
+  } else {
+    const int shared = commonPrefixLength(prefix, key.data, prefixLen);
+    if (shared < prefixLen) shortenPrefix(shared);
+  }
+
+  const int suffixLen = STRINGSIZE - prefixLen;
+  memmove(data + (pos + 1) * suffixLen, data + pos * suffixLen,
+          (numKeys - pos) * suffixLen);
+  memcpy(data + pos * suffixLen, key.data + prefixLen, suffixLen);
+
+  // RecordIds after the new entry move one slot further from the end
+  char *rids = data + STRINGLEAFDATASIZE - numKeys * sizeof(RecordId);
+  memmove(rids - sizeof(RecordId), rids, (numKeys - pos) * sizeof(RecordId));
+  setRid(pos, rid);
+  numKeys++;
+}
+
+void LeafNode<StringKey>::removeAt(const int pos) {
+  const int suffixLen = STRINGSIZE - prefixLen;
+  memmove(data + pos * suffixLen, data + (pos + 1) * suffixLen,
+          (numKeys - pos - 1) * suffixLen);
+  memset(data + (numKeys - 1) * suffixLen, 0, suffixLen);
+
+  // RecordIds after the removed entry move one slot closer to the end
+  char *rids = data + STRINGLEAFDATASIZE - numKeys * sizeof(RecordId);
+  memmove(rids + sizeof(RecordId), rids,
+          (numKeys - pos - 1) * sizeof(RecordId));
+  memset(rids, 0, sizeof(RecordId));
+  numKeys--;
+}
+
 /**
- * Insert a new entry using the pair <value,rid>.
- * Start from root to recursively find out the leaf to insert the entry in. The
- * insertion may cause splitting of leaf node. This splitting will require
- * addition of new leaf page number entry into the parent non-leaf, which may
- * in-turn get split. This may continue all the way upto the root causing the
- * root to get split. If root gets split, metapage needs to be changed
- * accordingly. Make sure to unpin pages as soon as you can.
- * @param key            Key to insert, pointer to integer/double/char string
- * @param rid            Record ID of a record whose entry is getting inserted
- *into the index.
- **/
-void BTreeIndex::insertEntry(void *key, const RecordId rid) {
-  RIDKeyPair<int> newEntry;
-  newEntry.set(rid, *((int *)key));
+ * Stores the keys with a shorter prefix, moving the keys from the last one
+ * down so that none is overwritten before it is moved.
+ */
+void LeafNode<StringKey>::shortenPrefix(const int newPrefixLen) {
+  const int oldSuffixLen = STRINGSIZE - prefixLen;
+  const int newSuffixLen = STRINGSIZE - newPrefixLen;
+  const int extra = prefixLen - newPrefixLen;
+  for (int i = numKeys - 1; i >= 0; i--) {
+    char *dest = data + i * newSuffixLen;
+    memmove(dest + extra, data + i * oldSuffixLen, oldSuffixLen);
+    memcpy(dest, prefix + newPrefixLen, extra);
+  }
+  prefixLen = newPrefixLen;
+}
+
+/**
+ * Replaces the entries of the leaf with the count sorted entries given, using
+ * the longest prefix their keys share.
+ */
+void LeafNode<StringKey>::assign(const StringKey *keys, const RecordId *rids,
+                                 const int count) {
+  prefixLen = count > 0 ? commonPrefixLength(keys[0].data,
+                                             keys[count - 1].data, STRINGSIZE)
+                        : 0;
+  if (count > 0) memcpy(prefix, keys[0].data, prefixLen);
+
+  const int suffixLen = STRINGSIZE - prefixLen;
+  for (int i = 0; i < count; i++) {
+    memcpy(data + i * suffixLen, keys[i].data + prefixLen, suffixLen);
+    setRid(i, rids[i]);
+  }
+  numKeys = count;
+}
+
+int LeafNode<StringKey>::insertRun(const StringKey *keys,
+                                   const RecordId *rids, const int count) {
+  if (count == 0) return 0;
+
+  // Every key shares with the first one what they all share, since the keys
+  // of the leaf and those of the run are each sorted
+  const StringKey first = numKeys > 0 ? getKey(0) : keys[0];
+  int shared = numKeys > 0 ? prefixLen : STRINGSIZE;
+  int merged = 0;
+  while (merged < count) {
+    const int newShared =
+        commonPrefixLength(first.data, keys[merged].data, shared);
+    if ((numKeys + merged + 1) *
+            (STRINGSIZE - newShared + (int)sizeof(RecordId)) >
+        STRINGLEAFDATASIZE) {
+      break;
+    }
+    shared = newShared;
+    merged++;
+  }
+  if (merged == 0) return 0;
+
+  StringKey allKeys[STRINGLEAFMAXKEYS];
+  RecordId allRids[STRINGLEAFMAXKEYS];
+  mergeLeafEntries(*this, keys, rids, merged, allKeys, allRids);
+  assign(allKeys, allRids, numKeys + merged);
+  return merged;
+}
 
-  PageKeyPair<int> *newInternal = nullptr;
+void LeafNode<StringKey>::splitInto(LeafNode &right, const int pos,
+                                    const StringKey &key,
+                                    const RecordId &rid) {
+  StringKey keys[STRINGLEAFMAXKEYS + 1];
+  RecordId rids[STRINGLEAFMAXKEYS + 1];
 
-  Page *rootPage;
-  this->bufMgr->readPage(this->file, this->rootPageNum, rootPage);
+  const int total = numKeys + 1;
+  for (int i = 0, j = 0; i < total; i++) {
+    if (i == pos) {
+      keys[i] = key;
+      rids[i] = rid;
+    } else {
+      keys[i] = getKey(j);
+      rids[i] = getRid(j);
+      j++;
+    }
+  }
+
+  // Split in the middle unless a half would not fit, which can happen when
+  // the new key shares less with the others than they share among themselves.
+  // Splitting right next to the new key always fits.
+  const int mid = total / 2;
+  int split = mid;
+  for (int d = 0; d < total; d++) {
+    if (mid - d >= 1 && stringLeafFits(keys, mid - d) &&
+        stringLeafFits(keys + mid - d, total - mid + d)) {
+      split = mid - d;
+      break;
+    }
+    if (mid + d < total && stringLeafFits(keys, mid + d) &&
+        stringLeafFits(keys + mid + d, total - mid - d)) {
+      split = mid + d;
+      break;
+    }
+  }
+
+  assign(keys, rids, split);
+  right.assign(keys + split, rids + split, total - split);
+}
+
+// -----------------------------------------------------------------------------
+// LeafNode<int>
+// -----------------------------------------------------------------------------
+
+void LeafNode<int>::init() {
+  numKeys = 0;
+  rightSibPageNo = Page::INVALID_NUMBER;
+  leftSibPageNo = Page::INVALID_NUMBER;
+  numGroups = 0;
+  basePage = 0;
+  pageBytes = 2;
+}
+
+int LeafNode<int>::getKey(const int i) const {
+  // Entry i is in the first posting list that ends after it
+  const std::uint16_t *ends = groupEnds();
+  const int g = std::upper_bound(ends, ends + numGroups, i) - ends;
+  return groupKeys()[g];
+}
+
+RecordId LeafNode<int>::getRid(const int i) const {
+  const int width = pageBytes + sizeof(SlotId);
+  return loadIntLeafRid(data + INTLEAFDATASIZE - (i + 1) * width, basePage,
+                        pageBytes);
+}
+
+void LeafNode<int>::copyRids(const int first, const int count,
+                             RecordId *out) const {
+  const int width = pageBytes + sizeof(SlotId);
+  const char *at = data + INTLEAFDATASIZE - (first + 1) * width;
+  for (int i = 0; i < count; i++, at -= width) {
+    out[i] = loadIntLeafRid(at, basePage, pageBytes);
+  }
+}
+
+void LeafNode<int>::copyKeys(const int first, const int count,
+                             int *out) const {
+  // Each key is repeated over its posting list
+  const std::uint16_t *ends = groupEnds();
+  int g = std::upper_bound(ends, ends + numGroups, first) - ends;
+  for (int i = first; i < first + count; i++) {
+    while (ends[g] <= i) g++;
+    *out++ = groupKeys()[g];
+  }
+}
+
+void LeafNode<int>::setRid(const int i, const RecordId &rid) {
+  const int width = pageBytes + sizeof(SlotId);
+  storeIntLeafRid(data + INTLEAFDATASIZE - (i + 1) * width, rid, basePage,
+                  pageBytes);
+}
+
+int LeafNode<int>::lowerBound(const int &key) const {
+  int g;
+  if (!keyInterpolate(groupKeys(), numGroups, key, false, g)) {
+    g = keyLowerBound(groupKeys(), numGroups, key);
+  }
+  return groupStart(g);
+}
+
+int LeafNode<int>::upperBound(const int &key) const {
+  int g;
+  if (!keyInterpolate(groupKeys(), numGroups, key, true, g)) {
+    g = keyUpperBound(groupKeys(), numGroups, key);
+  }
+  return groupStart(g);
+}
+
+/**
+ * Finds the base page and delta size that cover the page numbers of the leaf
+ * and that of rid. They only change if rid is outside what the current ones
+ * cover, and then never to smaller deltas.
+ */
+void LeafNode<int>::encodingFor(const RecordId &rid, PageId &base,
+                                int &bytes) const {
+  base = basePage;
+  bytes = pageBytes;
+  if (numKeys == 0) {
+    base = rid.page_number;
+    bytes = 2;
+    return;
+  }
+  if (rid.page_number >= basePage &&
+      (pageBytes == 4 || rid.page_number - basePage <= 0xffff)) {
+    return;
+  }
+
+  PageId high = rid.page_number;
+  for (int i = 0; i < numKeys; i++) {
+    high = std::max(high, getRid(i).page_number);
+  }
+  base = std::min(basePage, rid.page_number);
+  bytes = std::max(pageBytes, intLeafPageBytes(base, high));
+}
+
+/**
+ * Stores the RecordIds relative to another base page, with deltas at least
+ * as wide as before. Each one only moves towards the front, so going from the
+ * last one down none is overwritten before it is read.
+ */
+void LeafNode<int>::reencode(const PageId newBase, const int newPageBytes) {
+  const int oldWidth = pageBytes + sizeof(SlotId);
+  const int newWidth = newPageBytes + sizeof(SlotId);
+  for (int i = numKeys - 1; i >= 0; i--) {
+    const RecordId rid = loadIntLeafRid(
+        data + INTLEAFDATASIZE - (i + 1) * oldWidth, basePage, pageBytes);
+    storeIntLeafRid(data + INTLEAFDATASIZE - (i + 1) * newWidth, rid, newBase,
+                    newPageBytes);
+  }
+  basePage = newBase;
+  pageBytes = newPageBytes;
+}
+
+double LeafNode<int>::fill() const {
+  return (double)(numGroups * INTLEAFGROUPSIZE +
+                  numKeys * (pageBytes + (int)sizeof(SlotId))) /
+         INTLEAFDATASIZE;
+}
+
+bool LeafNode<int>::hasRoom(const int &key, const RecordId &rid,
+                            const double fillFactor) const {
+  if (numKeys == 0) return true;
+  PageId base;
+  int bytes;
+  encodingFor(rid, base, bytes);
+  const int g = keyLowerBound(groupKeys(), numGroups, key);
+  const int groups = numGroups + (g == numGroups || groupKeys()[g] != key);
+  return groups * INTLEAFGROUPSIZE +
+             (numKeys + 1) * (bytes + (int)sizeof(SlotId)) <=
+         INTLEAFDATASIZE * fillFactor;
+}
+
+/**
+ * Adds the key at index g, with an empty posting list starting at entry
+ * start. The ends move past the new key, and those from g on one more slot.
+ */
+void LeafNode<int>::insertGroup(const int g, const int key, const int start) {
+  const int count = numGroups;
+  char *oldEnds = data + count * sizeof(int);
+  char *newEnds = oldEnds + sizeof(int);
+  memmove(newEnds, oldEnds, count * sizeof(std::uint16_t));
+  memmove(newEnds + (g + 1) * sizeof(std::uint16_t),
+          newEnds + g * sizeof(std::uint16_t),
+          (count - g) * sizeof(std::uint16_t));
+
+  int *keys = groupKeys();
+  memmove(&keys[g + 1], &keys[g], (count - g) * sizeof(int));
+  keys[g] = key;
+  numGroups++;
+  groupEnds()[g] = start;
+}
+
+/**
+ * Takes out the key at index g, whose posting list is empty.
+ */
+void LeafNode<int>::removeGroup(const int g) {
+  const int count = numGroups;
+  int *keys = groupKeys();
+  memmove(&keys[g], &keys[g + 1], (count - g - 1) * sizeof(int));
+
+  char *oldEnds = data + count * sizeof(int);
+  char *newEnds = oldEnds - sizeof(int);
+  memmove(newEnds, oldEnds, g * sizeof(std::uint16_t));
+  memmove(newEnds + g * sizeof(std::uint16_t),
+          oldEnds + (g + 1) * sizeof(std::uint16_t),
+          (count - g - 1) * sizeof(std::uint16_t));
+  numGroups--;
+  memset(data + numGroups * INTLEAFGROUPSIZE, 0, INTLEAFGROUPSIZE);
+}
+
+void LeafNode<int>::insertAt(const int pos, const int &key,
+                             const RecordId &rid) {
+  PageId base;
+  int bytes;
+  encodingFor(rid, base, bytes);
+  if (numKeys == 0) {
+    basePage = base;
+    pageBytes = bytes;
+  } else if (base != basePage || bytes != pageBytes) {
+    reencode(base, bytes);
+  }
+
+  // A new key starts an empty posting list at the entry, and the posting
+  // lists from the entry's on all end one entry later
+  const int g = keyLowerBound(groupKeys(), numGroups, key);
+  if (g == numGroups || groupKeys()[g] != key) insertGroup(g, key, pos);
+  std::uint16_t *ends = groupEnds();
+  for (int j = g; j < numGroups; j++) ends[j]++;
+
+  // RecordIds after the new entry move one slot further from the end
+  const int width = pageBytes + sizeof(SlotId);
+  char *rids = data + INTLEAFDATASIZE - numKeys * width;
+  memmove(rids - width, rids, (numKeys - pos) * width);
+  numKeys++;
+  setRid(pos, rid);
+}
+
+void LeafNode<int>::removeAt(const int pos) {
+  const std::uint16_t *ends = groupEnds();
+  const int g = std::upper_bound(ends, ends + numGroups, pos) - ends;
+
+  // RecordIds after the removed entry move one slot closer to the end
+  const int width = pageBytes + sizeof(SlotId);
+  char *rids = data + INTLEAFDATASIZE - numKeys * width;
+  memmove(rids + width, rids, (numKeys - pos - 1) * width);
+  memset(rids, 0, width);
+  numKeys--;
+
+  std::uint16_t *groupEnd = groupEnds();
+  for (int j = g; j < numGroups; j++) groupEnd[j]--;
+  if (groupStart(g) == groupEnd[g]) removeGroup(g);
+}
+
+/**
+ * Replaces the entries of the leaf with the count sorted entries given, with
+ * the smallest page number as the base.
+ */
+void LeafNode<int>::assign(const int *keys, const RecordId *rids,
+                           const int count) {
+  memset(data, 0, INTLEAFDATASIZE);
+  PageId low = count > 0 ? rids[0].page_number : 0;
+  PageId high = low;
+  int groups = 0;
+  for (int i = 0; i < count; i++) {
+    low = std::min(low, rids[i].page_number);
+    high = std::max(high, rids[i].page_number);
+    groups += (i == 0 || keys[i] != keys[i - 1]);
+  }
+  basePage = low;
+  pageBytes = intLeafPageBytes(low, high);
+  numGroups = groups;
+  numKeys = count;
+
+  int *groupKey = groupKeys();
+  std::uint16_t *groupEnd = groupEnds();
+  for (int i = 0, g = -1; i < count; i++) {
+    if (i == 0 || keys[i] != keys[i - 1]) groupKey[++g] = keys[i];
+    groupEnd[g] = i + 1;
+    setRid(i, rids[i]);
+  }
+}
+
+int LeafNode<int>::insertRun(const int *keys, const RecordId *rids,
+                             const int count) {
+  if (count == 0) return 0;
+
+  PageId low = numKeys > 0 ? getRid(0).page_number : rids[0].page_number;
+  PageId high = low;
+  for (int i = 1; i < numKeys; i++) {
+    low = std::min(low, getRid(i).page_number);
+    high = std::max(high, getRid(i).page_number);
+  }
+
+  // Take entries while the distinct keys and the deltas of the page numbers
+  // of all of them fit
+  int groups = numGroups;
+  int merged = 0;
+  while (merged < count) {
+    const int key = keys[merged];
+    const PageId newLow = std::min(low, rids[merged].page_number);
+    const PageId newHigh = std::max(high, rids[merged].page_number);
+    const int g = keyLowerBound(groupKeys(), numGroups, key);
+    const bool newGroup = (merged == 0 || keys[merged - 1] != key) &&
+                          (g == numGroups || groupKeys()[g] != key);
+    if ((groups + newGroup) * INTLEAFGROUPSIZE +
+            (numKeys + merged + 1) *
+                (intLeafPageBytes(newLow, newHigh) + (int)sizeof(SlotId)) >
+        INTLEAFDATASIZE) {
+      break;
+    }
+    low = newLow;
+    high = newHigh;
+    groups += newGroup;
+    merged++;
+  }
+  if (merged == 0) return 0;
+
+  int allKeys[INTLEAFMAXKEYS];
+  RecordId allRids[INTLEAFMAXKEYS];
+  mergeLeafEntries(*this, keys, rids, merged, allKeys, allRids);
+  assign(allKeys, allRids, numKeys + merged);
+  return merged;
+}
+
+void LeafNode<int>::splitInto(LeafNode &right, const int pos, const int &key,
+                              const RecordId &rid) {
+  int keys[INTLEAFMAXKEYS + 1];
+  RecordId rids[INTLEAFMAXKEYS + 1];
+
+  const int total = numKeys + 1;
+  for (int i = 0, j = 0; i < total; i++) {
+    if (i == pos) {
+      keys[i] = key;
+      rids[i] = rid;
+    } else {
+      keys[i] = getKey(j);
+      rids[i] = getRid(j);
+      j++;
+    }
+  }
+
+  // Split in the middle unless a half would not fit, which can happen when
+  // one half holds many more distinct keys than the other, or needs wider
+  // page number deltas. Together the halves take at most one and a half
+  // leaves, so some place to split always leaves both of them fitting.
+  const int mid = total / 2;
+  int split = mid;
+  for (int d = 0; d < total; d++) {
+    if (mid - d >= 1 && intLeafFits(keys, rids, mid - d) &&
+        intLeafFits(keys + mid - d, rids + mid - d, total - mid + d)) {
+      split = mid - d;
+      break;
+    }
+    if (mid + d < total && intLeafFits(keys, rids, mid + d) &&
+        intLeafFits(keys + mid + d, rids + mid + d, total - mid - d)) {
+      split = mid + d;
+      break;
+    }
+  }
+
+  assign(keys, rids, split);
+  right.assign(keys + split, rids + split, total - split);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor
+// -----------------------------------------------------------------------------
+
+/**
+ * BTreeIndex Constructor.
+ * Check to see if the corresponding index file exists. If so, open the file.
+ * If not, create it and insert entries for every tuple in the base relation
+ * using FileScan class.
+ *
+ * @param relationName               Name of file.
+ * @param outIndexName               Return the name of index file.
+ * @param bufMgrIn                   Buffer Manager Instance
+ * @param attrByteOffset             Offset of attribute, over which index is to
+ * be built, in the record
+ * @param attrType                   Datatype of attribute over which index is
+ * built
+ * @param useBulkLoad                If true, a new index is built bottom-up
+ * from the sorted tuples instead of by inserting them one at a time
+ * @param fillFactor                 Fraction of each node filled by the bulk
+ * load
+ * @param readOnly                   If true, the index file is mapped into
+ * memory once it exists and the index cannot change
+ * @param buildThreads               Number of threads the bulk load builds a
+ * new index with, one per core if 0
+ * @param buildLog                   If not NULL, a new index is built online
+ * while the relation's writers keep adding records to this log
+ * @throws  BadIndexInfoException    If the index file already exists for the
+ * corresponding attribute, but values in metapage(relationName, attribute byte
+ * offset, attribute type etc.) do not match with values received through
+ * constructor parameters, or the index was not done being built online.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const int attrByteOffset, const Datatype attrType,
+                       const bool useBulkLoad, const double fillFactor,
+                       const bool readOnly, const std::size_t buildThreads,
+                       IndexBuildLog *buildLog)
+    : BTreeIndex(relationName, outIndexName, bufMgrIn, attrByteOffset,
+                 attrType, std::vector<KeyColumn>(), useBulkLoad, fillFactor,
+                 readOnly, buildThreads, buildLog, NULL) {}
+
+/**
+ * BTreeIndex Constructor for a COMPOSITE index.
+ *
+ * @param relationName               Name of file.
+ * @param outIndexName               Return the name of index file.
+ * @param bufMgrIn                   Buffer Manager Instance
+ * @param keyColumns                 Attributes of the key, the leading one
+ * first
+ * @param useBulkLoad                As for the other constructor
+ * @param fillFactor                 As for the other constructor
+ * @param readOnly                   As for the other constructor
+ * @param buildThreads               As for the other constructor
+ * @param buildLog                   As for the other constructor
+ * @throws  BadIndexInfoException    If the columns do not make a key, or the
+ * index file already exists with other columns or was not done being built
+ * online.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const std::vector<KeyColumn> &keyColumns,
+                       const bool useBulkLoad, const double fillFactor,
+                       const bool readOnly, const std::size_t buildThreads,
+                       IndexBuildLog *buildLog)
+    : BTreeIndex(relationName, outIndexName, bufMgrIn,
+                 keyColumns.empty() ? 0 : keyColumns[0].offset, COMPOSITE,
+                 keyColumns, useBulkLoad, fillFactor, readOnly, buildThreads,
+                 buildLog, NULL) {}
+
+namespace {
+
+/**
+ * Returns the number of bytes a column of the given type takes in a
+ * CompositeKey, or 0 if it cannot be a column.
+ */
+int columnWidth(const Datatype type) {
+  switch (type) {
+    case INTEGER:
+      return sizeof(int);
+    case DOUBLE:
+      return sizeof(double);
+    case STRING:
+      return STRINGSIZE;
+    case COMPOSITE:
+      break;
+  }
+  return 0;
+}
+
+/**
+ * Writes value to out with its most significant byte first.
+ */
+template <class U>
+void putBigEndian(U value, unsigned char *out) {
+  for (int i = (int)sizeof(U) - 1; i >= 0; i--) {
+    out[i] = (unsigned char)(value & 0xff);
+    value >>= 8;
+  }
+}
+
+/**
+ * Writes the encoding of a column's value, columnWidth() bytes that compare
+ * with memcmp() the way the values do.
+ */
+void encodeColumn(const Datatype type, const void *value, unsigned char *out) {
+  switch (type) {
+    case INTEGER: {
+      std::uint32_t bits;
+      memcpy(&bits, value, sizeof(bits));
+      putBigEndian<std::uint32_t>(bits ^ 0x80000000u, out);
+      break;
+    }
+    case DOUBLE: {
+      double number;
+      memcpy(&number, value, sizeof(number));
+      if (number == 0) number = 0;  // -0.0 is 0.0
+      std::uint64_t bits;
+      memcpy(&bits, &number, sizeof(bits));
+      bits = (bits >> 63) ? ~bits : bits ^ (1ULL << 63);
+      putBigEndian<std::uint64_t>(bits, out);
+      break;
+    }
+    case STRING:
+      strncpy(reinterpret_cast<char *>(out), static_cast<const char *>(value),
+              STRINGSIZE);
+      break;
+    case COMPOSITE:
+      break;
+  }
+}
+
+/**
+ * Returns the hash of a key for the key filter, FNV-1a of its bytes with
+ * their bits scrambled (the finalizer of SplitMix64).
+ */
+template <class T>
+std::uint64_t filterHash(const T &key) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&key);
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (std::size_t i = 0; i < sizeof(T); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+
+std::uint64_t filterHash(const double &key) {
+  // -0.0 equals 0.0, so it has to hash alike
+  const double normalized = key == 0 ? 0.0 : key;
+  std::uint64_t bits;
+  memcpy(&bits, &normalized, sizeof(bits));
+  return filterHash<std::uint64_t>(bits);
+}
+
+}  // namespace
+
+/**
+ * Opens or builds the index on a single attribute, or on keyColumns if
+ * attrType is COMPOSITE, in fileName if it is not NULL.
+ */
+BTreeIndex::BTreeIndex(const std::string &relationName,
+                       std::string &outIndexName, BufMgr *bufMgrIn,
+                       const int attrByteOffset, const Datatype attrType,
+                       const std::vector<KeyColumn> &keyColumns,
+                       const bool useBulkLoad, const double fillFactor,
+                       const bool readOnly, const std::size_t buildThreads,
+                       IndexBuildLog *buildLog, const std::string *fileName)
+    : readOnly(readOnly),
+      mappedPages(NULL),
+      numMappedPages(0),
+      maxHotNodes(bufMgrIn->getNumBufs() / 4),
+      openScans(0),
+      snapshotEpoch(0),
+      openSnapshots(0),
+      rightmostLeaf(Page::INVALID_NUMBER),
+      staleEntries(0),
+      countedEntries(0),
+      insertBufferCapacity(0),
+      buildLog(NULL),
+      leafSplits(0),
+      internalSplits(0),
+      rootSplits(0),
+      filterBlocks(0),
+      filterHashes(0),
+      filterRejects(0) {
+  // Create the file name
+  std::ostringstream idxStr;
+  idxStr << relationName << "." << attrByteOffset;
+  for (std::size_t c = 1; c < keyColumns.size(); c++) {
+    idxStr << "." << keyColumns[c].offset;
+  }
+  outIndexName = idxStr.str();  // indexName is the name of the index file
+  if (fileName != NULL) outIndexName = *fileName;
+
+  // The columns of a composite key must fit into it
+  if (attrType == COMPOSITE) {
+    int width = 0;
+    for (std::size_t c = 0; c < keyColumns.size(); c++) {
+      const int columnBytes = columnWidth(keyColumns[c].type);
+      if (columnBytes == 0) throw BadIndexInfoException(outIndexName);
+      width += columnBytes;
+    }
+    if (keyColumns.size() < 2 || (int)keyColumns.size() > MAX_KEY_COLUMNS ||
+        width > COMPOSITESIZE) {
+      throw BadIndexInfoException(outIndexName);
+    }
+  }
+
+  // set fields
+  this->bufMgr = bufMgrIn;
+  this->attrByteOffset = attrByteOffset;
+  this->attributeType = attrType;
+  this->keyColumns = keyColumns;
+  switch (attrType) {
+    case INTEGER:
+      this->leafOccupancy = KeyTraits<int>::LEAFSIZE;
+      this->nodeOccupancy = KeyTraits<int>::NONLEAFSIZE;
+      break;
+    case DOUBLE:
+      this->leafOccupancy = KeyTraits<double>::LEAFSIZE;
+      this->nodeOccupancy = KeyTraits<double>::NONLEAFSIZE;
+      break;
+    case STRING:
+      this->leafOccupancy = KeyTraits<StringKey>::LEAFSIZE;
+      this->nodeOccupancy = KeyTraits<StringKey>::NONLEAFSIZE;
+      break;
+    case COMPOSITE:
+      this->leafOccupancy = KeyTraits<CompositeKey>::LEAFSIZE;
+      this->nodeOccupancy = KeyTraits<CompositeKey>::NONLEAFSIZE;
+      break;
+  }
+  // Check to see if the corresponding index file exists
+  try {
+    // If file exists, open the file
+    this->file = new BlobFile(outIndexName, false);  // Try to open existing file
+    this->bufMgr->setFileClass(this->file, INDEX_PRIORITY);
+
+    // Read file info
+    this->headerPageNum = this->file->getFirstPageNo();
+    Page *headerPage;
+    this->bufMgr->readPage(this->file, this->headerPageNum, headerPage);
+
+    // Get meta info from headerPage
+    IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
+    this->rootPageNum = meta->rootPageNo;
+
+    // The first page after the header is always the first leaf, which stays
+    // the root for as long as the tree has a single leaf
+    this->initialRootPageId = this->headerPageNum + 1;
+
+    // The entry counts may be out of date from before, so the first estimate
+    // sets them again
+    if (!readOnly) this->staleEntries = 1;
+
+    // Make sure that this is valid index info
+    bool valid = relationName == meta->relationName &&
+                 attrType == meta->attrType &&
+                 this->attrByteOffset == meta->attrByteOffset &&
+                 !meta->buildInProgress;
+    if (valid && attrType == COMPOSITE) {
+      valid = meta->numKeyColumns == (int)keyColumns.size();
+      for (int c = 0; valid && c < meta->numKeyColumns; c++) {
+        valid = meta->keyColumns[c].offset == keyColumns[c].offset &&
+                meta->keyColumns[c].type == keyColumns[c].type;
+      }
+    }
+    if (!valid) {
+      // Closed here, since the destructor does not run
+      bufMgr->unPinPage(this->file, this->headerPageNum, false);
+      this->bufMgr->flushFile(this->file);
+      this->bufMgr->clearFileClass(this->file);
+      delete this->file;
+      this->file = NULL;
+      throw BadIndexInfoException(outIndexName);
+    }
+    const PageId filterPageNo = meta->filterPageNo;
+    const std::uint32_t filterBlocks = meta->filterBlocks;
+    const int filterHashes = meta->filterHashes;
+    const bool filterSaved = meta->filterSaved;
+
+    // Unpin page that was pinned when readPage was called
+    bufMgr->unPinPage(this->file, this->headerPageNum, false);
+
+    // The nodes that were in the pool before a restart are read back in the
+    // background, unless scans are to read them from the file
+    if (!readOnly) this->bufMgr->warmUp(this->file);
+
+    // A filter that was not saved misses the keys inserted since it last was
+    if (filterBlocks > 0) {
+      if (filterSaved) {
+        this->filterBlocks = filterBlocks;
+        this->filterHashes = filterHashes;
+        readFilter(filterPageNo);
+        if (!readOnly) markFilterSaved(false);
+      } else {
+        fillFilter(filterBlocks, filterHashes);
+      }
+    }
+
+  } catch (FileNotFoundException &e) {
+    // If file does not exist, create it and insert entries for every tuple
+    // in the base relation using FileScan class
+    this->file = new BlobFile(outIndexName, true);  // Create new file
+    this->bufMgr->setFileClass(this->file, INDEX_PRIORITY);
+
+    // allocate header page
+    Page *headerPage;
+    this->bufMgr->allocPage(this->file, this->headerPageNum, headerPage);
+
+    // Complete meta information for the header page
+    IndexMetaInfo *meta = (IndexMetaInfo *)headerPage;
+    meta->attrByteOffset = this->attrByteOffset;
+    meta->attrType = attrType;
+    strncpy((char *)(&(meta->relationName)), relationName.c_str(), 20);
+    meta->relationName[19] = 0;
+    meta->freePageNo = Page::INVALID_NUMBER;
+    meta->buildInProgress = buildLog != NULL;
+    meta->numKeyColumns = (int)keyColumns.size();
+    memset(meta->keyColumns, 0, sizeof(meta->keyColumns));
+    std::copy(keyColumns.begin(), keyColumns.end(), meta->keyColumns);
+    meta->filterPageNo = Page::INVALID_NUMBER;
+    meta->filterBlocks = 0;
+    meta->filterHashes = 0;
+    meta->filterSaved = false;
+
+    if (useBulkLoad && buildLog == NULL && fileName == NULL) {
+      // Build the whole tree bottom-up, then record where its root ended up
+      this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+      switch (attrType) {
+        case INTEGER:
+          bulkLoad<int>(relationName, fillFactor, buildThreads);
+          break;
+        case DOUBLE:
+          bulkLoad<double>(relationName, fillFactor, buildThreads);
+          break;
+        case STRING:
+          bulkLoad<StringKey>(relationName, fillFactor, buildThreads);
+          break;
+        case COMPOSITE:
+          bulkLoad<CompositeKey>(relationName, fillFactor, buildThreads);
+          break;
+      }
+
+      this->bufMgr->readPage(this->file, this->headerPageNum, headerPage);
+      meta = (IndexMetaInfo *)headerPage;
+      meta->rootPageNo = this->rootPageNum;
+      this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+      // Save the Index to the file
+      this->bufMgr->flushFile(this->file);
+    } else {
+      Page *rootPage;
+      this->bufMgr->allocPage(this->file, this->rootPageNum, rootPage);
+      meta->rootPageNo = this->rootPageNum;
+
+      // init root
+      switch (attrType) {
+        case INTEGER:
+          initEmptyLeaf<int>(rootPage);
+          break;
+        case DOUBLE:
+          initEmptyLeaf<double>(rootPage);
+          break;
+        case STRING:
+          initEmptyLeaf<StringKey>(rootPage);
+          break;
+        case COMPOSITE:
+          initEmptyLeaf<CompositeKey>(rootPage);
+          break;
+      }
+
+      this->initialRootPageId = this->rootPageNum;
+
+      // Unpin pages, they are no longer needed
+      this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+      this->bufMgr->unPinPage(this->file, this->rootPageNum, true);
+
+      if (buildLog != NULL) {
+        switch (attrType) {
+          case INTEGER:
+            buildOnline<int>(*buildLog);
+            break;
+          case DOUBLE:
+            buildOnline<double>(*buildLog);
+            break;
+          case STRING:
+            buildOnline<StringKey>(*buildLog);
+            break;
+          case COMPOSITE:
+            buildOnline<CompositeKey>(*buildLog);
+            break;
+        }
+      } else if (fileName != NULL) {
+        // Entries come from the caller
+        this->bufMgr->flushFile(this->file);
+      } else {
+        // Insert entries for every tuple in the base relation using FileScan
+        FileScan fileScan(relationName, this->bufMgr);
+        RecordId rid;
+
+        try {
+          // Actually insert the entries in a while loop
+          while (true) {
+            fileScan.scanNext(rid);
+            std::size_t length;
+            const char *record = fileScan.getRecordData(length);
+            this->insertRecord(record, rid);
+          }
+        } catch (EndOfFileException &e) {
+          // Save the Index to the file
+          releaseHotNodes();
+          this->bufMgr->flushFile(this->file);
+        }
+      }
+    }
+  }
+
+  if (readOnly) {
+    // Scans read straight from the file once all of it is on disk
+    this->mappedPages = this->file->mapPages(this->numMappedPages);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+
+/**
+ * BTreeIndex Destructor.
+ * End any initialized scan, flush index file, after unpinning any pinned pages,
+ *from the buffer manager and delete file instance thereby closing the index
+ *file. Destructor should not throw any exceptions. All exceptions should be
+ *caught in here itself.
+ **/
+BTreeIndex::~BTreeIndex() {
+  // No more records are forwarded once the writers get the log's latch back
+  if (this->buildLog != NULL) {
+    std::lock_guard<std::mutex> lock(this->buildLog->latch);
+    this->buildLog->forward = nullptr;
+  }
+
+  flushInserts();
+
+  // Ends any initialized scan, unpinning any pages pinned by it
+  try {
+    this->endScan();
+  } catch (ScanNotInitializedException &e) {
+    // No scan had been initialized so don't need to do anything
+  }
+
+  // Every cursor has been ended, so no scan is left on a retired leaf
+  if (!this->readOnly) freeRetiredNodes();
+
+
+  if (this->mappedPages != NULL) {
+    File::unmapPages(this->mappedPages, this->numMappedPages);
+    this->mappedPages = NULL;
+  }
+
+  releaseHotNodes();
+
+  if (!this->readOnly && this->filterWords) saveFilter();
+
+  // Flushes file, throws error
+  this->bufMgr->flushFile(this->file);
+
+  // Deletes file if necessary
+  if (this->file != NULL) {
+    this->bufMgr->clearFileClass(this->file);
+    delete this->file;
+    this->file = NULL;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+/**
+ * Insert a new entry using the pair <value,rid>.
+ * Start from root to recursively find out the leaf to insert the entry in. The
+ * insertion may cause splitting of leaf node. This splitting will require
+ * addition of new leaf page number entry into the parent non-leaf, which may
+ * in-turn get split. This may continue all the way upto the root causing the
+ * root to get split. If root gets split, metapage needs to be changed
+ * accordingly. Make sure to unpin pages as soon as you can.
+ * @param key            Key to insert, pointer to integer/double/char string
+ * @param rid            Record ID of a record whose entry is getting inserted
+ *into the index.
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+void BTreeIndex::insertEntry(const void *key, const RecordId rid) {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+  OpCount count(this->insertCounters);
+
+  if (this->insertBufferCapacity > 0) {
+    this->insertBufferLatch.lock();
+    switch (this->attributeType) {
+      case INTEGER:
+        bufferKey(KeyTraits<int>::load(key), rid);
+        break;
+      case DOUBLE:
+        bufferKey(KeyTraits<double>::load(key), rid);
+        break;
+      case STRING:
+        bufferKey(KeyTraits<StringKey>::load(key), rid);
+        break;
+      case COMPOSITE:
+        bufferKey(KeyTraits<CompositeKey>::load(key), rid);
+        break;
+    }
+    if (this->bufferedRids.size() >= this->insertBufferCapacity) {
+      flushBuffered();
+    }
+    this->insertBufferLatch.unlock();
+    return;
+  }
+
+  // The nodes one insert changes, splits and all, are logged together
+  LogOperation operation(this->bufMgr);
+  switch (this->attributeType) {
+    case INTEGER:
+      insertKey(KeyTraits<int>::load(key), rid);
+      break;
+    case DOUBLE:
+      insertKey(KeyTraits<double>::load(key), rid);
+      break;
+    case STRING:
+      insertKey(KeyTraits<StringKey>::load(key), rid);
+      break;
+    case COMPOSITE:
+      insertKey(KeyTraits<CompositeKey>::load(key), rid);
+      break;
+  }
+  operation.commit();
+}
+
+/**
+ * A helper method that inserts the entry of a record, as insertEntry() does.
+ *
+ * @param record  The record
+ * @param rid     Record ID of the record
+ */
+void BTreeIndex::insertRecord(const char *record, const RecordId rid) {
+  if (this->attributeType != COMPOSITE) {
+    insertEntry(record + this->attrByteOffset, rid);
+    return;
+  }
+  CompositeKey key;
+  loadRecordKey(record, key);
+  insertEntry(&key, rid);
+}
+
+/**
+ * A helper method that encodes the columns of a record into the key of a
+ * COMPOSITE index.
+ *
+ * @param record  The record
+ * @param key     The key, returned via this reference
+ */
+void BTreeIndex::loadRecordKey(const char *record, CompositeKey &key) const {
+  const void *values[MAX_KEY_COLUMNS];
+  for (std::size_t c = 0; c < this->keyColumns.size(); c++) {
+    values[c] = record + this->keyColumns[c].offset;
+  }
+  encodeKey(values, (int)this->keyColumns.size(), 0, key);
+}
+
+/**
+ * A helper method that inserts a key of the index's type into the index.
+ * insertEntry() dispatches on the attribute type once and calls this.
+ *
+ * @param key     Key to insert
+ * @param rid     Record ID of a record whose entry is getting inserted
+ */
+template <class T>
+void BTreeIndex::insertKey(const T &key, const RecordId rid) {
+  filterAdd(key);
+  RIDKeyPair<T> newEntry;
+  newEntry.set(rid, key);
+  this->staleEntries.fetch_add(1, std::memory_order_relaxed);
+
+  // Most inserts do not split anything, so try with as few exclusive latches as
+  // possible first. Keys that keep growing do not need the tree at all.
+  if (insertAppend(newEntry) || insertOptimistic(newEntry)) return;
+  insertPessimistic(newEntry);
+}
+
+/**
+ * A helper method that appends a data entry to the rightmost leaf if the key
+ * is not less than any in the index. Every such key goes to that leaf, since
+ * its keys are not below its lower bound.
+ *
+ * @param newEntry         Data entry of interest
+ * @return True if the entry was inserted
+ */
+template <class T>
+bool BTreeIndex::insertAppend(const RIDKeyPair<T> newEntry) {
+  PageId pageId = this->rightmostLeaf.load();
+  if (pageId == Page::INVALID_NUMBER) return false;
+
+  // A leaf taken out of the tree stops being the rightmost leaf before its
+  // latch is let go of
+  PageLatch &latch = this->latches.latchFor(pageId);
+  latch.lock();
+  if (this->rightmostLeaf.load() != pageId) {
+    latch.unlock();
+    return false;
+  }
+  Page *page;
+  this->bufMgr->readPage(this->file, pageId, page);
+  threadPagesTouched++;
+  threadDescentDepth++;
+  LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+  const bool appends = leaf->rightSibPageNo == Page::INVALID_NUMBER &&
+                       leaf->numKeys > 0 &&
+                       !(newEntry.key < leaf->getKey(leaf->numKeys - 1));
+  const bool inserted = appends && leaf->hasRoom(newEntry.key, newEntry.rid);
+  if (inserted) {
+    preserveNode(pageId, page);
+    leaf->insertAt(leaf->numKeys, newEntry.key, newEntry.rid);
+  }
+
+  // Inserts that do not append go down the tree until one appends again
+  if (!appends) {
+    this->rightmostLeaf.compare_exchange_strong(pageId, Page::INVALID_NUMBER);
+  }
+  this->bufMgr->unPinPage(this->file, pageId, inserted);
+  latch.unlock();
+  return inserted;
+}
+
+/**
+ * Insert a batch of entries. Entries are sorted by key, and each leaf they go
+ * to takes all of its entries that fit at once.
+ * @param keys           Array of n keys of the index's type: integers,
+ * doubles, or strings of STRINGSIZE characters each
+ * @param rids           Record IDs of the entries
+ * @param n              Number of entries
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+void BTreeIndex::insertBatch(const void *keys, const RecordId *rids,
+                             const std::size_t n) {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+
+  // Buffered entries were inserted first, so they go in first
+  if (this->insertBufferCapacity > 0) {
+    this->insertBufferLatch.lock();
+    flushBuffered();
+    insertSorted(keys, rids, n);
+    this->insertBufferLatch.unlock();
+  } else {
+    insertSorted(keys, rids, n);
+  }
+}
+
+/**
+ * A helper method that inserts a batch of entries into the tree, bypassing
+ * the insert buffer.
+ *
+ * @param keys  Array of n keys of the index's type
+ * @param rids  Record IDs of the entries
+ * @param n     Number of entries
+ */
+void BTreeIndex::insertSorted(const void *keys, const RecordId *rids,
+                              const std::size_t n) {
+  this->staleEntries.fetch_add(n, std::memory_order_relaxed);
+  switch (this->attributeType) {
+    case INTEGER:
+      insertKeys<int>(keys, rids, n);
+      break;
+    case DOUBLE:
+      insertKeys<double>(keys, rids, n);
+      break;
+    case STRING:
+      insertKeys<StringKey>(keys, rids, n);
+      break;
+    case COMPOSITE:
+      insertKeys<CompositeKey>(keys, rids, n);
+      break;
+  }
+}
+
+/**
+ * Turn the write-optimized insert mode on or off.
+ * @param capacity       Number of entries to collect before they are flushed,
+ * or 0 to insert each entry right away
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+void BTreeIndex::setInsertBuffer(const std::size_t capacity) {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+
+  flushInserts();
+  this->insertBufferCapacity = capacity;
+}
+
+/**
+ * Insert the entries the insert buffer has collected into the tree.
+ **/
+void BTreeIndex::flushInserts() {
+  if (this->insertBufferCapacity == 0) return;
+  this->insertBufferLatch.lock();
+  flushBuffered();
+  this->insertBufferLatch.unlock();
+}
+
+/**
+ * A helper method that inserts the entries of the insert buffer into the
+ * tree and empties it, with the buffer's latch held exclusively.
+ */
+void BTreeIndex::flushBuffered() {
+  if (this->bufferedRids.empty()) return;
+  insertSorted(&this->bufferedKeys[0], &this->bufferedRids[0],
+               this->bufferedRids.size());
+  this->bufferedKeys.clear();
+  this->bufferedRids.clear();
+}
+
+/**
+ * A helper method that adds a key of the index's type to the insert buffer.
+ *
+ * @param key     Key to insert
+ * @param rid     Record ID of a record whose entry is getting inserted
+ */
+template <class T>
+void BTreeIndex::bufferKey(const T &key, const RecordId rid) {
+  filterAdd(key);
+  const char *bytes = reinterpret_cast<const char *>(&key);
+  this->bufferedKeys.insert(this->bufferedKeys.end(), bytes,
+                            bytes + sizeof(T));
+  this->bufferedRids.push_back(rid);
+}
+
+/**
+ * A helper method that finds the entries with a key in the insert buffer.
+ *
+ * @param key     Key to look for
+ * @param outRid  If not NULL, receives the RecordId of the first entry
+ * @param outRids If not NULL, the RecordIds of all entries are appended here
+ * @return  True if an entry was found
+ */
+template <class T>
+bool BTreeIndex::findBuffered(const T &key, RecordId *outRid,
+                              std::vector<RecordId> *outRids) {
+  bool found = false;
+  for (std::size_t i = 0; i < this->bufferedRids.size(); i++) {
+    if (!(KeyTraits<T>::load(&this->bufferedKeys[i * sizeof(T)]) == key)) {
+      continue;
+    }
+    found = true;
+    if (outRids == NULL) {
+      *outRid = this->bufferedRids[i];
+      break;
+    }
+    outRids->push_back(this->bufferedRids[i]);
+  }
+  return found;
+}
+
+/**
+ * A helper method that inserts a batch of keys of the index's type.
+ * insertBatch() dispatches on the attribute type once and calls this.
+ *
+ * @param keys  Array of n keys of the index's type
+ * @param rids  Record IDs of the entries
+ * @param n     Number of entries
+ */
+template <class T>
+void BTreeIndex::insertKeys(const void *keys, const RecordId *rids,
+                            const std::size_t n) {
+  std::vector<std::size_t> order(n);
+  std::vector<T> given(n);
+  for (std::size_t i = 0; i < n; i++) {
+    given[i] = KeyTraits<T>::load(static_cast<const char *>(keys) +
+                                  i * sizeof(T));
+    filterAdd(given[i]);
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&given](const std::size_t a, const std::size_t b) {
+                     return given[a] < given[b];
+                   });
+  std::vector<T> sortedKeys(n);
+  std::vector<RecordId> sortedRids(n);
+  for (std::size_t i = 0; i < n; i++) {
+    sortedKeys[i] = given[order[i]];
+    sortedRids[i] = rids[order[i]];
+  }
+
+  std::size_t i = 0;
+  while (i < n) {
+    // The nodes each leaf's run changes are logged together
+    LogOperation operation(this->bufMgr);
+    T fence;
+    bool fenced;
+    Page *page;
+    const PageId pageId =
+        latchLeaf(sortedKeys[i], false, page, &fence, &fenced);
+
+    // The run is the entries with keys below the leaf's fence
+    std::size_t end = i + 1;
+    while (end < n && (!fenced || sortedKeys[end] < fence)) end++;
+    LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+    preserveNode(pageId, page);
+    const std::size_t merged =
+        leaf->insertRun(&sortedKeys[i], &sortedRids[i], (int)(end - i));
+    this->bufMgr->unPinPage(this->file, pageId, merged > 0);
+    this->latches.latchFor(pageId).unlock();
+
+    // A full leaf is split by inserting the next entry on its own
+    if (merged == 0) {
+      RIDKeyPair<T> newEntry;
+      newEntry.set(sortedRids[i], sortedKeys[i]);
+      insertPessimistic(newEntry);
+      i++;
+    } else {
+      i += merged;
+    }
+    operation.commit();
+  }
+}
+
+/**
+ * A helper method that inserts a data entry into a leaf that has room for it.
+ * Non-leaf nodes are latched in shared mode on the way down, each only until
+ * its child is latched, and the leaf exclusively.
+ *
+ * @param newEntry         Data entry of interest
+ * @return True if the entry was inserted, false if the leaf is full
+ */
+template <class T>
+bool BTreeIndex::insertOptimistic(const RIDKeyPair<T> newEntry) {
+  Page *page;
+  const PageId pageId = latchLeaf(newEntry.key, false, page);
+
+  LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+  const bool inserted = leaf->hasRoom(newEntry.key, newEntry.rid);
+  if (inserted) {
+    preserveNode(pageId, page);
+    insertLeaf(leaf, newEntry);
+    if (leaf->rightSibPageNo == Page::INVALID_NUMBER &&
+        !(newEntry.key < leaf->getKey(leaf->numKeys - 1))) {
+      this->rightmostLeaf = pageId;
+    }
+  }
+
+  // Unpinned first, so that the log copies the leaf while it is latched
+  this->bufMgr->unPinPage(this->file, pageId, inserted);
+  this->latches.latchFor(pageId).unlock();
+  return inserted;
+}
+
+/**
+ * A helper method that finds the leaf for key and latches it exclusively.
+ * Non-leaf nodes are latched in shared mode on the way down, each only until
+ * its child is latched.
+ *
+ * @param key    Key to look for
+ * @param first  If true, goes to the leftmost leaf that can hold key, else to
+ * the leaf a new entry with key goes to
+ * @param page   The leaf, pinned, returned via this reference
+ * @return  Page number of the leaf
+ */
+template <class T>
+PageId BTreeIndex::latchLeaf(const T &key, const bool first, Page *&page,
+                             T *fence, bool *fenced) {
+  if (fenced != NULL) *fenced = false;
+  this->rootLatch.lockShared();
+  PageId pageId = this->rootPageNum;
+  bool isLeaf = this->initialRootPageId == pageId;
+  PageLatch *latch = &this->latches.latchFor(pageId);
+  if (isLeaf) {
+    latch->lock();
+  } else {
+    latch->lockShared();
+  }
+  this->rootLatch.unlockShared();
+
+  int depth = 0;
+  bool pinned = true;
+  threadDescentDepth++;
+  if (isLeaf) {
+    this->bufMgr->readPage(this->file, pageId, page);
+    threadPagesTouched++;
+  } else {
+    pinned = readInternal(pageId, depth, page);
+  }
+
+  while (!isLeaf) {
+    NonLeafNode<T> *currNode = reinterpret_cast<NonLeafNode<T> *>(page);
+
+    // Find next node one level down and latch it before letting go of this one
+    PageId nextNodeId;
+    if (first) {
+      nextNodeId = currNode->getChild(currNode->lowerBound(key));
+    } else {
+      findNextInternal(currNode, nextNodeId, key);
+
+      // The separator right of the child bounds the keys going to it, more
+      // tightly than any separator further up
+      const int pos = currNode->upperBound(key);
+      if (fence != NULL && pos < currNode->numKeys) {
+        *fence = currNode->getKey(pos);
+        *fenced = true;
+      }
+    }
+    isLeaf = currNode->level;
+    PageLatch *nextLatch = &this->latches.latchFor(nextNodeId);
+    if (isLeaf) {
+      nextLatch->lock();
+    } else {
+      nextLatch->lockShared();
+    }
+
+    Page *nextPage;
+    bool nextPinned = true;
+    depth++;
+    threadDescentDepth++;
+    if (isLeaf) {
+      this->bufMgr->readPage(this->file, nextNodeId, nextPage);
+      threadPagesTouched++;
+    } else {
+      nextPinned = readInternal(nextNodeId, depth, nextPage);
+    }
+    latch->unlockShared();
+    if (pinned) this->bufMgr->unPinPage(this->file, pageId, false);
+
+    pageId = nextNodeId;
+    page = nextPage;
+    pinned = nextPinned;
+    latch = nextLatch;
+  }
+  return pageId;
+}
+
+/**
+ * A helper method that inserts a data entry into the index, splitting nodes as
+ * needed. Nodes are latched exclusively on the way down, and the latches above
+ * a node that cannot split are released, and their pages unpinned, as soon as
+ * it is latched.
+ *
+ * @param newEntry         Data entry of interest
+ * @throws  BadIndexInfoException  If the tree has more than MAX_TREE_HEIGHT
+ * levels
+ */
+template <class T>
+void BTreeIndex::insertPessimistic(const RIDKeyPair<T> newEntry) {
+  // Pages that may change, from the highest one down to the leaf, pinned and
+  // latched. Each one above the leaf takes a separator if the page below it
+  // splits. The stack lives in the frame, so the descent allocates nothing.
+  PageId pathIds[MAX_TREE_HEIGHT];
+  Page *pathPages[MAX_TREE_HEIGHT];
+  std::size_t pathSize = 0;
+
+  this->rootLatch.lock();
+  bool rootLatched = true;
+  PageId pageId = this->rootPageNum;
+  bool isLeaf = this->initialRootPageId == pageId;
+
+  while (true) {
+    if (pathSize == (std::size_t)MAX_TREE_HEIGHT) {
+      for (std::size_t i = 0; i < pathSize; i++) {
+        this->latches.latchFor(pathIds[i]).unlock();
+        this->bufMgr->unPinPage(this->file, pathIds[i], false);
+      }
+      if (rootLatched) this->rootLatch.unlock();
+      throw BadIndexInfoException(this->file->filename());
+    }
+    this->latches.latchFor(pageId).lock();
+    Page *page;
+    this->bufMgr->readPage(this->file, pageId, page);
+    threadPagesTouched++;
+    threadDescentDepth++;
+    pathIds[pathSize] = pageId;
+    pathPages[pathSize] = page;
+    pathSize++;
+
+    // Nothing above a page that cannot split changes, so the ancestors are
+    // let go of right away rather than when the insert is done
+    const bool safe =
+        isLeaf ? reinterpret_cast<LeafNode<T> *>(page)->hasRoom(newEntry.key,
+                                                                newEntry.rid)
+               : reinterpret_cast<NonLeafNode<T> *>(page)->hasRoomForAnyKey();
+    if (safe) {
+      for (std::size_t i = 0; i + 1 < pathSize; i++) {
+        this->latches.latchFor(pathIds[i]).unlock();
+        this->bufMgr->unPinPage(this->file, pathIds[i], false);
+      }
+      pathIds[0] = pageId;
+      pathPages[0] = page;
+      pathSize = 1;
+      if (rootLatched) {
+        this->rootLatch.unlock();
+        rootLatched = false;
+      }
+    }
+
+    if (isLeaf) break;
+
+    // Find next node one level down
+    NonLeafNode<T> *currNode = reinterpret_cast<NonLeafNode<T> *>(page);
+    findNextInternal(currNode, pageId, newEntry.key);
+    isLeaf = currNode->level;
+  }
+
+  // Insert into the leaf, then push separators up the path as far as needed.
+  // Only the first page of the path can be the root, and only if the root
+  // latch is still held.
+  // The separator of the last split travels up by value, set while pushUp is.
+  PageKeyPair<T> separator;
+  bool pushUp = false;
+  std::size_t depth = pathSize - 1;
+  LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(pathPages[depth]);
+  preserveNode(pathIds[depth], pathPages[depth]);
+  if (leaf->hasRoom(newEntry.key, newEntry.rid)) {
+    insertLeaf(leaf, newEntry);
+    this->bufMgr->unPinPage(this->file, pathIds[depth], true);
+  } else {
+    splitLeaf(leaf, pathIds[depth], rootLatched && depth == 0, separator,
+              newEntry);
+    pushUp = true;
+  }
+
+  while (depth-- > 0) {
+    NonLeafNode<T> *currNode = reinterpret_cast<NonLeafNode<T> *>(pathPages[depth]);
+    if (!pushUp) {
+      this->bufMgr->unPinPage(this->file, pathIds[depth], false);  // Child did not need to be split
+    } else if (currNode->hasRoom(separator.key)) {
+      preserveNode(pathIds[depth], pathPages[depth]);
+      insertInternal(currNode, separator);  // Internal not full so insert
+      pushUp = false;
+      this->bufMgr->unPinPage(this->file, pathIds[depth], true);
+    } else {
+      preserveNode(pathIds[depth], pathPages[depth]);
+      splitInternal(currNode, pathIds[depth], rootLatched && depth == 0,
+                    separator);
+    }
+  }
+
+  for (std::size_t i = 0; i < pathSize; i++) {
+    this->latches.latchFor(pathIds[i]).unlock();
+  }
+  if (rootLatched) this->rootLatch.unlock();
+}
+
+/**
+  * A helper method that finds next node to traverse to down the tree
+  *
+  * @param internal Current node we are on
+  * @param pageId   Return value for the next level page ID
+  * @param key      Key being compared
+ */
+template <class T>
+void BTreeIndex::findNextInternal(NonLeafNode<T> *internal, PageId &pageId, const T &key) {
+  // Child i holds the keys between key i - 1 and key i. Keys equal to a
+  // separator may be on either side, and new ones go to its right, so a new
+  // duplicate always lands after the existing ones.
+  pageId = internal->getChild(internal->upperBound(key));
+}
+
+/**
+ * A helper mehtod that is called when the root node needs to be split
+ *
+ * @param firstPage   pageId of first page in root
+ * @param separator   Separator of the page split off firstPage
+*/
+template <class T>
+void BTreeIndex::splitRoot(PageId firstPage,
+                           const PageKeyPair<T> &separator) {
+  this->rootSplits++;
+  // Create a new root
+  PageId newRootPageNum;
+  Page *newRoot;
+  allocNode(newRootPageNum, newRoot);
+  BADGERDB_TRACE(TRACE_ROOT_SPLIT, firstPage, newRootPageNum);
+  NonLeafNode<T> *newRootPage = reinterpret_cast<NonLeafNode<T> *>(newRoot);
+
+  int level;
+  if (initialRootPageId == this->rootPageNum) {
+    level = 1;
+  } else {
+    level = 0;
+  }
+
+  // update metadata of the root page
+  newRootPage->init(level, firstPage, separator.leftCount);
+  newRootPage->insertAt(0, separator.key, separator.pageNo, separator.count);
+
+  // The free list lives in the meta page too, so it is changed under the meta
+  // page's latch
+  PageLatch &metaLatch = this->latches.latchFor(this->headerPageNum);
+  metaLatch.lock();
+  Page *meta;
+  this->bufMgr->readPage(this->file, this->headerPageNum, meta);
+  threadPagesTouched++;
+  IndexMetaInfo *metaPage = (IndexMetaInfo *)meta;
+  metaPage->rootPageNo = newRootPageNum;
+  this->rootPageNum = newRootPageNum;
+
+  // unpin pages that are no longer needed
+  this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+  metaLatch.unlock();
+  this->bufMgr->unPinPage(this->file, newRootPageNum, true);
+}
+
+/**
+ * A helper method that splits a leaf and copys middle key up the tree.
+ *
+ * @param leaf        Leaf of interest
+ * @param leafPageId  Page Id of leaf of interest
+ * @param isRoot      True if the leaf is the root
+ * @param separator   Set to the separator for the parent
+ * @param newEntry    The new entry of interest
+*/
+template <class T>
+void BTreeIndex::splitLeaf(LeafNode<T> *leaf, PageId leafPageId, bool isRoot,
+                           PageKeyPair<T> &separator,
+                           const RIDKeyPair<T> newEntry) {
+  this->leafSplits++;
+  // Create new leaf
+  PageId newPageId;
+  Page *newPage;
+  allocNode(newPageId, newPage);
+  BADGERDB_TRACE(TRACE_LEAF_SPLIT, leafPageId, newPageId);
+  LeafNode<T> *newLeaf = reinterpret_cast<LeafNode<T> *>(newPage);
+
+  // The old leaf keeps the first half of its entries plus the new entry
+  // (counted as if it had already been inserted), the new leaf the rest. A key
+  // appended at the right edge of the tree goes to the new leaf alone, so that
+  // increasing keys leave every leaf full.
+  newLeaf->init();
+  const int pos = leaf->upperBound(newEntry.key);
+  const bool appends =
+      leaf->rightSibPageNo == Page::INVALID_NUMBER && pos == leaf->numKeys;
+  if (appends) {
+    newLeaf->insertAt(0, newEntry.key, newEntry.rid);
+  } else {
+    leaf->splitInto(*newLeaf, pos, newEntry.key, newEntry.rid);
+  }
+
+  // Update sibling pointers. The new leaf needs no latch: scans only reach it
+  // through the old leaf and inserts through the parent, both still latched,
+  // or through the left link of the old right sibling, set once it is done.
+  newLeaf->rightSibPageNo = leaf->rightSibPageNo;
+  newLeaf->leftSibPageNo = leafPageId;
+  leaf->rightSibPageNo = newPageId;
+  if (newLeaf->rightSibPageNo != Page::INVALID_NUMBER) {
+    setLeftSib<T>(newLeaf->rightSibPageNo, newPageId);
+  }
+
+  // Copy up a separator between the two leaves to the parent, the smallest key
+  // of the new leaf or something shorter
+  separator.set(newPageId,
+                KeyTraits<T>::separator(leaf->getKey(leaf->numKeys - 1),
+                                        newLeaf->getKey(0)));
+  separator.count = newLeaf->numKeys;
+  separator.leftCount = leaf->numKeys;
+
+  if (isRoot) splitRoot(leafPageId, separator); // Leaf is the root
+
+  this->bufMgr->unPinPage(this->file, leafPageId, true);
+  this->bufMgr->unPinPage(this->file, newPageId, true);
+
+  // Appends go straight to the new leaf from now on, even before the parent
+  // has its separator. Searches that reach the old leaf meanwhile move right.
+  if (appends) this->rightmostLeaf = newPageId;
+}
+
+/**
+ * A helper method that points the left sibling link of a leaf at another leaf.
+ *
+ * @param pageNo     Page number of the leaf
+ * @param leftSibNo  Page number of its new left sibling
+ */
+template <class T>
+void BTreeIndex::setLeftSib(const PageId pageNo, const PageId leftSibNo) {
+  PageLatch &latch = this->latches.latchFor(pageNo);
+  latch.lock();
+  Page *page;
+  this->bufMgr->readPage(this->file, pageNo, page);
+  threadPagesTouched++;
+  reinterpret_cast<LeafNode<T> *>(page)->leftSibPageNo = leftSibNo;
+  this->bufMgr->unPinPage(this->file, pageNo, true);
+  latch.unlock();
+}
+
+/**
+  * A helper method that inserts a data entry into a leaf
+  * @param leaf     Leaf of interest
+  * @param newEntry Entry of interest
+  */
+template <class T>
+void BTreeIndex::insertLeaf(LeafNode<T> *leaf, const RIDKeyPair<T> newEntry) {
+  // Insert after any equal keys so duplicates stay in insertion order
+  leaf->insertAt(leaf->upperBound(newEntry.key), newEntry.key, newEntry.rid);
+}
+
+/**
+  * A helper method that inserts splits an internal node and pushes the middle key upwards. Can recursively
+  * propagate up the tree
+  *
+  * @param oldNode         The internal node that's being split
+  * @param oldPageId       The page id of the internal node that's being split
+  * @param isRoot          True if the internal node is the root
+  * @param separator       Separator of the child that split, replaced by the
+  *                        one pushed up
+ */
+template <class T>
+void BTreeIndex::splitInternal(NonLeafNode<T> *oldNode, PageId oldPageId,
+                               bool isRoot, PageKeyPair<T> &separator) {
+  this->internalSplits++;
+  // Allocate a new internal node
+  PageId newPageId;
+  Page *newPage;
+
+  allocNode(newPageId, newPage);
+  BADGERDB_TRACE(TRACE_INTERNAL_SPLIT, oldPageId, newPageId);
+  NonLeafNode<T> *newNode = reinterpret_cast<NonLeafNode<T> *>(newPage);
+
+  // Split the node as if the new entry had already been inserted: the first
+  // half of the keys stay, the middle key is pushed up and the rest move to
+  // newNode. The child that split is right before the new entry.
+  T pushupKey;
+  const int pos = oldNode->upperBound(separator.key);
+  oldNode->setCount(pos, separator.leftCount);
+  oldNode->splitInto(*newNode, pos, separator.key, separator.pageNo,
+                     separator.count, pushupKey);
+  separator.set(newPageId, pushupKey);
+  separator.count = newNode->totalCount();
+  separator.leftCount = oldNode->totalCount();
+
+  if (isRoot) splitRoot(oldPageId, separator); // currNode is the root
+
+  this->bufMgr->unPinPage(this->file, oldPageId, true);
+  this->bufMgr->unPinPage(this->file, newPageId, true);
+}
+
+/**
+ * A helper method that inserts a data entry into an internal node
+ *
+ * @param internal The internal node of interest
+ * @param entry    The entry of interest
+ *
+ */
+template <class T>
+void BTreeIndex::insertInternal(NonLeafNode<T> *internal,
+                                const PageKeyPair<T> &newEntry) {
+  // The new page holds keys from newEntry.key up, so it goes right after it
+  // and after the page it was split off from
+  const int pos = internal->upperBound(newEntry.key);
+  internal->setCount(pos, newEntry.leftCount);
+  internal->insertAt(pos, newEntry.key, newEntry.pageNo, newEntry.count);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+/**
+ * Delete the entry <key,rid>. Of several equal entries only one is deleted.
+ * The leaf it was in stays in the tree even if it is left empty, until
+ * compact() takes it out.
+ * @param key            Key of the entry, pointer to integer/double/char string
+ * @param rid            Record ID of the entry
+ * @return True if the entry was found and deleted
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+bool BTreeIndex::deleteEntry(const void *key, const RecordId rid) {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+  flushInserts();
+
+  LogOperation operation(this->bufMgr);
+  bool deleted = false;
+  switch (this->attributeType) {
+    case INTEGER:
+      deleted = deleteKey(KeyTraits<int>::load(key), rid);
+      break;
+    case DOUBLE:
+      deleted = deleteKey(KeyTraits<double>::load(key), rid);
+      break;
+    case STRING:
+      deleted = deleteKey(KeyTraits<StringKey>::load(key), rid);
+      break;
+    case COMPOSITE:
+      deleted = deleteKey(KeyTraits<CompositeKey>::load(key), rid);
+      break;
+  }
+  operation.commit();
+  return deleted;
+}
+
+/**
+ * Change the key of the entry <oldKey,rid> to newKey, deleting it and
+ * inserting it again in one logged operation.
+ * @param oldKey         Key the entry has
+ * @param newKey         Key the entry is to have
+ * @param rid            Record ID of the entry
+ * @return True if the entry was found
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+bool BTreeIndex::updateEntry(const void *oldKey, const void *newKey,
+                             const RecordId rid) {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+  flushInserts();
+
+  LogOperation operation(this->bufMgr);
+  bool found = false;
+  switch (this->attributeType) {
+    case INTEGER:
+      found = deleteKey(KeyTraits<int>::load(oldKey), rid);
+      if (found) insertKey(KeyTraits<int>::load(newKey), rid);
+      break;
+    case DOUBLE:
+      found = deleteKey(KeyTraits<double>::load(oldKey), rid);
+      if (found) insertKey(KeyTraits<double>::load(newKey), rid);
+      break;
+    case STRING:
+      found = deleteKey(KeyTraits<StringKey>::load(oldKey), rid);
+      if (found) insertKey(KeyTraits<StringKey>::load(newKey), rid);
+      break;
+    case COMPOSITE:
+      found = deleteKey(KeyTraits<CompositeKey>::load(oldKey), rid);
+      if (found) insertKey(KeyTraits<CompositeKey>::load(newKey), rid);
+      break;
+  }
+  operation.commit();
+  return found;
+}
+
+/**
+ * A helper method that deletes an entry with a key of the index's type.
+ * deleteEntry() dispatches on the attribute type once and calls this.
+ *
+ * @param key     Key of the entry
+ * @param rid     Record ID of the entry
+ * @return  True if the entry was found and deleted
+ */
+template <class T>
+bool BTreeIndex::deleteKey(const T &key, const RecordId rid) {
+  // Entries with the key start in the leftmost leaf that can hold it, and may
+  // go on through its right siblings
+  Page *page;
+  PageId pageId = latchLeaf(key, true, page);
+  while (true) {
+    LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+    const int end = leaf->upperBound(key);
+    for (int i = leaf->lowerBound(key); i < end; i++) {
+      if (leaf->getRid(i) == rid) {
+        preserveNode(pageId, page);
+        leaf->removeAt(i);
+        this->staleEntries.fetch_add(1, std::memory_order_relaxed);
+        this->bufMgr->unPinPage(this->file, pageId, true);
+        this->latches.latchFor(pageId).unlock();
+        return true;
+      }
+    }
+
+    // A greater key in this leaf means no entry with the key is further right
+    const PageId nextId = leaf->rightSibPageNo;
+    if (end < leaf->numKeys || nextId == Page::INVALID_NUMBER) {
+      this->bufMgr->unPinPage(this->file, pageId, false);
+      this->latches.latchFor(pageId).unlock();
+      return false;
+    }
+
+    PageLatch &nextLatch = this->latches.latchFor(nextId);
+    nextLatch.lock();
+    Page *nextPage;
+    this->bufMgr->readPage(this->file, nextId, nextPage);
+    this->bufMgr->unPinPage(this->file, pageId, false);
+    this->latches.latchFor(pageId).unlock();
+    pageId = nextId;
+    page = nextPage;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compact
+// -----------------------------------------------------------------------------
+
+/**
+ * Take the empty leaves out of the tree, while other threads go on using it.
+ * @return Number of leaves taken out of the tree
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+std::size_t BTreeIndex::compact() {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+  flushInserts();
+
+  std::size_t reclaimed = 0;
+  switch (this->attributeType) {
+    case INTEGER:
+      reclaimed = compactKey<int>();
+      break;
+    case DOUBLE:
+      reclaimed = compactKey<double>();
+      break;
+    case STRING:
+      reclaimed = compactKey<StringKey>();
+      break;
+    case COMPOSITE:
+      reclaimed = compactKey<CompositeKey>();
+      break;
+  }
+  freeRetiredNodes();
+  return reclaimed;
+}
+
+/**
+ * A helper method that makes one compaction pass for the index's key type.
+ *
+ * @return  Number of leaves taken out of the tree
+ */
+template <class T>
+std::size_t BTreeIndex::compactKey() {
+  std::size_t reclaimed = 0;
+
+  // Parents of leaves are found one after another by going down from the root
+  // to the first one whose keys are not below the fence. The first separator
+  // right of the path on the way down to a parent is the next fence.
+  bool haveFence = false;
+  T fence = T();
+  while (true) {
+    this->rootLatch.lockShared();
+    PageId pageId = this->rootPageNum;
+    if (pageId == this->initialRootPageId) {
+      // A tree of a single leaf has no parent of leaves
+      this->rootLatch.unlockShared();
+      return reclaimed;
+    }
+    PageLatch *latch = &this->latches.latchFor(pageId);
+    latch->lockShared();
+    this->rootLatch.unlockShared();
+
+    Page *page;
+    this->bufMgr->readPage(this->file, pageId, page);
+    NonLeafNode<T> *parent = reinterpret_cast<NonLeafNode<T> *>(page);
+    bool haveNext = false;
+    T next = T();
+    while (!parent->level) {
+      const int i = haveFence ? parent->upperBound(fence) : 0;
+      if (i < parent->numKeys) {
+        haveNext = true;
+        next = parent->getKey(i);
+      }
+
+      const PageId childId = parent->getChild(i);
+      PageLatch *childLatch = &this->latches.latchFor(childId);
+      childLatch->lockShared();
+      Page *childPage;
+      this->bufMgr->readPage(this->file, childId, childPage);
+      latch->unlockShared();
+      this->bufMgr->unPinPage(this->file, pageId, false);
+
+      pageId = childId;
+      page = childPage;
+      latch = childLatch;
+      parent = reinterpret_cast<NonLeafNode<T> *>(page);
+    }
+
+    // Trade the shared latch for an exclusive one, and go down again if the
+    // parent changed in between
+    const std::uint32_t version = latch->getVersion();
+    latch->unlockShared();
+    latch->lock();
+    if (latch->getVersion() != version) {
+      this->bufMgr->unPinPage(this->file, pageId, false);
+      latch->unlock();
+      continue;
+    }
+
+    // Walk the leaves left to right, each latched exclusively along with the
+    // one left of it. The first child has no left sibling under this parent,
+    // so it stays even if empty. The parent's counts of the leaves that stay
+    // are brought up to date on the way.
+    PageId leftId = parent->getChild(0);
+    PageLatch *leftLatch = &this->latches.latchFor(leftId);
+    leftLatch->lock();
+    Page *leftPage;
+    this->bufMgr->readPage(this->file, leftId, leftPage);
+    bool leftDirty = false;
+    bool parentDirty = false;
+    const int firstCount = reinterpret_cast<LeafNode<T> *>(leftPage)->numKeys;
+    if (parent->getCount(0) != (std::uint32_t)firstCount) {
+      parent->setCount(0, firstCount);
+      parentDirty = true;
+    }
+    int i = 1;
+    while (i <= parent->numKeys) {
+      const PageId childId = parent->getChild(i);
+      PageLatch *childLatch = &this->latches.latchFor(childId);
+      childLatch->lock();
+      Page *childPage;
+      this->bufMgr->readPage(this->file, childId, childPage);
+
+      LeafNode<T> *left = reinterpret_cast<LeafNode<T> *>(leftPage);
+      LeafNode<T> *child = reinterpret_cast<LeafNode<T> *>(childPage);
+      if (child->numKeys == 0 && left->rightSibPageNo == childId) {
+        // The parent is logged before the left sibling, so after a crash the
+        // leaf is at worst still on the chain, empty, and never only in the
+        // parent. It keeps its own right sibling for scans still on it.
+        preserveNode(pageId, page);
+        preserveNode(leftId, leftPage);
+        parent->removeAt(i - 1);
+        touchNode(pageId);
+        left->rightSibPageNo = child->rightSibPageNo;
+        if (child->rightSibPageNo != Page::INVALID_NUMBER) {
+          setLeftSib<T>(child->rightSibPageNo, leftId);
+        }
+        PageId rightmost = childId;
+        this->rightmostLeaf.compare_exchange_strong(rightmost,
+                                                    Page::INVALID_NUMBER);
+        leftDirty = true;
+        this->bufMgr->unPinPage(this->file, childId, false);
+        childLatch->unlock();
+        {
+          std::lock_guard<std::mutex> lock(this->retiredLatch);
+          this->retiredNodes.push_back(childId);
+        }
+        reclaimed++;
+      } else {
+        if (parent->getCount(i) != (std::uint32_t)child->numKeys) {
+          parent->setCount(i, child->numKeys);
+          parentDirty = true;
+        }
+        this->bufMgr->unPinPage(this->file, leftId, leftDirty);
+        leftLatch->unlock();
+        leftId = childId;
+        leftPage = childPage;
+        leftLatch = childLatch;
+        leftDirty = false;
+        i++;
+      }
+    }
+    this->bufMgr->unPinPage(this->file, leftId, leftDirty);
+    leftLatch->unlock();
+    this->bufMgr->unPinPage(this->file, pageId, parentDirty);
+    latch->unlock();
+
+    if (!haveNext) return reclaimed;
+    fence = next;
+    haveFence = true;
+  }
+}
+
+/**
+ * A helper method that allocates a page for a new node, taking it off the free
+ * list if there is one there. The page is zero if it was free.
+ *
+ * @param pageNo  Number of the page, returned via this reference
+ * @param page    The page, pinned, returned via this reference
+ */
+void BTreeIndex::allocNode(PageId &pageNo, Page *&page) {
+  PageLatch &metaLatch = this->latches.latchFor(this->headerPageNum);
+  metaLatch.lock();
+  Page *metaPage;
+  this->bufMgr->readPage(this->file, this->headerPageNum, metaPage);
+  IndexMetaInfo *meta = reinterpret_cast<IndexMetaInfo *>(metaPage);
+  pageNo = meta->freePageNo;
+  const bool reused = pageNo != Page::INVALID_NUMBER;
+  if (reused) {
+    this->bufMgr->readPage(this->file, pageNo, page);
+    FreeNode *node = reinterpret_cast<FreeNode *>(page);
+    meta->freePageNo = node->nextFreePageNo;
+    node->nextFreePageNo = Page::INVALID_NUMBER;
+  }
+  this->bufMgr->unPinPage(this->file, this->headerPageNum, reused);
+  metaLatch.unlock();
+
+  if (!reused) this->bufMgr->allocPage(this->file, pageNo, page);
+  threadPagesTouched += 2;  // The meta page and the new node
+}
+
+/**
+ * A helper method that puts the retired leaves on the free list if no scan is
+ * open.
+ */
+void BTreeIndex::freeRetiredNodes() {
+  std::vector<PageId> freed;
+  {
+    std::lock_guard<std::mutex> lock(this->retiredLatch);
+    if (this->openScans.load() > 0) return;
+    freed.swap(this->retiredNodes);
+  }
+  if (freed.empty()) return;
+
+  PageLatch &metaLatch = this->latches.latchFor(this->headerPageNum);
+  metaLatch.lock();
+  Page *metaPage;
+  this->bufMgr->readPage(this->file, this->headerPageNum, metaPage);
+  IndexMetaInfo *meta = reinterpret_cast<IndexMetaInfo *>(metaPage);
+  for (std::size_t i = 0; i < freed.size(); i++) {
+    // Each node is logged before the meta page that points to it
+    PageLatch &latch = this->latches.latchFor(freed[i]);
+    latch.lock();
+    Page *page;
+    this->bufMgr->readPage(this->file, freed[i], page);
+    memset(reinterpret_cast<char *>(page), 0, Page::SIZE);
+    reinterpret_cast<FreeNode *>(page)->nextFreePageNo = meta->freePageNo;
+    this->bufMgr->unPinPage(this->file, freed[i], true);
+    latch.unlock();
+    meta->freePageNo = freed[i];
+  }
+  this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+  metaLatch.unlock();
+}
+
+/**
+ * A helper method that marks a page the caller has pinned dirty now, so that
+ * the log gets its image before the pages unpinned after it.
+ *
+ * @param pageNo  Number of the page
+ */
+void BTreeIndex::touchNode(const PageId pageNo) {
+  Page *page;
+  this->bufMgr->readPage(this->file, pageNo, page);
+  this->bufMgr->unPinPage(this->file, pageNo, true);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::bulkLoad
+// -----------------------------------------------------------------------------
+
+namespace {
+
+/**
+ * Number of (key, rid) pairs stored in one page of a sorted run.
+ */
+template <class T>
+struct RunPage {
+  static const std::size_t PAIRS = Page::SIZE / sizeof(RIDKeyPair<T>);
+};
+
+template <class T>
+const std::size_t RunPage<T>::PAIRS;
+
+/**
+ * Number of samples taken from every run per range the merged order is split
+ * into. More samples make the ranges closer to equal in size.
+ */
+const std::size_t SAMPLES_PER_PARTITION = 16;
+
+/**
+ * Calls fn(i) for every i in [0, n), each on a thread of its own, and rethrows
+ * the first exception any of them threw once all of them have returned.
+ */
+template <class Function>
+void runOnThreads(const std::size_t n, const Function &fn) {
+  if (n == 1) {
+    fn(0);
+    return;
+  }
+
+  std::mutex failureLatch;
+  std::exception_ptr failure;
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < n; i++) {
+    threads.push_back(std::thread([&fn, &failureLatch, &failure, i]() {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(failureLatch);
+        if (!failure) failure = std::current_exception();
+      }
+    }));
+  }
+  for (std::size_t i = 0; i < threads.size(); i++) threads[i].join();
+  if (failure) std::rethrow_exception(failure);
+}
+
+/**
+ * Sorted runs of (key, rid) pairs. Either all runs are consecutive ranges of
+ * entries held in memory, or all of them were spilled to consecutive pages of
+ * a temporary file.
+ */
+template <class T>
+struct SortedRuns {
+  SortedRuns() : file(NULL) {}
+
+  /**
+   * Removes the run file, also when the build is given up on an exception.
+   */
+  ~SortedRuns() { removeFile(); }
+
+  /**
+   * Closes and removes the run file, if the runs were spilled to one.
+   */
+  void removeFile() {
+    if (file == NULL) return;
+    const std::string name = file->filename();
+    delete file;
+    file = NULL;
+    try {
+      File::remove(name);
+    } catch (FileNotFoundException &e) {
+    }
+  }
+
+  /**
+   * Entries of the runs held in memory.
+   */
+  std::vector<RIDKeyPair<T> > entries;
+
+  /**
+   * Temporary file holding the spilled runs, or NULL if they are in memory.
+   */
+  File *file;
+
+  /**
+   * First entry (in memory) or first page (spilled) of every run, and the
+   * number of entries in it.
+   */
+  std::vector<std::size_t> start;
+  std::vector<std::size_t> length;
+
+  /**
+   * Returns entry i of run r. Pages of spilled runs are read into scratch.
+   */
+  RIDKeyPair<T> at(const std::size_t r, const std::size_t i,
+                   Page &scratch) const {
+    if (file == NULL) return entries[start[r] + i];
+
+    file->readPage((PageId)(start[r] + i / RunPage<T>::PAIRS), scratch);
+    RIDKeyPair<T> entry;
+    memcpy(&entry,
+           reinterpret_cast<char *>(&scratch) +
+               (i % RunPage<T>::PAIRS) * sizeof(RIDKeyPair<T>),
+           sizeof(RIDKeyPair<T>));
+    return entry;
+  }
+
+ private:
+  SortedRuns(const SortedRuns &);
+  SortedRuns &operator=(const SortedRuns &);
+};
+
+/**
+ * Appends a sorted run to the run file as consecutive pages.
+ *
+ * @param runs  Runs spilled so far, with the run file open
+ * @param run   Sorted entries of the run
+ */
+template <class T>
+void spillRun(SortedRuns<T> &runs, const std::vector<RIDKeyPair<T> > &run) {
+  for (std::size_t i = 0; i < run.size(); i += RunPage<T>::PAIRS) {
+    PageId pageNo;
+    Page page = runs.file->allocatePage(pageNo);
+    if (i == 0) runs.start.push_back(pageNo);
+
+    std::size_t count = std::min(RunPage<T>::PAIRS, run.size() - i);
+    memcpy(reinterpret_cast<char *>(&page), &run[i],
+           count * sizeof(RIDKeyPair<T>));
+    runs.file->writePage(pageNo, page);
+  }
+  runs.length.push_back(run.size());
+}
+
+/**
+ * Read position inside a range of one sorted run during a k-way merge. Spilled
+ * runs are read one page at a time.
+ */
+template <class T>
+class RunCursor {
+ public:
+  /**
+   * @param runs  Runs being merged
+   * @param run   Run to read
+   * @param begin First entry of the range
+   * @param end   Entry just past the range
+   */
+  RunCursor(const SortedRuns<T> &runs, const std::size_t run,
+            const std::size_t begin, const std::size_t end)
+      : runs(&runs),
+        run(run),
+        next(begin),
+        end(end),
+        loadedPageNo(Page::INVALID_NUMBER) {
+    if (next < end) load();
+  }
+
+  /**
+   * Returns true once every entry of the range has been read.
+   */
+  bool done() const { return next == end; }
+
+  /**
+   * Returns the current entry. Only valid while not done.
+   */
+  const RIDKeyPair<T> &current() const { return entry; }
+
+  /**
+   * Moves on to the next entry of the range.
+   */
+  void advance() {
+    if (++next < end) load();
+  }
+
+ private:
+  void load() {
+    if (runs->file == NULL) {
+      entry = runs->entries[runs->start[run] + next];
+      return;
+    }
+
+    const PageId pageNo =
+        (PageId)(runs->start[run] + next / RunPage<T>::PAIRS);
+    if (pageNo != loadedPageNo) {
+      runs->file->readPage(pageNo, page);
+      loadedPageNo = pageNo;
+    }
+    memcpy(&entry,
+           reinterpret_cast<char *>(&page) +
+               (next % RunPage<T>::PAIRS) * sizeof(RIDKeyPair<T>),
+           sizeof(RIDKeyPair<T>));
+  }
+
+  const SortedRuns<T> *runs;
+  std::size_t run;
+  std::size_t next;
+  std::size_t end;
+
+  /**
+   * Page of a spilled run holding the current entry.
+   */
+  Page page;
+  PageId loadedPageNo;
+
+  RIDKeyPair<T> entry;
+};
+
+/**
+ * Smallest unmerged entry of a run. Ordered so that a std::priority_queue
+ * returns the smallest entry first.
+ */
+template <class T>
+struct RunHead {
+  RIDKeyPair<T> entry;
+  std::size_t run;
+  bool operator<(const RunHead &other) const { return other.entry < entry; }
+};
+
+/**
+ * Packs a sorted stream of entries into linked leaves. A leaf stays pinned
+ * only until the next one is allocated and its sibling pointer is set, so the
+ * buffer manager writes every leaf once.
+ */
+template <class T>
+class LeafLevelWriter {
+ public:
+  /**
+   * @param bufMgr  Buffer manager of the index
+   * @param file    Index file
+   * @param fillFactor Fraction of each leaf to fill
+   * @param nodes   Receives the separator key and page of every leaf written
+   */
+  LeafLevelWriter(BufMgr *bufMgr, File *file, const double fillFactor,
+                  std::vector<PageKeyPair<T> > &nodes)
+      : bufMgr(bufMgr),
+        file(file),
+        fillFactor(fillFactor),
+        nodes(nodes),
+        leaf(NULL),
+        leafPageNo(Page::INVALID_NUMBER),
+        reservedPage(NULL),
+        reservedPageNo(Page::INVALID_NUMBER),
+        last() {}
+
+  /**
+   * Makes a page allocated and pinned by the caller the first leaf written,
+   * instead of a newly allocated one.
+   */
+  void reserve(const PageId pageNo, Page *page) {
+    reservedPage = page;
+    reservedPageNo = pageNo;
+  }
+
+  /**
+   * Appends the next entry in sorted order.
+   */
+  void append(const RIDKeyPair<T> &entry) {
+    if (leaf == NULL || !leaf->hasRoom(entry.key, entry.rid, fillFactor)) {
+      nextLeaf(entry.key);
+    }
+    leaf->insertAt(leaf->numKeys, entry.key, entry.rid);
+  }
+
+  /**
+   * Unpins the last leaf. An empty stream still produces one empty leaf to
+   * serve as the root.
+   *
+   * @param rightSibPageNo  Leaf the last leaf links to, if the stream is one
+   * range of a leaf level written by several writers
+   */
+  void finish(const PageId rightSibPageNo = Page::INVALID_NUMBER) {
+    if (leaf == NULL) nextLeaf(T());
+    if (leaf->numKeys > 0) last = leaf->getKey(leaf->numKeys - 1);
+    nodes.back().count = leaf->numKeys;
+    leaf->rightSibPageNo = rightSibPageNo;
+    bufMgr->unPinPage(file, leafPageNo, true);
+    leaf = NULL;
+  }
+
+  /**
+   * Returns the last key written. Only valid after finish().
+   */
+  const T &lastKey() const { return last; }
+
+ private:
+  void nextLeaf(const T &firstKey) {
+    PageId newPageNo;
+    Page *newPage;
+    if (reservedPage != NULL) {
+      newPageNo = reservedPageNo;
+      newPage = reservedPage;
+      reservedPage = NULL;
+    } else {
+      bufMgr->allocPage(file, newPageNo, newPage);
+    }
+    LeafNode<T> *newLeaf = reinterpret_cast<LeafNode<T> *>(newPage);
+    newLeaf->init();
+
+    PageKeyPair<T> node;
+    if (leaf != NULL) {
+      node.set(newPageNo, KeyTraits<T>::separator(
+                              leaf->getKey(leaf->numKeys - 1), firstKey));
+      nodes.back().count = leaf->numKeys;
+      leaf->rightSibPageNo = newPageNo;
+      newLeaf->leftSibPageNo = leafPageNo;
+      bufMgr->unPinPage(file, leafPageNo, true);
+    } else {
+      node.set(newPageNo, firstKey);
+    }
+    nodes.push_back(node);
+
+    leaf = newLeaf;
+    leafPageNo = newPageNo;
+  }
+
+  BufMgr *bufMgr;
+  File *file;
+  const double fillFactor;
+  std::vector<PageKeyPair<T> > &nodes;
+  LeafNode<T> *leaf;
+  PageId leafPageNo;
+  Page *reservedPage;
+  PageId reservedPageNo;
+  T last;
+};
+
+/**
+ * Merges entries [begin[r], end[r]) of every run r and appends them to the
+ * writer in sorted order.
+ */
+template <class T>
+void mergeRuns(const SortedRuns<T> &runs, const std::vector<std::size_t> &begin,
+               const std::vector<std::size_t> &end,
+               LeafLevelWriter<T> &writer) {
+  std::vector<RunCursor<T> > cursors;
+  std::priority_queue<RunHead<T> > heads;
+  for (std::size_t r = 0; r < runs.start.size(); r++) {
+    cursors.push_back(RunCursor<T>(runs, r, begin[r], end[r]));
+    if (cursors[r].done()) continue;
+
+    RunHead<T> head;
+    head.entry = cursors[r].current();
+    head.run = r;
+    heads.push(head);
+  }
+
+  while (!heads.empty()) {
+    RunHead<T> head = heads.top();
+    heads.pop();
+    writer.append(head.entry);
+
+    RunCursor<T> &cursor = cursors[head.run];
+    cursor.advance();
+    if (cursor.done()) continue;  // Range of the run exhausted
+    head.entry = cursor.current();
+    heads.push(head);
+  }
+}
+
+/**
+ * Splits the merged order of the runs into numParts ranges of about equal
+ * size, cut at splitter entries picked from evenly spaced samples of the runs.
+ * Entries that compare equal always end up in the same range.
+ *
+ * @param runs      Runs to split, holding at least one entry
+ * @param numParts  Number of ranges
+ * @param bounds    Receives numParts + 1 rows, where bounds[p][r] is the
+ * first entry of run r in range p, and bounds[numParts][r] the length of run r
+ */
+template <class T>
+void partitionRuns(const SortedRuns<T> &runs, const std::size_t numParts,
+                   std::vector<std::vector<std::size_t> > &bounds) {
+  const std::size_t numRuns = runs.start.size();
+  bounds.assign(numParts + 1, std::vector<std::size_t>(numRuns, 0));
+  bounds[numParts] = runs.length;
+  if (numParts == 1) return;
+
+  Page scratch;
+  std::vector<RIDKeyPair<T> > samples;
+  const std::size_t perRun = SAMPLES_PER_PARTITION * numParts;
+  for (std::size_t r = 0; r < numRuns; r++) {
+    if (runs.length[r] == 0) continue;
+    for (std::size_t s = 0; s < perRun; s++) {
+      samples.push_back(runs.at(r, runs.length[r] * s / perRun, scratch));
+    }
+  }
+  std::sort(samples.begin(), samples.end());
+
+  for (std::size_t p = 1; p < numParts; p++) {
+    const RIDKeyPair<T> splitter = samples[samples.size() * p / numParts];
+    for (std::size_t r = 0; r < numRuns; r++) {
+      // First entry of the run not less than the splitter
+      std::size_t low = bounds[p - 1][r];
+      std::size_t high = runs.length[r];
+      while (low < high) {
+        const std::size_t mid = low + (high - low) / 2;
+        if (runs.at(r, mid, scratch) < splitter) {
+          low = mid + 1;
+        } else {
+          high = mid;
+        }
+      }
+      bounds[p][r] = low;
+    }
+  }
+}
+
+}  // namespace
+
+/**
+ * A helper method that builds the tree bottom-up from every tuple in the base
+ * relation on several threads. A ParallelFileScan collects the (key, rid)
+ * pairs, spilling sorted runs to a temporary file when they do not fit in half
+ * of the buffer pool, or else sorting them as one run per thread. The merged
+ * order of the runs is split into one range per thread, and every thread
+ * merges its range into a part of the leaf level. The parts are linked through
+ * their first leaves, which are allocated up front, and the non-leaf levels
+ * are built on top. Every node is written exactly once.
+ *
+ * @param relationName Name of the base relation
+ * @param fillFactor   Fraction of each node to fill, in (0, 1]
+ * @param numThreads   Number of threads to build with, one per core if 0
+ */
+template <class T>
+void BTreeIndex::bulkLoad(const std::string &relationName,
+                          const double fillFactor,
+                          const std::size_t numThreads) {
+  // Every thread keeps a few pages pinned, so a small pool takes fewer of them
+  std::size_t threads = numThreads;
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<std::size_t>(
+      threads, std::max<std::size_t>(1, this->bufMgr->getNumBufs() / 4));
+
+  // Keep half of the pool free for the pages of the tree being built
+  const std::size_t runCapacity =
+      std::max<std::size_t>(1, this->bufMgr->getNumBufs() / 2) *
+      RunPage<T>::PAIRS;
+
+  SortedRuns<T> runs;
+  std::vector<RIDKeyPair<T> > run;
+  std::mutex runLatch;    // Protects run
+  std::mutex spillLatch;  // Protects runs while the relation is scanned
+  const std::string runFileName = this->file->filename() + ".sort";
+
+  {
+    // The worker that fills up the run sorts and spills it, while the others
+    // go on collecting the next one
+    ParallelFileScan scan(relationName, this->bufMgr, threads);
+    scan.run([&](const RecordBatch &batch) {
+      std::vector<RIDKeyPair<T> > entries(batch.rids.size());
+      T key;
+      for (std::size_t i = 0; i < entries.size(); i++) {
+        loadRecordKey(batch.records[i], key);
+        entries[i].set(batch.rids[i], key);
+      }
+
+      std::vector<RIDKeyPair<T> > full;
+      {
+        std::lock_guard<std::mutex> lock(runLatch);
+        run.insert(run.end(), entries.begin(), entries.end());
+        if (run.size() >= runCapacity) full.swap(run);
+      }
+      if (full.empty()) return;
+
+      std::sort(full.begin(), full.end());
+      std::lock_guard<std::mutex> lock(spillLatch);
+      if (runs.file == NULL) {
+        try {
+          File::remove(runFileName);  // Left over from a crashed build
+        } catch (FileNotFoundException &e) {
+        }
+        runs.file = new BlobFile(runFileName, true);
+      }
+      spillRun(runs, full);
+    });
+  }
+
+  if (runs.file == NULL) {
+    // Everything fit in memory, so it is sorted in place as one run per thread
+    runs.entries.swap(run);
+    const std::size_t size = runs.entries.size();
+    for (std::size_t r = 0; r < threads; r++) {
+      runs.start.push_back(size * r / threads);
+      runs.length.push_back(size * (r + 1) / threads - size * r / threads);
+    }
+    runOnThreads(threads, [&](const std::size_t r) {
+      std::sort(runs.entries.begin() + runs.start[r],
+                runs.entries.begin() + runs.start[r] + runs.length[r]);
+    });
+  } else if (!run.empty()) {
+    std::sort(run.begin(), run.end());
+    spillRun(runs, run);
+    std::vector<RIDKeyPair<T> >().swap(run);
+  }
+
+  // A range of less than a run page's worth of pairs is not worth a thread
+  std::size_t total = 0;
+  for (std::size_t r = 0; r < runs.length.size(); r++) total += runs.length[r];
+  const std::size_t numParts = std::max<std::size_t>(
+      1, std::min(threads, total / RunPage<T>::PAIRS));
+
+  std::vector<std::vector<std::size_t> > bounds;
+  partitionRuns(runs, numParts, bounds);
+
+  // The first leaf of every range that is not empty is allocated here, in
+  // order, so the first leaf of the tree is the page after the header and
+  // every range knows the leaf its last leaf links to. An empty relation still
+  // gets its one empty leaf from the first range.
+  std::vector<PageId> firstLeaf(numParts, (PageId)Page::INVALID_NUMBER);
+  std::vector<Page *> firstPage(numParts, NULL);
+  for (std::size_t p = 0; p < numParts; p++) {
+    bool empty = true;
+    for (std::size_t r = 0; r < runs.start.size(); r++) {
+      if (bounds[p][r] < bounds[p + 1][r]) empty = false;
+    }
+    if (empty && p > 0) continue;
+    this->bufMgr->allocPage(this->file, firstLeaf[p], firstPage[p]);
+  }
+
+  std::vector<std::vector<PageKeyPair<T> > > parts(numParts);
+  std::vector<T> lastKeys(numParts);
+  runOnThreads(numParts, [&](const std::size_t p) {
+    if (firstPage[p] == NULL) return;
+
+    PageId rightSibPageNo = Page::INVALID_NUMBER;
+    for (std::size_t q = p + 1; q < numParts; q++) {
+      if (firstPage[q] != NULL) {
+        rightSibPageNo = firstLeaf[q];
+        break;
+      }
+    }
+
+    LeafLevelWriter<T> writer(this->bufMgr, this->file, fillFactor, parts[p]);
+    writer.reserve(firstLeaf[p], firstPage[p]);
+    mergeRuns(runs, bounds[p], bounds[p + 1], writer);
+    writer.finish(rightSibPageNo);
+    lastKeys[p] = writer.lastKey();
+  });
+
+  runs.removeFile();
+
+  // Stitch the parts together, with the separator between the last key of a
+  // part and the first key of the next in front of the next, and the first
+  // leaf of the next linked back to the last leaf of the part
+  std::vector<PageKeyPair<T> > nodes;
+  std::size_t previous = numParts;
+  for (std::size_t p = 0; p < numParts; p++) {
+    if (parts[p].empty()) continue;
+    if (previous < numParts) {
+      parts[p][0].key =
+          KeyTraits<T>::separator(lastKeys[previous], parts[p][0].key);
+      Page *first;
+      this->bufMgr->readPage(this->file, parts[p][0].pageNo, first);
+      reinterpret_cast<LeafNode<T> *>(first)->leftSibPageNo =
+          parts[previous].back().pageNo;
+      this->bufMgr->unPinPage(this->file, parts[p][0].pageNo, true);
+    }
+    nodes.insert(nodes.end(), parts[p].begin(), parts[p].end());
+    previous = p;
+  }
+
+  // The first leaf is the root exactly when the tree has a single leaf
+  this->initialRootPageId = nodes[0].pageNo;
+
+  int level = 1;
+  while (nodes.size() > 1) {
+    buildNonLeafLevel<T>(nodes, level, fillFactor);
+    level = 0;
+  }
+  this->rootPageNum = nodes[0].pageNo;
+}
+
+/**
+ * A helper method that builds one non-leaf level above the given nodes. On
+ * return, children holds the nodes of the new level.
+ *
+ * @param children   First key and page of every node on the level below
+ * @param level      Level member of the new nodes (1 if just above leaves)
+ * @param fillFactor Fraction of each node to fill, in (0, 1]
+ */
+template <class T>
+void BTreeIndex::buildNonLeafLevel(std::vector<PageKeyPair<T> > &children,
+                                   const int level, const double fillFactor) {
+  std::vector<PageKeyPair<T> > parents;
+  std::size_t i = 0;
+  while (i < children.size()) {
+    PageId pageNo;
+    Page *page;
+    this->bufMgr->allocPage(this->file, pageNo, page);
+    NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
+
+    node->init(level, children[i].pageNo, children[i].count);
+    std::size_t next = i + 1;
+    while (next < children.size() &&
+           node->hasRoom(children[next].key, fillFactor)) {
+      node->insertAt(node->numKeys, children[next].key, children[next].pageNo,
+                     children[next].count);
+      next++;
+    }
+
+    // Never leave a last node with a single child
+    if (children.size() - next == 1) {
+      if (next - i > 2) {
+        node->dropLast();
+        next--;
+      } else {
+        node->insertAt(node->numKeys, children[next].key,
+                       children[next].pageNo, children[next].count);
+        next++;
+      }
+    }
+
+    PageKeyPair<T> parent;
+    parent.set(pageNo, children[i].key);
+    parent.count = node->totalCount();
+    parents.push_back(parent);
+
+    this->bufMgr->unPinPage(this->file, pageNo, true);
+    i = next;
+  }
+
+  children.swap(parents);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::buildOnline
+// -----------------------------------------------------------------------------
+
+template <class T>
+void BTreeIndex::buildOnline(IndexBuildLog &log) {
+  PageFile *relation = log.getRelation();
+
+  // Pages added after this only hold records that are in the log
+  std::vector<PageId> pageNos;
+  {
+    std::lock_guard<std::mutex> lock(log.latch);
+    for (FileIterator it = relation->begin(); it != relation->end(); ++it) {
+      pageNos.push_back(it.page_number());
+    }
+  }
+
+  // Number of records the log had when each page was read. Those records were
+  // on the page already, later ones on it were not.
+  std::unordered_map<PageId, std::size_t> loggedBefore;
+  std::vector<T> keys;
+  std::vector<RecordId> rids;
+  T key;
+  for (std::size_t i = 0; i < pageNos.size(); i++) {
+    {
+      std::lock_guard<std::mutex> lock(log.latch);
+      Page *page;
+      this->bufMgr->readPage(relation, pageNos[i], page, true);
+      for (PageIterator it = page->begin(); it != page->end(); ++it) {
+        std::size_t length;
+        const char *record = it.getRecordData(length);
+        loadRecordKey(record, key);
+        keys.push_back(key);
+        rids.push_back(it.getCurrentRecord());
+      }
+      this->bufMgr->unPinPage(relation, pageNos[i], false);
+      loggedBefore[pageNos[i]] = log.records.size();
+    }
+    if (keys.size() >= ONLINE_BUILD_BATCH) {
+      insertSorted(&keys[0], &rids[0], keys.size());
+      keys.clear();
+      rids.clear();
+    }
+  }
+
+  // Nothing but the build uses the index yet, so it can be flushed. Once the
+  // log forwards to it, the rest is only flushed when it is closed.
+  releaseHotNodes();
+  this->bufMgr->flushFile(this->file);
+
+  std::size_t replayed = 0;
+  while (true) {
+    std::unique_lock<std::mutex> lock(log.latch);
+    const std::size_t logged = log.records.size();
+    const bool last = logged - replayed <= ONLINE_BUILD_BATCH;
+
+    // Writers keep appending, so the records are copied out before letting go
+    std::vector<std::pair<RecordId, std::string> > slice(
+        log.records.begin() + replayed, log.records.begin() + logged);
+    if (!last) lock.unlock();
+
+    for (std::size_t j = 0; j < slice.size(); j++) {
+      const PageId pageNo = slice[j].first.page_number;
+      std::unordered_map<PageId, std::size_t>::const_iterator read =
+          loggedBefore.find(pageNo);
+      if (read != loggedBefore.end() && replayed + j < read->second) continue;
+      loadRecordKey(slice[j].second.data(), key);
+      keys.push_back(key);
+      rids.push_back(slice[j].first);
+    }
+    if (!keys.empty()) insertSorted(&keys[0], &rids[0], keys.size());
+    keys.clear();
+    rids.clear();
+    replayed = logged;
+    if (!last) continue;
+
+    // Switch over while the writers still wait for the latch
+    PageLatch &metaLatch = this->latches.latchFor(this->headerPageNum);
+    metaLatch.lock();
+    Page *meta;
+    this->bufMgr->readPage(this->file, this->headerPageNum, meta);
+    ((IndexMetaInfo *)meta)->buildInProgress = false;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+    metaLatch.unlock();
+
+    log.records.clear();
+    log.forward = [this](const RecordId &rid, const std::string &record) {
+      this->insertRecord(record.data(), rid);
+    };
+    this->buildLog = &log;
+    return;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+/**
+ * Find an entry with the given key. The leaf it is in is released before the
+ * call returns.
+ * @param key            Key to look for, pointer to integer/double/char string
+ * @param outRid         RecordId of the first entry with the key
+ * @return True if an entry was found
+ **/
+bool BTreeIndex::lookup(const void *key, RecordId &outRid) {
+  switch (this->attributeType) {
+    case INTEGER:
+      return lookupKey(KeyTraits<int>::load(key), &outRid, NULL);
+    case DOUBLE:
+      return lookupKey(KeyTraits<double>::load(key), &outRid, NULL);
+    case STRING:
+      return lookupKey(KeyTraits<StringKey>::load(key), &outRid, NULL);
+    case COMPOSITE:
+      return lookupKey(KeyTraits<CompositeKey>::load(key), &outRid, NULL);
+  }
+  return false;
+}
+
+/**
+ * Find every entry with the given key.
+ * @param key            Key to look for, pointer to integer/double/char string
+ * @param outRids        Replaced with the RecordIds of the entries, in index
+ * order
+ * @return Number of entries found
+ **/
+std::size_t BTreeIndex::lookupAll(const void *key,
+                                  std::vector<RecordId> &outRids) {
+  outRids.clear();
+  switch (this->attributeType) {
+    case INTEGER:
+      lookupKey(KeyTraits<int>::load(key), NULL, &outRids);
+      break;
+    case DOUBLE:
+      lookupKey(KeyTraits<double>::load(key), NULL, &outRids);
+      break;
+    case STRING:
+      lookupKey(KeyTraits<StringKey>::load(key), NULL, &outRids);
+      break;
+    case COMPOSITE:
+      lookupKey(KeyTraits<CompositeKey>::load(key), NULL, &outRids);
+      break;
+  }
+  return outRids.size();
+}
+
+/**
+ * A helper method that finds the entries with a key of the index's type.
+ * lookup() and lookupAll() dispatch on the attribute type once and call this.
+ *
+ * @param key     Key to look for
+ * @param outRid  If not NULL, receives the RecordId of the first entry
+ * @param outRids If not NULL, the RecordIds of all entries are appended here
+ * @return  True if an entry was found
+ */
+template <class T>
+bool BTreeIndex::lookupKey(const T &key, RecordId *outRid,
+                           std::vector<RecordId> *outRids) {
+  if (!filterMayContain(key)) return false;
+
+  // Buffered entries were inserted after those in the tree, so they come last
+  const bool buffering = this->insertBufferCapacity > 0;
+  if (buffering) this->insertBufferLatch.lockShared();
+  Page *page;
+  PageId pageNo = latchLeafShared(key, page);
+  bool found = findInLeaves(key, pageNo, page, outRid, outRids);
+  this->latches.latchFor(pageNo).unlockShared();
+  releaseNode(pageNo);
+  if (buffering) {
+    if (outRids != NULL || !found) {
+      found = findBuffered(key, outRid, outRids) || found;
+    }
+    this->insertBufferLatch.unlockShared();
+  }
+  return found;
+}
+
+/**
+ * Find the entries of each of a batch of keys.
+ * @param keys           Array of n keys of the index's type: integers,
+ * doubles, or strings of STRINGSIZE characters each
+ * @param n              Number of keys
+ * @param outRids        Replaced with the RecordIds of the entries, those of
+ * each key in index order, and the keys in the order they were given in
+ * @param ends           Replaced with n offsets into outRids, the end of the
+ * entries of each key
+ * @return Number of entries found
+ **/
+std::size_t BTreeIndex::lookupBatch(const void *keys, const std::size_t n,
+                                    std::vector<RecordId> &outRids,
+                                    std::vector<std::size_t> &ends) {
+  flushInserts();
+  switch (this->attributeType) {
+    case INTEGER:
+      lookupKeys<int>(keys, n, outRids, ends);
+      break;
+    case DOUBLE:
+      lookupKeys<double>(keys, n, outRids, ends);
+      break;
+    case STRING:
+      lookupKeys<StringKey>(keys, n, outRids, ends);
+      break;
+    case COMPOSITE:
+      lookupKeys<CompositeKey>(keys, n, outRids, ends);
+      break;
+  }
+  return outRids.size();
+}
+
+/**
+ * A helper method that finds the entries of a batch of keys of the index's
+ * type. The keys are looked up in sorted order, so that neighbouring keys in
+ * the same leaf are found without descending the tree again.
+ *
+ * @param keys     Array of n keys of the index's type
+ * @param n        Number of keys
+ * @param outRids  Replaced with the RecordIds of the entries, by key
+ * @param ends     Replaced with the end of the entries of each key in outRids
+ */
+template <class T>
+void BTreeIndex::lookupKeys(const void *keys, const std::size_t n,
+                            std::vector<RecordId> &outRids,
+                            std::vector<std::size_t> &ends) {
+  std::vector<T> probes(n);
+  std::vector<std::size_t> order(n);
+  for (std::size_t i = 0; i < n; i++) {
+    probes[i] = KeyTraits<T>::load(static_cast<const char *>(keys) +
+                                   i * sizeof(T));
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&probes](const std::size_t a, const std::size_t b) {
+              return probes[a] < probes[b];
+            });
+
+  // The entries are found in key order, then moved to the order of the keys
+  std::vector<RecordId> sorted;
+  std::vector<std::size_t> from(n), to(n);
+  Page *page = NULL;
+  PageId pageNo = Page::INVALID_NUMBER;
+  for (std::size_t k = 0; k < n; k++) {
+    const std::size_t i = order[k];
+    const T &key = probes[i];
+    if (k > 0 && !(probes[order[k - 1]] < key)) {
+      from[i] = from[order[k - 1]];
+      to[i] = to[order[k - 1]];
+      continue;
+    }
+    if (!filterMayContain(key)) {
+      from[i] = to[i] = sorted.size();
+      continue;
+    }
+
+    // The leaf of the last key is kept while keys greater than the key may be
+    // in it, since no entry with the key can be to its left
+    if (page != NULL) {
+      LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+      if (leaf->rightSibPageNo != Page::INVALID_NUMBER &&
+          (leaf->numKeys == 0 || leaf->getKey(leaf->numKeys - 1) < key)) {
+        this->latches.latchFor(pageNo).unlockShared();
+        releaseNode(pageNo);
+        page = NULL;
+      }
+    }
+    if (page == NULL) pageNo = latchLeafShared(key, page);
+
+    from[i] = sorted.size();
+    findInLeaves(key, pageNo, page, (RecordId *)NULL, &sorted);
+    to[i] = sorted.size();
+  }
+  if (page != NULL) {
+    this->latches.latchFor(pageNo).unlockShared();
+    releaseNode(pageNo);
+  }
+
+  outRids.clear();
+  ends.resize(n);
+  for (std::size_t i = 0; i < n; i++) {
+    outRids.insert(outRids.end(), sorted.begin() + from[i],
+                   sorted.begin() + to[i]);
+    ends[i] = outRids.size();
+  }
+}
+
+/**
+ * A helper method that finds the entries with key from a latched leaf on,
+ * moving right while they run past the end of the leaf.
+ *
+ * @param key      Key to look for
+ * @param pageNo   Leaf to start from, latched in shared mode. Replaced with
+ * the latched leaf the search ended on
+ * @param page     The leaf, replaced along with pageNo
+ * @param outRid   If not NULL, receives the RecordId of the first entry
+ * @param outRids  If not NULL, the RecordIds of all entries are appended here
+ * @return  True if an entry was found
+ */
+template <class T>
+bool BTreeIndex::findInLeaves(const T &key, PageId &pageNo, Page *&page,
+                              RecordId *outRid,
+                              std::vector<RecordId> *outRids) {
+  bool found = false;
+  while (true) {
+    LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+    const int first = leaf->lowerBound(key);
+    const int end = leaf->upperBound(key);
+    if (first < end) {
+      found = true;
+      if (outRids == NULL) {
+        *outRid = leaf->getRid(first);
+        break;
+      }
+      const std::size_t size = outRids->size();
+      outRids->resize(size + (end - first));
+      leaf->copyRids(first, end - first, &(*outRids)[size]);
+    }
+
+    // A greater key in this leaf means no entry with the key is further right
+    const PageId nextNo = leaf->rightSibPageNo;
+    if (end < leaf->numKeys || nextNo == Page::INVALID_NUMBER) break;
+
+    PageLatch &nextLatch = this->latches.latchFor(nextNo);
+    nextLatch.lockShared();
+    Page *nextPage;
+    readNode(nextNo, nextPage);
+    this->latches.latchFor(pageNo).unlockShared();
+    releaseNode(pageNo);
+    pageNo = nextNo;
+    page = nextPage;
+  }
+  return found;
+}
+
+/**
+ * A helper method that finds the leftmost leaf that can hold key and latches
+ * it in shared mode. Each node on the way down is latched before its parent is
+ * let go of. The leaf is got through readNode().
+ *
+ * @param key     Key to look for
+ * @param page    The leaf, returned via this reference
+ * @param cursor  If not NULL, its path is replaced by the nodes passed
+ * @return  Page number of the leaf
+ */
+template <class T>
+PageId BTreeIndex::latchLeafShared(const T &key, Page *&page,
+                                   IndexCursor *cursor) {
+  if (cursor != NULL) {
+    cursor->pathPages.clear();
+    cursor->pathVersions.clear();
+  }
+
+  // Latch the root before reading it in, then each node's child before letting
+  // go of the node
+  this->rootLatch.lockShared();
+  PageId pageNo = this->rootPageNum;
+  bool leafFound = this->initialRootPageId == pageNo;
+  PageLatch *latch = &this->latches.latchFor(pageNo);
+  latch->lockShared();
+  this->rootLatch.unlockShared();
+
+  // Read root page into the buffer pool
+  threadDescentDepth++;
+  if (leafFound) {
+    readNode(pageNo, page);
+    return pageNo;
+  }
+  const bool pinned = readInternal(pageNo, 0, page);
+  return descendShared(key, pageNo, 0, pinned, page, cursor);
+}
+
+/**
+ * A helper method that goes down from a latched non-leaf node to the leftmost
+ * leaf under it that can hold key, latching the leaf in shared mode as
+ * latchLeafShared() does. The node is let go of on the way.
+ *
+ * @param key     Key to look for
+ * @param pageNo  Page number of the node
+ * @param depth   Depth of the node, 0 for the root
+ * @param pinned  True if the node has to be unpinned once done with
+ * @param page    The node, and then the leaf, via this reference
+ * @param cursor  If not NULL, the nodes passed are added to its path
+ * @return  Page number of the leaf
+ */
+template <class T>
+PageId BTreeIndex::descendShared(const T &key, PageId pageNo, int depth,
+                                 bool pinned, Page *&page,
+                                 IndexCursor *cursor) {
+  PageLatch *latch = &this->latches.latchFor(pageNo);
+  bool leafFound = false;
+  while (!leafFound) {
+    NonLeafNode<T> *currNode = reinterpret_cast<NonLeafNode<T> *>(page);
+    if (cursor != NULL) {
+      cursor->pathPages.push_back(pageNo);
+      cursor->pathVersions.push_back(latch->getVersion());
+    }
+
+    // if this is the level above the leaf, end while loop
+    if (currNode->level) leafFound = true;
+
+    // Go to the leftmost child that can hold the key
+    PageId nextNode = currNode->getChild(currNode->lowerBound(key));
+    PageLatch *nextLatch = &this->latches.latchFor(nextNode);
+    nextLatch->lockShared();
+
+    // read the page in, then unpin the current page
+    Page *nextPage;
+    bool nextPinned = false;
+    depth++;
+    threadDescentDepth++;
+    if (leafFound) {
+      readNode(nextNode, nextPage);
+    } else {
+      nextPinned = readInternal(nextNode, depth, nextPage);
+    }
+    latch->unlockShared();
+    if (pinned) this->bufMgr->unPinPage(this->file, pageNo, false);
+
+    pageNo = nextNode;  // current page is not a leaf
+    page = nextPage;
+    pinned = nextPinned;
+    latch = nextLatch;
+  }
+
+  return pageNo;
+}
+
+/**
+ * A helper method that latches the leftmost leaf that can hold key for a
+ * cursor moving forward to it. The descent starts from the lowest node on the
+ * cursor's path that has not changed since and holds key in one of its
+ * subtrees other than the last, from the root if there is none. Such a node
+ * still holds every key from the one the path was found for up to key.
+ *
+ * @param cursor  Cursor of the scan, its path updated
+ * @param key     Key to look for, not below the keys the cursor has passed
+ * @param page    The leaf, returned via this reference
+ * @return  Page number of the leaf
+ */
+template <class T>
+PageId BTreeIndex::latchLeafFrom(IndexCursor &cursor, const T &key,
+                                 Page *&page) {
+  // The root may have been replaced, so the descent from it starts over
+  for (int depth = (int)cursor.pathPages.size() - 1; depth > 0; depth--) {
+    const PageId pageNo = cursor.pathPages[depth];
+    PageLatch &latch = this->latches.latchFor(pageNo);
+    latch.lockShared();
+    if (latch.getVersion() == cursor.pathVersions[depth]) {
+      Page *node;
+      const bool pinned = readInternal(pageNo, depth, node);
+      NonLeafNode<T> *currNode = reinterpret_cast<NonLeafNode<T> *>(node);
+      if (currNode->lowerBound(key) < currNode->numKeys) {
+        threadDescentDepth++;
+        cursor.pathPages.resize(depth);
+        cursor.pathVersions.resize(depth);
+        page = node;
+        return descendShared(key, pageNo, depth, pinned, page, &cursor);
+      }
+      if (pinned) this->bufMgr->unPinPage(this->file, pageNo, false);
+    }
+    latch.unlockShared();
+  }
+  return latchLeafShared(key, page, &cursor);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScan
+// -----------------------------------------------------------------------------
+
+/**
+ * Begin a filtered scan of the index.  For instance, if the method is called
+ * using ("a",GT,"d",LTE) then we should seek all entries with a value
+ * greater than "a" and less than or equal to "d".
+ * If another scan is already executing, that needs to be ended here.
+ * Set up all the variables for scan. Start from root to find out the leaf page
+ *that contains the first RecordID that satisfies the scan parameters. Keep that
+ *page pinned in the buffer pool.
+ * @param lowVal Low value of range, pointer to integer / double / char string,
+ *or NULL to leave the range open below
+ * @param lowOp      Low operator (GT/GTE)
+ * @param highVal    High value of range, pointer to integer / double / char
+ *string, or NULL to leave the range open above
+ * @param highOp High operator (LT/LTE)
+ * @param descending If true, entries are returned from the high end of the
+ *range down
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their
+ *their expected values
+ * @throws  BadScanrangeException If lowVal > highval
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+ *satisfies the scan criteria.
+ **/
+void BTreeIndex::startScan(void *lowValParm, const Operator lowOpParm,
+                           void *highValParm, const Operator highOpParm,
+                           const bool descending) {
+  startScan(this->scan, lowValParm, lowOpParm, highValParm, highOpParm,
+            descending);
+}
+
+/**
+ * Begin a filtered scan of the index on cursor, as startScan() does without
+ * one. A scan the cursor is already executing, on this or another index, is
+ * ended first. Scans on other cursors are not affected.
+ * @param cursor     Cursor that holds the state of the scan
+ * @param lowVal Low value of range, pointer to integer / double / char string,
+ *or NULL to leave the range open below
+ * @param lowOp      Low operator (GT/GTE)
+ * @param highVal    High value of range, pointer to integer / double / char
+ *string, or NULL to leave the range open above
+ * @param highOp High operator (LT/LTE)
+ * @param descending If true, entries are returned from the high end of the
+ *range down
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their
+ *their expected values
+ * @throws  BadScanrangeException If lowVal > highval
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+ *satisfies the scan criteria.
+ **/
+void BTreeIndex::startScan(IndexCursor &cursor, void *lowValParm,
+                           const Operator lowOpParm, void *highValParm,
+                           const Operator highOpParm, const bool descending) {
+  OpCount count(this->startScanCounters);
+  const ScanRange range = {lowValParm, lowOpParm, highValParm, highOpParm};
+  startRanges(cursor, &range, 1, descending);
+}
+
+/**
+ * Begin a scan of several ranges of the index on cursor.
+ * @param cursor  Cursor that holds the state of the scan
+ * @param ranges  Ranges to scan, sorted by their bounds and disjoint
+ * @throws  BadOpcodesException If a range's operators are not GT/GTE and
+ *LT/LTE
+ * @throws  BadScanrangeException If ranges is empty, or a range is empty,
+ *overlaps the one before or comes before it
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+ *satisfies the scan criteria.
+ **/
+void BTreeIndex::startScan(IndexCursor &cursor,
+                           const std::vector<ScanRange> &ranges) {
+  if (ranges.empty()) throw BadScanrangeException();
+  OpCount count(this->startScanCounters);
+  startRanges(cursor, &ranges[0], ranges.size(), false);
+}
+
+/**
+ * Begin a scan of several ranges of the index without a cursor.
+ * @param ranges  Ranges to scan, sorted by their bounds and disjoint
+ **/
+void BTreeIndex::startScan(const std::vector<ScanRange> &ranges) {
+  startScan(this->scan, ranges);
+}
+
+/**
+ * Make the key of a COMPOSITE index from the values of its leading columns,
+ * the other columns taking their smallest encoding.
+ * @param values     Pointer to the value of each column
+ * @param numValues  Number of values, at most the number of columns
+ * @return The key
+ * @throws  BadIndexInfoException If the index is not COMPOSITE or has fewer
+ *columns than values
+ **/
+CompositeKey BTreeIndex::makeKey(const void *const *values,
+                                 const int numValues) const {
+  CompositeKey key;
+  encodeKey(values, numValues, 0, key);
+  return key;
+}
+
+/**
+ * Begin a scan of the entries of a COMPOSITE index whose leading columns have
+ * the given values. The keys from the values followed by the smallest
+ * encoding of the other columns to the values followed by the largest
+ * encoding are a single range.
+ * @param cursor     Cursor that holds the state of the scan
+ * @param values     Pointer to the value of each leading column
+ * @param numValues  Number of values, 0 to scan every entry
+ * @throws  BadIndexInfoException If the index is not COMPOSITE or has fewer
+ *columns than values
+ * @throws  NoSuchKeyFoundException If no key has the values
+ **/
+void BTreeIndex::startPrefixScan(IndexCursor &cursor,
+                                 const void *const *values,
+                                 const int numValues) {
+  CompositeKey low;
+  CompositeKey high;
+  encodeKey(values, numValues, 0, low);
+  encodeKey(values, numValues, 0xff, high);
+  startScan(cursor, &low, GTE, &high, LTE);
+}
+
+/**
+ * Begin a prefix scan of a COMPOSITE index without a cursor.
+ * @param values     Pointer to the value of each leading column
+ * @param numValues  Number of values, 0 to scan every entry
+ **/
+void BTreeIndex::startPrefixScan(const void *const *values,
+                                 const int numValues) {
+  startPrefixScan(this->scan, values, numValues);
+}
+
+/**
+ * A helper method that encodes the values of the leading columns of a
+ * COMPOSITE key and fills the rest of it with fill.
+ *
+ * @param values     Pointer to the value of each leading column
+ * @param numValues  Number of values
+ * @param fill       Byte the rest of the key is filled with
+ * @param key        The key, returned via this reference
+ * @throws  BadIndexInfoException If the index is not COMPOSITE or has fewer
+ * columns than values
+ */
+void BTreeIndex::encodeKey(const void *const *values, const int numValues,
+                           const unsigned char fill, CompositeKey &key) const {
+  if (this->attributeType != COMPOSITE || numValues < 0 ||
+      numValues > (int)this->keyColumns.size()) {
+    throw BadIndexInfoException(this->file->filename());
+  }
+  int used = 0;
+  for (int c = 0; c < numValues; c++) {
+    encodeColumn(this->keyColumns[c].type, values[c], key.data + used);
+    used += columnWidth(this->keyColumns[c].type);
+  }
+  memset(key.data + used, fill, COMPOSITESIZE - used);
+}
+
+/**
+ * A helper method that begins a scan of one or more ranges on cursor.
+ *
+ * @param cursor     Cursor that holds the state of the scan
+ * @param ranges     Ranges to scan, sorted and disjoint
+ * @param numRanges  Number of ranges, at least 1
+ * @param descending If true, the single range is scanned from the high end
+ * @throws  BadOpcodesException If an operator is not one the range expects
+ * @throws  BadScanrangeException If a range is empty or ranges overlap or are
+ * out of order
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+ *satisfies the scan criteria.
+ */
+void BTreeIndex::startRanges(IndexCursor &cursor, const ScanRange *ranges,
+                             const std::size_t numRanges,
+                             const bool descending) {
+  for (std::size_t r = 0; r < numRanges; r++) {
+    if (!((ranges[r].lowOp == GT || ranges[r].lowOp == GTE) &&
+          (ranges[r].highOp == LT || ranges[r].highOp == LTE))) {
+      // Check that the parameters are valid
+      throw BadOpcodesException();
+    }
+  }
+  flushInserts();
+
+  // Get the ranges for the scan and check that they are valid. Nothing of a
+  // scan the cursor may still be executing is changed before.
+  bool valid = false;
+  switch (this->attributeType) {
+    case INTEGER:
+      valid = storeRanges(cursor, ranges, numRanges, cursor.rangeInts);
+      break;
+    case DOUBLE:
+      valid = storeRanges(cursor, ranges, numRanges, cursor.rangeDoubles);
+      break;
+    case STRING:
+      valid = storeRanges(cursor, ranges, numRanges, cursor.rangeStrings);
+      break;
+    case COMPOSITE:
+      valid = storeRanges(cursor, ranges, numRanges, cursor.rangeComposites);
+      break;
+  }
+  if (!valid) throw BadScanrangeException();
+
+  // If the scan is already started, end it and start a new one
+  if (cursor.scanExecuting) cursor.index->endScan(cursor);
+
+  cursor.index = this;
+  cursor.scanExecuting = true;
+  this->openScans++;
+  cursor.readAheadEnd = 0;
+  cursor.descending = descending;
+  cursor.prevLeaf = Page::INVALID_NUMBER;
+  cursor.nextRange = 0;
+  advanceRange(cursor);
+
+  switch (this->attributeType) {
+    case INTEGER:
+      if (descending) {
+        startScanDescending(cursor, cursor.lowValInt, cursor.highValInt);
+      } else {
+        startScanKey(cursor, cursor.lowValInt, cursor.highValInt);
+      }
+      break;
+    case DOUBLE:
+      if (descending) {
+        startScanDescending(cursor, cursor.lowValDouble, cursor.highValDouble);
+      } else {
+        startScanKey(cursor, cursor.lowValDouble, cursor.highValDouble);
+      }
+      break;
+    case STRING:
+      if (descending) {
+        startScanDescending(cursor, cursor.lowValString, cursor.highValString);
+      } else {
+        startScanKey(cursor, cursor.lowValString, cursor.highValString);
+      }
+      break;
+    case COMPOSITE:
+      if (descending) {
+        startScanDescending(cursor, cursor.lowValComposite,
+                            cursor.highValComposite);
+      } else {
+        startScanKey(cursor, cursor.lowValComposite, cursor.highValComposite);
+      }
+      break;
+  }
+}
+
+/**
+ * A helper method that stores the bounds of the ranges of a scan in the
+ * cursor. The ranges are checked before anything is stored.
+ *
+ * @param cursor     Cursor of the scan
+ * @param ranges     Ranges to scan
+ * @param numRanges  Number of ranges
+ * @param bounds     Low and high bound of each range, replaced
+ * @return  True if the ranges are each non-empty, sorted and disjoint
+ */
+template <class T>
+bool BTreeIndex::storeRanges(IndexCursor &cursor, const ScanRange *ranges,
+                             const std::size_t numRanges,
+                             std::vector<T> &bounds) {
+  T prevHigh = T();
+  Operator prevHighOp = LTE;
+  for (std::size_t r = 0; r < numRanges; r++) {
+    const T low = ranges[r].lowVal != NULL
+                      ? KeyTraits<T>::load(ranges[r].lowVal)
+                      : KeyTraits<T>::lowest();
+    const T high = ranges[r].highVal != NULL
+                       ? KeyTraits<T>::load(ranges[r].highVal)
+                       : KeyTraits<T>::highest();
+    const Operator lowOp = ranges[r].lowVal != NULL ? ranges[r].lowOp : GTE;
+    if (low > high) return false;
+
+    // Each range starts past the end of the one before
+    if (r > 0 && (low < prevHigh ||
+                  (low == prevHigh && lowOp == GTE && prevHighOp == LTE))) {
+      return false;
+    }
+    prevHigh = high;
+    prevHighOp = ranges[r].highVal != NULL ? ranges[r].highOp : LTE;
+  }
+
+  bounds.clear();
+  cursor.rangeOps.clear();
+  for (std::size_t r = 0; r < numRanges; r++) {
+    if (ranges[r].lowVal != NULL) {
+      bounds.push_back(KeyTraits<T>::load(ranges[r].lowVal));
+      cursor.rangeOps.push_back(ranges[r].lowOp);
+    } else {
+      bounds.push_back(KeyTraits<T>::lowest());
+      cursor.rangeOps.push_back(GTE);
+    }
+    if (ranges[r].highVal != NULL) {
+      bounds.push_back(KeyTraits<T>::load(ranges[r].highVal));
+      cursor.rangeOps.push_back(ranges[r].highOp);
+    } else {
+      bounds.push_back(KeyTraits<T>::highest());
+      cursor.rangeOps.push_back(LTE);
+    }
+  }
+  return true;
+}
+
+/**
+ * A helper method that makes the next range of a scan the current one.
+ *
+ * @param cursor  Cursor of the scan
+ * @return  False if the current range was the last
+ */
+bool BTreeIndex::advanceRange(IndexCursor &cursor) {
+  const std::size_t r = cursor.nextRange;
+  if (2 * r >= cursor.rangeOps.size()) return false;
+  cursor.nextRange++;
+  switch (this->attributeType) {
+    case INTEGER:
+      cursor.lowValInt = cursor.rangeInts[2 * r];
+      cursor.highValInt = cursor.rangeInts[2 * r + 1];
+      break;
+    case DOUBLE:
+      cursor.lowValDouble = cursor.rangeDoubles[2 * r];
+      cursor.highValDouble = cursor.rangeDoubles[2 * r + 1];
+      break;
+    case STRING:
+      cursor.lowValString = cursor.rangeStrings[2 * r];
+      cursor.highValString = cursor.rangeStrings[2 * r + 1];
+      break;
+    case COMPOSITE:
+      cursor.lowValComposite = cursor.rangeComposites[2 * r];
+      cursor.highValComposite = cursor.rangeComposites[2 * r + 1];
+      break;
+  }
+  cursor.lowOp = cursor.rangeOps[2 * r];
+  cursor.highOp = cursor.rangeOps[2 * r + 1];
+  return true;
+}
+
+/**
+ * A helper method that positions the scan on the first entry satisfying the
+ * low bound. startScan() validates the arguments, stores the bounds and calls
+ * this for the index's key type.
+ *
+ * @param cursor  Cursor of the scan
+ * @param lowVal  Low value of range
+ * @param highVal High value of range
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+ *satisfies the scan criteria.
+ */
+template <class T>
+void BTreeIndex::startScanKey(IndexCursor &cursor, const T &lowVal,
+                              const T &highVal) {
+  cursor.currentPageNum =
+      latchLeafShared(lowVal, cursor.currentPageData, &cursor);
+  readAhead<T>(cursor);
+
+  // Now that the current Node is the leaf node, find the smallest key that
+  // satisfies the low operand, in the first range that has one
+  seekLow<T>(cursor, lowVal, false);
+  while (true) {
+    LeafNode<T> *currLeaf =
+        reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+    PageLatch &latch = this->latches.latchFor(cursor.currentPageNum);
+
+    // No key is left in the index, so none is in a later range either
+    if (cursor.nextEntry == currLeaf->numKeys) break;
+
+    const T key = currLeaf->getKey(cursor.nextEntry);
+    if (cursor.highOp == LT ? ScanBound<LT>::holds(key, highVal)
+                            : ScanBound<LTE>::holds(key, highVal)) {
+      // use this valid key
+      cursor.leafVersion = latch.getVersion();
+      latch.unlockShared();
+      return;
+    }
+
+    // Smallest candidate is already past the high bound
+    if (!advanceRange(cursor)) break;
+    seekLow<T>(cursor, lowVal, true);
+  }
+
+  // no such key was found
+  this->latches.latchFor(cursor.currentPageNum).unlockShared();
+  releaseNode(cursor.currentPageNum);
+  cursor.scanExecuting = false;
+  this->openScans--;
+  throw NoSuchKeyFoundException();
+}
+
+/**
+ * A helper method that positions the scan on the first entry satisfying the
+ * low bound at or right of its latched leaf. The cursor moves right along the
+ * leaves, or when the bound is past its leaf and descend is set, goes down
+ * again through latchLeafFrom().
+ *
+ * @param cursor  Cursor of the scan
+ * @param lowVal  Low value of range
+ * @param descend True to go down again if the bound is past the leaf
+ */
+template <class T>
+void BTreeIndex::seekLow(IndexCursor &cursor, const T &lowVal,
+                         const bool descend) {
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  int bound = boundPosition(*node, cursor.lowOp, lowVal);
+  if (descend && bound == node->numKeys && node->rightSibPageNo) {
+    this->latches.latchFor(cursor.currentPageNum).unlockShared();
+    releaseNode(cursor.currentPageNum);
+    cursor.currentPageNum =
+        latchLeafFrom(cursor, lowVal, cursor.currentPageData);
+    readAhead<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+    bound = boundPosition(*node, cursor.lowOp, lowVal);
+  }
+
+  while (bound == node->numKeys && node->rightSibPageNo) {
+    // No matching key was found in this leaf so go to the next one
+    stepRight<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+    bound = boundPosition(*node, cursor.lowOp, lowVal);
+  }
+  cursor.nextEntry = bound;
+  cursor.lastValDups = 0;
+}
+
+/**
+ * A helper method that positions a descending scan on the last entry
+ * satisfying the high bound.
+ *
+ * @param cursor  Cursor of the scan
+ * @param lowVal  Low value of range
+ * @param highVal High value of range
+ * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+ *satisfies the scan criteria.
+ */
+template <class T>
+void BTreeIndex::startScanDescending(IndexCursor &cursor, const T &lowVal,
+                                     const T &highVal) {
+  cursor.currentPageNum = latchLeafShared(highVal, cursor.currentPageData);
+  seekHigh<T>(cursor, highVal);
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  while (cursor.nextEntry < 0 && node->leftSibPageNo) {
+    stepLeft<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  }
+  readAhead<T>(cursor);
+
+  PageLatch &latch = this->latches.latchFor(cursor.currentPageNum);
+  if (cursor.nextEntry < 0 ||
+      !(cursor.lowOp == GTE
+            ? ScanBound<GTE>::holds(node->getKey(cursor.nextEntry), lowVal)
+            : ScanBound<GT>::holds(node->getKey(cursor.nextEntry), lowVal))) {
+    // Largest candidate is already past the low bound
+    latch.unlockShared();
+    releaseNode(cursor.currentPageNum);
+    cursor.scanExecuting = false;
+    this->openScans--;
+    throw NoSuchKeyFoundException();
+  }
+
+  cursor.lastValDups = 0;
+  cursor.leafVersion = latch.getVersion();
+  latch.unlockShared();
+}
+
+/**
+ * A helper method that gets a page for a scan. Pages of a read-only index come
+ * straight from its mapping, others are pinned in the buffer pool.
+ *
+ * @param pageNo  Number of the page
+ * @param page    The page, returned via this reference
+ */
+void BTreeIndex::readNode(const PageId pageNo, Page *&page) {
+  threadPagesTouched++;
+  if (this->mappedPages != NULL && pageNo < this->numMappedPages) {
+    // Scans never write through the page, so the mapping can stay PROT_READ
+    page = const_cast<Page *>(this->mappedPages + pageNo);
+    return;
+  }
+  this->bufMgr->readPage(this->file, pageNo, page);
+}
+
+/**
+ * A helper method that gives back a page got through readNode().
+ *
+ * @param pageNo  Number of the page
+ */
+void BTreeIndex::releaseNode(const PageId pageNo) {
+  if (this->mappedPages != NULL && pageNo < this->numMappedPages) return;
+  this->bufMgr->unPinPage(this->file, pageNo, false);
+}
+
+/**
+ * A helper method that gets a non-leaf node for a traversal. Hot nodes and
+ * mapped pages are used in place. Any other node is pinned in the buffer pool,
+ * and if it is in the top HOT_NODE_LEVELS levels it is made hot and keeps that
+ * pin.
+ *
+ * @param pageNo  Number of the page
+ * @param depth   Depth of the node, 0 for the root
+ * @param page    The page, returned via this reference
+ * @return  True if the caller has to unpin the page once done with it
+ */
+bool BTreeIndex::readInternal(const PageId pageNo, const int depth,
+                              Page *&page) {
+  threadPagesTouched++;
+  if (this->mappedPages != NULL && pageNo < this->numMappedPages) {
+    page = const_cast<Page *>(this->mappedPages + pageNo);
+    return false;
+  }
+  std::atomic<Page *> &hot = this->hotNodes.at(pageNo);
+  page = hot.load(std::memory_order_acquire);
+  if (page != NULL) return false;
+
+  this->bufMgr->readPage(this->file, pageNo, page);
+  if (depth >= HOT_NODE_LEVELS) return true;
+
+  // Another thread may have made the node hot meanwhile
+  std::lock_guard<std::mutex> lock(this->hotNodeLatch);
+  if (hot.load(std::memory_order_relaxed) != NULL ||
+      this->hotNodeIds.size() >= this->maxHotNodes) {
+    return true;
+  }
+  hot.store(page, std::memory_order_release);
+  this->hotNodeIds.push_back(pageNo);
+  return false;
+}
+
+/**
+ * A helper method that unpins all hot nodes, emptying hotNodes. Called before
+ * the index file is flushed, since no page may be pinned then.
+ */
+void BTreeIndex::releaseHotNodes() {
+  std::vector<PageId> released;
+  {
+    std::lock_guard<std::mutex> lock(this->hotNodeLatch);
+    released.swap(this->hotNodeIds);
+    for (std::size_t i = 0; i < released.size(); i++) {
+      this->hotNodes.at(released[i]).store(NULL);
+    }
+  }
+
+  // The buffer manager's latches are never taken while holding hotNodeLatch
+  for (std::size_t i = 0; i < released.size(); i++) {
+    this->bufMgr->unPinPage(this->file, released[i], false);
+  }
+}
+
+/**
+ * A helper method that moves the cursor to the first entry of the right sibling
+ * of its leaf. The sibling is latched before the leaf is released.
+ *
+ * @param cursor  Cursor of the scan
+ */
+template <class T>
+void BTreeIndex::stepRight(IndexCursor &cursor) {
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  PageId nextLeaf = node->rightSibPageNo;
+  this->latches.latchFor(nextLeaf).lockShared();
+
+  // Unpin page and read the next one
+  Page *nextPage;
+  readNode(nextLeaf, nextPage);
+  this->latches.latchFor(cursor.currentPageNum).unlockShared();
+  releaseNode(cursor.currentPageNum);
+
+  cursor.currentPageNum = nextLeaf;
+  cursor.currentPageData = nextPage;
+  cursor.nextEntry = 0;
+  if (!cursor.descending) readAhead<T>(cursor);
+}
+
+/**
+ * A helper method that moves a descending scan to the last entry of the leaf
+ * left of its leaf. The caller checked that there is one.
+ *
+ * @param cursor  Cursor of the scan
+ */
+template <class T>
+void BTreeIndex::stepLeft(IndexCursor &cursor) {
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  const PageId from = cursor.currentPageNum;
+  const PageId fromRight = node->rightSibPageNo;
+  const PageId prevLeaf = node->leftSibPageNo;
+
+  // Writers latch leaves left to right, so this leaf is let go first
+  this->latches.latchFor(from).unlockShared();
+  releaseNode(from);
+  this->latches.latchFor(prevLeaf).lockShared();
+  readNode(prevLeaf, cursor.currentPageData);
+  cursor.currentPageNum = prevLeaf;
+
+  // Leaves split off meanwhile come before the one left, unless that was
+  // compacted away and its left sibling now links to its right one
+  node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  while (node->rightSibPageNo && node->rightSibPageNo != from &&
+         node->rightSibPageNo != fromRight) {
+    stepRight<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  }
+
+  cursor.prevLeaf = from;
+  cursor.nextEntry = node->numKeys - 1;
+  cursor.lastValDups = 0;
+  readAhead<T>(cursor);
+}
+
+/**
+ * A helper method that positions a descending scan on the last entry of its
+ * leaf within the high bound.
+ *
+ * @param cursor  Cursor of the scan
+ * @param highVal High value of range
+ */
+template <class T>
+void BTreeIndex::seekHigh(IndexCursor &cursor, const T &highVal) {
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  while (true) {
+    const int end = boundPosition(*node, cursor.highOp, highVal);
+    if (end < node->numKeys || !node->rightSibPageNo ||
+        node->rightSibPageNo == cursor.prevLeaf) {
+      cursor.nextEntry = end - 1;
+      return;
+    }
+    stepRight<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  }
+}
+
+/**
+ * A helper method that reads ahead the leaves to the right of the cursor's
+ * latched leaf. Leaves that follow each other in page number order, as bulk
+ * loading lays them out, are kept READ_AHEAD_PAGES ahead; otherwise just the
+ * right sibling is read ahead.
+ *
+ * @param cursor  Cursor of the scan
+ */
+template <class T>
+void BTreeIndex::readAhead(IndexCursor &cursor) {
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  if (cursor.descending) {
+    const PageId prev = node->leftSibPageNo;
+    if (prev && prev >= this->numMappedPages) {
+      this->bufMgr->prefetch(this->file, prev, 1);
+    }
+    return;
+  }
+  const PageId next = node->rightSibPageNo;
+
+  // Mapped pages need no reading
+  if (!next || next < this->numMappedPages) return;
+
+  if (next != cursor.currentPageNum + 1) {
+    this->bufMgr->prefetch(this->file, next, 1);
+    return;
+  }
+  const PageId from = std::max(next, cursor.readAheadEnd);
+  const PageId to = next + READ_AHEAD_PAGES;
+  if (from < to) {
+    this->bufMgr->prefetch(this->file, from, to - from);
+    cursor.readAheadEnd = to;
+  }
+}
+
+/**
+ * A helper method that latches the cursor's leaf in shared mode. If the leaf
+ * changed since the cursor let go of it, the position is found again from the
+ * last key returned, moving right if a split moved it to a sibling.
+ *
+ * @param cursor  Cursor of the scan
+ * @param lowVal  Low value of range
+ * @param lastVal Last key returned from the cursor's leaf
+ */
+template <class T>
+void BTreeIndex::latchScanLeaf(IndexCursor &cursor, const T &lowVal,
+                               const T &highVal, const T &lastVal) {
+  PageLatch &latch = this->latches.latchFor(cursor.currentPageNum);
+  latch.lockShared();
+  if (latch.getVersion() == cursor.leafVersion) return;
+
+  // A descending scan goes on before the last entry returned, or from the
+  // high bound if none was returned from the leaf. Splits since may have
+  // moved the entries it has not reached to leaves right of this one.
+  if (cursor.descending && !cursor.lastValDups) {
+    seekHigh<T>(cursor, highVal);
+    return;
+  }
+  const int back = cursor.descending ? 2 : 0;
+
+  // Entries only ever move right, to leaves split off this one. New
+  // duplicates go after the existing ones, so the returned entries still come
+  // first among those with the last key, unless some of them were deleted.
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  if (!cursor.lastValDups) {
+    while (true) {
+      cursor.nextEntry = boundPosition(*node, cursor.lowOp, lowVal);
+      if (cursor.nextEntry < node->numKeys || !node->rightSibPageNo) return;
+      stepRight<T>(cursor);
+      node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+    }
+  }
+
+  // The last entry returned is found by its RecordId if it is still here
+  const int first = node->lowerBound(lastVal);
+  const int end = node->upperBound(lastVal);
+  for (int i = first; i < end; i++) {
+    if (node->getRid(i) == cursor.lastRid) {
+      cursor.nextEntry = i + 1 - back;
+      cursor.lastValDups = i + 1 - first;
+      return;
+    }
+  }
+
+  int pos = first + cursor.lastValDups;
+  while (pos > node->numKeys && node->rightSibPageNo) {
+    // Some of the returned entries were moved to the right sibling
+    const int moved = pos - node->numKeys;
+    stepRight<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+    pos = node->lowerBound(lastVal) + moved;
+    cursor.lastValDups = moved;
+  }
+  cursor.nextEntry = std::min(pos, node->numKeys) - back;
+}
+
+/**
+ * A helper method that remembers the cursor's position and releases the latch
+ * on its leaf.
+ *
+ * @param cursor   Cursor of the scan
+ * @param returned True if the call returned any entries
+ * @param lastVal  Last key returned from the cursor's leaf, updated here
+ */
+template <class T>
+void BTreeIndex::unlatchScanLeaf(IndexCursor &cursor, const bool returned,
+                                 T &lastVal) {
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  if (returned && cursor.descending) {
+    // The last entry returned is the one after the next
+    lastVal = node->getKey(cursor.nextEntry + 1);
+    cursor.lastRid = node->getRid(cursor.nextEntry + 1);
+    cursor.lastValDups = cursor.nextEntry + 2 - node->lowerBound(lastVal);
+  } else if (returned) {
+    if (cursor.nextEntry > 0) {
+      lastVal = node->getKey(cursor.nextEntry - 1);
+      cursor.lastRid = node->getRid(cursor.nextEntry - 1);
+      cursor.lastValDups = cursor.nextEntry - node->lowerBound(lastVal);
+    } else {
+      // Nothing returned from this leaf yet. Its keys are all at least the
+      // last one returned, so the low bound finds the position.
+      cursor.lastValDups = 0;
+    }
+  }
+
+  PageLatch &latch = this->latches.latchFor(cursor.currentPageNum);
+  cursor.leafVersion = latch.getVersion();
+  latch.unlockShared();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
+
+/**
+ * Fetch the record id of the next index entry that matches the scan.
+ * Return the next record from current page being scanned. If current page has
+ * been scanned to its entirety, move on to the right sibling of current page,
+ * if any exists, to start scanning that page. Make sure to unpin any pages
+ * that are no longer required.
+ * @param outRid RecordId of next record found that satisfies the scan
+ * criteria returned in this
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ * criteria, are left to be scanned.
+ **/
+void BTreeIndex::scanNext(RecordId &outRid) { scanNext(this->scan, outRid); }
+
+/**
+ * Fetch the record id of the next index entry that matches the scan of cursor,
+ * as scanNext() does without one.
+ * @param cursor Cursor started on this index
+ * @param outRid RecordId of next record found that satisfies the scan
+ * criteria returned in this
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ * criteria, are left to be scanned.
+ **/
+void BTreeIndex::scanNext(IndexCursor &cursor, RecordId &outRid) {
+  scanNext(cursor, outRid, NULL);
+}
+
+/**
+ * Fetch the record id and the key of the next index entry that matches the
+ * scan.
+ * @param outRid RecordId of next record found that satisfies the scan
+ * criteria returned in this
+ * @param outKey Receives the key: an integer, a double, or STRINGSIZE
+ * characters without a terminator
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ * criteria, are left to be scanned.
+ **/
+void BTreeIndex::scanNext(RecordId &outRid, void *outKey) {
+  scanNext(this->scan, outRid, outKey);
+}
+
+/**
+ * Fetch the record id and the key of the next index entry that matches the
+ * scan of cursor.
+ * @param cursor Cursor started on this index
+ * @param outRid RecordId of next record found that satisfies the scan
+ * criteria returned in this
+ * @param outKey Receives the key, or NULL if it is not needed
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ * criteria, are left to be scanned.
+ **/
+void BTreeIndex::scanNext(IndexCursor &cursor, RecordId &outRid,
+                          void *outKey) {
+  // If startScan has not been called, then we don't know what we are scanning
+  // for so throw error
+  if (!cursor.scanExecuting) throw ScanNotInitializedException();
+  OpCount count(this->scanNextCounters);
+
+  switch (this->attributeType) {
+    case INTEGER:
+      scanNextKey(cursor, outRid, static_cast<int *>(outKey),
+                  cursor.lowValInt, cursor.highValInt, cursor.lastValInt);
+      break;
+    case DOUBLE:
+      scanNextKey(cursor, outRid, static_cast<double *>(outKey),
+                  cursor.lowValDouble, cursor.highValDouble,
+                  cursor.lastValDouble);
+      break;
+    case STRING:
+      scanNextKey(cursor, outRid, static_cast<StringKey *>(outKey),
+                  cursor.lowValString, cursor.highValString,
+                  cursor.lastValString);
+      break;
+    case COMPOSITE:
+      scanNextKey(cursor, outRid, static_cast<CompositeKey *>(outKey),
+                  cursor.lowValComposite, cursor.highValComposite,
+                  cursor.lastValComposite);
+      break;
+  }
+}
+
+/**
+ * A helper method that fetches the next entry of the scan for the index's key
+ * type. scanNext() passes in the bounds stored by startScan().
+ *
+ * @param cursor  Cursor of the scan
+ * @param outRid  RecordId of next record found that satisfies the scan
+ * @param outKey  Receives the key of the entry, if not NULL
+ * @param lowVal  Low value of range
+ * @param highVal High value of range
+ * @param lastVal Last key returned from the cursor's leaf
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ *criteria, are left to be scanned.
+ */
+template <class T>
+void BTreeIndex::scanNextKey(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                             const T &lowVal, const T &highVal, T &lastVal) {
+  if (cursor.descending) {
+    scanPrevKey(cursor, outRid, outKey, lowVal, highVal, lastVal);
+    return;
+  }
+  latchScanLeaf(cursor, lowVal, highVal, lastVal);
+
+  bool validKey = false;
+  while (true) {
+    // The check is picked by the operator of the current range's high bound
+    validKey = cursor.highOp == LT
+                   ? takeNext<T, LT>(cursor, outRid, outKey, highVal)
+                   : takeNext<T, LTE>(cursor, outRid, outKey, highVal);
+    const LeafNode<T> *node =
+        reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+    if (validKey || cursor.nextEntry >= node->numKeys) break;
+
+    // Past the high bound, so the scan goes on with the next range
+    if (!advanceRange(cursor)) break;
+    seekLow<T>(cursor, lowVal, true);
+  }
+
+  unlatchScanLeaf(cursor, validKey, lastVal);
+
+  // If no entry is left or the next one is out of range, the scan is complete
+  if (!validKey) throw IndexScanCompletedException();
+}
+
+/**
+ * A helper method that takes the entry at the position of an ascending scan,
+ * moving right past exhausted leaves, if it is within the high bound.
+ *
+ * @param cursor  Cursor of the scan, with its leaf latched
+ * @param outRid  RecordId of the entry
+ * @param outKey  Receives the key of the entry, if not NULL
+ * @param highVal High value of range
+ * @return  False if no entry is left or the next one is past the high bound
+ */
+template <class T, Operator HighOp>
+bool BTreeIndex::takeNext(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                          const T &highVal) {
+  // Move on while there is a next leaf node. The last leaf stays pinned until
+  // endScan().
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  while (cursor.nextEntry >= node->numKeys && node->rightSibPageNo) {
+    stepRight<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  }
+  if (cursor.nextEntry >= node->numKeys) return false;
+
+  // The position keeps the low bound, so only the high one is compared
+  const T key = node->getKey(cursor.nextEntry);
+  if (!ScanBound<HighOp>::holds(key, highVal)) return false;
+  outRid = node->getRid(cursor.nextEntry);
+  if (outKey != NULL) *outKey = key;
+  cursor.nextEntry++;
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatch
+// -----------------------------------------------------------------------------
+
+/**
+ * Fetch the record ids of the next index entries that match the scan, up to
+ * maxRids of them. The matching entries of each leaf are found with a single
+ * search for the high bound and copied at once. Pages are pinned and unpinned
+ * as in scanNext(), which may be mixed with this call.
+ * @param outRids Array receiving the RecordIds of matching entries
+ * @param maxRids Number of RecordIds outRids can hold
+ * @return Number of RecordIds written to outRids. Fewer than maxRids means the
+ * scan is complete, and once it is every further call returns 0.
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+std::size_t BTreeIndex::scanNextBatch(RecordId *outRids,
+                                      const std::size_t maxRids) {
+  return scanNextBatch(this->scan, outRids, maxRids);
+}
+
+/**
+ * Fetch the record ids of the next index entries that match the scan of
+ * cursor, up to maxRids of them, as scanNextBatch() does without one.
+ * @param cursor  Cursor started on this index
+ * @param outRids Array receiving the RecordIds of matching entries
+ * @param maxRids Number of RecordIds outRids can hold
+ * @return Number of RecordIds written to outRids. Fewer than maxRids means the
+ * scan is complete, and once it is every further call returns 0.
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+std::size_t BTreeIndex::scanNextBatch(IndexCursor &cursor, RecordId *outRids,
+                                      const std::size_t maxRids) {
+  return scanNextBatch(cursor, outRids, NULL, maxRids);
+}
+
+/**
+ * Fetch the record ids and the keys of the next index entries that match the
+ * scan, up to maxRids of them.
+ * @param outRids Array receiving the RecordIds of matching entries, or NULL
+ * @param outKeys Array receiving the keys of matching entries
+ * @param maxRids Number of entries the arrays can hold
+ * @return Number of entries written. Fewer than maxRids means the scan is
+ * complete, and once it is every further call returns 0.
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+std::size_t BTreeIndex::scanNextBatch(RecordId *outRids, void *outKeys,
+                                      const std::size_t maxRids) {
+  return scanNextBatch(this->scan, outRids, outKeys, maxRids);
+}
+
+/**
+ * Fetch the record ids and the keys of the next index entries that match the
+ * scan of cursor, up to maxRids of them.
+ * @param cursor  Cursor started on this index
+ * @param outRids Array receiving the RecordIds of matching entries, or NULL
+ * @param outKeys Array receiving the keys of matching entries, or NULL
+ * @param maxRids Number of entries the arrays can hold
+ * @return Number of entries written. Fewer than maxRids means the scan is
+ * complete, and once it is every further call returns 0.
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+std::size_t BTreeIndex::scanNextBatch(IndexCursor &cursor, RecordId *outRids,
+                                      void *outKeys,
+                                      const std::size_t maxRids) {
+  if (!cursor.scanExecuting) throw ScanNotInitializedException();
+
+  switch (this->attributeType) {
+    case INTEGER:
+      return scanNextBatchKey(cursor, outRids, static_cast<int *>(outKeys),
+                              maxRids, cursor.lowValInt, cursor.highValInt,
+                              cursor.lastValInt);
+    case DOUBLE:
+      return scanNextBatchKey(cursor, outRids, static_cast<double *>(outKeys),
+                              maxRids, cursor.lowValDouble,
+                              cursor.highValDouble, cursor.lastValDouble);
+    case STRING:
+      return scanNextBatchKey(cursor, outRids,
+                              static_cast<StringKey *>(outKeys), maxRids,
+                              cursor.lowValString, cursor.highValString,
+                              cursor.lastValString);
+    case COMPOSITE:
+      return scanNextBatchKey(cursor, outRids,
+                              static_cast<CompositeKey *>(outKeys), maxRids,
+                              cursor.lowValComposite, cursor.highValComposite,
+                              cursor.lastValComposite);
+  }
+  return 0;
+}
+
+/**
+ * A helper method that fetches the next run of entries of the scan for the
+ * index's key type. scanNextBatch() passes in the high bound stored by
+ * startScan().
+ *
+ * @param cursor  Cursor of the scan
+ * @param outRids Array receiving the RecordIds, or NULL
+ * @param outKeys Array receiving the keys, or NULL
+ * @param maxRids Number of entries the arrays can hold
+ * @param lowVal  Low value of range
+ * @param highVal High value of range
+ * @param lastVal Last key returned from the cursor's leaf
+ * @return Number of entries found
+ */
+template <class T>
+std::size_t BTreeIndex::scanNextBatchKey(IndexCursor &cursor,
+                                         RecordId *outRids, T *outKeys,
+                                         const std::size_t maxRids,
+                                         const T &lowVal, const T &highVal,
+                                         T &lastVal) {
+  if (cursor.descending) {
+    return scanPrevBatchKey(cursor, outRids, outKeys, maxRids, lowVal,
+                            highVal, lastVal);
+  }
+  latchScanLeaf(cursor, lowVal, highVal, lastVal);
+
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  std::size_t count = 0;
+
+  // Entries before it were returned from earlier ranges
+  std::size_t rangeStart = 0;
+
+  while (count < maxRids) {
+    if (cursor.nextEntry >= node->numKeys) {
+      // The last leaf stays pinned until endScan() like in scanNext()
+      if (!node->rightSibPageNo) break;
+
+      stepRight<T>(cursor);
+      node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+      continue;
+    }
+
+    // Every entry from nextEntry on satisfies the low bound, so the run ends
+    // at the first entry past the high bound
+    const int end = boundPosition(*node, cursor.highOp, highVal);
+    if (end > cursor.nextEntry) {
+      const int run = (int)std::min<std::size_t>(end - cursor.nextEntry,
+                                                 maxRids - count);
+      if (outRids != NULL) {
+        node->copyRids(cursor.nextEntry, run, outRids + count);
+      }
+      if (outKeys != NULL) {
+        node->copyKeys(cursor.nextEntry, run, outKeys + count);
+      }
+      count += run;
+      cursor.nextEntry += run;
+    }
+
+    if (end < node->numKeys) {
+      // Reached the high bound, so the scan goes on with the next range
+      if (cursor.nextEntry < end || !advanceRange(cursor)) break;
+      seekLow<T>(cursor, lowVal, true);
+      node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+      rangeStart = count;
+    }
+  }
+
+  // The cursor's position is found from the low bound if nothing was returned
+  // from the current range
+  unlatchScanLeaf(cursor, count > rangeStart, lastVal);
+  return count;
+}
+
+/**
+ * A helper method that fetches the next entry of a descending scan.
+ *
+ * @param cursor  Cursor of the scan
+ * @param outRid  RecordId of next record found that satisfies the scan
+ * @param outKey  Receives the key of the entry, if not NULL
+ * @param lowVal  Low value of range
+ * @param highVal High value of range
+ * @param lastVal Last key returned from the cursor's leaf
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ *criteria, are left to be scanned.
+ */
+template <class T>
+void BTreeIndex::scanPrevKey(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                             const T &lowVal, const T &highVal, T &lastVal) {
+  latchScanLeaf(cursor, lowVal, highVal, lastVal);
+  const bool validKey =
+      cursor.lowOp == GTE
+          ? takePrev<T, GTE>(cursor, outRid, outKey, lowVal)
+          : takePrev<T, GT>(cursor, outRid, outKey, lowVal);
+  unlatchScanLeaf(cursor, validKey, lastVal);
+  if (!validKey) throw IndexScanCompletedException();
+}
+
+/**
+ * A helper method that takes the entry at the position of a descending scan,
+ * moving left past exhausted leaves, if it is within the low bound.
+ *
+ * @param cursor  Cursor of the scan, with its leaf latched
+ * @param outRid  RecordId of the entry
+ * @param outKey  Receives the key of the entry, if not NULL
+ * @param lowVal  Low value of range
+ * @return  False if no entry is left or the next one is past the low bound
+ */
+template <class T, Operator LowOp>
+bool BTreeIndex::takePrev(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                          const T &lowVal) {
+  // The first leaf stays pinned until endScan()
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  while (cursor.nextEntry < 0 && node->leftSibPageNo) {
+    stepLeft<T>(cursor);
+    node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  }
+  if (cursor.nextEntry < 0) return false;
+
+  // Entries before the position are all within the high bound
+  const T key = node->getKey(cursor.nextEntry);
+  if (!ScanBound<LowOp>::holds(key, lowVal)) return false;
+  outRid = node->getRid(cursor.nextEntry);
+  if (outKey != NULL) *outKey = key;
+  cursor.nextEntry--;
+  return true;
+}
+
+/**
+ * A helper method that fetches the next run of entries of a descending scan.
+ *
+ * @param cursor  Cursor of the scan
+ * @param outRids Array receiving the RecordIds, or NULL
+ * @param outKeys Array receiving the keys, or NULL
+ * @param maxRids Number of entries the arrays can hold
+ * @param lowVal  Low value of range
+ * @param highVal High value of range
+ * @param lastVal Last key returned from the cursor's leaf
+ * @return Number of entries found
+ */
+template <class T>
+std::size_t BTreeIndex::scanPrevBatchKey(IndexCursor &cursor,
+                                         RecordId *outRids, T *outKeys,
+                                         const std::size_t maxRids,
+                                         const T &lowVal, const T &highVal,
+                                         T &lastVal) {
+  latchScanLeaf(cursor, lowVal, highVal, lastVal);
+
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+  std::size_t count = 0;
+  bool fromLeaf = false;
+
+  while (count < maxRids) {
+    if (cursor.nextEntry < 0) {
+      if (!node->leftSibPageNo) break;
+
+      stepLeft<T>(cursor);
+      node = reinterpret_cast<LeafNode<T> *>(cursor.currentPageData);
+      fromLeaf = false;
+      continue;
+    }
+
+    // Every entry up to nextEntry satisfies the high bound, so the run ends
+    // at the last entry past the low bound
+    const int begin = boundPosition(*node, cursor.lowOp, lowVal);
+    if (begin <= cursor.nextEntry) {
+      const int run = (int)std::min<std::size_t>(cursor.nextEntry + 1 - begin,
+                                                 maxRids - count);
+      for (int k = 0; k < run; k++) {
+        if (outRids != NULL) {
+          outRids[count + k] = node->getRid(cursor.nextEntry - k);
+        }
+        if (outKeys != NULL) {
+          outKeys[count + k] = node->getKey(cursor.nextEntry - k);
+        }
+      }
+      count += run;
+      cursor.nextEntry -= run;
+      fromLeaf = true;
+    }
+
+    if (begin > 0 && cursor.nextEntry < begin) break;  // Reached the low bound
+  }
+
+  unlatchScanLeaf(cursor, fromLeaf, lastVal);
+  return count;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::count
+// -----------------------------------------------------------------------------
+
+/**
+ * Count the entries in a range, reading only the leaves.
+ * @param lowVal  Low value of range, or NULL to leave it open below
+ * @param lowOp   Low operator (GT/GTE)
+ * @param highVal High value of range, or NULL to leave it open above
+ * @param highOp  High operator (LT/LTE)
+ * @return Number of entries in the range
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their
+ * expected values
+ * @throws  BadScanrangeException If lowVal > highVal
+ **/
+std::size_t BTreeIndex::count(void *lowVal, const Operator lowOp,
+                              void *highVal, const Operator highOp) {
+  const ScanRange range = {lowVal, lowOp, highVal, highOp};
+  return countRanges(&range, 1);
+}
+
+/**
+ * Count the entries in several ranges, reading only the leaves.
+ * @param ranges  Ranges to count, sorted by their bounds and disjoint
+ * @return Number of entries in the ranges
+ * @throws  BadScanrangeException If the ranges are empty, overlap or are out
+ * of order
+ **/
+std::size_t BTreeIndex::count(const std::vector<ScanRange> &ranges) {
+  if (ranges.empty()) throw BadScanrangeException();
+  return countRanges(&ranges[0], ranges.size());
+}
+
+/**
+ * A helper method that counts the entries in one or more ranges with a scan
+ * of its own, which copies out neither RecordIds nor keys.
+ *
+ * @param ranges     Ranges to count, sorted and disjoint
+ * @param numRanges  Number of ranges, at least 1
+ * @return Number of entries in the ranges
+ */
+std::size_t BTreeIndex::countRanges(const ScanRange *ranges,
+                                    const std::size_t numRanges) {
+  IndexCursor cursor;
+  try {
+    startRanges(cursor, ranges, numRanges, false);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+  const std::size_t found = scanNextBatch(
+      cursor, NULL, NULL, std::numeric_limits<std::size_t>::max());
+  endScan(cursor);
+  return found;
+}
+
+/**
+ * Find the smallest key of the index, reading only the leftmost leaf that
+ * holds an entry.
+ * @param outKey  Receives the key: an integer, a double, or STRINGSIZE
+ * characters without a terminator
+ * @return  False if the index is empty
+ **/
+bool BTreeIndex::min(void *outKey) {
+  flushInserts();
+  switch (this->attributeType) {
+    case INTEGER:
+      return edgeKey(false, *static_cast<int *>(outKey));
+    case DOUBLE:
+      return edgeKey(false, *static_cast<double *>(outKey));
+    case STRING:
+      return edgeKey(false, *static_cast<StringKey *>(outKey));
+    case COMPOSITE:
+      return edgeKey(false, *static_cast<CompositeKey *>(outKey));
+  }
+  return false;
+}
+
+/**
+ * Find the largest key of the index, reading only the rightmost leaf unless
+ * it is empty.
+ * @param outKey  Receives the key, as for min()
+ * @return  False if the index is empty
+ **/
+bool BTreeIndex::max(void *outKey) {
+  flushInserts();
+  switch (this->attributeType) {
+    case INTEGER:
+      return edgeKey(true, *static_cast<int *>(outKey));
+    case DOUBLE:
+      return edgeKey(true, *static_cast<double *>(outKey));
+    case STRING:
+      return edgeKey(true, *static_cast<StringKey *>(outKey));
+    case COMPOSITE:
+      return edgeKey(true, *static_cast<CompositeKey *>(outKey));
+  }
+  return false;
+}
+
+/**
+ * A helper method that finds the smallest or the largest key of the index.
+ * The leaf at that end of the tree is the only one read unless it is empty.
+ *
+ * @param last    True for the largest key
+ * @param outKey  Receives the key
+ * @return  False if the index is empty
+ */
+template <class T>
+bool BTreeIndex::edgeKey(const bool last, T &outKey) {
+  Page *page;
+  PageId pageNo = latchLeafShared(
+      last ? KeyTraits<T>::highest() : KeyTraits<T>::lowest(), page);
+  LeafNode<T> *node = reinterpret_cast<LeafNode<T> *>(page);
+
+  // Leaves right of the one found for the largest key can only hold that key
+  // again. Leaves emptied by deletes are passed over on the way to the
+  // smallest key.
+  while ((last || node->numKeys == 0) && node->rightSibPageNo) {
+    const PageId nextLeaf = node->rightSibPageNo;
+    this->latches.latchFor(nextLeaf).lockShared();
+    Page *nextPage;
+    readNode(nextLeaf, nextPage);
+    this->latches.latchFor(pageNo).unlockShared();
+    releaseNode(pageNo);
+    pageNo = nextLeaf;
+    page = nextPage;
+    node = reinterpret_cast<LeafNode<T> *>(page);
+  }
+
+  const bool found = node->numKeys > 0;
+  if (found) outKey = node->getKey(last ? node->numKeys - 1 : 0);
+  this->latches.latchFor(pageNo).unlockShared();
+  releaseNode(pageNo);
+  if (found || !last) return found;
+
+  // The last leaf is empty, so a descending scan goes left to the largest key
+  IndexCursor cursor;
+  try {
+    startScan(cursor, NULL, GTE, NULL, LTE, true);
+  } catch (const NoSuchKeyFoundException &e) {
+    return false;
+  }
+  RecordId rid;
+  try {
+    scanNext(cursor, rid, &outKey);
+  } catch (const IndexScanCompletedException &e) {
+    endScan(cursor);
+    return false;
+  }
+  endScan(cursor);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::estimateRange
+// -----------------------------------------------------------------------------
+
+/**
+ * Estimate the number of entries in a range from the entry counts of the
+ * non-leaf nodes, going down the tree once for each bound that is not open.
+ * @param lowVal  Low value of range, or NULL to leave it open below
+ * @param lowOp   Low operator (GT/GTE)
+ * @param highVal High value of range, or NULL to leave it open above
+ * @param highOp  High operator (LT/LTE)
+ * @return Estimated number of entries in the range
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of their
+ * expected values
+ * @throws  BadScanrangeException If lowVal > highVal
+ **/
+std::size_t BTreeIndex::estimateRange(void *lowVal, const Operator lowOp,
+                                      void *highVal, const Operator highOp) {
+  if (!((lowOp == GT || lowOp == GTE) && (highOp == LT || highOp == LTE))) {
+    throw BadOpcodesException();
+  }
+  flushInserts();
+  refreshStaleCounts();
+
+  const ScanRange range = {lowVal, lowOp, highVal, highOp};
+  switch (this->attributeType) {
+    case INTEGER:
+      return estimateRangeKey<int>(range);
+    case DOUBLE:
+      return estimateRangeKey<double>(range);
+    case STRING:
+      return estimateRangeKey<StringKey>(range);
+    case COMPOSITE:
+      return estimateRangeKey<CompositeKey>(range);
+  }
+  return 0;
+}
+
+/**
+ * Estimate the number of entries with a key less than the given one, or not
+ * greater than it if inclusive, going down the tree once.
+ * @param key       Key to rank, pointer to integer/double/char string
+ * @param inclusive If true, entries with the key are counted as well
+ * @return Estimated number of entries
+ **/
+std::size_t BTreeIndex::estimateRank(const void *key, const bool inclusive) {
+  flushInserts();
+  refreshStaleCounts();
+  switch (this->attributeType) {
+    case INTEGER:
+      return rankKey(KeyTraits<int>::load(key), inclusive);
+    case DOUBLE:
+      return rankKey(KeyTraits<double>::load(key), inclusive);
+    case STRING:
+      return rankKey(KeyTraits<StringKey>::load(key), inclusive);
+    case COMPOSITE:
+      return rankKey(KeyTraits<CompositeKey>::load(key), inclusive);
+  }
+  return 0;
+}
+
+/**
+ * Find a key that about the given fraction of the entries come before.
+ * @param fraction  Fraction of the entries, in [0, 1]
+ * @param outKey    Receives the key, as for scanNext()
+ * @return  False if the index is empty
+ **/
+bool BTreeIndex::estimateQuantile(const double fraction, void *outKey) {
+  flushInserts();
+  refreshStaleCounts();
+  const double clamped = std::min(1.0, std::max(0.0, fraction));
+  switch (this->attributeType) {
+    case INTEGER:
+      return quantileKey(clamped, *static_cast<int *>(outKey));
+    case DOUBLE:
+      return quantileKey(clamped, *static_cast<double *>(outKey));
+    case STRING:
+      return quantileKey(clamped, *static_cast<StringKey *>(outKey));
+    case COMPOSITE:
+      return quantileKey(clamped, *static_cast<CompositeKey *>(outKey));
+  }
+  return false;
+}
+
+/**
+ * A helper method that estimates the number of entries in a range for the
+ * index's key type. The entries below the high bound less those below the low
+ * bound are the ones in the range.
+ *
+ * @param range  Range to estimate, with its operators checked
+ * @return  Estimated number of entries
+ * @throws  BadScanrangeException If the low bound is above the high bound
+ */
+template <class T>
+std::size_t BTreeIndex::estimateRangeKey(const ScanRange &range) {
+  const T low = range.lowVal != NULL ? KeyTraits<T>::load(range.lowVal)
+                                     : KeyTraits<T>::lowest();
+  const T high = range.highVal != NULL ? KeyTraits<T>::load(range.highVal)
+                                       : KeyTraits<T>::highest();
+  if (low > high) throw BadScanrangeException();
+
+  const std::size_t below =
+      range.lowVal != NULL ? rankKey(low, range.lowOp == GT) : 0;
+  const std::size_t upTo =
+      rankKey(high, range.highVal == NULL || range.highOp == LTE);
+  return upTo > below ? upTo - below : 0;
+}
+
+/**
+ * A helper method that estimates the number of entries with a key below key,
+ * or not above it if inclusive. Each non-leaf node on the way down adds the
+ * counts of its children left of the one gone down to, and the leaf reached
+ * adds its own entries before the key. Nodes are latched in shared mode, each
+ * until its child is.
+ *
+ * @param key       Key to rank
+ * @param inclusive True to count entries equal to key as well
+ * @return  Estimated number of entries
+ */
+template <class T>
+std::size_t BTreeIndex::rankKey(const T &key, const bool inclusive) {
+  this->rootLatch.lockShared();
+  PageId pageNo = this->rootPageNum;
+  bool isLeaf = this->initialRootPageId == pageNo;
+  PageLatch *latch = &this->latches.latchFor(pageNo);
+  latch->lockShared();
+  this->rootLatch.unlockShared();
+
+  Page *page;
+  bool pinned = false;
+  int depth = 0;
+  if (isLeaf) {
+    readNode(pageNo, page);
+  } else {
+    pinned = readInternal(pageNo, depth, page);
+  }
 
-  insert(rootPage, this->rootPageNum, this->initialRootPageId == this->rootPageNum, newEntry, newInternal);
-}
+  std::size_t rank = 0;
+  while (!isLeaf) {
+    NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
 
-  /**
-   * A helper method that inserts a data entry into the index
-   *
-   * @param currPage         Current page we are on
-   * @param currPageId       pageId of current page
-   * @param isLeaf           True if current page is leaf
-   * @param newEntry         Data entry of interest
-   * @param newInternal      Internal used for pushing up key
-  */
-void BTreeIndex::insert(Page *currPage, PageId currPageId, bool isLeaf, const RIDKeyPair<int> newEntry, PageKeyPair<int> *&newInternal) {
-  if (isLeaf) {
-    // Get current page
-    LeafNodeInt *leaf = reinterpret_cast<LeafNodeInt *>(currPage);
+    // Children left of pos hold only keys below (or up to) key, those right
+    // of it none
+    const int pos = inclusive ? node->upperBound(key) : node->lowerBound(key);
+    for (int i = 0; i < pos; i++) rank += node->getCount(i);
 
-    if (!leaf->ridArray[this->leafOccupancy - 1].page_number) {
-      insertLeaf(leaf, newEntry);  // Node is not full, so insert leaf
-      this->bufMgr->unPinPage(this->file, currPageId, true);
+    isLeaf = node->level;
+    const PageId nextNo = node->getChild(pos);
+    PageLatch *nextLatch = &this->latches.latchFor(nextNo);
+    nextLatch->lockShared();
+    Page *nextPage;
+    bool nextPinned = false;
+    depth++;
+    if (isLeaf) {
+      readNode(nextNo, nextPage);
     } else {
-      splitLeaf(leaf, currPageId, newInternal, newEntry);
+      nextPinned = readInternal(nextNo, depth, nextPage);
     }
-  } else {
-    NonLeafNodeInt *currNode = reinterpret_cast<NonLeafNodeInt *>(currPage);
+    latch->unlockShared();
+    if (pinned) this->bufMgr->unPinPage(this->file, pageNo, false);
 
-    Page *nextPage;
-    PageId nextNodeId;
-
-    // Find next node one level down
-    findNextInternal(currNode, nextNodeId, newEntry.key);
+    pageNo = nextNo;
+    page = nextPage;
+    pinned = nextPinned;
+    latch = nextLatch;
+  }
 
-    // Get next page
-    this->bufMgr->readPage(this->file, nextNodeId, nextPage);
+  LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+  rank += inclusive ? leaf->upperBound(key) : leaf->lowerBound(key);
+  latch->unlockShared();
+  releaseNode(pageNo);
+  return rank;
+}
 
-    insert(nextPage, nextNodeId, currNode->level, newEntry, newInternal);
+/**
+ * A helper method that sets the entry counts of the non-leaves again if more
+ * than one in STALE_COUNT_DIVISOR of the entries were inserted or deleted
+ * since they last were. Entries that change while the counts are being set
+ * are left for the next time.
+ */
+void BTreeIndex::refreshStaleCounts() {
+  const std::size_t stale = this->staleEntries.load();
+  if (stale == 0 ||
+      stale <= this->countedEntries.load() / STALE_COUNT_DIVISOR) {
+    return;
+  }
+  this->staleEntries.fetch_sub(stale);
 
-    if (!newInternal) {
-      this->bufMgr->unPinPage(this->file, currPageId, false);  // Parent node did not need to be split
-    } else {
-      if (!currNode->pageNoArray[this->nodeOccupancy]) {
-        insertInternal(currNode, newInternal);  // Internal not full so insert
-        newInternal = nullptr;
-        this->bufMgr->unPinPage(this->file, currPageId, true);
-      } else {
-        splitInternal(currNode, currPageId, newInternal);
-      }
-    }
+  std::size_t counted = 0;
+  switch (this->attributeType) {
+    case INTEGER:
+      counted = refreshCounts<int>();
+      break;
+    case DOUBLE:
+      counted = refreshCounts<double>();
+      break;
+    case STRING:
+      counted = refreshCounts<StringKey>();
+      break;
+    case COMPOSITE:
+      counted = refreshCounts<CompositeKey>();
+      break;
   }
+  this->countedEntries = counted;
 }
 
 /**
-  * A helper method that finds next node to traverse to down the tree
-  *
-  * @param internal Current node we are on
-  * @param pageId   Return value for the next level page ID
-  * @param key      Key being compared
+ * A helper method that sets the entry counts of the non-leaves again for the
+ * index's key type.
+ *
+ * @return  Number of entries in the index
  */
-void BTreeIndex::findNextInternal(NonLeafNodeInt *internal, PageId &pageId, int key) {
-  for (int i = this->nodeOccupancy; i > 0; i--) {
-    if (internal->pageNoArray[i] != 0 && internal->keyArray[i - 1] < key) {
-      pageId = internal->pageNoArray[i];
-      return;
-    }
-  }
-  pageId = internal->pageNoArray[0];
+template <class T>
+std::size_t BTreeIndex::refreshCounts() {
+  this->rootLatch.lockShared();
+  const PageId rootId = this->rootPageNum;
+  this->rootLatch.unlockShared();
+
+  // A tree of a single leaf has no counts to set
+  if (rootId == this->initialRootPageId) return 0;
+  return refreshNodeCounts<T>(rootId);
 }
 
 /**
- * A helper mehtod that is called when the root node needs to be split
+ * A helper method that sets the entry counts of a non-leaf, and of the
+ * non-leaves under it, from the number of entries in the leaves. A parent of
+ * leaves is latched exclusively while it counts them, each leaf latched in
+ * shared mode in turn. A non-leaf above those is only latched while its
+ * children are read and while their counts are set, and if it changed in
+ * between, it keeps the counts the split that changed it set.
  *
- * @param firstPage   pageId of first page in root
- * @param newInternal Internal for split process
-*/
-void BTreeIndex::splitRoot(PageId firstPage, PageKeyPair<int> *newInternal) {
-  // Create a new root
-  PageId newRootPageNum;
-  Page *newRoot;
-  this->bufMgr->allocPage(this->file, newRootPageNum, newRoot);
-  NonLeafNodeInt *newRootPage = reinterpret_cast<NonLeafNodeInt *>(newRoot);
+ * @param pageId  Page of the non-leaf
+ * @return  Number of entries under the non-leaf
+ */
+template <class T>
+std::size_t BTreeIndex::refreshNodeCounts(const PageId pageId) {
+  PageLatch &latch = this->latches.latchFor(pageId);
+  latch.lockShared();
+  Page *page;
+  this->bufMgr->readPage(this->file, pageId, page);
+  NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
+  std::size_t total = 0;
+  bool dirty = false;
 
-  int level;
-  if (initialRootPageId == this->rootPageNum) {
-    level = 1;
-  } else {
-    level = 0;
+  if (node->level) {
+    latch.unlockShared();
+    latch.lock();
+    for (int i = 0; i <= node->numKeys; i++) {
+      const PageId childId = node->getChild(i);
+      PageLatch &childLatch = this->latches.latchFor(childId);
+      childLatch.lockShared();
+      Page *childPage;
+      this->bufMgr->readPage(this->file, childId, childPage);
+      const int count = reinterpret_cast<LeafNode<T> *>(childPage)->numKeys;
+      this->bufMgr->unPinPage(this->file, childId, false);
+      childLatch.unlockShared();
+      if (node->getCount(i) != (std::uint32_t)count) {
+        node->setCount(i, count);
+        dirty = true;
+      }
+      total += count;
+    }
+    this->bufMgr->unPinPage(this->file, pageId, dirty);
+    latch.unlock();
+    return total;
   }
 
-  // update metadata of the root page
-  newRootPage->level = level;
-  newRootPage->keyArray[0] = newInternal->key;
-  newRootPage->pageNoArray[0] = firstPage;
-  newRootPage->pageNoArray[1] = newInternal->pageNo;
+  std::vector<PageId> children(node->numKeys + 1);
+  for (int i = 0; i <= node->numKeys; i++) children[i] = node->getChild(i);
+  const std::uint32_t version = latch.getVersion();
+  latch.unlockShared();
 
-  Page *meta;
-  this->bufMgr->readPage(this->file, this->headerPageNum, meta);
-  IndexMetaInfo *metaPage = (IndexMetaInfo *)meta;
-  metaPage->rootPageNo = newRootPageNum;
-  this->rootPageNum = newRootPageNum;
+  std::vector<std::size_t> counts(children.size());
+  for (std::size_t i = 0; i < children.size(); i++) {
+    counts[i] = refreshNodeCounts<T>(children[i]);
+  }
 
-  // unpin pages that are no longer needed
-  this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
-  this->bufMgr->unPinPage(this->file, newRootPageNum, true);
+  latch.lock();
+  if (latch.getVersion() == version) {
+    for (int i = 0; i <= node->numKeys; i++) {
+      if (node->getCount(i) != (std::uint32_t)counts[i]) {
+        node->setCount(i, counts[i]);
+        dirty = true;
+      }
+      total += counts[i];
+    }
+  } else {
+    total = node->totalCount();
+  }
+  this->bufMgr->unPinPage(this->file, pageId, dirty);
+  latch.unlock();
+  return total;
 }
 
 /**
- * A helper method that splits a leaf and copys middle key up the tree.
+ * A helper method that finds a key with about fraction of the entries before
+ * it. Each non-leaf node on the way down goes to the child its share of the
+ * entries falls in, by their counts, and the leaf reached gives the entry at
+ * the same share of its own. An empty leaf passes the search on to the next
+ * one on its right.
  *
- * @param leaf        Leaf of interest
- * @param leafPageId  Page Id of leaf of interest
- * @param newInternal New internal node if parent node is full
- * @param newEntry    The new entry of interest
-*/
-void BTreeIndex::splitLeaf(LeafNodeInt *leaf, PageId leafPageId, PageKeyPair<int> *&newInternal, RIDKeyPair<int> newEntry) {
-  // Create new leaf
-  PageId newPageId;
-  Page *newPage;
-  this->bufMgr->allocPage(this->file, newPageId, newPage);
-  LeafNodeInt *newLeaf = reinterpret_cast<LeafNodeInt *>(newPage);
+ * @param fraction  Fraction of the entries, in [0, 1]
+ * @param outKey    Receives the key
+ * @return  False if the index is empty
+ */
+template <class T>
+bool BTreeIndex::quantileKey(const double fraction, T &outKey) {
+  this->rootLatch.lockShared();
+  PageId pageNo = this->rootPageNum;
+  bool isLeaf = this->initialRootPageId == pageNo;
+  PageLatch *latch = &this->latches.latchFor(pageNo);
+  latch->lockShared();
+  this->rootLatch.unlockShared();
 
-  int mid;
-  if (this->leafOccupancy % 2) {
-    mid = this->leafOccupancy / 2;
+  Page *page;
+  bool pinned = false;
+  int depth = 0;
+  if (isLeaf) {
+    readNode(pageNo, page);
   } else {
-    mid = this->leafOccupancy / 2 + 1;
+    pinned = readInternal(pageNo, depth, page);
   }
 
-  // Copy half the page to newLeaf
-  for (int i = mid; i < this->leafOccupancy; i++) {
-    newLeaf->keyArray[i - mid] = leaf->keyArray[i];
-    newLeaf->ridArray[i - mid] = leaf->ridArray[i];
-    leaf->keyArray[i] = 0;
-    leaf->ridArray[i].page_number = 0;
-  }
+  // Share of the entries under the current node that come before the key
+  double share = fraction;
+  while (!isLeaf) {
+    NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
+    const double target = share * node->totalCount();
+    int pos = 0;
+    double before = 0;
+    while (pos < node->numKeys && before + node->getCount(pos) <= target) {
+      before += node->getCount(pos);
+      pos++;
+    }
+    const std::uint32_t count = node->getCount(pos);
+    share = count > 0 ? std::min(1.0, (target - before) / count) : 0;
 
-  // Insert newEntry into appropriate leaf
-  if (newEntry.key > leaf->keyArray[mid - 1]) {
-    insertLeaf(newLeaf, newEntry);
-  } else {
-    insertLeaf(leaf, newEntry);
-  }
+    isLeaf = node->level;
+    const PageId nextNo = node->getChild(pos);
+    PageLatch *nextLatch = &this->latches.latchFor(nextNo);
+    nextLatch->lockShared();
+    Page *nextPage;
+    bool nextPinned = false;
+    depth++;
+    if (isLeaf) {
+      readNode(nextNo, nextPage);
+    } else {
+      nextPinned = readInternal(nextNo, depth, nextPage);
+    }
+    latch->unlockShared();
+    if (pinned) this->bufMgr->unPinPage(this->file, pageNo, false);
 
-  // Update sibling pointers
-  newLeaf->rightSibPageNo = leaf->rightSibPageNo;
-  leaf->rightSibPageNo = newPageId;
+    pageNo = nextNo;
+    page = nextPage;
+    pinned = nextPinned;
+    latch = nextLatch;
+  }
 
-  // Copy up the smallest key from new leaf to parent
-  newInternal = new PageKeyPair<int>();
-  PageKeyPair<int> newKeyPair;
-  newKeyPair.set(newPageId, newLeaf->keyArray[0]);
-  newInternal = &newKeyPair;
+  LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+  while (leaf->numKeys == 0 && leaf->rightSibPageNo) {
+    const PageId nextLeaf = leaf->rightSibPageNo;
+    this->latches.latchFor(nextLeaf).lockShared();
+    Page *nextPage;
+    readNode(nextLeaf, nextPage);
+    latch->unlockShared();
+    releaseNode(pageNo);
+    pageNo = nextLeaf;
+    page = nextPage;
+    latch = &this->latches.latchFor(pageNo);
+    leaf = reinterpret_cast<LeafNode<T> *>(page);
+  }
 
-  if (leafPageId == this->rootPageNum) splitRoot(leafPageId, newInternal); // Leaf is the root
+  const bool found = leaf->numKeys > 0;
+  if (found) {
+    outKey = leaf->getKey(
+        std::min(leaf->numKeys - 1, (int)(share * leaf->numKeys)));
+  }
+  latch->unlockShared();
+  releaseNode(pageNo);
 
-  this->bufMgr->unPinPage(this->file, leafPageId, true);
-  this->bufMgr->unPinPage(this->file, newPageId, true);
+  // Every leaf right of the one reached is empty, so the key is the largest
+  return found || edgeKey(true, outKey);
 }
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::setKeyFilter
+// -----------------------------------------------------------------------------
+
 /**
-  * A helper method that inserts a data entry into a leaf
-  * @param leaf     Leaf of interest
-  * @param newEntry Entry of interest
-  */
-void BTreeIndex::insertLeaf(LeafNodeInt *leaf, RIDKeyPair<int> newEntry) {
-  if (leaf->ridArray[0].page_number != 0) {  // Leaf is not empty
-    for (int i = this->leafOccupancy - 1; i >= 0; i--) {
-      if (leaf->ridArray[i].page_number != 0) {
-        if (leaf->keyArray[i] > newEntry.key) {
-          // Move the existing entry
-          leaf->keyArray[i + 1] = leaf->keyArray[i];
-          leaf->ridArray[i + 1] = leaf->ridArray[i];
-        } else {
-          // Insert the new entry
-          leaf->keyArray[i + 1] = newEntry.key;
-          leaf->ridArray[i + 1] = newEntry.rid;
-          return;
-        }
-      }
-    }
-  }
-  leaf->keyArray[0] = newEntry.key;
-  leaf->ridArray[0] = newEntry.rid;
+ * Give the index a key filter built from its entries, replacing any it has.
+ * @param expectedKeys   Number of keys the index is expected to hold
+ * @param bitsPerKey     Bits of filter per expected key
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+void BTreeIndex::setKeyFilter(const std::size_t expectedKeys,
+                              const int bitsPerKey) {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+  dropKeyFilter();
+
+  // k = ln 2 * bits per key is the fewest false positives
+  const std::size_t blockBits = FILTERBLOCKWORDS * 64;
+  const std::size_t bits =
+      std::max<std::size_t>(expectedKeys, 1) * std::max(bitsPerKey, 1);
+  const std::uint32_t blocks = (std::uint32_t)((bits + blockBits - 1) /
+                                               blockBits);
+  const int hashes = std::min(std::max((bitsPerKey * 69 + 50) / 100, 1), 16);
+  fillFilter(blocks, hashes);
 }
 
 /**
-  * A helper method that inserts splits an internal node and pushes the middle key upwards. Can recursively
-  * propagate up the tree
-  *
-  * @param oldNode         The internal node that's being split
-  * @param oldPageId       The page id of the internal node that's being split
-  * @param newInternal     Node with entry that will get pushed up
- */
-void BTreeIndex::splitInternal(NonLeafNodeInt *oldNode, PageId oldPageId, PageKeyPair<int> *&newInternal) {
-  // Allocate a new internal node
-  PageId newPageId;
-  Page *newPage;
-
-  this->bufMgr->allocPage(this->file, newPageId, newPage);
-  NonLeafNodeInt *newNode = reinterpret_cast<NonLeafNodeInt *>(newPage);
+ * Drop the key filter of the index and free its pages.
+ * @throws IndexReadOnlyException if the index was opened read-only
+ **/
+void BTreeIndex::dropKeyFilter() {
+  if (this->readOnly) throw IndexReadOnlyException(this->file->filename());
+  flushInserts();
+  this->filterWords.reset();
+  this->filterBlocks = 0;
+  this->filterHashes = 0;
 
-  int mid = this->nodeOccupancy / 2;
-  int pushupIndex = mid;
-  PageKeyPair<int> pushupEntry;
+  Page *metaPage;
+  this->bufMgr->readPage(this->file, this->headerPageNum, metaPage);
+  IndexMetaInfo *meta = reinterpret_cast<IndexMetaInfo *>(metaPage);
+  PageId pageNo = meta->filterPageNo;
+  const bool dropped = meta->filterBlocks > 0;
+  meta->filterPageNo = Page::INVALID_NUMBER;
+  meta->filterBlocks = 0;
+  meta->filterHashes = 0;
+  meta->filterSaved = false;
+  this->bufMgr->unPinPage(this->file, this->headerPageNum, dropped);
+  if (!dropped) return;
 
-  if (!(this->nodeOccupancy % 2)) {
-    // There are an even number of keys
-    if (newInternal->key < oldNode->keyArray[mid]) {
-      pushupIndex = mid - 1;
-    } else {
-      pushupIndex = mid;
+  // The pages go onto the free list along with retired leaves
+  {
+    std::lock_guard<std::mutex> lock(this->retiredLatch);
+    while (pageNo != Page::INVALID_NUMBER) {
+      Page *page;
+      this->bufMgr->readPage(this->file, pageNo, page);
+      const PageId nextPageNo = reinterpret_cast<FilterPage *>(page)->nextPageNo;
+      this->bufMgr->unPinPage(this->file, pageNo, false);
+      this->retiredNodes.push_back(pageNo);
+      pageNo = nextPageNo;
     }
   }
+  freeRetiredNodes();
+}
 
-  pushupEntry.set(newPageId, oldNode->keyArray[pushupIndex]);
-  mid = pushupIndex + 1;
-
-  // Move half of the entries to the new node and keep the other half here
-  for (int i = mid; i < this->nodeOccupancy; i++) {
-    newNode->keyArray[i - mid] = oldNode->keyArray[i];
-    newNode->pageNoArray[i - mid] = oldNode->pageNoArray[i + 1];
-    oldNode->pageNoArray[i + 1] = (PageId)0;
-    oldNode->keyArray[i + 1] = 0;
+template <class T>
+void BTreeIndex::filterAdd(const T &key) {
+  if (!this->filterWords) return;
+  const std::uint64_t hash = filterHash(key);
+  std::atomic<std::uint64_t> *block =
+      &this->filterWords[(hash >> 32) % this->filterBlocks * FILTERBLOCKWORDS];
+  std::uint32_t h = (std::uint32_t)hash;
+  const std::uint32_t delta = (h >> 17) | (h << 15);
+  for (int i = 0; i < this->filterHashes; i++) {
+    const std::uint32_t bit = h % (FILTERBLOCKWORDS * 64);
+    block[bit / 64].fetch_or((std::uint64_t)1 << (bit % 64),
+                             std::memory_order_relaxed);
+    h += delta;
   }
+}
 
-  newNode->level = oldNode->level;
-  oldNode->keyArray[pushupIndex] = 0;
-  oldNode->pageNoArray[pushupIndex] = (PageId) 0;
-
-  // Insert the child entry into the tree
-  NonLeafNodeInt *child;
-  if (newInternal->key < newNode->keyArray[0]) {
-    child = oldNode;
-  } else {
-    child = newNode;
+template <class T>
+bool BTreeIndex::filterMayContain(const T &key) {
+  if (!this->filterWords) return true;
+  const std::uint64_t hash = filterHash(key);
+  const std::atomic<std::uint64_t> *block =
+      &this->filterWords[(hash >> 32) % this->filterBlocks * FILTERBLOCKWORDS];
+  std::uint32_t h = (std::uint32_t)hash;
+  const std::uint32_t delta = (h >> 17) | (h << 15);
+  for (int i = 0; i < this->filterHashes; i++) {
+    const std::uint32_t bit = h % (FILTERBLOCKWORDS * 64);
+    const std::uint64_t word = block[bit / 64].load(std::memory_order_relaxed);
+    if ((word & ((std::uint64_t)1 << (bit % 64))) == 0) {
+      this->filterRejects.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    h += delta;
   }
+  return true;
+}
 
-  insertInternal(child, newInternal);
-  newInternal = &pushupEntry;
+void BTreeIndex::fillFilter(const std::uint32_t blocks, const int hashes) {
+  const std::size_t words = (std::size_t)blocks * FILTERBLOCKWORDS;
+  this->filterWords.reset(new std::atomic<std::uint64_t>[words]);
+  for (std::size_t w = 0; w < words; w++) this->filterWords[w].store(0);
+  this->filterBlocks = blocks;
+  this->filterHashes = hashes;
+  switch (this->attributeType) {
+    case INTEGER:
+      fillFilterKeys<int>();
+      break;
+    case DOUBLE:
+      fillFilterKeys<double>();
+      break;
+    case STRING:
+      fillFilterKeys<StringKey>();
+      break;
+    case COMPOSITE:
+      fillFilterKeys<CompositeKey>();
+      break;
+  }
+}
 
-  if (oldPageId == this->rootPageNum) splitRoot(oldPageId, newInternal); // currNode is the root
+template <class T>
+void BTreeIndex::fillFilterKeys() {
+  // The leaves are walked left to right, as findInLeaves() moves right
+  Page *page;
+  PageId pageNo = latchLeafShared(KeyTraits<T>::lowest(), page);
+  while (true) {
+    const LeafNode<T> *leaf = reinterpret_cast<const LeafNode<T> *>(page);
+    for (int i = 0; i < leaf->numKeys; i++) filterAdd(leaf->getKey(i));
+    const PageId nextNo = leaf->rightSibPageNo;
+    if (nextNo == Page::INVALID_NUMBER) break;
+    this->latches.latchFor(nextNo).lockShared();
+    Page *nextPage;
+    readNode(nextNo, nextPage);
+    this->latches.latchFor(pageNo).unlockShared();
+    releaseNode(pageNo);
+    pageNo = nextNo;
+    page = nextPage;
+  }
+  this->latches.latchFor(pageNo).unlockShared();
+  releaseNode(pageNo);
+}
 
-  this->bufMgr->unPinPage(this->file, oldPageId, true);
-  this->bufMgr->unPinPage(this->file, newPageId, true);
+void BTreeIndex::readFilter(PageId pageNo) {
+  const std::size_t words = (std::size_t)this->filterBlocks * FILTERBLOCKWORDS;
+  this->filterWords.reset(new std::atomic<std::uint64_t>[words]);
+  std::size_t w = 0;
+  while (w < words) {
+    Page *page;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    const FilterPage *filterPage = reinterpret_cast<const FilterPage *>(page);
+    const std::size_t n = std::min<std::size_t>(words - w, FILTERPAGEWORDS);
+    for (std::size_t i = 0; i < n; i++) {
+      this->filterWords[w + i].store(filterPage->words[i]);
+    }
+    w += n;
+    const PageId nextPageNo = filterPage->nextPageNo;
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+    pageNo = nextPageNo;
+  }
 }
 
-/**
- * A helper method that inserts a data entry into an internal node
- *
- * @param internal The internal node of interest
- * @param entry    The entry of interest
- *
- */
-void BTreeIndex::insertInternal(NonLeafNodeInt *internal, PageKeyPair<int> *newEntry) {
-  for (int i = this->nodeOccupancy; i >= 0; i--) {
-    if (!internal->pageNoArray[i]) {
-      continue; // There is no page here
+void BTreeIndex::saveFilter() {
+  // Each page is pinned until the link to the next one is set, the meta
+  // page's link to the first included
+  Page *page;
+  this->bufMgr->readPage(this->file, this->headerPageNum, page);
+  IndexMetaInfo *meta = reinterpret_cast<IndexMetaInfo *>(page);
+  meta->filterBlocks = this->filterBlocks;
+  meta->filterHashes = this->filterHashes;
+  PageId *link = &meta->filterPageNo;
+  PageId linkPageNo = this->headerPageNum;
+  const std::size_t words = (std::size_t)this->filterBlocks * FILTERBLOCKWORDS;
+  std::size_t w = 0;
+  while (w < words) {
+    PageId pageNo = *link;
+    if (pageNo == Page::INVALID_NUMBER) {
+      allocNode(pageNo, page);
+      reinterpret_cast<FilterPage *>(page)->nextPageNo = Page::INVALID_NUMBER;
+      *link = pageNo;
     } else {
-      if (internal->keyArray[i - 1] > newEntry->key) {
-        // move the pre-existing entry
-        internal->keyArray[i] = internal->keyArray[i - 1];
-        internal->pageNoArray[i + 1] = internal->pageNoArray[i];
-      } else {
-        // insert a new entry into the tree
-        internal->keyArray[i] = newEntry->key;
-        internal->pageNoArray[i + 1] = newEntry->pageNo;
-        return;
-      }
+      this->bufMgr->readPage(this->file, pageNo, page);
     }
+    this->bufMgr->unPinPage(this->file, linkPageNo, true);
+
+    FilterPage *filterPage = reinterpret_cast<FilterPage *>(page);
+    const std::size_t n = std::min<std::size_t>(words - w, FILTERPAGEWORDS);
+    for (std::size_t i = 0; i < n; i++) {
+      filterPage->words[i] = this->filterWords[w + i].load();
+    }
+    w += n;
+    link = &filterPage->nextPageNo;
+    linkPageNo = pageNo;
   }
-  internal->keyArray[0] = newEntry->key;
-  internal->pageNoArray[1] = newEntry->pageNo;
+  this->bufMgr->unPinPage(this->file, linkPageNo, true);
+
+  // The pages reach the file before the meta page says they are current
+  this->bufMgr->flushFile(this->file);
+  markFilterSaved(true);
+}
+
+void BTreeIndex::markFilterSaved(const bool saved) {
+  Page *page;
+  this->bufMgr->readPage(this->file, this->headerPageNum, page);
+  reinterpret_cast<IndexMetaInfo *>(page)->filterSaved = saved;
+  this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+  this->bufMgr->flushFile(this->file);
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::startScan
+// BTreeIndex::startSnapshotScan
 // -----------------------------------------------------------------------------
 
 /**
- * Begin a filtered scan of the index.  For instance, if the method is called
- * using ("a",GT,"d",LTE) then we should seek all entries with a value
- * greater than "a" and less than or equal to "d".
- * If another scan is already executing, that needs to be ended here.
- * Set up all the variables for scan. Start from root to find out the leaf page
- *that contains the first RecordID that satisfies the scan parameters. Keep that
- *page pinned in the buffer pool.
- * @param lowVal Low value of range, pointer to integer / double / char string
- * @param lowOp      Low operator (GT/GTE)
- * @param highVal    High value of range, pointer to integer / double / char
- *string
- * @param highOp High operator (LT/LTE)
- * @throws  BadOpcodesException If lowOp and highOp do not contain one of their
+ * Begin a snapshot scan of the index on cursor.
+ * @param cursor  Cursor that holds the state of the scan
+ * @param lowVal  Low value of range, or NULL for no low bound
+ * @param lowOp   Low operator (GT/GTE)
+ * @param highVal High value of range, or NULL for no high bound
+ * @param highOp  High operator (LT/LTE)
+ * @throws  BadOpcodesException If lowOp and highOp do not contain one of
  *their expected values
  * @throws  BadScanrangeException If lowVal > highval
  * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
  *satisfies the scan criteria.
  **/
-void BTreeIndex::startScan(void *lowValParm, const Operator lowOpParm,
-                           void *highValParm, const Operator highOpParm) {
-  // Get Int values range for scan
-  this->lowValInt = *((int *)lowValParm);
-  this->highValInt = *((int *)highValParm);
-
-  if (!((lowOpParm == GT || lowOpParm == GTE) && (highOpParm == LT || highOpParm == LTE))) {
-    // Check that the parameters are valid
+void BTreeIndex::startSnapshotScan(SnapshotCursor &cursor, void *lowVal,
+                                   const Operator lowOp, void *highVal,
+                                   const Operator highOp) {
+  if (!((lowOp == GT || lowOp == GTE) && (highOp == LT || highOp == LTE))) {
     throw BadOpcodesException();
-  } else if (this->lowValInt > this->highValInt) {
-    // Check that the ranges are valid
-    throw BadScanrangeException();
   }
+  flushInserts();
 
   // If the scan is already started, end it and start a new one
-  if (this->scanExecuting) this->endScan();
+  if (cursor.scanExecuting) cursor.index->endScan(cursor);
 
-  this->scanExecuting = true;
-  this->lowOp = lowOpParm;
-  this->highOp = highOpParm;
-  this->currentPageNum = this->rootPageNum;
-
-  // Read root page into the buffer pool
-  this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
+  const Operator low = lowVal != NULL ? lowOp : GTE;
+  const Operator high = highVal != NULL ? highOp : LTE;
+  switch (this->attributeType) {
+    case INTEGER:
+      cursor.highValInt = highVal != NULL ? KeyTraits<int>::load(highVal)
+                                          : KeyTraits<int>::highest();
+      startSnapshotKey(cursor,
+                       lowVal != NULL ? KeyTraits<int>::load(lowVal)
+                                      : KeyTraits<int>::lowest(),
+                       low, cursor.highValInt, high);
+      break;
+    case DOUBLE:
+      cursor.highValDouble = highVal != NULL
+                                 ? KeyTraits<double>::load(highVal)
+                                 : KeyTraits<double>::highest();
+      startSnapshotKey(cursor,
+                       lowVal != NULL ? KeyTraits<double>::load(lowVal)
+                                      : KeyTraits<double>::lowest(),
+                       low, cursor.highValDouble, high);
+      break;
+    case STRING:
+      cursor.highValString = highVal != NULL
+                                 ? KeyTraits<StringKey>::load(highVal)
+                                 : KeyTraits<StringKey>::highest();
+      startSnapshotKey(cursor,
+                       lowVal != NULL ? KeyTraits<StringKey>::load(lowVal)
+                                      : KeyTraits<StringKey>::lowest(),
+                       low, cursor.highValString, high);
+      break;
+    case COMPOSITE:
+      cursor.highValComposite = highVal != NULL
+                                    ? KeyTraits<CompositeKey>::load(highVal)
+                                    : KeyTraits<CompositeKey>::highest();
+      startSnapshotKey(cursor,
+                       lowVal != NULL ? KeyTraits<CompositeKey>::load(lowVal)
+                                      : KeyTraits<CompositeKey>::lowest(),
+                       low, cursor.highValComposite, high);
+      break;
+  }
+}
 
-  // The initialRootPageId is not the root
-  if (this->initialRootPageId != this->rootPageNum) {
-    NonLeafNodeInt *currNode = reinterpret_cast<NonLeafNodeInt *>(this->currentPageData);
+template <class T>
+void BTreeIndex::startSnapshotKey(SnapshotCursor &cursor, const T &lowVal,
+                                  const Operator lowOp, T &highVal,
+                                  const Operator highOp) {
+  if (highVal < lowVal) throw BadScanrangeException();
+  if (!cursor.node) cursor.node.reset(new Page());
 
-    bool leafFound = false;
+  // The snapshot is taken with the root latch held, so that its root is the
+  // root of its epoch
+  this->rootLatch.lockShared();
+  {
+    std::lock_guard<std::mutex> lock(this->versionLatch);
+    cursor.epoch = this->snapshotEpoch++;
+    this->snapshotEpochs.insert(cursor.epoch);
+    this->openSnapshots++;
+  }
+  PageId pageNo = this->rootPageNum;
+  bool isLeaf = this->initialRootPageId == pageNo;
+  this->rootLatch.unlockShared();
 
-    while (!leafFound) {
-      currNode = reinterpret_cast<NonLeafNodeInt *>(this->currentPageData);
+  cursor.index = this;
+  cursor.scanExecuting = true;
+  cursor.highOp = highOp;
+  this->openScans++;
 
-      // if this is the level above the leaf, end while loop
-      if (currNode->level) leafFound = true;
-      PageId nextNode;
+  // Go down to the leftmost leaf that can hold the low bound, through the
+  // nodes as the snapshot sees them
+  while (!isLeaf) {
+    readSnapshotNode(cursor, pageNo);
+    const NonLeafNode<T> *node =
+        reinterpret_cast<const NonLeafNode<T> *>(cursor.node.get());
+    isLeaf = node->level;
+    pageNo = node->getChild(node->lowerBound(lowVal));
+  }
+  readSnapshotNode(cursor, pageNo);
+  cursor.currentPageNum = pageNo;
 
-      // find the next node that is not a leaf
-      {
-        int i = this->nodeOccupancy;
-        while (i >= 0 && (!currNode->pageNoArray[i])) {
-          i--;
-        }
+  // Find the smallest key that satisfies the low operand
+  const LeafNode<T> *leaf =
+      reinterpret_cast<const LeafNode<T> *>(cursor.node.get());
+  int bound = boundPosition(*leaf, lowOp, lowVal);
+  while (bound == leaf->numKeys &&
+         leaf->rightSibPageNo != Page::INVALID_NUMBER) {
+    cursor.currentPageNum = leaf->rightSibPageNo;
+    readSnapshotNode(cursor, cursor.currentPageNum);
+    bound = boundPosition(*leaf, lowOp, lowVal);
+  }
+  cursor.nextEntry = bound;
 
-        while (i > 0 && (currNode->keyArray[i - 1] >= lowValInt)) {
-          i--;
-        }
-        nextNode = currNode->pageNoArray[i];
-      }
+  if (bound == leaf->numKeys ||
+      !(highOp == LT ? ScanBound<LT>::holds(leaf->getKey(bound), highVal)
+                     : ScanBound<LTE>::holds(leaf->getKey(bound), highVal))) {
+    endScan(cursor);
+    throw NoSuchKeyFoundException();
+  }
+}
 
-      // Unpin the current page
-      this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
-      this->currentPageNum = nextNode;  // current page is not a leaf
+/**
+ * Fetch the record id, and the key if outKey is not NULL, of the next entry
+ * of the snapshot scan of cursor.
+ * @param cursor  Cursor started on this index
+ * @param outRid  RecordId of next record found that satisfies the scan
+ *criteria returned in this
+ * @param outKey  Receives the key, as for scanNext() without a cursor
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ * @throws IndexScanCompletedException If no more records, satisfying the scan
+ *criteria, are left to be scanned.
+ **/
+void BTreeIndex::scanNext(SnapshotCursor &cursor, RecordId &outRid,
+                          void *outKey) {
+  if (!cursor.scanExecuting || cursor.index != this) {
+    throw ScanNotInitializedException();
+  }
+  switch (this->attributeType) {
+    case INTEGER:
+      snapshotNextKey(cursor, outRid, static_cast<int *>(outKey),
+                      cursor.highValInt);
+      break;
+    case DOUBLE:
+      snapshotNextKey(cursor, outRid, static_cast<double *>(outKey),
+                      cursor.highValDouble);
+      break;
+    case STRING:
+      snapshotNextKey(cursor, outRid, static_cast<StringKey *>(outKey),
+                      cursor.highValString);
+      break;
+    case COMPOSITE:
+      snapshotNextKey(cursor, outRid, static_cast<CompositeKey *>(outKey),
+                      cursor.highValComposite);
+      break;
+  }
+}
 
-      // read the page in
-      this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
+template <class T>
+void BTreeIndex::snapshotNextKey(SnapshotCursor &cursor, RecordId &outRid,
+                                 T *outKey, const T &highVal) {
+  const LeafNode<T> *leaf =
+      reinterpret_cast<const LeafNode<T> *>(cursor.node.get());
+  while (cursor.nextEntry == leaf->numKeys) {
+    if (leaf->rightSibPageNo == Page::INVALID_NUMBER) {
+      throw IndexScanCompletedException();
     }
+    cursor.currentPageNum = leaf->rightSibPageNo;
+    readSnapshotNode(cursor, cursor.currentPageNum);
+    cursor.nextEntry = 0;
   }
 
-  // Now that the current Node is the leaf node, try to find the smallest record that satisfies the operands
-  bool looking = true;
-  while (looking) {
-    LeafNodeInt *currLeaf = reinterpret_cast<LeafNodeInt *>(this->currentPageData);
-
-    // If the page is null, then the key kould not be found
-    if (!currLeaf->ridArray[0].page_number) {
-      this->bufMgr->unPinPage(this->file, this->currentPageNum, false);  // make sure page is unpinned
-      throw NoSuchKeyFoundException();
-    }
+  const T key = leaf->getKey(cursor.nextEntry);
+  if (!(cursor.highOp == LT ? ScanBound<LT>::holds(key, highVal)
+                            : ScanBound<LTE>::holds(key, highVal))) {
+    throw IndexScanCompletedException();
+  }
+  outRid = leaf->getRid(cursor.nextEntry);
+  if (outKey != NULL) *outKey = key;
+  cursor.nextEntry++;
+}
 
-    bool noVal = false;
-    // Search from left leaf page to right leaf page for the first value
-    for (int i = 0; i < leafOccupancy && !noVal; i++) {
-      int key = currLeaf->keyArray[i];
+/**
+ * Terminate the snapshot scan of cursor, letting go of its snapshot.
+ * @param cursor  Cursor started on this index
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+void BTreeIndex::endScan(SnapshotCursor &cursor) {
+  if (!cursor.scanExecuting) throw ScanNotInitializedException();
 
-      // Check if the next one in the key is not inserted
-      if (i < this->leafOccupancy - 1 && !currLeaf->ridArray[i + 1].page_number) noVal = true;
+  {
+    std::lock_guard<std::mutex> lock(this->versionLatch);
+    this->snapshotEpochs.erase(cursor.epoch);
+    this->openSnapshots--;
+    dropNodeImages();
+  }
+  this->openScans--;
 
-      // check that the current key is valid
-      bool validKey;
-      if (lowOp == GTE && highOp == LTE) {
-        validKey = (key <= this->highValInt && key >= this->lowValInt);
-      } else if (lowOp == GT && highOp == LTE) {
-        validKey = (key <= this->highValInt && key > this->lowValInt);
-      } else if (lowOp == GTE && highOp == LT) {
-        validKey = (key < this->highValInt && key >= this->lowValInt);
-      } else {
-        validKey = (key < this->highValInt && key > this->lowValInt);
-      }
+  cursor.index = NULL;
+  cursor.scanExecuting = false;
+  cursor.nextEntry = -1;
+  cursor.currentPageNum = static_cast<PageId>(-1);
+}
 
-      if (validKey) {
-        // use this valid key
-        this->nextEntry = i;
-        this->scanExecuting = true;
-        looking = false;
-        break;
-      } else if ((this->highOp == LT && key >= this->highValInt) ||
-                 (this->highOp == LTE && key > this->highValInt)) {
-        // Key is invalid and the situation is unsalvagable
-        this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
-        throw NoSuchKeyFoundException();
-      }
+void BTreeIndex::preserveNode(const PageId pageNo, const Page *page) {
+  if (this->openSnapshots.load() == 0) return;
+  std::lock_guard<std::mutex> lock(this->versionLatch);
+  if (this->snapshotEpochs.empty()) return;
 
-      if (i == this->leafOccupancy - 1 || noVal) {
-        // No matching key was found in this leaf so go to the next one
-        this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
+  // The last image serves every snapshot older than its epoch, so a new one
+  // is only needed if a snapshot was taken since
+  std::vector<NodeImage> &images = this->nodeImages[pageNo];
+  if (!images.empty() && *this->snapshotEpochs.rbegin() < images.back().epoch) {
+    return;
+  }
+  images.push_back(NodeImage());
+  images.back().epoch = this->snapshotEpoch;
+  images.back().data.assign(reinterpret_cast<const char *>(page),
+                            reinterpret_cast<const char *>(page) + Page::SIZE);
+}
 
-        // no next leaf so no such page was found
-        if (!currLeaf->rightSibPageNo) {
-          throw NoSuchKeyFoundException();
+void BTreeIndex::readSnapshotNode(SnapshotCursor &cursor,
+                                  const PageId pageNo) {
+  char *copy = reinterpret_cast<char *>(cursor.node.get());
+  PageLatch &latch = this->latches.latchFor(pageNo);
+  latch.lockShared();
+  bool saved = false;
+  {
+    std::lock_guard<std::mutex> lock(this->versionLatch);
+    std::unordered_map<PageId, std::vector<NodeImage> >::const_iterator found =
+        this->nodeImages.find(pageNo);
+    if (found != this->nodeImages.end()) {
+      const std::vector<NodeImage> &images = found->second;
+      for (std::size_t i = 0; i < images.size() && !saved; i++) {
+        if (images[i].epoch > cursor.epoch) {
+          memcpy(copy, &images[i].data[0], Page::SIZE);
+          saved = true;
         }
+      }
+    }
+  }
+  if (!saved) {
+    Page *page;
+    readNode(pageNo, page);
+    memcpy(copy, reinterpret_cast<const char *>(page), Page::SIZE);
+    releaseNode(pageNo);
+  }
+  latch.unlockShared();
+}
 
-        this->currentPageNum = currLeaf->rightSibPageNo;
-        this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
+void BTreeIndex::dropNodeImages() {
+  // An image is read by the snapshots from the epoch of the image before it,
+  // or from the first epoch, up to its own
+  std::unordered_map<PageId, std::vector<NodeImage> >::iterator it =
+      this->nodeImages.begin();
+  while (it != this->nodeImages.end()) {
+    std::vector<NodeImage> &images = it->second;
+    std::size_t kept = 0;
+    std::uint64_t from = 0;
+    for (std::size_t i = 0; i < images.size(); i++) {
+      const std::set<std::uint64_t>::const_iterator reader =
+          this->snapshotEpochs.lower_bound(from);
+      from = images[i].epoch;
+      if (reader != this->snapshotEpochs.end() && *reader < images[i].epoch) {
+        if (kept != i) images[kept].data.swap(images[i].data);
+        images[kept].epoch = images[i].epoch;
+        kept++;
       }
     }
+    images.erase(images.begin() + kept, images.end());
+    if (images.empty()) {
+      it = this->nodeImages.erase(it);
+    } else {
+      ++it;
+    }
   }
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// BTreeIndex::getStats
 // -----------------------------------------------------------------------------
 
 /**
- * Fetch the record id of the next index entry that matches the scan.
- * Return the next record from current page being scanned. If current page has
- * been scanned to its entirety, move on to the right sibling of current page,
- * if any exists, to start scanning that page. Make sure to unpin any pages
- * that are no longer required.
- * @param outRid RecordId of next record found that satisfies the scan
- * criteria returned in this
- * @throws ScanNotInitializedException If no scan has been initialized.
- * @throws IndexScanCompletedException If no more records, satisfying the scan
- * criteria, are left to be scanned.
+ * Find the shape of the tree and the work done on it since it was opened.
+ * @return  The statistics
  **/
-void BTreeIndex::scanNext(RecordId &outRid) {
-  // If startScan has not been called, then we don't know what we are scanning
-  // for so throw error
-  if (!scanExecuting) throw ScanNotInitializedException();
-
-  // Look at current page as a node
-  LeafNodeInt *node = reinterpret_cast<LeafNodeInt *>(this->currentPageData);
-
-  if (!node->ridArray[this->nextEntry].page_number || this->nextEntry == this->leafOccupancy) {
-    // Unpin page and read it
-    this->bufMgr->unPinPage(this->file, this->currentPageNum, false);
-
-    // Check whether there is a next leaf node
-    if (!node->rightSibPageNo) {
-      throw IndexScanCompletedException(); // No next leaf node
+BTreeStats BTreeIndex::getStats() {
+  BTreeStats stats;
+  switch (this->attributeType) {
+    case INTEGER:
+      shapeStats<int>(stats);
+      break;
+    case DOUBLE:
+      shapeStats<double>(stats);
+      break;
+    case STRING:
+      shapeStats<StringKey>(stats);
+      break;
+    case COMPOSITE:
+      shapeStats<CompositeKey>(stats);
+      break;
+  }
+  stats.leafSplits = this->leafSplits.load();
+  stats.internalSplits = this->internalSplits.load();
+  stats.rootSplits = this->rootSplits.load();
+  stats.filterBits = (std::size_t)this->filterBlocks * FILTERBLOCKWORDS * 64;
+  stats.filterRejects = this->filterRejects.load();
+  {
+    std::lock_guard<std::mutex> lock(this->versionLatch);
+    stats.openSnapshots = this->snapshotEpochs.size();
+    stats.snapshotImages = 0;
+    for (std::unordered_map<PageId, std::vector<NodeImage> >::const_iterator
+             it = this->nodeImages.begin();
+         it != this->nodeImages.end(); ++it) {
+      stats.snapshotImages += it->second.size();
     }
-
-    this->currentPageNum = node->rightSibPageNo;
-    this->bufMgr->readPage(this->file, this->currentPageNum, this->currentPageData);
-    node = reinterpret_cast<LeafNodeInt *>(this->currentPageData);
-
-    this->nextEntry = 0;
   }
+  stats.insert = this->insertCounters.load();
+  stats.startScan = this->startScanCounters.load();
+  stats.scanNext = this->scanNextCounters.load();
+  return stats;
+}
+
+/**
+ * A helper method that walks the tree level by level. The page numbers of a
+ * level are gathered from the non-leaf nodes of the level above, each node
+ * latched in shared mode only while it is read, so that other threads can
+ * go on using the index.
+ *
+ * @param stats  Receives the shape of the tree
+ */
+template <class T>
+void BTreeIndex::shapeStats(BTreeStats &stats) {
+  stats.levelNodes.clear();
+  stats.entries = 0;
+  double leafFill = 0;
+  double internalFill = 0;
+  std::size_t internalNodes = 0;
 
-  // Check if rid has a good/valid key
-  int key = node->keyArray[this->nextEntry];
+  this->rootLatch.lockShared();
+  std::vector<PageId> level(1, this->rootPageNum);
+  bool leaves = this->initialRootPageId == this->rootPageNum;
+  this->rootLatch.unlockShared();
 
-  bool validKey;
-  if (lowOp == GTE && highOp == LTE) {
-    validKey = key <= highValInt && key >= lowValInt;
-  } else if (lowOp == GT && highOp == LTE) {
-    validKey = key <= highValInt && key > lowValInt;
-  } else if (lowOp == GTE && highOp == LT) {
-    validKey = key < highValInt && key >= lowValInt;
-  } else {
-    validKey = key < highValInt && key > lowValInt;
+  while (!level.empty()) {
+    stats.levelNodes.push_back(level.size());
+    std::vector<PageId> below;
+    bool childLeaves = false;
+    for (std::size_t i = 0; i < level.size(); i++) {
+      PageLatch &latch = this->latches.latchFor(level[i]);
+      latch.lockShared();
+      Page *page;
+      readNode(level[i], page);
+      if (leaves) {
+        const LeafNode<T> *leaf = reinterpret_cast<LeafNode<T> *>(page);
+        stats.entries += leaf->numKeys;
+        leafFill += leaf->fill();
+      } else {
+        const NonLeafNode<T> *node = reinterpret_cast<NonLeafNode<T> *>(page);
+        for (int c = 0; c <= node->numKeys; c++) {
+          below.push_back(node->getChild(c));
+        }
+        childLeaves = node->level;
+        internalFill += node->fill();
+        internalNodes++;
+      }
+      latch.unlockShared();
+      releaseNode(level[i]);
+    }
+    if (leaves) {
+      stats.leafFill = leafFill / level.size();
+      break;
+    }
+    level.swap(below);
+    leaves = childLeaves;
   }
 
-  if (validKey) {
-    outRid = node->ridArray[this->nextEntry];
-    this->nextEntry++;
-  } else {
-    // If the current page has been scanned to its entirety, then the scan is complete
-    throw IndexScanCompletedException();
-  }
+  stats.height = (int)stats.levelNodes.size();
+  stats.internalFill = internalNodes > 0 ? internalFill / internalNodes : 0;
 }
 
 // -----------------------------------------------------------------------------
@@ -696,19 +6131,77 @@ void BTreeIndex::scanNext(RecordId &outRid) {
  *variables.
  * @throws ScanNotInitializedException If no scan has been initialized.
  **/
-void BTreeIndex::endScan() {
-  if (!this->scanExecuting) throw ScanNotInitializedException();
+void BTreeIndex::endScan() { endScan(this->scan); }
+
+/**
+ * Terminate the scan of cursor. Unpin its current leaf. Reset its scan specific
+ *variables.
+ * @param cursor Cursor started on this index
+ * @throws ScanNotInitializedException If no scan has been initialized.
+ **/
+void BTreeIndex::endScan(IndexCursor &cursor) {
+  if (!cursor.scanExecuting) throw ScanNotInitializedException();
 
   try {
-    bufMgr->unPinPage(this->file, this->currentPageNum, false);
+    releaseNode(cursor.currentPageNum);
   } catch (PageNotPinnedException &e) {
   }
 
+  this->openScans--;
+
   // Deinit necessary fields
-  this->nextEntry = -1;
-  this->currentPageData = nullptr;
-  this->scanExecuting = false;
-  this->currentPageNum = static_cast<PageId>(-1);
+  cursor.index = NULL;
+  cursor.nextEntry = -1;
+  cursor.currentPageData = nullptr;
+  cursor.scanExecuting = false;
+  cursor.currentPageNum = static_cast<PageId>(-1);
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor
+// -----------------------------------------------------------------------------
+
+IndexCursor::IndexCursor()
+    : index(NULL),
+      scanExecuting(false),
+      nextEntry(-1),
+      currentPageNum(static_cast<PageId>(-1)),
+      currentPageData(nullptr),
+      descending(false),
+      prevLeaf(Page::INVALID_NUMBER),
+      leafVersion(0),
+      readAheadEnd(0),
+      lastValDups(0),
+      nextRange(0) {}
+
+/**
+ * IndexCursor Destructor.
+ * End the scan, if any, unpinning its current leaf. Does not throw.
+ */
+IndexCursor::~IndexCursor() {
+  if (this->scanExecuting) this->index->endScan(*this);
+}
+
+// -----------------------------------------------------------------------------
+// SnapshotCursor
+// -----------------------------------------------------------------------------
+
+SnapshotCursor::SnapshotCursor()
+    : index(NULL),
+      scanExecuting(false),
+      epoch(0),
+      currentPageNum(static_cast<PageId>(-1)),
+      nextEntry(-1),
+      highValInt(0),
+      highValDouble(0),
+      highOp(LTE) {}
+
+/**
+ * SnapshotCursor Destructor.
+ * End the scan, if any, letting go of its snapshot. Does not throw.
+ */
+SnapshotCursor::~SnapshotCursor() {
+  if (this->scanExecuting) this->index->endScan(*this);
 }
 
 }  // namespace badgerdb
@@ -25,48 +25,425 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "buffer.h"
 #include "file.h"
+#include "key_search.h"
 #include "page.h"
+#include "page_latch.h"
+#include "relation_writer.h"
 #include "string.h"
 #include "types.h"
 
 namespace badgerdb {
 
+class BTreeIndex;
+
 /**
- * @brief Datatype enumeration type.
+ * @brief Size of String key.
  */
-enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2 };
+const int STRINGSIZE = 10;
 
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-enum Operator {
-  LT,  /* Less Than */
-  LTE, /* Less Than or Equal to */
-  GTE, /* Greater Than or Equal to */
-  GT   /* Greater Than */
-};
+//                                  key count    sibling ptrs          key
+//                                                                     rid
+const int INTARRAYLEAFSIZE = (Page::SIZE - sizeof(int) - 2 * sizeof(PageId)) /
+                             (sizeof(int) + sizeof(RecordId));
 
 /**
- * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+//                                     key count + padding  sibling ptrs
+//                                                      key        rid
+const int DOUBLEARRAYLEAFSIZE =
+    (Page::SIZE - sizeof(double) - 2 * sizeof(PageId)) /
+    (sizeof(double) + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key.
+ */
+//                                     key count + padding  sibling ptrs
+//                                                         key       rid
+const int STRINGARRAYLEAFSIZE =
+    (Page::SIZE - 2 * sizeof(int) - 2 * sizeof(PageId)) /
+    (STRINGSIZE * sizeof(char) + sizeof(RecordId));
+
+/**
+ * @brief Number of keys per block of the block directory of a B+Tree non-leaf
+ * for INTEGER key, a cache line of keys.
+ */
+const int INTNONLEAFBLOCKSIZE = KEY_BLOCK_BYTES / sizeof(int);
+
+/**
+ * @brief Number of keys per block of the block directory of a B+Tree non-leaf
+ * for DOUBLE key, a cache line of keys.
  */
-//                                                  sibling ptr             key
-//                                                  rid
-const int INTARRAYLEAFSIZE =
-  (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+const int DOUBLENONLEAFBLOCKSIZE = KEY_BLOCK_BYTES / sizeof(double);
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
  */
-//                                                     level     extra pageNo
-//                                                     key       pageNo
-const int INTARRAYNONLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
-                                (sizeof(int) + sizeof(PageId));
+//                           level, key count  extra pageNo, entry count
+//                                             key  pageNo  entry count
+//                                             and a block key per block
+const int INTARRAYNONLEAFSIZE =
+    (Page::SIZE - 2 * sizeof(int) - sizeof(PageId) - sizeof(std::uint32_t)) *
+    INTNONLEAFBLOCKSIZE /
+    ((sizeof(int) + sizeof(PageId) + sizeof(std::uint32_t)) *
+         INTNONLEAFBLOCKSIZE +
+     sizeof(int));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+//                           level, key count  extra pageNo, entry count
+//                                             key  pageNo  entry count
+//                                             and a block key per block
+const int DOUBLEARRAYNONLEAFSIZE =
+    (Page::SIZE - 2 * sizeof(int) - sizeof(PageId) - sizeof(std::uint32_t)) *
+    DOUBLENONLEAFBLOCKSIZE /
+    ((sizeof(double) + sizeof(PageId) + sizeof(std::uint32_t)) *
+         DOUBLENONLEAFBLOCKSIZE +
+     sizeof(double));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for STRING key.
+ */
+//                   level, key count, padding  extra pageNo, entry count
+//                                              key  pageNo  entry count
+const int STRINGARRAYNONLEAFSIZE =
+    (Page::SIZE - 3 * sizeof(int) - sizeof(PageId) - sizeof(std::uint32_t)) /
+    (STRINGSIZE * sizeof(char) + sizeof(PageId) + sizeof(std::uint32_t));
+
+/**
+ * @brief Size of a COMPOSITE key: the encodings of its columns one after
+ * another, zero padded.
+ */
+const int COMPOSITESIZE = 24;
+
+/**
+ * @brief Number of columns a COMPOSITE key can have at most.
+ */
+const int MAX_KEY_COLUMNS = 6;
+
+/**
+ * @brief Number of keys per block of the block directory of a B+Tree non-leaf
+ * for COMPOSITE key, those that fit into a cache line.
+ */
+const int COMPOSITENONLEAFBLOCKSIZE = KEY_BLOCK_BYTES / COMPOSITESIZE;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for COMPOSITE key.
+ */
+//                                  key count    sibling ptrs
+//                                                  key         rid
+const int COMPOSITEARRAYLEAFSIZE =
+    (Page::SIZE - sizeof(int) - 2 * sizeof(PageId)) /
+    (COMPOSITESIZE + sizeof(RecordId));
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for COMPOSITE key.
+ */
+//                           level, key count  extra pageNo, entry count
+//                                             key  pageNo  entry count
+//                                             and a block key per block
+const int COMPOSITEARRAYNONLEAFSIZE =
+    (Page::SIZE - 2 * sizeof(int) - sizeof(PageId) - sizeof(std::uint32_t)) *
+    COMPOSITENONLEAFBLOCKSIZE /
+    ((COMPOSITESIZE + sizeof(PageId) + sizeof(std::uint32_t)) *
+         COMPOSITENONLEAFBLOCKSIZE +
+     COMPOSITESIZE);
+
+/**
+ * @brief Number of levels an insert's path through the tree can hold. Every
+ * non-leaf node but the root has at least half of its key slots filled once
+ * split off, so a tree of 2^32 pages is far lower.
+ */
+const int MAX_TREE_HEIGHT = 32;
+
+/**
+ * @brief Bits per key of a key filter sized by BTreeIndex::setKeyFilter(),
+ * which makes about 1% of lookups of missing keys go to the tree anyway.
+ */
+const int DEFAULT_FILTER_BITS_PER_KEY = 10;
+
+/**
+ * @brief Number of 64-bit words in a block of a key filter. All bits of a key
+ * are in one block, a cache line.
+ */
+const int FILTERBLOCKWORDS = 8;
+
+/**
+ * @brief Number of words of a key filter a filter page holds.
+ */
+const int FILTERPAGEWORDS =
+    (Page::SIZE - sizeof(std::uint64_t)) / sizeof(std::uint64_t);
+
+/**
+ * @brief Size of the area holding key suffixes and RecordIds in a
+ * prefix-compressed STRING leaf.
+ */
+//                                                key count, sibling ptrs,
+//                                                prefix length    prefix
+const int STRINGLEAFDATASIZE =
+    Page::SIZE - 2 * sizeof(int) - 2 * sizeof(PageId) - STRINGSIZE;
+
+/**
+ * @brief Size of the area holding keys and RecordIds in an INTEGER leaf.
+ */
+//                                      key count, group count,
+//                                      page bytes       sibling ptrs, base
+const int INTLEAFDATASIZE = Page::SIZE - 3 * sizeof(int) - 3 * sizeof(PageId);
+
+/**
+ * @brief Size of the area holding separator suffixes, page numbers and entry
+ * counts in a prefix-compressed STRING non-leaf.
+ */
+//                                      level, key count, prefix length,
+//                                      suffix length              prefix
+const int STRINGNONLEAFDATASIZE = Page::SIZE - 4 * sizeof(int) - STRINGSIZE;
+
+/**
+ * @brief Key of a STRING index: the first STRINGSIZE characters of the
+ * attribute, padded with zeros if the attribute is shorter. Keys compare
+ * bytewise, the way strncmp() compares the attribute prefixes.
+ */
+struct StringKey {
+  char data[STRINGSIZE];
+
+  void set(const char *value) { strncpy(data, value, STRINGSIZE); }
+};
+
+inline bool operator==(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) == 0;
+}
+inline bool operator!=(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) != 0;
+}
+inline bool operator<(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) < 0;
+}
+inline bool operator<=(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) <= 0;
+}
+inline bool operator>(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) > 0;
+}
+inline bool operator>=(const StringKey &a, const StringKey &b) {
+  return memcmp(a.data, b.data, STRINGSIZE) >= 0;
+}
+
+/**
+ * @brief One attribute of a COMPOSITE key: where it is in the record and its
+ * type, INTEGER, DOUBLE or STRING.
+ */
+struct KeyColumn {
+  int offset;
+  Datatype type;
+};
+
+/**
+ * @brief Key of a COMPOSITE index. Each column is encoded so that its bytes
+ * compare the way its values do: integers and doubles big-endian with the
+ * sign flipped (all bits of negative doubles), strings as their first
+ * STRINGSIZE characters like StringKey. Keys thus compare with one memcmp(),
+ * column by column, and the keys with the same leading columns are a range.
+ * BTreeIndex::makeKey() encodes them.
+ */
+struct CompositeKey {
+  unsigned char data[COMPOSITESIZE];
+};
+
+inline bool operator==(const CompositeKey &a, const CompositeKey &b) {
+  return memcmp(a.data, b.data, COMPOSITESIZE) == 0;
+}
+inline bool operator!=(const CompositeKey &a, const CompositeKey &b) {
+  return memcmp(a.data, b.data, COMPOSITESIZE) != 0;
+}
+inline bool operator<(const CompositeKey &a, const CompositeKey &b) {
+  return memcmp(a.data, b.data, COMPOSITESIZE) < 0;
+}
+inline bool operator<=(const CompositeKey &a, const CompositeKey &b) {
+  return memcmp(a.data, b.data, COMPOSITESIZE) <= 0;
+}
+inline bool operator>(const CompositeKey &a, const CompositeKey &b) {
+  return memcmp(a.data, b.data, COMPOSITESIZE) > 0;
+}
+inline bool operator>=(const CompositeKey &a, const CompositeKey &b) {
+  return memcmp(a.data, b.data, COMPOSITESIZE) >= 0;
+}
+
+/**
+ * Composite keys are not numbers to interpolate between, so their non-leaves
+ * are always searched through the block directory.
+ */
+inline bool keyInterpolate(const CompositeKey *, const int,
+                           const CompositeKey &, const bool, int &) {
+  return false;
+}
+
+/**
+ * DOUBLE keys are searched through the block directory only. The guess pays
+ * off on dense integer ids; real values are seldom spread that evenly, and a
+ * guess that misses costs two extra comparisons on every node.
+ */
+inline bool keyInterpolate(const double *, const int, const double &,
+                           const bool, int &) {
+  return false;
+}
+
+/**
+ * @brief Compile time description of each key type: the node capacities for
+ * it, the number of keys per block of a non-leaf's block directory, how a key
+ * is read from a record or from a pointer passed to the BTreeIndex interface,
+ * the separator a split pushes up between the last key of a leaf and the
+ * first key of its new right sibling, and the smallest and largest keys, which
+ * open-ended scan bounds stand for.
+ */
+template <class T>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<int> {
+  static const int LEAFSIZE = INTARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = INTARRAYNONLEAFSIZE;
+  static const int NONLEAFBLOCKSIZE = INTNONLEAFBLOCKSIZE;
+  static int load(const void *value) {
+    int key;
+    memcpy(&key, value, sizeof(key));
+    return key;
+  }
+  static int separator(const int &, const int &right) { return right; }
+  static int lowest() { return std::numeric_limits<int>::min(); }
+  static int highest() { return std::numeric_limits<int>::max(); }
+};
+
+template <>
+struct KeyTraits<double> {
+  static const int LEAFSIZE = DOUBLEARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = DOUBLEARRAYNONLEAFSIZE;
+  static const int NONLEAFBLOCKSIZE = DOUBLENONLEAFBLOCKSIZE;
+  static double load(const void *value) {
+    double key;
+    memcpy(&key, value, sizeof(key));
+    return key;
+  }
+  static double separator(const double &, const double &right) {
+    return right;
+  }
+  static double lowest() { return -std::numeric_limits<double>::infinity(); }
+  static double highest() { return std::numeric_limits<double>::infinity(); }
+};
+
+template <>
+struct KeyTraits<StringKey> {
+  static const int LEAFSIZE = STRINGARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = STRINGARRAYNONLEAFSIZE;
+  static StringKey load(const void *value) {
+    StringKey key;
+    key.set(static_cast<const char *>(value));
+    return key;
+  }
+
+  /**
+   * Shortest prefix of right that is still greater than left, zero padded,
+   * which keeps the separators of prefix-compressed non-leaves short.
+   */
+  static StringKey separator(const StringKey &left, const StringKey &right) {
+    StringKey key = right;
+    int i = 0;
+    while (i < STRINGSIZE && left.data[i] == right.data[i]) i++;
+    if (i < STRINGSIZE) memset(key.data + i + 1, 0, STRINGSIZE - i - 1);
+    return key;
+  }
+  static StringKey lowest() {
+    StringKey key;
+    memset(key.data, 0, STRINGSIZE);
+    return key;
+  }
+  static StringKey highest() {
+    StringKey key;
+    memset(key.data, 0xff, STRINGSIZE);
+    return key;
+  }
+};
+
+template <>
+struct KeyTraits<CompositeKey> {
+  static const int LEAFSIZE = COMPOSITEARRAYLEAFSIZE;
+  static const int NONLEAFSIZE = COMPOSITEARRAYNONLEAFSIZE;
+  static const int NONLEAFBLOCKSIZE = COMPOSITENONLEAFBLOCKSIZE;
+  static CompositeKey load(const void *value) {
+    CompositeKey key;
+    memcpy(key.data, value, COMPOSITESIZE);
+    return key;
+  }
+
+  /**
+   * Shortest prefix of right that is still greater than left, zero padded,
+   * as for StringKey.
+   */
+  static CompositeKey separator(const CompositeKey &left,
+                                const CompositeKey &right) {
+    CompositeKey key = right;
+    int i = 0;
+    while (i < COMPOSITESIZE && left.data[i] == right.data[i]) i++;
+    if (i < COMPOSITESIZE) {
+      memset(key.data + i + 1, 0, COMPOSITESIZE - i - 1);
+    }
+    return key;
+  }
+  static CompositeKey lowest() {
+    CompositeKey key;
+    memset(key.data, 0, COMPOSITESIZE);
+    return key;
+  }
+  static CompositeKey highest() {
+    CompositeKey key;
+    memset(key.data, 0xff, COMPOSITESIZE);
+    return key;
+  }
+};
+
+/**
+ * @brief Default fraction of each leaf and non-leaf node that is filled when
+ * an index is built by bulk loading.
+ */
+const double DEFAULT_FILL_FACTOR = 1.0;
+
+/**
+ * @brief Estimates set the entry counts of the non-leaves again once more than
+ * one in this many entries were inserted or deleted since they last did, so
+ * that no count is off by more than that share of the entries.
+ */
+const int STALE_COUNT_DIVISOR = 32;
+
+/**
+ * @brief Number of entries an online build inserts at a time. It replays the
+ * side log without holding its latch until no more than this many are left.
+ */
+const std::size_t ONLINE_BUILD_BATCH = 4096;
+
+/**
+ * @brief Number of levels at the top of the tree whose non-leaf nodes each
+ * index keeps pinned while it is open, so traversals do not look them up in
+ * the buffer pool.
+ */
+const int HOT_NODE_LEVELS = 2;
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to
@@ -94,9 +471,19 @@ class PageKeyPair {
 public:
   PageId pageNo;
   T key;
+
+  /**
+   * Number of entries under pageNo and, if it was split off from the page on
+   * its left, the number left under that page.
+   */
+  std::uint32_t count;
+  std::uint32_t leftCount;
+
   void set(int p, T k) {
     pageNo = p;
     key = k;
+    count = 0;
+    leftCount = 0;
   }
 };
 
@@ -143,6 +530,61 @@ struct IndexMetaInfo {
    * Page number of root page of the B+ Tree inside the file index file.
    */
   PageId rootPageNo;
+
+  /**
+   * Page number of the first node on the free list, Page::INVALID_NUMBER if
+   * it is empty.
+   */
+  PageId freePageNo;
+
+  /**
+   * True while the index is being built online and does not have every record
+   * of the relation yet.
+   */
+  bool buildInProgress;
+
+  /**
+   * Columns of the key of a COMPOSITE index, in order. attrByteOffset is the
+   * offset of the first one.
+   */
+  int numKeyColumns;
+  KeyColumn keyColumns[MAX_KEY_COLUMNS];
+
+  /**
+   * First page of the key filter, the number of blocks it has and of bits
+   * each key sets, or Page::INVALID_NUMBER and 0 if the index has none.
+   */
+  PageId filterPageNo;
+  std::uint32_t filterBlocks;
+  int filterHashes;
+
+  /**
+   * True if the filter pages were written when the index was last closed.
+   * Cleared while the index is open for writing, so a filter left out of
+   * date by a crash is rebuilt.
+   */
+  bool filterSaved;
+};
+
+/**
+ * @brief A node on the free list of an index. The page is zero apart from the
+ * number of the next free node.
+ */
+struct FreeNode {
+  PageId nextFreePageNo;
+};
+
+/**
+ * @brief A page of the key filter of an index. The pages are chained in order.
+ */
+struct FilterPage {
+  /**
+   * Page number of the next filter page, Page::INVALID_NUMBER if this is the
+   * last.
+   */
+  PageId nextPageNo;
+
+  std::uint64_t words[FILTERPAGEWORDS];
 };
 
 /*
@@ -151,228 +593,2253 @@ the page to this struct and use it to access the parts These structures
 basically are the format in which the information is stored in the pages for
 the index file depending on what kind of node they are. The level memeber of
 each non leaf structure seen below is set to 1 if the nodes at this level are
-just above the leaf nodes. Otherwise set to 0.
+just above the leaf nodes. Otherwise set to 0. The numKeys member of each node
+counts the entries in use; the arrays are sorted and only their first numKeys
+keys (and numKeys + 1 child pages of a non-leaf) are meaningful.
+
+INTEGER and DOUBLE non-leaves group their keys into blocks of a cache line and
+keep the last key of each full block in a block directory. A search goes
+through the directory, a few cache lines, and then the one block the key can
+be in, instead of binary searching the whole key array, which reads a cache
+line from all over the page. Hot nodes are searched many times over, so their
+directories stay in the processor caches. Before that, the position of an
+INTEGER key is guessed by interpolating between the first and the last key of
+the node, which on nearly uniform keys finds it in one cache line.
+
+A non-leaf also keeps the number of entries under each of its children. The
+counts are set when a child splits, when the tree is bulk loaded and, for
+parents of leaves, by compact(); inserts that do not split and deletes only
+add to a tally of how many entries changed since. Once that is more than one
+in STALE_COUNT_DIVISOR of the entries, the next estimate walks the tree and
+sets every count again. They are thus approximate, and only used for
+estimates.
+
+The tree only works with the nodes through their member functions, so a key
+type can use its own page format. STRING nodes are prefix compressed: the
+bytes every key of the page shares are stored once, and the separators of
+non-leaves are cut down to the shortest key that still tells the two children
+apart.
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all non-leaf nodes, templated for the key type.
  */
-struct NonLeafNodeInt {
+template <class T>
+struct NonLeafNode {
   /**
    * Level of the node in the tree.
    */
   int level;
 
+  /**
+   * Number of keys stored in the node. The node has one more child page than
+   * it has keys.
+   */
+  int numKeys;
+
   /**
    * Stores keys.
    */
-  int keyArray[INTARRAYNONLEAFSIZE];
+  T keyArray[KeyTraits<T>::NONLEAFSIZE];
 
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf
    * nodes in the tree.
    */
-  PageId pageNoArray[INTARRAYNONLEAFSIZE + 1];
-};
+  PageId pageNoArray[KeyTraits<T>::NONLEAFSIZE + 1];
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
- */
-struct LeafNodeInt {
   /**
-   * Stores keys.
+   * Number of entries under each child page, as of the last time it was set.
    */
-  int keyArray[INTARRAYLEAFSIZE];
+  std::uint32_t countArray[KeyTraits<T>::NONLEAFSIZE + 1];
 
   /**
-   * Stores RecordIds.
+   * Last key of each full block of NONLEAFBLOCKSIZE keys, zero for the others.
    */
-  RecordId ridArray[INTARRAYLEAFSIZE];
+  T blockKeys[KeyTraits<T>::NONLEAFSIZE / KeyTraits<T>::NONLEAFBLOCKSIZE];
 
   /**
-   * Page number of the leaf on the right side.
-   * This linking of leaves allows to easily move from one leaf to the next leaf
-   * during index scan.
+   * Makes this a node on the given level with a single child and no keys.
    */
-  PageId rightSibPageNo;
-};
+  void init(const int nodeLevel, const PageId firstChild,
+            const std::uint32_t firstCount) {
+    level = nodeLevel;
+    numKeys = 0;
+    pageNoArray[0] = firstChild;
+    countArray[0] = firstCount;
+  }
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
- * of a relation. This index supports only one scan at a time.
- */
-class BTreeIndex {
-private:
   /**
-   * File object for the index file.
+   * Returns key i.
    */
-  File *file;
+  T getKey(const int i) const { return keyArray[i]; }
 
   /**
-   * Buffer Manager Instance.
+   * Returns child page i, which holds the keys between key i - 1 and key i.
    */
-  BufMgr *bufMgr;
+  PageId getChild(const int i) const { return pageNoArray[i]; }
 
   /**
-   * Page number of meta page.
+   * Returns the number of entries under child page i.
    */
-  PageId headerPageNum;
+  std::uint32_t getCount(const int i) const { return countArray[i]; }
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Sets the number of entries under child page i.
    */
-  PageId rootPageNum;
+  void setCount(const int i, const std::uint32_t count) {
+    countArray[i] = count;
+  }
 
   /**
-   * Datatype of attribute over which index is built.
+   * Returns the number of entries under the node.
    */
-  Datatype attributeType;
+  std::uint32_t totalCount() const {
+    std::uint32_t total = 0;
+    for (int i = 0; i <= numKeys; i++) total += countArray[i];
+    return total;
+  }
 
   /**
-   * Offset of attribute, over which index is built, inside records.
+   * Returns the fraction of the node's key slots in use.
    */
-  int attrByteOffset;
+  double fill() const {
+    return (double)numKeys / KeyTraits<T>::NONLEAFSIZE;
+  }
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Returns the index of the first key that is not less than key.
    */
-  int leafOccupancy;
+  int lowerBound(const T &key) const {
+    int pos;
+    if (keyInterpolate(keyArray, numKeys, key, false, pos)) return pos;
+    return keyBlockLowerBound(keyArray, blockKeys, numKeys,
+                              KeyTraits<T>::NONLEAFBLOCKSIZE, key);
+  }
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Returns the index of the first key that is greater than key.
    */
-  int nodeOccupancy;
+  int upperBound(const T &key) const {
+    int pos;
+    if (keyInterpolate(keyArray, numKeys, key, true, pos)) return pos;
+    return keyBlockUpperBound(keyArray, blockKeys, numKeys,
+                              KeyTraits<T>::NONLEAFBLOCKSIZE, key);
+  }
 
-  // MEMBERS SPECIFIC TO SCANNING
+  /**
+   * Brings the block directory up to date after the keys from index pos on
+   * changed.
+   */
+  void indexBlocks(const int pos) {
+    const int size = KeyTraits<T>::NONLEAFBLOCKSIZE;
+    const int full = numKeys / size;
+    for (int b = pos / size; b < full; b++) {
+      blockKeys[b] = keyArray[b * size + size - 1];
+    }
+    memset(&blockKeys[full], 0,
+           (KeyTraits<T>::NONLEAFSIZE / size - full) * sizeof(T));
+  }
 
   /**
-   * True if an index scan has been started.
+   * Returns true if key can be inserted without filling more than fillFactor
+   * of the node. A node without keys always has room for one.
    */
-  bool scanExecuting;
+  bool hasRoom(const T &key, const double fillFactor = 1.0) const {
+    return numKeys + 2 <=
+           std::max(2, (int)((KeyTraits<T>::NONLEAFSIZE + 1) * fillFactor));
+  }
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Returns true if any key can be inserted, so the node cannot split.
    */
-  int nextEntry;
+  bool hasRoomForAnyKey() const { return numKeys < KeyTraits<T>::NONLEAFSIZE; }
 
   /**
-   * Page number of current page being scanned.
+   * Inserts key at index pos and child, with count entries under it, right
+   * after it. The node must have room for the key.
    */
-  PageId currentPageNum;
+  void insertAt(const int pos, const T &key, const PageId child,
+                const std::uint32_t count) {
+    const int moved = numKeys - pos;
+    memmove(&keyArray[pos + 1], &keyArray[pos], moved * sizeof(T));
+    memmove(&pageNoArray[pos + 2], &pageNoArray[pos + 1],
+            moved * sizeof(PageId));
+    memmove(&countArray[pos + 2], &countArray[pos + 1],
+            moved * sizeof(std::uint32_t));
+    keyArray[pos] = key;
+    pageNoArray[pos + 1] = child;
+    countArray[pos + 1] = count;
+    numKeys++;
+    indexBlocks(pos);
+  }
 
   /**
-   * Current Page being scanned.
+   * Removes the last key and the last child.
    */
-  Page *currentPageData;
+  void dropLast() { numKeys--; }
 
   /**
-   * Low INTEGER value for scan.
+   * Removes key pos and the child right after it.
    */
-  int lowValInt;
+  void removeAt(const int pos) {
+    const int moved = numKeys - pos - 1;
+    memmove(&keyArray[pos], &keyArray[pos + 1], moved * sizeof(T));
+    memmove(&pageNoArray[pos + 1], &pageNoArray[pos + 2],
+            moved * sizeof(PageId));
+    memmove(&countArray[pos + 1], &countArray[pos + 2],
+            moved * sizeof(std::uint32_t));
+    numKeys--;
+    memset(&keyArray[numKeys], 0, sizeof(T));
+    memset(&pageNoArray[numKeys + 1], 0, sizeof(PageId));
+    memset(&countArray[numKeys + 1], 0, sizeof(std::uint32_t));
+    indexBlocks(pos);
+  }
 
   /**
-   * Low DOUBLE value for scan.
+   * Splits the node as if key and child, with childCount entries under it,
+   * had already been inserted at pos: the first half of the keys stay, the
+   * middle key is returned in pushup and the rest move to the empty node
+   * right.
    */
-  double lowValDouble;
+  void splitInto(NonLeafNode &right, const int pos, const T &key,
+                 const PageId child, const std::uint32_t childCount,
+                 T &pushup) {
+    const int count = numKeys;
+    const int mid = (count + 1) / 2;
 
+    if (pos < mid) {
+      // New entry lands in this node, so the pushed up key is one earlier
+      const int moved = count - mid;
+      memcpy(right.keyArray, &keyArray[mid], moved * sizeof(T));
+      memcpy(right.pageNoArray, &pageNoArray[mid],
+             (moved + 1) * sizeof(PageId));
+      memcpy(right.countArray, &countArray[mid],
+             (moved + 1) * sizeof(std::uint32_t));
+      pushup = keyArray[mid - 1];
+      right.numKeys = moved;
+      numKeys = mid - 1;
+      insertAt(pos, key, child, childCount);
+    } else if (pos == mid) {
+      // New key itself is pushed up and its page starts the new node
+      const int moved = count - mid;
+      memcpy(right.keyArray, &keyArray[mid], moved * sizeof(T));
+      memcpy(&right.pageNoArray[1], &pageNoArray[mid + 1],
+             moved * sizeof(PageId));
+      memcpy(&right.countArray[1], &countArray[mid + 1],
+             moved * sizeof(std::uint32_t));
+      right.pageNoArray[0] = child;
+      right.countArray[0] = childCount;
+      pushup = key;
+      right.numKeys = moved;
+      numKeys = mid;
+    } else {
+      const int moved = count - mid - 1;
+      memcpy(right.keyArray, &keyArray[mid + 1], moved * sizeof(T));
+      memcpy(right.pageNoArray, &pageNoArray[mid + 1],
+             (moved + 1) * sizeof(PageId));
+      memcpy(right.countArray, &countArray[mid + 1],
+             (moved + 1) * sizeof(std::uint32_t));
+      pushup = keyArray[mid];
+      right.numKeys = moved;
+      numKeys = mid;
+      right.insertAt(pos - mid - 1, key, child, childCount);
+    }
+    right.level = level;
+
+    // Entries given up are zeroed, so that they compress away on disk
+    memset(&keyArray[numKeys], 0, (count - numKeys) * sizeof(T));
+    memset(&pageNoArray[numKeys + 1], 0, (count - numKeys) * sizeof(PageId));
+    memset(&countArray[numKeys + 1], 0,
+           (count - numKeys) * sizeof(std::uint32_t));
+    indexBlocks(0);
+    right.indexBlocks(0);
+  }
+};
+
+/**
+ * @brief Structure for all leaf nodes, templated for the key type.
+ */
+template <class T>
+struct LeafNode {
   /**
-   * Low STRING value for scan.
+   * Number of entries stored in the leaf.
    */
-  std::string lowValString;
+  int numKeys;
 
   /**
-   * High INTEGER value for scan.
+   * Stores keys.
    */
-  int highValInt;
+  T keyArray[KeyTraits<T>::LEAFSIZE];
 
   /**
-   * High DOUBLE value for scan.
+   * Stores RecordIds.
    */
-  double highValDouble;
+  RecordId ridArray[KeyTraits<T>::LEAFSIZE];
 
   /**
-   * High STRING value for scan.
+   * Page number of the leaf on the right side.
+   * This linking of leaves allows to easily move from one leaf to the next leaf
+   * during index scan.
    */
-  std::string highValString;
+  PageId rightSibPageNo;
 
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * Page number of the leaf on the left side, which descending scans move to.
    */
-  Operator lowOp;
+  PageId leftSibPageNo;
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Makes this a leaf with no entries and no siblings.
    */
-  Operator highOp;
+  void init() {
+    numKeys = 0;
+    rightSibPageNo = Page::INVALID_NUMBER;
+    leftSibPageNo = Page::INVALID_NUMBER;
+  }
 
   /**
-   * Used for splitting root
+   * Returns the key of entry i.
    */
-  PageId initialRootPageId;
+  T getKey(const int i) const { return keyArray[i]; }
 
   /**
-   * A helper method that inserts a data entry into the index
-   *
-   * @param currPage         Current page we are on
-   * @param currPageId       pageId of current page
-   * @param isLeaf           True if current page is leaf
-   * @param newEntry         Data entry of interest
-   * @param newInternal      Internal used for pushing up key
-  */
-  void insert(Page *currPage, PageId currPageId, bool isLeaf, RIDKeyPair<int> newEntry, PageKeyPair<int> *&newInternal);
+   * Returns the RecordId of entry i.
+   */
+  RecordId getRid(const int i) const { return ridArray[i]; }
 
   /**
-    * A helper method that finds next node to traverse to down the tree
-    *
+   * Returns the fraction of the leaf's entry slots in use.
+   */
+  double fill() const { return (double)numKeys / KeyTraits<T>::LEAFSIZE; }
+
+  /**
+   * Copies the RecordIds of count entries starting at entry first to out.
+   */
+  void copyRids(const int first, const int count, RecordId *out) const {
+    memcpy(out, &ridArray[first], count * sizeof(RecordId));
+  }
+
+  /**
+   * Copies the keys of count entries starting at entry first to out.
+   */
+  void copyKeys(const int first, const int count, T *out) const {
+    std::copy(keyArray + first, keyArray + first + count, out);
+  }
+
+  /**
+   * Returns the index of the first entry whose key is not less than key.
+   */
+  int lowerBound(const T &key) const {
+    return keyLowerBound(keyArray, numKeys, key);
+  }
+
+  /**
+   * Returns the index of the first entry whose key is greater than key.
+   */
+  int upperBound(const T &key) const {
+    return keyUpperBound(keyArray, numKeys, key);
+  }
+
+  /**
+   * Returns true if an entry with the given key and rid can be inserted
+   * without filling more than fillFactor of the leaf. An empty leaf always has
+   * room.
+   */
+  bool hasRoom(const T &key, const RecordId &,
+               const double fillFactor = 1.0) const {
+    return numKeys < std::max(1, (int)(KeyTraits<T>::LEAFSIZE * fillFactor));
+  }
+
+  /**
+   * Inserts an entry at index pos. The leaf must have room for the entry.
+   */
+  void insertAt(const int pos, const T &key, const RecordId &rid) {
+    const int moved = numKeys - pos;
+    memmove(&keyArray[pos + 1], &keyArray[pos], moved * sizeof(T));
+    memmove(&ridArray[pos + 1], &ridArray[pos], moved * sizeof(RecordId));
+    keyArray[pos] = key;
+    ridArray[pos] = rid;
+    numKeys++;
+  }
+
+  /**
+   * Removes entry pos.
+   */
+  void removeAt(const int pos) {
+    const int moved = numKeys - pos - 1;
+    memmove(&keyArray[pos], &keyArray[pos + 1], moved * sizeof(T));
+    memmove(&ridArray[pos], &ridArray[pos + 1], moved * sizeof(RecordId));
+    numKeys--;
+    memset(&keyArray[numKeys], 0, sizeof(T));
+    memset(&ridArray[numKeys], 0, sizeof(RecordId));
+  }
+
+  /**
+   * Merges as many entries of the sorted run as fit into the leaf in one pass,
+   * from the first one on, each after the entries with an equal key. Returns
+   * the number of entries merged.
+   */
+  int insertRun(const T *keys, const RecordId *rids, const int count) {
+    const int room = KeyTraits<T>::LEAFSIZE - numKeys;
+    const int merged = std::min(count, room);
+
+    // Filled in from the back, so that no entry is overwritten before it moves
+    int i = numKeys - 1;
+    int j = merged - 1;
+    for (int k = numKeys + merged - 1; j >= 0; k--) {
+      if (i >= 0 && keys[j] < keyArray[i]) {
+        keyArray[k] = keyArray[i];
+        ridArray[k] = ridArray[i];
+        i--;
+      } else {
+        keyArray[k] = keys[j];
+        ridArray[k] = rids[j];
+        j--;
+      }
+    }
+    numKeys += merged;
+    return merged;
+  }
+
+  /**
+   * Splits the leaf as if the entry had already been inserted at pos: the
+   * first half of the entries stay and the rest move to the empty leaf right.
+   * Sibling pointers are left to the caller.
+   */
+  void splitInto(LeafNode &right, const int pos, const T &key,
+                 const RecordId &rid) {
+    const int count = numKeys;
+    const int mid = (count + 1) / 2;
+
+    if (pos < mid) {
+      // New entry lands in this leaf, which gives up one more entry
+      const int moved = count - (mid - 1);
+      memcpy(right.keyArray, &keyArray[mid - 1], moved * sizeof(T));
+      memcpy(right.ridArray, &ridArray[mid - 1], moved * sizeof(RecordId));
+      right.numKeys = moved;
+      numKeys = mid - 1;
+      insertAt(pos, key, rid);
+    } else {
+      const int moved = count - mid;
+      memcpy(right.keyArray, &keyArray[mid], moved * sizeof(T));
+      memcpy(right.ridArray, &ridArray[mid], moved * sizeof(RecordId));
+      right.numKeys = moved;
+      numKeys = mid;
+      right.insertAt(pos - mid, key, rid);
+    }
+
+    // Entries given up are zeroed, so that they compress away on disk
+    memset(&keyArray[numKeys], 0, (count - numKeys) * sizeof(T));
+    memset(&ridArray[numKeys], 0, (count - numKeys) * sizeof(RecordId));
+  }
+};
+
+/**
+ * @brief Non-leaf node for STRING keys. The first prefixLen bytes shared by
+ * every separator are stored once; each separator keeps only the next
+ * suffixLen bytes, the rest being zero. Separator suffixes fill the data area
+ * from the front, and child page numbers, each followed by the number of
+ * entries under the child, from the back.
+ */
+template <>
+struct NonLeafNode<StringKey> {
+  /**
+   * Level of the node in the tree.
+   */
+  int level;
+
+  /**
+   * Number of keys stored in the node. The node has one more child page than
+   * it has keys.
+   */
+  int numKeys;
+
+  /**
+   * Number of leading bytes shared by every key of the node.
+   */
+  int prefixLen;
+
+  /**
+   * Number of bytes stored per key after the prefix.
+   */
+  int suffixLen;
+
+  /**
+   * Leading bytes shared by every key of the node.
+   */
+  char prefix[STRINGSIZE];
+
+  /**
+   * Key suffixes from the front, child page numbers and entry counts from the
+   * back.
+   */
+  char data[STRINGNONLEAFDATASIZE];
+
+  void init(const int nodeLevel, const PageId firstChild,
+            const std::uint32_t firstCount);
+  StringKey getKey(const int i) const;
+  PageId getChild(const int i) const;
+  std::uint32_t getCount(const int i) const;
+  void setCount(const int i, const std::uint32_t count);
+  std::uint32_t totalCount() const;
+  int lowerBound(const StringKey &key) const;
+  int upperBound(const StringKey &key) const;
+  bool hasRoom(const StringKey &key, const double fillFactor = 1.0) const;
+  bool hasRoomForAnyKey() const;
+  double fill() const;
+  void insertAt(const int pos, const StringKey &key, const PageId child,
+                const std::uint32_t count);
+  void dropLast() { numKeys--; }
+  void removeAt(const int pos);
+  void splitInto(NonLeafNode &right, const int pos, const StringKey &key,
+                 const PageId child, const std::uint32_t childCount,
+                 StringKey &pushup);
+
+ private:
+  void setChild(const int i, const PageId child);
+  void widen(const int newPrefixLen, const int newSuffixLen);
+  void assign(const StringKey *keys, const PageId *children,
+              const std::uint32_t *counts, const int count);
+};
+
+/**
+ * @brief Leaf node for STRING keys. The first prefixLen bytes shared by every
+ * key are stored once and each entry keeps only the rest of its key. Key
+ * suffixes fill the data area from the front and RecordIds from the back, so
+ * the more the keys share, the more entries the leaf holds.
+ */
+template <>
+struct LeafNode<StringKey> {
+  /**
+   * Number of entries stored in the leaf.
+   */
+  int numKeys;
+
+  /**
+   * Page numbers of the leaves on the right and left side.
+   */
+  PageId rightSibPageNo;
+  PageId leftSibPageNo;
+
+  /**
+   * Number of leading bytes shared by every key of the leaf.
+   */
+  int prefixLen;
+
+  /**
+   * Leading bytes shared by every key of the leaf.
+   */
+  char prefix[STRINGSIZE];
+
+  /**
+   * Key suffixes from the front, RecordIds from the back.
+   */
+  char data[STRINGLEAFDATASIZE];
+
+  void init();
+  StringKey getKey(const int i) const;
+  RecordId getRid(const int i) const;
+  void copyRids(const int first, const int count, RecordId *out) const;
+  void copyKeys(const int first, const int count, StringKey *out) const;
+  int lowerBound(const StringKey &key) const;
+  int upperBound(const StringKey &key) const;
+  bool hasRoom(const StringKey &key, const RecordId &rid,
+               const double fillFactor = 1.0) const;
+  double fill() const;
+  void insertAt(const int pos, const StringKey &key, const RecordId &rid);
+  void removeAt(const int pos);
+  int insertRun(const StringKey *keys, const RecordId *rids, const int count);
+  void splitInto(LeafNode &right, const int pos, const StringKey &key,
+                 const RecordId &rid);
+
+ private:
+  void setRid(const int i, const RecordId &rid);
+  void shortenPrefix(const int newPrefixLen);
+  void assign(const StringKey *keys, const RecordId *rids, const int count);
+};
+
+/**
+ * @brief Leaf node for INTEGER keys, which stores every distinct key once
+ * along with the posting list of its entries. The distinct keys and the end
+ * of each one's posting list fill the data area from the front, and the
+ * RecordIds from the back. Each RecordId is stored as the delta of its page
+ * number from basePage in pageBytes bytes, followed by its slot number, so
+ * entry i is still found without decoding the entries before it. A posting
+ * list too long for one leaf goes on in the right siblings, as duplicates do
+ * in any other leaf. Searches first guess where a key is among the distinct
+ * keys by interpolating between the first and the last of them.
+ */
+template <>
+struct LeafNode<int> {
+  /**
+   * Number of entries stored in the leaf.
+   */
+  int numKeys;
+
+  /**
+   * Page numbers of the leaves on the right and left side.
+   */
+  PageId rightSibPageNo;
+  PageId leftSibPageNo;
+
+  /**
+   * Number of distinct keys in the leaf.
+   */
+  int numGroups;
+
+  /**
+   * Page number the page numbers of the RecordIds are stored relative to.
+   */
+  PageId basePage;
+
+  /**
+   * Number of bytes each page number delta takes, 2 or 4.
+   */
+  int pageBytes;
+
+  /**
+   * Distinct keys and the ends of their posting lists from the front,
+   * RecordIds from the back.
+   */
+  char data[INTLEAFDATASIZE];
+
+  void init();
+  int getKey(const int i) const;
+  RecordId getRid(const int i) const;
+  void copyRids(const int first, const int count, RecordId *out) const;
+  void copyKeys(const int first, const int count, int *out) const;
+  int lowerBound(const int &key) const;
+  int upperBound(const int &key) const;
+  bool hasRoom(const int &key, const RecordId &rid,
+               const double fillFactor = 1.0) const;
+  double fill() const;
+  void insertAt(const int pos, const int &key, const RecordId &rid);
+  void removeAt(const int pos);
+  int insertRun(const int *keys, const RecordId *rids, const int count);
+  void splitInto(LeafNode &right, const int pos, const int &key,
+                 const RecordId &rid);
+
+ private:
+  const int *groupKeys() const { return reinterpret_cast<const int *>(data); }
+  int *groupKeys() { return reinterpret_cast<int *>(data); }
+  const std::uint16_t *groupEnds() const {
+    return reinterpret_cast<const std::uint16_t *>(data +
+                                                   numGroups * sizeof(int));
+  }
+  std::uint16_t *groupEnds() {
+    return reinterpret_cast<std::uint16_t *>(data + numGroups * sizeof(int));
+  }
+  int groupStart(const int g) const { return g > 0 ? groupEnds()[g - 1] : 0; }
+  void insertGroup(const int g, const int key, const int start);
+  void removeGroup(const int g);
+  void setRid(const int i, const RecordId &rid);
+  void encodingFor(const RecordId &rid, PageId &base, int &bytes) const;
+  void reencode(const PageId newBase, const int newPageBytes);
+  void assign(const int *keys, const RecordId *rids, const int count);
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ */
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ */
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+ */
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+ */
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+ */
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+ */
+typedef LeafNode<StringKey> LeafNodeString;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is COMPOSITE.
+ */
+typedef NonLeafNode<CompositeKey> NonLeafNodeComposite;
+
+/**
+ * @brief Structure for all leaf nodes when the key is COMPOSITE.
+ */
+typedef LeafNode<CompositeKey> LeafNodeComposite;
+
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE,
+              "NonLeafNodeInt must fit in a page.");
+static_assert(sizeof(LeafNodeInt) <= Page::SIZE,
+              "LeafNodeInt must fit in a page.");
+static_assert(sizeof(NonLeafNodeDouble) <= Page::SIZE,
+              "NonLeafNodeDouble must fit in a page.");
+static_assert(sizeof(LeafNodeDouble) <= Page::SIZE,
+              "LeafNodeDouble must fit in a page.");
+static_assert(sizeof(NonLeafNodeString) <= Page::SIZE,
+              "NonLeafNodeString must fit in a page.");
+static_assert(sizeof(LeafNodeString) <= Page::SIZE,
+              "LeafNodeString must fit in a page.");
+static_assert(sizeof(NonLeafNodeComposite) <= Page::SIZE,
+              "NonLeafNodeComposite must fit in a page.");
+static_assert(sizeof(LeafNodeComposite) <= Page::SIZE,
+              "LeafNodeComposite must fit in a page.");
+
+/**
+ * @brief One range of a scan of several ranges, with bounds as startScan()
+ * takes them. A NULL bound leaves its end of the range open, the operator
+ * being ignored.
+ */
+struct ScanRange {
+  void *lowVal;
+  Operator lowOp;
+  void *highVal;
+  Operator highOp;
+};
+
+/**
+ * @brief Check of keys against one bound of a scan, with the operator as a
+ * template argument so that each check compiles to a single comparison or
+ * search. Scans pick the instance for the current range once per call.
+ */
+template <Operator Op>
+struct ScanBound {
+  /**
+   * Returns true if key is on the side of bound that Op keeps.
+   */
+  template <class T>
+  static bool holds(const T &key, const T &bound) {
+    return Op == LT    ? key < bound
+           : Op == LTE ? key <= bound
+           : Op == GTE ? key >= bound
+                       : key > bound;
+  }
+
+  /**
+   * Returns the index of the first entry of node that a low bound keeps, or
+   * of the first entry past those a high bound keeps.
+   */
+  template <class T>
+  static int position(const LeafNode<T> &node, const T &bound) {
+    return Op == LT || Op == GTE ? node.lowerBound(bound)
+                                 : node.upperBound(bound);
+  }
+};
+
+/**
+ * Returns ScanBound<op>::position() for an operator only known at run time.
+ */
+template <class T>
+int boundPosition(const LeafNode<T> &node, const Operator op,
+                  const T &bound) {
+  switch (op) {
+    case LT:
+      return ScanBound<LT>::position(node, bound);
+    case LTE:
+      return ScanBound<LTE>::position(node, bound);
+    case GTE:
+      return ScanBound<GTE>::position(node, bound);
+    case GT:
+    default:
+      return ScanBound<GT>::position(node, bound);
+  }
+}
+
+/**
+ * @brief Work done by the calls of one BTreeIndex method since the index was
+ * opened.
+ */
+struct BTreeOpStats {
+  /**
+   * Number of calls
+   */
+  std::uint64_t calls;
+
+  /**
+   * Nodes passed going down from the root or a node above to a leaf, the leaf
+   * included, over all calls
+   */
+  std::uint64_t descentDepth;
+
+  /**
+   * Pages of the index read or pinned, hot nodes and mapped pages included,
+   * over all calls
+   */
+  std::uint64_t pagesTouched;
+};
+
+/**
+ * @brief Running totals behind a BTreeOpStats, added to by several threads.
+ */
+struct BTreeOpCounters {
+  std::atomic<std::uint64_t> calls;
+  std::atomic<std::uint64_t> descentDepth;
+  std::atomic<std::uint64_t> pagesTouched;
+
+  BTreeOpCounters() : calls(0), descentDepth(0), pagesTouched(0) {}
+
+  /**
+   * Returns the totals.
+   */
+  BTreeOpStats load() const {
+    BTreeOpStats stats = {calls.load(), descentDepth.load(),
+                          pagesTouched.load()};
+    return stats;
+  }
+};
+
+/**
+ * @brief Shape of a BTreeIndex and the work done on it since it was opened,
+ * as BTreeIndex::getStats() finds them.
+ */
+struct BTreeStats {
+  /**
+   * Number of levels, the leaves included. 1 while the root is a leaf.
+   */
+  int height;
+
+  /**
+   * Number of nodes on each level, from the root's level down to the leaves'
+   */
+  std::vector<std::size_t> levelNodes;
+
+  /**
+   * Number of entries in the leaves
+   */
+  std::size_t entries;
+
+  /**
+   * Average fraction of a node's space in use, over the leaves and over the
+   * non-leaf nodes. 0 if there are none.
+   */
+  double leafFill;
+  double internalFill;
+
+  /**
+   * Leaves and non-leaf nodes split in two, and splits that gave the tree a
+   * new root
+   */
+  std::uint64_t leafSplits;
+  std::uint64_t internalSplits;
+  std::uint64_t rootSplits;
+
+  /**
+   * Bits of the key filter, 0 if there is none, and lookups it answered
+   * without going to the tree since the index was opened
+   */
+  std::size_t filterBits;
+  std::uint64_t filterRejects;
+
+  /**
+   * Snapshot scans open, and node images kept for them
+   */
+  std::size_t openSnapshots;
+  std::size_t snapshotImages;
+
+  /**
+   * Work done by insertEntry(), startScan() and scanNext(), of every overload
+   */
+  BTreeOpStats insert;
+  BTreeOpStats startScan;
+  BTreeOpStats scanNext;
+};
+
+/**
+ * @brief The state of one scan of a BTreeIndex. Any number of cursors can scan
+ * the same index at once, each keeping only its own current leaf pinned. A
+ * cursor is started, advanced and ended through the BTreeIndex it scans, and
+ * has to be ended before that index is destroyed. One cursor must not be used
+ * by several threads at once.
+ */
+class IndexCursor {
+  friend class BTreeIndex;
+
+private:
+  /**
+   * Index being scanned, if a scan has been started.
+   */
+  BTreeIndex *index;
+
+  /**
+   * True if an index scan has been started.
+   */
+  bool scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */
+  int nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+  PageId currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+  Page *currentPageData;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+  int lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+  double lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+  StringKey lowValString;
+
+  /**
+   * Low COMPOSITE value for scan.
+   */
+  CompositeKey lowValComposite;
+
+  /**
+   * High INTEGER value for scan.
+   */
+  int highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+  double highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+  StringKey highValString;
+
+  /**
+   * High COMPOSITE value for scan.
+   */
+  CompositeKey highValComposite;
+
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+  Operator lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+  Operator highOp;
+
+  /**
+   * True if entries are returned from the high end of the range down.
+   */
+  bool descending;
+
+  /**
+   * Leaf a descending scan last stepped left from, or Page::INVALID_NUMBER.
+   */
+  PageId prevLeaf;
+
+  // The current leaf is not latched between calls, so inserts may change it.
+  // These remember the position in a way that survives that.
+
+  /**
+   * Version of the current leaf's latch when the cursor last let go of it.
+   */
+  std::uint32_t leafVersion;
+
+  /**
+   * Page number up to which leaves have been read ahead, exclusive.
+   */
+  PageId readAheadEnd;
+
+  /**
+   * Last INTEGER key returned from the current leaf.
+   */
+  int lastValInt;
+
+  /**
+   * Last DOUBLE key returned from the current leaf.
+   */
+  double lastValDouble;
+
+  /**
+   * Last STRING key returned from the current leaf.
+   */
+  StringKey lastValString;
+
+  /**
+   * Last COMPOSITE key returned from the current leaf.
+   */
+  CompositeKey lastValComposite;
+
+  /**
+   * Number of entries with the last key returned from the current leaf, up to
+   * that entry, or 0 if none has been returned from it and the low bound (the
+   * high bound, for a descending scan) gives the position.
+   */
+  int lastValDups;
+
+  /**
+   * RecordId of the last entry returned from the current leaf. Deletes may
+   * take out entries before it, so it is looked for before lastValDups is
+   * trusted.
+   */
+  RecordId lastRid;
+
+  /**
+   * Low and high bound of every range of the scan, for the index's key type,
+   * with the operators of each, and the index of the range after the current
+   * one. A scan of a single range has its bounds in lowValInt and the rest.
+   */
+  std::vector<int> rangeInts;
+  std::vector<double> rangeDoubles;
+  std::vector<StringKey> rangeStrings;
+  std::vector<CompositeKey> rangeComposites;
+  std::vector<Operator> rangeOps;
+  std::size_t nextRange;
+
+  /**
+   * Non-leaf nodes from the root to the current leaf as of the last descent,
+   * and the versions of their latches then.
+   */
+  std::vector<PageId> pathPages;
+  std::vector<std::uint32_t> pathVersions;
+
+  IndexCursor(const IndexCursor &);
+  IndexCursor &operator=(const IndexCursor &);
+
+public:
+  /**
+   * IndexCursor Constructor. The cursor starts out without a scan.
+   */
+  IndexCursor();
+
+  /**
+   * IndexCursor Destructor.
+   * End the scan, if any, unpinning its current leaf.
+   */
+  ~IndexCursor();
+
+  /**
+   * Returns true if a scan has been started and not ended.
+   */
+  bool isScanning() const { return scanExecuting; }
+};
+
+/**
+ * @brief The state of one snapshot scan of a BTreeIndex. The scan returns the
+ * entries of its range as they were when it started, whatever inserts,
+ * deletes and splits go on meanwhile, in ascending order. It keeps no page
+ * pinned or latched between calls, but a copy of its current leaf: writers
+ * keep the image a node had before they first change it while the snapshot
+ * needs it, and the scan reads that instead. Like an IndexCursor, it is
+ * started, advanced and ended through the BTreeIndex it scans, has to be ended
+ * before that index is destroyed, and must not be used by several threads at
+ * once.
+ */
+class SnapshotCursor {
+  friend class BTreeIndex;
+
+private:
+  /**
+   * Index being scanned, if a scan has been started.
+   */
+  BTreeIndex *index;
+
+  /**
+   * True if a scan has been started and not ended.
+   */
+  bool scanExecuting;
+
+  /**
+   * Epoch of the snapshot. Changes made in later epochs are not seen.
+   */
+  std::uint64_t epoch;
+
+  /**
+   * Page number of the node in node, and the index of the next entry of the
+   * leaf to return.
+   */
+  PageId currentPageNum;
+  int nextEntry;
+
+  /**
+   * Copy of the current node, as the snapshot sees it.
+   */
+  std::unique_ptr<Page> node;
+
+  /**
+   * High bound of the scan, for the index's key type, and its operator.
+   */
+  int highValInt;
+  double highValDouble;
+  StringKey highValString;
+  CompositeKey highValComposite;
+  Operator highOp;
+
+  SnapshotCursor(const SnapshotCursor &);
+  SnapshotCursor &operator=(const SnapshotCursor &);
+
+public:
+  /**
+   * SnapshotCursor Constructor. The cursor starts out without a scan.
+   */
+  SnapshotCursor();
+
+  /**
+   * SnapshotCursor Destructor.
+   * End the scan, if any, letting go of its snapshot.
+   */
+  ~SnapshotCursor();
+
+  /**
+   * Returns true if a scan has been started and not ended.
+   */
+  bool isScanning() const { return scanExecuting; }
+};
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
+ * of a relation. Several scans can run at once through IndexCursor objects.
+ * insertEntry(), deleteEntry(), updateEntry(), compact() and the scan methods
+ * taking a cursor may be called from several threads at once. The scan methods
+ * without a cursor share one, so only one thread may use them.
+ *
+ * Deletes never merge or redistribute nodes: a leaf stays where it is until it
+ * is empty, and is only then taken out of the tree by compact(). Entries thus
+ * never move left, which keeps scans that let go of their leaf between calls
+ * correct. Leaves taken out go on a free list in the meta page once no scan is
+ * open, and splits take their new nodes from it first.
+ */
+class BTreeIndex {
+  friend class IndexNestedLoopJoin;
+  friend class MergeJoin;
+  friend class PartitionedIndex;
+
+private:
+  /**
+   * File object for the index file.
+   */
+  File *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file. Protected by
+   * rootLatch.
+   */
+  PageId rootPageNum;
+
+  /**
+   * Latch protecting rootPageNum. Held exclusively by inserts that may split
+   * the root.
+   */
+  PageLatch rootLatch;
+
+  /**
+   * Latches of the index's pages.
+   */
+  PageLatchTable latches;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  /**
+   * Columns of the key of a COMPOSITE index, empty for the other types.
+   */
+  std::vector<KeyColumn> keyColumns;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key.
+   */
+  int leafOccupancy;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key.
+   */
+  int nodeOccupancy;
+
+  /**
+   * Cursor used by the scan methods that do not take one.
+   */
+  IndexCursor scan;
+
+  /**
+   * Used for splitting root
+   */
+  PageId initialRootPageId;
+
+  /**
+   * True if the index was opened read-only, so it cannot change.
+   */
+  bool readOnly;
+
+  /**
+   * Pages of the index file mapped into memory in read-only mode, NULL if the
+   * index reads its pages through the buffer manager.
+   */
+  const Page *mappedPages;
+
+  /**
+   * Number of pages in mappedPages.
+   */
+  std::size_t numMappedPages;
+
+  /**
+   * Non-leaf nodes of the top HOT_NODE_LEVELS levels, each pinned once in the
+   * buffer pool for as long as it is here. NULL for any other page. Nodes are
+   * added as traversals first reach them.
+   */
+  PageTable<std::atomic<Page *> > hotNodes;
+
+  /**
+   * Numbers of the pages in hotNodes, protected by hotNodeLatch along with
+   * adding to hotNodes.
+   */
+  std::vector<PageId> hotNodeIds;
+  std::mutex hotNodeLatch;
+
+  /**
+   * Most nodes kept in hotNodes, a quarter of the buffer pool.
+   */
+  std::size_t maxHotNodes;
+
+  /**
+   * Number of cursors with a scan of this index open.
+   */
+  std::atomic<int> openScans;
+
+  /**
+   * Leaves compact() took out of the tree while scans were open. A scan may
+   * still be on one of them, so they go on the free list only once no scan is
+   * open. Protected by retiredLatch.
+   */
+  std::vector<PageId> retiredNodes;
+  std::mutex retiredLatch;
+
+  /**
+   * Image of a node as it was before the first change made to it in an
+   * epoch.
+   */
+  struct NodeImage {
+    std::uint64_t epoch;
+    std::vector<char> data;
+  };
+
+  /**
+   * Version store of the snapshot scans. Each snapshot is taken at the
+   * current epoch, and the next one starts then. The first time a node is
+   * changed in an epoch after a snapshot that needs it, its image goes on its
+   * list, oldest first. A snapshot reads the first image of a later epoch than
+   * its own, or the node itself if there is none. Images no open snapshot
+   * reads are dropped when a snapshot ends. Protected by versionLatch, taken
+   * after any page latch; openSnapshots lets writers skip it while no
+   * snapshot is open.
+   */
+  std::uint64_t snapshotEpoch;
+  std::set<std::uint64_t> snapshotEpochs;
+  std::unordered_map<PageId, std::vector<NodeImage> > nodeImages;
+  std::atomic<int> openSnapshots;
+  std::mutex versionLatch;
+
+  /**
+   * The rightmost leaf, while inserts are appending keys to it, or
+   * Page::INVALID_NUMBER. Only changed with the leaf's latch held.
+   */
+  std::atomic<PageId> rightmostLeaf;
+
+  /**
+   * Entries inserted or deleted since the entry counts of the non-leaves were
+   * last set by an estimate, and the number of entries there were then.
+   */
+  std::atomic<std::size_t> staleEntries;
+  std::atomic<std::size_t> countedEntries;
+
+  /**
+   * Number of entries the insert buffer collects before they go into the
+   * tree, or 0 if entries are inserted right away.
+   */
+  std::size_t insertBufferCapacity;
+
+  /**
+   * Entries insertEntry() collected and that are not in the tree yet, their
+   * keys packed as insertBatch() takes them. Protected by insertBufferLatch,
+   * which lookups hold in shared mode while they search the tree, so that no
+   * entry is seen in both places or in neither.
+   */
+  std::vector<char> bufferedKeys;
+  std::vector<RecordId> bufferedRids;
+  PageLatch insertBufferLatch;
+
+  /**
+   * Side log of the relation the index was built online from, which forwards
+   * new records to the index, or NULL.
+   */
+  IndexBuildLog *buildLog;
+
+  /**
+   * Splits since the index was opened, by the kind of node split, and those
+   * that made a new root.
+   */
+  std::atomic<std::uint64_t> leafSplits;
+  std::atomic<std::uint64_t> internalSplits;
+  std::atomic<std::uint64_t> rootSplits;
+
+  /**
+   * Work done by insertEntry(), startScan() and scanNext() since the index
+   * was opened.
+   */
+  BTreeOpCounters insertCounters;
+  BTreeOpCounters startScanCounters;
+  BTreeOpCounters scanNextCounters;
+
+  /**
+   * Bloom filter of the keys of the index, FILTERBLOCKWORDS words per block,
+   * or NULL if there is none. Keys are added before their entries go into
+   * the tree, so a lookup that misses the filter can skip the tree.
+   */
+  std::unique_ptr<std::atomic<std::uint64_t>[]> filterWords;
+  std::uint32_t filterBlocks;
+  int filterHashes;
+
+  /**
+   * Lookups the key filter answered since the index was opened.
+   */
+  std::atomic<std::uint64_t> filterRejects;
+
+  /**
+   * A helper method that adds a key to the key filter, if there is one.
+   */
+  template <class T>
+  void filterAdd(const T &key);
+
+  /**
+   * A helper method that returns false if the key filter shows no entry has
+   * the key, and true if one may.
+   */
+  template <class T>
+  bool filterMayContain(const T &key);
+
+  /**
+   * A helper method that sizes an empty key filter and adds the key of every
+   * entry in the leaves to it.
+   *
+   * @param blocks  Number of blocks of the filter
+   * @param hashes  Number of bits each key sets
+   */
+  void fillFilter(const std::uint32_t blocks, const int hashes);
+
+  /**
+   * A helper method that adds the key of every entry in the leaves to the key
+   * filter. fillFilter() dispatches on the attribute type once and calls this.
+   */
+  template <class T>
+  void fillFilterKeys();
+
+  /**
+   * A helper method that reads the key filter from its pages.
+   *
+   * @param pageNo  First page of the filter
+   */
+  void readFilter(PageId pageNo);
+
+  /**
+   * A helper method that writes the key filter to its pages, chaining more
+   * pages to the meta page as needed, and marks it saved. No page of the
+   * index may be pinned.
+   */
+  void saveFilter();
+
+  /**
+   * A helper method that marks the saved key filter out of date, or saved,
+   * and flushes the index file. No page of the index may be pinned.
+   */
+  void markFilterSaved(const bool saved);
+
+  /**
+   * A helper method that gets a page of the index for reading. Mapped pages
+   * are used in place, any other page is read through the buffer manager and
+   * stays pinned until releaseNode() is called.
+   *
+   * @param pageNo  Number of the page
+   * @param page    The page, returned via this reference
+   */
+  void readNode(const PageId pageNo, Page *&page);
+
+  /**
+   * A helper method that gives back a page got through readNode().
+   *
+   * @param pageNo  Number of the page
+   */
+  void releaseNode(const PageId pageNo);
+
+  /**
+   * A helper method that gets a non-leaf node for a traversal. Hot nodes and
+   * mapped pages are used in place. Any other node is pinned in the buffer
+   * pool, and if it is in the top HOT_NODE_LEVELS levels it is made hot and
+   * keeps that pin.
+   *
+   * @param pageNo  Number of the page
+   * @param depth   Depth of the node, 0 for the root
+   * @param page    The page, returned via this reference
+   * @return  True if the caller has to unpin the page once done with it
+   */
+  bool readInternal(const PageId pageNo, const int depth, Page *&page);
+
+  /**
+   * A helper method that unpins all hot nodes, emptying hotNodes. Called
+   * before the index file is flushed, since no page may be pinned then.
+   */
+  void releaseHotNodes();
+
+  /**
+   * A helper method that allocates a page for a new node, taking it off the
+   * free list if there is one there. The page is zero if it was free.
+   *
+   * @param pageNo  Number of the page, returned via this reference
+   * @param page    The page, pinned, returned via this reference
+   */
+  void allocNode(PageId &pageNo, Page *&page);
+
+  /**
+   * A helper method that puts the retired leaves on the free list if no scan
+   * is open.
+   */
+  void freeRetiredNodes();
+
+  /**
+   * A helper method that keeps the image of a node an open snapshot needs
+   * before it is changed. The caller holds the node's latch exclusively.
+   *
+   * @param pageNo  Number of the node
+   * @param page    The node, pinned, not changed yet
+   */
+  void preserveNode(const PageId pageNo, const Page *page);
+
+  /**
+   * A helper method that copies a node, as the snapshot of cursor sees it,
+   * into the cursor.
+   *
+   * @param cursor  Cursor of the snapshot scan
+   * @param pageNo  Number of the node
+   */
+  void readSnapshotNode(SnapshotCursor &cursor, const PageId pageNo);
+
+  /**
+   * A helper method that drops the images no open snapshot reads any more.
+   * The caller holds versionLatch.
+   */
+  void dropNodeImages();
+
+  /**
+   * A helper method that takes the snapshot of cursor and positions it on the
+   * first entry satisfying the low bound. startSnapshotScan() validates the
+   * arguments and calls this for the index's key type.
+   *
+   * @param cursor  Cursor of the snapshot scan
+   * @param lowVal  Low value of range
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, stored in the cursor
+   * @param highOp  High operator (LT/LTE)
+   * @throws  NoSuchKeyFoundException If there is no key in the snapshot that
+   *satisfies the scan criteria.
+   */
+  template <class T>
+  void startSnapshotKey(SnapshotCursor &cursor, const T &lowVal,
+                        const Operator lowOp, T &highVal,
+                        const Operator highOp);
+
+  /**
+   * A helper method that returns the next entry of a snapshot scan.
+   * scanNext() dispatches on the attribute type once and calls this.
+   *
+   * @param cursor  Cursor of the snapshot scan
+   * @param outRid  RecordId of the entry
+   * @param outKey  Receives the key, if not NULL
+   * @param highVal High value of range
+   * @throws  IndexScanCompletedException If no entry of the range is left.
+   */
+  template <class T>
+  void snapshotNextKey(SnapshotCursor &cursor, RecordId &outRid, T *outKey,
+                       const T &highVal);
+
+  /**
+   * A helper method that marks a page the caller has pinned dirty now, so that
+   * the log gets its image before the pages unpinned after it.
+   *
+   * @param pageNo  Number of the page
+   */
+  void touchNode(const PageId pageNo);
+
+  /**
+   * A helper method that finds the leaf for key and latches it exclusively.
+   * Non-leaf nodes are latched in shared mode on the way down, each only until
+   * its child is latched.
+   *
+   * @param key    Key to look for
+   * @param first  If true, goes to the leftmost leaf that can hold key, else to
+   * the leaf a new entry with key goes to
+   * @param page   The leaf, pinned, returned via this reference
+   * @param fence  If not NULL and first is false, receives the smallest key
+   * that goes to a leaf right of this one
+   * @param fenced Set to false if no key goes right of this leaf
+   * @return  Page number of the leaf
+   */
+  template <class T>
+  PageId latchLeaf(const T &key, const bool first, Page *&page,
+                   T *fence = NULL, bool *fenced = NULL);
+
+  /**
+   * A helper method that finds the leftmost leaf that can hold key and latches
+   * it in shared mode. Each node on the way down is latched before its parent
+   * is let go of. The leaf is got through readNode().
+   *
+   * @param key     Key to look for
+   * @param page    The leaf, returned via this reference
+   * @param cursor  If not NULL, its path is replaced by the nodes passed
+   * @return  Page number of the leaf
+   */
+  template <class T>
+  PageId latchLeafShared(const T &key, Page *&page,
+                         IndexCursor *cursor = NULL);
+
+  /**
+   * A helper method that goes down from a latched non-leaf node to the
+   * leftmost leaf under it that can hold key, latching the leaf in shared
+   * mode as latchLeafShared() does. The node is let go of on the way.
+   *
+   * @param key     Key to look for
+   * @param pageNo  Page number of the node
+   * @param depth   Depth of the node, 0 for the root
+   * @param pinned  True if the node has to be unpinned once done with
+   * @param page    The node, and then the leaf, via this reference
+   * @param cursor  If not NULL, the nodes passed are added to its path
+   * @return  Page number of the leaf
+   */
+  template <class T>
+  PageId descendShared(const T &key, PageId pageNo, int depth, bool pinned,
+                       Page *&page, IndexCursor *cursor);
+
+  /**
+   * A helper method that latches the leftmost leaf that can hold key for a
+   * cursor moving forward to it. The descent starts from the lowest node on
+   * the cursor's path that has not changed since and holds key in one of its
+   * subtrees other than the last, from the root if there is none.
+   *
+   * @param cursor  Cursor of the scan, its path updated
+   * @param key     Key to look for, not below the keys the cursor has passed
+   * @param page    The leaf, returned via this reference
+   * @return  Page number of the leaf
+   */
+  template <class T>
+  PageId latchLeafFrom(IndexCursor &cursor, const T &key, Page *&page);
+
+  /**
+   * A helper method that finds the entries with a key of the index's type.
+   * lookup() and lookupAll() dispatch on the attribute type once and call
+   * this.
+   *
+   * @param key     Key to look for
+   * @param outRid  If not NULL, receives the RecordId of the first entry
+   * @param outRids If not NULL, the RecordIds of all entries are appended here
+   * @return  True if an entry was found
+   */
+  template <class T>
+  bool lookupKey(const T &key, RecordId *outRid,
+                 std::vector<RecordId> *outRids);
+
+  /**
+   * A helper method that finds the entries of a batch of keys of the index's
+   * type, in sorted order so that neighbouring keys in one leaf are found
+   * without descending the tree again.
+   *
+   * @param keys     Array of n keys of the index's type
+   * @param n        Number of keys
+   * @param outRids  Replaced with the RecordIds of the entries, by key
+   * @param ends     Replaced with the end of the entries of each key in outRids
+   */
+  template <class T>
+  void lookupKeys(const void *keys, const std::size_t n,
+                  std::vector<RecordId> &outRids,
+                  std::vector<std::size_t> &ends);
+
+  /**
+   * A helper method that finds the entries with key from a latched leaf on,
+   * moving right while they run past the end of the leaf.
+   *
+   * @param key      Key to look for
+   * @param pageNo   Leaf to start from, latched in shared mode. Replaced with
+   * the latched leaf the search ended on
+   * @param page     The leaf, replaced along with pageNo
+   * @param outRid   If not NULL, receives the RecordId of the first entry
+   * @param outRids  If not NULL, the RecordIds of all entries are appended here
+   * @return  True if an entry was found
+   */
+  template <class T>
+  bool findInLeaves(const T &key, PageId &pageNo, Page *&page,
+                    RecordId *outRid, std::vector<RecordId> *outRids);
+
+  /**
+   * A helper method that deletes an entry with a key of the index's type.
+   * deleteEntry() dispatches on the attribute type once and calls this.
+   *
+   * @param key     Key of the entry
+   * @param rid     Record ID of the entry
+   * @return  True if the entry was found and deleted
+   */
+  template <class T>
+  bool deleteKey(const T &key, const RecordId rid);
+
+  /**
+   * A helper method that makes one compaction pass for the index's key type.
+   *
+   * @return  Number of leaves taken out of the tree
+   */
+  template <class T>
+  std::size_t compactKey();
+
+  /**
+   * A helper method that inserts a key of the index's type into the index.
+   * insertEntry() dispatches on the attribute type once and calls this.
+   *
+   * @param key     Key to insert
+   * @param rid     Record ID of a record whose entry is getting inserted
+   */
+  template <class T>
+  void insertKey(const T &key, const RecordId rid);
+
+  /**
+   * A helper method that adds a key of the index's type to the insert buffer,
+   * with the buffer's latch held exclusively.
+   *
+   * @param key     Key to insert
+   * @param rid     Record ID of a record whose entry is getting inserted
+   */
+  template <class T>
+  void bufferKey(const T &key, const RecordId rid);
+
+  /**
+   * A helper method that finds the entries with a key in the insert buffer,
+   * with the buffer's latch held.
+   *
+   * @param key     Key to look for
+   * @param outRid  If not NULL, receives the RecordId of the first entry
+   * @param outRids If not NULL, the RecordIds of all entries are appended here
+   * @return  True if an entry was found
+   */
+  template <class T>
+  bool findBuffered(const T &key, RecordId *outRid,
+                    std::vector<RecordId> *outRids);
+
+  /**
+   * A helper method that inserts the entries of the insert buffer into the
+   * tree and empties it, with the buffer's latch held exclusively.
+   */
+  void flushBuffered();
+
+  /**
+   * A helper method that inserts a batch of entries into the tree, bypassing
+   * the insert buffer.
+   *
+   * @param keys  Array of n keys of the index's type
+   * @param rids  Record IDs of the entries
+   * @param n     Number of entries
+   */
+  void insertSorted(const void *keys, const RecordId *rids,
+                    const std::size_t n);
+
+  /**
+   * A helper method that inserts a batch of keys of the index's type.
+   * insertBatch() dispatches on the attribute type once and calls this.
+   *
+   * @param keys  Array of n keys of the index's type
+   * @param rids  Record IDs of the entries
+   * @param n     Number of entries
+   */
+  template <class T>
+  void insertKeys(const void *keys, const RecordId *rids, const std::size_t n);
+
+  /**
+   * A helper method that inserts a data entry into a leaf that has room for
+   * it. Non-leaf nodes are latched in shared mode on the way down, each only
+   * until its child is latched, and the leaf exclusively.
+   *
+   * @param newEntry         Data entry of interest
+   * @return True if the entry was inserted, false if the leaf is full
+   */
+  template <class T>
+  bool insertOptimistic(const RIDKeyPair<T> newEntry);
+
+  /**
+   * A helper method that appends a data entry to the rightmost leaf without
+   * going down the tree, if the key is not less than any key in the index and
+   * the leaf has room for it. Only the leaf is latched.
+   *
+   * @param newEntry         Data entry of interest
+   * @return True if the entry was inserted
+   */
+  template <class T>
+  bool insertAppend(const RIDKeyPair<T> newEntry);
+
+  /**
+   * A helper method that inserts a data entry into the index, splitting nodes
+   * as needed. Nodes are latched exclusively on the way down, and the latches
+   * above a node that cannot split are released, and their pages unpinned,
+   * as soon as it is latched.
+   *
+   * @param newEntry         Data entry of interest
+   * @throws  BadIndexInfoException  If the tree has more than MAX_TREE_HEIGHT
+   * levels
+   */
+  template <class T>
+  void insertPessimistic(const RIDKeyPair<T> newEntry);
+
+  /**
+    * A helper method that finds next node to traverse to down the tree
+    *
     * @param internal Current node we are on
     * @param pageId   Return value for the next level page ID
     * @param key      Key being compared
    */
-  void findNextInternal(NonLeafNodeInt *internal, PageId &pageId, int key);
+  template <class T>
+  void findNextInternal(NonLeafNode<T> *internal, PageId &pageId, const T &key);
+
+  /**
+   * A helper mehtod that is called when the root node needs to be split
+   *
+   * @param firstPage   pageId of first page in root
+   * @param separator   Separator of the page split off firstPage
+  */
+  template <class T>
+  void splitRoot(PageId firstPage, const PageKeyPair<T> &separator);
+
+  /**
+   * A helper method that splits a leaf and copys middle key up the tree.
+   *
+   * @param leaf        Leaf of interest
+   * @param leafPageId  Page Id of leaf of interest
+   * @param isRoot      True if the leaf is the root
+   * @param separator   Set to the separator for the parent
+   * @param newEntry    The new entry of interest
+  */
+  template <class T>
+  void splitLeaf(LeafNode<T> *leaf, PageId leafPageId, bool isRoot,
+                 PageKeyPair<T> &separator, const RIDKeyPair<T> newEntry);
+
+  /**
+   * A helper method that points the left sibling link of a leaf at another
+   * leaf, latching the leaf exclusively. The caller holds the latch of the
+   * leaf on its left, if any, since leaves are latched left to right.
+   *
+   * @param pageNo     Page number of the leaf
+   * @param leftSibNo  Page number of its new left sibling
+   */
+  template <class T>
+  void setLeftSib(const PageId pageNo, const PageId leftSibNo);
+
+  /**
+    * A helper method that inserts a data entry into a leaf
+    * @param leaf     Leaf of interest
+    * @param newEntry Entry of interest
+    */
+  template <class T>
+  void insertLeaf(LeafNode<T> *leaf, const RIDKeyPair<T> newEntry);
+
+  /**
+    * A helper method that inserts splits an internal node and pushes the middle key upwards. Can recursively
+    * propagate up the tree
+    *
+    * @param oldNode         The internal node that's being split
+    * @param oldPageId       The page id of the internal node that's being split
+    * @param isRoot          True if the internal node is the root
+    * @param separator       Separator of the child that split, replaced by the
+    *                        one pushed up
+   */
+  template <class T>
+  void splitInternal(NonLeafNode<T> *oldNode, PageId oldPageId, bool isRoot,
+                     PageKeyPair<T> &separator);
+
+  /**
+   * A helper method that inserts a data entry into an internal node
+   *
+   * @param internal The internal node of interest
+   * @param entry    The entry of interest
+   *
+   */
+  template <class T>
+  void insertInternal(NonLeafNode<T> *internal,
+                      const PageKeyPair<T> &newEntry);
+
+  /**
+   * Opens or builds the index on a single attribute, or on keyColumns if
+   * attrType is COMPOSITE. The public constructors delegate to it.
+   * If fileName is not NULL, the index is kept in the file of that name
+   * instead, and a new one starts out empty rather than being built from the
+   * relation, for a PartitionedIndex to fill.
+   */
+  BTreeIndex(const std::string &relationName, std::string &outIndexName,
+             BufMgr *bufMgrIn, const int attrByteOffset,
+             const Datatype attrType,
+             const std::vector<KeyColumn> &keyColumns,
+             const bool useBulkLoad, const double fillFactor,
+             const bool readOnly, const std::size_t buildThreads,
+             IndexBuildLog *buildLog, const std::string *fileName);
+
+  /**
+   * A helper method that reads the key of a record for the index's key type.
+   *
+   * @param record  The record
+   * @param key     The key, returned via this reference
+   */
+  template <class T>
+  void loadRecordKey(const char *record, T &key) const {
+    key = KeyTraits<T>::load(record + this->attrByteOffset);
+  }
+
+  /**
+   * A helper method that encodes the columns of a record into the key of a
+   * COMPOSITE index.
+   *
+   * @param record  The record
+   * @param key     The key, returned via this reference
+   */
+  void loadRecordKey(const char *record, CompositeKey &key) const;
+
+  /**
+   * A helper method that inserts the entry of a record, as insertEntry() does.
+   *
+   * @param record  The record
+   * @param rid     Record ID of the record
+   */
+  void insertRecord(const char *record, const RecordId rid);
+
+  /**
+   * A helper method that builds the tree bottom-up from every tuple in the base
+   * relation on several threads. The (key, rid) pairs are collected with a
+   * ParallelFileScan into sorted runs, spilled to a temporary file when they do
+   * not fit in half of the buffer pool. The merged order of the runs is split
+   * into one range per thread, each packed into a part of the leaf level, and
+   * the non-leaf levels are built on top. Every node is written exactly once.
+   *
+   * @param relationName Name of the base relation
+   * @param fillFactor   Fraction of each node to fill, in (0, 1]
+   * @param numThreads   Number of threads to build with, one per core if 0
+   */
+  template <class T>
+  void bulkLoad(const std::string &relationName, const double fillFactor,
+                const std::size_t numThreads);
+
+  /**
+   * A helper method that builds the index while writers keep inserting into
+   * the relation. The relation's pages are read one at a time under the log's
+   * latch and inserted in batches, then the records the log collected
+   * meanwhile are replayed, skipping those already on a page when it was read.
+   * Once little is left, the rest is replayed with the latch held, the meta
+   * page is marked complete and the log starts forwarding records to the
+   * index, all before the writers get the latch back. The index is flushed
+   * before the replay; later changes reach the file when it is closed.
+   *
+   * @param log  Side log every writer of the relation was given
+   */
+  template <class T>
+  void buildOnline(IndexBuildLog &log);
+
+  /**
+   * A helper method that builds one non-leaf level above the given nodes. On
+   * return, children holds the nodes of the new level.
+   *
+   * @param children   First key and page of every node on the level below
+   * @param level      Level member of the new nodes (1 if just above leaves)
+   * @param fillFactor Fraction of each node to fill, in (0, 1]
+   */
+  template <class T>
+  void buildNonLeafLevel(std::vector<PageKeyPair<T> > &children,
+                         const int level, const double fillFactor);
+
+  /**
+   * A helper method that positions the scan on the first entry satisfying the
+   * low bound. startScan() validates the arguments, stores the bounds and
+   * calls this for the index's key type.
+   *
+   * @param cursor  Cursor of the scan
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   */
+  template <class T>
+  void startScanKey(IndexCursor &cursor, const T &lowVal, const T &highVal);
+
+  /**
+   * A helper method that begins a scan of one or more ranges on cursor.
+   * startScan() calls it with the range or ranges it was given.
+   *
+   * @param cursor     Cursor that holds the state of the scan
+   * @param ranges     Ranges to scan, sorted and disjoint
+   * @param numRanges  Number of ranges, at least 1
+   * @param descending If true, the single range is scanned from the high end
+   * @throws  BadOpcodesException If an operator is not one the range expects
+   * @throws  BadScanrangeException If a range is empty or ranges overlap or
+   * are out of order
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   */
+  void startRanges(IndexCursor &cursor, const ScanRange *ranges,
+                   const std::size_t numRanges, const bool descending);
+
+  /**
+   * A helper method that encodes the values of the leading columns of a
+   * COMPOSITE key and fills the rest of it with fill.
+   *
+   * @param values     Pointer to the value of each leading column
+   * @param numValues  Number of values
+   * @param fill       Byte the rest of the key is filled with
+   * @param key        The key, returned via this reference
+   * @throws  BadIndexInfoException If the index is not COMPOSITE or has fewer
+   * columns than values
+   */
+  void encodeKey(const void *const *values, const int numValues,
+                 const unsigned char fill, CompositeKey &key) const;
+
+  /**
+   * A helper method that stores the bounds of the ranges of a scan in the
+   * cursor, open bounds replaced by the smallest and largest keys.
+   *
+   * @param cursor     Cursor of the scan
+   * @param ranges     Ranges to scan
+   * @param numRanges  Number of ranges
+   * @param bounds     Low and high bound of each range, replaced
+   * @return  True if the ranges are each non-empty, sorted and disjoint
+   */
+  template <class T>
+  bool storeRanges(IndexCursor &cursor, const ScanRange *ranges,
+                   const std::size_t numRanges, std::vector<T> &bounds);
+
+  /**
+   * A helper method that makes the next range of a multi-range scan the
+   * current one.
+   *
+   * @param cursor  Cursor of the scan
+   * @return  False if the current range was the last
+   */
+  bool advanceRange(IndexCursor &cursor);
+
+  /**
+   * A helper method that positions the scan on the first entry satisfying the
+   * low bound at or right of its latched leaf. The cursor moves right along
+   * the leaves, or when the bound is past its leaf and descend is set, goes
+   * down again through latchLeafFrom().
+   *
+   * @param cursor  Cursor of the scan
+   * @param lowVal  Low value of range
+   * @param descend True to go down again if the bound is past the leaf
+   */
+  template <class T>
+  void seekLow(IndexCursor &cursor, const T &lowVal, const bool descend);
+
+  /**
+   * A helper method that positions a descending scan on the last entry
+   * satisfying the high bound, as startScanKey() does for the low bound.
+   *
+   * @param cursor  Cursor of the scan
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   */
+  template <class T>
+  void startScanDescending(IndexCursor &cursor, const T &lowVal,
+                           const T &highVal);
+
+  /**
+   * A helper method that fetches the next entry of a descending scan, the
+   * one before the last entry returned. scanNextKey() calls it.
+   *
+   * @param cursor  Cursor of the scan
+   * @param outRid  RecordId of next record found that satisfies the scan
+   * @param outKey  Receives the key of the entry, if not NULL
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @param lastVal Last key returned from the cursor's leaf
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   */
+  template <class T>
+  void scanPrevKey(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                   const T &lowVal, const T &highVal, T &lastVal);
 
   /**
-   * A helper mehtod that is called when the root node needs to be split
+   * A helper method that takes the entry at the position of an ascending
+   * scan, moving right past exhausted leaves, if it is within the high bound.
+   * Entries from the position on all satisfy the low bound.
    *
-   * @param firstPage   pageId of first page in root
-   * @param newInternal Internal for split process
-  */
-  void splitRoot(PageId firstPage, PageKeyPair<int> *newchildEntry);
+   * @param cursor  Cursor of the scan, with its leaf latched
+   * @param outRid  RecordId of the entry
+   * @param outKey  Receives the key of the entry, if not NULL
+   * @param highVal High value of range
+   * @return  False if no entry is left or the next one is past the high bound
+   */
+  template <class T, Operator HighOp>
+  bool takeNext(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                const T &highVal);
 
   /**
-   * A helper method that splits a leaf and copys middle key up the tree.
+   * A helper method that takes the entry at the position of a descending
+   * scan, moving left past exhausted leaves, if it is within the low bound.
+   * Entries up to the position all satisfy the high bound.
    *
-   * @param leaf        Leaf of interest
-   * @param leafPageId  Page Id of leaf of interest
-   * @param newInternal New internal node if parent node is full
-   * @param newEntry    The new entry of interest
-  */
-  void splitLeaf(LeafNodeInt *leaf, PageId leafPageId, PageKeyPair<int> *&newInternal, RIDKeyPair<int> newEntry);
+   * @param cursor  Cursor of the scan, with its leaf latched
+   * @param outRid  RecordId of the entry
+   * @param outKey  Receives the key of the entry, if not NULL
+   * @param lowVal  Low value of range
+   * @return  False if no entry is left or the next one is past the low bound
+   */
+  template <class T, Operator LowOp>
+  bool takePrev(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                const T &lowVal);
 
   /**
-    * A helper method that inserts a data entry into a leaf
-    * @param leaf     Leaf of interest
-    * @param newEntry Entry of interest
-    */
-  void insertLeaf(LeafNodeInt *leaf, RIDKeyPair<int> newEntry);
+   * A helper method that fetches the next run of entries of a descending
+   * scan, in descending order. scanNextBatchKey() calls it.
+   *
+   * @param cursor  Cursor of the scan
+   * @param outRids Array receiving the RecordIds, or NULL
+   * @param outKeys Array receiving the keys, or NULL
+   * @param maxRids Number of entries the arrays can hold
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @param lastVal Last key returned from the cursor's leaf
+   * @return Number of entries found
+   */
+  template <class T>
+  std::size_t scanPrevBatchKey(IndexCursor &cursor, RecordId *outRids,
+                               T *outKeys, const std::size_t maxRids,
+                               const T &lowVal, const T &highVal,
+                               T &lastVal);
 
   /**
-    * A helper method that inserts splits an internal node and pushes the middle key upwards. Can recursively
-    * propagate up the tree
-    *
-    * @param oldNode         The internal node that's being split
-    * @param oldPageId       The page id of the internal node that's being split
-    * @param newInternal     Node with entry that will get pushed up
+   * A helper method that fetches the next entry of the scan for the index's
+   * key type. scanNext() passes in the bounds stored by startScan().
+   *
+   * @param cursor  Cursor of the scan
+   * @param outRid  RecordId of next record found that satisfies the scan
+   * @param outKey  Receives the key of the entry, if not NULL
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @param lastVal Last key returned from the cursor's leaf
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
    */
-  void splitInternal(NonLeafNodeInt *oldNode, PageId oldPageId, PageKeyPair<int> *&newInternal);
+  template <class T>
+  void scanNextKey(IndexCursor &cursor, RecordId &outRid, T *outKey,
+                   const T &lowVal, const T &highVal, T &lastVal);
 
   /**
-   * A helper method that inserts a data entry into an internal node
+   * A helper method that fetches the next run of entries of the scan for the
+   * index's key type. scanNextBatch() passes in the high bound stored by
+   * startScan().
    *
-   * @param internal The internal node of interest
-   * @param entry    The entry of interest
+   * @param cursor  Cursor of the scan
+   * @param outRids Array receiving the RecordIds, or NULL to only count the
+   * entries
+   * @param outKeys Array receiving the keys, or NULL
+   * @param maxRids Number of entries the arrays can hold
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @param lastVal Last key returned from the cursor's leaf
+   * @return Number of entries found
+   */
+  template <class T>
+  std::size_t scanNextBatchKey(IndexCursor &cursor, RecordId *outRids,
+                               T *outKeys, const std::size_t maxRids,
+                               const T &lowVal, const T &highVal,
+                               T &lastVal);
+
+  /**
+   * A helper method that finds the smallest or the largest key of the index.
+   * The leaf at that end of the tree is the only one read unless it is empty.
+   *
+   * @param last    True for the largest key
+   * @param outKey  Receives the key
+   * @return  False if the index is empty
+   */
+  template <class T>
+  bool edgeKey(const bool last, T &outKey);
+
+  /**
+   * A helper method that counts the entries in one or more ranges with a scan
+   * of its own. count() calls it with the range or ranges it was given.
+   *
+   * @param ranges     Ranges to count, sorted and disjoint
+   * @param numRanges  Number of ranges, at least 1
+   * @return Number of entries in the ranges
+   */
+  std::size_t countRanges(const ScanRange *ranges,
+                          const std::size_t numRanges);
+
+  /**
+   * A helper method that estimates the number of entries with a key below
+   * key, or not above it if inclusive, from the counts of the nodes on the
+   * path down to the leaf that holds the next entry.
+   *
+   * @param key       Key to rank
+   * @param inclusive True to count entries equal to key as well
+   * @return  Estimated number of entries
+   */
+  template <class T>
+  std::size_t rankKey(const T &key, const bool inclusive);
+
+  /**
+   * A helper method that sets the entry counts of the non-leaves again if too
+   * many entries were inserted or deleted since they last were.
+   */
+  void refreshStaleCounts();
+
+  /**
+   * A helper method that sets the entry counts of the non-leaves again for
+   * the index's key type.
+   *
+   * @return  Number of entries in the index
+   */
+  template <class T>
+  std::size_t refreshCounts();
+
+  /**
+   * A helper method that sets the entry counts of a non-leaf, and of the
+   * non-leaves under it, from the entries of the leaves.
+   *
+   * @param pageId  Page of the non-leaf
+   * @return  Number of entries under the non-leaf
+   */
+  template <class T>
+  std::size_t refreshNodeCounts(const PageId pageId);
+
+  /**
+   * A helper method that estimates the number of entries in a range for the
+   * index's key type. estimateRange() dispatches on the attribute type once
+   * and calls this.
+   *
+   * @param range  Range to estimate, with its operators checked
+   * @return  Estimated number of entries
+   * @throws  BadScanrangeException If the low bound is above the high bound
+   */
+  template <class T>
+  std::size_t estimateRangeKey(const ScanRange &range);
+
+  /**
+   * A helper method that finds a key with about fraction of the entries
+   * before it, going down by the counts of the nodes.
+   *
+   * @param fraction  Fraction of the entries, in [0, 1]
+   * @param outKey    Receives the key
+   * @return  False if the index is empty
+   */
+  template <class T>
+  bool quantileKey(const double fraction, T &outKey);
+
+  /**
+   * A helper method that walks the tree level by level, counting the nodes
+   * of each level and adding up how full they are.
+   *
+   * @param stats  Receives the shape of the tree
+   */
+  template <class T>
+  void shapeStats(BTreeStats &stats);
+
+  /**
+   * A helper method that latches the cursor's leaf in shared mode. If the leaf
+   * changed since the cursor let go of it, the position is found again from
+   * the last key returned, moving right if a split moved it to a sibling.
+   *
+   * @param cursor  Cursor of the scan
+   * @param lowVal  Low value of range
+   * @param highVal High value of range
+   * @param lastVal Last key returned from the cursor's leaf
+   */
+  template <class T>
+  void latchScanLeaf(IndexCursor &cursor, const T &lowVal, const T &highVal,
+                     const T &lastVal);
+
+  /**
+   * A helper method that remembers the cursor's position and releases the
+   * latch on its leaf.
+   *
+   * @param cursor   Cursor of the scan
+   * @param returned True if the call returned any entries, or for a
+   * descending scan, any entries of the cursor's leaf
+   * @param lastVal  Last key returned from the cursor's leaf, updated here
+   */
+  template <class T>
+  void unlatchScanLeaf(IndexCursor &cursor, const bool returned, T &lastVal);
+
+  /**
+   * A helper method that moves the cursor to the first entry of the right
+   * sibling of its leaf. The sibling is latched before the leaf is released.
+   *
+   * @param cursor  Cursor of the scan
+   */
+  template <class T>
+  void stepRight(IndexCursor &cursor);
+
+  /**
+   * A helper method that moves a descending scan to the last entry of the
+   * leaf left of its leaf. The leaf is released before the one on its left is
+   * latched, and if that one split meanwhile, the cursor moves right to the
+   * leaf now before the one it left.
+   *
+   * @param cursor  Cursor of the scan
+   */
+  template <class T>
+  void stepLeft(IndexCursor &cursor);
+
+  /**
+   * A helper method that positions a descending scan on the last entry of its
+   * leaf within the high bound. The cursor moves right while the next leaf may
+   * hold more such entries, up to the leaf it last stepped left from.
+   *
+   * @param cursor  Cursor of the scan
+   * @param highVal High value of range
+   */
+  template <class T>
+  void seekHigh(IndexCursor &cursor, const T &highVal);
+
+  /**
+   * A helper method that reads ahead the leaves to the right of the cursor's
+   * latched leaf. Leaves that follow each other in page number order, as bulk
+   * loading lays them out, are kept READ_AHEAD_PAGES ahead; otherwise just the
+   * right sibling is read ahead. Descending scans read ahead the left sibling.
    *
+   * @param cursor  Cursor of the scan
    */
-  void insertInternal(NonLeafNodeInt *internal, PageKeyPair<int> *newEntry);
+  template <class T>
+  void readAhead(IndexCursor &cursor);
 
 public:
   /**
@@ -387,14 +2854,59 @@ public:
    * @param attrByteOffset      Offset of attribute, over which index is to be
    * built, in the record
    * @param attrType            Datatype of attribute over which index is built
+   * @param useBulkLoad         If true, a new index is built bottom-up from the
+   * sorted tuples instead of by inserting them one at a time
+   * @param fillFactor          Fraction of each node filled by the bulk load
+   * @param readOnly            If true, the index file is mapped into memory
+   * once it exists, and scans read its pages from the mapping instead of the
+   * buffer pool. The index then cannot change.
+   * @param buildThreads        Number of threads the bulk load builds a new
+   * index with, one per core if 0. Fewer are used if the buffer pool is small.
+   * @param buildLog            If not NULL, a new index is built online from
+   * a relation of slotted pages that writers keep inserting into, each given
+   * this log beforehand. Records inserted after the constructor returns go
+   * into the index as well, for as long as it is open.
    * @throws  BadIndexInfoException     If the index file already exists for the
    * corresponding attribute, but values in metapage(relationName, attribute
    * byte offset, attribute type etc.) do not match with values received through
-   * constructor parameters.
+   * constructor parameters, or the index was not done being built online.
    */
   BTreeIndex(const std::string &relationName, std::string &outIndexName,
              BufMgr *bufMgrIn, const int attrByteOffset,
-             const Datatype attrType);
+             const Datatype attrType, const bool useBulkLoad = true,
+             const double fillFactor = DEFAULT_FILL_FACTOR,
+             const bool readOnly = false,
+             const std::size_t buildThreads = 0,
+             IndexBuildLog *buildLog = NULL);
+
+  /**
+   * BTreeIndex Constructor for a COMPOSITE index, whose key is made of several
+   * attributes of the record. It opens or builds the index like the
+   * constructor of a single attribute does. The index file is named after
+   * the relation and the offsets of all the columns, such as "rel.0.8".
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param keyColumns          Attributes of the key, the leading one first:
+   * 2 to MAX_KEY_COLUMNS of them, whose encodings take at most COMPOSITESIZE
+   * bytes (4 per INTEGER, 8 per DOUBLE and STRINGSIZE per STRING)
+   * @param useBulkLoad         As for the other constructor
+   * @param fillFactor          As for the other constructor
+   * @param readOnly            As for the other constructor
+   * @param buildThreads        As for the other constructor
+   * @param buildLog            As for the other constructor
+   * @throws  BadIndexInfoException     If the columns do not make a key, or
+   * the index file already exists with other columns or was not done being
+   * built online.
+   */
+  BTreeIndex(const std::string &relationName, std::string &outIndexName,
+             BufMgr *bufMgrIn, const std::vector<KeyColumn> &keyColumns,
+             const bool useBulkLoad = true,
+             const double fillFactor = DEFAULT_FILL_FACTOR,
+             const bool readOnly = false,
+             const std::size_t buildThreads = 0,
+             IndexBuildLog *buildLog = NULL);
 
   /**
    * BTreeIndex Destructor.
@@ -413,11 +2925,151 @@ public:
    *in-turn get split. This may continue all the way upto the root causing the
    *root to get split. If root gets split, metapage needs to be changed
    *accordingly. Make sure to unpin pages as soon as you can.
+   * If the buffer manager has a log, the insert returns once the nodes it
+   * changed are durable in the log.
    * @param key     Key to insert, pointer to integer/double/char string
    * @param rid     Record ID of a record whose entry is getting inserted into
    *the index.
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  void insertEntry(const void *key, const RecordId rid);
+
+  /**
+   * Insert a batch of entries, as when many records are appended at once. The
+   * entries are sorted by key, and the ones that go to the same leaf are
+   * merged into it in one pass, with one descent of the tree between them.
+   * Entries with equal keys end up in the order they were given in, after
+   * those already in the index, as if inserted one by one.
+   * @param keys    Array of n keys of the index's type: integers, doubles, or
+   * strings of STRINGSIZE characters each
+   * @param rids    Record IDs of the n entries
+   * @param n       Number of entries
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  void insertBatch(const void *keys, const RecordId *rids,
+                   const std::size_t n);
+
+  /**
+   * Turn the write-optimized insert mode on or off. In it insertEntry() only
+   * collects new entries in a buffer in memory, and they go into the tree
+   * capacity at a time, sorted, as insertBatch() inserts them, so that each
+   * leaf is read and written once for all of the entries it takes. Lookups
+   * find the buffered entries too. Scans, batched lookups, deletes, updates
+   * and compaction have the buffer flushed first. Buffered entries are only
+   * logged once flushed. Must not be called while other threads use the
+   * index.
+   * @param capacity  Number of entries to collect before they are flushed, or
+   * 0 to insert each entry right away. Turning the mode off flushes the buffer.
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  void setInsertBuffer(const std::size_t capacity);
+
+  /**
+   * Insert the entries the insert buffer has collected into the tree. The
+   * destructor does this too.
+   **/
+  void flushInserts();
+
+  /**
+   * Give the index a key filter, a Bloom filter of its keys kept in memory
+   * and in pages of the index file, replacing any it has. The filter is built
+   * from the entries in the index and kept up to date by every insert, so a
+   * lookup of a key no entry has mostly returns without reading a leaf.
+   * Deleted keys stay in the filter. Must not be called while other threads
+   * use the index.
+   * @param expectedKeys  Number of keys the index is expected to hold. More
+   * keys make more lookups of missing keys go to the tree.
+   * @param bitsPerKey    Bits of filter per expected key
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  void setKeyFilter(const std::size_t expectedKeys,
+                    const int bitsPerKey = DEFAULT_FILTER_BITS_PER_KEY);
+
+  /**
+   * Drop the key filter of the index, if it has one, and free its pages.
+   * Must not be called while other threads use the index.
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  void dropKeyFilter();
+
+  /**
+   * Delete the entry <key,rid>. Of several equal entries only one is deleted.
+   * The leaf it was in stays in the tree even if it is left empty, until
+   * compact() takes it out. If the buffer manager has a log, the delete
+   * returns once the leaf is durable in the log.
+   * @param key     Key of the entry, pointer to integer/double/char string
+   * @param rid     Record ID of the entry
+   * @return  True if the entry was found and deleted, false if there is none
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Change the key of the entry <oldKey,rid> to newKey. The entry is deleted
+   * and inserted again with the new key, and the nodes both change are logged
+   * together, so after a crash either both or neither are redone.
+   * @param oldKey  Key the entry has, pointer to integer/double/char string
+   * @param newKey  Key the entry is to have
+   * @param rid     Record ID of the entry
+   * @return  True if the entry was found, false if there is none, in which
+   * case nothing is inserted
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  bool updateEntry(const void *oldKey, const void *newKey,
+                   const RecordId rid);
+
+  /**
+   * Take the empty leaves out of the tree, while other threads go on using
+   * it. The parents of leaves are visited one after another from left to
+   * right. In each, every empty leaf but the first child is unlinked from its
+   * left sibling and removed from the parent along with the separator in
+   * front of it, and the entry counts of the other leaves are brought up to
+   * date. The leaves go on the free list once no scan is open. The
+   * first leaf of the tree, and parents split off while the pass runs, are
+   * left alone.
+   * @return  Number of leaves taken out of the tree
+   * @throws  IndexReadOnlyException  If the index was opened read-only.
+   **/
+  std::size_t compact();
+
+  /**
+   * Find an entry with the given key in a single call, without setting up a
+   * scan. The tree is searched down to the leftmost leaf that can hold the
+   * key, and the leaf is released again before the call returns. May be called
+   * from several threads at once, and on a read-only index.
+   * @param key     Key to look for, pointer to integer/double/char string
+   * @param outRid  RecordId of the first entry with the key, in index order
+   * @return  True if an entry was found, false if the key is not in the index
+   **/
+  bool lookup(const void *key, RecordId &outRid);
+
+  /**
+   * Find every entry with the given key in a single call, as lookup() does.
+   * The entries of each leaf are copied at once, and the leaves holding them
+   * are released as the search moves right.
+   * @param key     Key to look for, pointer to integer/double/char string
+   * @param outRids Replaced with the RecordIds of the entries, in index order
+   * @return  Number of entries found
+   **/
+  std::size_t lookupAll(const void *key, std::vector<RecordId> &outRids);
+
+  /**
+   * Find the entries of each of a batch of keys, as for the inner side of an
+   * index nested loops join. The keys are looked up in sorted order, and a
+   * leaf is kept latched while the next keys may be in it, so probes landing
+   * in the same leaf descend the tree once between them.
+   * @param keys    Array of n keys of the index's type: integers, doubles, or
+   * strings of STRINGSIZE characters each
+   * @param n       Number of keys
+   * @param outRids Replaced with the RecordIds of the entries, those of each
+   * key in index order, and the keys in the order they were given in
+   * @param ends    Replaced with n offsets into outRids, the end of the entries
+   * of each key, so those of key i start at ends[i - 1] or at 0
+   * @return  Number of entries found
    **/
-  void insertEntry(void *key, const RecordId rid);
+  std::size_t lookupBatch(const void *keys, const std::size_t n,
+                          std::vector<RecordId> &outRids,
+                          std::vector<std::size_t> &ends);
 
   /**
    * Begin a filtered scan of the index.  For instance, if the method is called
@@ -428,11 +3080,13 @@ public:
    *page that contains the first RecordID that satisfies the scan parameters.
    *Keep that page pinned in the buffer pool.
    * @param lowVal  Low value of range, pointer to integer / double / char
-   *string
+   *string, or NULL to leave the range open below
    * @param lowOp   Low operator (GT/GTE)
    * @param highVal High value of range, pointer to integer / double / char
-   *string
+   *string, or NULL to leave the range open above
    * @param highOp  High operator (LT/LTE)
+   * @param descending If true, entries are returned from the high end of the
+   *range down, reading only the leaves they are on
    * @throws  BadOpcodesException If lowOp and highOp do not contain one of
    *their their expected values
    * @throws  BadScanrangeException If lowVal > highval
@@ -440,7 +3094,87 @@ public:
    *satisfies the scan criteria.
    **/
   void startScan(void *lowVal, const Operator lowOp, void *highVal,
-                 const Operator highOp);
+                 const Operator highOp, const bool descending = false);
+
+  /**
+   * Begin a filtered scan of the index on cursor, as startScan() does without
+   * one. A scan the cursor is already executing, on this or another index, is
+   * ended first. Scans on other cursors are not affected.
+   * @param cursor  Cursor that holds the state of the scan
+   * @param lowVal  Low value of range, pointer to integer / double / char
+   *string, or NULL to leave the range open below
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, pointer to integer / double / char
+   *string, or NULL to leave the range open above
+   * @param highOp  High operator (LT/LTE)
+   * @param descending If true, entries are returned from the high end of the
+   *range down
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   **/
+  void startScan(IndexCursor &cursor, void *lowVal, const Operator lowOp,
+                 void *highVal, const Operator highOp,
+                 const bool descending = false);
+
+  /**
+   * Begin a scan of several ranges of the index, as startScan() with a cursor
+   * does. The entries of each range are returned in turn. Once a range is
+   * done, the scan goes on in the same leaf if the next range starts there,
+   * and otherwise goes down again from the lowest node above both.
+   * @param cursor  Cursor that holds the state of the scan
+   * @param ranges  Ranges to scan, sorted by their bounds and disjoint
+   * @throws  BadOpcodesException If a range's operators are not GT/GTE and
+   *LT/LTE
+   * @throws  BadScanrangeException If ranges is empty, or a range is empty,
+   *overlaps the one before or comes before it
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   **/
+  void startScan(IndexCursor &cursor, const std::vector<ScanRange> &ranges);
+
+  /**
+   * Begin a scan of several ranges of the index without a cursor, as
+   * startScan() with one does.
+   * @param ranges  Ranges to scan, sorted by their bounds and disjoint
+   **/
+  void startScan(const std::vector<ScanRange> &ranges);
+
+  /**
+   * Make the key of a COMPOSITE index from the values of its leading
+   * columns, the other columns taking their smallest encoding. The key is
+   * passed wherever the index takes a pointer to a key.
+   * @param values     Pointer to the value of each column: an integer, a
+   *double, or a char string of which the first STRINGSIZE characters count
+   * @param numValues  Number of values, at most the number of columns
+   * @return The key
+   * @throws  BadIndexInfoException If the index is not COMPOSITE or has fewer
+   *columns than values
+   **/
+  CompositeKey makeKey(const void *const *values, const int numValues) const;
+
+  /**
+   * Begin a scan of the entries of a COMPOSITE index whose leading columns
+   * have the given values, whatever the values of the others, in index
+   * order. It is a single range of keys, scanned as startScan() does.
+   * @param cursor     Cursor that holds the state of the scan
+   * @param values     Pointer to the value of each leading column, as for
+   *makeKey()
+   * @param numValues  Number of values, 0 to scan every entry
+   * @throws  BadIndexInfoException If the index is not COMPOSITE or has fewer
+   *columns than values
+   * @throws  NoSuchKeyFoundException If no key has the values
+   **/
+  void startPrefixScan(IndexCursor &cursor, const void *const *values,
+                       const int numValues);
+
+  /**
+   * Begin a prefix scan of a COMPOSITE index without a cursor, as
+   * startPrefixScan() with one does.
+   **/
+  void startPrefixScan(const void *const *values, const int numValues);
 
   /**
    * Fetch the record id of the next index entry that matches the scan.
@@ -456,12 +3190,249 @@ public:
    **/
   void scanNext(RecordId &outRid);  // returned record id
 
+  /**
+   * Fetch the record id of the next index entry that matches the scan of
+   * cursor, as scanNext() does without one.
+   * @param cursor  Cursor started on this index
+   * @param outRid  RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(IndexCursor &cursor, RecordId &outRid);
+
+  /**
+   * Fetch the record ids of the next index entries that match the scan, up to
+   * maxRids of them. The matching entries of each leaf are found with a single
+   * search for the high bound and copied at once. Pages are pinned and unpinned
+   * as in scanNext(), which may be mixed with this call.
+   * @param outRids Array receiving the RecordIds of matching entries
+   * @param maxRids Number of RecordIds outRids can hold
+   * @return Number of RecordIds written to outRids. Fewer than maxRids means
+   *the scan is complete, and once it is every further call returns 0.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  std::size_t scanNextBatch(RecordId *outRids, const std::size_t maxRids);
+
+  /**
+   * Fetch the record ids of the next index entries that match the scan of
+   * cursor, up to maxRids of them, as scanNextBatch() does without one.
+   * @param cursor  Cursor started on this index
+   * @param outRids Array receiving the RecordIds of matching entries
+   * @param maxRids Number of RecordIds outRids can hold
+   * @return Number of RecordIds written to outRids. Fewer than maxRids means
+   *the scan is complete, and once it is every further call returns 0.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  std::size_t scanNextBatch(IndexCursor &cursor, RecordId *outRids,
+                            const std::size_t maxRids);
+
+  /**
+   * Fetch the record id and the key of the next index entry that matches the
+   * scan, as scanNext() does. The key comes from the leaf, so queries on the
+   * indexed attribute alone need not read the relation.
+   * @param outRid  RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @param outKey  Receives the key: an integer, a double, or STRINGSIZE
+   *characters without a terminator
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(RecordId &outRid, void *outKey);
+
+  /**
+   * Fetch the record id and the key of the next index entry that matches the
+   * scan of cursor, as scanNext() does without one.
+   * @param cursor  Cursor started on this index
+   * @param outRid  RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @param outKey  Receives the key, as for scanNext() without a cursor
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(IndexCursor &cursor, RecordId &outRid, void *outKey);
+
+  /**
+   * Fetch the record ids and the keys of the next index entries that match
+   * the scan, up to maxRids of them, as scanNextBatch() does.
+   * @param outRids Array receiving the RecordIds of matching entries, or NULL
+   *if only the keys are needed
+   * @param outKeys Array receiving the keys of matching entries: integers,
+   *doubles, or strings of STRINGSIZE characters each
+   * @param maxRids Number of entries the arrays can hold
+   * @return Number of entries written. Fewer than maxRids means the scan is
+   *complete, and once it is every further call returns 0.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  std::size_t scanNextBatch(RecordId *outRids, void *outKeys,
+                            const std::size_t maxRids);
+
+  /**
+   * Fetch the record ids and the keys of the next index entries that match
+   * the scan of cursor, as scanNextBatch() does without one.
+   * @param cursor  Cursor started on this index
+   * @param outRids Array receiving the RecordIds of matching entries, or NULL
+   * @param outKeys Array receiving the keys of matching entries
+   * @param maxRids Number of entries the arrays can hold
+   * @return Number of entries written. Fewer than maxRids means the scan is
+   *complete, and once it is every further call returns 0.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  std::size_t scanNextBatch(IndexCursor &cursor, RecordId *outRids,
+                            void *outKeys, const std::size_t maxRids);
+
+  /**
+   * Count the entries in a range, reading only the leaves. The entries of
+   * each leaf are counted with a single search for the high bound. Scans of
+   * other cursors are not affected.
+   * @param lowVal  Low value of range, or NULL to leave it open below
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, or NULL to leave it open above
+   * @param highOp  High operator (LT/LTE)
+   * @return Number of entries in the range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their expected values
+   * @throws  BadScanrangeException If lowVal > highVal
+   **/
+  std::size_t count(void *lowVal, const Operator lowOp, void *highVal,
+                    const Operator highOp);
+
+  /**
+   * Count the entries in several ranges, as count() of one range does.
+   * @param ranges  Ranges to count, sorted by their bounds and disjoint
+   * @return Number of entries in the ranges
+   * @throws  BadScanrangeException If the ranges are empty, overlap or are
+   *out of order
+   **/
+  std::size_t count(const std::vector<ScanRange> &ranges);
+
+  /**
+   * Find the smallest key of the index, reading only the leftmost leaf that
+   * holds an entry.
+   * @param outKey  Receives the key, as for scanNext()
+   * @return  False if the index is empty
+   **/
+  bool min(void *outKey);
+
+  /**
+   * Find the largest key of the index, reading only the rightmost leaf unless
+   * it is empty.
+   * @param outKey  Receives the key, as for scanNext()
+   * @return  False if the index is empty
+   **/
+  bool max(void *outKey);
+
+  /**
+   * Estimate the number of entries in a range without reading the leaves
+   * inside it, as a planner does before it chooses between an index scan and
+   * a FileScan. The tree is gone down once for each bound that is not open,
+   * adding up the entry counts the non-leaf nodes keep of the children left
+   * of the path, and the leaf reached is searched for the bound. Those counts
+   * are set again first if many entries changed since they last were, but
+   * may still be a little out of date (see NonLeafNode), so the result is an
+   * estimate.
+   * @param lowVal  Low value of range, or NULL to leave it open below
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, or NULL to leave it open above
+   * @param highOp  High operator (LT/LTE)
+   * @return Estimated number of entries in the range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their expected values
+   * @throws  BadScanrangeException If lowVal > highVal
+   **/
+  std::size_t estimateRange(void *lowVal, const Operator lowOp, void *highVal,
+                            const Operator highOp);
+
+  /**
+   * Estimate the number of entries with a key less than the given one, as
+   * estimateRange() does, going down the tree once.
+   * @param key       Key to rank, pointer to integer/double/char string
+   * @param inclusive If true, entries with the key are counted as well
+   * @return Estimated number of entries
+   **/
+  std::size_t estimateRank(const void *key, const bool inclusive = false);
+
+  /**
+   * Find a key that about the given fraction of the entries come before, such
+   * as the median for 0.5, going down the tree once by the entry counts of
+   * the non-leaf nodes.
+   * @param fraction  Fraction of the entries, in [0, 1]
+   * @param outKey    Receives the key, as for scanNext()
+   * @return  False if the index is empty
+   **/
+  bool estimateQuantile(const double fraction, void *outKey);
+
+  /**
+   * Find the shape of the tree and the work done on it since it was opened.
+   * Every node is read, one at a time, each latched in shared mode while it
+   * is looked at, so the shape is only exact while no other thread changes
+   * the index. Entries the insert buffer holds are not in the tree yet.
+   * @return  The statistics
+   **/
+  BTreeStats getStats();
+
   /**
    * Terminate the current scan. Unpin any pinned pages. Reset scan specific
    *variables.
    * @throws ScanNotInitializedException If no scan has been initialized.
    **/
   void endScan();
+
+  /**
+   * Terminate the scan of cursor. Unpin its current leaf. Reset its scan
+   *specific variables.
+   * @param cursor  Cursor started on this index
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  void endScan(IndexCursor &cursor);
+
+  /**
+   * Begin a snapshot scan of the index on cursor. The scan returns the
+   * entries with keys in the range as they are now, in ascending order, even
+   * while other threads insert and delete entries. Writers keep images of the
+   * nodes they change while the snapshot is open, so long snapshot scans cost
+   * memory, not time. A scan the cursor is executing is ended first.
+   * @param cursor  Cursor that holds the state of the scan
+   * @param lowVal  Low value of range, pointer to integer / double / char
+   *string, or NULL for no low bound
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, pointer to integer / double / char
+   *string, or NULL for no high bound
+   * @param highOp  High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that
+   *satisfies the scan criteria.
+   **/
+  void startSnapshotScan(SnapshotCursor &cursor, void *lowVal,
+                         const Operator lowOp, void *highVal,
+                         const Operator highOp);
+
+  /**
+   * Fetch the record id, and the key if outKey is not NULL, of the next entry
+   * of the snapshot scan of cursor.
+   * @param cursor  Cursor started on this index
+   * @param outRid  RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @param outKey  Receives the key, as for scanNext() without a cursor
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(SnapshotCursor &cursor, RecordId &outRid,
+                void *outKey = NULL);
+
+  /**
+   * Terminate the snapshot scan of cursor, letting go of its snapshot and of
+   * the node images only it needed.
+   * @param cursor  Cursor started on this index
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  void endScan(SnapshotCursor &cursor);
 };
 
 }  // namespace badgerdb
@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include <memory>
+#include <new>
 
 #include "buffer.h"
 #include "exceptions/hash_already_present_exception.h"
@@ -18,89 +19,166 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo) {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+std::uint32_t BufHashTbl::hash(const FileId fileId, const PageId pageNo,
+                               const std::uint32_t size) const {
+  // Mix the id of the file and the page number the way MurmurHash3 finalizes,
+  // so that every bit of both reaches the low bits used as index
+  std::uint64_t h = (std::uint64_t)fileId << 32 | pageNo;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return (std::uint32_t)h & (size - 1);
 }
 
-BufHashTbl::BufHashTbl(int htSize) : HTSIZE(htSize) {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket*[htSize];
-  for (int i = 0; i < HTSIZE; i++) ht[i] = NULL;
+std::uint32_t BufHashTbl::probe(const hashBucket* table,
+                                const std::uint32_t size, const File* file,
+                                const FileId fileId,
+                                const PageId pageNo) const {
+  std::uint32_t index = hash(fileId, pageNo, size);
+  while (table[index].file != NULL &&
+         (table[index].file != file || table[index].fileId != fileId ||
+          table[index].pageNo != pageNo)) {
+    index = (index + 1) & (size - 1);
+  }
+  return index;
+}
+
+BufHashTbl::BufHashTbl(int htSize)
+    : HTSIZE(16), numEntries(0), oldHt(NULL), oldSize(0), oldNext(0) {
+  // at most half full when holding htSize entries
+  while (HTSIZE < 2 * (std::uint32_t)htSize) HTSIZE *= 2;
+  ht = new hashBucket[HTSIZE];
+  for (std::uint32_t i = 0; i < HTSIZE; i++) ht[i].file = NULL;
 }
 
 BufHashTbl::~BufHashTbl() {
-  for (int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
+  delete[] oldHt;
+  delete[] ht;
+}
+
+void BufHashTbl::erase(hashBucket* table, const std::uint32_t size,
+                       std::uint32_t hole) {
+  // Move back every later entry of the probe run that could no longer be
+  // reached across the hole
+  std::uint32_t index = hole;
+  while (true) {
+    index = (index + 1) & (size - 1);
+    if (table[index].file == NULL) break;
+
+    const std::uint32_t home =
+        hash(table[index].fileId, table[index].pageNo, size);
+    const bool reachable = (hole < index) ? (hole < home && home <= index)
+                                          : (hole < home || home <= index);
+    if (!reachable) {
+      table[hole] = table[index];
+      hole = index;
     }
   }
-  delete[] ht;
+  table[hole].file = NULL;
+}
+
+void BufHashTbl::grow() {
+  // Entries are only ever in two arrays at once
+  if (oldHt != NULL) migrate(oldSize);
+
+  hashBucket* newHt = new (std::nothrow) hashBucket[2 * HTSIZE];
+  if (!newHt) throw HashTableException();
+  for (std::uint32_t i = 0; i < 2 * HTSIZE; i++) newHt[i].file = NULL;
+
+  oldHt = ht;
+  oldSize = HTSIZE;
+  oldNext = 0;
+  ht = newHt;
+  HTSIZE = 2 * oldSize;
+}
+
+void BufHashTbl::migrate(std::uint32_t slots) {
+  for (; slots > 0 && oldNext < oldSize; slots--) {
+    hashBucket& bucket = oldHt[oldNext];
+    if (bucket.file == NULL) {
+      oldNext++;
+      continue;
+    }
+
+    // Taking the entry out may move a later one of its run into the slot, so
+    // the slot is looked at again
+    ht[probe(ht, HTSIZE, bucket.file, bucket.fileId, bucket.pageNo)] = bucket;
+    erase(oldHt, oldSize, oldNext);
+  }
+  if (oldNext == oldSize) {
+    delete[] oldHt;
+    oldHt = NULL;
+  }
 }
 
 void BufHashTbl::insert(const File* file, const PageId pageNo,
                         const FrameId frameNo) {
-  int index = hash(file, pageNo);
-
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-      throw HashAlreadyPresentException(tmpBuc->file->filename(),
-                                        tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+  const FileId fileId = file->id();
+  const hashBucket* found = NULL;
+  std::uint32_t index = probe(ht, HTSIZE, file, fileId, pageNo);
+  if (ht[index].file != NULL) {
+    found = &ht[index];
+  } else if (oldHt != NULL) {
+    const std::uint32_t oldIndex = probe(oldHt, oldSize, file, fileId, pageNo);
+    if (oldHt[oldIndex].file != NULL) found = &oldHt[oldIndex];
   }
+  if (found != NULL)
+    throw HashAlreadyPresentException(found->file->filename(), found->pageNo,
+                                      found->frameNo);
+
+  if (oldHt != NULL) migrate(MIGRATE_SLOTS);
+  if (2 * (numEntries + 1) > HTSIZE) grow();
+  index = probe(ht, HTSIZE, file, fileId, pageNo);
+
+  ht[index].file = (File*)file;
+  ht[index].fileId = fileId;
+  ht[index].pageNo = pageNo;
+  ht[index].frameNo = frameNo;
+  numEntries++;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc) throw HashTableException();
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo,
+                           FrameId& frameNo) const {
+  const FileId fileId = file->id();
+  std::uint32_t index = probe(ht, HTSIZE, file, fileId, pageNo);
+  if (ht[index].file != NULL) {
+    frameNo = ht[index].frameNo;  // return frameNo by reference
+    return true;
+  }
+  if (oldHt == NULL) return false;
 
-  tmpBuc->file = (File*)file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+  index = probe(oldHt, oldSize, file, fileId, pageNo);
+  if (oldHt[index].file == NULL) return false;
+  frameNo = oldHt[index].frameNo;
+  return true;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo,
                         FrameId& frameNo) {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      frameNo = tmpBuc->frameNo;  // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
-
-  throw HashNotFoundException(file->filename(), pageNo);
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if (prevBuc)
-        prevBuc->next = tmpBuc->next;
-      else
-        ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    } else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
-  }
+  remove(file, file->id(), pageNo);
+}
 
-  throw HashNotFoundException(file->filename(), pageNo);
+void BufHashTbl::remove(const File* file, const FileId fileId,
+                        const PageId pageNo) {
+  const std::uint32_t index = probe(ht, HTSIZE, file, fileId, pageNo);
+  if (ht[index].file != NULL) {
+    erase(ht, HTSIZE, index);
+  } else {
+    const std::uint32_t oldIndex =
+        oldHt != NULL ? probe(oldHt, oldSize, file, fileId, pageNo) : 0;
+    if (oldHt == NULL || oldHt[oldIndex].file == NULL)
+      throw HashNotFoundException(file->filename(), pageNo);
+    erase(oldHt, oldSize, oldIndex);
+  }
+  numEntries--;
+  if (oldHt != NULL) migrate(MIGRATE_SLOTS);
 }
 
 }  // namespace badgerdb
@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include "file.h"
 
 namespace badgerdb {
@@ -17,10 +19,15 @@ namespace badgerdb {
  */
 struct hashBucket {
   /**
-   * pointer a file object (more on this below)
+   * pointer a file object (more on this below), NULL if the slot is empty
    */
   File* file;
 
+  /**
+   * id of the file, which the entry is hashed on
+   */
+  FileId fileId;
+
   /**
    * page number within a file
    */
@@ -30,41 +37,112 @@ struct hashBucket {
    * frame number of page in the buffer pool
    */
   FrameId frameNo;
-
-  /**
-   * Next node in the hash table
-   */
-  hashBucket* next;
 };
 
 /**
  * @brief Hash table class to keep track of pages in the buffer pool
  *
+ * Entries are kept in one flat array and found by linear probing, so a lookup
+ * usually touches a single cache line and inserting or removing a page never
+ * allocates. Removing an entry shifts the entries probed after it back into
+ * place instead of leaving a tombstone. The table is kept at most half full
+ * and only grows if it holds more entries than it was sized for.
+ *
+ * Growing does not stop the table to re-insert every entry. The old array is
+ * kept next to one twice its size, and each insertion or removal moves the
+ * entries of a few slots of the old array over, until it is empty. Meanwhile
+ * new entries go to the new array and lookups try both.
+ *
  * @warning This class is not threadsafe.
  */
 class BufHashTbl {
  private:
   /**
-   *	Size of Hash Table
+   *	Size of Hash Table, a power of two
    */
-  int HTSIZE;
+  std::uint32_t HTSIZE;
+
+  /**
+   * Number of entries in the hash table
+   */
+  std::uint32_t numEntries;
+
   /**
    * Actual Hash table object
    */
-  hashBucket** ht;
+  hashBucket* ht;
 
   /**
-   * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+   * Array the table is growing out of, NULL if it is not growing. Its slots
+   * before oldNext have been moved to ht and are empty.
+   */
+  hashBucket* oldHt;
+  std::uint32_t oldSize;
+  std::uint32_t oldNext;
+
+  /**
+   * Number of slots of the old array each insertion or removal moves over.
+   * Twice what it takes to empty the old array before the new one is half
+   * full.
+   */
+  static const std::uint32_t MIGRATE_SLOTS = 4;
+
+  /**
+   * returns hash value between 0 and size-1 computed using the file's id and
+   * pageNo. Ids are small and dense, and do not depend on where the File
+   * object was allocated, so the spread is the same from run to run.
    *
-   * @param file   	File object
+   * @param fileId  Id of the file
    * @param pageNo  Page number in the file
    * @return  			Hash value.
    */
-  int hash(const File* file, const PageId pageNo);
+  std::uint32_t hash(const FileId fileId, const PageId pageNo,
+                     const std::uint32_t size) const;
+
+  /**
+   * Returns the slot of table holding (file, pageNo), or the empty slot where
+   * it would be inserted.
+   *
+   * @param table   Array of slots
+   * @param size    Number of slots, a power of two
+   * @param file   	File object
+   * @param fileId  Id of the file
+   * @param pageNo  Page number in the file
+   * @return  			Slot index.
+   */
+  std::uint32_t probe(const hashBucket* table, const std::uint32_t size,
+                      const File* file, const FileId fileId,
+                      const PageId pageNo) const;
+
+  /**
+   * Empties a slot of table, moving back the later entries of its probe run
+   * that could no longer be reached across it.
+   *
+   * @param table   Array of slots
+   * @param size    Number of slots, a power of two
+   * @param hole    Slot to empty
+   */
+  void erase(hashBucket* table, const std::uint32_t size, std::uint32_t hole);
+
+  /**
+   * Starts growing into an array of twice the size, first moving over what is
+   * left of the array the table was growing out of, if any.
+   *
+   * @throws  HashTableException if the new table could not be allocated
+   */
+  void grow();
+
+  /**
+   * Moves the entries of up to slots slots of the old array to the new one,
+   * and frees the old array once it is empty.
+   */
+  void migrate(std::uint32_t slots);
 
  public:
   /**
    * Constructor of BufHashTbl class
+   *
+   * @param htSize  Number of entries the table is sized for
    */
   BufHashTbl(const int htSize);  // constructor
 
@@ -81,11 +159,22 @@ class BufHashTbl {
    * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page
    * already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as
+   * @throws  HashTableException if the table was full and could not grow as
    * running of memory
    */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
+  /**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table), without throwing if it is not.
+   *
+   * @param file  	File object
+   * @param pageNo	Page number in the file
+   * @param frameNo Frame number reference, set if the page was found
+   * @return  True if the page entry was found
+   */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId& frameNo) const;
+
   /**
    * Check if (file, pageNo) is currently in the buffer pool (ie. in
    * the hash table).
@@ -107,6 +196,19 @@ class BufHashTbl {
    * table
    */
   void remove(const File* file, const PageId pageNo);
+
+  /**
+   * Delete entry (file,pageNo) from hash table, given the id the file had
+   * when the entry was inserted. The File object is not looked at, so it may
+   * be gone already.
+   *
+   * @param file   	File object
+   * @param fileId  Id of the file
+   * @param pageNo  Page number in the file
+   * @throws HashNotFoundException if the page entry is not found in the hash
+   * table
+   */
+  void remove(const File* file, const FileId fileId, const PageId pageNo);
 };
 
 }  // namespace badgerdb
@@ -8,211 +8,1219 @@
 
 #include "buffer.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <new>
+#include <sstream>
+#include <thread>
 
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
-#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
+#include "trace.h"
 
 namespace badgerdb {
 
+namespace {
+
+/**
+ * Maps bytes of zeroed memory, a multiple of HUGE_PAGE_SIZE, in huge pages:
+ * reserved ones if there are enough, else pages the kernel is asked to back
+ * with transparent huge pages. Sets reserved to tell which.
+ */
+void* mapHugePages(const std::size_t bytes, bool& reserved) {
+  void* memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  reserved = memory != MAP_FAILED;
+  if (reserved) return memory;
+
+  memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) throw std::bad_alloc();
+  madvise(memory, bytes, MADV_HUGEPAGE);  // Only a hint, so failing is fine
+  return memory;
+}
+
+/**
+ * Returns the CPUs of each NUMA node with CPUs, read from sysfs. Empty if
+ * the machine does not tell, in which case it is treated as a single node.
+ */
+std::vector<cpu_set_t> numaNodeCpus() {
+  std::vector<cpu_set_t> nodes;
+  for (int node = 0;; node++) {
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream in(path.str().c_str());
+    if (!in) break;
+
+    // A list of CPUs and CPU ranges, such as "0-3,8-11"
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+      int first;
+      int last;
+      char dash;
+      std::istringstream parse(range);
+      if (!(parse >> first)) continue;
+      if (!(parse >> dash >> last)) last = first;
+      for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    if (CPU_COUNT(&cpus) > 0) nodes.push_back(cpus);
+  }
+  return nodes;
+}
+
+/**
+ * Splits frames [0, numBufs) into one range per NUMA node and calls
+ * init(first, end) for the part of each range within [from, to) on a thread
+ * running on the range's node, so that the memory init() touches first is
+ * placed on that node. With a single node init() is called for all frames on
+ * the calling thread.
+ */
+template <class Init>
+void initOnNodes(const std::uint32_t numBufs, const std::uint32_t from,
+                 const std::uint32_t to, Init init) {
+  const std::vector<cpu_set_t> nodes = numaNodeCpus();
+  if (nodes.size() <= 1) {
+    init(from, to);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for (std::size_t n = 0; n < nodes.size(); n++) {
+    const std::uint32_t first = std::max(
+        from, (std::uint32_t)((std::uint64_t)numBufs * n / nodes.size()));
+    const std::uint32_t end = std::min(
+        to, (std::uint32_t)((std::uint64_t)numBufs * (n + 1) / nodes.size()));
+    if (first >= end) continue;
+    const cpu_set_t cpus = nodes[n];
+    threads.push_back(std::thread([first, end, cpus, &init]() {
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      init(first, end);
+    }));
+  }
+  for (std::size_t n = 0; n < threads.size(); n++) threads[n].join();
+}
+
+/**
+ * Returns the nanoseconds passed since start.
+ */
+std::uint64_t nanosSince(const std::chrono::steady_clock::time_point start) {
+  return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/**
+ * Rounds bytes up to a whole number of huge pages.
+ */
+std::size_t hugePageBytes(const std::size_t bytes) {
+  return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+}  // namespace
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs) : numBufs(bufs) {
-  bufDescTable = new BufDesc[bufs];
-
-  for (FrameId i = 0; i < bufs; i++) {
-    bufDescTable[i].frameNo = i;
-    bufDescTable[i].valid = false;
+BufMgr::BufMgr(std::uint32_t bufs, const double highDirtyRatio,
+               const double lowDirtyRatio, const ReplacementStrategy strategy,
+               const PoolMemory memory, const std::uint32_t maxBufs)
+    : policy(ReplacementPolicy::create(strategy, bufs, std::max(bufs, maxBufs))),
+      numBufs(bufs),
+      maxBufs(std::max(bufs, maxBufs)),
+      constructedBufs(0),
+      pinCounts(new std::atomic<int>[std::max(bufs, maxBufs)]),
+      poolMemory(memory),
+      poolBytes(0),
+      descBytes(0),
+      hugePagesReserved(false),
+      numDirty(0),
+      highDirtyRatio(highDirtyRatio),
+      lowDirtyRatio(lowDirtyRatio),
+      highDirtyMark((std::uint32_t)(bufs * highDirtyRatio)),
+      lowDirtyMark((std::uint32_t)(bufs * lowDirtyRatio)),
+      stopWriter(false),
+      warmupIntervalMs(0),
+      stopPrefetchers(false),
+      log(NULL),
+      checkpointBytes(0) {
+  // Address space is reserved for every frame the pool may be resized to, so
+  // frames never move, but memory is only taken by the frames set up
+  if (memory == HUGE_PAGES) {
+    // Huge pages are aligned for O_DIRECT too. The frames and descriptors are
+    // only touched by the threads of their nodes, which places them there.
+    poolBytes = hugePageBytes(this->maxBufs * sizeof(Page));
+    bufPool = static_cast<Page*>(mapHugePages(poolBytes, hugePagesReserved));
+  } else {
+    // Frames are page aligned, and so aligned for files opened with O_DIRECT,
+    // so pages are read into and written from them without an aligned copy
+    poolBytes = this->maxBufs * sizeof(Page);
+    void* pool = mmap(NULL, poolBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pool == MAP_FAILED) throw std::bad_alloc();
+    bufPool = static_cast<Page*>(pool);
   }
+  descBytes = this->maxBufs * sizeof(BufDesc);
+  void* descs = mmap(NULL, descBytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (descs == MAP_FAILED) {
+    munmap(bufPool, poolBytes);
+    throw std::bad_alloc();
+  }
+  bufDescTable = static_cast<BufDesc*>(descs);
+  addFrames(0, bufs);
 
-  bufPool = new Page[bufs];
-
+  // allocate the buffer hash tables, splitting the original size among them.
+  // They grow by themselves if the pool does.
   int htsize = ((((int)(bufs * 1.2)) * 2) / 2) + 1;
-  hashTable = new BufHashTbl(htsize);  // allocate the buffer hash table
+  for (std::uint32_t i = 0; i < NUM_SHARDS; i++) {
+    hashTable[i] = new BufHashTbl(htsize / NUM_SHARDS + 1);
+  }
 
-  clockHand = bufs - 1;
+  writerThread = std::thread(&BufMgr::runWriter, this);
+  for (std::uint32_t i = 0; i < NUM_PREFETCHERS; i++) {
+    prefetchThreads[i] = std::thread(&BufMgr::runPrefetcher, this);
+  }
 }
 
 BufMgr::~BufMgr() {
+  {
+    std::lock_guard<std::mutex> lock(prefetchLatch);
+    stopPrefetchers = true;
+  }
+  prefetchWake.notify_all();
+  for (std::uint32_t i = 0; i < NUM_PREFETCHERS; i++) prefetchThreads[i].join();
+
+  {
+    std::lock_guard<std::mutex> lock(writerLatch);
+    stopWriter = true;
+  }
+  writerWake.notify_one();
+  writerThread.join();
+
   // Flush out all unwritten pages
   for (std::uint32_t i = 0; i < numBufs; i++) {
     BufDesc* tmpbuf = &(bufDescTable[i]);
     if (tmpbuf->valid == true && tmpbuf->dirty == true) {
-      tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+      try {
+        if (log != NULL) log->flush(tmpbuf->pageLsn);
+        tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+      } catch (const IoErrorException& e) {
+        // The page is lost as in a crash, and redone from the log if it got
+        // there
+      }
     }
   }
 
-  delete hashTable;
-  delete[] bufDescTable;
-  delete[] bufPool;
+  for (std::uint32_t i = 0; i < NUM_SHARDS; i++) delete hashTable[i];
+  delete policy;
+  for (std::uint32_t i = 0; i < constructedBufs; i++) bufDescTable[i].~BufDesc();
+  munmap(bufDescTable, descBytes);
+  munmap(bufPool, poolBytes);  // Pages need no destruction
 }
 
-void BufMgr::allocBuf(FrameId& frame) {
-  // perform first part of clock algorithm to search for
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+void BufMgr::addFrames(const FrameId first, const FrameId end) {
+  const std::uint32_t constructed = constructedBufs;
+  auto init = [this, constructed](const FrameId from, const FrameId to) {
+    for (FrameId i = from; i < to; i++) {
+      if (i < constructed) {
+        bufDescTable[i].Clear();
+      } else {
+        new (&bufDescTable[i]) BufDesc();
+      }
+      new (&bufPool[i]) Page();
+      bufDescTable[i].frameNo = i;
+      pinCounts[i] = 0;
+    }
+  };
+  if (poolMemory == HUGE_PAGES) {
+    initOnNodes(maxBufs, first, end, init);
+  } else {
+    init(first, end);
+  }
+  if (end > constructedBufs) constructedBufs = end;
+}
 
-  while (numScanned < 2 * numBufs)  // Need to scn twice
-  {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+void BufMgr::resize(const std::uint32_t newBufs) {
+  if (newBufs == 0 || newBufs > maxBufs) throw BufferExceededException();
+  std::lock_guard<std::mutex> lock(resizeLatch);
+  const std::uint32_t oldBufs = numBufs.load();
 
-    // if invalid, use frame
-    if (!bufDescTable[clockHand].valid) {
-      break;
+  if (newBufs > oldBufs) {
+    // The frames are ready before the policy hands them out
+    addFrames(oldBufs, newBufs);
+    policy->resize(newBufs);
+    numBufs.store(newBufs);
+  } else if (newBufs < oldBufs) {
+    // Claim every frame going away, which writes back and drops its page, and
+    // keep it claimed so that nobody puts a page in it again. Frames pinned
+    // are tried again until they are unpinned.
+    std::vector<bool> claimed(oldBufs - newBufs, false);
+    std::uint32_t unclaimed = oldBufs - newBufs;
+    try {
+      while (unclaimed > 0) {
+        for (FrameId i = newBufs; i < oldBufs; i++) {
+          if (!claimed[i - newBufs] && claimFrame(i)) {
+            claimed[i - newBufs] = true;
+            unclaimed--;
+          }
+        }
+        if (unclaimed > 0) std::this_thread::yield();
+      }
+    } catch (...) {
+      for (FrameId i = newBufs; i < oldBufs; i++) {
+        if (claimed[i - newBufs]) pinCounts[i]--;
+      }
+      throw;
+    }
+    policy->resize(newBufs);
+    numBufs.store(newBufs);
+
+    // The descriptors stay, for threads still looking at the frames, but the
+    // memory of the pages is given back. Failing to is harmless.
+    const std::size_t granule =
+        poolMemory == HUGE_PAGES ? HUGE_PAGE_SIZE : (std::size_t)sysconf(_SC_PAGESIZE);
+    const std::size_t from =
+        (newBufs * sizeof(Page) + granule - 1) / granule * granule;
+    const std::size_t to = oldBufs * sizeof(Page) / granule * granule;
+    if (from < to) {
+      madvise(reinterpret_cast<char*>(bufPool) + from, to - from, MADV_DONTNEED);
+    }
+  }
+
+  highDirtyMark = (std::uint32_t)(newBufs * highDirtyRatio);
+  lowDirtyMark = (std::uint32_t)(newBufs * lowDirtyRatio);
+  writerWake.notify_one();
+}
+
+std::uint32_t BufMgr::shardOf(const FileId fileId, const PageId pageNo) const {
+  // Consecutive pages of a file land in different shards
+  std::uint32_t h = (fileId * 0x9e3779b9u) ^ pageNo;
+  h *= 2654435761u;
+  return (h >> 16) % NUM_SHARDS;
+}
+
+std::uint32_t BufMgr::fileShardOf(const FileId fileId) const {
+  return fileId % NUM_SHARDS;
+}
+
+std::mutex& BufMgr::ioLatchOf(const File* file) {
+  return ioLatch[fileShardOf(file->id())];
+}
+
+void BufMgr::trackFrame(BufDesc& desc) {
+  const std::uint32_t shard = fileShardOf(desc.fileId);
+  std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+  std::vector<FrameId>& frames = fileFrames[shard][desc.file];
+  if (frames.empty()) fileNames[shard][desc.file] = desc.file->filename();
+  desc.fileSlot = (std::uint32_t)frames.size();
+  frames.push_back(desc.frameNo);
+}
+
+void BufMgr::untrackFrame(BufDesc& desc) {
+  const std::uint32_t shard = fileShardOf(desc.fileId);
+  std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+  std::unordered_map<const File*, std::vector<FrameId> >::iterator it =
+      fileFrames[shard].find(desc.file);
+  std::vector<FrameId>& frames = it->second;
+
+  // The last frame of the list takes the place of this one
+  const FrameId last = frames.back();
+  frames[desc.fileSlot] = last;
+  bufDescTable[last].fileSlot = desc.fileSlot;
+  frames.pop_back();
+  if (frames.empty()) {
+    fileFrames[shard].erase(it);
+    fileNames[shard].erase(desc.file);
+  }
+}
+
+void BufMgr::allocBuf(const File* file, FrameId& frame,
+                      PriorityClass& priority) {
+  const std::uint32_t shard = fileShardOf(file->id());
+  FileClass cls = {HEAP_PRIORITY, 0, 0};
+  std::uint32_t held = 0;
+  {
+    std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+    std::unordered_map<const File*, FileClass>::iterator it =
+        fileClasses[shard].find(file);
+    if (it != fileClasses[shard].end()) {
+      cls = it->second;
+      std::unordered_map<const File*, std::vector<FrameId> >::iterator frames =
+          fileFrames[shard].find(file);
+      if (frames != fileFrames[shard].end()) {
+        held = (std::uint32_t)frames->second.size();
+      }
     }
+  }
+  priority = cls.priority;
 
-    // is valid, check referenced bit
-    if (!bufDescTable[clockHand].refbit) {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0) {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file,
-                          bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
+  if (cls.quota > 0 && held >= cls.quota) {
+    // The file has used up its quota, so it reuses the frames of its own
+    // pages, taken in turn. If its pages are dropped meanwhile, it is back
+    // under the quota.
+    bool underQuota = false;
+    for (std::uint32_t i = 0; i < held && !underQuota; i++) {
+      FrameId victim = 0;
+      {
+        std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+        std::unordered_map<const File*, FileClass>::iterator it =
+            fileClasses[shard].find(file);
+        std::unordered_map<const File*, std::vector<FrameId> >::iterator
+            frames = fileFrames[shard].find(file);
+        if (it == fileClasses[shard].end() ||
+            frames == fileFrames[shard].end() ||
+            frames->second.size() < it->second.quota) {
+          underQuota = true;
+          continue;
+        }
+        victim = frames->second[it->second.hand++ % frames->second.size()];
+      }
+      if (claimFrame(victim, INDEX_PRIORITY, file)) {
+        frame = victim;
+        telemetry.recordSweep(i + 1);
+        return;
       }
-    } else {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
     }
+    if (!underQuota) throw BufferExceededException();
   }
 
-  // check for full buffer pool
-  if (!found && numScanned >= 2 * numBufs) {
-    throw BufferExceededException();
+  // Ask the policy for frames until one can be claimed. Each thread tries
+  // twice as many frames as the pool holds, since pinned frames are suggested
+  // again after the others. Pages of higher classes are passed over at first.
+  const std::uint32_t bufs = numBufs;
+  for (std::uint32_t numScanned = 0; numScanned < PRIORITY_PROBES + 2 * bufs;
+       numScanned++) {
+    const FrameId victim = policy->nextVictim();
+    const PriorityClass evictable =
+        numScanned < PRIORITY_PROBES ? cls.priority : INDEX_PRIORITY;
+    if (claimFrame(victim, evictable)) {
+      // return new frame number
+      frame = victim;
+      telemetry.recordSweep(numScanned + 1);
+      return;
+    }
   }
 
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty) {
+  // full buffer pool
+  throw BufferExceededException();
+}  // end allocBuf
+
+bool BufMgr::claimFrame(const FrameId frame, const PriorityClass evictable,
+                        const File* owner) {
+  // Pinned frames are passed over without reading their descriptor
+  if (pinCounts[frame].load(std::memory_order_relaxed) != 0) return false;
+  BufDesc& desc = bufDescTable[frame];
+
+  // Another thread is assigning or flushing this frame, so move on
+  std::unique_lock<std::mutex> frameLock(desc.latch, std::try_to_lock);
+  if (!frameLock.owns_lock()) return false;
+
+  // if invalid, use frame unless another thread has claimed it already
+  if (!desc.valid) {
+    if (owner != NULL) return false;
+    int unpinned = 0;
+    return pinCounts[frame].compare_exchange_strong(unpinned, 1);
+  }
+  if (desc.priority > evictable) return false;
+  if (owner != NULL && desc.file != owner) return false;
+
+  // check to see if someone has it pinned
+  if (pinCounts[frame].load() != 0) return false;
+
+  File* file = desc.file;
+  const FileId fileId = desc.fileId;
+  const PageId pageNo = desc.pageNo;
+  const std::uint32_t shard = shardOf(fileId, pageNo);
+  {
+    std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+
+    // Pinned under the shard latch, so nobody else can find and pin it
+    int unpinned = 0;
+    if (!pinCounts[frame].compare_exchange_strong(unpinned, 1)) return false;
+
+    if (!desc.dirty) {
+      // is not pinned, use it
+      // remove previous entry from hash table
+      hashTable[shard]->remove(file, fileId, pageNo);
+      untrackFrame(desc);
+      desc.Clear();
+      policy->evicted(frame);
+      telemetry.countEviction(false);
+      BADGERDB_TRACE(TRACE_EVICTION, pageNo, 0);
+      return true;
+    }
+    markClean(desc);
+    desc.loading = true;
+  }
+
+  // flush the changes to disk. The page stays in the page table while it is
+  // written, so no other thread reads the old version back from disk, but
+  // threads that pin it wait until it has been written.
+  writeBack(frame);
+
+  // Use it unless it was pinned or dirtied again while being written
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+  if (pinCounts[frame].load() == 1 && !desc.dirty) {
+    hashTable[shard]->remove(file, fileId, pageNo);
+    untrackFrame(desc);
+    desc.Clear();
+    policy->evicted(frame);
+    telemetry.countEviction(true);
+    BADGERDB_TRACE(TRACE_EVICTION, pageNo, 1);
+    return true;
+  }
+  desc.loading.store(false, std::memory_order_release);
+  pinCounts[frame]--;
+  return false;
+}
+
+void BufMgr::markDirty(BufDesc& desc) {
+  if (desc.dirty) return;
+  desc.dirty = true;
+
+  // Wake up the writer as the pool goes past the high watermark
+  if (numDirty.fetch_add(1) == highDirtyMark) {
+    std::lock_guard<std::mutex> lock(writerLatch);
+    writerWake.notify_one();
+  }
+}
+
+void BufMgr::markClean(BufDesc& desc) {
+  if (!desc.dirty) return;
+  desc.dirty = false;
+  numDirty--;
+}
+
+void BufMgr::writeBack(const FrameId frame) {
+  BufDesc& desc = bufDescTable[frame];
+  try {
+    // Write-ahead: the changes to the page are durable in the log first
+    if (log != NULL) log->flush(desc.pageLsn);
+    std::lock_guard<std::mutex> ioLock(ioLatchOf(desc.file));
     bufStats.diskwrites++;
-    // status =
-    // bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-                                            bufPool[clockHand]);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    desc.file->writePage(desc.pageNo, bufPool[frame]);
+    telemetry.recordWrite(nanosSince(start));
+    noteWritten(desc.file);
+  } catch (...) {
+    std::lock_guard<std::mutex> shardLock(
+        shardLatch[shardOf(desc.fileId, desc.pageNo)]);
+    markDirty(desc);
+    desc.loading.store(false, std::memory_order_release);
+    pinCounts[frame]--;
+    throw;
   }
+}
 
-  // Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+void BufMgr::noteWritten(const File* file) {
+  if (log == NULL) return;
+  std::lock_guard<std::mutex> lock(writtenFilesLatch);
+  writtenFiles.insert(file->filename());
+}
 
-  // return new frame number
-  frame = clockHand;
-}  // end allocBuf
+void BufMgr::cleanFrame(const FrameId frame) {
+  BufDesc& desc = bufDescTable[frame];
+
+  // Leave frames being assigned or flushed to the threads working on them
+  std::unique_lock<std::mutex> frameLock(desc.latch, std::try_to_lock);
+  if (!frameLock.owns_lock() || !desc.valid) return;
+
+  {
+    std::lock_guard<std::mutex> shardLock(
+        shardLatch[shardOf(desc.fileId, desc.pageNo)]);
+    if (!desc.dirty) return;
+
+    // Pages in use may be changing, so only unpinned ones are written
+    int unpinned = 0;
+    if (!pinCounts[frame].compare_exchange_strong(unpinned, 1)) return;
+    markClean(desc);
+    desc.loading = true;
+  }
+
+  try {
+    writeBack(frame);
+  } catch (...) {
+    // The page stays dirty, so evicting it reports the error
+    return;
+  }
+  desc.loading.store(false, std::memory_order_release);
+  pinCounts[frame]--;
+}
+
+void BufMgr::runWriter() {
+  std::vector<FrameId> order;
+  std::unique_lock<std::mutex> lock(writerLatch);
+  while (!stopWriter) {
+    if (warmupIntervalMs > 0 &&
+        std::chrono::steady_clock::now() >= nextWarmupSave) {
+      const std::string path = warmupPath;
+      nextWarmupSave = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(warmupIntervalMs);
+      lock.unlock();
+      saveResidentPages(path);
+      lock.lock();
+      continue;
+    }
+    if (checkpointBytes > 0 &&
+        log->getAppendedLsn() - log->getCheckpointLsn() >= checkpointBytes) {
+      lock.unlock();
+      try {
+        checkpoint();
+      } catch (...) {
+        // Tried again at the next check
+      }
+      lock.lock();
+      continue;
+    }
+    if (numDirty.load() <= highDirtyMark) {
+      if (checkpointBytes > 0) {
+        const int pollMs = CHECKPOINT_POLL_MS;
+        writerWake.wait_for(lock, std::chrono::milliseconds(pollMs));
+      } else if (warmupIntervalMs > 0) {
+        writerWake.wait_until(lock, nextWarmupSave);
+      } else {
+        writerWake.wait(lock);
+      }
+      continue;
+    }
+    lock.unlock();
+
+    // Clean the frames the policy is going to evict next first
+    policy->victimOrder(order);
+    for (std::size_t i = 0; i < order.size() && numDirty.load() > lowDirtyMark;
+         i++) {
+      cleanFrame(order[i]);
+    }
+
+    lock.lock();
+    if (numDirty.load() > lowDirtyMark) {
+      // The pages left dirty are in use, so give their users some time
+      writerWake.wait_for(lock, std::chrono::milliseconds(10));
+    }
+  }
+}
+
+bool BufMgr::pinResident(File* file, const PageId pageNo, FrameId& frame,
+                         const bool sequential) {
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+  if (!hashTable[shard]->tryLookup(file, pageNo, frame)) return false;
 
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page) {
+  policy->pinned(frame, sequential);
+  pinCounts[frame]++;
+  return true;
+}
+
+bool BufMgr::waitForLoad(const FrameId frame) {
+  BufDesc& desc = bufDescTable[frame];
+  if (desc.loading.load(std::memory_order_acquire)) {
+    telemetry.countPinWait();
+    while (desc.loading.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  if (desc.valid) return true;
+
+  // The read failed and the frame has been taken out of the page table
+  pinCounts[frame]--;
+  return false;
+}
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page,
+                      const bool sequential) {
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo <<
   // endl;
+  bufStats.accesses++;
   FrameId frameNo = 0;
-  try {
-    hashTable->lookup(file, pageNo, frameNo);
-
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
-  } catch (const HashNotFoundException&
-               e)  // not in the buffer pool, must allocate a new page
+  bool hit = false;
+  while (true) {
+    if (pinResident(file, pageNo, frameNo, sequential)) {
+      hit = waitForLoad(frameNo);
+      if (hit) break;
+      continue;
+    }
+
+    // not in the buffer pool, must allocate a new page
+    if (loadPage(file, pageNo, frameNo, false, sequential)) break;
+  }
+
+  // The frame is pinned, so its class stays put
+  const PriorityClass priority = bufDescTable[frameNo].priority;
+  bufStats.classAccesses[priority]++;
+  if (hit) bufStats.classHits[priority]++;
+  telemetry.countAccess(file, hit);
+
+  page = &bufPool[frameNo];
+}
+
+bool BufMgr::loadPage(File* file, const PageId pageNo, FrameId& frame,
+                      const bool readAhead, const bool sequential) {
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+
+  // alloc a new frame
+  FrameId newFrame;
+  PriorityClass priority;
+  allocBuf(file, newFrame, priority);
+  BufDesc& desc = bufDescTable[newFrame];
+
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    std::unique_lock<std::mutex> ioLock;
+    if (readAhead) {
+      ioLock = std::unique_lock<std::mutex>(ioLatchOf(file));
+      if (pageNo >= file->getNumPages()) {
+        pinCounts[newFrame]--;
+        return false;
+      }
+    }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    // status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+    std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+    if (hashTable[shard]->tryLookup(file, pageNo, frame)) {
+      // Another thread read the page in first, so give the frame back
+      pinCounts[newFrame]--;
+      if (readAhead) return false;
+      policy->pinned(frame, sequential);
+      pinCounts[frame]++;
+      return waitForLoad(frame);
+    }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+    // set up the entry properly, so that others wait for the read
+    desc.Set(file, pageNo, priority);
+    desc.loading = true;
+    policy->loaded(newFrame, file, pageNo, sequential);
 
     // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    hashTable[shard]->insert(file, pageNo, newFrame);
+    trackFrame(desc);
+  }
+
+  // read the page into the new frame. Reads are positioned, so they need
+  // not wait for other I/O on the file.
+  try {
+    bufStats.diskreads++;
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    file->readPage(pageNo, bufPool[newFrame]);
+    const std::uint64_t nanos = nanosSince(start);
+    telemetry.recordRead(nanos);
+    BADGERDB_TRACE(TRACE_PAGE_READ, pageNo, nanos);
+  } catch (...) {
+    // Take the page out again. Threads waiting for it drop their pins.
+    {
+      std::lock_guard<std::mutex> frameLock(desc.latch);
+      std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+      hashTable[shard]->remove(file, pageNo);
+      untrackFrame(desc);
+      desc.file = NULL;
+      desc.pageNo = Page::INVALID_NUMBER;
+      desc.valid = false;
+      policy->evicted(newFrame);
+    }
+    desc.loading.store(false, std::memory_order_release);
+    pinCounts[newFrame]--;
+    throw;
+  }
+  desc.loading.store(false, std::memory_order_release);
+  frame = newFrame;
+  return true;
+}
+
+bool BufMgr::isResident(const File* file, const PageId pageNo) {
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+  FrameId frameNo;
+  return hashTable[shard]->tryLookup(file, pageNo, frameNo);
+}
+
+void BufMgr::prefetch(File* file, const PageId pageNo,
+                      const std::uint32_t count) {
+  std::lock_guard<std::mutex> lock(prefetchLatch);
+  for (std::uint32_t i = 0; i < count && prefetchQueue.size() < numBufs / 4;
+       i++) {
+    PrefetchRequest request = {file, pageNo + i, true};
+    prefetchQueue.push_back(request);
+  }
+  prefetchWake.notify_all();
+}
+
+void BufMgr::cancelPrefetch(const File* file) {
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+  for (std::deque<PrefetchRequest>::iterator it = prefetchQueue.begin();
+       it != prefetchQueue.end();) {
+    if (it->file == file) {
+      it = prefetchQueue.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  while (std::find(prefetching.begin(), prefetching.end(), file) !=
+         prefetching.end()) {
+    prefetchDone.wait(lock);
+  }
+}
+
+void BufMgr::runPrefetcher() {
+  std::unique_lock<std::mutex> lock(prefetchLatch);
+  while (true) {
+    while (!stopPrefetchers && prefetchQueue.empty()) prefetchWake.wait(lock);
+    if (stopPrefetchers) return;
+    const PrefetchRequest request = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    prefetching.push_back(request.file);
+    lock.unlock();
+
+    try {
+      FrameId frameNo;
+      if (!isResident(request.file, request.pageNo) &&
+          loadPage(request.file, request.pageNo, frameNo, true,
+                   request.sequential)) {
+        unPinPage(request.file, request.pageNo, false);
+      }
+    } catch (...) {
+      // Reading ahead is only a hint, so the page is left for its reader
+    }
+
+    lock.lock();
+    prefetching.erase(
+        std::find(prefetching.begin(), prefetching.end(), request.file));
+    prefetchDone.notify_all();
   }
 }
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) {
+  if (dirty && log != NULL) logPage(file, pageNo);
+
   // lookup in hashtable
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  hashTable[shard]->lookup(file, pageNo, frameNo);
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true) markDirty(bufDescTable[frameNo]);
 
   // make sure the page is actually pinned
-  if (bufDescTable[frameNo].pinCnt == 0) {
+  if (pinCounts[frameNo] == 0) {
     throw PageNotPinnedException(file->filename(), pageNo, frameNo);
   } else
-    bufDescTable[frameNo].pinCnt--;
+    pinCounts[frameNo]--;
+}
+
+void BufMgr::logPage(File* file, const PageId pageNo) {
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  FrameId frameNo = 0;
+  {
+    std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+    hashTable[shard]->lookup(file, pageNo, frameNo);
+    BufDesc& desc = bufDescTable[frameNo];
+    if (pinCounts[frameNo] == 0) {
+      throw PageNotPinnedException(file->filename(), pageNo, frameNo);
+    }
+
+    // The page is dirty from before its change is logged, so that a
+    // checkpoint taken meanwhile does not count it as written
+    if (!desc.dirty) desc.recLsn = log->getAppendedLsn();
+    markDirty(desc);
+  }
+
+  // The caller's pin keeps the page in its frame while it is copied
+  LoggedPage logged;
+  logged.file = file;
+  logged.pageNo = pageNo;
+  logged.sequence = log->nextSequence();
+  logged.image.assign(reinterpret_cast<const char*>(&bufPool[frameNo]),
+                      Page::SIZE);
+
+  LogOperation* operation = LogOperation::current;
+  if (operation != NULL && operation->bufMgr == this) {
+    std::vector<LoggedPage>& pages = operation->pages;
+    for (std::size_t i = 0; i < pages.size(); i++) {
+      if (pages[i].file == file && pages[i].pageNo == pageNo) {
+        pages[i].sequence = logged.sequence;
+        pages[i].image.swap(logged.image);
+        return;
+      }
+    }
+    pinCounts[frameNo]++;
+    pages.push_back(logged);
+    return;
+  }
+
+  const Lsn lsn = log->append(std::vector<LoggedPage>(1, logged));
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+  bufDescTable[frameNo].pageLsn =
+      std::max(bufDescTable[frameNo].pageLsn, lsn);
+}
+
+void BufMgr::releaseLogged(const File* file, const PageId pageNo,
+                           const Lsn lsn) {
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+  FrameId frameNo = 0;
+  hashTable[shard]->lookup(file, pageNo, frameNo);
+  BufDesc& desc = bufDescTable[frameNo];
+  desc.pageLsn = std::max(desc.pageLsn, lsn);
+  pinCounts[frameNo]--;
 }
 
 void BufMgr::allocPage(File* file, PageId& pageNo, Page*& page) {
   FrameId frameNo;
 
   // alloc a new frame
-  allocBuf(frameNo);
+  PriorityClass priority;
+  allocBuf(file, frameNo, priority);
+  BufDesc& desc = bufDescTable[frameNo];
 
   // allocate a new page in the file
   // std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() <<
   // "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
+  // The page goes into the page table before the I/O latch is let go, so that
+  // reading ahead does not read it in meanwhile
+  std::lock_guard<std::mutex> frameLock(desc.latch);
+  std::lock_guard<std::mutex> ioLock(ioLatchOf(file));
+  try {
+    file->allocatePage(pageNo, bufPool[frameNo]);
+  } catch (...) {
+    pinCounts[frameNo]--;
+    throw;
+  }
   page = &bufPool[frameNo];
 
   // set up the entry properly
-  bufDescTable[frameNo].Set(file, pageNo);
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+  desc.Set(file, pageNo, priority);
+  policy->loaded(frameNo, file, pageNo, false);
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  hashTable[shard]->insert(file, pageNo, frameNo);
+  trackFrame(desc);
 }
 
 void BufMgr::flushFile(const File* file) {
-  for (std::uint32_t i = 0; i < numBufs; i++) {
+  // Pages read ahead are pinned while they are read in
+  cancelPrefetch(file);
+
+  // Only the frames holding pages of the file are visited. Each is checked
+  // under its latch, since it may have been evicted since.
+  std::vector<FrameId> frames;
+  {
+    const std::uint32_t fileShard = fileShardOf(file->id());
+    std::lock_guard<std::mutex> lock(fileFramesLatch[fileShard]);
+    std::unordered_map<const File*, std::vector<FrameId> >::const_iterator it =
+        fileFrames[fileShard].find(file);
+    if (it != fileFrames[fileShard].end()) frames = it->second;
+  }
+
+  for (std::size_t f = 0; f < frames.size(); f++) {
+    const FrameId i = frames[f];
     BufDesc* tmpbuf = &(bufDescTable[i]);
+    std::lock_guard<std::mutex> frameLock(tmpbuf->latch);
     if (tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file) {
-      if (tmpbuf->pinCnt > 0)
+      const std::uint32_t shard = shardOf(file->id(), tmpbuf->pageNo);
+      std::lock_guard<std::mutex> ioLock(ioLatchOf(file));
+      std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+      if (pinCounts[i] > 0)
         throw PagePinnedException(file->filename(), tmpbuf->pageNo,
                                   tmpbuf->frameNo);
 
       if (tmpbuf->dirty == true) {
         // if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i])))
         // != OK)
+        if (log != NULL) log->flush(tmpbuf->pageLsn);
+        const std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
         tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-        tmpbuf->dirty = false;
+        telemetry.recordWrite(nanosSince(start));
+        noteWritten(file);
+        markClean(*tmpbuf);
       }
 
-      hashTable->remove(file, tmpbuf->pageNo);
+      hashTable[shard]->remove(file, tmpbuf->pageNo);
+      untrackFrame(*tmpbuf);
       tmpbuf->Clear();
+      policy->evicted(i);
     } else if (tmpbuf->valid == false && tmpbuf->file == file)
       throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid,
-                               tmpbuf->refbit);
+                               false);
   }
 }
 
 void BufMgr::disposePage(File* file, const PageId pageNo) {
   // Deallocate from file altogether
   // See if it is in the buffer pool
-  FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
-
-  // clear the page
-  bufDescTable[frameNo].Clear();
+  const std::uint32_t shard = shardOf(file->id(), pageNo);
+  while (true) {
+    FrameId frameNo = 0;
+    {
+      std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+      hashTable[shard]->lookup(file, pageNo, frameNo);
+    }
 
-  hashTable->remove(file, pageNo);
+    // The frame latch has to be taken before the shard latch, so check that
+    // the page was not evicted in between
+    BufDesc& desc = bufDescTable[frameNo];
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    std::lock_guard<std::mutex> shardLock(shardLatch[shard]);
+    if (desc.valid && desc.file == file && desc.pageNo == pageNo) {
+      // clear the page
+      markClean(desc);
+      untrackFrame(desc);
+      desc.Clear();
+      pinCounts[frameNo] = 0;
+      hashTable[shard]->remove(file, pageNo);
+      policy->evicted(frameNo);
+      break;
+    }
+  }
 
   // deallocate it in the file
+  std::lock_guard<std::mutex> ioLock(ioLatchOf(file));
   file->deletePage(pageNo);
 }
 
+void BufMgr::setCheckpointInterval(const std::uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(writerLatch);
+  checkpointBytes = bytes;
+  writerWake.notify_one();
+}
+
+void BufMgr::setWarmupFile(const std::string& path,
+                           const std::uint32_t intervalMs) {
+  std::lock_guard<std::mutex> lock(writerLatch);
+  warmupPath = path;
+  warmupIntervalMs = path.empty() ? 0 : intervalMs;
+  nextWarmupSave = std::chrono::steady_clock::now() +
+                   std::chrono::milliseconds(warmupIntervalMs);
+  writerWake.notify_one();
+}
+
+bool BufMgr::saveResidentPages(const std::string& path) {
+  // The page of each frame and the name of its file, read under the latches
+  // of the frame lists, which a frame leaves before it gets another page
+  const std::uint32_t noName = (std::uint32_t)-1;
+  std::vector<std::string> names;
+  std::vector<std::pair<std::uint32_t, PageId> > pages(
+      maxBufs, std::make_pair(noName, (PageId)0));
+  for (std::uint32_t shard = 0; shard < NUM_SHARDS; shard++) {
+    std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+    for (std::unordered_map<const File*, std::vector<FrameId> >::const_iterator
+             it = fileFrames[shard].begin();
+         it != fileFrames[shard].end(); ++it) {
+      names.push_back(fileNames[shard][it->first]);
+      for (std::size_t f = 0; f < it->second.size(); f++) {
+        const FrameId frame = it->second[f];
+        pages[frame].first = (std::uint32_t)(names.size() - 1);
+        pages[frame].second = bufDescTable[frame].pageNo;
+      }
+    }
+  }
+  if (names.empty()) return false;
+
+  // The policy lists the frames it evicts first first, and may leave out
+  // some that are pinned, which are hot too
+  std::vector<FrameId> order;
+  policy->victimOrder(order);
+  std::vector<bool> ordered(maxBufs, false);
+  for (std::size_t i = 0; i < order.size(); i++) ordered[order[i]] = true;
+  std::vector<FrameId> hottest;
+  for (FrameId frame = 0; frame < maxBufs; frame++) {
+    if (pages[frame].first != noName && !ordered[frame]) {
+      hottest.push_back(frame);
+    }
+  }
+  hottest.insert(hottest.end(), order.rbegin(), order.rend());
+
+  // Written to a new file that replaces the old one, which stays whole if
+  // this fails
+  const std::string newPath = path + ".new";
+  {
+    std::ofstream out(newPath.c_str(), std::ios::trunc);
+    for (std::size_t i = 0; i < hottest.size(); i++) {
+      std::pair<std::uint32_t, PageId>& page = pages[hottest[i]];
+      if (page.first == noName) continue;
+      out << page.second << ' ' << names[page.first] << '\n';
+      page.first = noName;
+    }
+    out.close();
+    if (!out) {
+      std::remove(newPath.c_str());
+      return false;
+    }
+  }
+  return std::rename(newPath.c_str(), path.c_str()) == 0;
+}
+
+std::size_t BufMgr::warmUp(File* file) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(writerLatch);
+    path = warmupPath;
+  }
+  if (path.empty()) return 0;
+  std::ifstream in(path.c_str());
+  const std::string name = file->filename();
+  std::vector<PageId> pageNos;
+  PageId pageNo;
+  std::string pageFile;
+  for (std::uint32_t listed = 0; listed < numBufs.load() && in >> pageNo;
+       listed++) {
+    in.get();
+    std::getline(in, pageFile);
+    if (pageFile == name) pageNos.push_back(pageNo);
+  }
+  std::sort(pageNos.begin(), pageNos.end());
+  pageNos.erase(std::unique(pageNos.begin(), pageNos.end()), pageNos.end());
+
+  std::lock_guard<std::mutex> lock(prefetchLatch);
+  for (std::size_t p = 0; p < pageNos.size(); p++) {
+    PrefetchRequest request = {file, pageNos[p], false};
+    prefetchQueue.push_back(request);
+  }
+  prefetchWake.notify_all();
+  return pageNos.size();
+}
+
+void BufMgr::checkpoint() {
+  if (log == NULL) return;
+  std::lock_guard<std::mutex> lock(checkpointLatch);
+  const Lsn beginLsn = log->getAppendedLsn();
+  const Lsn lastLsn = log->getCheckpointLsn();
+
+  std::vector<DirtyPage> dirtyPages;
+  for (FrameId i = 0; i < numBufs; i++) {
+    BufDesc& desc = bufDescTable[i];
+    bool stale;
+    {
+      std::lock_guard<std::mutex> frameLock(desc.latch);
+      if (!desc.valid) continue;
+      std::lock_guard<std::mutex> shardLock(
+          shardLatch[shardOf(desc.fileId, desc.pageNo)]);
+      stale = desc.dirty && desc.recLsn < lastLsn;
+    }
+    if (stale) cleanFrame(i);
+
+    // Writes of the page hold the frame latch, so a page found clean here is
+    // in its file
+    std::lock_guard<std::mutex> frameLock(desc.latch);
+    if (!desc.valid) continue;
+    std::lock_guard<std::mutex> shardLock(
+        shardLatch[shardOf(desc.fileId, desc.pageNo)]);
+    if (desc.dirty) {
+      DirtyPage dirty;
+      dirty.filename = desc.file->filename();
+      dirty.pageNo = desc.pageNo;
+      dirty.recLsn = desc.recLsn;
+      dirtyPages.push_back(dirty);
+    }
+  }
+
+  // Pages written before the scan are left out of the table, so they have to
+  // be durable before the checkpoint is
+  std::unordered_set<std::string> files;
+  {
+    std::lock_guard<std::mutex> filesLock(writtenFilesLatch);
+    files.swap(writtenFiles);
+  }
+  for (std::unordered_set<std::string>::const_iterator it = files.begin();
+       it != files.end(); ++it) {
+    File::syncFile(*it);
+  }
+  log->checkpoint(beginLsn, dirtyPages);
+}
+
+//----------------------------------------
+// LogOperation
+//----------------------------------------
+
+thread_local LogOperation* LogOperation::current = NULL;
+
+LogOperation::LogOperation(BufMgr* bufMgr)
+    : bufMgr(bufMgr), active(bufMgr->log != NULL && current == NULL) {
+  if (active) current = this;
+}
+
+LogOperation::~LogOperation() {
+  try {
+    commit();
+  } catch (...) {
+    // Destructors do not throw; the pages stay pinned
+  }
+}
+
+void LogOperation::commit() {
+  if (!active) return;
+  active = false;
+  current = NULL;
+  if (pages.empty()) return;
+
+  LogManager* log = bufMgr->log;
+  const Lsn lsn = log->append(pages);
+  for (std::size_t i = 0; i < pages.size(); i++) {
+    bufMgr->releaseLogged(pages[i].file, pages[i].pageNo, lsn);
+  }
+  pages.clear();
+  log->flush(lsn);
+}
+
+void BufMgr::setFileClass(const File* file, const PriorityClass priority,
+                          const std::uint32_t quota) {
+  const std::uint32_t shard = fileShardOf(file->id());
+  std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+  FileClass& cls = fileClasses[shard][file];
+  cls.priority = priority;
+  cls.quota = quota;
+  cls.hand = 0;
+}
+
+void BufMgr::clearFileClass(const File* file) {
+  const std::uint32_t shard = fileShardOf(file->id());
+  std::lock_guard<std::mutex> lock(fileFramesLatch[shard]);
+  fileClasses[shard].erase(file);
+}
+
+void BufMgr::exportMetrics(std::ostream& out) const {
+  const std::string prefix = "badgerdb_buffer_";
+  out << "# HELP " << prefix << "accesses_total Pages read through readPage\n";
+  out << "# TYPE " << prefix << "accesses_total counter\n";
+  out << prefix << "accesses_total " << bufStats.accesses.load() << "\n";
+  out << "# HELP " << prefix << "disk_reads_total Pages read from disk\n";
+  out << "# TYPE " << prefix << "disk_reads_total counter\n";
+  out << prefix << "disk_reads_total " << bufStats.diskreads.load() << "\n";
+  out << "# HELP " << prefix << "disk_writes_total Pages written to disk\n";
+  out << "# TYPE " << prefix << "disk_writes_total counter\n";
+  out << prefix << "disk_writes_total " << bufStats.diskwrites.load() << "\n";
+  out << "# HELP " << prefix << "frames Frames in the buffer pool\n";
+  out << "# TYPE " << prefix << "frames gauge\n";
+  out << prefix << "frames " << numBufs.load() << "\n";
+  out << "# HELP " << prefix << "dirty_frames Frames holding a dirty page\n";
+  out << "# TYPE " << prefix << "dirty_frames gauge\n";
+  out << prefix << "dirty_frames " << numDirty.load() << "\n";
+
+  BufTelemetrySnapshot snapshot;
+  telemetry.snapshot(snapshot);
+  BufTelemetry::writePrometheus(out, snapshot, prefix);
+}
+
 void BufMgr::printSelf(void) {
   BufDesc* tmpbuf;
   int validFrames = 0;
@@ -221,6 +1229,7 @@ void BufMgr::printSelf(void) {
     tmpbuf = &(bufDescTable[i]);
     std::cout << "FrameNo:" << i << " ";
     tmpbuf->Print();
+    std::cout << "pinCnt:" << pinCounts[i] << "\n";
 
     if (tmpbuf->valid == true) validFrames++;
   }
@@ -8,10 +8,24 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "bufHashTbl.h"
+#include "buffer_telemetry.h"
 #include "file.h"
+#include "log_manager.h"
+#include "replacement_policy.h"
 
 namespace badgerdb {
 
@@ -19,19 +33,68 @@ namespace badgerdb {
  * forward declaration of BufMgr class
  */
 class BufMgr;
+class LogOperation;
+
+/**
+ * @brief Priority classes of the pages of a file. When a frame is needed,
+ * pages of a higher class are only evicted if no frame free or holding a page
+ * of the requesting page's class or lower can be had.
+ */
+enum PriorityClass {
+  /**
+   * Scratch pages, such as those of sorts and intermediate results
+   */
+  TEMP_PRIORITY = 0,
+
+  /**
+   * Pages of relations, the default
+   */
+  HEAP_PRIORITY = 1,
+
+  /**
+   * Pages of indexes, which every lookup goes through
+   */
+  INDEX_PRIORITY = 2
+};
+
+/**
+ * @brief Number of priority classes.
+ */
+const int NUM_PRIORITY_CLASSES = 3;
 
 /**
  * @brief Class for maintaining information about buffer pool frames
+ *
+ * The page a frame holds (file, pageNo, valid) only changes under the frame's
+ * latch. dirty is protected by the latch of the page's shard of the page
+ * table, and fileSlot by the latch of the file's frame list. loading is atomic
+ * so that threads can wait for a page without the frame latch.
+ *
+ * The pin count of a frame is not kept here but in an array of the buffer
+ * manager of its own, and how recently the page was used is up to the buffer
+ * manager's ReplacementPolicy. Looking for a frame to evict thus goes through
+ * arrays packed with the fields it checks, and only reads the descriptors of
+ * frames that can be evicted.
  */
 class BufDesc {
   friend class BufMgr;
 
  private:
+  /**
+   * Latch held while the page assigned to the frame changes
+   */
+  std::mutex latch;
+
   /**
    * Pointer to file to which corresponding frame is assigned
    */
   File* file;
 
+  /**
+   * Id of that file, which the page table is sharded on
+   */
+  FileId fileId;
+
   /**
    * Page within file to which corresponding frame is assigned
    */
@@ -43,9 +106,14 @@ class BufDesc {
   FrameId frameNo;
 
   /**
-   * Number of times this page has been pinned
+   * Position of the frame in the list of frames holding pages of its file
+   */
+  std::uint32_t fileSlot;
+
+  /**
+   * Priority class of the page's file when it was read in
    */
-  int pinCnt;
+  PriorityClass priority;
 
   /**
    * True if page is dirty;  false otherwise
@@ -58,20 +126,37 @@ class BufDesc {
   bool valid;
 
   /**
-   * Has this buffer frame been reference recently
+   * True while the page is being read in from disk or written back to it.
+   * Threads that pin the page meanwhile wait for it to be cleared, so that
+   * nobody changes a page while it is written.
+   */
+  std::atomic<bool> loading;
+
+  /**
+   * Log sequence number of the last operation that changed the page. The page
+   * is only written once the log is durable up to it.
+   */
+  Lsn pageLsn;
+
+  /**
+   * End of the log when the page was last dirtied while clean. Every change
+   * to the page not yet written is logged after it.
    */
-  bool refbit;
+  Lsn recLsn;
 
   /**
    * Initialize buffer frame for a new user
    */
   void Clear() {
-    pinCnt = 0;
     file = NULL;
+    fileId = 0;
     pageNo = Page::INVALID_NUMBER;
+    priority = HEAP_PRIORITY;
     dirty = false;
-    refbit = false;
     valid = false;
+    loading = false;
+    pageLsn = 0;
+    recLsn = 0;
   };
 
   /**
@@ -81,14 +166,18 @@ class BufDesc {
    *
    * @param filePtr	File object
    * @param pageNum	Page number in the file
+   * @param cls     Priority class of the file
    */
-  void Set(File* filePtr, PageId pageNum) {
+  void Set(File* filePtr, PageId pageNum, PriorityClass cls) {
     file = filePtr;
+    fileId = filePtr->id();
     pageNo = pageNum;
-    pinCnt = 1;
+    priority = cls;
     dirty = false;
     valid = true;
-    refbit = true;
+    loading = false;
+    pageLsn = 0;
+    recLsn = 0;
   }
 
   void Print() {
@@ -99,9 +188,7 @@ class BufDesc {
       std::cout << "file:NULL ";
 
     std::cout << "valid:" << valid << " ";
-    std::cout << "pinCnt:" << pinCnt << " ";
     std::cout << "dirty:" << dirty << " ";
-    std::cout << "refbit:" << refbit << "\n";
   }
 
   /**
@@ -117,22 +204,43 @@ struct BufStats {
   /**
    * Total number of accesses to buffer pool
    */
-  int accesses;
+  std::atomic<int> accesses;
 
   /**
    * Number of pages read from disk (including allocs)
    */
-  int diskreads;
+  std::atomic<int> diskreads;
 
   /**
    * Number of pages written back to disk
    */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+  /**
+   * Number of pages of each priority class read through readPage(), and the
+   * number of those found in the buffer pool
+   */
+  std::atomic<int> classAccesses[NUM_PRIORITY_CLASSES];
+  std::atomic<int> classHits[NUM_PRIORITY_CLASSES];
+
+  /**
+   * Returns the fraction of the pages of a priority class read that were
+   * found in the buffer pool, or 0 if none were read
+   */
+  double hitRate(const PriorityClass priority) const {
+    const int reads = classAccesses[priority].load();
+    return reads == 0 ? 0 : (double)classHits[priority].load() / reads;
+  }
 
   /**
    * Clear all values
    */
-  void clear() { accesses = diskreads = diskwrites = 0; }
+  void clear() {
+    accesses = diskreads = diskwrites = 0;
+    for (int i = 0; i < NUM_PRIORITY_CLASSES; i++) {
+      classAccesses[i] = classHits[i] = 0;
+    }
+  }
 
   /**
    * Constructor of BufStats class
@@ -140,26 +248,192 @@ struct BufStats {
   BufStats() { clear(); }
 };
 
+/**
+ * @brief Default fraction of the buffer pool that may be dirty before the
+ * background writer starts cleaning frames.
+ */
+const double DEFAULT_HIGH_DIRTY_RATIO = 0.5;
+
+/**
+ * @brief Default fraction of the buffer pool left dirty once the background
+ * writer is done cleaning frames.
+ */
+const double DEFAULT_LOW_DIRTY_RATIO = 0.25;
+
+/**
+ * @brief Number of pages sequential scans keep read ahead of the page they are
+ * on.
+ */
+const std::uint32_t READ_AHEAD_PAGES = 8;
+
+/**
+ * @brief How the memory of a buffer pool is allocated.
+ */
+enum PoolMemory {
+  /**
+   * Pages of the default size, from the heap.
+   */
+  SMALL_PAGES,
+
+  /**
+   * 2MB huge pages, so that a large pool takes few TLB entries: reserved huge
+   * pages if the system has enough, else transparent huge pages. On a machine
+   * with several NUMA nodes the frames are split into one range per node, and
+   * each range and the descriptors of its frames are placed on their node.
+   */
+  HUGE_PAGES
+};
+
+/**
+ * @brief Size of the huge pages a HUGE_PAGES buffer pool is allocated in.
+ */
+const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
 /**
  * @brief The central class which manages the buffer pool including frame
  * allocation and deallocation to pages in the file
+ *
+ * All public methods may be called from several threads at once. The page
+ * table is split into shards, each with its own latch, and disk I/O is done
+ * without holding any shard latch. A File object is not thread safe itself, so
+ * I/O on one file is serialized by a latch picked by the file.
+ *
+ * A background writer thread writes back dirty, unpinned pages ahead of the
+ * clock hand whenever more of the pool than the high watermark is dirty, until
+ * no more than the low watermark is. Eviction then rarely has to write a page
+ * before it can reuse the frame.
+ *
+ * Pages asked for through prefetch() are read in by a few read-ahead threads,
+ * so several reads are in flight while the caller works on earlier pages.
+ *
+ * With a warm-up file set by setWarmupFile(), the background writer also
+ * saves the pages in the pool to that file from time to time, hottest first.
+ * After a restart, warmUp() has the read-ahead threads read the pages saved
+ * for a file back in, in page order.
+ *
+ * With a write-ahead log, checkpoint() records the dirty pages of the pool in
+ * the log while other threads keep changing pages, so recovery only has to
+ * read the log from the oldest change not yet written. Pages that stayed
+ * dirty since the checkpoint before are written first, so that this point
+ * keeps moving. The background writer also takes a checkpoint whenever the
+ * log has grown by the interval set with setCheckpointInterval().
+ *
+ * The pool can be resized with resize() while in use, up to a size fixed when
+ * it is created. The tables of the page table grow without stopping, moving a
+ * few entries over to a larger array with each change to them.
  */
 class BufMgr {
+  friend class LogOperation;
+
  private:
   /**
-   * Current position of clockhand in our buffer pool
+   * Number of shards of the page table, and of file I/O latches
+   */
+  static const std::uint32_t NUM_SHARDS = 16;
+
+  /**
+   * Number of read-ahead threads
+   */
+  static const std::uint32_t NUM_PREFETCHERS = 4;
+
+  /**
+   * Milliseconds between the background writer's checks whether a checkpoint
+   * is due
    */
-  FrameId clockHand;
+  static const int CHECKPOINT_POLL_MS = 20;
+
+  /**
+   * Number of frames suggested by the replacement policy that allocBuf() may
+   * pass over for holding pages of a higher priority class than it allocates
+   * for, before it takes any frame
+   */
+  static const std::uint32_t PRIORITY_PROBES = 64;
+
+  /**
+   * A page asked for through prefetch()
+   */
+  struct PrefetchRequest {
+    File* file;
+    PageId pageNo;
+    bool sequential;
+  };
+
+  /**
+   * Priority class of a file, the number of frames its pages may take, 0 for
+   * any number, and the position in its frame list of the next frame to reuse
+   * once they have taken that many
+   */
+  struct FileClass {
+    PriorityClass priority;
+    std::uint32_t quota;
+    std::uint32_t hand;
+  };
+
+  /**
+   * Picks the frames to evict
+   */
+  ReplacementPolicy* policy;
 
   /**
    * Number of frames in the buffer pool
    */
-  std::uint32_t numBufs;
+  std::atomic<std::uint32_t> numBufs;
+
+  /**
+   * Number of frames the pool may be resized to. Memory for them is reserved
+   * up front, so that frames never move.
+   */
+  std::uint32_t maxBufs;
+
+  /**
+   * Number of frames whose descriptor has been constructed, the most the pool
+   * has ever had
+   */
+  std::uint32_t constructedBufs;
+
+  /**
+   * Makes resizes run one at a time
+   */
+  std::mutex resizeLatch;
+
+  /**
+   * Hash tables mapping (File, page) to frame, one per shard
+   */
+  BufHashTbl* hashTable[NUM_SHARDS];
+
+  /**
+   * Latches protecting the shards of the page table
+   */
+  std::mutex shardLatch[NUM_SHARDS];
+
+  /**
+   * Latches serializing writes, allocations and deletions of pages of the
+   * files hashed to them. These update the file header and the list of pages.
+   * A thread holding several latches takes the frame latch first, then the
+   * I/O latch, then the shard latch and then the frame list latch.
+   */
+  std::mutex ioLatch[NUM_SHARDS];
+
+  /**
+   * Frames holding pages of each file, in no particular order, so that
+   * flushing a file only visits its own frames. Files are spread over the
+   * maps like over the I/O latches, and each map has its own latch.
+   */
+  std::unordered_map<const File*, std::vector<FrameId> > fileFrames[NUM_SHARDS];
+  std::mutex fileFramesLatch[NUM_SHARDS];
 
   /**
-   * Hash table mapping (File, page) to frame
+   * Classes of the files set with setFileClass(), spread over the maps like
+   * the frame lists and protected by the same latches
    */
-  BufHashTbl* hashTable;
+  std::unordered_map<const File*, FileClass> fileClasses[NUM_SHARDS];
+
+  /**
+   * Names of the files with frames in the pool, kept with their frame lists
+   * and protected by the same latches, so that the pages of the pool can be
+   * saved without touching File objects that may have been closed since
+   */
+  std::unordered_map<const File*, std::string> fileNames[NUM_SHARDS];
 
   /**
    * Array of BufDesc objects to hold information corresponding to every frame
@@ -167,25 +441,309 @@ class BufMgr {
    */
   BufDesc* bufDescTable;
 
+  /**
+   * Number of times the page in each frame has been pinned. A frame that is
+   * not valid but pinned has been claimed by a thread that is about to assign
+   * it a page.
+   */
+  std::unique_ptr<std::atomic<int>[]> pinCounts;
+
+  /**
+   * How bufPool and bufDescTable were allocated, and the bytes mapped for
+   * them
+   */
+  PoolMemory poolMemory;
+  std::size_t poolBytes;
+  std::size_t descBytes;
+
+  /**
+   * True if bufPool is backed by reserved huge pages
+   */
+  bool hugePagesReserved;
+
   /**
    * Maintains Buffer pool usage statistics
    */
   BufStats bufStats;
 
   /**
-   * Advance clock to next frame in the buffer pool
+   * Per-file hits and misses, evictions, waits and I/O latencies
+   */
+  BufTelemetry telemetry;
+
+  /**
+   * Number of frames holding a dirty page
+   */
+  std::atomic<std::uint32_t> numDirty;
+
+  /**
+   * Fractions of the pool the dirty marks are set to
+   */
+  double highDirtyRatio;
+  double lowDirtyRatio;
+
+  /**
+   * Number of dirty frames above which the background writer cleans frames,
+   * and the number it leaves dirty
+   */
+  std::atomic<std::uint32_t> highDirtyMark;
+  std::atomic<std::uint32_t> lowDirtyMark;
+
+  /**
+   * Protects stopWriter and checkpointBytes, with writerWake signalled when
+   * the writer has work or has to stop
+   */
+  std::mutex writerLatch;
+  std::condition_variable writerWake;
+  bool stopWriter;
+
+  /**
+   * Background writer cleaning dirty frames
+   */
+  std::thread writerThread;
+
+  /**
+   * File the pages of the pool are saved to and read back from, empty if
+   * none, the milliseconds between saves, 0 for none, and when the next save
+   * is due. Protected by writerLatch.
+   */
+  std::string warmupPath;
+  std::uint32_t warmupIntervalMs;
+  std::chrono::steady_clock::time_point nextWarmupSave;
+
+  /**
+   * Protects the read-ahead queue, the files being read ahead and
+   * stopPrefetchers. prefetchWake is signalled when requests are queued or the
+   * threads have to stop, and prefetchDone whenever a request is done.
+   */
+  std::mutex prefetchLatch;
+  std::condition_variable prefetchWake;
+  std::condition_variable prefetchDone;
+  bool stopPrefetchers;
+
+  /**
+   * Pages waiting to be read ahead
+   */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+  /**
+   * Files of the pages being read ahead, one entry per request
+   */
+  std::vector<const File*> prefetching;
+
+  /**
+   * Threads reading pages ahead
+   */
+  std::thread prefetchThreads[NUM_PREFETCHERS];
+
+  /**
+   * Write-ahead log of the page changes, NULL if they are not logged
+   */
+  LogManager* log;
+
+  /**
+   * Growth of the log after which the background writer takes a checkpoint,
+   * or 0 if it takes none
+   */
+  std::uint64_t checkpointBytes;
+
+  /**
+   * Makes checkpoints run one at a time
+   */
+  std::mutex checkpointLatch;
+
+  /**
+   * Names of the files pages have been written to since the last checkpoint,
+   * which it has to sync
+   */
+  std::unordered_set<std::string> writtenFiles;
+  std::mutex writtenFilesLatch;
+
+  /**
+   * Returns the shard of the page table that holds (file, pageNo)
+   */
+  std::uint32_t shardOf(const FileId fileId, const PageId pageNo) const;
+
+  /**
+   * Returns the index of the I/O latch and of the frame list of file
+   */
+  std::uint32_t fileShardOf(const FileId fileId) const;
+
+  /**
+   * Returns the latch serializing changes to file
    */
-  void advanceClock() { clockHand = (clockHand + 1) % numBufs; }
+  std::mutex& ioLatchOf(const File* file);
 
   /**
-   * Allocate a free frame.
+   * Adds a frame that was just given a page to the frame list of the page's
+   * file. Called with the latch of the page's shard held.
    *
+   * @param desc    Frame holding the page
+   */
+  void trackFrame(BufDesc& desc);
+
+  /**
+   * Takes a frame about to give up its page off the frame list of the page's
+   * file. Called with the latch of the page's shard held.
+   *
+   * @param desc    Frame holding the page
+   */
+  void untrackFrame(BufDesc& desc);
+
+  /**
+   * Sets up frames [first, end) as empty, unpinned frames, constructing the
+   * descriptors and pages of frames the pool never had. Frames of a
+   * HUGE_PAGES pool are set up on the threads of their NUMA nodes.
+   */
+  void addFrames(const FrameId first, const FrameId end);
+
+  /**
+   * Allocate a free frame for a page of file. The frame is returned claimed:
+   * pinned once and not valid, so that no other thread allocates it before it
+   * is assigned a page.
+   *
+   * A file that has used up its quota only gets frames holding its own pages.
+   * Otherwise frames holding pages of a higher priority class than the file's
+   * are passed over while the policy suggests others.
+   *
+   * @param file      File the frame is for
    * @param frame   	Frame reference, frame ID of allocated frame returned
    * via this variable
+   * @param priority  Priority class of the file, returned via this reference
    * @throws BufferExceededException If no such buffer is found which can be
    * allocated
    */
-  void allocBuf(FrameId& frame);
+  void allocBuf(const File* file, FrameId& frame, PriorityClass& priority);
+
+  /**
+   * Claims a frame suggested by the replacement policy if it is free or holds
+   * an unpinned page, writing the page back first if it is dirty.
+   *
+   * @param frame     Frame to claim
+   * @param evictable Highest priority class of the pages that may be evicted
+   * @param owner     If not NULL, only a page of this file may be evicted, and
+   * free frames are not taken
+   * @return  True if the frame has been claimed
+   */
+  bool claimFrame(const FrameId frame,
+                  const PriorityClass evictable = INDEX_PRIORITY,
+                  const File* owner = NULL);
+
+  /**
+   * Marks the page in a frame dirty. Called with the latch of the page's
+   * shard held.
+   *
+   * @param desc    Frame holding the page
+   */
+  void markDirty(BufDesc& desc);
+
+  /**
+   * Marks the page in a frame clean. Called with the latch of the page's shard
+   * held.
+   *
+   * @param desc    Frame holding the page
+   */
+  void markClean(BufDesc& desc);
+
+  /**
+   * Writes the page in a frame back to disk. The caller holds the frame latch
+   * and a pin on the frame, and has marked the page clean and set loading. If
+   * the write fails the page is marked dirty again, loading cleared and the
+   * pin dropped.
+   *
+   * @param frame   Frame holding the page
+   */
+  void writeBack(const FrameId frame);
+
+  /**
+   * Records that a page of file was written, if pages are logged.
+   */
+  void noteWritten(const File* file);
+
+  /**
+   * Logs the image of a pinned page about to be unpinned dirty: with the
+   * thread's running LogOperation, which keeps a pin on it until it is
+   * logged, or else as an operation of its own.
+   *
+   * @param file    File of the page
+   * @param pageNo  Number of the page
+   * @throws  PageNotPinnedException If the page is not pinned
+   */
+  void logPage(File* file, const PageId pageNo);
+
+  /**
+   * Records that a page was logged at lsn, and drops the pin a LogOperation
+   * kept on it.
+   */
+  void releaseLogged(const File* file, const PageId pageNo, const Lsn lsn);
+
+  /**
+   * Writes back the page in a frame if it is dirty and unpinned, leaving it in
+   * the buffer pool. Frames another thread has latched are skipped.
+   *
+   * @param frame   Frame to clean
+   */
+  void cleanFrame(const FrameId frame);
+
+  /**
+   * Body of the background writer thread.
+   */
+  void runWriter();
+
+  /**
+   * Reads a page that was not found in the buffer pool into a newly allocated
+   * frame.
+   *
+   * @param file       File object
+   * @param pageNo     Page number in the file
+   * @param frame      Frame holding the page, returned via this reference
+   * @param readAhead  True if nobody is waiting for the page. Such pages are
+   * skipped if they are past the end of the file or already in the buffer
+   * pool. Their frame is set up under the latch serializing allocations, so a
+   * page being allocated is never read in.
+   * @param sequential True if the page is read by a sequential scan
+   * @return  True if the page is in the frame, pinned. False if the caller
+   * should look the page up again, or the page was skipped.
+   */
+  bool loadPage(File* file, const PageId pageNo, FrameId& frame,
+                const bool readAhead, const bool sequential);
+
+  /**
+   * Returns true if (file, pageNo) is in the buffer pool.
+   */
+  bool isResident(const File* file, const PageId pageNo);
+
+  /**
+   * Drops the queued read-ahead requests for the file and waits for those
+   * being served.
+   */
+  void cancelPrefetch(const File* file);
+
+  /**
+   * Body of the read-ahead threads.
+   */
+  void runPrefetcher();
+
+  /**
+   * Pins the frame holding (file, pageNo) if the page is in the buffer pool.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file
+   * @param frame   Frame holding the page, returned via this reference
+   * @param sequential  True if the page is read by a sequential scan
+   * @return  True if the page was found and pinned
+   */
+  bool pinResident(File* file, const PageId pageNo, FrameId& frame,
+                   const bool sequential);
+
+  /**
+   * Waits for a pinned frame to finish loading or writing back its page.
+   *
+   * @param frame   Frame pinned by the caller
+   * @return  True if the page was loaded. If loading it failed, the pin is
+   * dropped and false returned.
+   */
+  bool waitForLoad(const FrameId frame);
 
  public:
   /**
@@ -195,8 +753,23 @@ class BufMgr {
 
   /**
    * Constructor of BufMgr class
+   *
+   * @param bufs            Number of frames in the buffer pool
+   * @param highDirtyRatio  Fraction of the frames that may be dirty before the
+   * background writer starts cleaning them
+   * @param lowDirtyRatio   Fraction of the frames the background writer leaves
+   * dirty
+   * @param strategy        How frames to reuse are picked
+   * @param memory          How the memory of the frames is allocated
+   * @param maxBufs         Number of frames the pool may be resized to, or 0
+   * for bufs. Only address space is reserved for the frames beyond bufs.
    */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs,
+         const double highDirtyRatio = DEFAULT_HIGH_DIRTY_RATIO,
+         const double lowDirtyRatio = DEFAULT_LOW_DIRTY_RATIO,
+         const ReplacementStrategy strategy = CLOCK,
+         const PoolMemory memory = SMALL_PAGES,
+         const std::uint32_t maxBufs = 0);
 
   /**
    * Destructor of BufMgr class
@@ -213,8 +786,82 @@ class BufMgr {
    * @param PageNo  Page number in the file to be read
    * @param page  	Reference to page pointer. Used to fetch the Page object
    * in which requested page from file is read in.
+   * @param sequential  True if the page is read by a sequential scan, so that
+   * the replacement policy can give it up sooner than other pages
    */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void readPage(File* file, const PageId PageNo, Page*& page,
+                const bool sequential = false);
+
+  /**
+   * Asks for pages to be read into the buffer pool in the background, so that
+   * reading them later finds them there. Pages that do not exist, or that
+   * cannot be given a frame, are skipped. Requests beyond a quarter of the
+   * pool waiting at once are dropped. The pages are read in as pages of a
+   * sequential scan.
+   *
+   * @param file   	File object
+   * @param PageNo  Number of the first page to read
+   * @param count   Number of consecutive pages to read
+   */
+  void prefetch(File* file, const PageId PageNo, const std::uint32_t count);
+
+  /**
+   * Logs every change to a page, made known by unpinning the page dirty, in
+   * log, or stops logging if log is NULL. Pages are then only written once
+   * the log is durable up to their last change. Call this while no page is
+   * pinned. The log has to outlive its use.
+   *
+   * @param log  Write-ahead log to use
+   */
+  void setLog(LogManager* log) { this->log = log; }
+
+  /**
+   * Has the background writer take a checkpoint whenever the log has grown by
+   * bytes since the last one, or no more checkpoints if bytes is 0. Set a log
+   * first, and the interval to 0 before setting the log to NULL.
+   *
+   * @param bytes  Log growth between checkpoints
+   */
+  void setCheckpointInterval(const std::uint64_t bytes);
+
+  /**
+   * Sets the warm-up file the pages of the pool are saved to and read back
+   * from. The background writer saves them to it every intervalMs
+   * milliseconds, or never if it is 0.
+   *
+   * @param path        Name of the warm-up file, or empty for none
+   * @param intervalMs  Milliseconds between saves
+   */
+  void setWarmupFile(const std::string& path, const std::uint32_t intervalMs);
+
+  /**
+   * Writes the file name and page number of every page in the pool to a
+   * warm-up file, those the replacement policy would evict last first. The
+   * file is replaced as a whole, and left alone if the pool holds no page.
+   *
+   * @param path  Name of the file
+   * @return  True if the file was written
+   */
+  bool saveResidentPages(const std::string& path);
+
+  /**
+   * Has the read-ahead threads read the pages of file listed in the warm-up
+   * file back into the pool, in page order, as pages read at random rather
+   * than by a scan. Only the hottest pages of the list, as many as the pool
+   * has frames, are considered. Pages that no longer exist are skipped.
+   *
+   * @param file  File object
+   * @return  Number of pages asked for
+   */
+  std::size_t warmUp(File* file);
+
+  /**
+   * Takes a fuzzy checkpoint: writes back the unpinned pages dirty since
+   * before the last checkpoint, syncs the files written to, and logs the
+   * pages still dirty. Other threads may go on using the pool meanwhile.
+   * Does nothing without a log.
+   */
+  void checkpoint();
 
   /**
    * Unpin a page from memory since it is no longer required for it to remain in
@@ -244,6 +891,8 @@ class BufMgr {
    * Writes out all dirty pages of the file to disk.
    * All the frames assigned to the file need to be unpinned from buffer pool
    * before this function can be successfully called. Otherwise Error returned.
+   * Takes time in the number of frames holding pages of the file, not in the
+   * size of the pool.
    *
    * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the
@@ -263,20 +912,155 @@ class BufMgr {
    */
   void disposePage(File* file, const PageId PageNo);
 
+  /**
+   * Sets the priority class of the pages of a file, and the number of frames
+   * they may take. Pages already in the pool keep the class they were read in
+   * with. The file is known by its address, so clear its class before the
+   * File object goes away.
+   *
+   * @param file      File object
+   * @param priority  Priority class of its pages
+   * @param quota     Most frames its pages may take at once, or 0 for no limit
+   */
+  void setFileClass(const File* file, const PriorityClass priority,
+                    const std::uint32_t quota = 0);
+
+  /**
+   * Puts a file back into the default class: HEAP_PRIORITY, without a quota.
+   *
+   * @param file   	File object
+   */
+  void clearFileClass(const File* file);
+
   /**
    * Print member variable values.
    */
   void printSelf();
 
+  /**
+   * Changes the number of frames in the buffer pool while other threads keep
+   * using it. Frames added are handed out as soon as the replacement policy
+   * knows about them. Frames removed, the last ones of the pool, are drained
+   * first: their pages are written back if dirty and dropped, waiting for the
+   * pages pinned in them to be unpinned, so the caller must not hold such a
+   * pin. Their memory is then given back to the system.
+   *
+   * @param newBufs  New number of frames, from 1 up to the maxBufs the pool
+   * was created with
+   * @throws BufferExceededException If newBufs is 0 or more than maxBufs
+   */
+  void resize(const std::uint32_t newBufs);
+
+  /**
+   * Get number of frames in the buffer pool
+   */
+  std::uint32_t getNumBufs() const { return numBufs.load(); }
+
+  /**
+   * Get number of frames the buffer pool may be resized to
+   */
+  std::uint32_t getMaxBufs() const { return maxBufs; }
+
+  /**
+   * Returns true if the frames are backed by reserved huge pages, rather than
+   * by transparent huge pages or pages of the default size
+   */
+  bool usesReservedHugePages() const { return hugePagesReserved; }
+
+  /**
+   * Get number of frames holding a dirty page
+   */
+  std::uint32_t getNumDirty() const { return numDirty.load(); }
+
   /**
    * Get buffer pool usage statistics
    */
   BufStats& getBufStats() { return bufStats; }
 
   /**
-   * Clear buffer pool usage statistics
+   * Clear buffer pool usage statistics, and the telemetry
    */
-  void clearBufStats() { bufStats.clear(); }
+  void clearBufStats() {
+    bufStats.clear();
+    telemetry.clear();
+  }
+
+  /**
+   * Adds up the telemetry of the threads using the pool.
+   *
+   * @param snapshot  Totals, replaced via this reference
+   */
+  void getTelemetry(BufTelemetrySnapshot& snapshot) const {
+    telemetry.snapshot(snapshot);
+  }
+
+  /**
+   * Writes the usage statistics and the telemetry in the Prometheus text
+   * exposition format, with metric names starting with badgerdb_buffer_.
+   *
+   * @param out  Stream written to
+   */
+  void exportMetrics(std::ostream& out) const;
+};
+
+/**
+ * @brief Groups the page changes a thread makes through a BufMgr into one
+ * operation of the buffer manager's write-ahead log, so that recovery redoes
+ * all of them or none.
+ *
+ * While the operation runs, the pages the thread unpins dirty are logged with
+ * it instead of on their own, and stay pinned, so that none of them is written
+ * before they are logged. commit() logs them and waits until the log is
+ * durable, sharing the sync with other threads committing at the same time.
+ * An operation does nothing if the buffer manager has no log, or if the thread
+ * is already running one, which the changes then become part of.
+ */
+class LogOperation {
+ public:
+  /**
+   * Starts an operation on the calling thread.
+   *
+   * @param bufMgr  Buffer manager the pages are changed through
+   */
+  explicit LogOperation(BufMgr* bufMgr);
+
+  /**
+   * Commits the operation if it has not been committed yet.
+   */
+  ~LogOperation();
+
+  /**
+   * Logs the pages changed, lets go of them and waits until the log is
+   * durable. Changes made after this are logged on their own.
+   */
+  void commit();
+
+ private:
+  friend class BufMgr;
+
+  /**
+   * Buffer manager the pages are changed through
+   */
+  BufMgr* bufMgr;
+
+  /**
+   * True until the operation is committed, false if it does nothing
+   */
+  bool active;
+
+  /**
+   * Newest image of each page changed so far
+   */
+  std::vector<LoggedPage> pages;
+
+  /**
+   * Operation running on each thread, NULL if there is none
+   */
+  static thread_local LogOperation* current;
+
+  // No copying
+  LogOperation(const LogOperation&);
+  LogOperation& operator=(const LogOperation&);
 };
 
 }  // namespace badgerdb
@@ -0,0 +1,206 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "buffer_telemetry.h"
+
+#include "file.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Slot of each thread, handed out in turn as threads first record something
+ */
+std::atomic<unsigned> nextSlot(0);
+thread_local unsigned threadSlot = nextSlot++;
+
+/**
+ * Writes the cumulative buckets, sum and count of a histogram of nanoseconds
+ * in seconds.
+ */
+void writeSeconds(std::ostream& out, const std::string& name,
+                  const std::string& help, const Histogram& histogram) {
+  out << "# HELP " << name << " " << help << "\n";
+  out << "# TYPE " << name << " histogram\n";
+  for (int shift = 10; shift <= 34; shift++) {
+    const std::uint64_t nanos = 1ULL << shift;
+    out << name << "_bucket{le=\"" << nanos / 1e9 << "\"} "
+        << histogram.countAtMost(nanos - 1) << "\n";
+  }
+  out << name << "_bucket{le=\"+Inf\"} " << histogram.getCount() << "\n";
+  out << name << "_sum " << histogram.getSum() / 1e9 << "\n";
+  out << name << "_count " << histogram.getCount() << "\n";
+}
+
+/**
+ * Escapes a label value: backslashes, quotes and newlines.
+ */
+std::string labelValue(const std::string& value) {
+  std::string escaped;
+  for (std::size_t i = 0; i < value.size(); i++) {
+    if (value[i] == '\\' || value[i] == '"') escaped += '\\';
+    if (value[i] == '\n') {
+      escaped += "\\n";
+      continue;
+    }
+    escaped += value[i];
+  }
+  return escaped;
+}
+
+}  // namespace
+
+BufTelemetry::BufTelemetry() : slots(new Slot[NUM_SLOTS]) {
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    slots[i].cleanEvictions = 0;
+    slots[i].dirtyEvictions = 0;
+    slots[i].pinWaits = 0;
+  }
+}
+
+BufTelemetry::Slot& BufTelemetry::slot() {
+  return slots[threadSlot % NUM_SLOTS];
+}
+
+void BufTelemetry::countAccess(const File* file, const bool hit) {
+  Slot& s = slot();
+  std::lock_guard<std::mutex> lock(s.filesLatch);
+  std::unordered_map<const File*, FileEntry>::iterator it = s.files.find(file);
+  if (it == s.files.end()) {
+    FileEntry entry = {file->filename(), {0, 0}};
+    it = s.files.insert(std::make_pair(file, entry)).first;
+  }
+  if (hit) {
+    it->second.counts.hits++;
+  } else {
+    it->second.counts.misses++;
+  }
+}
+
+void BufTelemetry::countEviction(const bool dirty) {
+  Slot& s = slot();
+  (dirty ? s.dirtyEvictions : s.cleanEvictions)
+      .fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufTelemetry::countPinWait() {
+  slot().pinWaits.fetch_add(1, std::memory_order_relaxed);
+}
+
+void BufTelemetry::recordRead(const std::uint64_t nanos) {
+  slot().readLatency.record(nanos);
+}
+
+void BufTelemetry::recordWrite(const std::uint64_t nanos) {
+  slot().writeLatency.record(nanos);
+}
+
+void BufTelemetry::recordSweep(const std::uint64_t frames) {
+  slot().sweepLength.record(frames);
+}
+
+void BufTelemetry::snapshot(BufTelemetrySnapshot& snapshot) const {
+  snapshot.files.clear();
+  snapshot.cleanEvictions = 0;
+  snapshot.dirtyEvictions = 0;
+  snapshot.pinWaits = 0;
+  snapshot.readLatency.clear();
+  snapshot.writeLatency.clear();
+  snapshot.sweepLength.clear();
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    Slot& s = slots[i];
+    {
+      std::lock_guard<std::mutex> lock(s.filesLatch);
+      for (std::unordered_map<const File*, FileEntry>::const_iterator it =
+               s.files.begin();
+           it != s.files.end(); ++it) {
+        FileAccessCounts& counts = snapshot.files[it->second.name];
+        counts.hits += it->second.counts.hits;
+        counts.misses += it->second.counts.misses;
+      }
+    }
+    snapshot.cleanEvictions += s.cleanEvictions.load();
+    snapshot.dirtyEvictions += s.dirtyEvictions.load();
+    snapshot.pinWaits += s.pinWaits.load();
+    snapshot.readLatency.merge(s.readLatency);
+    snapshot.writeLatency.merge(s.writeLatency);
+    snapshot.sweepLength.merge(s.sweepLength);
+  }
+}
+
+void BufTelemetry::clear() {
+  for (int i = 0; i < NUM_SLOTS; i++) {
+    Slot& s = slots[i];
+    {
+      std::lock_guard<std::mutex> lock(s.filesLatch);
+      s.files.clear();
+    }
+    s.cleanEvictions = 0;
+    s.dirtyEvictions = 0;
+    s.pinWaits = 0;
+    s.readLatency.clear();
+    s.writeLatency.clear();
+    s.sweepLength.clear();
+  }
+}
+
+void BufTelemetry::writePrometheus(std::ostream& out,
+                                   const BufTelemetrySnapshot& snapshot,
+                                   const std::string& prefix) {
+  out << "# HELP " << prefix << "file_hits_total Pages of a file found in "
+      << "the buffer pool\n";
+  out << "# TYPE " << prefix << "file_hits_total counter\n";
+  for (std::map<std::string, FileAccessCounts>::const_iterator it =
+           snapshot.files.begin();
+       it != snapshot.files.end(); ++it) {
+    out << prefix << "file_hits_total{file=\"" << labelValue(it->first)
+        << "\"} " << it->second.hits << "\n";
+  }
+  out << "# HELP " << prefix << "file_misses_total Pages of a file read "
+      << "into the buffer pool\n";
+  out << "# TYPE " << prefix << "file_misses_total counter\n";
+  for (std::map<std::string, FileAccessCounts>::const_iterator it =
+           snapshot.files.begin();
+       it != snapshot.files.end(); ++it) {
+    out << prefix << "file_misses_total{file=\"" << labelValue(it->first)
+        << "\"} " << it->second.misses << "\n";
+  }
+
+  out << "# HELP " << prefix << "evictions_total Frames given up, by whether "
+      << "their page was dirty\n";
+  out << "# TYPE " << prefix << "evictions_total counter\n";
+  out << prefix << "evictions_total{page=\"clean\"} " << snapshot.cleanEvictions
+      << "\n";
+  out << prefix << "evictions_total{page=\"dirty\"} " << snapshot.dirtyEvictions
+      << "\n";
+
+  out << "# HELP " << prefix << "pin_waits_total Pins that waited for a page "
+      << "being read or written\n";
+  out << "# TYPE " << prefix << "pin_waits_total counter\n";
+  out << prefix << "pin_waits_total " << snapshot.pinWaits << "\n";
+
+  writeSeconds(out, prefix + "read_seconds", "Time taken by page reads",
+               snapshot.readLatency);
+  writeSeconds(out, prefix + "write_seconds", "Time taken by page writes",
+               snapshot.writeLatency);
+
+  const std::string sweep = prefix + "sweep_frames";
+  out << "# HELP " << sweep << " Frames tried per frame allocated\n";
+  out << "# TYPE " << sweep << " histogram\n";
+  for (std::uint64_t frames = 1; frames <= 1024; frames *= 2) {
+    out << sweep << "_bucket{le=\"" << frames << "\"} "
+        << snapshot.sweepLength.countAtMost(frames) << "\n";
+  }
+  out << sweep << "_bucket{le=\"+Inf\"} " << snapshot.sweepLength.getCount()
+      << "\n";
+  out << sweep << "_sum " << snapshot.sweepLength.getSum() << "\n";
+  out << sweep << "_count " << snapshot.sweepLength.getCount() << "\n";
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,291 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Histogram of non-negative values in the manner of HdrHistogram: every
+ * power of two is split into SUB_BUCKETS buckets of equal width, so any value
+ * is known to within 1/SUB_BUCKETS of itself whatever its size.
+ *
+ * Count is std::uint64_t for a histogram read by one thread, and
+ * std::atomic<std::uint64_t> for one that threads record into at once.
+ */
+template <class Count>
+class BasicHistogram {
+ public:
+  /**
+   * Buckets each power of two is split into
+   */
+  static const int SUB_BUCKETS = 16;
+
+  /**
+   * Values from 2^MAX_EXPONENT up all go into the last bucket
+   */
+  static const int MAX_EXPONENT = 40;
+
+  /**
+   * Number of buckets. Values below SUB_BUCKETS have a bucket each.
+   */
+  static const int NUM_BUCKETS = (MAX_EXPONENT - 3) * SUB_BUCKETS;
+
+  BasicHistogram() { clear(); }
+
+  /**
+   * Returns the bucket of value.
+   */
+  static int bucketOf(const std::uint64_t value) {
+    if (value < (std::uint64_t)SUB_BUCKETS) return (int)value;
+    const int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) return NUM_BUCKETS - 1;
+    const int sub = (int)(value >> (exponent - 4)) & (SUB_BUCKETS - 1);
+    return (exponent - 3) * SUB_BUCKETS + sub;
+  }
+
+  /**
+   * Returns the largest value that goes into bucket.
+   */
+  static std::uint64_t bucketLimit(const int bucket) {
+    if (bucket < SUB_BUCKETS) return (std::uint64_t)bucket;
+    if (bucket == NUM_BUCKETS - 1) return UINT64_MAX;
+    const int exponent = bucket / SUB_BUCKETS + 3;
+    const std::uint64_t sub = (std::uint64_t)(bucket % SUB_BUCKETS);
+    return ((SUB_BUCKETS + sub + 1) << (exponent - 4)) - 1;
+  }
+
+  /**
+   * Records count occurrences of value.
+   */
+  void record(const std::uint64_t value, const std::uint64_t count = 1) {
+    counts[bucketOf(value)] += count;
+    total += count;
+    sum += value * count;
+  }
+
+  /**
+   * Adds the values recorded in other.
+   */
+  template <class OtherCount>
+  void merge(const BasicHistogram<OtherCount>& other) {
+    for (int b = 0; b < NUM_BUCKETS; b++) counts[b] += other.bucketCount(b);
+    total += other.getCount();
+    sum += other.getSum();
+  }
+
+  void clear() {
+    for (int b = 0; b < NUM_BUCKETS; b++) counts[b] = 0;
+    total = 0;
+    sum = 0;
+  }
+
+  /**
+   * Returns the number of values recorded in bucket.
+   */
+  std::uint64_t bucketCount(const int bucket) const { return counts[bucket]; }
+
+  /**
+   * Returns the number of values recorded, and their sum.
+   */
+  std::uint64_t getCount() const { return total; }
+  std::uint64_t getSum() const { return sum; }
+
+  /**
+   * Returns the number of values recorded in the buckets up to the one of
+   * value, so values a little above value may be counted too.
+   */
+  std::uint64_t countAtMost(const std::uint64_t value) const {
+    std::uint64_t count = 0;
+    for (int b = 0; b <= bucketOf(value); b++) count += counts[b];
+    return count;
+  }
+
+  /**
+   * Returns a value that fraction of the values recorded are at most: the
+   * limit of the bucket the value of that rank is in. 0 if nothing has been
+   * recorded.
+   *
+   * @param fraction  Rank of the value, from 0 to 1
+   */
+  std::uint64_t percentile(const double fraction) const {
+    const std::uint64_t n = total;
+    if (n == 0) return 0;
+    std::uint64_t rank = (std::uint64_t)(fraction * n + 0.5);
+    if (rank < 1) rank = 1;
+    std::uint64_t count = 0;
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+      count += counts[b];
+      if (count >= rank) return bucketLimit(b);
+    }
+    return bucketLimit(NUM_BUCKETS - 1);
+  }
+
+ private:
+  Count counts[NUM_BUCKETS];
+  Count total;
+  Count sum;
+};
+
+typedef BasicHistogram<std::uint64_t> Histogram;
+typedef BasicHistogram<std::atomic<std::uint64_t> > ConcurrentHistogram;
+
+/**
+ * @brief Pages of one file found in the buffer pool and read in by readPage().
+ */
+struct FileAccessCounts {
+  std::uint64_t hits;
+  std::uint64_t misses;
+};
+
+/**
+ * @brief Totals of a BufTelemetry at one point in time.
+ */
+struct BufTelemetrySnapshot {
+  /**
+   * Hits and misses of each file, by file name
+   */
+  std::map<std::string, FileAccessCounts> files;
+
+  /**
+   * Frames given up that held a clean and a dirty page
+   */
+  std::uint64_t cleanEvictions;
+  std::uint64_t dirtyEvictions;
+
+  /**
+   * Times a thread pinned a page still being read in or written back and had
+   * to wait for it
+   */
+  std::uint64_t pinWaits;
+
+  /**
+   * Nanoseconds taken by page reads and page writes
+   */
+  Histogram readLatency;
+  Histogram writeLatency;
+
+  /**
+   * Frames the replacement policy suggested per frame allocated
+   */
+  Histogram sweepLength;
+};
+
+/**
+ * @brief Counters and histograms of the work of a buffer manager.
+ *
+ * Threads record into one of NUM_SLOTS slots, each thread always into the
+ * same one, so that threads rarely share the cache lines they write, and a
+ * snapshot adds the slots up. Files are told apart by their File object and
+ * reported by name.
+ */
+class BufTelemetry {
+ public:
+  BufTelemetry();
+
+  /**
+   * Counts a page of file read through readPage(), found in the buffer pool
+   * if hit is set.
+   */
+  void countAccess(const File* file, const bool hit);
+
+  /**
+   * Counts a frame given up, that held a dirty page if dirty is set.
+   */
+  void countEviction(const bool dirty);
+
+  /**
+   * Counts a wait for a page being read in or written back.
+   */
+  void countPinWait();
+
+  /**
+   * Records how long a page read and a page write took.
+   */
+  void recordRead(const std::uint64_t nanos);
+  void recordWrite(const std::uint64_t nanos);
+
+  /**
+   * Records the number of frames tried to allocate one.
+   */
+  void recordSweep(const std::uint64_t frames);
+
+  /**
+   * Adds up the slots.
+   *
+   * @param snapshot  Totals, replaced via this reference
+   */
+  void snapshot(BufTelemetrySnapshot& snapshot) const;
+
+  /**
+   * Zeroes every counter and histogram.
+   */
+  void clear();
+
+  /**
+   * Writes a snapshot in the Prometheus text exposition format, each metric
+   * name starting with prefix. Latencies are given in seconds, with a bucket
+   * for every power of two nanoseconds from 1us to 16s.
+   *
+   * @param out       Stream written to
+   * @param snapshot  Totals to write
+   * @param prefix    Start of the metric names, such as "badgerdb_buffer_"
+   */
+  static void writePrometheus(std::ostream& out,
+                              const BufTelemetrySnapshot& snapshot,
+                              const std::string& prefix);
+
+ private:
+  /**
+   * Number of slots
+   */
+  static const int NUM_SLOTS = 16;
+
+  /**
+   * Hits and misses of a file, and its name
+   */
+  struct FileEntry {
+    std::string name;
+    FileAccessCounts counts;
+  };
+
+  /**
+   * Counters of the threads recording into one slot. The histograms make a
+   * slot span hundreds of cache lines, so slots hardly share any.
+   */
+  struct Slot {
+    std::mutex filesLatch;
+    std::unordered_map<const File*, FileEntry> files;
+    std::atomic<std::uint64_t> cleanEvictions;
+    std::atomic<std::uint64_t> dirtyEvictions;
+    std::atomic<std::uint64_t> pinWaits;
+    ConcurrentHistogram readLatency;
+    ConcurrentHistogram writeLatency;
+    ConcurrentHistogram sweepLength;
+  };
+
+  /**
+   * Returns the slot of the calling thread.
+   */
+  Slot& slot();
+
+  std::unique_ptr<Slot[]> slots;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,95 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define BADGERDB_CRC32C_X86
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Bit reversed Castagnoli polynomial.
+ */
+const std::uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+/**
+ * Table of the checksum of every byte value, filled in on first use.
+ */
+struct Crc32cTable {
+  std::uint32_t entries[256];
+  Crc32cTable() {
+    for (std::uint32_t i = 0; i < 256; i++) {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLYNOMIAL : 0);
+      }
+      entries[i] = crc;
+    }
+  }
+};
+
+#ifdef BADGERDB_CRC32C_X86
+
+/**
+ * crc32c() with the SSE 4.2 instruction, 8 bytes at a time. Compiled for SSE
+ * 4.2 regardless of the target flags and only called when the CPU has it.
+ */
+__attribute__((target("sse4.2"))) std::uint32_t crc32cSse42(
+    const std::uint32_t crc, const void *data, const std::size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  std::uint64_t value = ~crc;
+  std::size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    value = _mm_crc32_u64(value, word);
+  }
+  std::uint32_t tail = (std::uint32_t)value;
+  for (; i < size; i++) tail = _mm_crc32_u8(tail, bytes[i]);
+  return ~tail;
+}
+
+/**
+ * Returns true if the CPU supports SSE 4.2. Detected once per process.
+ */
+bool crc32cHasSse42() {
+  static const bool hasSse42 = __builtin_cpu_supports("sse4.2");
+  return hasSse42;
+}
+
+#endif  // BADGERDB_CRC32C_X86
+
+}  // namespace
+
+std::uint32_t crc32cSoftware(const std::uint32_t crc, const void *data,
+                             const std::size_t size) {
+  static const Crc32cTable table;
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  std::uint32_t value = ~crc;
+  for (std::size_t i = 0; i < size; i++) {
+    value = (value >> 8) ^ table.entries[(value ^ bytes[i]) & 0xff];
+  }
+  return ~value;
+}
+
+std::uint32_t crc32c(const std::uint32_t crc, const void *data,
+                     const std::size_t size) {
+#ifdef BADGERDB_CRC32C_X86
+  if (crc32cHasSse42()) return crc32cSse42(crc, data, size);
+#endif
+  return crc32cSoftware(crc, data, size);
+}
+
+}  // namespace badgerdb
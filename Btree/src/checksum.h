@@ -0,0 +1,35 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * Extends a CRC32C (Castagnoli) checksum over size bytes at data, using the
+ * crc32 instruction of SSE 4.2 if the CPU has it. Start with crc 0 and feed
+ * every range through in order.
+ *
+ * @param crc   Checksum of the bytes before data
+ * @param data  Bytes to add
+ * @param size  Number of bytes to add
+ * @return  Checksum including the bytes
+ */
+std::uint32_t crc32c(const std::uint32_t crc, const void *data,
+                     const std::size_t size);
+
+/**
+ * Same as crc32c(), computed a byte at a time from a table.
+ */
+std::uint32_t crc32cSoftware(const std::uint32_t crc, const void *data,
+                             const std::size_t size);
+
+}  // namespace badgerdb
@@ -0,0 +1,194 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "compression.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Shortest match worth a copy, and the longest distance one can reach back.
+ */
+const std::size_t MIN_MATCH = 4;
+const std::size_t MAX_OFFSET = 65535;
+
+/**
+ * The last few bytes of a block are always literals, and the last match ends
+ * before them, as in the LZ4 block format.
+ */
+const std::size_t LAST_LITERALS = 5;
+const std::size_t MATCH_SAFETY = 12;
+
+const int HASH_BITS = 12;
+
+std::uint32_t read32(const std::uint8_t *p) {
+  std::uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+std::uint32_t hashOf(const std::uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+ * Output of the compressor, failing once capacity is reached.
+ */
+class BlockWriter {
+ public:
+  BlockWriter(std::uint8_t *dst, const std::size_t capacity)
+      : out(dst), size(0), capacity(capacity) {}
+
+  /**
+   * Writes the part of a length beyond the 15 that fits in a token.
+   */
+  bool putLength(std::size_t length) {
+    while (length >= 255) {
+      if (!put(255)) return false;
+      length -= 255;
+    }
+    return put((std::uint8_t)length);
+  }
+
+  bool put(const std::uint8_t byte) {
+    if (size == capacity) return false;
+    out[size++] = byte;
+    return true;
+  }
+
+  bool put(const std::uint8_t *bytes, const std::size_t length) {
+    if (capacity - size < length) return false;
+    memcpy(out + size, bytes, length);
+    size += length;
+    return true;
+  }
+
+  /**
+   * Writes one sequence of literals, followed by a match unless it is the
+   * last sequence of the block.
+   */
+  bool putSequence(const std::uint8_t *literals, const std::size_t numLiterals,
+                   const std::size_t offset, const std::size_t matchLength) {
+    const std::size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    const std::uint8_t token =
+        (std::uint8_t)((numLiterals < 15 ? numLiterals : 15) << 4 |
+                       (matchCode < 15 ? matchCode : 15));
+    if (!put(token)) return false;
+    if (numLiterals >= 15 && !putLength(numLiterals - 15)) return false;
+    if (!put(literals, numLiterals)) return false;
+    if (matchLength == 0) return true;
+    if (!put((std::uint8_t)offset) || !put((std::uint8_t)(offset >> 8))) {
+      return false;
+    }
+    return matchCode < 15 || putLength(matchCode - 15);
+  }
+
+  std::uint8_t *out;
+  std::size_t size;
+  std::size_t capacity;
+};
+
+}  // namespace
+
+std::size_t compressBlock(const void *src, const std::size_t size, void *dst,
+                          const std::size_t capacity) {
+  const std::uint8_t *in = static_cast<const std::uint8_t *>(src);
+  BlockWriter writer(static_cast<std::uint8_t *>(dst), capacity);
+
+  std::size_t anchor = 0;
+  if (size > MATCH_SAFETY) {
+    // Positions plus one of the last sequence seen with each hash, 0 for none
+    std::uint32_t table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const std::size_t matchLimit = size - MATCH_SAFETY;
+    const std::size_t matchEnd = size - LAST_LITERALS;
+    std::size_t pos = 0;
+    while (pos < matchLimit) {
+      const std::uint32_t sequence = read32(in + pos);
+      std::uint32_t &slot = table[hashOf(sequence)];
+      const std::size_t candidate = slot;
+      slot = (std::uint32_t)(pos + 1);
+      if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET ||
+          read32(in + candidate - 1) != sequence) {
+        pos++;
+        continue;
+      }
+
+      const std::size_t ref = candidate - 1;
+      std::size_t length = MIN_MATCH;
+      while (pos + length < matchEnd && in[ref + length] == in[pos + length]) {
+        length++;
+      }
+      if (!writer.putSequence(in + anchor, pos - anchor, pos - ref, length)) {
+        return 0;
+      }
+      pos += length;
+      anchor = pos;
+    }
+  }
+  if (!writer.putSequence(in + anchor, size - anchor, 0, 0)) return 0;
+  return writer.size;
+}
+
+bool decompressBlock(const void *src, const std::size_t srcSize, void *dst,
+                     const std::size_t size) {
+  const std::uint8_t *in = static_cast<const std::uint8_t *>(src);
+  std::uint8_t *out = static_cast<std::uint8_t *>(dst);
+  std::size_t ip = 0;
+  std::size_t op = 0;
+
+  while (ip < srcSize) {
+    const std::uint8_t token = in[ip++];
+
+    std::size_t numLiterals = token >> 4;
+    if (numLiterals == 15) {
+      std::uint8_t byte;
+      do {
+        if (ip == srcSize) return false;
+        byte = in[ip++];
+        numLiterals += byte;
+      } while (byte == 255);
+    }
+    if (srcSize - ip < numLiterals || size - op < numLiterals) return false;
+    memcpy(out + op, in + ip, numLiterals);
+    ip += numLiterals;
+    op += numLiterals;
+
+    // The last sequence has no match
+    if (ip == srcSize) break;
+
+    if (srcSize - ip < 2) return false;
+    const std::size_t offset = in[ip] | (std::size_t)in[ip + 1] << 8;
+    ip += 2;
+    if (offset == 0 || offset > op) return false;
+
+    std::size_t length = (token & 15) + MIN_MATCH;
+    if ((token & 15) == 15) {
+      std::uint8_t byte;
+      do {
+        if (ip == srcSize) return false;
+        byte = in[ip++];
+        length += byte;
+      } while (byte == 255);
+    }
+    if (size - op < length) return false;
+
+    // Matches may overlap the bytes they produce, so copy a byte at a time
+    const std::uint8_t *from = out + op - offset;
+    for (std::size_t i = 0; i < length; i++) out[op + i] = from[i];
+    op += length;
+  }
+  return op == size;
+}
+
+}  // namespace badgerdb
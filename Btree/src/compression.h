@@ -0,0 +1,43 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace badgerdb {
+
+/**
+ * Compresses size bytes at src into dst in the LZ4 block format: runs of
+ * literal bytes, each followed by a copy of earlier output up to 64KB back.
+ * Matches are found greedily through a hash table of 4 byte sequences, which
+ * is quick, and good enough for the zeroed and repetitive parts of pages.
+ *
+ * @param src       Bytes to compress
+ * @param size      Number of bytes to compress
+ * @param dst       Memory to compress into
+ * @param capacity  Number of bytes dst has room for
+ * @return  Number of compressed bytes, or 0 if they do not fit in capacity
+ */
+std::size_t compressBlock(const void *src, const std::size_t size, void *dst,
+                          const std::size_t capacity);
+
+/**
+ * Decompresses a block made by compressBlock() into exactly size bytes.
+ * Malformed blocks are caught instead of writing outside dst.
+ *
+ * @param src         Compressed block
+ * @param srcSize     Number of bytes in the block
+ * @param dst         Memory to decompress into
+ * @param size        Number of bytes the block decompresses to
+ * @return  True if the block decompressed to exactly size bytes
+ */
+bool decompressBlock(const void *src, const std::size_t srcSize, void *dst,
+                     const std::size_t size);
+
+}  // namespace badgerdb
@@ -0,0 +1,23 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "index_read_only_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IndexReadOnlyException::IndexReadOnlyException(const std::string& name)
+    : BadgerDbException("") {
+  std::stringstream ss;
+  ss << "Index is open read-only: " << name;
+  message_.assign(ss.str());
+}
+
+}  // namespace badgerdb
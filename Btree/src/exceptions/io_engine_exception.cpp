@@ -0,0 +1,23 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "io_engine_exception.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IoEngineException::IoEngineException(const int error) : BadgerDbException("") {
+  std::stringstream ss;
+  ss << "Could not set up io_uring: " << strerror(error);
+  message_.assign(ss.str());
+}
+
+}  // namespace badgerdb
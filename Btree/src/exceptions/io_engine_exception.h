@@ -0,0 +1,31 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when the asynchronous I/O engine cannot be
+ * set up.
+ */
+class IoEngineException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an I/O engine exception for the given error number.
+   *
+   * @param error  errno of the system call that failed.
+   */
+  explicit IoEngineException(const int error);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,60 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when reading, writing or syncing a file
+ *        fails, or a read ends before the bytes asked for.
+ */
+class IoErrorException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an I/O error exception for the given file and error number.
+   *
+   * @param name   Name of the file the I/O was on.
+   * @param error  errno of the system call that failed, or 0 if the file
+   *               ended before the bytes read.
+   */
+  IoErrorException(const std::string& name, const int error);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~IoErrorException() throw() {}
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the errno of the failed call, or 0 for a read past the end.
+   */
+  virtual int error() const { return error_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno of the failed call, or 0.
+   */
+  const int error_;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,64 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a page read from disk does not match
+ *        the checksum stored with it.
+ *
+ * This happens if only part of the page made it to disk, e.g. because of a
+ * power loss while it was written, or if the file was damaged since.
+ */
+class PageChecksumException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a page checksum exception for the given page number and
+   * filename.
+   *
+   * @param page_number  Number of the damaged page.
+   * @param file         Name of the file the page was read from.
+   */
+  PageChecksumException(const PageId page_number, const std::string& file);
+
+  /**
+   * Destroys the exception.  Does nothing special; just included to make the
+   * compiler happy.
+   */
+  virtual ~PageChecksumException() throw() {}
+
+  /**
+   * Returns the number of the damaged page.
+   */
+  virtual PageId page_number() const { return page_number_; }
+
+  /**
+   * Returns name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+ protected:
+  /**
+   * Number of the damaged page.
+   */
+  const PageId page_number_;
+
+  /**
+   * Name of file which caused this exception.
+   */
+  const std::string filename_;
+};
+
+}  // namespace badgerdb
@@ -8,24 +8,69 @@
 
 #include "file.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
-#include <fstream>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <new>
 #include <string>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_error_exception.h"
+#include "exceptions/page_checksum_exception.h"
+#include "checksum.h"
+#include "compression.h"
 #include "file_iterator.h"
+#include "io_engine.h"
 #include "page.h"
+#include "trace.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
-File::CountMap File::open_counts_;
+// Pages are read and written whole, header and data in one go
+static_assert(sizeof(Page) == Page::SIZE, "Page must not be padded.");
+static_assert(Page::SIZE % File::DIRECT_ALIGNMENT == 0,
+              "Pages must start on O_DIRECT boundaries.");
+
+const PageId PageFile::SPACE_MAP_ENTRIES;
+const std::size_t PageFile::SPACE_MAP_GRANULE;
+const std::size_t BlobFile::SECTOR_SIZE;
+const std::uint32_t BlobFile::MAX_EXTENT_SECTORS;
+const std::size_t BlobFile::FREE_LISTS_OFFSET;
+const std::size_t BlobFile::DIRECTORY_OFFSET;
+const PageId BlobFile::EXTENTS_PER_TABLE;
+const std::size_t BlobFile::DIRECTORY_SIZE;
+
+std::vector<File::OpenFile> File::open_files_;
+std::vector<FileId> File::free_ids_;
+std::unordered_map<std::string, FileId> File::file_ids_;
+IoEngine* File::io_engine_ = NULL;
+bool File::direct_io_ = false;
+bool File::page_checksums_ = false;
+bool File::page_compression_ = false;
+
+void File::setIoEngine(IoEngine* engine) { io_engine_ = engine; }
+
+void File::setDirectIO(const bool enable) { direct_io_ = enable; }
+
+void File::setPageChecksums(const bool enable) { page_checksums_ = enable; }
+
+void File::setPageCompression(const bool enable) {
+  page_compression_ = enable;
+}
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -41,88 +86,234 @@ bool File::isOpen(const std::string& filename) {
   if (!exists(filename)) {
     return false;
   }
-  return open_counts_.find(filename) != open_counts_.end();
+  return file_ids_.find(filename) != file_ids_.end();
 }
 
 bool File::exists(const std::string& filename) {
-  std::fstream file(filename);
-  if (file) {
-    file.close();
-    return true;
-  }
+  struct stat status;
+  return ::stat(filename.c_str(), &status) == 0 && S_ISREG(status.st_mode);
+}
 
-  return false;
+void File::syncFile(const std::string& filename) {
+  const std::unordered_map<std::string, FileId>::const_iterator found =
+      file_ids_.find(filename);
+  if (found != file_ids_.end()) {
+    if (::fdatasync(open_files_[found->second].fd) != 0) {
+      throw IoErrorException(filename, errno);
+    }
+    return;
+  }
+  const int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  const int result = ::fdatasync(fd);
+  const int error = errno;
+  ::close(fd);
+  if (result != 0) throw IoErrorException(filename, error);
 }
 
 File::~File() { close(); }
 
+void File::sync() {
+  if (::fdatasync(fd_) != 0) throw IoErrorException(filename_, errno);
+}
+
 PageId File::getFirstPageNo() {
   const FileHeader& header = readHeader();
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+PageId File::getNumPages() const { return readHeader().num_pages; }
+
+File::File(const std::string& name, const bool create_new)
+    : filename_(name),
+      fd_(-1),
+      id_(0),
+      direct_(false),
+      checksums_(false),
+      compressed_(false) {
   openIfNeeded(create_new);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */,
+                         page_checksums_ ? 1u : 0u /* page_checksums */,
+                         0 /* page_compression */, 0 /* extent_end */};
     writeHeader(header);
   }
+  const FileHeader header = readHeader();
+  checksums_ = header.page_checksums != 0;
+  compressed_ = header.page_compression != 0;
 }
 
 void File::openIfNeeded(const bool create_new) {
-  if (open_counts_.find(filename_) !=
-      open_counts_.end()) {  // exists an entry already
-    ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
-  } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
-    const bool already_exists = exists(filename_);
-    if (create_new) {
-      // Error if we try to overwrite an existing file.
-      if (already_exists) {
-        throw FileExistsException(filename_);
-      }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
-    } else {
-      // Error if we try to open a file that doesn't exist.
-      if (!already_exists) {
-        throw FileNotFoundException(filename_);
-      }
+  const std::unordered_map<std::string, FileId>::const_iterator found =
+      file_ids_.find(filename_);
+  if (found != file_ids_.end()) {  // exists an entry already
+    id_ = found->second;
+    OpenFile& entry = open_files_[id_];
+    ++entry.count;
+    fd_ = entry.fd;
+    direct_ = entry.direct;
+    return;
+  }
+
+  // Error if we try to overwrite an existing file or open one that doesn't
+  // exist. The open itself tells, rather than a separate probe.
+  const int flags = O_RDWR | (create_new ? O_CREAT | O_EXCL : 0);
+  direct_ = direct_io_;
+  fd_ = ::open(filename_.c_str(), flags | (direct_ ? O_DIRECT : 0), 0666);
+  if (fd_ < 0 && direct_ && errno == EINVAL) {
+    // The file system does not support O_DIRECT, so use the page cache. The
+    // failed open may have created the file already.
+    direct_ = false;
+    fd_ = ::open(filename_.c_str(), flags & ~O_EXCL, 0666);
+  }
+  if (fd_ < 0) {
+    if (create_new && errno == EEXIST) {
+      throw FileExistsException(filename_);
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
-    open_counts_[filename_] = 1;
+    throw FileNotFoundException(filename_);
   }
+
+  if (free_ids_.empty()) {
+    id_ = (FileId)open_files_.size();
+    open_files_.push_back(OpenFile());
+  } else {
+    id_ = free_ids_.back();
+    free_ids_.pop_back();
+  }
+  OpenFile& entry = open_files_[id_];
+  entry.fd = fd_;
+  entry.count = 1;
+  entry.direct = direct_;
+  file_ids_[filename_] = id_;
 }
 
 void File::close() {
-  if (open_counts_[filename_] > 0) --open_counts_[filename_];
+  if (fd_ < 0) return;
+  fd_ = -1;
+
+  OpenFile& entry = open_files_[id_];
+  assert(entry.count > 0);
+  if (--entry.count == 0) {
+    ::close(entry.fd);
+    entry.fd = -1;
+    free_ids_.push_back(id_);
+    file_ids_.erase(filename_);
+  }
+}
+
+/**
+ * Returns true if O_DIRECT can take a transfer of size bytes at offset to or
+ * from buffer as it is.
+ */
+static bool isDirectAligned(const off_t offset, const void* buffer,
+                            const std::size_t size) {
+  const std::size_t mask = File::DIRECT_ALIGNMENT - 1;
+  return ((offset | size | reinterpret_cast<std::uintptr_t>(buffer)) & mask) == 0;
+}
+
+const Page* File::mapPages(std::size_t& num_pages) const {
+  if (compressed_) return NULL;
+  struct stat status;
+  if (fstat(fd_, &status) != 0) return NULL;
+
+  // The header page may be cut short when no page follows it
+  num_pages = (status.st_size + Page::SIZE - 1) / Page::SIZE;
+  if (num_pages == 0) return NULL;
+  void* map = mmap(NULL, num_pages * Page::SIZE, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) return NULL;
+  return static_cast<const Page*>(map);
+}
 
-  stream_.reset();
-  assert(open_counts_[filename_] >= 0);
+void File::unmapPages(const Page* pages, const std::size_t num_pages) {
+  munmap(const_cast<Page*>(pages), num_pages * Page::SIZE);
+}
+
+void File::readAt(const off_t offset, void* buffer,
+                  const std::size_t size) const {
+  if (direct_ && !isDirectAligned(offset, buffer, size)) {
+    directTransfer(offset, buffer, size, false);
+    return;
+  }
+  if (transfer(offset, buffer, size, false) < size) {
+    throw IoErrorException(filename_, 0);
+  }
+}
+
+void File::writeAt(const off_t offset, const void* buffer,
+                   const std::size_t size) {
+  if (direct_ && !isDirectAligned(offset, buffer, size)) {
+    directTransfer(offset, const_cast<void*>(buffer), size, true);
+    return;
+  }
+  transfer(offset, const_cast<void*>(buffer), size, true);
+}
+
+void File::directTransfer(const off_t offset, void* buffer,
+                          const std::size_t size, const bool write) const {
+  const off_t mask = DIRECT_ALIGNMENT - 1;
+  const off_t start = offset & ~mask;
+  const std::size_t length = ((offset + size + mask) & ~mask) - start;
+  void* block;
+  if (posix_memalign(&block, DIRECT_ALIGNMENT, length) != 0) {
+    throw std::bad_alloc();
+  }
+  std::unique_ptr<char, void (*)(void*)> bytes(static_cast<char*>(block),
+                                               free);
+
+  // Only keep what is on disk around the range if the range is not made up of
+  // whole blocks. The blocks may run past the end of the file, the range read
+  // may not.
+  if (!write || start != offset || length != size) {
+    const std::size_t done = transfer(start, bytes.get(), length, false);
+    if (!write && done < (offset - start) + size) {
+      throw IoErrorException(filename_, 0);
+    }
+    memset(bytes.get() + done, 0, length - done);
+  }
+  if (write) {
+    memcpy(bytes.get() + (offset - start), buffer, size);
+    transfer(start, bytes.get(), length, true);
+  } else {
+    memcpy(buffer, bytes.get() + (offset - start), size);
+  }
+}
 
-  if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
-    open_counts_.erase(filename_);
+std::size_t File::transfer(const off_t offset, void* buffer,
+                           const std::size_t size, const bool write) const {
+  char* bytes = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < size) {
+    ssize_t n;
+    if (io_engine_ != NULL) {
+      n = write ? io_engine_->write(fd_, bytes + done, size - done, offset + done)
+                : io_engine_->read(fd_, bytes + done, size - done, offset + done);
+    } else {
+      n = write ? ::pwrite(fd_, bytes + done, size - done, offset + done)
+                : ::pread(fd_, bytes + done, size - done, offset + done);
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw IoErrorException(filename_, errno);
+    if (n == 0) {
+      if (write) throw IoErrorException(filename_, EIO);
+      break;  // End of file
+    }
+    done += n;
   }
+  return done;
 }
 
 FileHeader File::readHeader() const {
   FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+  readAt(0 /* pos */, &header, sizeof(FileHeader));
   return header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  writeAt(0 /* pos */, &header, sizeof(FileHeader));
 }
 
 PageFile PageFile::create(const std::string& filename) {
@@ -147,97 +338,89 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
   close();  // close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
+  checksums_ = rhs.checksums_;
+  compressed_ = rhs.compressed_;
   return *this;
 }
 
 Page PageFile::allocatePage(PageId& new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePage(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePage(PageId& new_page_number, Page& new_page) {
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    readPage(header.first_free_page, true /* allow_free */, new_page);
     new_page.set_page_number(header.first_free_page);
-    new_page_number = new_page.page_number();
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   } else {
-    new_page.set_page_number(header.num_pages);
-    new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER) {
-      header.first_used_page = new_page.page_number();
-    } else {
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+    // The free space map grows with the file, one map page at a time.
+    if (isSpaceMapPage(header.num_pages)) {
+      Page map_page;
+      writePage(header.num_pages, map_page.header_, map_page);
+      ++header.num_pages;
     }
+    new_page.initialize();
+    new_page.set_page_number(header.num_pages);
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_,
-              existing_page);
+  new_page_number = new_page.page_number();
+
+  // Pages past the tail of the used list, like all new pages, are appended to
+  // it. Others are linked in after the used page before them.
+  const PageId previous_page_number =
+      new_page_number > header.last_used_page
+          ? header.last_used_page
+          : previousUsedPage(new_page_number);
+  if (previous_page_number == Page::INVALID_NUMBER) {
+    new_page.set_next_page_number(header.first_used_page);
+    header.first_used_page = new_page_number;
+  } else {
+    PageHeader previous_header = readPageHeader(previous_page_number);
+    new_page.set_next_page_number(previous_header.next_page_number);
+    previous_header.next_page_number = new_page_number;
+    writePageHeader(previous_page_number, previous_header);
+  }
+  if (new_page.next_page_number() == Page::INVALID_NUMBER) {
+    header.last_used_page = new_page_number;
   }
-  writeHeader(header);
 
-  return new_page;
+  writePage(new_page_number, new_page.header_, new_page);
+  writeSpaceMapEntry(new_page_number, spaceMapEntry(new_page.header_));
+  writeHeader(header);
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void PageFile::readPage(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
 
   if (page_number >= header.num_pages) {
     throw InvalidPageException(page_number, filename_);
   }
-  return readPage(page_number, false /* allow_free */);
+  readPage(page_number, false /* allow_free */, page);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+void PageFile::readPage(const PageId page_number, const bool allow_free,
+                        Page& page) const {
+  readAt(pagePosition(page_number), &page, Page::SIZE);
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
+  if (checksums_ && page.isUsed() &&
+      page.header_.checksum != pageChecksum(page.header_, page)) {
+    throw PageChecksumException(page_number, filename_);
+  }
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
@@ -249,42 +432,128 @@ void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
   // Page on disk may have had its next page pointer updated since it was read;
   // we don't modify that, but we do keep all the other modifications to the
   // page header.
+  const std::uint8_t old_entry = spaceMapEntry(header);
   const PageId next_page_number = header.next_page_number;
   header = new_page.header_;
   header.next_page_number = next_page_number;
   writePage(new_page_number, header, new_page);
+
+  // The map only changes when the page's free space moves to another step
+  const std::uint8_t entry = spaceMapEntry(header);
+  if (entry != old_entry) writeSpaceMapEntry(new_page_number, entry);
 }
 
 void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
+  // Unlink the page from the used page before it, or from the header if it is
+  // the head of the used list.
+  const PageId previous_page_number = previousUsedPage(page_number);
+  if (previous_page_number == Page::INVALID_NUMBER) {
     header.first_used_page = existing_page.next_page_number();
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    PageHeader previous_header = readPageHeader(previous_page_number);
+    previous_header.next_page_number = existing_page.next_page_number();
+    writePageHeader(previous_page_number, previous_header);
+  }
+  if (header.last_used_page == page_number) {
+    header.last_used_page = previous_page_number;
   }
+
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_,
-              previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
+  writeSpaceMapEntry(page_number, 0);
+  writeHeader(header);
+}
+
+PageId PageFile::appendPages(Page* pages, const PageId count) {
+  if (count == 0) return Page::INVALID_NUMBER;
+  FileHeader header = readHeader();
+
+  // Number the pages from the end of the file on, stepping over map pages
+  PageId page_number = header.num_pages;
+  for (PageId i = 0; i < count; i++) {
+    if (isSpaceMapPage(page_number)) ++page_number;
+    pages[i].set_page_number(page_number++);
+  }
+  for (PageId i = 0; i < count; i++) {
+    pages[i].set_next_page_number(i + 1 < count ? pages[i + 1].page_number()
+                                                : Page::INVALID_NUMBER);
+    if (checksums_) {
+      pages[i].header_.checksum = pageChecksum(pages[i].header_, pages[i]);
+    }
+  }
+
+  // One run per map page the pages are described by
+  PageId i = 0;
+  while (i < count) {
+    const PageId first = pages[i].page_number();
+    const PageId map_page = first - (first - 1) % (SPACE_MAP_ENTRIES + 1);
+    const PageId run =
+        std::min(count - i, map_page + SPACE_MAP_ENTRIES + 1 - first);
+    writeAt(pagePosition(first), &pages[i], (std::size_t)run * Page::SIZE);
+
+    if (map_page >= header.num_pages) {
+      // The map page is new as well, and written with the entries in it
+      Page map;
+      for (PageId j = 0; j < run; j++) {
+        map.data_[first + j - map_page - 1] =
+            (char)spaceMapEntry(pages[i + j].header_);
+      }
+      writePage(map_page, map.header_, map);
+    } else {
+      std::uint8_t entries[SPACE_MAP_ENTRIES];
+      for (PageId j = 0; j < run; j++) {
+        entries[j] = spaceMapEntry(pages[i + j].header_);
+      }
+      writeAt(spaceMapPosition(first), entries, run);
+    }
+    i += run;
+  }
+
+  // Link the pages in after the last used page
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = pages[0].page_number();
+  } else {
+    PageHeader last_header = readPageHeader(header.last_used_page);
+    last_header.next_page_number = pages[0].page_number();
+    writePageHeader(header.last_used_page, last_header);
+  }
+  header.last_used_page = pages[count - 1].page_number();
+  header.num_pages = pages[count - 1].page_number() + 1;
   writeHeader(header);
+  return pages[0].page_number();
+}
+
+PageId PageFile::findPageWithSpace(const std::size_t record_size,
+                                   const PageId from) const {
+  // A new slot may be needed as well. Only entries whose step guarantees the
+  // room are taken.
+  const std::size_t needed = record_size + sizeof(PageSlot);
+  const std::size_t steps =
+      (needed + SPACE_MAP_GRANULE - 1) / SPACE_MAP_GRANULE;
+  if (steps >= UINT8_MAX) return Page::INVALID_NUMBER;
+  const std::uint8_t min_entry = (std::uint8_t)(1 + steps);
+
+  const PageId num_pages = readHeader().num_pages;
+  const PageId first = std::max(from, (PageId)2);
+  std::uint8_t entries[SPACE_MAP_ENTRIES];
+  for (PageId map_page = first - (first - 1) % (SPACE_MAP_ENTRIES + 1);
+       map_page < num_pages; map_page += SPACE_MAP_ENTRIES + 1) {
+    const PageId count = std::min(SPACE_MAP_ENTRIES, num_pages - map_page - 1);
+    readAt(pagePosition(map_page) + sizeof(PageHeader), entries, count);
+    for (PageId i = 0; i < count; i++) {
+      if (map_page + 1 + i >= first && entries[i] >= min_entry) {
+        return map_page + 1 + i;
+      }
+    }
+  }
+  return Page::INVALID_NUMBER;
 }
 
 FileIterator PageFile::begin() {
@@ -298,19 +567,95 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                          const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  PageHeader stamped = header;
+  if (checksums_) stamped.checksum = pageChecksum(stamped, new_page);
+
+  if (memcmp(&stamped, &new_page.header_, sizeof(PageHeader)) == 0) {
+    writeAt(pagePosition(page_number), &new_page, Page::SIZE);
+    return;
+  }
+  Page image;
+  memcpy(&image, &new_page, Page::SIZE);
+  image.header_ = stamped;
+  writeAt(pagePosition(page_number), &image, Page::SIZE);
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(pagePosition(page_number), &header, sizeof(PageHeader));
   return header;
 }
 
+void PageFile::getUsedPages(std::vector<PageId>& page_numbers) const {
+  page_numbers.clear();
+  const PageId num_pages = readHeader().num_pages;
+  std::uint8_t entries[SPACE_MAP_ENTRIES];
+  for (PageId map_page = 1; map_page < num_pages;
+       map_page += SPACE_MAP_ENTRIES + 1) {
+    const PageId count = std::min(SPACE_MAP_ENTRIES, num_pages - map_page - 1);
+    readAt(pagePosition(map_page) + sizeof(PageHeader), entries, count);
+    for (PageId i = 0; i < count; i++) {
+      if (entries[i] != 0) page_numbers.push_back(map_page + 1 + i);
+    }
+  }
+}
+
+void PageFile::writePageHeader(const PageId page_number,
+                               const PageHeader& header) {
+  writeAt(pagePosition(page_number), &header, sizeof(PageHeader));
+}
+
+bool PageFile::isSpaceMapPage(const PageId page_number) {
+  return page_number != 0 && (page_number - 1) % (SPACE_MAP_ENTRIES + 1) == 0;
+}
+
+off_t PageFile::spaceMapPosition(const PageId page_number) {
+  const PageId map_page =
+      page_number - (page_number - 1) % (SPACE_MAP_ENTRIES + 1);
+  return pagePosition(map_page) + sizeof(PageHeader) +
+         (page_number - map_page - 1);
+}
+
+std::uint8_t PageFile::spaceMapEntry(const PageHeader& header) {
+  if (header.current_page_number == Page::INVALID_NUMBER) return 0;
+  const std::size_t steps =
+      (header.free_space_upper_bound - header.free_space_lower_bound +
+       header.num_fragmented_bytes) /
+      SPACE_MAP_GRANULE;
+  return (std::uint8_t)(1 + std::min<std::size_t>(steps, UINT8_MAX - 1));
+}
+
+std::uint32_t PageFile::pageChecksum(const PageHeader& header,
+                                     const Page& page) {
+  PageHeader covered = header;
+  covered.next_page_number = Page::INVALID_NUMBER;
+  covered.checksum = 0;
+  const std::uint32_t crc = crc32c(0, &covered, sizeof(covered));
+  return crc32c(crc, page.data_, Page::DATA_SIZE);
+}
+
+void PageFile::writeSpaceMapEntry(const PageId page_number,
+                                  const std::uint8_t entry) {
+  writeAt(spaceMapPosition(page_number), &entry, sizeof(entry));
+}
+
+PageId PageFile::previousUsedPage(const PageId page_number) const {
+  std::uint8_t entries[SPACE_MAP_ENTRIES];
+  PageId page = page_number;
+  while (page > 2) {
+    // Read the entries of the pages from the map page covering page - 1 up to
+    // page - 1, and look for a used one from the back
+    const PageId map_page = (page - 1) - (page - 2) % (SPACE_MAP_ENTRIES + 1);
+    const PageId count = page - 1 - map_page;
+    readAt(pagePosition(map_page) + sizeof(PageHeader), entries, count);
+    for (PageId i = count; i > 0; i--) {
+      if (entries[i - 1] != 0) return map_page + i;
+    }
+    page = map_page;
+  }
+  return Page::INVALID_NUMBER;
+}
+
 BlobFile BlobFile::create(const std::string& filename) {
   return BlobFile(filename, true /* create_new */);
 }
@@ -320,7 +665,19 @@ BlobFile BlobFile::open(const std::string& filename) {
 }
 
 BlobFile::BlobFile(const std::string& name, const bool create_new)
-    : File(name, create_new) {}
+    : File(name, create_new) {
+  if (create_new && page_compression_) {
+    // Extents start after the header page, which holds the free lists and
+    // the directory. The whole page is written so that both read as empty.
+    static const char empty_header[Page::SIZE] = {};
+    FileHeader header = readHeader();
+    writeAt(0, empty_header, Page::SIZE);
+    header.page_compression = 1;
+    header.extent_end = Page::SIZE / SECTOR_SIZE;
+    writeHeader(header);
+    compressed_ = true;
+  }
+}
 
 BlobFile::~BlobFile() {}
 
@@ -333,12 +690,20 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   close();  // close my file and associate me with the new one
   filename_ = rhs.filename_;
   openIfNeeded(false /* create_new */);
+  checksums_ = rhs.checksums_;
+  compressed_ = rhs.compressed_;
   return *this;
 }
 
 Page BlobFile::allocatePage(PageId& new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
+  allocatePage(new_page_number, new_page);
+  return new_page;
+}
+
+void BlobFile::allocatePage(PageId& new_page_number, Page& new_page) {
+  FileHeader header = readHeader();
+  new_page.initialize();
 
   new_page_number = header.num_pages;
 
@@ -348,23 +713,32 @@ Page BlobFile::allocatePage(PageId& new_page_number) {
 
   ++header.num_pages;
 
-  writePage(new_page_number, new_page);
+  // Writing a compressed page may allocate sectors, which updates the header
   writeHeader(header);
-
-  return new_page;
+  writePage(new_page_number, new_page);
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+  readPage(page_number, page);
   return page;
 }
 
+void BlobFile::readPage(const PageId page_number, Page& page) const {
+  if (compressed_) {
+    readCompressedPage(page_number, page);
+    return;
+  }
+  readAt(pagePosition(page_number), &page, Page::SIZE);
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-  stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-  stream_->flush();
+  BADGERDB_TRACE(TRACE_BLOB_WRITE, new_page_number, compressed_);
+  if (compressed_) {
+    writeCompressedPage(new_page_number, new_page);
+    return;
+  }
+  writeAt(pagePosition(new_page_number), &new_page, Page::SIZE);
 }
 
 // delePage should not be called for a blob_file, not supported
@@ -372,4 +746,115 @@ void BlobFile::deletePage(const PageId page_number) {
   throw InvalidPageException(page_number, filename_);
 }
 
+off_t BlobFile::directoryPosition(const PageId page_number) const {
+  const PageId table = page_number / EXTENTS_PER_TABLE;
+  if (table >= DIRECTORY_SIZE) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return DIRECTORY_OFFSET + (off_t)table * sizeof(std::uint32_t);
+}
+
+off_t BlobFile::extentPosition(const PageId page_number) const {
+  std::uint32_t table_sector;
+  readAt(directoryPosition(page_number), &table_sector, sizeof(table_sector));
+  if (table_sector == 0) return -1;
+  return (off_t)table_sector * SECTOR_SIZE +
+         (page_number % EXTENTS_PER_TABLE) * sizeof(PageExtent);
+}
+
+std::uint32_t BlobFile::allocateExtent(const std::uint32_t count) {
+  const off_t head_position =
+      FREE_LISTS_OFFSET + (off_t)count * sizeof(std::uint32_t);
+  std::uint32_t head;
+  readAt(head_position, &head, sizeof(head));
+  if (head != 0) {
+    std::uint32_t next;
+    readAt((off_t)head * SECTOR_SIZE, &next, sizeof(next));
+    writeAt(head_position, &next, sizeof(next));
+    return head;
+  }
+
+  FileHeader header = readHeader();
+  const std::uint32_t first = header.extent_end;
+  header.extent_end += count;
+  writeHeader(header);
+  return first;
+}
+
+void BlobFile::freeExtent(const std::uint32_t sector,
+                          const std::uint32_t count) {
+  const off_t head_position =
+      FREE_LISTS_OFFSET + (off_t)count * sizeof(std::uint32_t);
+  std::uint32_t head;
+  readAt(head_position, &head, sizeof(head));
+  writeAt((off_t)sector * SECTOR_SIZE, &head, sizeof(head));
+  writeAt(head_position, &sector, sizeof(sector));
+}
+
+void BlobFile::readCompressedPage(const PageId page_number, Page& page) const {
+  PageExtent extent = {0, 0, 0};
+  const off_t position = extentPosition(page_number);
+  if (position >= 0) readAt(position, &extent, sizeof(extent));
+
+  // Pages never written read as zeros
+  if (extent.sector == 0) {
+    memset(reinterpret_cast<char*>(&page), 0, Page::SIZE);
+    return;
+  }
+  const off_t offset = (off_t)extent.sector * SECTOR_SIZE;
+  if (extent.length == Page::SIZE) {
+    readAt(offset, &page, Page::SIZE);
+    return;
+  }
+  char compressed[Page::SIZE];
+  readAt(offset, compressed, extent.length);
+  if (!decompressBlock(compressed, extent.length, &page, Page::SIZE)) {
+    throw InvalidPageException(page_number, filename_);
+  }
+}
+
+void BlobFile::writeCompressedPage(const PageId page_number,
+                                   const Page& new_page) {
+  // Pages are only kept compressed if that saves at least a sector
+  char compressed[Page::SIZE];
+  std::size_t length = compressBlock(&new_page, Page::SIZE, compressed,
+                                     Page::SIZE - SECTOR_SIZE);
+  const void* data = compressed;
+  if (length == 0) {
+    length = Page::SIZE;
+    data = &new_page;
+  }
+  const std::uint32_t needed =
+      (std::uint32_t)((length + SECTOR_SIZE - 1) / SECTOR_SIZE);
+
+  off_t position = extentPosition(page_number);
+  if (position < 0) {
+    static const char empty_table[Page::SIZE] = {};
+    const std::uint32_t table_sector = allocateExtent(MAX_EXTENT_SECTORS);
+    writeAt((off_t)table_sector * SECTOR_SIZE, empty_table, Page::SIZE);
+    writeAt(directoryPosition(page_number), &table_sector,
+            sizeof(table_sector));
+    position = extentPosition(page_number);
+  }
+
+  PageExtent extent;
+  readAt(position, &extent, sizeof(extent));
+  const PageExtent old_extent = extent;
+  const bool moved = extent.sector == 0 || extent.sectors < needed ||
+                     extent.sectors > 2 * needed;
+  if (moved) {
+    extent.sector = allocateExtent(needed);
+    extent.sectors = (std::uint16_t)needed;
+  }
+  extent.length = (std::uint16_t)length;
+
+  // The entry only points at the extent once the page is in it, and the old
+  // extent is only given up after that
+  writeAt((off_t)extent.sector * SECTOR_SIZE, data, length);
+  writeAt(position, &extent, sizeof(extent));
+  if (moved && old_extent.sector != 0) {
+    freeExtent(old_extent.sector, old_extent.sectors);
+  }
+}
+
 }  // namespace badgerdb
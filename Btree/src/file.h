@@ -8,16 +8,19 @@
 
 #pragma once
 
-#include <fstream>
-#include <map>
-#include <memory>
+#include <sys/types.h>
+
+#include <cstddef>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "page.h"
 
 namespace badgerdb {
 
 class FileIterator;
+class IoEngine;
 
 /**
  * @brief Header metadata for files on disk which contain pages.
@@ -43,6 +46,26 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file.
+   */
+  PageId last_used_page;
+
+  /**
+   * Nonzero if the pages of the file carry a checksum.
+   */
+  std::uint32_t page_checksums;
+
+  /**
+   * Nonzero if the pages of the file are stored compressed.
+   */
+  std::uint32_t page_compression;
+
+  /**
+   * First unallocated sector past the extents of a compressed file.
+   */
+  std::uint32_t extent_end;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +75,11 @@ struct FileHeader {
   bool operator==(const FileHeader& rhs) const {
     return num_pages == rhs.num_pages && num_free_pages == rhs.num_free_pages &&
            first_used_page == rhs.first_used_page &&
-           first_free_page == rhs.first_free_page;
+           first_free_page == rhs.first_free_page &&
+           last_used_page == rhs.last_used_page &&
+           page_checksums == rhs.page_checksums &&
+           page_compression == rhs.page_compression &&
+           extent_end == rhs.extent_end;
   }
 };
 
@@ -60,16 +87,27 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor of an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the same
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the
- * File class detects this (by looking in the open_streams_ map) and just
- * returns a file object with the already created stream for the file without
- * actually opening the UNIX file again.
+ * File class detects this (by looking its name up in file_ids_) and just
+ * returns a file object with the already opened descriptor for the file
+ * without actually opening the UNIX file again.
+ *
+ * Every open file has a small integer id, an index into a flat table of open
+ * descriptors that closing goes straight to. Ids are handed out densely and
+ * reused, so the buffer pool can hash pages on (id, page number) rather than
+ * on where File objects happen to live in memory.
  *
- * @warning This class is not threadsafe.
+ * All I/O is positioned (pread/pwrite), so there is no shared seek pointer and
+ * nothing buffered in user space. Pages can be read from several threads at
+ * once; anything that changes the file must still be serialized by the caller.
+ * Optionally, I/O goes through an IoEngine, and files are opened with O_DIRECT
+ * to bypass the OS page cache.
+ *
+ * @warning Opening and closing files is not threadsafe.
  */
 
 class File {
@@ -109,6 +147,69 @@ class File {
    */
   static bool exists(const std::string& filename);
 
+  /**
+   * Makes everything written to a file so far durable, through any of its
+   * descriptors. Files that do not exist are left alone.
+   *
+   * @param filename  Name of the file.
+   * @throws  IoErrorException  If the sync fails.
+   */
+  static void syncFile(const std::string& filename);
+
+  /**
+   * Sends the I/O of all files through engine, or through plain system calls
+   * if engine is NULL. The engine has to outlive its use.
+   *
+   * @param engine  I/O engine to use.
+   */
+  static void setIoEngine(IoEngine* engine);
+
+  /**
+   * Sets whether files opened from now on bypass the OS page cache. Pages
+   * read into or written from memory aligned to DIRECT_ALIGNMENT (like the
+   * buffer pool) go straight to disk, anything else through an aligned copy.
+   *
+   * @param enable  Whether to open files with O_DIRECT.
+   */
+  static void setDirectIO(const bool enable);
+
+  /**
+   * Sets whether files created from now on keep a checksum in every page.
+   * The checksum is stored when a page is written, and checked when it is
+   * read back from disk, so pages served from a buffer pool cost nothing.
+   * Files remember the setting they were created with. Only PageFile pages
+   * have a header to hold the checksum; BlobFile pages are left as they are.
+   *
+   * @param enable  Whether new files keep page checksums.
+   */
+  static void setPageChecksums(const bool enable);
+
+  /**
+   * Returns true if the pages of this file keep a checksum.
+   */
+  bool hasPageChecksums() const { return checksums_; }
+
+  /**
+   * Sets whether BlobFiles created from now on store their pages compressed.
+   * Files remember the setting they were created with. PageFiles update page
+   * headers and free space map entries in place, so they are never
+   * compressed.
+   *
+   * @param enable  Whether new BlobFiles compress their pages.
+   */
+  static void setPageCompression(const bool enable);
+
+  /**
+   * Returns true if the pages of this file are stored compressed.
+   */
+  bool hasPageCompression() const { return compressed_; }
+
+  /**
+   * Alignment of memory, offsets and sizes that I/O on a file opened with
+   * O_DIRECT needs.
+   */
+  static const std::size_t DIRECT_ALIGNMENT = 4096;
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -122,6 +223,16 @@ class File {
    */
   virtual Page allocatePage(PageId& new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file, building it directly in new_page (e.g.
+   * a buffer pool frame) instead of returning a copy.
+   *
+   * @param new_page_number   Number of the new page, returned via this
+   *                          reference
+   * @param new_page          Page to hold the new page
+   */
+  virtual void allocatePage(PageId& new_page_number, Page& new_page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -132,6 +243,17 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file directly into page (e.g. a buffer
+   * pool frame) instead of returning a copy.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read it into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPage(const PageId page_number, Page& page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -148,6 +270,13 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Makes everything written to the file so far durable.
+   *
+   * @throws  IoErrorException  If the sync fails.
+   */
+  void sync();
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -155,6 +284,14 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Returns the id of the open file, shared with other File objects open on
+   * it.
+   *
+   * @return Id of file.
+   */
+  FileId id() const { return id_; }
+
   /**
    * Returns pageid of first page in the file.
    *
@@ -162,22 +299,96 @@ class File {
    */
   PageId getFirstPageNo();
 
+  /**
+   * Returns the number of pages in the file, including free pages. Page
+   * numbers from this one on do not exist yet.
+   *
+   * @return  Number of pages in the file.
+   */
+  PageId getNumPages() const;
+
+  /**
+   * Maps the whole file into memory read-only and shared with other processes
+   * mapping it. Page n of the file is element n of the returned array, the
+   * header taking up element 0. The mapping does not see pages added to the
+   * file later. Compressed files cannot be mapped.
+   *
+   * @param num_pages   Number of pages mapped, returned via this reference
+   * @return  The mapped pages, or NULL if the file could not be mapped
+   */
+  const Page* mapPages(std::size_t& num_pages) const;
+
+  /**
+   * Removes a mapping made by mapPages().
+   *
+   * @param pages       The mapped pages
+   * @param num_pages   Number of pages mapped
+   */
+  static void unmapPages(const Page* pages, const std::size_t num_pages);
+
  protected:
   /**
    * Returns the position of the page with the given number in the file (as an
-   * offset from the beginning of the file).
+   * offset from the beginning of the file). The header takes up page 0, so
+   * every page starts on a multiple of Page::SIZE.
    *
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return (off_t)page_number * Page::SIZE;
   }
 
+  /**
+   * Reads size bytes at offset of the file.
+   *
+   * @param offset  Position in the file to read from.
+   * @param buffer  Memory to read into.
+   * @param size    Number of bytes to read.
+   * @throws  IoErrorException  If the read fails or the file ends first.
+   */
+  void readAt(const off_t offset, void* buffer, const std::size_t size) const;
+
+  /**
+   * Writes size bytes at offset of the file.
+   *
+   * @param offset  Position in the file to write to.
+   * @param buffer  Memory to write from.
+   * @param size    Number of bytes to write.
+   * @throws  IoErrorException  If the write fails.
+   */
+  void writeAt(const off_t offset, const void* buffer, const std::size_t size);
+
+  /**
+   * Reads or writes a range that O_DIRECT cannot take as it is, through an
+   * aligned copy of the blocks covering it.
+   *
+   * @param offset  Position in the file.
+   * @param buffer  Memory to read into or write from.
+   * @param size    Number of bytes.
+   * @param write   Whether to write the range rather than read it.
+   * @throws  IoErrorException  If the I/O fails, or the file ends before the
+   *                            range read.
+   */
+  void directTransfer(const off_t offset, void* buffer, const std::size_t size,
+                      const bool write) const;
+
+  /**
+   * Reads like pread() or writes like pwrite(), through the I/O engine if one
+   * is set, looping until size bytes are done or the end of the file.
+   *
+   * @return  Number of bytes done, short of size only for a read that reached
+   *          the end of the file.
+   * @throws  IoErrorException  If a call fails other than by being
+   *                            interrupted.
+   */
+  std::size_t transfer(const off_t offset, void* buffer, const std::size_t size,
+                       const bool write) const;
+
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -188,7 +399,7 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <fd_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
@@ -208,18 +419,56 @@ class File {
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
-  typedef std::map<std::string, int> CountMap;
+  /**
+   * @brief Entry of an open file in open_files_.
+   */
+  struct OpenFile {
+    /**
+     * Descriptor of the file, -1 if the entry is free.
+     */
+    int fd;
+
+    /**
+     * Number of File objects using the descriptor.
+     */
+    int count;
+
+    /**
+     * Whether fd was opened with O_DIRECT.
+     */
+    bool direct;
+  };
+
+  /**
+   * Open files, indexed by id, and the ids of the free entries.
+   */
+  static std::vector<OpenFile> open_files_;
+  static std::vector<FileId> free_ids_;
+
+  /**
+   * Id of each open file, by name.
+   */
+  static std::unordered_map<std::string, FileId> file_ids_;
+
+  /**
+   * Engine all file I/O goes through, NULL for plain system calls.
+   */
+  static IoEngine* io_engine_;
+
+  /**
+   * Whether files are opened with O_DIRECT.
+   */
+  static bool direct_io_;
 
   /**
-   * Streams for opened files.
+   * Whether files are created with page checksums.
    */
-  static StreamMap open_streams_;
+  static bool page_checksums_;
 
   /**
-   * Counts for opened files.
+   * Whether BlobFiles are created with compressed pages.
    */
-  static CountMap open_counts_;
+  static bool page_compression_;
 
   /**
    * Name of the file this object represents.
@@ -227,15 +476,60 @@ class File {
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of underlying filesystem object, -1 once closed.
    */
-  std::shared_ptr<std::fstream> stream_;
+  int fd_;
+
+  /**
+   * Id of the file in open_files_, while fd_ is open.
+   */
+  FileId id_;
+
+  /**
+   * Whether fd_ was opened with O_DIRECT.
+   */
+  bool direct_;
+
+  /**
+   * Whether the pages of the file keep a checksum, as read from its header.
+   */
+  bool checksums_;
+
+  /**
+   * Whether the pages of the file are stored compressed, as read from its
+   * header.
+   */
+  bool compressed_;
 
   friend class FileIterator;
 };
 
+/**
+ * @brief File of pages holding records.
+ *
+ * Used pages are linked into a list in page number order, and free pages into
+ * a list of their own. A free space map records, with one byte per page, if
+ * the page is used and roughly how much room it has left. Every
+ * SPACE_MAP_ENTRIES + 1 pages, starting at page 1, one page holds the map of
+ * the pages that follow it up to the next map page. Map pages are on neither
+ * list.
+ *
+ * Finding the used page before a page, which linking a page into the used list
+ * or out of it needs, and finding a page with room for a record only read map
+ * pages, each covering thousands of pages, instead of walking the used list.
+ */
 class PageFile : public File {
  public:
+  /**
+   * Number of pages described by one free space map page.
+   */
+  static const PageId SPACE_MAP_ENTRIES = Page::DATA_SIZE;
+
+  /**
+   * Bytes of free space per step of the free space map entries.
+   */
+  static const std::size_t SPACE_MAP_GRANULE = 32;
+
   /**
    * Creates a new file.
    *
@@ -247,12 +541,12 @@ class PageFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
    * It first checks if the file is already open. If so, then the new File
-   * object created uses the same input-output stream to read to or write fom
+   * object created uses the same file descriptor to read to or write fom
    * that already open file. Reference count (open_counts_ static variable
    * inside the File object) is incremented whenever an already open file is
    * opened again. Otherwise the UNIX file is actually opened. The fileName and
-   * the stream associated with this File object are inserted into the
-   * open_streams_ map.
+   * the descriptor associated with this File object are inserted into the
+   * open_fds_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -300,6 +594,15 @@ class PageFile : public File {
    */
   Page allocatePage(PageId& new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it directly in new_page.
+   *
+   * @param new_page_number   Number of the new page, returned via this
+   *                          reference
+   * @param new_page          Page to hold the new page
+   */
+  void allocatePage(PageId& new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +613,16 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file directly into page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read it into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -326,6 +639,45 @@ class PageFile : public File {
    */
   void deletePage(const PageId page_number) override;
 
+  /**
+   * Appends pages filled in memory to the end of the file as used pages,
+   * linked after the last used page, without going through allocatePage() for
+   * each. Every run of pages between two free space map pages goes out in a
+   * single write, and the map entries of the run in another. Free pages are
+   * left on the free list.
+   *
+   * The page numbers, next page numbers and checksums of the pages are filled
+   * in. No buffer pool may hold a page of the file changed since it was read.
+   *
+   * @param pages   Pages to append, count of them in a row.
+   * @param count   Number of pages.
+   * @return  Number of the first page appended, or Page::INVALID_NUMBER if
+   *          count is 0.
+   */
+  PageId appendPages(Page* pages, const PageId count);
+
+  /**
+   * Returns the number of a used page that has room for a record of the given
+   * size according to the free space map, looking at the pages in page number
+   * order. The map rounds free space down, so pages with barely enough room
+   * may be passed over. Pages changed in a buffer pool and not yet written
+   * back are described as they are on disk.
+   *
+   * @param record_size   Size of the record in bytes.
+   * @param from          Number of the first page to look at.
+   * @return  Number of the page, or Page::INVALID_NUMBER if no page has room.
+   */
+  PageId findPageWithSpace(const std::size_t record_size,
+                           const PageId from = 0) const;
+
+  /**
+   * Lists the used pages of the file in page number order, the order they are
+   * linked in, according to the free space map.
+   *
+   * @param page_numbers  Numbers of the pages, replaced via this reference.
+   */
+  void getUsedPages(std::vector<PageId>& page_numbers) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -346,21 +698,25 @@ class PageFile : public File {
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
+   * @param page          Page to read it into.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
+   * @throws  PageChecksumException If the file keeps page checksums and the
+   *                                used page read does not match its own.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPage(const PageId page_number, const bool allow_free,
+                Page& page) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
    * This does not ensure that the number in the header equals the position on
-   * disk.  No bounds checking is performed.
+   * disk.  No bounds checking is performed.  If the file keeps page checksums,
+   * the checksum of the header is filled in.
    *
    * @param page_number Number of page whose contents to replace.
    * @param header      Header of page to write.
@@ -378,9 +734,89 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk.  No bounds checking is
+   * performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
+  /**
+   * Returns true if the given page holds part of the free space map.
+   *
+   * @param page_number   Number of page.
+   */
+  static bool isSpaceMapPage(const PageId page_number);
+
+  /**
+   * Returns the position in the file of the free space map entry of the given
+   * page, which must not be a map page itself.
+   *
+   * @param page_number   Number of page.
+   * @return  Position of the entry in the file.
+   */
+  static off_t spaceMapPosition(const PageId page_number);
+
+  /**
+   * Returns the free space map entry describing a page with the given header:
+   * 0 if the page is not used, and otherwise 1 plus its free space in
+   * SPACE_MAP_GRANULE steps, rounded down.
+   *
+   * @param header  Header of the page.
+   * @return  Free space map entry.
+   */
+  static std::uint8_t spaceMapEntry(const PageHeader& header);
+
+  /**
+   * Returns the CRC32C of a page with the given header, leaving out the next
+   * page number and the checksum itself.
+   *
+   * @param header  Header of the page.
+   * @param page    Page whose data to include.
+   * @return  Checksum of the page.
+   */
+  static std::uint32_t pageChecksum(const PageHeader& header,
+                                    const Page& page);
+
+  /**
+   * Writes the free space map entry of the given page.
+   *
+   * @param page_number   Number of page.
+   * @param entry         New entry.
+   */
+  void writeSpaceMapEntry(const PageId page_number, const std::uint8_t entry);
+
+  /**
+   * Returns the number of the used page before the given one, or
+   * Page::INVALID_NUMBER if there is none, reading the free space map backwards
+   * from the page.
+   *
+   * @param page_number   Number of page.
+   * @return  Number of the previous used page.
+   */
+  PageId previousUsedPage(const PageId page_number) const;
+
   friend class FileIterator;
 };
 
+/**
+ * @brief File of raw pages, such as the nodes of an index.
+ *
+ * Pages are normally kept at their page number's position. A compressed file
+ * instead keeps every page with compressBlock(), in an extent of as many 512
+ * byte sectors as it needs. Pages that do not compress by at least one sector
+ * are kept as they are. A page that outgrows its extent, or shrinks to less
+ * than half of it, moves to another one. Extents given up are kept on a free
+ * list per size, linked through their first bytes, and reused before the file
+ * grows.
+ *
+ * An extent table, one entry per page, tells where each page is. The table
+ * is split into pages of its own, allocated as extents too. The header page
+ * holds, after the FileHeader, the heads of the free lists and a directory
+ * of the table pages.
+ */
 class BlobFile : public File {
  public:
   /**
@@ -394,12 +830,12 @@ class BlobFile : public File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
    * It first checks if the file is already open. If so, then the new File
-   * object created uses the same input-output stream to read to or write fom
+   * object created uses the same file descriptor to read to or write fom
    * that already open file. Reference count (open_counts_ static variable
    * inside the File object) is incremented whenever an already open file is
    * opened again. Otherwise the UNIX file is actually opened. The fileName and
-   * the stream associated with this File object are inserted into the
-   * open_streams_ map.
+   * the descriptor associated with this File object are inserted into the
+   * open_fds_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -449,6 +885,15 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId& new_page_number) override;
 
+  /**
+   * Allocates a new page in the file, building it directly in new_page.
+   *
+   * @param new_page_number   Number of the new page, returned via this
+   *                          reference
+   * @param new_page          Page to hold the new page
+   */
+  void allocatePage(PageId& new_page_number, Page& new_page) override;
+
   /**
    * Reads an existing page from the file.
    *
@@ -459,6 +904,16 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  /**
+   * Reads an existing page from the file directly into page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read it into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPage(const PageId page_number, Page& page) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -474,6 +929,102 @@ class BlobFile : public File {
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number) override;
+
+ private:
+  /**
+   * Where a page of a compressed file is kept.
+   */
+  struct PageExtent {
+    /**
+     * First sector of the extent, 0 if the page was never written.
+     */
+    std::uint32_t sector;
+
+    /**
+     * Number of bytes the page takes up, Page::SIZE if it is not compressed.
+     */
+    std::uint16_t length;
+
+    /**
+     * Number of sectors in the extent.
+     */
+    std::uint16_t sectors;
+  };
+
+  /**
+   * Size of the units extents are allocated in.
+   */
+  static const std::size_t SECTOR_SIZE = 512;
+
+  /**
+   * Number of sectors in the largest extent.
+   */
+  static const std::uint32_t MAX_EXTENT_SECTORS = Page::SIZE / SECTOR_SIZE;
+
+  /**
+   * Positions in the header page of the free list heads, one per extent size,
+   * and of the directory.
+   */
+  static const std::size_t FREE_LISTS_OFFSET = 64;
+  static const std::size_t DIRECTORY_OFFSET =
+      FREE_LISTS_OFFSET + (MAX_EXTENT_SECTORS + 1) * sizeof(std::uint32_t);
+
+  /**
+   * Number of extent table entries per table page, and of table pages the
+   * directory can list.
+   */
+  static const PageId EXTENTS_PER_TABLE = Page::SIZE / sizeof(PageExtent);
+  static const std::size_t DIRECTORY_SIZE =
+      (Page::SIZE - DIRECTORY_OFFSET) / sizeof(std::uint32_t);
+
+  /**
+   * Returns the position in the file of the extent table entry of a page of
+   * a compressed file.
+   *
+   * @param page_number   Number of page.
+   * @return  Position of the entry, or -1 if the table page holding it has
+   *          not been allocated.
+   */
+  off_t extentPosition(const PageId page_number) const;
+
+  /**
+   * Position in the header page of the directory entry of the table page
+   * holding the extent of a page.
+   *
+   * @param page_number   Number of page.
+   * @throws  InvalidPageException  If the page number is past what the
+   *                                directory can cover.
+   */
+  off_t directoryPosition(const PageId page_number) const;
+
+  /**
+   * Returns the first sector of an extent of count sectors, taken off the
+   * free list of its size or else from the end of a compressed file.
+   */
+  std::uint32_t allocateExtent(const std::uint32_t count);
+
+  /**
+   * Puts an extent of count sectors on the free list of its size.
+   */
+  void freeExtent(const std::uint32_t sector, const std::uint32_t count);
+
+  /**
+   * Reads a page of a compressed file.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to decompress it into.
+   * @throws  InvalidPageException  If the page does not decompress.
+   */
+  void readCompressedPage(const PageId page_number, Page& page) const;
+
+  /**
+   * Compresses a page into its extent, moving it to a larger extent if need
+   * be.
+   *
+   * @param page_number   Number of page whose contents to replace.
+   * @param new_page      Page to write.
+   */
+  void writeCompressedPage(const PageId page_number, const Page& new_page);
 };
 
 }  // namespace badgerdb
@@ -8,22 +8,31 @@
 
 #include "filescan.h"
 
+#include <algorithm>
+#include <thread>
+
+#include "btree.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 namespace badgerdb {
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr) {
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr,
+                   const std::vector<ScanPredicate> &predicates,
+                   const std::vector<ByteRange> &projection)
+    : predicates(predicates), projection(projection) {
   file = new PageFile(name, false);  // dont create new file
   bufMgr = bufferMgr;
   curDirtyFlag = false;
   curPage = NULL;
+  readAheadEnd = 0;
   filePageIter = file->begin();
 }
 
 FileScan::~FileScan() {
   // generally must unpin last page of the scan
   if (curPage != NULL) {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.page_number(), curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
     filePageIter = file->begin();
@@ -33,8 +42,23 @@ FileScan::~FileScan() {
 }
 
 void FileScan::scanNext(RecordId &outRid) {
-  std::string rec;
+  // see if the record satisfies the scan's predicate
+  do {
+    nextRecord(outRid);
+  } while (!matches());
+}
 
+bool FileScan::matches() {
+  if (predicates.empty()) return true;
+  std::size_t length;
+  const char *record = pageRecordIter.getRecordData(length);
+  for (std::size_t i = 0; i < predicates.size(); i++) {
+    if (!predicates[i].matches(record, length)) return false;
+  }
+  return true;
+}
+
+void FileScan::nextRecord(RecordId &outRid) {
   if (filePageIter == file->end()) {
     throw EndOfFileException();
   }
@@ -48,16 +72,14 @@ void FileScan::scanNext(RecordId &outRid) {
     }
 
     // read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    bufMgr->readPage(file, filePageIter.page_number(), curPage, true);
     curDirtyFlag = false;
+    readAhead();
 
     // get the first record off the page
     pageRecordIter = curPage->begin();
 
     if (pageRecordIter != curPage->end()) {
-      // get pointer to record
-      rec = *pageRecordIter;
-
       outRid = pageRecordIter.getCurrentRecord();
       return;
     }
@@ -69,7 +91,7 @@ void FileScan::scanNext(RecordId &outRid) {
 
   while (pageRecordIter == curPage->end()) {
     // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.page_number(), curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
 
@@ -80,27 +102,323 @@ void FileScan::scanNext(RecordId &outRid) {
     }
 
     // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+    bufMgr->readPage(file, filePageIter.page_number(), curPage, true);
+    readAhead();
 
     // get the first record off the page
     pageRecordIter = curPage->begin();
   }
 
   // curRec points at a valid record
-  // see if the record satisfies the scan's predicate
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
   // return rid of the record
   outRid = pageRecordIter.getCurrentRecord();
   return;
 }
 
+void FileScan::readAhead() {
+  const PageId from = std::max(filePageIter.page_number() + 1, readAheadEnd);
+  const PageId to = filePageIter.page_number() + 1 + READ_AHEAD_PAGES;
+  if (from < to) {
+    bufMgr->prefetch(file, from, to - from);
+    readAheadEnd = to;
+  }
+}
+
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page
-std::string FileScan::getRecord() { return *pageRecordIter; }
+std::string FileScan::getRecord() {
+  if (projection.empty()) return *pageRecordIter;
+
+  std::size_t length;
+  const char *record = pageRecordIter.getRecordData(length);
+  std::string projected;
+  for (std::size_t i = 0; i < projection.size(); i++) {
+    // Ranges past the end of the record are cut short
+    const std::size_t start = std::min(projection[i].offset, length);
+    const std::size_t end =
+        std::min(projection[i].offset + projection[i].length, length);
+    projected.append(record + start, end - start);
+  }
+  return projected;
+}
+
+const char *FileScan::getRecordData(std::size_t &length) {
+  return pageRecordIter.getRecordData(length);
+}
+
+ColumnScan::ColumnScan(const std::string &name, BufMgr *bufMgr,
+                       const PaxSchema &schema, const std::size_t column)
+    : file(new PageFile(name, false)),
+      bufMgr(bufMgr),
+      schema(schema),
+      column(column),
+      curPage(NULL),
+      readAheadEnd(0) {
+  filePageIter = file->begin();
+}
+
+ColumnScan::~ColumnScan() {
+  if (curPage != NULL) {
+    bufMgr->unPinPage(file, filePageIter.page_number(), false);
+    curPage = NULL;
+  }
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+const char *ColumnScan::scanNextPage(std::size_t &count) {
+  while (true) {
+    if (curPage != NULL) {
+      bufMgr->unPinPage(file, filePageIter.page_number(), false);
+      curPage = NULL;
+      filePageIter++;
+    }
+    if (filePageIter == file->end()) {
+      throw EndOfFileException();
+    }
+
+    bufMgr->readPage(file, filePageIter.page_number(), curPage, true);
+    readAhead();
+
+    PaxPage page(curPage, schema);
+    if (!page.matchesSchema()) {
+      throw InvalidPageException(filePageIter.page_number(), file->filename());
+    }
+    count = page.numRecords();
+    if (count > 0) return page.getColumn(column);
+  }
+}
+
+RecordId ColumnScan::getRecordId(const std::size_t i) const {
+  return {curPage->page_number(), (SlotId)(i + 1), 0};
+}
+
+void ColumnScan::readAhead() {
+  const PageId from = std::max(filePageIter.page_number() + 1, readAheadEnd);
+  const PageId to = filePageIter.page_number() + 1 + READ_AHEAD_PAGES;
+  if (from < to) {
+    bufMgr->prefetch(file, from, to - from);
+    readAheadEnd = to;
+  }
+}
+
+ParallelFileScan::ParallelFileScan(const std::string &name, BufMgr *bufferMgr,
+                                   const std::size_t numWorkers,
+                                   const std::vector<ScanPredicate> &predicates)
+    : bufMgr(bufferMgr),
+      numWorkers(numWorkers),
+      predicates(predicates),
+      nextMorsel(0),
+      failed(false) {
+  file = new PageFile(name, false);  // dont create new file
+  if (this->numWorkers == 0) {
+    this->numWorkers = std::max(1u, std::thread::hardware_concurrency());
+  }
+}
+
+ParallelFileScan::~ParallelFileScan() {
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::run(const BatchFunction &visit) {
+  file->getUsedPages(pageNos);
+  nextMorsel = 0;
+  failed = false;
+  failure = std::exception_ptr();
+
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < numWorkers; i++) {
+    workers.push_back(
+        std::thread(&ParallelFileScan::work, this, std::cref(visit)));
+  }
+  for (std::size_t i = 0; i < workers.size(); i++) workers[i].join();
+  if (failure) std::rethrow_exception(failure);
+}
+
+void ParallelFileScan::work(const BatchFunction &visit) {
+  RecordBatch batch;
+  try {
+    while (!failed.load(std::memory_order_relaxed)) {
+      const std::size_t first = nextMorsel.fetch_add(SCAN_MORSEL_PAGES);
+      if (first >= pageNos.size()) return;
+      const std::size_t last =
+          std::min(first + SCAN_MORSEL_PAGES, pageNos.size()) - 1;
+
+      // Pages of a morsel are mostly consecutive, so they are read ahead as a
+      // run. Pages of the run outside the morsel are skipped by the readers.
+      bufMgr->prefetch(file, pageNos[first],
+                       std::min<PageId>(pageNos[last] - pageNos[first] + 1,
+                                        SCAN_MORSEL_PAGES));
+
+      for (std::size_t p = first;
+           p <= last && !failed.load(std::memory_order_relaxed); p++) {
+        Page *page;
+        bufMgr->readPage(file, pageNos[p], page, true);
+        batch.rids.clear();
+        batch.records.clear();
+        batch.lengths.clear();
+        for (PageIterator it = page->begin(); it != page->end(); ++it) {
+          std::size_t length;
+          const char *record = it.getRecordData(length);
+          bool matches = true;
+          for (std::size_t i = 0; i < predicates.size() && matches; i++) {
+            matches = predicates[i].matches(record, length);
+          }
+          if (!matches) continue;
+          batch.rids.push_back(it.getCurrentRecord());
+          batch.records.push_back(record);
+          batch.lengths.push_back(length);
+        }
+
+        try {
+          if (!batch.rids.empty()) visit(batch);
+        } catch (...) {
+          bufMgr->unPinPage(file, pageNos[p], false);
+          throw;
+        }
+        bufMgr->unPinPage(file, pageNos[p], false);
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(failureLatch);
+    if (!failed.load()) failure = std::current_exception();
+    failed = true;
+  }
+}
 
 // mark current page of scan dirty
 void FileScan::markDirty() { curDirtyFlag = true; }
 
+IndexHeapScan::IndexHeapScan(const std::string &name, BufMgr *bufferMgr,
+                             BTreeIndex &index, IndexCursor &cursor,
+                             const std::vector<ScanPredicate> &predicates)
+    : bufMgr(bufferMgr),
+      current(0),
+      pageCount(0),
+      curPage(NULL),
+      curPageNo(Page::INVALID_NUMBER),
+      readAheadPos(0),
+      predicates(predicates) {
+  // Collected a batch at a time, each leaf's entries copied at once
+  const std::size_t batchSize = 1024;
+  std::size_t got;
+  do {
+    const std::size_t size = rids.size();
+    rids.resize(size + batchSize);
+    got = index.scanNextBatch(cursor, &rids[size], batchSize);
+    rids.resize(size + got);
+  } while (got == batchSize);
+  index.endScan(cursor);
+
+  file = new PageFile(name, false);  // dont create new file
+  sortRids();
+}
+
+IndexHeapScan::IndexHeapScan(const std::string &name, BufMgr *bufferMgr,
+                             const std::vector<RecordId> &rids,
+                             const std::vector<ScanPredicate> &predicates)
+    : bufMgr(bufferMgr),
+      rids(rids),
+      current(0),
+      pageCount(0),
+      curPage(NULL),
+      curPageNo(Page::INVALID_NUMBER),
+      readAheadPos(0),
+      predicates(predicates) {
+  file = new PageFile(name, false);  // dont create new file
+  sortRids();
+}
+
+IndexHeapScan::~IndexHeapScan() {
+  if (curPage != NULL) {
+    bufMgr->unPinPage(file, curPageNo, false);
+    curPage = NULL;
+  }
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void IndexHeapScan::sortRids() {
+  std::sort(rids.begin(), rids.end(),
+            [](const RecordId &a, const RecordId &b) {
+              return a.page_number != b.page_number
+                         ? a.page_number < b.page_number
+                         : a.slot_number < b.slot_number;
+            });
+  rids.erase(std::unique(rids.begin(), rids.end()), rids.end());
+  for (std::size_t i = 0; i < rids.size(); i++) {
+    if (i == 0 || rids[i].page_number != rids[i - 1].page_number) pageCount++;
+  }
+}
+
+void IndexHeapScan::scanNext(RecordId &outRid) {
+  while (true) {
+    // The first call starts at the first RecordId, later ones after the last
+    if (curPage != NULL) current++;
+    if (current >= rids.size()) {
+      if (curPage != NULL) {
+        bufMgr->unPinPage(file, curPageNo, false);
+        curPage = NULL;
+      }
+      current = rids.size();
+      throw EndOfFileException();
+    }
+
+    // Move on to the page of the RecordId, pinned while its records are
+    // returned
+    const RecordId &rid = rids[current];
+    if (curPage == NULL || rid.page_number != curPageNo) {
+      if (curPage != NULL) {
+        bufMgr->unPinPage(file, curPageNo, false);
+        curPage = NULL;
+      }
+      bufMgr->readPage(file, rid.page_number, curPage, true);
+      curPageNo = rid.page_number;
+      readAhead();
+    }
+
+    std::size_t length;
+    const char *record = curPage->getRecordData(rid, length);
+    bool matches = true;
+    for (std::size_t i = 0; i < predicates.size() && matches; i++) {
+      matches = predicates[i].matches(record, length);
+    }
+    if (matches) {
+      outRid = rid;
+      return;
+    }
+  }
+}
+
+std::string IndexHeapScan::getRecord() {
+  return curPage->getRecord(rids[current]);
+}
+
+const char *IndexHeapScan::getRecordData(std::size_t &length) {
+  return curPage->getRecordData(rids[current], length);
+}
+
+void IndexHeapScan::readAhead() {
+  readAheadPos = std::max(readAheadPos, current);
+  const PageId limit = curPageNo + 1 + READ_AHEAD_PAGES;
+  std::uint32_t pages = 0;
+  while (readAheadPos < rids.size() && pages < READ_AHEAD_PAGES) {
+    const PageId first = rids[readAheadPos].page_number;
+    if (first >= limit && pages > 0) break;
+
+    // A run of consecutive pages goes out as one request
+    PageId last = first;
+    while (readAheadPos < rids.size() &&
+           rids[readAheadPos].page_number <= last + 1 &&
+           pages + (rids[readAheadPos].page_number - first) <
+               READ_AHEAD_PAGES) {
+      last = rids[readAheadPos].page_number;
+      readAheadPos++;
+    }
+    if (first != curPageNo) bufMgr->prefetch(file, first, last - first + 1);
+    pages += last - first + 1;
+  }
+}
+
 }  // namespace badgerdb
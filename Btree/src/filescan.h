@@ -8,31 +8,132 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "buffer.h"
 #include "file_iterator.h"
 #include "page.h"
 #include "page_iterator.h"
+#include "pax_page.h"
 #include "types.h"
 
 namespace badgerdb {
 
+class BTreeIndex;
+class IndexCursor;
+
+/**
+ * @brief Condition on one attribute of the records of a scan: the attribute
+ * at a byte offset compared to a constant, "attribute op value".
+ *
+ * Conditions are checked on the record in the buffer pool. Records too short
+ * to hold the attribute do not satisfy it. STRING attributes compare their
+ * first value.length() bytes with value.
+ */
+class ScanPredicate {
+ public:
+  ScanPredicate(const std::size_t offset, const Operator op, const int value)
+      : offset(offset), type(INTEGER), op(op), intValue(value),
+        doubleValue(0) {}
+
+  ScanPredicate(const std::size_t offset, const Operator op,
+                const double value)
+      : offset(offset), type(DOUBLE), op(op), intValue(0),
+        doubleValue(value) {}
+
+  ScanPredicate(const std::size_t offset, const Operator op,
+                const std::string &value)
+      : offset(offset), type(STRING), op(op), intValue(0), doubleValue(0),
+        stringValue(value) {}
+
+  /**
+   * Returns true if the record of the given length satisfies the condition.
+   */
+  bool matches(const char *record, const std::size_t length) const {
+    switch (type) {
+      case INTEGER: {
+        if (offset + sizeof(int) > length) return false;
+        int attr;
+        memcpy(&attr, record + offset, sizeof(int));
+        return compare(attr, intValue);
+      }
+      case DOUBLE: {
+        if (offset + sizeof(double) > length) return false;
+        double attr;
+        memcpy(&attr, record + offset, sizeof(double));
+        return compare(attr, doubleValue);
+      }
+      case STRING:
+        if (offset + stringValue.length() > length) return false;
+        return compare(memcmp(record + offset, stringValue.data(),
+                              stringValue.length()),
+                       0);
+      case COMPOSITE:
+        break;
+    }
+    return false;
+  }
+
+ private:
+  template <class T>
+  bool compare(const T &attr, const T &value) const {
+    switch (op) {
+      case LT:
+        return attr < value;
+      case LTE:
+        return attr <= value;
+      case GTE:
+        return attr >= value;
+      case GT:
+        return attr > value;
+    }
+    return false;
+  }
+
+  std::size_t offset;
+  Datatype type;
+  Operator op;
+  int intValue;
+  double doubleValue;
+  std::string stringValue;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
+ *
+ * Pages are read as pages of a sequential scan, so the buffer manager gives
+ * them up before pages that are used over and over.
+ *
+ * A scan can be given conditions that all records it returns satisfy, checked
+ * in place in the buffer pool, so records it skips are never copied. It can
+ * also be given a projection, in which case getRecord() returns only the
+ * ranges of bytes it lists, one after the other.
  */
 class FileScan {
  public:
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  FileScan(const std::string &name, BufMgr *bufMgr,
+           const std::vector<ScanPredicate> &predicates =
+               std::vector<ScanPredicate>(),
+           const std::vector<ByteRange> &projection = std::vector<ByteRange>());
 
   ~FileScan();
 
   // return RecordId of next record that satisfies the scan
   void scanNext(RecordId &outRid);
 
-  // read current record, returning pointer and length
+  // read current record, returning a copy of it, or of its projection
   std::string getRecord();
 
+  // read current record without copying it, returning pointer and length. The
+  // pointer is into the buffer pool and valid until the next call to scanNext
+  const char *getRecordData(std::size_t &length);
+
   // marks current page of scan dirty
   void markDirty();
 
@@ -59,6 +160,323 @@ class FileScan {
    * True if page has been updated
    */
   bool curDirtyFlag;
+
+  /**
+   * Page number up to which pages have been read ahead, exclusive
+   */
+  PageId readAheadEnd;
+
+  /**
+   * Conditions all records returned satisfy
+   */
+  std::vector<ScanPredicate> predicates;
+
+  /**
+   * Bytes of the records getRecord() returns, all of them if empty
+   */
+  std::vector<ByteRange> projection;
+
+  /**
+   * Moves on to the next record of the file, whether it satisfies the
+   * conditions or not.
+   */
+  void nextRecord(RecordId &outRid);
+
+  /**
+   * Returns true if the current record satisfies all conditions.
+   */
+  bool matches();
+
+  /**
+   * Keeps READ_AHEAD_PAGES pages after the current one read ahead. Pages of a
+   * file are mostly kept in page number order, so those are read.
+   */
+  void readAhead();
+};
+
+/**
+ * @brief This class is used to fetch the records an index scan found, a heap
+ * page at a time.
+ *
+ * The RecordIds come in key order, which on an index the relation is not
+ * clustered by jumps between pages at random. They are collected first and
+ * sorted by page and slot, so that each page is read once, in page number
+ * order, and all of its matching records are returned while it is pinned.
+ * The next pages to visit are read ahead. Pages are read as pages of a
+ * sequential scan.
+ */
+class IndexHeapScan {
+ public:
+  /**
+   * Runs the scan of cursor to its end and ends it, collecting its RecordIds.
+   *
+   * @param name        Name of the relation the index is on
+   * @param bufMgr      Buffer Manager instance
+   * @param index       Index the cursor's scan was started on
+   * @param cursor      Cursor with a scan started
+   * @param predicates  Conditions all records returned satisfy, such as the
+   * ones of the scan checked again on the records
+   */
+  IndexHeapScan(const std::string &name, BufMgr *bufMgr, BTreeIndex &index,
+                IndexCursor &cursor,
+                const std::vector<ScanPredicate> &predicates =
+                    std::vector<ScanPredicate>());
+
+  /**
+   * Fetches the records of the given RecordIds, as found by lookups. A
+   * RecordId given more than once is returned once.
+   *
+   * @param name        Name of the relation
+   * @param bufMgr      Buffer Manager instance
+   * @param rids        RecordIds of the records, in any order
+   * @param predicates  Conditions all records returned satisfy
+   */
+  IndexHeapScan(const std::string &name, BufMgr *bufMgr,
+                const std::vector<RecordId> &rids,
+                const std::vector<ScanPredicate> &predicates =
+                    std::vector<ScanPredicate>());
+
+  ~IndexHeapScan();
+
+  /**
+   * Moves on to the next record, in page number and slot order.
+   *
+   * @param outRid  RecordId of the record, returned via this reference
+   * @throws  EndOfFileException  If there are no more records
+   */
+  void scanNext(RecordId &outRid);
+
+  /**
+   * Returns a copy of the current record.
+   */
+  std::string getRecord();
+
+  /**
+   * Returns the current record without copying it. The pointer is into the
+   * buffer pool and valid until the next call to scanNext().
+   *
+   * @param length  Length of the record, returned via this reference
+   */
+  const char *getRecordData(std::size_t &length);
+
+  /**
+   * Returns the number of distinct pages the records are on.
+   */
+  std::size_t numPages() const { return pageCount; }
+
+ private:
+  /**
+   * Sorts the RecordIds and drops the repeated ones.
+   */
+  void sortRids();
+
+  /**
+   * Asks for the pages of the RecordIds after the current one to be read
+   * ahead, up to READ_AHEAD_PAGES pages past the current page. Consecutive
+   * page numbers are asked for as one run.
+   */
+  void readAhead();
+
+  /**
+   * File which is being scanned.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * RecordIds to fetch, sorted, and the index of the current one
+   */
+  std::vector<RecordId> rids;
+  std::size_t current;
+
+  /**
+   * Number of distinct pages in rids
+   */
+  std::size_t pageCount;
+
+  /**
+   * Current page, pinned, or NULL before the first record
+   */
+  Page *curPage;
+  PageId curPageNo;
+
+  /**
+   * Index into rids of the first RecordId whose page has not been read ahead
+   */
+  std::size_t readAheadPos;
+
+  /**
+   * Conditions all records returned satisfy
+   */
+  std::vector<ScanPredicate> predicates;
+};
+
+/**
+ * @brief This class is used to scan one attribute of a relation stored in PAX
+ * pages, a page at a time.
+ *
+ * Every call hands out the minipage of the attribute straight from the page in
+ * the buffer pool, so the rest of the records is never looked at, and the
+ * values can be processed with vector instructions. Pages are read as pages of
+ * a sequential scan.
+ */
+class ColumnScan {
+ public:
+  /**
+   * @param name    Name of the relation
+   * @param bufMgr  Buffer Manager instance
+   * @param schema  Schema the pages of the relation are laid out for
+   * @param column  Column of the attribute to scan
+   */
+  ColumnScan(const std::string &name, BufMgr *bufMgr, const PaxSchema &schema,
+             const std::size_t column);
+
+  ~ColumnScan();
+
+  /**
+   * Moves on to the next page holding records.
+   *
+   * @param count   Number of values on the page, returned via this reference
+   * @return  The first value. Values are the attribute's length apart, and
+   * stay valid until the next call.
+   * @throws  EndOfFileException    If there are no more pages
+   * @throws  InvalidPageException  If a page is not laid out for the schema
+   */
+  const char *scanNextPage(std::size_t &count);
+
+  /**
+   * Returns the ID of the record of value i of the current page.
+   */
+  RecordId getRecordId(const std::size_t i) const;
+
+ private:
+  /**
+   * File which is being scanned.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  PaxSchema schema;
+  std::size_t column;
+
+  /**
+   * Current page being scanned, or NULL before the first page.
+   */
+  Page *curPage;
+
+  FileIterator filePageIter;
+
+  /**
+   * Page number up to which pages have been read ahead, exclusive
+   */
+  PageId readAheadEnd;
+
+  /**
+   * Keeps READ_AHEAD_PAGES pages after the current one read ahead.
+   */
+  void readAhead();
+};
+
+/**
+ * @brief Number of consecutive used pages a worker of a ParallelFileScan
+ * claims at a time.
+ */
+const std::size_t SCAN_MORSEL_PAGES = 16;
+
+/**
+ * @brief Records of one page returned by a ParallelFileScan. The records point
+ * into the page in the buffer pool, which stays pinned while the batch is
+ * handed to the caller.
+ */
+struct RecordBatch {
+  std::vector<RecordId> rids;
+  std::vector<const char *> records;
+  std::vector<std::size_t> lengths;
+};
+
+/**
+ * @brief This class is used to scan all records in a relation with several
+ * threads.
+ *
+ * The used pages of the relation are split into morsels of SCAN_MORSEL_PAGES
+ * consecutive pages. Worker threads claim morsels one at a time and read the
+ * morsel ahead, then hand the records satisfying the scan's conditions to the
+ * caller one page at a time. Records come in no particular order.
+ */
+class ParallelFileScan {
+ public:
+  /**
+   * Function called with each batch, on the worker threads, so it has to be
+   * thread safe.
+   */
+  typedef std::function<void(const RecordBatch &)> BatchFunction;
+
+  /**
+   * @param name        Name of the relation
+   * @param bufMgr      Buffer Manager instance
+   * @param numWorkers  Number of worker threads, one per core if 0
+   * @param predicates  Conditions all records returned satisfy
+   */
+  ParallelFileScan(const std::string &name, BufMgr *bufMgr,
+                   const std::size_t numWorkers = 0,
+                   const std::vector<ScanPredicate> &predicates =
+                       std::vector<ScanPredicate>());
+
+  ~ParallelFileScan();
+
+  /**
+   * Scans the whole relation, returning once all batches have been handed
+   * over. If the function or reading a page throws, the other workers stop
+   * at their next page and the first exception is rethrown.
+   *
+   * @param visit   Function handed every batch
+   */
+  void run(const BatchFunction &visit);
+
+ private:
+  /**
+   * Body of the worker threads.
+   */
+  void work(const BatchFunction &visit);
+
+  /**
+   * File which is being scanned.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  std::size_t numWorkers;
+
+  /**
+   * Conditions all records returned satisfy
+   */
+  std::vector<ScanPredicate> predicates;
+
+  /**
+   * Used pages of the file, and the index of the first page of the next
+   * morsel to claim
+   */
+  std::vector<PageId> pageNos;
+  std::atomic<std::size_t> nextMorsel;
+
+  /**
+   * Set once a worker has failed, with the first exception thrown
+   */
+  std::atomic<bool> failed;
+  std::exception_ptr failure;
+  std::mutex failureLatch;
 };
 
 }  // namespace badgerdb
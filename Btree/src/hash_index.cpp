@@ -0,0 +1,547 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "hash_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "filescan.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Scrambles the bits of value (the finalizer of SplitMix64), so that keys
+ * that differ in their high bits land in different buckets.
+ */
+std::uint64_t mix(std::uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+// HashIndex::HashIndex -- Constructor
+// -----------------------------------------------------------------------------
+
+HashIndex::HashIndex(const std::string &relationName,
+                     std::string &outIndexName, BufMgr *bufMgrIn,
+                     const int attrByteOffset, const Datatype attrType)
+    : file(NULL),
+      bufMgr(bufMgrIn),
+      attributeType(attrType),
+      attrByteOffset(attrByteOffset),
+      globalDepth(0),
+      bucketSplits(0),
+      directoryDoublings(0) {
+  std::ostringstream idxStr;
+  idxStr << relationName << "." << attrByteOffset << ".hash";
+  outIndexName = idxStr.str();
+  if (attrType == COMPOSITE) throw BadIndexInfoException(outIndexName);
+
+  try {
+    this->file = new BlobFile(outIndexName, false);
+    this->bufMgr->setFileClass(this->file, INDEX_PRIORITY);
+
+    this->headerPageNum = this->file->getFirstPageNo();
+    Page *headerPage;
+    this->bufMgr->readPage(this->file, this->headerPageNum, headerPage);
+    const HashIndexMetaInfo *meta = (const HashIndexMetaInfo *)headerPage;
+    const bool valid = relationName == meta->relationName &&
+                       attrType == meta->attrType &&
+                       attrByteOffset == meta->attrByteOffset;
+    this->globalDepth = meta->globalDepth;
+    const PageId directoryPageNo = meta->directoryPageNo;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, false);
+    if (!valid) {
+      // Closed here, since the destructor does not run
+      this->bufMgr->flushFile(this->file);
+      this->bufMgr->clearFileClass(this->file);
+      delete this->file;
+      this->file = NULL;
+      throw BadIndexInfoException(outIndexName);
+    }
+    readDirectory(directoryPageNo);
+  } catch (FileNotFoundException &e) {
+    this->file = new BlobFile(outIndexName, true);
+    this->bufMgr->setFileClass(this->file, INDEX_PRIORITY);
+
+    Page *headerPage;
+    this->bufMgr->allocPage(this->file, this->headerPageNum, headerPage);
+    HashIndexMetaInfo *meta = (HashIndexMetaInfo *)headerPage;
+    strncpy(meta->relationName, relationName.c_str(), 20);
+    meta->relationName[19] = 0;
+    meta->attrByteOffset = attrByteOffset;
+    meta->attrType = attrType;
+    meta->globalDepth = 0;
+    meta->directoryPageNo = Page::INVALID_NUMBER;
+    this->bufMgr->unPinPage(this->file, this->headerPageNum, true);
+
+    switch (attrType) {
+      case INTEGER:
+        build<int>(relationName);
+        break;
+      case DOUBLE:
+        build<double>(relationName);
+        break;
+      case STRING:
+        build<StringKey>(relationName);
+        break;
+      case COMPOSITE:
+        break;
+    }
+    writeDirectory();
+    this->bufMgr->flushFile(this->file);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::~HashIndex -- destructor
+// -----------------------------------------------------------------------------
+
+HashIndex::~HashIndex() {
+  writeDirectory();
+  this->bufMgr->flushFile(this->file);
+  this->bufMgr->clearFileClass(this->file);
+  delete this->file;
+  this->file = NULL;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::hashKey
+// -----------------------------------------------------------------------------
+
+std::uint64_t HashIndex::hashKey(const int &key) {
+  return mix((std::uint32_t)key);
+}
+
+std::uint64_t HashIndex::hashKey(const double &key) {
+  // -0.0 equals 0.0, so it has to hash alike
+  const double normalized = key == 0 ? 0.0 : key;
+  std::uint64_t bits;
+  memcpy(&bits, &normalized, sizeof(bits));
+  return mix(bits);
+}
+
+std::uint64_t HashIndex::hashKey(const StringKey &key) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < STRINGSIZE; i++) {
+    hash ^= (unsigned char)key.data[i];
+    hash *= 1099511628211ULL;
+  }
+  return mix(hash);
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+void HashIndex::insertEntry(const void *key, const RecordId rid) {
+  std::lock_guard<std::mutex> lock(this->latch);
+  switch (this->attributeType) {
+    case INTEGER:
+      insertKey(KeyTraits<int>::load(key), rid);
+      break;
+    case DOUBLE:
+      insertKey(KeyTraits<double>::load(key), rid);
+      break;
+    case STRING:
+      insertKey(KeyTraits<StringKey>::load(key), rid);
+      break;
+    case COMPOSITE:
+      break;
+  }
+}
+
+template <class T>
+void HashIndex::insertKey(const T &key, const RecordId rid) {
+  const std::uint64_t hash = hashKey(key);
+  const std::uint64_t depthMask = ((std::uint64_t)1 << MAX_GLOBAL_DEPTH) - 1;
+  while (true) {
+    const PageId bucketPageNo = bucketOf(hash);
+    Page *page;
+    this->bufMgr->readPage(this->file, bucketPageNo, page);
+    HashBucket<T> *bucket = (HashBucket<T> *)page;
+    if (bucket->numEntries < HashBucket<T>::CAPACITY) {
+      bucket->keyArray[bucket->numEntries] = key;
+      bucket->ridArray[bucket->numEntries] = rid;
+      bucket->numEntries++;
+      this->bufMgr->unPinPage(this->file, bucketPageNo, true);
+      return;
+    }
+
+    // A split helps as long as some key hashes apart from this one in the
+    // bits the directory can grow to
+    bool apart = false;
+    for (int i = 0; i < bucket->numEntries && !apart; i++) {
+      apart = ((hashKey(bucket->keyArray[i]) ^ hash) & depthMask) != 0;
+    }
+    if (apart) {
+      splitBucket<T>(bucketPageNo, page);
+      continue;
+    }
+
+    // Otherwise the entry goes to the first overflow page with room
+    PageId pageNo = bucketPageNo;
+    while (bucket->numEntries == HashBucket<T>::CAPACITY &&
+           bucket->overflowPageNo != Page::INVALID_NUMBER) {
+      const PageId nextPageNo = bucket->overflowPageNo;
+      this->bufMgr->unPinPage(this->file, pageNo, false);
+      pageNo = nextPageNo;
+      this->bufMgr->readPage(this->file, pageNo, page);
+      bucket = (HashBucket<T> *)page;
+    }
+    if (bucket->numEntries == HashBucket<T>::CAPACITY) {
+      PageId overflowPageNo;
+      this->bufMgr->allocPage(this->file, overflowPageNo, page);
+      HashBucket<T> *overflow = (HashBucket<T> *)page;
+      overflow->localDepth = 0;
+      overflow->numEntries = 0;
+      overflow->overflowPageNo = Page::INVALID_NUMBER;
+      bucket->overflowPageNo = overflowPageNo;
+      this->bufMgr->unPinPage(this->file, pageNo, true);
+      pageNo = overflowPageNo;
+      bucket = overflow;
+    }
+    bucket->keyArray[bucket->numEntries] = key;
+    bucket->ridArray[bucket->numEntries] = rid;
+    bucket->numEntries++;
+    this->bufMgr->unPinPage(this->file, pageNo, true);
+    return;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::splitBucket
+// -----------------------------------------------------------------------------
+
+template <class T>
+void HashIndex::splitBucket(const PageId bucketPageNo, Page *bucketPage) {
+  HashBucket<T> *bucket = (HashBucket<T> *)bucketPage;
+  const int depth = bucket->localDepth;
+  if (depth == this->globalDepth) {
+    // The directory's second half points where the first does
+    const std::size_t size = this->directory.size();
+    this->directory.resize(2 * size);
+    std::copy(this->directory.begin(), this->directory.begin() + size,
+              this->directory.begin() + size);
+    this->globalDepth++;
+    this->directoryDoublings++;
+  }
+
+  PageId siblingPageNo;
+  Page *page;
+  this->bufMgr->allocPage(this->file, siblingPageNo, page);
+  HashBucket<T> *target = (HashBucket<T> *)page;
+  target->localDepth = depth + 1;
+  target->numEntries = 0;
+  target->overflowPageNo = Page::INVALID_NUMBER;
+  PageId targetPageNo = siblingPageNo;
+  bucket->localDepth = depth + 1;
+
+  // Entries whose hash has the bit set move to the sibling, from the bucket
+  // and each of its overflow pages
+  const std::uint64_t bit = (std::uint64_t)1 << depth;
+  PageId pageNo = bucketPageNo;
+  while (true) {
+    int kept = 0;
+    for (int i = 0; i < bucket->numEntries; i++) {
+      if ((hashKey(bucket->keyArray[i]) & bit) == 0) {
+        bucket->keyArray[kept] = bucket->keyArray[i];
+        bucket->ridArray[kept] = bucket->ridArray[i];
+        kept++;
+        continue;
+      }
+      if (target->numEntries == HashBucket<T>::CAPACITY) {
+        PageId overflowPageNo;
+        this->bufMgr->allocPage(this->file, overflowPageNo, page);
+        HashBucket<T> *overflow = (HashBucket<T> *)page;
+        overflow->localDepth = 0;
+        overflow->numEntries = 0;
+        overflow->overflowPageNo = Page::INVALID_NUMBER;
+        target->overflowPageNo = overflowPageNo;
+        this->bufMgr->unPinPage(this->file, targetPageNo, true);
+        targetPageNo = overflowPageNo;
+        target = overflow;
+      }
+      target->keyArray[target->numEntries] = bucket->keyArray[i];
+      target->ridArray[target->numEntries] = bucket->ridArray[i];
+      target->numEntries++;
+    }
+    bucket->numEntries = kept;
+    const PageId nextPageNo = bucket->overflowPageNo;
+    this->bufMgr->unPinPage(this->file, pageNo, true);
+    if (nextPageNo == Page::INVALID_NUMBER) break;
+    pageNo = nextPageNo;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    bucket = (HashBucket<T> *)page;
+  }
+  this->bufMgr->unPinPage(this->file, targetPageNo, true);
+
+  for (std::size_t e = 0; e < this->directory.size(); e++) {
+    if (this->directory[e] == bucketPageNo && (e & bit) != 0) {
+      this->directory[e] = siblingPageNo;
+    }
+  }
+  this->bucketSplits++;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::lookup
+// -----------------------------------------------------------------------------
+
+bool HashIndex::lookup(const void *key, RecordId &outRid) {
+  std::lock_guard<std::mutex> lock(this->latch);
+  std::vector<RecordId> rids;
+  switch (this->attributeType) {
+    case INTEGER:
+      lookupKey(KeyTraits<int>::load(key), rids, 1);
+      break;
+    case DOUBLE:
+      lookupKey(KeyTraits<double>::load(key), rids, 1);
+      break;
+    case STRING:
+      lookupKey(KeyTraits<StringKey>::load(key), rids, 1);
+      break;
+    case COMPOSITE:
+      break;
+  }
+  if (rids.empty()) return false;
+  outRid = rids[0];
+  return true;
+}
+
+std::size_t HashIndex::lookupAll(const void *key,
+                                 std::vector<RecordId> &outRids) {
+  std::lock_guard<std::mutex> lock(this->latch);
+  outRids.clear();
+  const std::size_t all = (std::size_t)-1;
+  switch (this->attributeType) {
+    case INTEGER:
+      return lookupKey(KeyTraits<int>::load(key), outRids, all);
+    case DOUBLE:
+      return lookupKey(KeyTraits<double>::load(key), outRids, all);
+    case STRING:
+      return lookupKey(KeyTraits<StringKey>::load(key), outRids, all);
+    case COMPOSITE:
+      break;
+  }
+  return 0;
+}
+
+template <class T>
+std::size_t HashIndex::lookupKey(const T &key, std::vector<RecordId> &outRids,
+                                 const std::size_t maxRids) {
+  PageId pageNo = bucketOf(hashKey(key));
+  while (pageNo != Page::INVALID_NUMBER && outRids.size() < maxRids) {
+    Page *page;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    const HashBucket<T> *bucket = (const HashBucket<T> *)page;
+    for (int i = 0; i < bucket->numEntries && outRids.size() < maxRids; i++) {
+      if (bucket->keyArray[i] == key) outRids.push_back(bucket->ridArray[i]);
+    }
+    const PageId nextPageNo = bucket->overflowPageNo;
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+    pageNo = nextPageNo;
+  }
+  return outRids.size();
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool HashIndex::deleteEntry(const void *key, const RecordId rid) {
+  std::lock_guard<std::mutex> lock(this->latch);
+  switch (this->attributeType) {
+    case INTEGER:
+      return deleteKey(KeyTraits<int>::load(key), rid);
+    case DOUBLE:
+      return deleteKey(KeyTraits<double>::load(key), rid);
+    case STRING:
+      return deleteKey(KeyTraits<StringKey>::load(key), rid);
+    case COMPOSITE:
+      break;
+  }
+  return false;
+}
+
+template <class T>
+bool HashIndex::deleteKey(const T &key, const RecordId rid) {
+  PageId pageNo = bucketOf(hashKey(key));
+  while (pageNo != Page::INVALID_NUMBER) {
+    Page *page;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    HashBucket<T> *bucket = (HashBucket<T> *)page;
+    for (int i = 0; i < bucket->numEntries; i++) {
+      if (bucket->keyArray[i] == key && bucket->ridArray[i] == rid) {
+        // The last entry of the page takes its place
+        bucket->numEntries--;
+        bucket->keyArray[i] = bucket->keyArray[bucket->numEntries];
+        bucket->ridArray[i] = bucket->ridArray[bucket->numEntries];
+        this->bufMgr->unPinPage(this->file, pageNo, true);
+        return true;
+      }
+    }
+    const PageId nextPageNo = bucket->overflowPageNo;
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+    pageNo = nextPageNo;
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::build
+// -----------------------------------------------------------------------------
+
+template <class T>
+void HashIndex::build(const std::string &relationName) {
+  // A single empty bucket, which every hash maps to
+  PageId bucketPageNo;
+  Page *page;
+  this->bufMgr->allocPage(this->file, bucketPageNo, page);
+  HashBucket<T> *bucket = (HashBucket<T> *)page;
+  bucket->localDepth = 0;
+  bucket->numEntries = 0;
+  bucket->overflowPageNo = Page::INVALID_NUMBER;
+  this->bufMgr->unPinPage(this->file, bucketPageNo, true);
+  this->directory.assign(1, bucketPageNo);
+
+  FileScan fileScan(relationName, this->bufMgr);
+  RecordId rid;
+  try {
+    while (true) {
+      fileScan.scanNext(rid);
+      std::size_t length;
+      const char *record = fileScan.getRecordData(length);
+      insertKey(KeyTraits<T>::load(record + this->attrByteOffset), rid);
+    }
+  } catch (EndOfFileException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::getStats
+// -----------------------------------------------------------------------------
+
+HashIndexStats HashIndex::getStats() {
+  std::lock_guard<std::mutex> lock(this->latch);
+  HashIndexStats stats;
+  stats.globalDepth = this->globalDepth;
+  stats.buckets = 0;
+  stats.overflowPages = 0;
+  stats.entries = 0;
+  stats.bucketSplits = this->bucketSplits;
+  stats.directoryDoublings = this->directoryDoublings;
+  switch (this->attributeType) {
+    case INTEGER:
+      countBuckets<int>(stats);
+      break;
+    case DOUBLE:
+      countBuckets<double>(stats);
+      break;
+    case STRING:
+      countBuckets<StringKey>(stats);
+      break;
+    case COMPOSITE:
+      break;
+  }
+  return stats;
+}
+
+template <class T>
+void HashIndex::countBuckets(HashIndexStats &stats) {
+  std::vector<PageId> buckets(this->directory);
+  std::sort(buckets.begin(), buckets.end());
+  buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+  stats.buckets = buckets.size();
+  for (std::size_t b = 0; b < buckets.size(); b++) {
+    PageId pageNo = buckets[b];
+    while (pageNo != Page::INVALID_NUMBER) {
+      Page *page;
+      this->bufMgr->readPage(this->file, pageNo, page);
+      const HashBucket<T> *bucket = (const HashBucket<T> *)page;
+      stats.entries += bucket->numEntries;
+      if (pageNo != buckets[b]) stats.overflowPages++;
+      const PageId nextPageNo = bucket->overflowPageNo;
+      this->bufMgr->unPinPage(this->file, pageNo, false);
+      pageNo = nextPageNo;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// HashIndex::readDirectory / writeDirectory
+// -----------------------------------------------------------------------------
+
+void HashIndex::readDirectory(const PageId firstPageNo) {
+  this->directory.assign((std::size_t)1 << this->globalDepth,
+                         (PageId)Page::INVALID_NUMBER);
+  PageId pageNo = firstPageNo;
+  std::size_t e = 0;
+  while (e < this->directory.size()) {
+    Page *page;
+    this->bufMgr->readPage(this->file, pageNo, page);
+    const HashDirectoryPage *directoryPage = (const HashDirectoryPage *)page;
+    const std::size_t n = std::min(this->directory.size() - e,
+                                   (std::size_t)HASHDIRECTORYSIZE);
+    std::copy(directoryPage->bucketPageNo, directoryPage->bucketPageNo + n,
+              this->directory.begin() + e);
+    e += n;
+    const PageId nextPageNo = directoryPage->nextPageNo;
+    this->bufMgr->unPinPage(this->file, pageNo, false);
+    pageNo = nextPageNo;
+  }
+}
+
+void HashIndex::writeDirectory() {
+  Page *page;
+  this->bufMgr->readPage(this->file, this->headerPageNum, page);
+  HashIndexMetaInfo *meta = (HashIndexMetaInfo *)page;
+  meta->globalDepth = this->globalDepth;
+
+  // Each page is pinned until the link to the next one is set, the meta
+  // page's link to the first included
+  PageId *link = &meta->directoryPageNo;
+  PageId linkPageNo = this->headerPageNum;
+  std::size_t e = 0;
+  do {
+    PageId pageNo = *link;
+    if (pageNo == Page::INVALID_NUMBER) {
+      this->bufMgr->allocPage(this->file, pageNo, page);
+      ((HashDirectoryPage *)page)->nextPageNo = Page::INVALID_NUMBER;
+      *link = pageNo;
+    } else {
+      this->bufMgr->readPage(this->file, pageNo, page);
+    }
+    this->bufMgr->unPinPage(this->file, linkPageNo, true);
+
+    HashDirectoryPage *directoryPage = (HashDirectoryPage *)page;
+    const std::size_t n = std::min(this->directory.size() - e,
+                                   (std::size_t)HASHDIRECTORYSIZE);
+    std::copy(this->directory.begin() + e, this->directory.begin() + e + n,
+              directoryPage->bucketPageNo);
+    e += n;
+    link = &directoryPage->nextPageNo;
+    linkPageNo = pageNo;
+  } while (e < this->directory.size());
+  this->bufMgr->unPinPage(this->file, linkPageNo, true);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,363 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Bits of the hash of a key the directory of a HashIndex can grow to,
+ * so it has at most 2^MAX_GLOBAL_DEPTH entries. Keys whose hashes agree in
+ * all of these bits share a bucket, which chains overflow pages once full.
+ */
+const int MAX_GLOBAL_DEPTH = 24;
+
+/**
+ * @brief Number of directory entries a directory page holds.
+ */
+const int HASHDIRECTORYSIZE = (Page::SIZE - sizeof(PageId)) / sizeof(PageId);
+
+/**
+ * @brief Structure to store the meta data of a HashIndex in its header page.
+ */
+struct HashIndexMetaInfo {
+  /**
+   * Name of base relation.
+   */
+  char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in
+   * pages.
+   */
+  int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+  Datatype attrType;
+
+  /**
+   * Number of bits of the hash that index the directory.
+   */
+  int globalDepth;
+
+  /**
+   * Page number of the first directory page.
+   */
+  PageId directoryPageNo;
+};
+
+/**
+ * @brief A page of the directory of a HashIndex, whose pages are chained in
+ * order.
+ */
+struct HashDirectoryPage {
+  /**
+   * Page number of the next directory page, Page::INVALID_NUMBER if this is
+   * the last.
+   */
+  PageId nextPageNo;
+
+  /**
+   * Page number of the bucket of each directory entry.
+   */
+  PageId bucketPageNo[HASHDIRECTORYSIZE];
+};
+
+/**
+ * @brief A bucket page of a HashIndex, or an overflow page chained to one.
+ * Entries are kept unordered, in the order they came in.
+ */
+template <class T>
+struct HashBucket {
+  /**
+   * Number of entries a bucket page holds.
+   */
+  static const int CAPACITY =
+      (Page::SIZE - 2 * sizeof(int) - sizeof(PageId)) /
+      (sizeof(T) + sizeof(RecordId));
+
+  /**
+   * Number of low bits of the hash that all keys of the bucket share. Unused
+   * in overflow pages.
+   */
+  int localDepth;
+
+  /**
+   * Number of entries in the page.
+   */
+  int numEntries;
+
+  /**
+   * Page number of the next overflow page, Page::INVALID_NUMBER if there is
+   * none. Only buckets whose keys all hash alike have overflow pages.
+   */
+  PageId overflowPageNo;
+
+  T keyArray[CAPACITY];
+  RecordId ridArray[CAPACITY];
+};
+
+static_assert(sizeof(HashIndexMetaInfo) <= Page::SIZE,
+              "hash index meta page too large");
+static_assert(sizeof(HashDirectoryPage) <= Page::SIZE,
+              "hash directory page too large");
+static_assert(sizeof(HashBucket<int>) <= Page::SIZE,
+              "hash bucket too large");
+static_assert(sizeof(HashBucket<double>) <= Page::SIZE,
+              "hash bucket too large");
+static_assert(sizeof(HashBucket<StringKey>) <= Page::SIZE,
+              "hash bucket too large");
+
+/**
+ * @brief Shape of a HashIndex and the work done on it since it was opened,
+ * as HashIndex::getStats() finds them.
+ */
+struct HashIndexStats {
+  /**
+   * Number of bits of the hash that index the directory
+   */
+  int globalDepth;
+
+  /**
+   * Number of distinct buckets, and overflow pages chained to them
+   */
+  std::size_t buckets;
+  std::size_t overflowPages;
+
+  /**
+   * Number of entries in the buckets and their overflow pages
+   */
+  std::size_t entries;
+
+  /**
+   * Buckets split in two, and splits that doubled the directory
+   */
+  std::uint64_t bucketSplits;
+  std::uint64_t directoryDoublings;
+};
+
+/**
+ * @brief Extendible hash index on an INTEGER, DOUBLE or STRING attribute of a
+ * relation, for workloads that only look keys up by equality.
+ *
+ * The directory maps the low globalDepth bits of a key's hash to its bucket
+ * page. It is kept in memory while the index is open, so a lookup reads a
+ * single page unless the bucket has overflow pages. A full bucket is split in
+ * two on its next bit, which doubles the directory if the bucket used all of
+ * its bits; other buckets are left alone, so inserts never stall on a
+ * rebuild. Buckets are not merged when entries are deleted.
+ *
+ * The directory is written back to the file when the index is destroyed. The
+ * index latches itself for each call, so it can be shared by threads.
+ */
+class HashIndex {
+ private:
+  /**
+   * File object for the index file.
+   */
+  File *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+  PageId headerPageNum;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  /**
+   * Number of bits of the hash that index the directory.
+   */
+  int globalDepth;
+
+  /**
+   * Bucket page of each directory entry, 2^globalDepth of them.
+   */
+  std::vector<PageId> directory;
+
+  /**
+   * Buckets split, and directory doublings, since the index was opened.
+   */
+  std::uint64_t bucketSplits;
+  std::uint64_t directoryDoublings;
+
+  /**
+   * Held by every public method for the whole call.
+   */
+  mutable std::mutex latch;
+
+  /**
+   * Returns the hash of a key, the same for keys that compare equal.
+   */
+  static std::uint64_t hashKey(const int &key);
+  static std::uint64_t hashKey(const double &key);
+  static std::uint64_t hashKey(const StringKey &key);
+
+  /**
+   * Returns the page number of the bucket of a hash.
+   */
+  PageId bucketOf(const std::uint64_t hash) const {
+    return directory[hash & (((std::uint64_t)1 << globalDepth) - 1)];
+  }
+
+  /**
+   * Insert an entry, splitting the bucket of the key until it has room or
+   * chaining an overflow page to it if its keys cannot be told apart.
+   * insertEntry() dispatches on the attribute type once and calls this.
+   */
+  template <class T>
+  void insertKey(const T &key, const RecordId rid);
+
+  /**
+   * Split a full bucket on bit localDepth of the hash, doubling the
+   * directory first if that bit does not index it yet. The entries whose hash
+   * has the bit set move to a new bucket. A bucket with overflow pages moves
+   * as a whole, since all its keys hash alike.
+   * @param bucketPageNo  Page number of the bucket
+   * @param bucketPage    The bucket, pinned, which is unpinned
+   */
+  template <class T>
+  void splitBucket(const PageId bucketPageNo, Page *bucketPage);
+
+  /**
+   * Find the entries with a key, up to maxRids of them.
+   * lookup() and lookupAll() dispatch on the attribute type once and call
+   * this.
+   * @return Number of entries found
+   */
+  template <class T>
+  std::size_t lookupKey(const T &key, std::vector<RecordId> &outRids,
+                        const std::size_t maxRids);
+
+  /**
+   * Delete an entry. deleteEntry() dispatches on the attribute type once and
+   * calls this.
+   * @return True if the entry was found
+   */
+  template <class T>
+  bool deleteKey(const T &key, const RecordId rid);
+
+  /**
+   * Insert the entry of every record of the relation.
+   */
+  template <class T>
+  void build(const std::string &relationName);
+
+  /**
+   * Count the buckets, overflow pages and entries into stats.
+   */
+  template <class T>
+  void countBuckets(HashIndexStats &stats);
+
+  /**
+   * Read the directory from the chain of directory pages.
+   */
+  void readDirectory(const PageId firstPageNo);
+
+  /**
+   * Write the directory to the chain of directory pages, which grows as
+   * needed, and the global depth to the meta page.
+   */
+  void writeDirectory();
+
+ public:
+  /**
+   * HashIndex Constructor.
+   * Check to see if the corresponding index file exists. If so, open the file.
+   * If not, create it and insert entries for every tuple in the base relation
+   * using FileScan class. The index file is named after the relation and the
+   * attribute's offset, such as "rel.0.hash".
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param attrByteOffset      Offset of attribute, over which index is to be
+   * built, in the record
+   * @param attrType            Datatype of attribute over which index is built
+   * @throws  BadIndexInfoException     If the attribute is COMPOSITE, or the
+   * index file already exists for the corresponding attribute, but values in
+   * metapage(relationName, attribute byte offset, attribute type) do not match
+   * with values received through constructor parameters.
+   */
+  HashIndex(const std::string &relationName, std::string &outIndexName,
+            BufMgr *bufMgrIn, const int attrByteOffset,
+            const Datatype attrType);
+
+  /**
+   * HashIndex Destructor.
+   * Write the directory back, flush the index file and close it. Destructor
+   * should not throw any exceptions.
+   */
+  ~HashIndex();
+
+  /**
+   * Insert a new entry using the pair <value,rid>.
+   * @param key     Key to insert, pointer to integer/double/char string
+   * @param rid     Record ID of a record whose entry is getting inserted into
+   *the index.
+   **/
+  void insertEntry(const void *key, const RecordId rid);
+
+  /**
+   * Find an entry with the given key.
+   * @param key     Key to look up, pointer to integer/double/char string
+   * @param outRid  RecordId of the entry found, if any
+   * @return True if an entry was found
+   **/
+  bool lookup(const void *key, RecordId &outRid);
+
+  /**
+   * Find every entry with the given key.
+   * @param key      Key to look up, pointer to integer/double/char string
+   * @param outRids  RecordIds of the entries found, in no particular order,
+   *replaced via this reference
+   * @return Number of entries found
+   **/
+  std::size_t lookupAll(const void *key, std::vector<RecordId> &outRids);
+
+  /**
+   * Delete the entry with the given key and record id.
+   * @param key     Key of the entry, pointer to integer/double/char string
+   * @param rid     Record ID of the entry
+   * @return True if the entry was found and deleted
+   **/
+  bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Return the shape of the index, found by reading all of its buckets, and
+   * the splits done since it was opened.
+   **/
+  HashIndexStats getStats();
+};
+
+}  // namespace badgerdb
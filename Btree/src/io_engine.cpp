@@ -0,0 +1,214 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "exceptions/io_engine_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+int ioUringSetup(const unsigned entries, io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+int ioUringEnter(const int ringFd, const unsigned toSubmit,
+                 const unsigned minComplete, const unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags,
+                      NULL, 0);
+}
+
+}  // namespace
+
+IoEngine::IoEngine(const std::uint32_t depth)
+    : queueDepth(depth),
+      ringFd(-1),
+      sqRing(MAP_FAILED),
+      cqRing(MAP_FAILED),
+      sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+      inFlight(0) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ringFd = ioUringSetup(queueDepth, &params);
+  if (ringFd < 0) throw IoEngineException(errno);
+
+  sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+  sqes = static_cast<io_uring_sqe*>(mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, ringFd,
+                                         IORING_OFF_SQES));
+  if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+    const int error = errno;
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    if (cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+    if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+    close(ringFd);
+    throw IoEngineException(error);
+  }
+
+  char* sq = static_cast<char*>(sqRing);
+  sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+  char* cq = static_cast<char*>(cqRing);
+  cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  // The kernel may round the ring up, but never hands out fewer entries. The
+  // completion ring is larger still, so it cannot overflow.
+  if (queueDepth > params.sq_entries) queueDepth = params.sq_entries;
+
+  completionThread = std::thread(&IoEngine::reap, this);
+}
+
+IoEngine::~IoEngine() {
+  // A no-op without a request tells the completion thread to stop
+  struct iovec none = {NULL, 0};
+  while (push(IORING_OP_NOP, -1, &none, 0, 0) == -EAGAIN) {
+    std::this_thread::yield();
+  }
+  completionThread.join();
+
+  munmap(sqes, sqesSize);
+  munmap(cqRing, cqRingSize);
+  munmap(sqRing, sqRingSize);
+  close(ringFd);
+}
+
+bool IoEngine::isSupported() {
+  static const bool supported = [] {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    const int fd = ioUringSetup(1, &params);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+  }();
+  return supported;
+}
+
+ssize_t IoEngine::read(const int fd, void* buffer, const std::size_t size,
+                       const off_t offset) {
+  return submit(IORING_OP_READV, fd, buffer, size, offset);
+}
+
+ssize_t IoEngine::write(const int fd, const void* buffer,
+                        const std::size_t size, const off_t offset) {
+  return submit(IORING_OP_WRITEV, fd, const_cast<void*>(buffer), size, offset);
+}
+
+ssize_t IoEngine::submit(const std::uint8_t opcode, const int fd, void* buffer,
+                         const std::size_t size, const off_t offset) {
+  Request request;
+  request.vec.iov_base = buffer;
+  request.vec.iov_len = size;
+  request.done = false;
+  request.result = 0;
+
+  {
+    std::unique_lock<std::mutex> lock(requestLatch);
+    requestDone.wait(lock, [this] { return inFlight < queueDepth; });
+    inFlight++;
+  }
+
+  const int error = push(opcode, fd, &request.vec, offset,
+                         reinterpret_cast<std::uintptr_t>(&request));
+  std::unique_lock<std::mutex> lock(requestLatch);
+  if (error != 0) {
+    inFlight--;
+    requestDone.notify_all();
+    errno = -error;
+    return -1;
+  }
+  requestDone.wait(lock, [&request] { return request.done; });
+
+  if (request.result < 0) {
+    errno = -request.result;
+    return -1;
+  }
+  return request.result;
+}
+
+int IoEngine::push(const std::uint8_t opcode, const int fd,
+                   const struct iovec* vec, const off_t offset,
+                   const std::uint64_t userData) {
+  std::lock_guard<std::mutex> lock(submitLatch);
+
+  // Only this thread moves the tail, and the kernel consumes every entry
+  // before io_uring_enter returns, so the ring is empty here
+  const unsigned tail = *sqTail;
+  const unsigned index = tail & *sqMask;
+  io_uring_sqe* sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<std::uintptr_t>(vec);
+  sqe->len = 1;
+  sqe->off = offset;
+  sqe->user_data = userData;
+  sqArray[index] = index;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+  while (ioUringEnter(ringFd, 1, 0, 0) < 0) {
+    if (errno == EINTR) continue;
+    // Not taken, so withdraw the entry
+    const int error = errno;
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+    return -error;
+  }
+  return 0;
+}
+
+void IoEngine::reap() {
+  while (true) {
+    unsigned head = *cqHead;
+    const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      ioUringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+      continue;
+    }
+
+    bool stop = false;
+    {
+      std::lock_guard<std::mutex> lock(requestLatch);
+      for (; head != tail; head++) {
+        const io_uring_cqe& cqe = cqes[head & *cqMask];
+        if (cqe.user_data == 0) {
+          stop = true;
+          continue;
+        }
+        Request* request = reinterpret_cast<Request*>(cqe.user_data);
+        request->result = cqe.res;
+        request->done = true;
+        inFlight--;
+      }
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    requestDone.notify_all();
+    if (stop) return;
+  }
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,173 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace badgerdb {
+
+/**
+ * @brief Asynchronous I/O engine that submits positioned reads and writes
+ * through a Linux io_uring.
+ *
+ * Any number of threads can issue requests at once. Up to the queue depth of
+ * them are in flight in the kernel together, so the page faults of several
+ * scans overlap instead of waiting for each other. Each call still returns
+ * only once its own request has completed. A completion thread reaps the
+ * completion queue and wakes up the threads whose requests finished.
+ *
+ * The ring is set up with raw system calls, so no library beyond the kernel
+ * headers is needed.
+ */
+class IoEngine {
+ public:
+  /**
+   * Sets up a ring with room for queueDepth requests in flight.
+   *
+   * @param queueDepth  Maximum number of requests in flight at once
+   * @throws  IoEngineException if the kernel does not support io_uring
+   */
+  explicit IoEngine(const std::uint32_t queueDepth);
+
+  /**
+   * Waits for the requests in flight and tears down the ring.
+   */
+  ~IoEngine();
+
+  /**
+   * Returns true if the kernel lets this process set up an io_uring.
+   */
+  static bool isSupported();
+
+  /**
+   * Reads like pread(), through the ring.
+   *
+   * @param fd      File descriptor to read from
+   * @param buffer  Memory to read into
+   * @param size    Number of bytes to read
+   * @param offset  Position in the file to read from
+   * @return  Number of bytes read, or -1 with errno set
+   */
+  ssize_t read(const int fd, void* buffer, const std::size_t size,
+               const off_t offset);
+
+  /**
+   * Writes like pwrite(), through the ring.
+   *
+   * @param fd      File descriptor to write to
+   * @param buffer  Memory to write from
+   * @param size    Number of bytes to write
+   * @param offset  Position in the file to write to
+   * @return  Number of bytes written, or -1 with errno set
+   */
+  ssize_t write(const int fd, const void* buffer, const std::size_t size,
+                const off_t offset);
+
+ private:
+  /**
+   * One request, owned by the thread waiting for it.
+   */
+  struct Request {
+    struct iovec vec;
+    bool done;
+    int result;
+  };
+
+  /**
+   * Queues one request, waits for it and returns its result.
+   */
+  ssize_t submit(const std::uint8_t opcode, const int fd, void* buffer,
+                 const std::size_t size, const off_t offset);
+
+  /**
+   * Adds one entry to the submission ring and hands it to the kernel.
+   *
+   * @return  0, or the negated errno if the kernel did not take it
+   */
+  int push(const std::uint8_t opcode, const int fd, const struct iovec* vec,
+           const off_t offset, const std::uint64_t userData);
+
+  /**
+   * Body of the completion thread.
+   */
+  void reap();
+
+  // No copying
+  IoEngine(const IoEngine&);
+  IoEngine& operator=(const IoEngine&);
+
+  /**
+   * Maximum number of requests in flight
+   */
+  std::uint32_t queueDepth;
+
+  /**
+   * Descriptor of the ring
+   */
+  int ringFd;
+
+  /**
+   * Mapped submission and completion rings, and the submission queue entries
+   */
+  void* sqRing;
+  std::size_t sqRingSize;
+  void* cqRing;
+  std::size_t cqRingSize;
+  io_uring_sqe* sqes;
+  std::size_t sqesSize;
+
+  /**
+   * Fields of the submission ring shared with the kernel
+   */
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+
+  /**
+   * Fields of the completion ring shared with the kernel
+   */
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  io_uring_cqe* cqes;
+
+  /**
+   * Serializes filling in the submission ring
+   */
+  std::mutex submitLatch;
+
+  /**
+   * Protects inFlight and the done flags of the requests, with requestDone
+   * signalled whenever a request completes
+   */
+  std::mutex requestLatch;
+  std::condition_variable requestDone;
+
+  /**
+   * Number of requests submitted and not yet reaped
+   */
+  std::uint32_t inFlight;
+
+  /**
+   * Reaps completions until the engine is destroyed
+   */
+  std::thread completionThread;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,344 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "join.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+
+namespace badgerdb {
+
+const std::size_t IndexNestedLoopJoin::NO_POSITION;
+
+namespace {
+
+/**
+ * Returns the size of a key of an index on an attribute of type, or 0 if
+ * joins do not take such indexes.
+ */
+std::size_t joinKeySize(const Datatype type) {
+  switch (type) {
+    case INTEGER:
+      return sizeof(int);
+    case DOUBLE:
+      return sizeof(double);
+    case STRING:
+      return STRINGSIZE;
+    case COMPOSITE:
+      break;
+  }
+  return 0;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::IndexNestedLoopJoin -- Constructor
+// -----------------------------------------------------------------------------
+
+IndexNestedLoopJoin::IndexNestedLoopJoin(const std::string &outerRelation,
+                                         const int outerAttrByteOffset,
+                                         BTreeIndex *inner, BufMgr *bufMgr,
+                                         const std::size_t batchSize)
+    : inner(inner),
+      keyType(inner->attributeType),
+      keySize(joinKeySize(inner->attributeType)),
+      outerAttrByteOffset(outerAttrByteOffset),
+      batchSize(batchSize),
+      outerScan(outerRelation, bufMgr),
+      outerDone(false),
+      outerCount(0),
+      innerCount(0),
+      innerPos(0),
+      innerDone(true),
+      groupBegin(0),
+      outerPos(NO_POSITION) {
+  if (this->keySize == 0 || batchSize == 0) {
+    throw BadIndexInfoException("join of " + outerRelation);
+  }
+  this->outerKeys.reset(new char[batchSize * this->keySize]);
+  this->outerRids.resize(batchSize);
+  this->innerKeys.reset(new char[batchSize * this->keySize]);
+  this->innerRids.resize(batchSize);
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::~IndexNestedLoopJoin -- destructor
+// -----------------------------------------------------------------------------
+
+IndexNestedLoopJoin::~IndexNestedLoopJoin() {
+  if (this->cursor.isScanning()) this->inner->endScan(this->cursor);
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::next
+// -----------------------------------------------------------------------------
+
+std::size_t IndexNestedLoopJoin::next(JoinPair *outPairs,
+                                      const std::size_t maxPairs) {
+  switch (this->keyType) {
+    case INTEGER:
+      return nextPairs<int>(outPairs, maxPairs);
+    case DOUBLE:
+      return nextPairs<double>(outPairs, maxPairs);
+    case STRING:
+      return nextPairs<StringKey>(outPairs, maxPairs);
+    case COMPOSITE:
+      break;
+  }
+  return 0;
+}
+
+template <class T>
+std::size_t IndexNestedLoopJoin::nextPairs(JoinPair *outPairs,
+                                           const std::size_t maxPairs) {
+  const char *outerKeys = this->outerKeys.get();
+  std::size_t numPairs = 0;
+  while (numPairs < maxPairs) {
+    if (this->innerPos < this->innerCount) {
+      // Pair the inner entry with every outer record of its key, which come
+      // no earlier than those of the entry before
+      const T key = KeyTraits<T>::load(this->innerKeys.get() +
+                                       this->innerPos * this->keySize);
+      if (this->outerPos == NO_POSITION) {
+        while (this->groupBegin < this->outerCount &&
+               KeyTraits<T>::load(outerKeys +
+                                  this->groupBegin * this->keySize) < key) {
+          this->groupBegin++;
+        }
+        this->outerPos = this->groupBegin;
+      }
+      while (this->outerPos < this->outerCount &&
+             KeyTraits<T>::load(outerKeys + this->outerPos * this->keySize) ==
+                 key) {
+        if (numPairs == maxPairs) return numPairs;
+        outPairs[numPairs].outer = this->outerRids[this->outerPos];
+        outPairs[numPairs].inner = this->innerRids[this->innerPos];
+        numPairs++;
+        this->outerPos++;
+      }
+      this->innerPos++;
+      this->outerPos = NO_POSITION;
+    } else if (!this->innerDone) {
+      this->innerCount = this->inner->scanNextBatch(
+          this->cursor, this->innerRids.data(), this->innerKeys.get(),
+          this->batchSize);
+      this->innerPos = 0;
+      if (this->innerCount < this->batchSize) {
+        this->innerDone = true;
+        this->inner->endScan(this->cursor);
+      }
+    } else if (!readOuterBatch<T>()) {
+      break;
+    }
+  }
+  return numPairs;
+}
+
+// -----------------------------------------------------------------------------
+// IndexNestedLoopJoin::readOuterBatch
+// -----------------------------------------------------------------------------
+
+template <class T>
+bool IndexNestedLoopJoin::readOuterBatch() {
+  std::vector<std::pair<T, RecordId> > batch;
+  batch.reserve(this->batchSize);
+  try {
+    while (!this->outerDone && batch.size() < this->batchSize) {
+      RecordId rid;
+      this->outerScan.scanNext(rid);
+      std::size_t length;
+      const char *record = this->outerScan.getRecordData(length);
+      batch.push_back(std::make_pair(
+          KeyTraits<T>::load(record + this->outerAttrByteOffset), rid));
+    }
+  } catch (EndOfFileException &e) {
+    this->outerDone = true;
+  }
+  if (batch.empty()) return false;
+
+  std::stable_sort(batch.begin(), batch.end(),
+                   [](const std::pair<T, RecordId> &a,
+                      const std::pair<T, RecordId> &b) {
+                     return a.first < b.first;
+                   });
+  std::vector<T> keys;
+  for (std::size_t e = 0; e < batch.size(); e++) {
+    memcpy(this->outerKeys.get() + e * this->keySize, &batch[e].first,
+           this->keySize);
+    this->outerRids[e] = batch[e].second;
+    if (keys.empty() || keys.back() < batch[e].first) {
+      keys.push_back(batch[e].first);
+    }
+  }
+  this->outerCount = batch.size();
+  this->groupBegin = 0;
+  this->outerPos = NO_POSITION;
+  this->innerCount = 0;
+  this->innerPos = 0;
+
+  // One range per distinct key, which the scan visits in order
+  std::vector<ScanRange> ranges(keys.size());
+  for (std::size_t k = 0; k < keys.size(); k++) {
+    ranges[k].lowVal = &keys[k];
+    ranges[k].lowOp = GTE;
+    ranges[k].highVal = &keys[k];
+    ranges[k].highOp = LTE;
+  }
+  try {
+    this->inner->startScan(this->cursor, ranges);
+    this->innerDone = false;
+  } catch (NoSuchKeyFoundException &e) {
+    this->innerDone = true;
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// MergeJoin::MergeJoin -- Constructor
+// -----------------------------------------------------------------------------
+
+MergeJoin::MergeJoin(BTreeIndex *outer, BTreeIndex *inner,
+                     const std::size_t batchSize)
+    : keyType(outer->attributeType),
+      keySize(joinKeySize(outer->attributeType)),
+      batchSize(batchSize),
+      groupPos(0),
+      groupActive(false) {
+  if (this->keySize == 0 || inner->attributeType != outer->attributeType ||
+      batchSize == 0) {
+    throw BadIndexInfoException("merge join");
+  }
+  Input *inputs[2] = {&this->outer, &this->inner};
+  BTreeIndex *indexes[2] = {outer, inner};
+  for (int i = 0; i < 2; i++) {
+    Input &input = *inputs[i];
+    input.index = indexes[i];
+    input.keys.reset(new char[batchSize * this->keySize]);
+    input.rids.resize(batchSize);
+    input.count = 0;
+    input.pos = 0;
+    input.done = false;
+    try {
+      input.index->startScan(input.cursor, NULL, GTE, NULL, LTE);
+    } catch (NoSuchKeyFoundException &e) {
+      input.done = true;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// MergeJoin::~MergeJoin -- destructor
+// -----------------------------------------------------------------------------
+
+MergeJoin::~MergeJoin() {
+  if (this->outer.cursor.isScanning()) {
+    this->outer.index->endScan(this->outer.cursor);
+  }
+  if (this->inner.cursor.isScanning()) {
+    this->inner.index->endScan(this->inner.cursor);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// MergeJoin::Input::available
+// -----------------------------------------------------------------------------
+
+bool MergeJoin::Input::available(const std::size_t batchSize) {
+  if (this->pos < this->count) return true;
+  if (this->done) return false;
+  this->count = this->index->scanNextBatch(this->cursor, this->rids.data(),
+                                           this->keys.get(), batchSize);
+  this->pos = 0;
+  if (this->count < batchSize) {
+    this->done = true;
+    this->index->endScan(this->cursor);
+  }
+  return this->count > 0;
+}
+
+// -----------------------------------------------------------------------------
+// MergeJoin::next
+// -----------------------------------------------------------------------------
+
+std::size_t MergeJoin::next(JoinPair *outPairs, const std::size_t maxPairs) {
+  switch (this->keyType) {
+    case INTEGER:
+      return nextPairs<int>(outPairs, maxPairs);
+    case DOUBLE:
+      return nextPairs<double>(outPairs, maxPairs);
+    case STRING:
+      return nextPairs<StringKey>(outPairs, maxPairs);
+    case COMPOSITE:
+      break;
+  }
+  return 0;
+}
+
+template <class T>
+std::size_t MergeJoin::nextPairs(JoinPair *outPairs,
+                                 const std::size_t maxPairs) {
+  Input &outer = this->outer;
+  Input &inner = this->inner;
+  std::size_t numPairs = 0;
+  while (numPairs < maxPairs) {
+    if (this->groupActive) {
+      // Pair each outer entry of the group's key with the whole group
+      const T key = KeyTraits<T>::load(this->groupKey);
+      if (!outer.available(this->batchSize) ||
+          !(KeyTraits<T>::load(outer.keys.get() + outer.pos * this->keySize) ==
+            key)) {
+        this->groupActive = false;
+        continue;
+      }
+      while (this->groupPos < this->group.size()) {
+        if (numPairs == maxPairs) return numPairs;
+        outPairs[numPairs].outer = outer.rids[outer.pos];
+        outPairs[numPairs].inner = this->group[this->groupPos];
+        numPairs++;
+        this->groupPos++;
+      }
+      outer.pos++;
+      this->groupPos = 0;
+      continue;
+    }
+
+    if (!outer.available(this->batchSize) ||
+        !inner.available(this->batchSize)) {
+      break;
+    }
+    const T outerKey =
+        KeyTraits<T>::load(outer.keys.get() + outer.pos * this->keySize);
+    const T innerKey =
+        KeyTraits<T>::load(inner.keys.get() + inner.pos * this->keySize);
+    if (outerKey < innerKey) {
+      outer.pos++;
+    } else if (innerKey < outerKey) {
+      inner.pos++;
+    } else {
+      // Gather the inner entries of the key, which may span batches
+      memcpy(this->groupKey, &innerKey, this->keySize);
+      this->group.clear();
+      while (inner.available(this->batchSize) &&
+             KeyTraits<T>::load(inner.keys.get() +
+                                inner.pos * this->keySize) == innerKey) {
+        this->group.push_back(inner.rids[inner.pos]);
+        inner.pos++;
+      }
+      this->groupPos = 0;
+      this->groupActive = true;
+    }
+  }
+  return numPairs;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,253 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "filescan.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Number of entries a join reads from each of its inputs at a time.
+ */
+const std::size_t JOIN_BATCH_SIZE = 1024;
+
+/**
+ * @brief Record ids of a record of the outer input of a join and a record of
+ * the inner input whose keys are equal.
+ */
+struct JoinPair {
+  RecordId outer;
+  RecordId inner;
+};
+
+/**
+ * @brief Equi-join of a relation with an index on an INTEGER, DOUBLE or STRING
+ * attribute of another, probing the index for the key of each record of the
+ * relation.
+ *
+ * Records of the outer relation are read a batch at a time and sorted by key.
+ * The distinct keys of a batch are looked up in the inner index with a single
+ * scan of several ranges on one cursor, which goes on in the same leaf from
+ * one key to the next whenever it can instead of descending the tree again,
+ * and reads the matching entries in batches.
+ *
+ * The pairs of each batch come out in key order, and those of equal keys in
+ * the order of the outer relation and then of the index. Like a cursor, a
+ * join is used by one thread at a time.
+ */
+class IndexNestedLoopJoin {
+ private:
+  /**
+   * Index of the inner input, and the type and size of its keys.
+   */
+  BTreeIndex *inner;
+  Datatype keyType;
+  std::size_t keySize;
+
+  /**
+   * Offset of the join attribute inside records of the outer relation.
+   */
+  int outerAttrByteOffset;
+
+  /**
+   * Number of outer records, and of inner entries, read at a time.
+   */
+  std::size_t batchSize;
+
+  /**
+   * Scan of the outer relation, and whether it reached the end.
+   */
+  FileScan outerScan;
+  bool outerDone;
+
+  /**
+   * Keys and record ids of the current batch of outer records, sorted by key.
+   */
+  std::unique_ptr<char[]> outerKeys;
+  std::vector<RecordId> outerRids;
+  std::size_t outerCount;
+
+  /**
+   * Scan of the inner index for the keys of the batch.
+   */
+  IndexCursor cursor;
+
+  /**
+   * Keys and record ids of the inner entries last read from the scan, the
+   * next one to pair up, and whether the scan is complete.
+   */
+  std::unique_ptr<char[]> innerKeys;
+  std::vector<RecordId> innerRids;
+  std::size_t innerCount;
+  std::size_t innerPos;
+  bool innerDone;
+
+  /**
+   * First outer record whose key is not below the key of the next inner
+   * entry, and the next outer record to pair with that entry, or
+   * NO_POSITION if it has not been paired with any yet.
+   */
+  std::size_t groupBegin;
+  std::size_t outerPos;
+
+  static const std::size_t NO_POSITION = (std::size_t)-1;
+
+  IndexNestedLoopJoin(const IndexNestedLoopJoin &);
+  IndexNestedLoopJoin &operator=(const IndexNestedLoopJoin &);
+
+  /**
+   * Write the next pairs to outPairs, up to maxPairs of them. next()
+   * dispatches on the key type once and calls this.
+   */
+  template <class T>
+  std::size_t nextPairs(JoinPair *outPairs, const std::size_t maxPairs);
+
+  /**
+   * Read and sort the next batch of outer records, and start the scan of the
+   * inner index for their keys.
+   * @return  False if there are no more outer records
+   */
+  template <class T>
+  bool readOuterBatch();
+
+ public:
+  /**
+   * Set up the join. No record is read until next() is called.
+   * @param outerRelation        Name of the outer relation
+   * @param outerAttrByteOffset  Offset of the join attribute in its records
+   * @param inner                Index of the inner input, on an attribute of
+   * the same type as the outer one
+   * @param bufMgr               Buffer Manager Instance
+   * @param batchSize            Outer records sorted together, and inner
+   * entries read, at a time
+   * @throws  BadIndexInfoException  If the index is COMPOSITE or batchSize is
+   * 0.
+   */
+  IndexNestedLoopJoin(const std::string &outerRelation,
+                      const int outerAttrByteOffset, BTreeIndex *inner,
+                      BufMgr *bufMgr,
+                      const std::size_t batchSize = JOIN_BATCH_SIZE);
+
+  /**
+   * Ends the scan of the inner index, if one is executing.
+   */
+  ~IndexNestedLoopJoin();
+
+  /**
+   * Fetch the next pairs of matching records.
+   * @param outPairs  Array receiving the pairs
+   * @param maxPairs  Number of pairs the array can hold
+   * @return  Number of pairs written. Fewer than maxPairs means the join is
+   * complete, and once it is every further call returns 0.
+   */
+  std::size_t next(JoinPair *outPairs, const std::size_t maxPairs);
+};
+
+/**
+ * @brief Equi-join of two indexes on INTEGER, DOUBLE or STRING attributes of
+ * the same type, walking the leaves of both in key order in step.
+ *
+ * Entries are read from each index in batches, with a cursor each. The
+ * entries of the inner index that share a key are kept while the outer
+ * entries with that key are paired with them, so each leaf is read once
+ * however many keys repeat. The pairs come out in key order, and those of
+ * equal keys in the order of the outer index and then of the inner. The two
+ * indexes may be the same. Like a cursor, a join is used by one thread at a
+ * time.
+ */
+class MergeJoin {
+ private:
+  /**
+   * One input of the join: the scan of an index, and the entries last read
+   * from it.
+   */
+  struct Input {
+    BTreeIndex *index;
+    IndexCursor cursor;
+    std::unique_ptr<char[]> keys;
+    std::vector<RecordId> rids;
+    std::size_t count;
+    std::size_t pos;
+    bool done;
+
+    /**
+     * Read the next batch of entries if every entry read has been used.
+     * @return  False if there are no entries left
+     */
+    bool available(const std::size_t batchSize);
+  };
+
+  /**
+   * Type and size of the keys of both indexes.
+   */
+  Datatype keyType;
+  std::size_t keySize;
+
+  /**
+   * Number of entries read from each index at a time.
+   */
+  std::size_t batchSize;
+
+  Input outer;
+  Input inner;
+
+  /**
+   * Key of the inner entries being paired up, their record ids, and the
+   * next one to pair with the current outer entry, if groupActive.
+   */
+  char groupKey[STRINGSIZE];
+  std::vector<RecordId> group;
+  std::size_t groupPos;
+  bool groupActive;
+
+  MergeJoin(const MergeJoin &);
+  MergeJoin &operator=(const MergeJoin &);
+
+  /**
+   * Write the next pairs to outPairs, up to maxPairs of them. next()
+   * dispatches on the key type once and calls this.
+   */
+  template <class T>
+  std::size_t nextPairs(JoinPair *outPairs, const std::size_t maxPairs);
+
+ public:
+  /**
+   * Set up the join, starting a scan of each index.
+   * @param outer      Index of the outer input
+   * @param inner      Index of the inner input
+   * @param batchSize  Entries read from each index at a time
+   * @throws  BadIndexInfoException  If the keys of the indexes are of
+   * different types or COMPOSITE, or batchSize is 0.
+   */
+  MergeJoin(BTreeIndex *outer, BTreeIndex *inner,
+            const std::size_t batchSize = JOIN_BATCH_SIZE);
+
+  /**
+   * Ends the scans of the indexes that are still executing.
+   */
+  ~MergeJoin();
+
+  /**
+   * Fetch the next pairs of matching records.
+   * @param outPairs  Array receiving the pairs
+   * @param maxPairs  Number of pairs the array can hold
+   * @return  Number of pairs written. Fewer than maxPairs means the join is
+   * complete, and once it is every further call returns 0.
+   */
+  std::size_t next(JoinPair *outPairs, const std::size_t maxPairs);
+};
+
+}  // namespace badgerdb
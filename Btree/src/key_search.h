@@ -0,0 +1,282 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BADGERDB_KEY_SEARCH_X86
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief Number of keys left for the vector kernel to compare once binary
+ * search has narrowed down the range. Four cache lines of INTEGER keys.
+ */
+const int KEY_SEARCH_WINDOW = 64;
+
+/**
+ * Counts the keys of keys[0, n) that are less than key (or, if greater is set,
+ * greater than key) one at a time.
+ */
+inline int countKeysScalar(const int *keys, const int n, const int key,
+                           const bool greater) {
+  int count = 0;
+  for (int i = 0; i < n; i++) {
+    count += greater ? (keys[i] > key) : (keys[i] < key);
+  }
+  return count;
+}
+
+#ifdef BADGERDB_KEY_SEARCH_X86
+
+/**
+ * SSE2 version of countKeysScalar(), comparing 4 keys at a time. SSE2 is part
+ * of every x86-64 target, so this is the compile time default.
+ */
+inline int countKeysSse2(const int *keys, const int n, const int key,
+                         const bool greater) {
+  const __m128i k = _mm_set1_epi32(key);
+  __m128i acc = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys + i));
+    // Matching lanes are all ones, i.e. -1, so subtracting counts them
+    acc = _mm_sub_epi32(acc, greater ? _mm_cmpgt_epi32(v, k) : _mm_cmpgt_epi32(k, v));
+  }
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(acc) + countKeysScalar(keys + i, n - i, key, greater);
+}
+
+/**
+ * AVX2 version of countKeysScalar(), comparing 8 keys at a time. Compiled for
+ * AVX2 regardless of the target flags and only called when the CPU has it.
+ */
+__attribute__((target("avx2"))) inline int countKeysAvx2(const int *keys,
+                                                          const int n,
+                                                          const int key,
+                                                          const bool greater) {
+  const __m256i k = _mm256_set1_epi32(key);
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+    acc = _mm256_sub_epi32(acc, greater ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v));
+  }
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum) + countKeysScalar(keys + i, n - i, key, greater);
+}
+
+/**
+ * Returns true if the CPU supports AVX2. Detected once per process.
+ */
+inline bool keySearchHasAvx2() {
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  return hasAvx2;
+}
+
+#endif  // BADGERDB_KEY_SEARCH_X86
+
+/**
+ * Counts the keys of keys[0, n) that are less than key (or, if greater is set,
+ * greater than key) with the widest kernel available.
+ */
+inline int countKeys(const int *keys, const int n, const int key,
+                     const bool greater) {
+#ifdef BADGERDB_KEY_SEARCH_X86
+  if (keySearchHasAvx2()) return countKeysAvx2(keys, n, key, greater);
+  return countKeysSse2(keys, n, key, greater);
+#else
+  return countKeysScalar(keys, n, key, greater);
+#endif
+}
+
+/**
+ * Returns the index of the first of the count sorted keys that is not less than
+ * key, or count if there is none. A branch-free binary search narrows the range
+ * down to KEY_SEARCH_WINDOW keys, which are then compared all at once.
+ *
+ * @param keys  Sorted key array of a node
+ * @param count Number of keys in the node
+ * @param key   Key being searched for
+ */
+inline int keyLowerBound(const int *keys, const int count, const int key) {
+  const int *base = keys;
+  int n = count;
+  while (n > KEY_SEARCH_WINDOW) {
+    const int half = n / 2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+  return (int)(base - keys) + countKeys(base, n, key, false);
+}
+
+/**
+ * Returns the index of the first of the count sorted keys that is greater than
+ * key, or count if there is none. Searches like keyLowerBound().
+ *
+ * @param keys  Sorted key array of a node
+ * @param count Number of keys in the node
+ * @param key   Key being searched for
+ */
+inline int keyUpperBound(const int *keys, const int count, const int key) {
+  const int *base = keys;
+  int n = count;
+  while (n > KEY_SEARCH_WINDOW) {
+    const int half = n / 2;
+    base = (base[half] <= key) ? base + half : base;
+    n -= half;
+  }
+  return (int)(base - keys) + n - countKeys(base, n, key, true);
+}
+
+/**
+ * Returns the index of the first of the count sorted keys that is not less than
+ * key, for key types without a vector kernel. The whole search is a branch-free
+ * binary search using the key type's operator<.
+ *
+ * @param keys  Sorted key array of a node
+ * @param count Number of keys in the node
+ * @param key   Key being searched for
+ */
+template <class T>
+inline int keyLowerBound(const T *keys, const int count, const T &key) {
+  const T *base = keys;
+  int n = count;
+  while (n > 1) {
+    const int half = n / 2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+  return (int)(base - keys) + (n == 1 && *base < key);
+}
+
+/**
+ * Returns the index of the first of the count sorted keys that is greater than
+ * key, for key types without a vector kernel. Searches like the generic
+ * keyLowerBound().
+ *
+ * @param keys  Sorted key array of a node
+ * @param count Number of keys in the node
+ * @param key   Key being searched for
+ */
+template <class T>
+inline int keyUpperBound(const T *keys, const int count, const T &key) {
+  const T *base = keys;
+  int n = count;
+  while (n > 1) {
+    const int half = n / 2;
+    base = (key < base[half]) ? base : base + half;
+    n -= half;
+  }
+  return (int)(base - keys) + (n == 1 && !(key < *base));
+}
+
+/**
+ * @brief Number of keys around the position interpolation guesses for a key
+ * that are compared to find it. A cache line of INTEGER keys.
+ */
+const int KEY_GUESS_WINDOW = 16;
+
+/**
+ * Guesses where key goes among the count sorted keys by interpolating between
+ * the first and the last key, as if the keys were spread evenly between them,
+ * and checks the KEY_GUESS_WINDOW keys around the guess. On nearly uniform
+ * keys, such as sequential ids, a search then reads one or two cache lines
+ * whatever the size of the node. Returns false if key is outside the keys or
+ * its place is not in the window, for the caller to search the usual way.
+ *
+ * @param keys  Sorted key array of a node
+ * @param count Number of keys in the node
+ * @param key   Key being searched for
+ * @param upper If true, looks for the first key greater than key, else for the
+ * first key not less than key
+ * @param pos   Index of the key, returned via this reference
+ * @return  True if pos was found
+ */
+template <class T>
+inline bool keyInterpolate(const T *keys, const int count, const T &key,
+                           const bool upper, int &pos) {
+  // Small nodes are searched as fast without a guess
+  if (count < 2 * KEY_GUESS_WINDOW) return false;
+  const double fraction =
+      ((double)key - (double)keys[0]) / ((double)keys[count - 1] - keys[0]);
+  if (!(fraction >= 0 && fraction <= 1)) return false;
+
+  const int guess = (int)(fraction * (count - 1));
+  int low = guess - KEY_GUESS_WINDOW / 2;
+  if (low < 0) low = 0;
+  if (low > count - KEY_GUESS_WINDOW) low = count - KEY_GUESS_WINDOW;
+  const int high = low + KEY_GUESS_WINDOW;
+
+  // The place of key is in the window if the key before it goes before key and
+  // the key after it does not
+  if (upper) {
+    if (low > 0 && key < keys[low - 1]) return false;
+    if (high < count && !(key < keys[high])) return false;
+    pos = low + keyUpperBound(keys + low, KEY_GUESS_WINDOW, key);
+  } else {
+    if (low > 0 && !(keys[low - 1] < key)) return false;
+    if (high < count && keys[high] < key) return false;
+    pos = low + keyLowerBound(keys + low, KEY_GUESS_WINDOW, key);
+  }
+  return true;
+}
+
+/**
+ * @brief Size in bytes of the blocks the keys of a node with a block directory
+ * are grouped into. A cache line.
+ */
+const int KEY_BLOCK_BYTES = 64;
+
+/**
+ * Returns the index of the first of the count sorted keys that is not less than
+ * key, for keys grouped into blocks of blockSize keys whose last keys are kept
+ * in blockKeys, one per full block. The block directory is searched first and
+ * then the one block the key can be in, so a search reads the few cache lines
+ * of the directory and one block of keys rather than lines all over the array.
+ *
+ * @param keys      Sorted key array of a node
+ * @param blockKeys Last key of each full block of keys
+ * @param count     Number of keys in the node
+ * @param blockSize Number of keys per block
+ * @param key       Key being searched for
+ */
+template <class T>
+inline int keyBlockLowerBound(const T *keys, const T *blockKeys,
+                              const int count, const int blockSize,
+                              const T &key) {
+  const int first = keyLowerBound(blockKeys, count / blockSize, key) * blockSize;
+  const int n = count - first < blockSize ? count - first : blockSize;
+  return first + keyLowerBound(keys + first, n, key);
+}
+
+/**
+ * Returns the index of the first of the count sorted keys that is greater than
+ * key, searching the block directory first as keyBlockLowerBound() does.
+ *
+ * @param keys      Sorted key array of a node
+ * @param blockKeys Last key of each full block of keys
+ * @param count     Number of keys in the node
+ * @param blockSize Number of keys per block
+ * @param key       Key being searched for
+ */
+template <class T>
+inline int keyBlockUpperBound(const T *keys, const T *blockKeys,
+                              const int count, const int blockSize,
+                              const T &key) {
+  const int first = keyUpperBound(blockKeys, count / blockSize, key) * blockSize;
+  const int n = count - first < blockSize ? count - first : blockSize;
+  return first + keyUpperBound(keys + first, n, key);
+}
+
+}  // namespace badgerdb
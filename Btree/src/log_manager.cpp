@@ -0,0 +1,556 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "log_manager.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "checksum.h"
+#include "compression.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_error_exception.h"
+#include "file.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Marks the start of every operation record, and of every checkpoint record.
+ */
+const std::uint32_t OPERATION_MAGIC = 0x4c415742;
+const std::uint32_t CHECKPOINT_MAGIC = 0x4b504343;
+
+/**
+ * Marks a master record.
+ */
+const std::uint32_t MASTER_MAGIC = 0x5254534d;
+
+/**
+ * The log file starts with two master records, each in a slot of its own, so
+ * that a torn write of one leaves the other intact. Records follow.
+ */
+const off_t MASTER_SLOT_SIZE = 2048;
+const off_t LOG_HEADER_SIZE = 2 * MASTER_SLOT_SIZE;
+
+/**
+ * Unit in which file space before the redo point is given back.
+ */
+const off_t PUNCH_UNIT = 4096;
+
+/**
+ * Points at the checkpoint record a checkpoint wrote. Of the master records
+ * with a valid checksum, the one with the higher number is the newest.
+ */
+struct MasterRecord {
+  std::uint32_t magic;
+  std::uint32_t checksum;
+  std::uint64_t number;
+  std::uint64_t checkpointOffset;
+};
+
+/**
+ * Header of a record, followed by length bytes holding the pages of an
+ * operation, or the dirty page table of a checkpoint.
+ */
+struct OperationHeader {
+  std::uint32_t magic;
+  std::uint32_t numPages;
+  std::uint32_t length;
+  std::uint32_t checksum;
+};
+
+/**
+ * Kinds of file a page can belong to.
+ */
+enum FileKind { PAGE_FILE = 0, BLOB_FILE = 1 };
+
+/**
+ * Header of one page of an operation, followed by the name of its file and
+ * its image, compressed unless length is Page::SIZE.
+ */
+struct PageImageHeader {
+  std::uint64_t sequence;
+  PageId pageNo;
+  std::uint16_t nameLength;
+  std::uint16_t length;
+  std::uint8_t kind;
+  std::uint8_t reserved[7];
+};
+
+/**
+ * Start of the payload of a checkpoint record, followed by numPages dirty
+ * pages. Offsets are positions in the log file.
+ */
+struct CheckpointHeader {
+  std::uint64_t beginOffset;
+  std::uint64_t redoOffset;
+};
+
+/**
+ * Header of one dirty page of a checkpoint, followed by the name of its file.
+ */
+struct DirtyPageHeader {
+  std::uint64_t recOffset;
+  PageId pageNo;
+  std::uint16_t nameLength;
+  std::uint16_t reserved;
+};
+
+/**
+ * Newest image of a page found in the log.
+ */
+struct RecoveredPage {
+  std::uint64_t sequence;
+  std::uint8_t kind;
+  std::string image;
+};
+
+void appendBytes(std::vector<char>& out, const void* bytes,
+                 const std::size_t size) {
+  const char* begin = static_cast<const char*>(bytes);
+  out.insert(out.end(), begin, begin + size);
+}
+
+/**
+ * Writes size bytes at offset of the log named name, retrying short writes.
+ *
+ * @throws  IoErrorException  If a write fails or makes no progress
+ */
+void writeFully(const std::string& name, const int fd, const char* bytes,
+                const std::size_t size, const off_t offset) {
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t n = ::pwrite(fd, bytes + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw IoErrorException(name, errno);
+    if (n == 0) throw IoErrorException(name, EIO);
+    done += n;
+  }
+}
+
+/**
+ * Makes what was written to the log named name durable.
+ *
+ * @throws  IoErrorException  If the sync fails
+ */
+void syncFully(const std::string& name, const int fd) {
+  if (::fdatasync(fd) != 0) throw IoErrorException(name, errno);
+}
+
+/**
+ * Reads up to size bytes at offset, retrying short reads.
+ *
+ * @return  Number of bytes read
+ */
+std::size_t readFully(const int fd, char* bytes, const std::size_t size,
+                      const off_t offset) {
+  std::size_t done = 0;
+  while (done < size) {
+    const ssize_t n = ::pread(fd, bytes + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    done += n;
+  }
+  return done;
+}
+
+/**
+ * Returns the checksum of the fields of a master record after its checksum.
+ */
+std::uint32_t masterChecksum(const MasterRecord& master) {
+  return crc32c(0, &master.number,
+                sizeof(master) - offsetof(MasterRecord, number));
+}
+
+/**
+ * Returns true if the bytes at pos of log start a whole record with the given
+ * magic number, whose header is put in op.
+ */
+bool validRecord(const std::vector<char>& log, const std::size_t pos,
+                 const std::uint32_t magic, OperationHeader& op) {
+  if (log.size() - pos < sizeof(OperationHeader)) return false;
+  memcpy(&op, &log[pos], sizeof(op));
+  return op.magic == magic && log.size() - pos - sizeof(op) >= op.length &&
+         crc32c(0, &log[pos + sizeof(op)], op.length) == op.checksum;
+}
+
+typedef std::map<std::pair<std::string, PageId>, RecoveredPage> RecoveredMap;
+
+/**
+ * Writes the images of the pages of one file back, and syncs the file.
+ *
+ * @param begin   First page of the file
+ * @param end     Page after the last page of the file
+ * @return  Number of pages written
+ */
+template <class F>
+std::size_t redoPages(RecoveredMap::const_iterator begin,
+                      const RecoveredMap::const_iterator end) {
+  F file = F::open(begin->first.first);
+  std::size_t redone = 0;
+  Page page;
+  for (; begin != end; ++begin) {
+    memcpy(reinterpret_cast<char*>(&page), begin->second.image.data(),
+           Page::SIZE);
+    try {
+      file.writePage(begin->first.second, page);
+      redone++;
+    } catch (const InvalidPageException& e) {
+      // The page was deleted after it was logged
+    }
+  }
+  file.sync();
+  return redone;
+}
+
+}  // namespace
+
+LogManager::LogManager(const std::string& name)
+    : name(name),
+      fd(-1),
+      baseLsn(0),
+      appendedLsn(0),
+      durableLsn(0),
+      flushing(false),
+      sequences(0),
+      syncs(0),
+      checkpointLsn(0),
+      checkpoints(0) {
+  recover(name);
+  fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) throw FileNotFoundException(name);
+}
+
+LogManager::~LogManager() {
+  try {
+    flush(getAppendedLsn());
+  } catch (const IoErrorException& e) {
+    // Records not made durable are lost, as on a crash
+  }
+  ::close(fd);
+}
+
+std::size_t LogManager::recover(const std::string& name) {
+  const int fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) return 0;
+
+  // Find the newest checkpoint the master records point at
+  MasterRecord master = {};
+  for (int slot = 0; slot < 2; slot++) {
+    MasterRecord candidate;
+    if (readFully(fd, reinterpret_cast<char*>(&candidate), sizeof(candidate),
+                  slot * MASTER_SLOT_SIZE) == sizeof(candidate) &&
+        candidate.magic == MASTER_MAGIC &&
+        candidate.checksum == masterChecksum(candidate) &&
+        candidate.number > master.number) {
+      master = candidate;
+    }
+  }
+  std::vector<char> checkpoint;
+  OperationHeader op;
+  if (master.number > 0) {
+    checkpoint.resize(sizeof(OperationHeader));
+    checkpoint.resize(readFully(fd, &checkpoint[0], checkpoint.size(),
+                                master.checkpointOffset));
+    if (checkpoint.size() == sizeof(OperationHeader)) {
+      memcpy(&op, &checkpoint[0], sizeof(op));
+      checkpoint.resize(sizeof(op) + op.length);
+      checkpoint.resize(sizeof(op) + readFully(fd, &checkpoint[sizeof(op)],
+                                               op.length,
+                                               master.checkpointOffset +
+                                                   sizeof(op)));
+    }
+  }
+
+  // Without a checkpoint every record is read and every image redone
+  off_t redoOffset = LOG_HEADER_SIZE;
+  off_t beginOffset = LOG_HEADER_SIZE;
+  std::map<std::pair<std::string, PageId>, off_t> dirtyPages;
+  if (validRecord(checkpoint, 0, CHECKPOINT_MAGIC, op)) {
+    CheckpointHeader header;
+    memcpy(&header, &checkpoint[sizeof(op)], sizeof(header));
+    redoOffset = header.redoOffset;
+    beginOffset = header.beginOffset;
+    std::size_t at = sizeof(op) + sizeof(header);
+    for (std::uint32_t i = 0; i < op.numPages; i++) {
+      DirtyPageHeader dirty;
+      memcpy(&dirty, &checkpoint[at], sizeof(dirty));
+      at += sizeof(dirty);
+      const std::string file(&checkpoint[at], dirty.nameLength);
+      at += dirty.nameLength;
+      dirtyPages[std::make_pair(file, dirty.pageNo)] = dirty.recOffset;
+    }
+  }
+
+  struct stat status;
+  std::vector<char> log;
+  if (fstat(fd, &status) == 0 && status.st_size > redoOffset) {
+    log.resize(status.st_size - redoOffset);
+    log.resize(readFully(fd, &log[0], log.size(), redoOffset));
+  }
+  ::close(fd);
+
+  // Keep the newest image of every page among the operations logged whole.
+  // An image logged before the page was last dirty at the checkpoint, or
+  // before the checkpoint began for pages that were clean, is in the file.
+  RecoveredMap pages;
+  std::size_t pos = 0;
+  while (true) {
+    if (validRecord(log, pos, CHECKPOINT_MAGIC, op)) {
+      pos += sizeof(op) + op.length;
+      continue;
+    }
+    if (!validRecord(log, pos, OPERATION_MAGIC, op)) break;
+    const off_t offset = redoOffset + (off_t)pos;
+    std::size_t at = pos + sizeof(op);
+    for (std::uint32_t i = 0; i < op.numPages; i++) {
+      PageImageHeader header;
+      memcpy(&header, &log[at], sizeof(header));
+      at += sizeof(header);
+      const std::string file(&log[at], header.nameLength);
+      at += header.nameLength;
+
+      const std::pair<std::string, PageId> key(file, header.pageNo);
+      std::map<std::pair<std::string, PageId>, off_t>::const_iterator dirty =
+          dirtyPages.find(key);
+      if (offset < (dirty != dirtyPages.end() ? dirty->second : beginOffset)) {
+        at += header.length;
+        continue;
+      }
+
+      RecoveredPage& page = pages[key];
+      if (page.image.empty() || header.sequence > page.sequence) {
+        page.sequence = header.sequence;
+        page.kind = header.kind;
+        page.image.assign(Page::SIZE, '\0');
+        if (header.length == Page::SIZE) {
+          memcpy(&page.image[0], &log[at], Page::SIZE);
+        } else {
+          decompressBlock(&log[at], header.length, &page.image[0], Page::SIZE);
+        }
+      }
+      at += header.length;
+    }
+    pos += sizeof(op) + op.length;
+  }
+
+  // Pages are sorted by file, so each file is opened once
+  std::size_t redone = 0;
+  RecoveredMap::const_iterator it = pages.begin();
+  while (it != pages.end()) {
+    RecoveredMap::const_iterator next = it;
+    while (next != pages.end() && next->first.first == it->first.first) ++next;
+
+    // Files removed after they were logged are gone for good
+    if (File::exists(it->first.first)) {
+      redone += it->second.kind == BLOB_FILE ? redoPages<BlobFile>(it, next)
+                                             : redoPages<PageFile>(it, next);
+    }
+    it = next;
+  }
+
+  // Everything is in the files now
+  ::truncate(name.c_str(), 0);
+  return redone;
+}
+
+Lsn LogManager::append(const std::vector<LoggedPage>& pages) {
+  std::vector<char> payload;
+  char compressed[Page::SIZE];
+  for (std::size_t i = 0; i < pages.size(); i++) {
+    const LoggedPage& page = pages[i];
+    PageImageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.sequence = page.sequence;
+    header.pageNo = page.pageNo;
+    header.nameLength = (std::uint16_t)page.file->filename().size();
+    header.kind = dynamic_cast<const BlobFile*>(page.file) != NULL
+                      ? BLOB_FILE
+                      : PAGE_FILE;
+
+    // Images that do not get smaller are logged as they are
+    std::size_t length = compressBlock(page.image.data(), Page::SIZE,
+                                       compressed, Page::SIZE - 1);
+    const char* image = compressed;
+    if (length == 0) {
+      length = Page::SIZE;
+      image = page.image.data();
+    }
+    header.length = (std::uint16_t)length;
+    appendBytes(payload, &header, sizeof(header));
+    appendBytes(payload, page.file->filename().data(), header.nameLength);
+    appendBytes(payload, image, length);
+  }
+
+  OperationHeader op;
+  op.magic = OPERATION_MAGIC;
+  op.numPages = (std::uint32_t)pages.size();
+  op.length = (std::uint32_t)payload.size();
+  op.checksum = crc32c(0, payload.data(), payload.size());
+
+  std::lock_guard<std::mutex> lock(latch);
+  appendBytes(tail, &op, sizeof(op));
+  appendBytes(tail, payload.data(), payload.size());
+  appendedLsn += sizeof(op) + payload.size();
+  return appendedLsn;
+}
+
+void LogManager::flush(const Lsn lsn) {
+  std::unique_lock<std::mutex> lock(latch);
+  while (durableLsn < lsn) {
+    if (flushing) {
+      flushed.wait(lock);
+      continue;
+    }
+
+    // Lead a group: write out everything appended so far, including the
+    // records of threads that came along while the last sync ran
+    flushing = true;
+    std::vector<char> records;
+    records.swap(tail);
+    const Lsn start = appendedLsn - records.size();
+    const Lsn end = appendedLsn;
+    const off_t offset = offsetOf(start);
+    lock.unlock();
+
+    try {
+      writeFully(name, fd, records.data(), records.size(), offset);
+      syncFully(name, fd);
+    } catch (const IoErrorException& e) {
+      // The records are not durable, so put them back for the next flush and
+      // let the threads waiting on this one try again
+      lock.lock();
+      tail.insert(tail.begin(), records.begin(), records.end());
+      flushing = false;
+      flushed.notify_all();
+      throw;
+    }
+
+    lock.lock();
+    durableLsn = end;
+    syncs++;
+    flushing = false;
+    flushed.notify_all();
+  }
+}
+
+void LogManager::truncate() {
+  std::unique_lock<std::mutex> lock(latch);
+  while (flushing) flushed.wait(lock);
+  tail.clear();
+  if (::ftruncate(fd, 0) != 0) throw IoErrorException(name, errno);
+  syncFully(name, fd);
+  baseLsn = durableLsn = checkpointLsn = appendedLsn;
+}
+
+Lsn LogManager::checkpoint(const Lsn beginLsn,
+                           const std::vector<DirtyPage>& dirtyPages) {
+  std::unique_lock<std::mutex> lock(latch);
+
+  // Recovery starts at the oldest change not yet written to its file
+  Lsn redoLsn = beginLsn;
+  for (std::size_t i = 0; i < dirtyPages.size(); i++) {
+    redoLsn = std::min(redoLsn, dirtyPages[i].recLsn);
+  }
+  std::vector<char> payload;
+  CheckpointHeader header;
+  header.beginOffset = offsetOf(beginLsn);
+  header.redoOffset = offsetOf(redoLsn);
+  appendBytes(payload, &header, sizeof(header));
+  for (std::size_t i = 0; i < dirtyPages.size(); i++) {
+    DirtyPageHeader dirty;
+    memset(&dirty, 0, sizeof(dirty));
+    dirty.recOffset = offsetOf(dirtyPages[i].recLsn);
+    dirty.pageNo = dirtyPages[i].pageNo;
+    dirty.nameLength = (std::uint16_t)dirtyPages[i].filename.size();
+    appendBytes(payload, &dirty, sizeof(dirty));
+    appendBytes(payload, dirtyPages[i].filename.data(), dirty.nameLength);
+  }
+
+  OperationHeader op;
+  op.magic = CHECKPOINT_MAGIC;
+  op.numPages = (std::uint32_t)dirtyPages.size();
+  op.length = (std::uint32_t)payload.size();
+  op.checksum = crc32c(0, payload.data(), payload.size());
+  appendBytes(tail, &op, sizeof(op));
+  appendBytes(tail, payload.data(), payload.size());
+  appendedLsn += sizeof(op) + payload.size();
+  const Lsn end = appendedLsn;
+
+  MasterRecord master;
+  master.magic = MASTER_MAGIC;
+  master.number = checkpoints + 1;
+  master.checkpointOffset = offsetOf(end) - sizeof(op) - payload.size();
+  master.checksum = masterChecksum(master);
+  const off_t redoOffset = (off_t)header.redoOffset;
+  lock.unlock();
+
+  // The master record may only point at the checkpoint once it is durable
+  flush(end);
+  writeFully(name, fd, reinterpret_cast<const char*>(&master), sizeof(master),
+             (master.number % 2) * MASTER_SLOT_SIZE);
+  syncFully(name, fd);
+
+  // Neither master record points before the redo point any more, so the
+  // records there are never read again
+  const off_t unused = redoOffset / PUNCH_UNIT * PUNCH_UNIT - LOG_HEADER_SIZE;
+  // Filesystems that cannot punch holes just keep the space
+  if (unused > 0 &&
+      ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  LOG_HEADER_SIZE, unused) != 0 &&
+      errno != EOPNOTSUPP) {
+    throw IoErrorException(name, errno);
+  }
+
+  lock.lock();
+  checkpointLsn = end;
+  checkpoints++;
+  return redoLsn;
+}
+
+std::uint64_t LogManager::nextSequence() {
+  std::lock_guard<std::mutex> lock(latch);
+  return ++sequences;
+}
+
+Lsn LogManager::getAppendedLsn() {
+  std::lock_guard<std::mutex> lock(latch);
+  return appendedLsn;
+}
+
+std::uint64_t LogManager::getNumSyncs() {
+  std::lock_guard<std::mutex> lock(latch);
+  return syncs;
+}
+
+Lsn LogManager::getCheckpointLsn() {
+  std::lock_guard<std::mutex> lock(latch);
+  return checkpointLsn;
+}
+
+std::uint64_t LogManager::getNumCheckpoints() {
+  std::lock_guard<std::mutex> lock(latch);
+  return checkpoints;
+}
+
+off_t LogManager::offsetOf(const Lsn lsn) const {
+  return LOG_HEADER_SIZE + (off_t)(lsn > baseLsn ? lsn - baseLsn : 0);
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,243 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Log sequence number: the position in the log just past a record.
+ * Numbers keep growing when the log is truncated.
+ */
+typedef std::uint64_t Lsn;
+
+/**
+ * @brief Image of a page as changed by an operation, waiting to be logged.
+ */
+struct LoggedPage {
+  /**
+   * File the page belongs to, and its number
+   */
+  const File* file;
+  PageId pageNo;
+
+  /**
+   * Order the image was taken in, among the images of all operations. The
+   * newest image of a page is the one recovery keeps.
+   */
+  std::uint64_t sequence;
+
+  /**
+   * Contents of the page
+   */
+  std::string image;
+};
+
+/**
+ * @brief Page that was dirty in the buffer pool when a checkpoint was taken.
+ */
+struct DirtyPage {
+  /**
+   * Name of the file the page belongs to, and its number
+   */
+  std::string filename;
+  PageId pageNo;
+
+  /**
+   * Log sequence number the log had reached when the page was dirtied. Every
+   * change to the page not yet written to its file is logged after it.
+   */
+  Lsn recLsn;
+};
+
+/**
+ * @brief Write-ahead log of page images.
+ *
+ * Each operation appends the images of the pages it changed as one record,
+ * with a checksum over all of it, so recovery either redoes all of an
+ * operation or none of it. A page modified by an operation may only be
+ * written to its file once the log is durable up to the operation's record.
+ *
+ * Records are appended to a buffer in memory. flush() waits until the log is
+ * durable up to a record: the first thread to flush writes out everything
+ * appended so far and syncs it, and threads flushing while it does so wait
+ * for it and then go as a group, so concurrent operations share syncs.
+ *
+ * Images are redone whole, which needs no log sequence number on the page
+ * itself: redoing a page twice leaves it the same.
+ *
+ * A checkpoint logs the table of pages dirty in the buffer pool, each with the
+ * point in the log where its unwritten changes begin, while operations go on
+ * appending. The head of the file holds two master records, written in turn,
+ * that point at the last checkpoint. Recovery reads the log only from the
+ * earliest point the checkpoint still needs, and the file space before it is
+ * given back to the file system.
+ */
+class LogManager {
+ public:
+  /**
+   * Opens the log file, creating it if there is none. Operations an earlier
+   * run logged are redone first, and the log emptied.
+   *
+   * @param name  Name of the log file
+   * @throws  FileNotFoundException  If the log cannot be opened
+   */
+  explicit LogManager(const std::string& name);
+
+  /**
+   * Makes the log durable and closes it.
+   */
+  ~LogManager();
+
+  /**
+   * Redoes the operations in a log file, writing the newest logged image of
+   * every page to its file, and then empties the log. A torn record at the
+   * end, from a crash while it was written, is left out. Images the last
+   * checkpoint shows to be in their file already are skipped.
+   *
+   * @param name  Name of the log file
+   * @return  Number of pages written
+   */
+  static std::size_t recover(const std::string& name);
+
+  /**
+   * Appends one operation to the log.
+   *
+   * @param pages  Images of the pages the operation changed
+   * @return  Log sequence number of the operation
+   */
+  Lsn append(const std::vector<LoggedPage>& pages);
+
+  /**
+   * Waits until the log is durable up to lsn.
+   *
+   * @param lsn  Log sequence number to wait for
+   * @throws  IoErrorException  If writing or syncing the log fails. The log is
+   * then durable only as far as before, and the records are written again by
+   * the next flush.
+   */
+  void flush(const Lsn lsn);
+
+  /**
+   * Logs a checkpoint and makes it durable. The changes logged before beginLsn
+   * to pages not in dirtyPages, and before their recLsn to pages in it, must
+   * be in their files and synced. Call this from one thread at a time.
+   *
+   * @param beginLsn    Value of getAppendedLsn() when the checkpoint began
+   * @param dirtyPages  Pages dirty in the buffer pool since then
+   * @return  Log sequence number recovery starts reading the log at
+   * @throws  IoErrorException  If writing or syncing the log fails, in which
+   * case recovery still starts from the checkpoint before
+   */
+  Lsn checkpoint(const Lsn beginLsn, const std::vector<DirtyPage>& dirtyPages);
+
+  /**
+   * Empties the log. Only call this once every page logged has been written
+   * to its file and synced, and while no operation is running.
+   *
+   * @throws  IoErrorException  If the log file cannot be truncated or synced
+   */
+  void truncate();
+
+  /**
+   * Returns the next number for LoggedPage::sequence.
+   */
+  std::uint64_t nextSequence();
+
+  /**
+   * Returns the log sequence number of the last operation appended.
+   */
+  Lsn getAppendedLsn();
+
+  /**
+   * Returns the number of times the log file has been synced.
+   */
+  std::uint64_t getNumSyncs();
+
+  /**
+   * Returns the log sequence number of the last checkpoint, or the one at
+   * which the log was last emptied.
+   */
+  Lsn getCheckpointLsn();
+
+  /**
+   * Returns the number of checkpoints taken.
+   */
+  std::uint64_t getNumCheckpoints();
+
+ private:
+  /**
+   * Returns the position in the log file of lsn. Log sequence numbers from
+   * before the log was last emptied are at the start of the records.
+   */
+  off_t offsetOf(const Lsn lsn) const;
+
+  /**
+   * Name of the log file
+   */
+  std::string name;
+
+  /**
+   * Descriptor of the log file
+   */
+  int fd;
+
+  /**
+   * Protects everything below, with flushed signalled whenever a flush ends
+   */
+  std::mutex latch;
+  std::condition_variable flushed;
+
+  /**
+   * Records appended and not yet handed to a flush
+   */
+  std::vector<char> tail;
+
+  /**
+   * Log sequence number of the start of the file, of the end of the records
+   * appended, and of the end of the records durable
+   */
+  Lsn baseLsn;
+  Lsn appendedLsn;
+  Lsn durableLsn;
+
+  /**
+   * True while a thread writes out and syncs records
+   */
+  bool flushing;
+
+  /**
+   * Number of sequence numbers handed out, and of syncs
+   */
+  std::uint64_t sequences;
+  std::uint64_t syncs;
+
+  /**
+   * Log sequence number of the last checkpoint, and the number of checkpoints
+   */
+  Lsn checkpointLsn;
+  std::uint64_t checkpoints;
+
+  // No copying
+  LogManager(const LogManager&);
+  LogManager& operator=(const LogManager&);
+};
+
+}  // namespace badgerdb
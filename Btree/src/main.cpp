@@ -23,21 +23,55 @@
  * of Wisconsin-Madison.
  */
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "btree.h"
+#include "checksum.h"
+#include "compression.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/end_of_file_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/index_read_only_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/io_error_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/page_checksum_exception.h"
+#include "exceptions/page_pinned_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "file_iterator.h"
 #include "filescan.h"
+#include "hash_index.h"
+#include "io_engine.h"
+#include "join.h"
+#include "key_search.h"
+#include "log_manager.h"
 #include "page.h"
 #include "page_iterator.h"
+#include "partitioned_index.h"
+#include "pax_page.h"
+#include "relation_generator.h"
+#include "relation_writer.h"
+#include "replacement_policy.h"
+#include "trace.h"
 
 #define checkPassFail(a, b)                                          \
   {                                                                  \
@@ -88,12 +122,118 @@ void createRelationForward();
 void createRelationBackward();
 void createRelationRandom();
 void createRelationForwardWithRange(int start, int end);
+void generateRelation(const RelationSpec &spec);
 void intTests();
+void intScanChecks(BTreeIndex *index);
+void readOnlyTests();
+void doubleTests();
+void doubleScanChecks(BTreeIndex *index);
+void stringTests();
+void stringScanChecks(BTreeIndex *index);
+void bulkLoadTests();
+void splitTests();
+void keySearchTests();
+void stringNodeTests();
+void cursorTests();
+int cursorKey(BTreeIndex *index, IndexCursor &cursor);
+void concurrentTests();
+void concurrentScans(BTreeIndex *index, int seed, int *failures);
+void concurrentPages(BufMgr *pool, File *file, int seed, int *failures);
+void concurrentInsertTests();
+void concurrentInserts(BTreeIndex *index, int seed);
+void concurrentInsertScans(BTreeIndex *index, const std::atomic<bool> *done,
+                           int *failures);
+void hashTableTests();
+void backgroundWriterTests();
+void readAheadTests();
+void scanResistanceTests();
+void hotNodeTests();
+void fileFrameTests();
+void pageAllocationTests();
+void relationWriterTests();
+void recordViewTests();
+void scanPredicateTests();
+void parallelScanTests();
+void parallelBuildTests();
+void pageCompactionTests();
+void paxTests();
+void checksumTests();
+void compressionTests();
+void walTests();
+void checkpointTests();
+void deleteTests();
+void postingListTests();
+void lookupTests();
+void batchLookupTests();
+void batchInsertTests();
+void appendTests();
+void insertBufferTests();
+void onlineBuildTests();
+void descendingScanTests();
+int descendingScan(BTreeIndex *index, void *lowVal, Operator lowOp,
+                   void *highVal, Operator highOp, std::size_t batchSize = 0);
+void multiRangeScanTests();
+int rangeScan(BTreeIndex *index, const std::vector<ScanRange> &ranges,
+              std::size_t batchSize = 0);
+int openScan(BTreeIndex *index, void *lowVal, Operator lowOp, void *highVal,
+             Operator highOp);
+void indexOnlyScanTests();
+void cardinalityTests();
+bool nearlyEqual(int estimate, int actual, int slack);
+void heapScanTests();
+void hugePageTests();
+void clockTests();
+void resizeTests(ReplacementStrategy strategy);
+void priorityTests();
+void telemetryTests();
+void btreeStatsTests();
+void relationGeneratorTests();
+void traceTests();
+void compositeKeyTests();
+void hashIndexTests();
+void keyFilterTests();
+void snapshotTests();
+void partitionedIndexTests();
+void joinTests();
+void warmupTests();
+int settledReads(BufMgr &pool);
+int listedPages(const std::string &warmupName, const std::string &fileName);
+int joinMismatches(const std::vector<JoinPair> &pairs, int &addedPairs);
+int storedKeys(PageFile *file, std::vector<int> &keys);
+bool withinEstimate(int estimate, int actual);
+int keyedScan(BTreeIndex *index, int lowVal, int highVal, bool descending,
+              std::size_t batchSize);
+int randomInserts(BTreeIndex *index, int count);
+int postingCount(BTreeIndex *index, int key);
+void loggedInserts(BufMgr *pool, File *file, PageId first, PageId second,
+                   int count);
+int countFileScan(const std::vector<ScanPredicate> &predicates,
+                  const std::string &name = relationName);
+void pageListTests(PageFile &file);
+std::vector<PageId> usedPageNumbers(PageFile &file);
+int hashTableMismatches(BufHashTbl &table, File *file, File *other,
+                        int numPages);
+int stringCountScan(BTreeIndex *index, const std::vector<std::string> &keys,
+                    const char *lowVal, Operator lowOp, const char *highVal,
+                    Operator highOp, std::size_t batchSize = 0);
+std::string paddedStringKey(const char *value);
+int checkStringLeafSplit(const char *fillKey, const char *newKey);
+int checkStringNonLeafSplit(const char *newKey);
+int countScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+              Operator highOp);
+int batchCountScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+                   Operator highOp, std::size_t batchSize);
 void testEmpty();
 void testNegative();
 void testOutOfBounds();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
             Operator highOp);
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp);
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp);
+int scanResults(BTreeIndex *index, void *lowVal, Operator lowOp,
+                void *highVal, Operator highOp);
 void indexTests();
 void test1();
 void test2();
@@ -101,6 +241,61 @@ void test3();
 void test4();
 void test5();
 void test6();
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
+void test35();
+void test36();
+void test37();
+void test38();
+void test39();
+void test40();
+void test41();
+void test42();
+void test43();
+void test44();
+void test45();
+void test46();
+void test47();
+void test48();
+void test49();
+void test50();
+void test51();
+void test52();
+void test53();
+void test54();
+void test55();
+void test56();
+void test57();
+void test58();
+void test59();
+void test60();
+void test61();
 void createRandomRelationOfSize(int size);
 void errorTests();
 void deleteRelation();
@@ -178,6 +373,226 @@ int main(int argc, char **argv) {
   test6();
   std::cout << "\nTEST 6 PASSED\n" << std::endl;
 
+  std::cout << "\nTEST 7 START\n" << std::endl;
+  test7();
+  std::cout << "\nTEST 7 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 8 START\n" << std::endl;
+  test8();
+  std::cout << "\nTEST 8 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 9 START\n" << std::endl;
+  test9();
+  std::cout << "\nTEST 9 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 10 START\n" << std::endl;
+  test10();
+  std::cout << "\nTEST 10 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 11 START\n" << std::endl;
+  test11();
+  std::cout << "\nTEST 11 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 12 START\n" << std::endl;
+  test12();
+  std::cout << "\nTEST 12 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 13 START\n" << std::endl;
+  test13();
+  std::cout << "\nTEST 13 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 14 START\n" << std::endl;
+  test14();
+  std::cout << "\nTEST 14 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 15 START\n" << std::endl;
+  test15();
+  std::cout << "\nTEST 15 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 16 START\n" << std::endl;
+  test16();
+  std::cout << "\nTEST 16 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 17 START\n" << std::endl;
+  test17();
+  std::cout << "\nTEST 17 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 18 START\n" << std::endl;
+  test18();
+  std::cout << "\nTEST 18 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 19 START\n" << std::endl;
+  test19();
+  std::cout << "\nTEST 19 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 20 START\n" << std::endl;
+  test20();
+  std::cout << "\nTEST 20 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 21 START\n" << std::endl;
+  test21();
+  std::cout << "\nTEST 21 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 22 START\n" << std::endl;
+  test22();
+  std::cout << "\nTEST 22 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 23 START\n" << std::endl;
+  test23();
+  std::cout << "\nTEST 23 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 24 START\n" << std::endl;
+  test24();
+  std::cout << "\nTEST 24 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 25 START\n" << std::endl;
+  test25();
+  std::cout << "\nTEST 25 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 26 START\n" << std::endl;
+  test26();
+  std::cout << "\nTEST 26 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 27 START\n" << std::endl;
+  test27();
+  std::cout << "\nTEST 27 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 28 START\n" << std::endl;
+  test28();
+  std::cout << "\nTEST 28 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 29 START\n" << std::endl;
+  test29();
+  std::cout << "\nTEST 29 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 30 START\n" << std::endl;
+  test30();
+  std::cout << "\nTEST 30 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 31 START\n" << std::endl;
+  test31();
+  std::cout << "\nTEST 31 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 32 START\n" << std::endl;
+  test32();
+  std::cout << "\nTEST 32 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 33 START\n" << std::endl;
+  test33();
+  std::cout << "\nTEST 33 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 34 START\n" << std::endl;
+  test34();
+  std::cout << "\nTEST 34 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 35 START\n" << std::endl;
+  test35();
+  std::cout << "\nTEST 35 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 36 START\n" << std::endl;
+  test36();
+  std::cout << "\nTEST 36 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 37 START\n" << std::endl;
+  test37();
+  std::cout << "\nTEST 37 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 38 START\n" << std::endl;
+  test38();
+  std::cout << "\nTEST 38 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 39 START\n" << std::endl;
+  test39();
+  std::cout << "\nTEST 39 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 40 START\n" << std::endl;
+  test40();
+  std::cout << "\nTEST 40 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 41 START\n" << std::endl;
+  test41();
+  std::cout << "\nTEST 41 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 42 START\n" << std::endl;
+  test42();
+  std::cout << "\nTEST 42 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 43 START\n" << std::endl;
+  test43();
+  std::cout << "\nTEST 43 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 44 START\n" << std::endl;
+  test44();
+  std::cout << "\nTEST 44 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 45 START\n" << std::endl;
+  test45();
+  std::cout << "\nTEST 45 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 46 START\n" << std::endl;
+  test46();
+  std::cout << "\nTEST 46 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 47 START\n" << std::endl;
+  test47();
+  std::cout << "\nTEST 47 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 48 START\n" << std::endl;
+  test48();
+  std::cout << "\nTEST 48 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 49 START\n" << std::endl;
+  test49();
+  std::cout << "\nTEST 49 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 50 START\n" << std::endl;
+  test50();
+  std::cout << "\nTEST 50 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 51 START\n" << std::endl;
+  test51();
+  std::cout << "\nTEST 51 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 52 START\n" << std::endl;
+  test52();
+  std::cout << "\nTEST 52 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 53 START\n" << std::endl;
+  test53();
+  std::cout << "\nTEST 53 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 54 START\n" << std::endl;
+  test54();
+  std::cout << "\nTEST 54 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 55 START\n" << std::endl;
+  test55();
+  std::cout << "\nTEST 55 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 56 START\n" << std::endl;
+  test56();
+  std::cout << "\nTEST 56 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 57 START\n" << std::endl;
+  test57();
+  std::cout << "\nTEST 57 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 58 START\n" << std::endl;
+  test58();
+  std::cout << "\nTEST 58 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 59 START\n" << std::endl;
+  test59();
+  std::cout << "\nTEST 59 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 60 START\n" << std::endl;
+  test60();
+  std::cout << "\nTEST 60 PASSED\n" << std::endl;
+
+  std::cout << "\nTEST 61 START\n" << std::endl;
+  test61();
+  std::cout << "\nTEST 61 PASSED\n" << std::endl;
+
   std::cout << "\nERROR TESTS START\n" << std::endl;
   errorTests();
   std::cout << "\nERROR TESTS PASSED\n" << std::endl;
@@ -249,337 +664,5786 @@ void test6() {
   deleteRelation();
 }
 
-/**
- * Creates a random relation of the given size.
- * @param size the size of the new random relation.
- */
-void createRandomRelationOfSize(int size) {
-  // destroy any old copies of relation file
-  try {
-    File::remove(relationName);
-  } catch (const FileNotFoundException &e) {
-  }
-  file1 = new PageFile(relationName, true);
-
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
-
-  // insert records in random order
+void test7() {
+  // Build the index by repeated insertion, by a bulk load with half full nodes
+  // and by a bulk load whose sort has to spill runs to disk
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Bulk load tests" << std::endl;
+  createRelationRandom();
+  bulkLoadTests();
+  deleteRelation();
+}
 
-  std::vector<int> intvec(size);
-  for (int i = 0; i < size; i++) {
-    intvec[i] = i;
-  }
+void test8() {
+  // Insert enough entries into an index to split non-leaf nodes and the root
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Non-leaf split tests" << std::endl;
+  createRandomRelationOfSize(0);
+  splitTests();
+  File::remove(intIndexName);
+  deleteRelation();
+}
 
-  long pos;
-  int val;
-  int i = 0;
-  while (i < size) {
-    pos = random() % (size - i);
-    val = intvec[pos];
-    sprintf(record1.s, "%05d string record", val);
-    record1.i = val;
-    record1.d = val;
+void test9() {
+  // Compare the node key search kernels against the standard library
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Key search kernel tests" << std::endl;
+  keySearchTests();
+}
 
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+void test10() {
+  // Insert STRING keys that stress the prefix-compressed node format
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Prefix-compressed string node tests" << std::endl;
+  createRandomRelationOfSize(0);
+  stringNodeTests();
+  File::remove(stringIndexName);
+  deleteRelation();
+}
 
-    while (1) {
-      try {
-        new_page.insertRecord(new_data);
-        break;
-      } catch (const InsufficientSpaceException &e) {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
-      }
-    }
+void test11() {
+  // Run several scans of one index at once through cursors
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Index cursor tests" << std::endl;
+  createRandomRelationOfSize(0);
+  cursorTests();
+  File::remove(intIndexName);
+  deleteRelation();
+}
 
-    int temp = intvec[size - 1 - i];
-    intvec[size - 1 - i] = intvec[pos];
-    intvec[pos] = temp;
-    i++;
-  }
+void test12() {
+  // Share an index and a small buffer pool between threads
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Concurrent buffer manager tests" << std::endl;
+  createRandomRelationOfSize(0);
+  concurrentTests();
+  File::remove(intIndexName);
+  deleteRelation();
+}
 
-  file1->writePage(new_page_number, new_page);
+void test13() {
+  // Insert into one index from several threads while others scan it
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Concurrent insert tests" << std::endl;
+  createRandomRelationOfSize(0);
+  concurrentInsertTests();
+  File::remove(intIndexName);
+  deleteRelation();
 }
 
-// -----------------------------------------------------------------------------
-// createRelationForward
-// -----------------------------------------------------------------------------
+void test14() {
+  // Fill, empty and refill a buffer pool hash table past its initial size
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Buffer hash table tests" << std::endl;
+  createRandomRelationOfSize(0);
+  hashTableTests();
+  deleteRelation();
+}
 
-void createRelationForward() {
-  std::vector<RecordId> ridVec;
-  // destroy any old copies of relation file
-  try {
-    File::remove(relationName);
-  } catch (const FileNotFoundException &e) {
+void test15() {
+  // Bypass the OS page cache and do all file I/O through io_uring
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Direct I/O engine tests" << std::endl;
+  if (!IoEngine::isSupported()) {
+    std::cout << "io_uring is not available, skipping" << std::endl;
+    return;
   }
+  IoEngine engine(32);
+  File::setIoEngine(&engine);
+  File::setDirectIO(true);
 
-  file1 = new PageFile(relationName, true);
+  createRelationForward();
+  intTests();
+  File::remove(intIndexName);
+  deleteRelation();
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+  createRandomRelationOfSize(0);
+  concurrentTests();
+  File::remove(intIndexName);
+  deleteRelation();
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = 0; i < relationSize; i++) {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+  File::setDirectIO(false);
+  File::setIoEngine(NULL);
+}
 
-    while (1) {
-      try {
-        new_page.insertRecord(new_data);
-        break;
-      } catch (const InsufficientSpaceException &e) {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
-      }
-    }
-  }
+void test16() {
+  // Scan an index mapped into memory instead of read through the buffer pool
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Read-only index tests" << std::endl;
+  createRelationForward();
+  readOnlyTests();
+  File::remove(intIndexName);
+  deleteRelation();
+}
 
-  file1->writePage(new_page_number, new_page);
+void test17() {
+  // Dirty pages get written back before the clock hand needs their frames
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Background writer tests" << std::endl;
+  createRandomRelationOfSize(0);
+  backgroundWriterTests();
+  deleteRelation();
 }
 
-// -----------------------------------------------------------------------------
-// createRelationBackward
-// -----------------------------------------------------------------------------
+void test18() {
+  // Pages read ahead are found in the buffer pool by the reads that follow
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Read-ahead tests" << std::endl;
+  createRelationForward();
+  readAheadTests();
+  deleteRelation();
+}
 
-void createRelationBackward() {
-  // destroy any old copies of relation file
-  try {
-    File::remove(relationName);
-  } catch (const FileNotFoundException &e) {
-  }
-  file1 = new PageFile(relationName, true);
+void test19() {
+  // A relation scan does not push out pages that are used over and over
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Scan resistant replacement tests" << std::endl;
+  createRelationForward();
+  scanResistanceTests();
+  deleteRelation();
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+  // Every index test again with 2Q replacement
+  BufMgr *clockBufMgr = bufMgr;
+  bufMgr = new BufMgr(100, DEFAULT_HIGH_DIRTY_RATIO, DEFAULT_LOW_DIRTY_RATIO,
+                      TWO_QUEUE);
+  createRelationForward();
+  indexTests();
+  deleteRelation();
+  delete bufMgr;
+  bufMgr = clockBufMgr;
+}
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = relationSize - 1; i >= 0; i--) {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = i;
+void test20() {
+  // The top of the tree is not looked up in the buffer pool
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Hot node tests" << std::endl;
+  createRandomRelationOfSize(0);
+  hotNodeTests();
+  File::remove(intIndexName);
+  deleteRelation();
+}
 
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+void test21() {
+  // Flushing a file leaves the pages of other files in the buffer pool
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Per-file frame list tests" << std::endl;
+  createRelationForward();
+  fileFrameTests();
+  deleteRelation();
+}
 
-    while (1) {
-      try {
-        new_page.insertRecord(new_data);
-        break;
-      } catch (const InsufficientSpaceException &e) {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
-      }
-    }
-  }
+void test22() {
+  // Allocating and deleting pages keeps the used list sorted and complete
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Page allocation tests" << std::endl;
+  pageAllocationTests();
+}
 
-  file1->writePage(new_page_number, new_page);
+void test23() {
+  // Records are packed into pages, reusing pages that still have room
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Relation writer tests" << std::endl;
+  createRelationForward();
+  relationWriterTests();
+  deleteRelation();
 }
 
-// -----------------------------------------------------------------------------
-// createRelationRandom
-// -----------------------------------------------------------------------------
+void test24() {
+  // Scans can read records in place in the buffer pool
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Record view tests" << std::endl;
+  createRelationRandom();
+  recordViewTests();
+  deleteRelation();
+}
 
-void createRelationRandom() {
-  // destroy any old copies of relation file
-  try {
-    File::remove(relationName);
-  } catch (const FileNotFoundException &e) {
-  }
-  file1 = new PageFile(relationName, true);
+void test25() {
+  // Relation scans only return the records satisfying their conditions
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Scan predicate tests" << std::endl;
+  createRelationRandom();
+  scanPredicateTests();
+  deleteRelation();
+}
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+void test26() {
+  // Several threads together see every record of the relation exactly once
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Parallel scan tests" << std::endl;
+  createRelationRandom();
+  parallelScanTests();
+  deleteRelation();
+}
 
-  // insert records in random order
+void test27() {
+  // Indexes built on several threads match the ones built on one
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Parallel index build tests" << std::endl;
+  createRelationRandom();
+  parallelBuildTests();
+  deleteRelation();
+}
 
-  std::vector<int> intvec(relationSize);
-  for (int i = 0; i < relationSize; i++) {
-    intvec[i] = i;
-  }
+void test28() {
+  // Space of deleted records is reused, and the other records keep their ids
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Page compaction tests" << std::endl;
+  pageCompactionTests();
+}
 
-  long pos;
-  int val;
-  int i = 0;
-  while (i < relationSize) {
-    pos = random() % (relationSize - i);
-    val = intvec[pos];
-    sprintf(record1.s, "%05d string record", val);
-    record1.i = val;
-    record1.d = val;
+void test29() {
+  // Relations in PAX pages can be scanned one attribute at a time
+  std::cout << "---------------------" << std::endl;
+  std::cout << "PAX page tests" << std::endl;
+  createRelationForward();
+  paxTests();
+  deleteRelation();
+}
 
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(RECORD));
+void test30() {
+  // Pages corrupted on disk are caught when they are read back
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Page checksum tests" << std::endl;
+  checksumTests();
+}
 
-    while (1) {
-      try {
-        new_page.insertRecord(new_data);
-        break;
-      } catch (const InsufficientSpaceException &e) {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
-      }
-    }
+void test31() {
+  // Indexes kept in compressed pages take less room and read back the same
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Page compression tests" << std::endl;
+  createRelationForward();
+  compressionTests();
+  deleteRelation();
+}
 
-    int temp = intvec[relationSize - 1 - i];
-    intvec[relationSize - 1 - i] = intvec[pos];
-    intvec[pos] = temp;
-    i++;
-  }
+void test32() {
+  // Page changes lost in a crash are redone from the write-ahead log
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Write-ahead log tests" << std::endl;
+  walTests();
+}
 
-  file1->writePage(new_page_number, new_page);
+void test33() {
+  // Recovery only redoes the changes made after a fuzzy checkpoint
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Checkpoint tests" << std::endl;
+  checkpointTests();
 }
 
-// -----------------------------------------------------------------------------
-// createRelationForwardWithRange
-// -----------------------------------------------------------------------------
-void createRelationForwardWithRange(int start, int end) {
-  std::vector<RecordId> ridVec;
-  // destroy any old copies of relation file
-  try {
-    File::remove(relationName);
-  } catch (FileNotFoundException &e) {
-  }
+void test34() {
+  // Deleted entries are gone from scans, and empty leaves are reused
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Delete and compaction tests" << std::endl;
+  createRelationForward();
+  deleteTests();
+  deleteRelation();
+}
 
-  file1 = new PageFile(relationName, true);
+void test35() {
+  // INTEGER leaves store each distinct key once with its posting list
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Posting list tests" << std::endl;
+  createRelationForward();
+  postingListTests();
+  deleteRelation();
+}
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-  PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+void test36() {
+  // Point lookups find the same entries as scans
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Point lookup tests" << std::endl;
+  createRelationForward();
+  lookupTests();
+  deleteRelation();
+}
 
-  // Insert a bunch of tuples into the relation.
-  for (int i = start; i < end; i++) {
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+void test37() {
+  // A batch of lookups finds what each lookup on its own does
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Batched lookup tests" << std::endl;
+  createRelationForward();
+  batchLookupTests();
+  deleteRelation();
+}
 
+void test38() {
+  // A batch of inserts leaves the index as inserting one by one does
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Batched insert tests" << std::endl;
+  createRelationForward();
+  batchInsertTests();
+  deleteRelation();
+}
+
+void test39() {
+  // Inserting increasing keys packs the leaves as full as bulk loading does
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Append tests" << std::endl;
+  createRelationForward();
+  appendTests();
+  deleteRelation();
+}
+
+void test40() {
+  // Buffered inserts are found right away, and reach the leaves in batches
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Insert buffer tests" << std::endl;
+  createRelationRandom();
+  insertBufferTests();
+  deleteRelation();
+}
+
+void test41() {
+  // Records inserted while an index is built online end up in it as well
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Online build tests" << std::endl;
+  createRelationForward();
+  onlineBuildTests();
+  deleteRelation();
+}
+
+void test42() {
+  // Descending scans return the entries of a range from the high end down
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Descending scan tests" << std::endl;
+  createRelationForward();
+  descendingScanTests();
+  deleteRelation();
+}
+
+void test43() {
+  // Scans of ranges open on one end, and of several ranges at once
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Multi-range scan tests" << std::endl;
+  createRelationForward();
+  multiRangeScanTests();
+  deleteRelation();
+}
+
+void test44() {
+  // Scans that return keys, and counts and extremes read from the leaves
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Index-only scan tests" << std::endl;
+  createRelationForward();
+  indexOnlyScanTests();
+  deleteRelation();
+}
+
+void test45() {
+  // Range sizes, ranks and quantiles estimated from the counts of non-leaves
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Cardinality estimate tests" << std::endl;
+  createRelationRandom();
+  cardinalityTests();
+  deleteRelation();
+}
+
+void test46() {
+  // Records of an index scan fetched in page order, each page read once
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Index heap scan tests" << std::endl;
+  createRelationRandom();
+  heapScanTests();
+  deleteRelation();
+}
+
+void test47() {
+  // A buffer pool in huge pages works like any other
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Huge page buffer pool tests" << std::endl;
+  createRelationForward();
+  hugePageTests();
+  deleteRelation();
+}
+
+void test48() {
+  // The clock sweeps its packed referenced bits a word at a time
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Clock replacement tests" << std::endl;
+  clockTests();
+}
+
+void test49() {
+  // Frames are added to and drained from a pool in use
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Buffer pool resize tests" << std::endl;
+  createRelationForward();
+  resizeTests(CLOCK);
+  resizeTests(TWO_QUEUE);
+  deleteRelation();
+}
+
+void test50() {
+  // Pages of higher priority classes outlast scans, and quotas cap files
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Priority class and quota tests" << std::endl;
+  createRelationForward();
+  priorityTests();
+  deleteRelation();
+}
+
+void test51() {
+  // Hits, misses, evictions and I/O times are counted and exported
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Buffer telemetry tests" << std::endl;
+  createRelationForward();
+  telemetryTests();
+  deleteRelation();
+}
+
+void test52() {
+  // The shape of the tree and the work of inserts and scans are reported
+  std::cout << "---------------------" << std::endl;
+  std::cout << "B+tree statistics tests" << std::endl;
+  createRelationForward();
+  btreeStatsTests();
+  deleteRelation();
+}
+
+void test53() {
+  // Relations are written straight into their files, from several threads
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Relation generator tests" << std::endl;
+  relationGeneratorTests();
+  deleteRelation();
+}
+
+void test54() {
+  // Page reads, evictions, index writes and splits leave trace events
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Trace event tests" << std::endl;
+  createRelationForward();
+  traceTests();
+  deleteRelation();
+}
+
+void test55() {
+  // Indexes on several attributes, scanned by a prefix of their columns
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Composite key tests" << std::endl;
+  compositeKeyTests();
+  deleteRelation();
+}
+
+void test56() {
+  // Extendible hash indexes for equality lookups
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Hash index tests" << std::endl;
+  createRelationForward();
+  hashIndexTests();
+  deleteRelation();
+}
+
+void test57() {
+  // Bloom filters of the keys answer lookups of missing keys
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Key filter tests" << std::endl;
+  createRelationForward();
+  keyFilterTests();
+  deleteRelation();
+}
+
+void test58() {
+  // Snapshot scans see the index as it was when they started
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Snapshot scan tests" << std::endl;
+  createRelationForward();
+  snapshotTests();
+  deleteRelation();
+}
+
+void test59() {
+  // Partitioned indexes spread key ranges over several files
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Partitioned index tests" << std::endl;
+  createRelationForward();
+  partitionedIndexTests();
+  deleteRelation();
+}
+
+void test60() {
+  // Joins pair up records with equal keys in batches
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Join tests" << std::endl;
+  createRelationForward();
+  joinTests();
+  deleteRelation();
+}
+
+void test61() {
+  // Pages in the pool are saved and read back in after a restart
+  std::cout << "---------------------" << std::endl;
+  std::cout << "Buffer pool warm-up tests" << std::endl;
+  createRelationForward();
+  warmupTests();
+  deleteRelation();
+}
+
+/**
+ * Writes the relation spec describes into a new file1.
+ */
+void generateRelation(const RelationSpec &spec) {
+  // destroy any old copies of relation file
+  try {
+    File::remove(relationName);
+  } catch (const FileNotFoundException &e) {
+  }
+  file1 = new PageFile(relationName, true);
+  RelationGenerator(spec).generate(file1);
+}
+
+/**
+ * Creates a random relation of the given size.
+ * @param size the size of the new random relation.
+ */
+void createRandomRelationOfSize(int size) {
+  RelationSpec spec;
+  spec.pattern = RANDOM_KEYS;
+  spec.high = size;
+  spec.seed = random();
+  generateRelation(spec);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationForward
+// -----------------------------------------------------------------------------
+
+void createRelationForward() {
+  RelationSpec spec;
+  spec.high = relationSize;
+  generateRelation(spec);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationBackward
+// -----------------------------------------------------------------------------
+
+void createRelationBackward() {
+  RelationSpec spec;
+  spec.pattern = BACKWARD_KEYS;
+  spec.high = relationSize;
+  generateRelation(spec);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationRandom
+// -----------------------------------------------------------------------------
+
+void createRelationRandom() {
+  RelationSpec spec;
+  spec.pattern = RANDOM_KEYS;
+  spec.high = relationSize;
+  spec.seed = random();
+  generateRelation(spec);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationForwardWithRange
+// -----------------------------------------------------------------------------
+void createRelationForwardWithRange(int start, int end) {
+  RelationSpec spec;
+  spec.low = start;
+  spec.high = end;
+  generateRelation(spec);
+}
+
+// -----------------------------------------------------------------------------
+// indexTests
+// -----------------------------------------------------------------------------
+
+void indexTests() {
+  intTests();
+  try {
+    File::remove(intIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  doubleTests();
+  try {
+    File::remove(doubleIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  stringTests();
+  try {
+    File::remove(stringIndexName);
+  } catch (const FileNotFoundException &e) {
+  }
+}
+
+// -----------------------------------------------------------------------------
+// intTests
+// -----------------------------------------------------------------------------
+
+void intTests() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // run some tests
+  intScanChecks(&index);
+}
+
+void intScanChecks(BTreeIndex *index) {
+  checkPassFail(intScan(index, 25, GT, 40, LT), 14)
+  checkPassFail(intScan(index, 20, GTE, 35, LTE), 16)
+  checkPassFail(intScan(index, -3, GT, 3, LT), 3)
+  checkPassFail(intScan(index, 996, GT, 1001, LT), 4)
+  checkPassFail(intScan(index, 0, GT, 1, LT), 0)
+  checkPassFail(intScan(index, 300, GT, 400, LT), 99)
+  checkPassFail(intScan(index, 3000, GTE, 4000, LT), 1000)
+}
+
+void readOnlyTests() {
+  {
+    std::cout << "Build the index, then open it read-only" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER, true, DEFAULT_FILL_FACTOR, true);
+  intScanChecks(&index);
+
+  bool thrown = false;
+  try {
+    int key = 0;
+    RecordId rid = {1, 1, 0};
+    index.insertEntry(&key, rid);
+  } catch (const IndexReadOnlyException &e) {
+    thrown = true;
+  }
+  checkPassFail(thrown, true)
+}
+
+// -----------------------------------------------------------------------------
+// doubleTests
+// -----------------------------------------------------------------------------
+
+void doubleTests() {
+  std::cout << "Create a B+ Tree index on the double field" << std::endl;
+  BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                   DOUBLE);
+
+  // run some tests
+  doubleScanChecks(&index);
+}
+
+void doubleScanChecks(BTreeIndex *index) {
+  checkPassFail(doubleScan(index, 25, GT, 40, LT), 14)
+  checkPassFail(doubleScan(index, 20, GTE, 35, LTE), 16)
+  checkPassFail(doubleScan(index, -3, GT, 3, LT), 3)
+  checkPassFail(doubleScan(index, 996, GT, 1001, LT), 4)
+  checkPassFail(doubleScan(index, 0, GT, 1, LT), 0)
+  checkPassFail(doubleScan(index, 300, GT, 400, LT), 99)
+  checkPassFail(doubleScan(index, 3000, GTE, 4000, LT), 1000)
+  checkPassFail(doubleScan(index, 24.5, GT, 40.5, LT), 16)
+}
+
+// -----------------------------------------------------------------------------
+// stringTests
+// -----------------------------------------------------------------------------
+
+void stringTests() {
+  std::cout << "Create a B+ Tree index on the string field" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                   STRING);
+
+  // run some tests
+  stringScanChecks(&index);
+}
+
+void stringScanChecks(BTreeIndex *index) {
+  checkPassFail(stringScan(index, 25, GT, 40, LT), 14)
+  checkPassFail(stringScan(index, 20, GTE, 35, LTE), 16)
+  checkPassFail(stringScan(index, -3, GT, 3, LT), 3)
+  checkPassFail(stringScan(index, 996, GT, 1001, LT), 4)
+  checkPassFail(stringScan(index, 0, GT, 1, LT), 0)
+  checkPassFail(stringScan(index, 300, GT, 400, LT), 99)
+  checkPassFail(stringScan(index, 3000, GTE, 4000, LT), 1000)
+}
+
+// -----------------------------------------------------------------------------
+// bulkLoadTests
+// -----------------------------------------------------------------------------
+
+void bulkLoadTests() {
+  {
+    std::cout << "Build the index by repeated insertEntry" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    intScanChecks(&index);
+  }
+  File::remove(intIndexName);
+
+  {
+    std::cout << "Bulk load the index with half full nodes" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, true, 0.5);
+    intScanChecks(&index);
+  }
+  File::remove(intIndexName);
+
+  {
+    // Half of a 10 frame pool holds fewer pairs than the relation has tuples
+    std::cout << "Bulk load the index through a small buffer pool" << std::endl;
+    BufMgr smallBufMgr(10);
+    BTreeIndex index(relationName, intIndexName, &smallBufMgr,
+                     offsetof(tuple, i), INTEGER);
+    intScanChecks(&index);
+  }
+  File::remove(intIndexName);
+
+  {
+    std::cout << "Build double and string indexes by repeated insertEntry"
+              << std::endl;
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE, false);
+    doubleScanChecks(&doubleIndex);
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING, false);
+    stringScanChecks(&stringIndex);
+  }
+  File::remove(doubleIndexName);
+  File::remove(stringIndexName);
+
+  // Reopening an existing index must not rebuild it
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+  {
+    std::cout << "Reopen an existing bulk loaded index" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    intScanChecks(&index);
+  }
+  File::remove(intIndexName);
+}
+// test for empty tree
+void testEmpty() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // run some tests
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 0)
+  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 0)
+  checkPassFail(intScan(&index, -3, GT, 3, LT), 0)
+  checkPassFail(intScan(&index, 996, GT, 1001, LT), 0)
+  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+  checkPassFail(intScan(&index, 300, GT, 400, LT), 0)
+  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+}
+
+// test for one leaf
+void intTestsOneLeaf() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // run some tests
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+  checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
+  checkPassFail(intScan(&index, 996, GT, 1001, LT), 0)
+  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+  checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+}
+
+// test for negative value
+void testNegative() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // run some tests
+  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
+  checkPassFail(intScan(&index, -3, GT, 3, LT), 5)
+  checkPassFail(intScan(&index, -1000, GT, 1000, LT), 1999)
+  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
+  checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
+  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+}
+
+void testOutOfBounds() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  checkPassFail(intScan(&index, 4000, GTE, 6000, LT), 1000);
+  checkPassFail(intScan(&index, 4999, GTE, 5000, LT), 1);
+
+  checkPassFail(intScan(&index, -20000, GTE, 7099, LT), 5000);
+  checkPassFail(intScan(&index, 4800, GTE, 5050, LTE), 200);
+
+  checkPassFail(intScan(&index, 5500, GTE, 6000, LT), 0);
+  checkPassFail(intScan(&index, 4999, GT, 6000, LT), 0);
+  checkPassFail(intScan(&index, -2000, GT, 0, LT), 0);
+
+  checkPassFail(intScan(&index, -2000, GT, 0, LTE), 1);
+  checkPassFail(intScan(&index, -2000, GT, 5, LTE), 6);
+  checkPassFail(intScan(&index, -2000, GT, 200, LT), 200);
+}
+
+// -----------------------------------------------------------------------------
+// splitTests
+// -----------------------------------------------------------------------------
+
+// Number of entries inserted by splitTests, enough for the root of a tree built
+// in key order to be a split non-leaf node
+const int splitTestSize = 500000;
+
+void splitTests() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // The relation is empty, so the record ids only encode their key
+  for (int i = 0; i < splitTestSize; i++) {
+    int key = (i % 2) ? splitTestSize - i : i;
+    RecordId keyRid = {(PageId)(key + 1), 1, 0};
+    index.insertEntry(&key, keyRid);
+  }
+
+  checkPassFail(countScan(&index, 0, GTE, splitTestSize, LT), splitTestSize)
+  checkPassFail(countScan(&index, 25, GT, 40, LT), 14)
+  checkPassFail(countScan(&index, 250000, GTE, 260000, LTE), 10001)
+  checkPassFail(countScan(&index, splitTestSize - 5, GT, splitTestSize, LT), 4)
+  checkPassFail(countScan(&index, splitTestSize, GTE, splitTestSize + 9, LT), 0)
+
+  // Batches smaller than, close to and larger than a leaf's worth of entries
+  checkPassFail(batchCountScan(&index, 0, GTE, splitTestSize, LT, 1), splitTestSize)
+  checkPassFail(batchCountScan(&index, 25, GT, 40, LT, 7), 14)
+  checkPassFail(batchCountScan(&index, 250000, GTE, 260000, LTE, 7), 10001)
+  checkPassFail(batchCountScan(&index, 250000, GTE, 260000, LTE, 1000), 10001)
+  checkPassFail(batchCountScan(&index, 0, GTE, splitTestSize, LTE, 100000), splitTestSize)
+  checkPassFail(batchCountScan(&index, splitTestSize, GTE, splitTestSize + 9, LT, 10), 0)
+}
+
+/**
+ * Scans an index whose record ids encode their key (see splitTests) and
+ * checks that keys come back in order and inside the range.
+ *
+ * @return the number of entries found, or -1 if one is out of place
+ */
+int countScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+              Operator highOp) {
+  RecordId scanRid;
+  int numResults = 0;
+  int lastKey = lowVal;
+
+  try {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+
+  while (1) {
+    try {
+      index->scanNext(scanRid);
+    } catch (const IndexScanCompletedException &e) {
+      break;
+    }
+
+    int key = (int)scanRid.page_number - 1;
+    if (key < lastKey || (lowOp == GT && key == lowVal) || key > highVal ||
+        (highOp == LT && key == highVal)) {
+      numResults = -1;
+      break;
+    }
+    lastKey = key;
+    numResults++;
+  }
+
+  index->endScan();
+  return numResults;
+}
+
+/**
+ * Scans an index like countScan(), fetching up to batchSize record ids per call
+ * to scanNextBatch(). Also checks that only the last batch comes back short and
+ * that the scan keeps returning empty batches once it is complete.
+ *
+ * @return the number of entries found, or -1 if one is out of place
+ */
+int batchCountScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+                   Operator highOp, std::size_t batchSize) {
+  std::vector<RecordId> batch(batchSize);
+  int numResults = 0;
+  int lastKey = lowVal;
+
+  try {
+    index->startScan(&lowVal, lowOp, &highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+
+  std::size_t fetched;
+  do {
+    fetched = index->scanNextBatch(&batch[0], batchSize);
+    for (std::size_t i = 0; i < fetched; i++) {
+      int key = (int)batch[i].page_number - 1;
+      if (key < lastKey || (lowOp == GT && key == lowVal) || key > highVal ||
+          (highOp == LT && key == highVal)) {
+        index->endScan();
+        return -1;
+      }
+      lastKey = key;
+      numResults++;
+    }
+  } while (fetched == batchSize);
+
+  if (index->scanNextBatch(&batch[0], batchSize) != 0) numResults = -1;
+
+  index->endScan();
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// keySearchTests
+// -----------------------------------------------------------------------------
+
+void keySearchTests() {
+  int mismatches = 0;
+  std::vector<int> keys(INTARRAYNONLEAFSIZE);
+  std::vector<int> blockKeys(INTARRAYNONLEAFSIZE / INTNONLEAFBLOCKSIZE + 1);
+
+  for (int count = 0; count <= INTARRAYNONLEAFSIZE; count += (count < 80) ? 1 : 97) {
+    // Few distinct values, so there are plenty of duplicates, plus the extremes
+    for (int i = 0; i < count; i++) keys[i] = (int)(random() % 64) - 32;
+    if (count > 0) keys[0] = INT_MIN;
+    if (count > 1) keys[count - 1] = INT_MAX;
+    std::sort(keys.begin(), keys.begin() + count);
+    for (int b = 0; b < count / INTNONLEAFBLOCKSIZE; b++) {
+      blockKeys[b] = keys[(b + 1) * INTNONLEAFBLOCKSIZE - 1];
+    }
+
+    const int probes[] = {INT_MIN, -33, -32, -1, 0, 5, 31, 32, INT_MAX};
+    for (int p = 0; p < 9; p++) {
+      const int key = probes[p];
+      const int lower = std::lower_bound(keys.begin(), keys.begin() + count, key) - keys.begin();
+      const int upper = std::upper_bound(keys.begin(), keys.begin() + count, key) - keys.begin();
+
+      if (keyLowerBound(&keys[0], count, key) != lower) mismatches++;
+      if (keyUpperBound(&keys[0], count, key) != upper) mismatches++;
+      int guessed;
+      if (keyInterpolate(&keys[0], count, key, false, guessed) &&
+          guessed != lower) {
+        mismatches++;
+      }
+      if (keyInterpolate(&keys[0], count, key, true, guessed) &&
+          guessed != upper) {
+        mismatches++;
+      }
+      if (keyBlockLowerBound(&keys[0], &blockKeys[0], count,
+                             INTNONLEAFBLOCKSIZE, key) != lower) {
+        mismatches++;
+      }
+      if (keyBlockUpperBound(&keys[0], &blockKeys[0], count,
+                             INTNONLEAFBLOCKSIZE, key) != upper) {
+        mismatches++;
+      }
+      if (countKeysScalar(&keys[0], count, key, false) != lower) mismatches++;
+#ifdef BADGERDB_KEY_SEARCH_X86
+      if (countKeysSse2(&keys[0], count, key, false) != lower) mismatches++;
+      if (countKeysSse2(&keys[0], count, key, true) != count - upper) mismatches++;
+      if (keySearchHasAvx2()) {
+        if (countKeysAvx2(&keys[0], count, key, false) != lower) mismatches++;
+        if (countKeysAvx2(&keys[0], count, key, true) != count - upper) mismatches++;
+      }
+#endif
+    }
+  }
+
+  // Keys spread evenly, with gaps, are found through the first guess
+  int guesses = 0;
+  for (int i = 0; i < INTARRAYNONLEAFSIZE; i++) keys[i] = 1000 + 3 * i;
+  for (int key = 990; key < 1000 + 3 * INTARRAYNONLEAFSIZE + 10; key++) {
+    const int lower =
+        std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+    const int upper =
+        std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+    int guessed;
+    if (keyInterpolate(&keys[0], INTARRAYNONLEAFSIZE, key, false, guessed)) {
+      guesses++;
+      if (guessed != lower) mismatches++;
+    }
+    if (keyInterpolate(&keys[0], INTARRAYNONLEAFSIZE, key, true, guessed) &&
+        guessed != upper) {
+      mismatches++;
+    }
+  }
+  checkPassFail(guesses, 3 * INTARRAYNONLEAFSIZE - 2)
+
+  // DOUBLE keys are never guessed, however evenly spread
+  std::vector<double> doubles(DOUBLEARRAYNONLEAFSIZE);
+  for (int i = 0; i < DOUBLEARRAYNONLEAFSIZE; i++) doubles[i] = 1000 + 3 * i;
+  int guessed;
+  const bool guessedDouble = keyInterpolate(
+      &doubles[0], DOUBLEARRAYNONLEAFSIZE, 1300.0, false, guessed);
+  checkPassFail(guessedDouble, false)
+  checkPassFail(mismatches, 0)
+}
+
+// -----------------------------------------------------------------------------
+// stringNodeTests
+// -----------------------------------------------------------------------------
+
+void stringNodeTests() {
+  // Keys with long shared prefixes, a long run of one repeated key, and short
+  // zero padded keys, inserted in random order
+  std::vector<std::string> keys;
+  char value[100];
+  for (int i = 0; i < 20000; i++) {
+    sprintf(value, "%05d string record", i);
+    keys.push_back(paddedStringKey(value));
+  }
+  for (int i = 0; i < 5000; i++) keys.push_back(paddedStringKey("zzzzzzzzzz"));
+  for (int i = 0; i < 20000; i++) {
+    int length = 1 + (int)(random() % STRINGSIZE);
+    for (int j = 0; j < length; j++) value[j] = (char)('a' + random() % 26);
+    value[length] = 0;
+    keys.push_back(paddedStringKey(value));
+  }
+  keys.push_back(paddedStringKey("zzzzzzzzz"));
+  for (std::size_t i = keys.size() - 1; i > 0; i--) {
+    std::swap(keys[i], keys[random() % (i + 1)]);
+  }
+
+  {
+    std::cout << "Create a B+ Tree index on the string field" << std::endl;
+    BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                     STRING);
+
+    // The relation is empty, so the record ids only locate their key in keys
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      RecordId keyRid = {(PageId)(i + 1), 1, 0};
+      index.insertEntry((void *)keys[i].c_str(), keyRid);
+    }
+  }
+
+  std::cout << "Reopen the index and scan it" << std::endl;
+  BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple, s),
+                   STRING);
+  std::vector<std::string> sorted(keys);
+  std::sort(sorted.begin(), sorted.end());
+
+  const char *bounds[][2] = {{"", "zzzzzzzzzz"}, {"00100", "00200 string"},
+                             {"a", "b"},         {"ab", "abz"},
+                             {"m", "m"},         {"zzzzzzzzz", "zzzzzzzzzz"},
+                             {"00019999 s", "a"}};
+  const Operator lowOps[] = {GTE, GT};
+  const Operator highOps[] = {LTE, LT};
+  for (int b = 0; b < 7; b++) {
+    for (int l = 0; l < 2; l++) {
+      for (int h = 0; h < 2; h++) {
+        const std::string low = paddedStringKey(bounds[b][0]);
+        const std::string high = paddedStringKey(bounds[b][1]);
+        std::vector<std::string>::iterator first =
+            (lowOps[l] == GTE)
+                ? std::lower_bound(sorted.begin(), sorted.end(), low)
+                : std::upper_bound(sorted.begin(), sorted.end(), low);
+        std::vector<std::string>::iterator last =
+            (highOps[h] == LTE)
+                ? std::upper_bound(sorted.begin(), sorted.end(), high)
+                : std::lower_bound(sorted.begin(), sorted.end(), high);
+        const int expected = (first < last) ? (int)(last - first) : 0;
+
+        checkPassFail(stringCountScan(&index, keys, bounds[b][0], lowOps[l],
+                                      bounds[b][1], highOps[h]),
+                      expected)
+        checkPassFail(stringCountScan(&index, keys, bounds[b][0], lowOps[l],
+                                      bounds[b][1], highOps[h], 333),
+                      expected)
+      }
+    }
+  }
+
+  // Splits where the new key shares less than the full node does, so that a
+  // split down the middle would not fit
+  checkPassFail(checkStringLeafSplit("zzzzzzzzzz", "a"), 0)
+  checkPassFail(checkStringLeafSplit("zzzzzzzzzz", "{"), 0)
+  checkPassFail(checkStringLeafSplit("zzzzzzzzzz", "zzzzzzzzzz"), 0)
+  checkPassFail(checkStringNonLeafSplit("b"), 0)
+  checkPassFail(checkStringNonLeafSplit("a"), 0)
+  checkPassFail(checkStringNonLeafSplit("aaaaaaaamm"), 0)
+}
+
+/**
+ * Fills a STRING leaf with copies of fillKey, splits it with newKey and checks
+ * that the two leaves hold all entries in order.
+ *
+ * @return the number of entries out of place
+ */
+int checkStringLeafSplit(const char *fillKey, const char *newKey) {
+  Page leftPage, rightPage;
+  LeafNodeString *left = reinterpret_cast<LeafNodeString *>(&leftPage);
+  LeafNodeString *right = reinterpret_cast<LeafNodeString *>(&rightPage);
+  const StringKey fill = KeyTraits<StringKey>::load(fillKey);
+  const StringKey key = KeyTraits<StringKey>::load(newKey);
+
+  std::vector<StringKey> expectedKeys;
+  std::vector<PageId> expectedPages;
+  left->init();
+  RecordId fillRid = {1, 1, 0};
+  while (left->hasRoom(fill, fillRid)) {
+    left->insertAt(left->numKeys, fill, fillRid);
+    expectedKeys.push_back(fill);
+    expectedPages.push_back(fillRid.page_number);
+    fillRid.page_number++;
+  }
+  if (left->numKeys <= STRINGARRAYLEAFSIZE) return -1;  // Nothing compressed
+
+  const int pos = left->upperBound(key);
+  RecordId rid = {0, 1, 0};
+  right->init();
+  left->splitInto(*right, pos, key, rid);
+  expectedKeys.insert(expectedKeys.begin() + pos, key);
+  expectedPages.insert(expectedPages.begin() + pos, 0);
+
+  int mismatches = 0;
+  if (left->numKeys == 0 || right->numKeys == 0) mismatches++;
+  if (left->numKeys + right->numKeys != (int)expectedKeys.size()) return -1;
+  for (int i = 0; i < (int)expectedKeys.size(); i++) {
+    const LeafNodeString *node = (i < left->numKeys) ? left : right;
+    const int j = (i < left->numKeys) ? i : i - left->numKeys;
+    if (node->getKey(j) != expectedKeys[i]) mismatches++;
+    if (node->getRid(j).page_number != expectedPages[i]) mismatches++;
+  }
+  return mismatches;
+}
+
+/**
+ * Fills a STRING non-leaf with keys sharing an 8 byte prefix, splits it with
+ * newKey and checks that the keys, children and entry counts of the two nodes
+ * and the pushed up key are all in order and that both nodes search correctly.
+ *
+ * @return the number of keys, children or searches out of place
+ */
+int checkStringNonLeafSplit(const char *newKey) {
+  Page leftPage, rightPage;
+  NonLeafNodeString *left = reinterpret_cast<NonLeafNodeString *>(&leftPage);
+  NonLeafNodeString *right = reinterpret_cast<NonLeafNodeString *>(&rightPage);
+  const StringKey key = KeyTraits<StringKey>::load(newKey);
+
+  // Plenty of keys that only differ in their last two bytes, with duplicates
+  std::vector<StringKey> keys;
+  char value[STRINGSIZE + 1];
+  for (int i = 0; i < 2000; i++) {
+    const int suffix = (i * 7) % 676;
+    sprintf(value, "aaaaaaaa%c%c", 'a' + suffix / 26, 'a' + suffix % 26);
+    keys.push_back(KeyTraits<StringKey>::load(value));
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<StringKey> expectedKeys;
+  std::vector<PageId> expectedChildren(1, 1000000);
+  std::vector<std::uint32_t> expectedCounts(1, 5);
+  left->init(1, expectedChildren[0], expectedCounts[0]);
+  while (left->hasRoom(keys[expectedKeys.size()])) {
+    const PageId child = (PageId)(expectedKeys.size() + 1);
+    left->insertAt(left->numKeys, keys[expectedKeys.size()], child, child * 3);
+    expectedKeys.push_back(keys[expectedKeys.size()]);
+    expectedChildren.push_back(child);
+    expectedCounts.push_back(child * 3);
+  }
+  if (left->numKeys <= STRINGARRAYNONLEAFSIZE) return -1;  // Nothing compressed
+
+  const int pos = left->upperBound(key);
+  StringKey pushup;
+  left->splitInto(*right, pos, key, 999, 7, pushup);
+  expectedKeys.insert(expectedKeys.begin() + pos, key);
+  expectedChildren.insert(expectedChildren.begin() + pos + 1, 999);
+  expectedCounts.insert(expectedCounts.begin() + pos + 1, 7);
+
+  int mismatches = 0;
+  std::vector<StringKey> actualKeys;
+  std::vector<PageId> actualChildren;
+  std::vector<std::uint32_t> actualCounts;
+  for (int i = 0; i < left->numKeys; i++) actualKeys.push_back(left->getKey(i));
+  actualKeys.push_back(pushup);
+  for (int i = 0; i < right->numKeys; i++) actualKeys.push_back(right->getKey(i));
+  for (int i = 0; i <= left->numKeys; i++) actualChildren.push_back(left->getChild(i));
+  for (int i = 0; i <= right->numKeys; i++) actualChildren.push_back(right->getChild(i));
+  for (int i = 0; i <= left->numKeys; i++) actualCounts.push_back(left->getCount(i));
+  for (int i = 0; i <= right->numKeys; i++) actualCounts.push_back(right->getCount(i));
+  if (actualKeys != expectedKeys) mismatches++;
+  if (actualChildren != expectedChildren) mismatches++;
+  if (actualCounts != expectedCounts) mismatches++;
+  if (left->totalCount() + right->totalCount() !=
+      std::accumulate(expectedCounts.begin(), expectedCounts.end(), 0u)) {
+    mismatches++;
+  }
+  if (right->level != 1) mismatches++;
+
+  const char *probes[] = {"", "a", "aaaaaaaa", "aaaaaaaaa", "aaaaaaaamm",
+                          "aaaaaaaammz", "aaaaaaaazz", "b", "{"};
+  for (int p = 0; p < 9; p++) {
+    const StringKey probe = KeyTraits<StringKey>::load(probes[p]);
+    const NonLeafNodeString *nodes[] = {left, right};
+    for (int n = 0; n < 2; n++) {
+      std::vector<StringKey> nodeKeys;
+      for (int i = 0; i < nodes[n]->numKeys; i++) nodeKeys.push_back(nodes[n]->getKey(i));
+      const int lower = std::lower_bound(nodeKeys.begin(), nodeKeys.end(), probe) - nodeKeys.begin();
+      const int upper = std::upper_bound(nodeKeys.begin(), nodeKeys.end(), probe) - nodeKeys.begin();
+      if (nodes[n]->lowerBound(probe) != lower) mismatches++;
+      if (nodes[n]->upperBound(probe) != upper) mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+/**
+ * Returns the STRINGSIZE bytes a STRING index keeps of value.
+ */
+std::string paddedStringKey(const char *value) {
+  char key[STRINGSIZE];
+  strncpy(key, value, STRINGSIZE);
+  return std::string(key, STRINGSIZE);
+}
+
+/**
+ * Scans an index whose record ids locate their key in keys (see
+ * stringNodeTests) and checks that keys come back in order and inside the
+ * range. A nonzero batchSize fetches that many record ids per call to
+ * scanNextBatch() instead of calling scanNext().
+ *
+ * @return the number of entries found, or -1 if one is out of place
+ */
+int stringCountScan(BTreeIndex *index, const std::vector<std::string> &keys,
+                    const char *lowVal, Operator lowOp, const char *highVal,
+                    Operator highOp, std::size_t batchSize) {
+  const std::string low = paddedStringKey(lowVal);
+  const std::string high = paddedStringKey(highVal);
+  std::vector<RecordId> batch(std::max<std::size_t>(batchSize, 1));
+  int numResults = 0;
+  std::string lastKey = low;
+
+  try {
+    index->startScan((void *)lowVal, lowOp, (void *)highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+
+  std::size_t fetched = 1;
+  while (fetched && numResults >= 0) {
+    if (batchSize) {
+      fetched = index->scanNextBatch(&batch[0], batchSize);
+    } else {
+      try {
+        index->scanNext(batch[0]);
+      } catch (const IndexScanCompletedException &e) {
+        break;
+      }
+    }
+
+    for (std::size_t i = 0; i < fetched; i++) {
+      const std::string &key = keys[batch[i].page_number - 1];
+      if (key < lastKey || (lowOp == GT && key == low) || key > high ||
+          (highOp == LT && key == high)) {
+        numResults = -1;
+        break;
+      }
+      lastKey = key;
+      numResults++;
+    }
+  }
+
+  index->endScan();
+  return numResults;
+}
+
+// -----------------------------------------------------------------------------
+// cursorTests
+// -----------------------------------------------------------------------------
+
+// Number of entries inserted by cursorTests, enough for a few dozen leaves
+const int cursorTestSize = 20000;
+
+void cursorTests() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // The relation is empty, so the record ids only encode their key
+  for (int i = 0; i < cursorTestSize; i++) {
+    int key = (i * 7919) % cursorTestSize;
+    RecordId keyRid = {(PageId)(key + 1), 1, 0};
+    index.insertEntry(&key, keyRid);
+  }
+
+  // Interleave a full scan, a short scan and the cursorless scan, each of
+  // which has to see exactly its own range in order
+  {
+    IndexCursor all, some;
+    int low = 0, high = cursorTestSize, someLow = 5000, someHigh = 5600;
+    int defaultLow = 100, defaultHigh = 9000;
+    index.startScan(all, &low, GTE, &high, LT);
+    index.startScan(some, &someLow, GT, &someHigh, LTE);
+    index.startScan(&defaultLow, GTE, &defaultHigh, LT);
+
+    int nextAll = 0, nextSome = someLow + 1, nextDefault = defaultLow;
+    int mismatches = 0;
+    while (all.isScanning()) {
+      if (cursorKey(&index, all) != (nextAll < high ? nextAll : -1)) mismatches++;
+      nextAll++;
+      if (some.isScanning()) {
+        if (cursorKey(&index, some) != (nextSome <= someHigh ? nextSome : -1))
+          mismatches++;
+        nextSome++;
+      }
+      if (nextDefault < defaultHigh) {
+        RecordId rid;
+        index.scanNext(rid);
+        if ((int)rid.page_number - 1 != nextDefault) mismatches++;
+        nextDefault++;
+      }
+    }
+    index.endScan();
+
+    checkPassFail(mismatches, 0)
+    checkPassFail(nextAll, cursorTestSize + 1)
+    checkPassFail(nextSome, someHigh + 2)
+  }
+
+  // A nested loop self join, restarting the inner cursor for every outer key,
+  // with a batched outer scan
+  {
+    IndexCursor outer, inner;
+    int low = 1000, high = 3000;
+    index.startScan(outer, &low, GTE, &high, LT);
+
+    RecordId batch[64];
+    int matches = 0;
+    std::size_t fetched;
+    do {
+      fetched = index.scanNextBatch(outer, batch, 64);
+      for (std::size_t i = 0; i < fetched; i++) {
+        int key = (int)batch[i].page_number - 1;
+        index.startScan(inner, &key, GTE, &key, LTE);
+        while (cursorKey(&index, inner) == key) matches++;
+      }
+    } while (fetched == 64);
+
+    checkPassFail(matches, high - low)
+  }
+
+  // Cursors still open when they go out of scope unpin their leaf
+  {
+    IndexCursor open1, open2;
+    int low = 0, high = cursorTestSize;
+    index.startScan(open1, &low, GTE, &high, LTE);
+    index.startScan(open2, &low, GTE, &high, LTE);
+    cursorKey(&index, open2);
+  }
+
+  // Restarting a cursor ends its scan, also when the new one finds no key
+  {
+    IndexCursor cursor;
+    int low = 10, high = 10;
+    index.startScan(cursor, &low, GTE, &high, LTE);
+    index.startScan(cursor, &low, GTE, &high, LTE);
+    checkPassFail(cursorKey(&index, cursor), 10)
+    bool noKey = false;
+    try {
+      index.startScan(cursor, &low, GT, &high, LTE);
+    } catch (const NoSuchKeyFoundException &e) {
+      noKey = true;
+    }
+    checkPassFail(noKey && !cursor.isScanning(), true)
+  }
+}
+
+/**
+ * Returns the key of the next entry of the scan of cursor, on an index whose
+ * record ids encode their key (see cursorTests). Once the scan is complete,
+ * ends it and returns -1.
+ */
+int cursorKey(BTreeIndex *index, IndexCursor &cursor) {
+  RecordId rid;
+  try {
+    index->scanNext(cursor, rid);
+  } catch (const IndexScanCompletedException &e) {
+    index->endScan(cursor);
+    return -1;
+  }
+  return (int)rid.page_number - 1;
+}
+
+// -----------------------------------------------------------------------------
+// concurrentTests
+// -----------------------------------------------------------------------------
+
+// Number of threads sharing a buffer pool in concurrentTests
+const int concurrentThreads = 4;
+
+// Pages each thread of concurrentTests writes, several times what the pool holds
+const int concurrentPagesPerThread = 40;
+
+void concurrentTests() {
+  // Few enough frames that the threads keep evicting each other's pages
+  BufMgr smallBufMgr(16);
+
+  {
+    std::cout << "Scan one index from several threads" << std::endl;
+    BTreeIndex index(relationName, intIndexName, &smallBufMgr,
+                     offsetof(tuple, i), INTEGER);
+
+    // The relation is empty, so the record ids only encode their key
+    for (int i = 0; i < cursorTestSize; i++) {
+      int key = (i * 7919) % cursorTestSize;
+      RecordId keyRid = {(PageId)(key + 1), 1, 0};
+      index.insertEntry(&key, keyRid);
+    }
+
+    std::vector<int> failures(concurrentThreads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < concurrentThreads; t++) {
+      threads.push_back(std::thread(concurrentScans, &index, t, &failures[t]));
+    }
+    for (int t = 0; t < concurrentThreads; t++) threads[t].join();
+
+    int totalFailures = 0;
+    for (int t = 0; t < concurrentThreads; t++) totalFailures += failures[t];
+    checkPassFail(totalFailures, 0)
+  }
+
+  const std::string pagesFileName = relationName + ".pages";
+  {
+    std::cout << "Write and read back pages from several threads" << std::endl;
+    BlobFile pagesFile(pagesFileName, true);
+
+    std::vector<int> failures(concurrentThreads, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < concurrentThreads; t++) {
+      threads.push_back(
+          std::thread(concurrentPages, &smallBufMgr, &pagesFile, t, &failures[t]));
+    }
+    for (int t = 0; t < concurrentThreads; t++) threads[t].join();
+
+    int totalFailures = 0;
+    for (int t = 0; t < concurrentThreads; t++) totalFailures += failures[t];
+    checkPassFail(totalFailures, 0)
+
+    smallBufMgr.flushFile(&pagesFile);
+  }
+  File::remove(pagesFileName);
+}
+
+/**
+ * Runs range scans of different lengths on its own cursor, on an index whose
+ * record ids encode their key (see concurrentTests), and counts the scans that
+ * return the wrong entries in failures.
+ */
+void concurrentScans(BTreeIndex *index, int seed, int *failures) {
+  IndexCursor cursor;
+  for (int round = 0; round < 100; round++) {
+    int low = (seed * 4999 + round * 7919) % cursorTestSize;
+    int high = low + (round * 37) % 600;
+    index->startScan(cursor, &low, GTE, &high, LTE);
+
+    int expected = low;
+    int key;
+    while ((key = cursorKey(index, cursor)) != -1) {
+      if (key != expected) break;
+      expected++;
+    }
+    if (cursor.isScanning()) index->endScan(cursor);
+    if (key != -1 || expected != std::min(high, cursorTestSize - 1) + 1) {
+      (*failures)++;
+    }
+  }
+}
+
+/**
+ * Allocates pages of file through pool, stamps each with its thread and
+ * number, then reads them all back and counts the pages with the wrong stamp
+ * in failures.
+ */
+void concurrentPages(BufMgr *pool, File *file, int seed, int *failures) {
+  std::vector<PageId> pageNos(concurrentPagesPerThread);
+  for (int i = 0; i < concurrentPagesPerThread; i++) {
+    Page *page;
+    pool->allocPage(file, pageNos[i], page);
+    *reinterpret_cast<int *>(page) = seed * concurrentPagesPerThread + i;
+    pool->unPinPage(file, pageNos[i], true);
+  }
+
+  for (int pass = 0; pass < 3; pass++) {
+    for (int i = 0; i < concurrentPagesPerThread; i++) {
+      Page *page;
+      pool->readPage(file, pageNos[i], page);
+      if (*reinterpret_cast<int *>(page) != seed * concurrentPagesPerThread + i) {
+        (*failures)++;
+      }
+      pool->unPinPage(file, pageNos[i], false);
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// concurrentInsertTests
+// -----------------------------------------------------------------------------
+
+// Threads inserting and scanning in concurrentInsertTests
+const int concurrentWriters = 8;
+const int concurrentReaders = 2;
+
+// Distinct keys inserted by concurrentInsertTests, split among the writers
+const int concurrentInsertSize = 60000;
+
+// Key every writer also inserts concurrentDupsPerWriter times
+const int concurrentDupKey = 30000;
+const int concurrentDupsPerWriter = 500;
+
+void concurrentInsertTests() {
+  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  std::atomic<bool> done(false);
+  std::vector<int> failures(concurrentReaders, 0);
+  std::vector<std::thread> readers, writers;
+  for (int t = 0; t < concurrentReaders; t++) {
+    readers.push_back(
+        std::thread(concurrentInsertScans, &index, &done, &failures[t]));
+  }
+  for (int t = 0; t < concurrentWriters; t++) {
+    writers.push_back(std::thread(concurrentInserts, &index, t));
+  }
+  for (int t = 0; t < concurrentWriters; t++) writers[t].join();
+  done = true;
+  for (int t = 0; t < concurrentReaders; t++) readers[t].join();
+
+  int totalFailures = 0;
+  for (int t = 0; t < concurrentReaders; t++) totalFailures += failures[t];
+  checkPassFail(totalFailures, 0)
+
+  // Every entry made it in exactly once, and the duplicates of each writer
+  // kept their insertion order
+  IndexCursor cursor;
+  int low = INT_MIN, high = INT_MAX;
+  index.startScan(cursor, &low, GTE, &high, LTE);
+  std::vector<int> nextDup(concurrentWriters, 0);
+  int expected = 0, extraDups = 0, mismatches = 0;
+  RecordId rid;
+  while (true) {
+    try {
+      index.scanNext(cursor, rid);
+    } catch (const IndexScanCompletedException &e) {
+      break;
+    }
+    const int key = (int)rid.page_number - 1;
+    if (rid.slot_number == 0) {
+      if (key != expected) mismatches++;
+      expected = key + 1;
+    } else {
+      const int writer = (rid.slot_number - 1) / concurrentDupsPerWriter;
+      const int dup = (rid.slot_number - 1) % concurrentDupsPerWriter;
+      if (key != concurrentDupKey || dup != nextDup[writer]) mismatches++;
+      nextDup[writer]++;
+      extraDups++;
+    }
+  }
+  index.endScan(cursor);
+
+  checkPassFail(mismatches, 0)
+  checkPassFail(expected, concurrentInsertSize)
+  checkPassFail(extraDups, concurrentWriters * concurrentDupsPerWriter)
+}
+
+/**
+ * Inserts the keys of concurrentInsertTests that belong to writer seed, in a
+ * scrambled order, with record ids that encode the key and, for duplicates of
+ * concurrentDupKey, the writer and the duplicate number.
+ */
+void concurrentInserts(BTreeIndex *index, int seed) {
+  const int perWriter = concurrentInsertSize / concurrentWriters;
+  int dups = 0;
+  for (int i = 0; i < perWriter; i++) {
+    int key = ((i * 7919) % perWriter) * concurrentWriters + seed;
+    RecordId keyRid = {(PageId)(key + 1), 0, 0};
+    index->insertEntry(&key, keyRid);
+
+    if (i % (perWriter / concurrentDupsPerWriter) == 0 &&
+        dups < concurrentDupsPerWriter) {
+      int dupKey = concurrentDupKey;
+      RecordId dupRid = {(PageId)(dupKey + 1),
+                         (SlotId)(seed * concurrentDupsPerWriter + dups + 1), 0};
+      index->insertEntry(&dupKey, dupRid);
+      dups++;
+    }
+  }
+}
+
+/**
+ * Scans ranges of the index of concurrentInsertTests until done is set,
+ * counting in failures the scans whose entries come back out of order, out of
+ * range or more than once.
+ */
+void concurrentInsertScans(BTreeIndex *index, const std::atomic<bool> *done,
+                           int *failures) {
+  IndexCursor cursor;
+  for (int round = 0; !*done || round < 5; round++) {
+    int low = (round * 7919) % concurrentInsertSize;
+    int high = low + 2000;
+    try {
+      index->startScan(cursor, &low, GT, &high, LT);
+    } catch (const NoSuchKeyFoundException &e) {
+      continue;
+    }
+
+    RecordId rid, lastRid = {0, 0, 0};
+    int lastKey = low;
+    std::vector<bool> seenDups(concurrentWriters * concurrentDupsPerWriter + 1);
+    while (true) {
+      try {
+        index->scanNext(cursor, rid);
+      } catch (const IndexScanCompletedException &e) {
+        break;
+      }
+      const int key = (int)rid.page_number - 1;
+      bool bad = key <= low || key >= high || key < lastKey;
+      if (rid.slot_number == 0) {
+        bad = bad || rid == lastRid;
+      } else {
+        bad = bad || seenDups[rid.slot_number];
+        seenDups[rid.slot_number] = true;
+      }
+      if (bad) {
+        (*failures)++;
+        break;
+      }
+      lastKey = key;
+      lastRid = rid;
+    }
+    index->endScan(cursor);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// hashTableTests
+// -----------------------------------------------------------------------------
+
+const int hashTestPages = 3000;
+
+// Frames in the pool of backgroundWriterTests, and the pages dirtied in it
+const int writerTestFrames = 64;
+const int writerTestPages = 48;
+
+void backgroundWriterTests() {
+  // The writer starts above half of the pool dirty and stops at a quarter
+  BufMgr writerBufMgr(writerTestFrames, 0.5, 0.25);
+  std::vector<PageId> pageNos(writerTestPages);
+  std::vector<RecordId> rids(writerTestPages);
+  for (int i = 0; i < writerTestPages; i++) {
+    Page *page;
+    writerBufMgr.allocPage(file1, pageNos[i], page);
+    rids[i] = page->insertRecord(std::to_string(i));
+    writerBufMgr.unPinPage(file1, pageNos[i], true);
+  }
+
+  // Give the writer up to a few seconds to get back under the high watermark.
+  // Each time the pool goes past it, the writer cleans down to the low one.
+  for (int wait = 0; wait < 5000; wait++) {
+    if (writerBufMgr.getNumDirty() <= writerTestFrames / 2) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  const bool cleaned = writerBufMgr.getNumDirty() <= writerTestFrames / 2;
+  checkPassFail(cleaned, true)
+  const bool written = writerBufMgr.getBufStats().diskwrites.load() >=
+                       writerTestPages - writerTestFrames / 2;
+  checkPassFail(written, true)
+
+  // Pages cleaned by the writer read back the same once evicted
+  writerBufMgr.flushFile(file1);
+  checkPassFail(writerBufMgr.getNumDirty(), 0u)
+  int mismatches = 0;
+  for (int i = 0; i < writerTestPages; i++) {
+    Page *page;
+    writerBufMgr.readPage(file1, pageNos[i], page);
+    if (page->getRecord(rids[i]) != std::to_string(i)) mismatches++;
+    writerBufMgr.unPinPage(file1, pageNos[i], false);
+  }
+  checkPassFail(mismatches, 0)
+  writerBufMgr.flushFile(file1);
+}
+
+void readAheadTests() {
+  BufMgr aheadBufMgr(64);
+  const PageId first = file1->getFirstPageNo();
+  const PageId end = file1->getNumPages();
+
+  // The second run goes past the end of the file, which is skipped
+  aheadBufMgr.prefetch(file1, first, 8);
+  aheadBufMgr.prefetch(file1, end - 2, 4);
+  for (int wait = 0; wait < 5000; wait++) {
+    if (aheadBufMgr.getBufStats().diskreads.load() >= 10) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  checkPassFail(aheadBufMgr.getBufStats().diskreads.load(), 10)
+
+  int misses = 0;
+  for (PageId pageNo = first; pageNo < first + 8; pageNo++) {
+    Page *page;
+    aheadBufMgr.readPage(file1, pageNo, page);
+    if (page->page_number() != pageNo) misses++;
+    aheadBufMgr.unPinPage(file1, pageNo, false);
+  }
+  for (PageId pageNo = end - 2; pageNo < end; pageNo++) {
+    Page *page;
+    aheadBufMgr.readPage(file1, pageNo, page);
+    aheadBufMgr.unPinPage(file1, pageNo, false);
+  }
+  checkPassFail(misses, 0)
+  checkPassFail(aheadBufMgr.getBufStats().diskreads.load(), 10)
+  aheadBufMgr.flushFile(file1);
+
+  // A scan keeps the pages after its own read ahead
+  {
+    FileScan fileScan(relationName, &aheadBufMgr);
+    RecordId rid;
+    int records = 0;
+    try {
+      while (true) {
+        fileScan.scanNext(rid);
+        records++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+    checkPassFail(records, relationSize)
+  }
+}
+
+// Frames in the pool of scanResistanceTests, pages used over and over, and
+// pages read once to get those out of A1in
+const int resistanceTestFrames = 32;
+const int hotPages = 4;
+const int coldPages = 40;
+
+void scanResistanceTests() {
+  BufMgr queueBufMgr(resistanceTestFrames, DEFAULT_HIGH_DIRTY_RATIO,
+                     DEFAULT_LOW_DIRTY_RATIO, TWO_QUEUE);
+  const PageId first = file1->getFirstPageNo();
+  const bool enoughPages = file1->getNumPages() > first + hotPages + coldPages;
+  checkPassFail(enoughPages, true)
+
+  // The hot pages leave A1in while the cold ones are read, and are read again
+  // before A1out forgets them, which puts them in Am
+  Page *page;
+  for (int i = 0; i < hotPages + coldPages; i++) {
+    queueBufMgr.readPage(file1, first + i, page);
+    queueBufMgr.unPinPage(file1, first + i, false);
+  }
+  for (int i = 0; i < hotPages; i++) {
+    queueBufMgr.readPage(file1, first + i, page);
+    queueBufMgr.unPinPage(file1, first + i, false);
+  }
+
+  {
+    FileScan fileScan(relationName, &queueBufMgr);
+    RecordId rid;
+    try {
+      while (true) fileScan.scanNext(rid);
+    } catch (const EndOfFileException &e) {
+    }
+  }
+
+  // All of them are still in the pool
+  const int reads = queueBufMgr.getBufStats().diskreads.load();
+  for (int i = 0; i < hotPages; i++) {
+    queueBufMgr.readPage(file1, first + i, page);
+    queueBufMgr.unPinPage(file1, first + i, false);
+  }
+  checkPassFail(queueBufMgr.getBufStats().diskreads.load() - reads, 0)
+  queueBufMgr.flushFile(file1);
+}
+
+void hotNodeTests() {
+  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                   INTEGER);
+
+  // The relation is empty, so the record ids only encode their key
+  for (int i = 0; i < cursorTestSize; i++) {
+    int key = (i * 7919) % cursorTestSize;
+    RecordId keyRid = {(PageId)(key + 1), 1, 0};
+    index.insertEntry(&key, keyRid);
+  }
+
+  // Above the leaves there is only the root, which is hot by now, so a scan
+  // within one leaf reads that leaf alone from the buffer pool
+  bufMgr->clearBufStats();
+  checkPassFail(countScan(&index, 100, GTE, 110, LT), 10)
+  checkPassFail(bufMgr->getBufStats().accesses.load(), 1)
+
+  // Inserts behave the same
+  bufMgr->clearBufStats();
+  int key = cursorTestSize;
+  RecordId keyRid = {(PageId)(key + 1), 1, 0};
+  index.insertEntry(&key, keyRid);
+  checkPassFail(bufMgr->getBufStats().accesses.load(), 1)
+  checkPassFail(countScan(&index, cursorTestSize - 5, GT, cursorTestSize, LTE),
+                5)
+}
+
+void fileFrameTests() {
+  // A second File object for the relation has its own pages in the pool
+  PageFile other = PageFile::open(relationName);
+  BufMgr frameBufMgr(64);
+  const PageId first = file1->getFirstPageNo();
+  for (PageId pageNo = first; pageNo < first + 16; pageNo++) {
+    Page *page;
+    File *owner = (pageNo - first) % 2 == 0 ? (File *)file1 : (File *)&other;
+    frameBufMgr.readPage(owner, pageNo, page);
+    frameBufMgr.unPinPage(owner, pageNo, pageNo == first + 1);
+  }
+
+  checkPassFail(frameBufMgr.getNumDirty(), 1u)
+  frameBufMgr.clearBufStats();
+  frameBufMgr.flushFile(&other);
+  checkPassFail(frameBufMgr.getNumDirty(), 0u)
+  for (PageId pageNo = first; pageNo < first + 16; pageNo++) {
+    Page *page;
+    File *owner = (pageNo - first) % 2 == 0 ? (File *)file1 : (File *)&other;
+    frameBufMgr.readPage(owner, pageNo, page);
+    frameBufMgr.unPinPage(owner, pageNo, false);
+  }
+  checkPassFail(frameBufMgr.getBufStats().diskreads.load(), 8)
+
+  // Pinned pages of the file are still found
+  Page *page;
+  frameBufMgr.readPage(&other, first + 3, page);
+  int pinned = 0;
+  try {
+    frameBufMgr.flushFile(&other);
+  } catch (const PagePinnedException &e) {
+    pinned++;
+  }
+  checkPassFail(pinned, 1)
+  frameBufMgr.unPinPage(&other, first + 3, false);
+
+  frameBufMgr.flushFile(&other);
+  frameBufMgr.flushFile(file1);
+  frameBufMgr.clearBufStats();
+  frameBufMgr.readPage(file1, first, page);
+  frameBufMgr.unPinPage(file1, first, false);
+  checkPassFail(frameBufMgr.getBufStats().diskreads.load(), 1)
+  frameBufMgr.flushFile(file1);
+}
+
+// File of pageAllocationTests, and the pages allocated in it. The pages take
+// up more than one free space map page.
+const std::string allocTestName = "relA.alloc";
+const int allocTestPages = PageFile::SPACE_MAP_ENTRIES + 100;
+
+std::vector<PageId> usedPageNumbers(PageFile &file) {
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+    pageNos.push_back(iter.page_number());
+  }
+  return pageNos;
+}
+
+void pageAllocationTests() {
+  try {
+    File::remove(allocTestName);
+  } catch (const FileNotFoundException &e) {
+  }
+  {
+    PageFile file = PageFile::create(allocTestName);
+    pageListTests(file);
+  }
+  File::remove(allocTestName);
+}
+
+void pageListTests(PageFile &file) {
+  std::vector<PageId> pageNos;
+  for (int i = 0; i < allocTestPages; i++) {
+    PageId pageNo;
+    file.allocatePage(pageNo);
+    pageNos.push_back(pageNo);
+  }
+
+  // Free space map pages are skipped
+  bool noMapPages = true;
+  for (int i = 0; i < allocTestPages; i++) {
+    if (pageNos[i] == 1 || pageNos[i] == PageFile::SPACE_MAP_ENTRIES + 2) {
+      noMapPages = false;
+    }
+  }
+  checkPassFail(noMapPages, true)
+  bool listed = usedPageNumbers(file) == pageNos;
+  checkPassFail(listed, true)
+
+  // Delete the head, the tail, the first page after a map page and every third
+  // page, which leaves the used list in page number order
+  std::vector<PageId> deleted;
+  deleted.push_back(pageNos.front());
+  deleted.push_back(pageNos.back());
+  deleted.push_back(PageFile::SPACE_MAP_ENTRIES + 3);
+  for (int i = 3; i < allocTestPages - 1; i += 3) {
+    if (pageNos[i] != PageFile::SPACE_MAP_ENTRIES + 3) {
+      deleted.push_back(pageNos[i]);
+    }
+  }
+  for (std::size_t i = 0; i < deleted.size(); i++) file.deletePage(deleted[i]);
+  std::vector<PageId> remaining;
+  for (int i = 0; i < allocTestPages; i++) {
+    if (std::find(deleted.begin(), deleted.end(), pageNos[i]) ==
+        deleted.end()) {
+      remaining.push_back(pageNos[i]);
+    }
+  }
+  listed = usedPageNumbers(file) == remaining;
+  checkPassFail(listed, true)
+
+  // Reused pages go back into their place
+  for (std::size_t i = 0; i < deleted.size(); i++) {
+    PageId pageNo;
+    file.allocatePage(pageNo);
+  }
+  listed = usedPageNumbers(file) == pageNos;
+  checkPassFail(listed, true)
+
+  // Fill the first page until a record of a tenth of a page no longer fits
+  const std::string record(Page::DATA_SIZE / 10, 'x');
+  checkPassFail(file.findPageWithSpace(record.size()), pageNos[0])
+  Page page = file.readPage(pageNos[0]);
+  std::vector<RecordId> rids;
+  while (page.hasSpaceForRecord(record)) {
+    rids.push_back(page.insertRecord(record));
+  }
+  file.writePage(pageNos[0], page);
+  checkPassFail(file.findPageWithSpace(record.size()), pageNos[1])
+  checkPassFail(file.findPageWithSpace(Page::DATA_SIZE), Page::INVALID_NUMBER)
+
+  // Emptying it makes room again
+  for (std::size_t i = 0; i < rids.size(); i++) page.deleteRecord(rids[i]);
+  file.writePage(pageNos[0], page);
+  checkPassFail(file.findPageWithSpace(record.size()), pageNos[0])
+}
+
+void relationWriterTests() {
+  // Every page but the last is full
+  std::vector<PageId> pageNos = usedPageNumbers(*file1);
+  const PageId lastPage = pageNos.back();
+  int notFull = 0;
+  for (std::size_t i = 0; i + 1 < pageNos.size(); i++) {
+    if (file1->readPage(pageNos[i]).hasSpaceForRecord(std::string(
+            reinterpret_cast<char *>(&record1), sizeof(record1)))) {
+      notFull++;
+    }
+  }
+  checkPassFail(notFull, 0)
+
+  // A second writer goes on with the last page, then allocates new ones
+  std::vector<RecordId> rids;
+  {
+    RelationWriter writer(file1, bufMgr);
+    for (int i = 0; i < relationSize; i++) {
+      record1.i = relationSize + i;
+      std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
+      rids.push_back(writer.insertRecord(new_data));
+    }
+
+    int tooLarge = 0;
+    try {
+      writer.insertRecord(std::string(Page::DATA_SIZE, 'x'));
+    } catch (const InsufficientSpaceException &e) {
+      tooLarge++;
+    }
+    checkPassFail(tooLarge, 1)
+  }
+  checkPassFail(rids.front().page_number, lastPage)
+
+  // The pages are filled as closely as the first relation's
+  Page firstPage = file1->readPage(pageNos[0]);
+  std::size_t perPage = 0;
+  for (PageIterator it = firstPage.begin(); it != firstPage.end(); ++it) {
+    perPage++;
+  }
+  checkPassFail(usedPageNumbers(*file1).size(),
+                (2 * relationSize + perPage - 1) / perPage)
+
+  // The records are on disk once the writer is gone
+  int found = 0;
+  {
+    FileScan scan(relationName, bufMgr);
+    try {
+      RecordId scanRid;
+      while (1) {
+        scan.scanNext(scanRid);
+        found++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+  }
+  checkPassFail(found, 2 * relationSize)
+}
+
+void recordViewTests() {
+  FileScan scan(relationName, bufMgr);
+  const char *poolStart = reinterpret_cast<const char *>(bufMgr->bufPool);
+  const char *poolEnd = poolStart + bufMgr->getNumBufs() * Page::SIZE;
+  int found = 0;
+  int mismatches = 0;
+  try {
+    RecordId scanRid;
     while (1) {
+      scan.scanNext(scanRid);
+      std::size_t length;
+      const char *data = scan.getRecordData(length);
+      if (data < poolStart || data + length > poolEnd ||
+          std::string(data, length) != scan.getRecord()) {
+        mismatches++;
+      }
+      found++;
+    }
+  } catch (const EndOfFileException &e) {
+  }
+  checkPassFail(found, relationSize)
+  checkPassFail(mismatches, 0)
+}
+
+int countFileScan(const std::vector<ScanPredicate> &predicates,
+                  const std::string &name) {
+  FileScan scan(name, bufMgr, predicates);
+  int found = 0;
+  try {
+    RecordId scanRid;
+    while (1) {
+      scan.scanNext(scanRid);
+      found++;
+    }
+  } catch (const EndOfFileException &e) {
+  }
+  return found;
+}
+
+void scanPredicateTests() {
+  std::vector<ScanPredicate> predicates;
+  checkPassFail(countFileScan(predicates), relationSize)
+
+  // 25 <= i < 40
+  predicates.push_back(ScanPredicate(offsetof(tuple, i), GTE, 25));
+  predicates.push_back(ScanPredicate(offsetof(tuple, i), LT, 40));
+  checkPassFail(countFileScan(predicates), 15)
+
+  // d > 4990.5
+  predicates.clear();
+  predicates.push_back(ScanPredicate(offsetof(tuple, d), GT, 4990.5));
+  checkPassFail(countFileScan(predicates), 9)
+
+  // s <= "00099", comparing the first five bytes
+  predicates.clear();
+  predicates.push_back(
+      ScanPredicate(offsetof(tuple, s), LTE, std::string("00099")));
+  checkPassFail(countFileScan(predicates), 100)
+
+  // Attributes past the end of the record never match
+  predicates.clear();
+  predicates.push_back(ScanPredicate(sizeof(tuple), GTE, INT_MIN));
+  checkPassFail(countFileScan(predicates), 0)
+
+  // Projection of i and the first five bytes of s
+  predicates.clear();
+  predicates.push_back(ScanPredicate(offsetof(tuple, i), LTE, 0));
+  std::vector<ByteRange> projection;
+  ByteRange intRange = {offsetof(tuple, i), sizeof(int)};
+  ByteRange stringRange = {offsetof(tuple, s), 5};
+  projection.push_back(intRange);
+  projection.push_back(stringRange);
+  FileScan scan(relationName, bufMgr, predicates, projection);
+  RecordId scanRid;
+  scan.scanNext(scanRid);
+  const std::string projected = scan.getRecord();
+  int zero = 0;
+  const bool projectedRight =
+      projected == std::string(reinterpret_cast<char *>(&zero), sizeof(int)) +
+                       "00000";
+  checkPassFail(projectedRight, true)
+}
+
+void parallelScanTests() {
+  std::vector<std::atomic<int> > seen(relationSize);
+  for (int i = 0; i < relationSize; i++) seen[i] = 0;
+  std::atomic<int> mismatches(0);
+  {
+    ParallelFileScan scan(relationName, bufMgr, 4);
+    scan.run([&](const RecordBatch &batch) {
+      for (std::size_t i = 0; i < batch.rids.size(); i++) {
+        RECORD record;
+        memcpy(&record, batch.records[i], sizeof(RECORD));
+        if (batch.lengths[i] != sizeof(RECORD) || record.d != record.i ||
+            batch.rids[i].page_number == Page::INVALID_NUMBER) {
+          mismatches++;
+        }
+        if (record.i >= 0 && record.i < relationSize) seen[record.i]++;
+      }
+    });
+  }
+  int once = 0;
+  for (int i = 0; i < relationSize; i++) once += seen[i] == 1;
+  checkPassFail(once, relationSize)
+  checkPassFail(mismatches.load(), 0)
+
+  // With a condition, and a failing batch function
+  std::vector<ScanPredicate> predicates;
+  predicates.push_back(ScanPredicate(offsetof(tuple, i), LT, 100));
+  std::atomic<int> found(0);
+  int failures = 0;
+  {
+    ParallelFileScan scan(relationName, bufMgr, 4, predicates);
+    scan.run([&](const RecordBatch &batch) { found += batch.rids.size(); });
+    try {
+      scan.run([&](const RecordBatch &batch) {
+        throw BadScanrangeException();
+      });
+    } catch (const BadScanrangeException &e) {
+      failures++;
+    }
+  }
+  checkPassFail(found.load(), 100)
+  checkPassFail(failures, 1)
+}
+
+void parallelBuildTests() {
+  {
+    std::cout << "Bulk load the index on four threads" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, true, DEFAULT_FILL_FACTOR, false, 4);
+    intScanChecks(&index);
+    // Every leaf is reachable from the first through the sibling links
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize)
+  }
+  {
+    std::cout << "Reopen the index built on four threads" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    intScanChecks(&index);
+  }
+  File::remove(intIndexName);
+
+  {
+    // Half of an 8 frame pool holds fewer pairs than the relation has tuples,
+    // so the runs are merged from disk, by two threads
+    std::cout << "Bulk load the index on threads through a small buffer pool"
+              << std::endl;
+    BufMgr smallBufMgr(8);
+    BTreeIndex index(relationName, intIndexName, &smallBufMgr,
+                     offsetof(tuple, i), INTEGER, true, DEFAULT_FILL_FACTOR,
+                     false, 4);
+    intScanChecks(&index);
+  }
+  File::remove(intIndexName);
+
+  {
+    std::cout << "Bulk load double and string indexes on three threads"
+              << std::endl;
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE, true,
+                           DEFAULT_FILL_FACTOR, false, 3);
+    doubleScanChecks(&doubleIndex);
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING, true,
+                           DEFAULT_FILL_FACTOR, false, 3);
+    stringScanChecks(&stringIndex);
+  }
+  File::remove(doubleIndexName);
+  File::remove(stringIndexName);
+}
+
+void pageCompactionTests() {
+  Page page;
+  std::vector<RecordId> rids;
+  std::vector<std::string> records;
+  while (true) {
+    const std::string record(100, (char)('a' + records.size() % 26));
+    if (!page.hasSpaceForRecord(record)) break;
+    rids.push_back(page.insertRecord(record));
+    records.push_back(record);
+  }
+
+  // Every other record leaves a hole between its neighbours
+  int deleted = 0;
+  for (std::size_t i = 0; i < rids.size(); i += 2) {
+    page.deleteRecord(rids[i]);
+    records[i].clear();
+    deleted++;
+  }
+  bool reclaimed = page.getFreeSpace() >= deleted * 100;
+  checkPassFail(reclaimed, true)
+
+  // Neither fits until the holes are closed
+  const std::string large(250, 'L');
+  const RecordId largeRid = page.insertRecord(large);
+  page.updateRecord(rids[1], std::string(300, 'U'));
+  records[1] = std::string(300, 'U');
+
+  int inserted = 0;
+  while (true) {
+    const std::string record(100, 'z');
+    if (!page.hasSpaceForRecord(record)) break;
+    page.insertRecord(record);
+    inserted++;
+  }
+  bool dense = page.getFreeSpace() < 100 + sizeof(PageSlot);
+  checkPassFail(dense, true)
+  bool refilled = inserted >= deleted - 6;
+  checkPassFail(refilled, true)
+
+  int mismatches = 0;
+  for (std::size_t i = 0; i < rids.size(); i++) {
+    if (!records[i].empty() && page.getRecord(rids[i]) != records[i]) {
+      mismatches++;
+    }
+  }
+  if (page.getRecord(largeRid) != large) mismatches++;
+  checkPassFail(mismatches, 0)
+
+  // Emptying the page gives every byte back
+  std::vector<RecordId> remaining;
+  for (PageIterator it = page.begin(); it != page.end(); ++it) {
+    remaining.push_back(it.getCurrentRecord());
+  }
+  for (std::size_t i = 0; i < remaining.size(); i++) {
+    page.deleteRecord(remaining[i]);
+  }
+  checkPassFail(page.getFreeSpace(), Page::DATA_SIZE)
+}
+
+void paxTests() {
+  const std::string paxName = relationName + ".pax";
+  try {
+    File::remove(paxName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  std::vector<ByteRange> attributes;
+  const ByteRange i = {offsetof(tuple, i), sizeof(int)};
+  const ByteRange d = {offsetof(tuple, d), sizeof(double)};
+  const ByteRange s = {offsetof(tuple, s), sizeof(record1.s)};
+  attributes.push_back(i);
+  attributes.push_back(d);
+  attributes.push_back(s);
+  const PaxSchema schema(attributes, sizeof(RECORD));
+  checkPassFail(schema.columnAt(offsetof(tuple, d)), 1u)
+
+  std::vector<RecordId> rids;
+  std::vector<std::string> records;
+  {
+    PageFile paxFile(paxName, true);
+    RelationWriter writer(&paxFile, bufMgr, &schema);
+    memset(record1.s, ' ', sizeof(record1.s));
+    for (int k = 0; k < relationSize; k++) {
+      sprintf(record1.s, "%05d string record", k);
+      record1.i = k;
+      record1.d = (double)k;
+      records.push_back(
+          std::string(reinterpret_cast<char *>(&record1), sizeof(record1)));
+      rids.push_back(writer.insertRecord(records.back()));
+    }
+  }
+
+  // Without slots, records take less room than in the slotted relation
+  {
+    PageFile paxFile = PageFile::open(paxName);
+    const std::size_t paxPages = usedPageNumbers(paxFile).size();
+    bool denser = paxPages < usedPageNumbers(*file1).size();
+    checkPassFail(denser, true)
+
+    int mismatches = 0;
+    for (int k = 0; k < relationSize; k += 97) {
+      Page *page;
+      bufMgr->readPage(&paxFile, rids[k].page_number, page);
+      if (PaxPage(page, schema).getRecord(rids[k]) != records[k]) mismatches++;
+      bufMgr->unPinPage(&paxFile, rids[k].page_number, false);
+    }
+    checkPassFail(mismatches, 0)
+  }
+
+  {
+    ColumnScan scan(paxName, bufMgr, schema,
+                    schema.columnAt(offsetof(tuple, i)));
+    long long sum = 0;
+    int found = 0;
+    int misplaced = 0;
+    try {
+      while (true) {
+        std::size_t count;
+        const int *values =
+            reinterpret_cast<const int *>(scan.scanNextPage(count));
+        for (std::size_t k = 0; k < count; k++) {
+          sum += values[k];
+          if (scan.getRecordId(k) != rids[values[k]]) misplaced++;
+        }
+        found += count;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+    checkPassFail(found, relationSize)
+    checkPassFail(misplaced, 0)
+    bool summed = sum == (long long)relationSize * (relationSize - 1) / 2;
+    checkPassFail(summed, true)
+  }
+
+  {
+    // The pages of a slotted relation are not mistaken for PAX pages
+    ColumnScan scan(relationName, bufMgr, schema, 0);
+    bool rejected = false;
+    try {
+      std::size_t count;
+      scan.scanNextPage(count);
+    } catch (const InvalidPageException &e) {
+      rejected = true;
+    }
+    checkPassFail(rejected, true)
+  }
+  File::remove(paxName);
+}
+
+void checksumTests() {
+  const char *digits = "123456789";
+  checkPassFail(crc32c(0, digits, 9), 0xE3069283u)
+  checkPassFail(crc32cSoftware(0, digits, 9), 0xE3069283u)
+
+  const std::string crcName = relationName + ".crc";
+  try {
+    File::remove(crcName);
+  } catch (const FileNotFoundException &e) {
+  }
+
+  std::vector<RecordId> rids;
+  File::setPageChecksums(true);
+  {
+    PageFile crcFile(crcName, true);
+    File::setPageChecksums(false);
+    bool enabled = crcFile.hasPageChecksums();
+    checkPassFail(enabled, true)
+
+    RelationWriter writer(&crcFile, bufMgr);
+    memset(record1.s, ' ', sizeof(record1.s));
+    for (int k = 0; k < relationSize; k++) {
+      sprintf(record1.s, "%05d string record", k);
+      record1.i = k;
+      record1.d = (double)k;
+      rids.push_back(writer.insertRecord(
+          std::string(reinterpret_cast<char *>(&record1), sizeof(record1))));
+    }
+  }
+
+  // Files keep checksums whatever the setting is when they are opened
+  int found = 0;
+  {
+    FileScan scan(crcName, bufMgr);
+    try {
+      RecordId rid;
+      while (true) {
+        scan.scanNext(rid);
+        found++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+  }
+  checkPassFail(found, relationSize)
+
+  // Flip one byte of a record on disk
+  {
+    std::fstream raw(crcName.c_str(),
+                     std::ios::in | std::ios::out | std::ios::binary);
+    raw.seekg((std::streamoff)rids.back().page_number * Page::SIZE + 4000);
+    char byte = 0;
+    raw.read(&byte, 1);
+    byte ^= 0x5a;
+    raw.seekp((std::streamoff)rids.back().page_number * Page::SIZE + 4000);
+    raw.write(&byte, 1);
+  }
+
+  bool caught = false;
+  {
+    FileScan scan(crcName, bufMgr);
+    try {
+      RecordId rid;
+      while (true) scan.scanNext(rid);
+    } catch (const PageChecksumException &e) {
+      caught = e.page_number() == rids.back().page_number;
+    } catch (const EndOfFileException &e) {
+    }
+  }
+  checkPassFail(caught, true)
+  File::remove(crcName);
+}
+
+void compressionTests() {
+  std::vector<char> block(Page::SIZE, 0);
+  for (int k = 0; k < 3000; k++) block[k] = (char)(k % 37);
+  std::vector<char> packed(Page::SIZE);
+  std::vector<char> unpacked(Page::SIZE);
+  const std::size_t length =
+      compressBlock(&block[0], Page::SIZE, &packed[0], Page::SIZE);
+  bool shrunk = length > 0 && length < Page::SIZE / 4;
+  checkPassFail(shrunk, true)
+  bool restored =
+      decompressBlock(&packed[0], length, &unpacked[0], Page::SIZE) &&
+      unpacked == block;
+  checkPassFail(restored, true)
+  bool truncated =
+      decompressBlock(&packed[0], length - 1, &unpacked[0], Page::SIZE);
+  checkPassFail(truncated, false)
+
+  // Noise does not compress, so the page is turned down
+  for (std::size_t k = 0; k < block.size(); k++) block[k] = (char)rand();
+  checkPassFail(
+      compressBlock(&block[0], Page::SIZE, &packed[0], Page::SIZE - 512), 0u)
+
+  File::setPageCompression(true);
+  {
+    std::cout << "Build the index in compressed pages" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    intScanChecks(&index);
+  }
+  File::setPageCompression(false);
+
+  // Even full leaves compress, by more than the header page and the extent
+  // table add
+  std::size_t numPages;
+  {
+    BlobFile indexFile = BlobFile::open(intIndexName);
+    bool compressed = indexFile.hasPageCompression();
+    checkPassFail(compressed, true)
+    numPages = indexFile.getNumPages();
+  }
+  std::ifstream onDisk(intIndexName.c_str(),
+                       std::ios::binary | std::ios::ate);
+  bool smaller = (std::size_t)onDisk.tellg() < numPages * Page::SIZE;
+  onDisk.close();
+  checkPassFail(smaller, true)
+
+  {
+    std::cout << "Reopen the compressed index" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    intScanChecks(&index);
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize)
+  }
+  File::remove(intIndexName);
+}
+
+void walTests() {
+  const std::string logName = relationName + ".wal";
+  const std::string loggedName = relationName + ".logged";
+  try {
+    File::remove(loggedName);
+  } catch (const FileNotFoundException &e) {
+  }
+  const int perThread = 25;
+
+  std::string crashed;
+  {
+    LogManager log(logName);
+    BufMgr pool(50);
+    pool.setLog(&log);
+    PageFile loggedFile(loggedName, true);
+
+    // Each thread adds records to a pair of pages of its own, both pages in
+    // one operation
+    std::vector<PageId> pageNos(2 * concurrentThreads);
+    for (std::size_t p = 0; p < pageNos.size(); p++) {
+      Page *page;
+      pool.allocPage(&loggedFile, pageNos[p], page);
+      pool.unPinPage(&loggedFile, pageNos[p], false);
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < concurrentThreads; t++) {
+      threads.push_back(std::thread(loggedInserts, &pool, &loggedFile,
+                                    pageNos[2 * t], pageNos[2 * t + 1],
+                                    perThread));
+    }
+    for (int t = 0; t < concurrentThreads; t++) threads[t].join();
+
+    // Commits whose records are all appended before any of them flushes
+    // share one sync, whichever thread leads it. The images logged are the
+    // pages as they are, so recovery below is unchanged.
+    std::vector<LoggedPage> images(concurrentThreads);
+    for (int t = 0; t < concurrentThreads; t++) {
+      Page *page;
+      pool.readPage(&loggedFile, pageNos[2 * t], page);
+      images[t].file = &loggedFile;
+      images[t].pageNo = pageNos[2 * t];
+      images[t].sequence = log.nextSequence();
+      images[t].image.assign(reinterpret_cast<const char *>(page), Page::SIZE);
+      pool.unPinPage(&loggedFile, pageNos[2 * t], false);
+    }
+    const std::uint64_t syncsBefore = log.getNumSyncs();
+    std::atomic<int> appended(0);
+    std::vector<std::thread> committers;
+    for (int t = 0; t < concurrentThreads; t++) {
+      committers.push_back(std::thread([&log, &images, &appended, t]() {
+        const Lsn lsn = log.append(std::vector<LoggedPage>(1, images[t]));
+        appended++;
+        while (appended.load() < concurrentThreads) std::this_thread::yield();
+        log.flush(lsn);
+      }));
+    }
+    for (int t = 0; t < concurrentThreads; t++) committers[t].join();
+    const std::uint64_t groupSyncs = log.getNumSyncs() - syncsBefore;
+    checkPassFail(groupSyncs, 1u)
+
+    // The changes are only in the buffer pool and the log so far, which is
+    // what a crash would leave on disk
+    std::ifstream onDisk(loggedName.c_str(), std::ios::binary);
+    crashed.assign(std::istreambuf_iterator<char>(onDisk),
+                   std::istreambuf_iterator<char>());
+    pool.flushFile(&loggedFile);
+  }
+  {
+    std::ofstream onDisk(loggedName.c_str(),
+                         std::ios::binary | std::ios::trunc);
+    onDisk.write(crashed.data(), crashed.size());
+  }
+  std::vector<ScanPredicate> none;
+  checkPassFail(countFileScan(none, loggedName), 0)
+
+  // Recovery writes the newest image of every page logged
+  checkPassFail(LogManager::recover(logName), 2u * concurrentThreads)
+  checkPassFail(countFileScan(none, loggedName),
+                2 * concurrentThreads * perThread)
+  checkPassFail(LogManager::recover(logName), 0u)
+
+  File::remove(loggedName);
+  std::remove(logName.c_str());
+}
+
+void checkpointTests() {
+  const std::string logName = relationName + ".wal";
+  const std::string loggedName = relationName + ".logged";
+  try {
+    File::remove(loggedName);
+  } catch (const FileNotFoundException &e) {
+  }
+  const int perThread = 25;
+  const int afterJoin = 20;
+  const int afterCheckpoint = 5;
+  const int total = 2 * concurrentThreads * perThread + 2 * afterJoin +
+                    2 * afterCheckpoint;
+
+  std::string crashed;
+  {
+    LogManager log(logName);
+    BufMgr pool(50);
+    pool.setLog(&log);
+    pool.setCheckpointInterval(Page::SIZE);
+    PageFile loggedFile(loggedName, true);
+
+    std::vector<PageId> pageNos(2 * concurrentThreads);
+    for (std::size_t p = 0; p < pageNos.size(); p++) {
+      Page *page;
+      pool.allocPage(&loggedFile, pageNos[p], page);
+      pool.unPinPage(&loggedFile, pageNos[p], false);
+    }
+
+    // Checkpoints are taken while the threads go on changing pages
+    std::vector<std::thread> threads;
+    for (int t = 0; t < concurrentThreads; t++) {
+      threads.push_back(std::thread(loggedInserts, &pool, &loggedFile,
+                                    pageNos[2 * t], pageNos[2 * t + 1],
+                                    perThread));
+    }
+    for (int c = 0; c < 5; c++) pool.checkpoint();
+    for (int t = 0; t < concurrentThreads; t++) threads[t].join();
+
+    // The log grows past the interval, so the writer takes one of its own
+    const std::uint64_t taken = log.getNumCheckpoints();
+    loggedInserts(&pool, &loggedFile, pageNos[0], pageNos[1], afterJoin);
+    for (int wait = 0; wait < 500 && log.getNumCheckpoints() == taken;
+         wait++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    bool background = log.getNumCheckpoints() > taken;
+    checkPassFail(background, true)
+    pool.setCheckpointInterval(0);
+
+    // The second checkpoint writes the pages the first one found dirty
+    pool.checkpoint();
+    pool.checkpoint();
+    loggedInserts(&pool, &loggedFile, pageNos[2], pageNos[3],
+                  afterCheckpoint);
+
+    std::ifstream onDisk(loggedName.c_str(), std::ios::binary);
+    crashed.assign(std::istreambuf_iterator<char>(onDisk),
+                   std::istreambuf_iterator<char>());
+    pool.flushFile(&loggedFile);
+  }
+  {
+    std::ofstream onDisk(loggedName.c_str(),
+                         std::ios::binary | std::ios::trunc);
+    onDisk.write(crashed.data(), crashed.size());
+  }
+  std::vector<ScanPredicate> none;
+  checkPassFail(countFileScan(none, loggedName), total - 2 * afterCheckpoint)
+
+  // Only the two pages changed after the last checkpoint are redone
+  checkPassFail(LogManager::recover(logName), 2u)
+  checkPassFail(countFileScan(none, loggedName), total)
+  checkPassFail(LogManager::recover(logName), 0u)
+
+  File::remove(loggedName);
+  std::remove(logName.c_str());
+}
+
+/**
+ * Inserts count records into each of two pages, one logged operation per pair
+ * of records.
+ */
+void loggedInserts(BufMgr *pool, File *file, PageId first, PageId second,
+                   int count) {
+  const std::string record(reinterpret_cast<char *>(&record1), sizeof(record1));
+  for (int k = 0; k < count; k++) {
+    LogOperation operation(pool);
+    const PageId pageNos[] = {first, second};
+    for (int p = 0; p < 2; p++) {
+      Page *page;
+      pool->readPage(file, pageNos[p], page);
+      page->insertRecord(record);
+      pool->unPinPage(file, pageNos[p], true);
+    }
+    operation.commit();
+  }
+}
+
+void deleteTests() {
+  // Record ids of the relation by key
+  std::vector<RecordId> rids(relationSize);
+  {
+    FileScan fscan(relationName, bufMgr);
+    try {
+      RecordId rid;
+      while (true) {
+        fscan.scanNext(rid);
+        std::size_t length;
+        const char *record = fscan.getRecordData(length);
+        rids[*reinterpret_cast<const int *>(record + offsetof(tuple, i))] = rid;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+  }
+
+  const int gapLow = 1000;
+  const int gapHigh = 4500;
+  std::size_t reclaimed;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // Every odd key goes, and a range of keys that empties whole leaves
+    int deleted = 0;
+    for (int k = 0; k < relationSize; k++) {
+      if ((k % 2 == 1 || (k >= gapLow && k < gapHigh)) &&
+          index.deleteEntry(&k, rids[k])) {
+        deleted++;
+      }
+    }
+    checkPassFail(deleted, relationSize / 2 + (gapHigh - gapLow) / 2)
+    int key = 1;
+    bool again = index.deleteEntry(&key, rids[1]);
+    checkPassFail(again, false)
+    key = 0;
+    bool otherRid = index.deleteEntry(&key, rids[2]);
+    checkPassFail(otherRid, false)
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT),
+                  relationSize - deleted)
+    checkPassFail(intScan(&index, gapLow - 1, GT, gapHigh, LT), 0)
+
+    // Key 0 moves past the others, and a deleted entry is not updated
+    int newKey = relationSize + 10;
+    key = 0;
+    bool moved = index.updateEntry(&key, &newKey, rids[0]);
+    checkPassFail(moved, true)
+    key = 1;
+    bool missing = index.updateEntry(&key, &newKey, rids[1]);
+    checkPassFail(missing, false)
+    checkPassFail(intScan(&index, -1, GT, 1, LT), 0)
+    checkPassFail(intScan(&index, relationSize, GT, relationSize + 20, LT), 1)
+
+    // A scan open across the compaction goes on past the leaves taken out
+    IndexCursor cursor;
+    int low = gapLow - 10;
+    int high = gapHigh + 10;
+    index.startScan(cursor, &low, GTE, &high, LT);
+    RecordId rid;
+    index.scanNext(cursor, rid);
+    reclaimed = index.compact();
+    bool some = reclaimed > 0;
+    checkPassFail(some, true)
+    int found = 1;
+    try {
+      while (true) {
+        index.scanNext(cursor, rid);
+        found++;
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan(cursor);
+    checkPassFail(found, 10)
+
+    // Nothing else to take out, but the leaves go on the free list now
+    checkPassFail(index.compact(), 0u)
+    checkPassFail(intScan(&index, -1, GT, relationSize + 20, LT),
+                  relationSize - deleted)
+  }
+
+  std::size_t numPages = BlobFile::open(intIndexName).getNumPages();
+  {
+    // Splits take their leaves off the free list instead of growing the file
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    for (int k = gapLow; k < gapLow + 500; k++) {
+      index.insertEntry(&k, rids[k]);
+    }
+    checkPassFail(intScan(&index, gapLow - 1, GT, gapHigh, LT), 500)
+  }
+  std::size_t reopened = BlobFile::open(intIndexName).getNumPages();
+  std::cout << "Reclaimed " << reclaimed << " leaves" << std::endl;
+  checkPassFail(reopened, numPages)
+  File::remove(intIndexName);
+}
+
+void postingListTests() {
+  // Entries with few distinct keys go in and out of a leaf in random order,
+  // with page numbers below the base page and too far from it for two bytes
+  Page leftPage, rightPage;
+  LeafNodeInt *leaf = reinterpret_cast<LeafNodeInt *>(&leftPage);
+  LeafNodeInt *right = reinterpret_cast<LeafNodeInt *>(&rightPage);
+  std::vector<int> keys;
+  std::vector<RecordId> rids;
+  leaf->init();
+  for (int n = 0; n < 20000; n++) {
+    const int key = (int)(random() % 8);
+    RecordId rid = {(PageId)(100 + random() % 1000), (SlotId)(random() % 50),
+                    0};
+    if (n == 500) rid.page_number = 5;
+    if (n == 1000) rid.page_number = 1 << 20;
+    if (!leaf->hasRoom(key, rid)) break;
+    const int pos = leaf->upperBound(key);
+    leaf->insertAt(pos, key, rid);
+    keys.insert(keys.begin() + pos, key);
+    rids.insert(rids.begin() + pos, rid);
+    if (n % 7 == 3) {
+      const int at = (int)(random() % keys.size());
+      leaf->removeAt(at);
+      keys.erase(keys.begin() + at);
+      rids.erase(rids.begin() + at);
+    }
+  }
+  bool denser = leaf->numKeys > INTARRAYLEAFSIZE;
+  checkPassFail(denser, true)
+  checkPassFail(leaf->numKeys, (int)keys.size())
+
+  int mismatches = 0;
+  std::vector<RecordId> copied(keys.size());
+  leaf->copyRids(0, leaf->numKeys, &copied[0]);
+  for (int i = 0; i < leaf->numKeys; i++) {
+    if (leaf->getKey(i) != keys[i] || leaf->getRid(i) != rids[i]) mismatches++;
+    if (copied[i] != rids[i]) mismatches++;
+  }
+  for (int key = -1; key <= 8; key++) {
+    const int lower =
+        std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+    const int upper =
+        std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+    if (leaf->lowerBound(key) != lower) mismatches++;
+    if (leaf->upperBound(key) != upper) mismatches++;
+  }
+  checkPassFail(mismatches, 0)
+
+  // Splitting keeps every entry in order, the new one included
+  const int newKey = 3;
+  const RecordId newRid = {7, 1, 0};
+  const int pos = leaf->upperBound(newKey);
+  keys.insert(keys.begin() + pos, newKey);
+  rids.insert(rids.begin() + pos, newRid);
+  right->init();
+  leaf->splitInto(*right, pos, newKey, newRid);
+  bool split = leaf->numKeys > 0 && right->numKeys > 0 &&
+               leaf->numKeys + right->numKeys == (int)keys.size();
+  checkPassFail(split, true)
+  for (int i = 0; i < (int)keys.size(); i++) {
+    LeafNodeInt *half = i < leaf->numKeys ? leaf : right;
+    const int j = i < leaf->numKeys ? i : i - leaf->numKeys;
+    if (half->getKey(j) != keys[i] || half->getRid(j) != rids[i]) mismatches++;
+  }
+  checkPassFail(mismatches, 0)
+
+  // A single posting list with two byte deltas holds many times as many
+  // entries as RecordIds stored whole would
+  leaf->init();
+  RecordId rid = {1, 0, 0};
+  while (leaf->hasRoom(1, rid)) {
+    leaf->insertAt(leaf->numKeys, 1, rid);
+    rid.page_number++;
+  }
+  bool dense = leaf->numKeys > 2 * INTARRAYLEAFSIZE;
+  checkPassFail(dense, true)
+
+  {
+    // Posting lists of a few negative keys next to the relation's own keys
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int postings = 20000;
+    for (int j = 0; j < postings; j++) {
+      const int key = -1 - j % 4;
+      const RecordId posted = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      index.insertEntry(&key, posted);
+    }
+    checkPassFail(postingCount(&index, -3), postings / 4)
+    for (int j = 1; j < postings; j += 4) {
+      const int key = -2;
+      const RecordId posted = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      index.deleteEntry(&key, posted);
+    }
+    checkPassFail(postingCount(&index, -2), 0)
+    checkPassFail(postingCount(&index, -4), postings / 4)
+    checkPassFail(intScan(&index, -1, GT, relationSize, LT), relationSize)
+    checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+  }
+  File::remove(intIndexName);
+}
+
+/**
+ * Counts the entries of index with the given key, a batch at a time.
+ */
+int postingCount(BTreeIndex *index, int key) {
+  IndexCursor cursor;
+  try {
+    index->startScan(cursor, &key, GTE, &key, LTE);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+  RecordId batch[64];
+  int count = 0;
+  std::size_t fetched;
+  while ((fetched = index->scanNextBatch(cursor, batch, 64)) > 0) {
+    count += (int)fetched;
+  }
+  index->endScan(cursor);
+  return count;
+}
+
+void lookupTests() {
+  {
+    // Every record is found under its key, with its own RecordId
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int found = 0;
+    int mismatches = 0;
+    {
+      FileScan scan(relationName, bufMgr);
+      try {
+        RecordId scanRid;
+        while (1) {
+          scan.scanNext(scanRid);
+          const std::string record = scan.getRecord();
+          const RECORD *data = reinterpret_cast<const RECORD *>(record.c_str());
+          RecordId rid;
+          if (!index.lookup(&data->i, rid)) continue;
+          found++;
+          if (rid != scanRid) mismatches++;
+        }
+      } catch (const EndOfFileException &e) {
+      }
+    }
+    checkPassFail(found, relationSize)
+    checkPassFail(mismatches, 0)
+
+    // Keys not in the index are not found
+    const int missing[] = {-1, relationSize, relationSize + 1000};
+    RecordId rid;
+    std::vector<RecordId> rids(3);
+    for (int j = 0; j < 3; j++) {
+      if (index.lookup(&missing[j], rid)) mismatches++;
+      if (index.lookupAll(&missing[j], rids) != 0 || !rids.empty()) {
+        mismatches++;
+      }
+    }
+    checkPassFail(mismatches, 0)
+
+    // Duplicates spread over several leaves are all found
+    const int key = 77;
+    const int duplicates = 3000;
+    for (int j = 0; j < duplicates; j++) {
+      const RecordId posted = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      index.insertEntry(&key, posted);
+    }
+    checkPassFail(index.lookupAll(&key, rids), (std::size_t)duplicates + 1)
+    checkPassFail(postingCount(&index, key), duplicates + 1)
+    RecordId first;
+    index.lookup(&key, first);
+    bool same = first == rids[0];
+    checkPassFail(same, true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // String keys are looked up by their first characters, as scans do
+    BTreeIndex index(relationName, stringIndexName, bufMgr,
+                     offsetof(tuple, s), STRING);
+    int mismatches = 0;
+    char key[64];
+    RecordId rid;
+    std::vector<RecordId> rids;
+    for (int j = 0; j < relationSize; j += 97) {
+      sprintf(key, "%05d string record", j);
+      if (!index.lookup(key, rid) || index.lookupAll(key, rids) != 1 ||
+          rids[0] != rid) {
+        mismatches++;
+      }
+    }
+    sprintf(key, "%05d string record", relationSize);
+    if (index.lookup(key, rid)) mismatches++;
+    checkPassFail(mismatches, 0)
+  }
+  File::remove(stringIndexName);
+}
+
+void batchLookupTests() {
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int key = 1234;
+    for (int j = 0; j < 1000; j++) {
+      const RecordId posted = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      index.insertEntry(&key, posted);
+    }
+
+    // Every key in random order, some twice, and some not in the index
+    std::vector<int> keys;
+    for (int j = -10; j < relationSize + 10; j++) keys.push_back(j);
+    for (int j = 0; j < relationSize; j += 3) keys.push_back(j);
+    keys.push_back(key);
+    std::random_shuffle(keys.begin(), keys.end());
+
+    std::vector<RecordId> rids;
+    std::vector<std::size_t> ends;
+    const std::size_t found = index.lookupBatch(&keys[0], keys.size(), rids,
+                                                ends);
+    // Key is found 1001 times each time it is in the batch
+    const std::size_t expectedFound =
+        relationSize + (relationSize + 2) / 3 + 1000 + 1001;
+    checkPassFail(found, expectedFound)
+    checkPassFail(ends.size(), keys.size())
+
+    int mismatches = 0;
+    std::vector<RecordId> expected;
+    for (std::size_t j = 0; j < keys.size(); j++) {
+      index.lookupAll(&keys[j], expected);
+      const std::size_t start = j == 0 ? 0 : ends[j - 1];
+      if (ends[j] - start != expected.size() ||
+          !std::equal(expected.begin(), expected.end(), rids.begin() + start)) {
+        mismatches++;
+      }
+    }
+    checkPassFail(mismatches, 0)
+
+    // Neighbouring keys share their leaf instead of each reading it in
+    bufMgr->clearBufStats();
+    index.lookupBatch(&keys[0], keys.size(), rids, ends);
+    const int batched = bufMgr->getBufStats().accesses.load();
+    bufMgr->clearBufStats();
+    for (std::size_t j = 0; j < keys.size(); j++) {
+      index.lookupAll(&keys[j], expected);
+    }
+    bool fewer = batched * 10 < bufMgr->getBufStats().accesses.load();
+    checkPassFail(fewer, true)
+
+    // An empty batch finds nothing
+    checkPassFail(index.lookupBatch(&keys[0], 0, rids, ends), (std::size_t)0)
+    bool empty = rids.empty() && ends.empty();
+    checkPassFail(empty, true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Strings are passed STRINGSIZE characters each
+    BTreeIndex index(relationName, stringIndexName, bufMgr,
+                     offsetof(tuple, s), STRING);
+    std::vector<char> keys;
+    char key[64];
+    for (int j = relationSize - 1; j >= 0; j -= 7) {
+      sprintf(key, "%05d string record", j);
+      keys.insert(keys.end(), key, key + STRINGSIZE);
+    }
+    std::vector<RecordId> rids;
+    std::vector<std::size_t> ends;
+    const std::size_t n = keys.size() / STRINGSIZE;
+    checkPassFail(index.lookupBatch(&keys[0], n, rids, ends), n)
+    int mismatches = 0;
+    for (std::size_t j = 0; j < n; j++) {
+      sprintf(key, "%05d string record", relationSize - 1 - 7 * (int)j);
+      RecordId rid;
+      if (ends[j] != j + 1 || !index.lookup(key, rid) || rid != rids[j]) {
+        mismatches++;
+      }
+    }
+    checkPassFail(mismatches, 0)
+  }
+  File::remove(stringIndexName);
+}
+
+void batchInsertTests() {
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int low = -1000;
+    const int high = relationSize + 1000;
+    std::vector<std::vector<RecordId> > expected(high - low);
+    for (int key = 0; key < relationSize; key++) {
+      RecordId rid;
+      index.lookup(&key, rid);
+      expected[key - low].push_back(rid);
+    }
+
+    // Two batches of keys inside and outside the relation's, duplicates and
+    // all, the second one merged into leaves the first one filled
+    const int batches[] = {30000, 5000};
+    int total = relationSize;
+    for (int b = 0; b < 2; b++) {
+      std::vector<int> keys;
+      std::vector<RecordId> rids;
+      for (int j = 0; j < batches[b]; j++) {
+        const int key = low + (int)(random() % (high - low));
+        const RecordId rid = {(PageId)(1 + total / 50), (SlotId)(total % 50),
+                              0};
+        keys.push_back(key);
+        rids.push_back(rid);
+        expected[key - low].push_back(rid);
+        total++;
+      }
+      bufMgr->clearBufStats();
+      index.insertBatch(&keys[0], &rids[0], keys.size());
+      bool fewer = bufMgr->getBufStats().accesses.load() * 4 < batches[b];
+      checkPassFail(fewer, true)
+    }
+
+    int mismatches = 0;
+    std::vector<RecordId> found;
+    for (int key = low; key < high; key++) {
+      index.lookupAll(&key, found);
+      if (found != expected[key - low]) mismatches++;
+    }
+    checkPassFail(mismatches, 0)
+
+    // An empty batch changes nothing
+    index.insertBatch(&low, NULL, 0);
+    checkPassFail(index.lookupAll(&low, found), expected[0].size())
+  }
+  File::remove(intIndexName);
+
+  {
+    // Keys sharing less than the prefix of the leaves they go to
+    BTreeIndex index(relationName, stringIndexName, bufMgr,
+                     offsetof(tuple, s), STRING);
+    std::vector<char> keys;
+    std::vector<RecordId> rids;
+    std::vector<int> counts(relationSize);
+    char key[64];
+    const int batch = 10000;
+    for (int j = 0; j < batch; j++) {
+      const int which = (int)(random() % relationSize);
+      sprintf(key, "%05d string record", which);
+      keys.insert(keys.end(), key, key + STRINGSIZE);
+      const RecordId rid = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      rids.push_back(rid);
+      counts[which]++;
+    }
+    index.insertBatch(&keys[0], &rids[0], batch);
+    int mismatches = 0;
+    std::vector<RecordId> found;
+    for (int j = 0; j < relationSize; j++) {
+      sprintf(key, "%05d string record", j);
+      if (index.lookupAll(key, found) != (std::size_t)counts[j] + 1) {
+        mismatches++;
+      }
+    }
+    checkPassFail(mismatches, 0)
+  }
+  File::remove(stringIndexName);
+
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+    std::vector<double> keys;
+    std::vector<RecordId> rids;
+    for (int j = 0; j < 2 * relationSize; j++) {
+      keys.push_back((double)(j * 7 % relationSize) + 0.5);
+      const RecordId rid = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      rids.push_back(rid);
+    }
+    index.insertBatch(&keys[0], &rids[0], keys.size());
+    int mismatches = 0;
+    std::vector<RecordId> found;
+    for (int j = 0; j < relationSize; j++) {
+      const double key = j + 0.5;
+      if (index.lookupAll(&key, found) != 2) mismatches++;
+    }
+    checkPassFail(mismatches, 0)
+  }
+  File::remove(doubleIndexName);
+}
+
+void appendTests() {
+  std::size_t bulkPages;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+  bulkPages = BlobFile::open(intIndexName).getNumPages();
+  File::remove(intIndexName);
+
+  std::size_t appendedPages;
+  {
+    std::cout << "Insert the relation's keys in increasing order" << std::endl;
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    intScanChecks(&index);
+  }
+  appendedPages = BlobFile::open(intIndexName).getNumPages();
+  checkPassFail(appendedPages, bulkPages)
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+
+    // A key in the middle splits its full leaf in half, and appends go on
+    // after it
+    const int middle = relationSize / 2;
+    RecordId middleRid;
+    index.lookup(&middle, middleRid);
+    index.insertEntry(&middle, middleRid);
+    const int duplicates = 3000;
+    for (int j = 0; j < duplicates; j++) {
+      const int key = relationSize + j / 10;
+      const RecordId rid = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+      index.insertEntry(&key, rid);
+    }
+    checkPassFail(postingCount(&index, middle), 2)
+    int mismatches = 0;
+    for (int j = 0; j < duplicates / 10; j++) {
+      const int key = relationSize + j;
+      if (postingCount(&index, key) != 10) mismatches++;
+    }
+    checkPassFail(mismatches, 0)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Leaves with a fixed number of entries come out exactly full
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE, false);
+    doubleScanChecks(&index);
+  }
+  appendedPages = BlobFile::open(doubleIndexName).getNumPages();
+  File::remove(doubleIndexName);
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+  }
+  bulkPages = BlobFile::open(doubleIndexName).getNumPages();
+  checkPassFail(appendedPages, bulkPages)
+  File::remove(doubleIndexName);
+}
+
+void insertBufferTests() {
+  const int count = 20000;
+  int direct;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    direct = randomInserts(&index, count);
+  }
+  File::remove(intIndexName);
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    index.setInsertBuffer(4096);
+    const int buffered = randomInserts(&index, count);
+    std::cout << "Buffer pool accesses: " << direct << " one by one, "
+              << buffered << " buffered" << std::endl;
+    bool fewer = buffered * 10 < direct;
+    checkPassFail(fewer, true)
+
+    // Entries still in the buffer are found after those in the tree
+    const int key = relationSize + 5;
+    const RecordId first = {1, 1, 0};
+    const RecordId second = {1, 2, 0};
+    index.setInsertBuffer(0);
+    index.insertEntry(&key, first);
+    index.setInsertBuffer(100);
+    index.insertEntry(&key, second);
+    std::vector<RecordId> found;
+    bool merged = index.lookupAll(&key, found) == 2 && found[0] == first &&
+                  found[1] == second;
+    checkPassFail(merged, true)
+    const int other = relationSize + 6;
+    index.insertEntry(&other, second);
+    RecordId rid;
+    bool inBuffer = index.lookup(&other, rid) && rid == second;
+    checkPassFail(inBuffer, true)
+
+    // Scans see them too, since the buffer is flushed first
+    checkPassFail(postingCount(&index, other), 1)
+    index.insertEntry(&other, first);
+  }
+
+  {
+    // The destructor flushed the last one
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int other = relationSize + 6;
+    checkPassFail(postingCount(&index, other), 2)
+    int total = 0;
+    std::vector<RecordId> found;
+    for (int key = 0; key < relationSize; key++) {
+      total += (int)index.lookupAll(&key, found);
+    }
+    checkPassFail(total, relationSize + count)
+  }
+  File::remove(intIndexName);
+}
+
+/**
+ * Inserts count entries with random keys of the relation's range, and returns
+ * the number of buffer pool accesses taken.
+ */
+int randomInserts(BTreeIndex *index, int count) {
+  srandom(42);
+  bufMgr->clearBufStats();
+  for (int j = 0; j < count; j++) {
+    const int key = (int)(random() % relationSize);
+    const RecordId rid = {(PageId)(1 + j / 50), (SlotId)(j % 50), 0};
+    index->insertEntry(&key, rid);
+  }
+  index->flushInserts();
+  return bufMgr->getBufStats().accesses.load();
+}
+
+void onlineBuildTests() {
+  const int during = 20000;
+  const int after = 1000;
+  IndexBuildLog log(file1);
+  std::atomic<bool> attached(false);
+  std::atomic<bool> built(false);
+  std::atomic<int> inserted(0);
+
+  // Keeps inserting while the index is built, then a little more once the
+  // log forwards to it
+  std::thread writer([&]() {
+    RelationWriter relationWriter(file1, bufMgr);
+    relationWriter.setBuildLog(&log);
+    attached = true;
+    RECORD record;
+    memset(&record, 0, sizeof(record));
+    for (int k = 0; k < during + after; k++) {
+      if (k == during) {
+        while (!built) std::this_thread::yield();
+      }
+      const int key = relationSize + k;
+      sprintf(record.s, "%05d string record", key);
+      record.i = key;
+      record.d = (double)key;
+      relationWriter.insertRecord(
+          std::string(reinterpret_cast<char *>(&record), sizeof(record)));
+      inserted++;
+    }
+  });
+  while (!attached) std::this_thread::yield();
+
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false, DEFAULT_FILL_FACTOR, false, 0, &log);
+    std::cout << "Inserted during the build: " << inserted.load()
+              << std::endl;
+    built = true;
+    writer.join();
+
+    // Every record is in the index exactly once
+    int missing = 0;
+    std::vector<RecordId> found;
+    for (int key = 0; key < relationSize + during + after; key++) {
+      if (index.lookupAll(&key, found) != 1) missing++;
+    }
+    checkPassFail(missing, 0)
+    checkPassFail(intScan(&index, 0, GTE, relationSize + during + after, LT),
+                  relationSize + during + after)
+  }
+
+  {
+    // The finished build opens like any other index
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    const int key = relationSize + during + after - 1;
+    checkPassFail(postingCount(&index, key), 1)
+  }
+  File::remove(intIndexName);
+}
+
+void descendingScanTests() {
+  const int lows[] = {25, 20, -3, 996, 0, 300, 3000, 0};
+  const Operator lowOps[] = {GT, GTE, GT, GT, GT, GT, GTE, GTE};
+  const int highs[] = {40, 35, 3, 1001, 1, 400, 4000, relationSize};
+  const Operator highOps[] = {LT, LTE, LT, LT, LT, LT, LT, LT};
+  const int numRanges = 8;
+
+  for (int bulk = 0; bulk < 2; bulk++) {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, bulk == 1);
+
+    // Every range holds what the forward scan finds, in descending order
+    for (int r = 0; r < numRanges; r++) {
+      int low = lows[r];
+      int high = highs[r];
+      const int forward = intScan(&index, low, lowOps[r], high, highOps[r]);
+      checkPassFail(descendingScan(&index, &low, lowOps[r], &high, highOps[r]),
+                    forward)
+      checkPassFail(descendingScan(&index, &low, lowOps[r], &high, highOps[r],
+                                   7),
+                    forward)
+    }
+
+    // The top entries are read from the last leaves alone
+    int low = 0;
+    int high = relationSize;
+    bufMgr->clearBufStats();
+    index.startScan(&low, GTE, &high, LT, true);
+    RecordId rid;
+    for (int j = 0; j < 10; j++) index.scanNext(rid);
+    index.endScan();
+    const int accesses = (int)bufMgr->getBufStats().accesses.load();
+    std::cout << "Buffer pool accesses for the top 10: " << accesses
+              << std::endl;
+    bool few = accesses < 10;
+    checkPassFail(few, true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Leaves compacted away are unlinked in both directions
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    for (int key = 1000; key < 3000; key++) {
+      RecordId rid;
+      index.lookup(&key, rid);
+      index.deleteEntry(&key, rid);
+    }
+    bool reclaimed = index.compact() > 0;
+    checkPassFail(reclaimed, true)
+    int low = 0;
+    int high = relationSize;
+    checkPassFail(descendingScan(&index, &low, GTE, &high, LT),
+                  relationSize - 2000)
+    low = 500;
+    high = 3500;
+    checkPassFail(descendingScan(&index, &low, GTE, &high, LT, 16), 1000)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Descending scans of the other key types
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE, false);
+    double lowDouble = 100;
+    double highDouble = 2500;
+    checkPassFail(
+        descendingScan(&doubleIndex, &lowDouble, GT, &highDouble, LTE), 2400)
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING, false);
+    char lowString[STRINGSIZE + 1];
+    char highString[STRINGSIZE + 1];
+    sprintf(lowString, "%05d", 100);
+    sprintf(highString, "%05d", 2500);
+    checkPassFail(
+        descendingScan(&stringIndex, lowString, GT, highString, LT, 5), 2400)
+  }
+  File::remove(doubleIndexName);
+  File::remove(stringIndexName);
+
+  {
+    // Splits on both ends while descending scans go on
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+      for (int k = 0; k < 20000 && !done; k++) {
+        const int key = (k % 2 == 0) ? relationSize + k : -1 - k;
+        const RecordId rid = {(PageId)(1 + k / 50), (SlotId)(k % 50), 0};
+        index.insertEntry(&key, rid);
+      }
+    });
+    int wrong = 0;
+    for (int pass = 0; pass < 20; pass++) {
+      int low = 0;
+      int high = relationSize;
+      IndexCursor cursor;
+      index.startScan(cursor, &low, GTE, &high, LT, true);
+      RecordId rids[64];
+      int count = 0;
+      std::size_t got;
+      while ((got = index.scanNextBatch(cursor, rids, 64)) > 0) count += got;
+      index.endScan(cursor);
+      if (count != relationSize) wrong++;
+    }
+    done = true;
+    writer.join();
+    checkPassFail(wrong, 0)
+  }
+  File::remove(intIndexName);
+}
+
+/**
+ * Runs a descending scan and returns the number of entries it finds, or -1 if
+ * their records do not come in descending order of i. Entries are fetched
+ * batchSize at a time, or one by one if batchSize is 0.
+ */
+int descendingScan(BTreeIndex *index, void *lowVal, Operator lowOp,
+                   void *highVal, Operator highOp, std::size_t batchSize) {
+  IndexCursor cursor;
+  try {
+    index->startScan(cursor, lowVal, lowOp, highVal, highOp, true);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+
+  std::vector<RecordId> rids;
+  if (batchSize == 0) {
+    try {
+      RecordId rid;
+      while (true) {
+        index->scanNext(cursor, rid);
+        rids.push_back(rid);
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+  } else {
+    std::vector<RecordId> batch(batchSize);
+    std::size_t got;
+    while ((got = index->scanNextBatch(cursor, &batch[0], batchSize)) > 0) {
+      rids.insert(rids.end(), batch.begin(), batch.begin() + got);
+    }
+  }
+  index->endScan(cursor);
+
+  int previous = INT_MAX;
+  for (std::size_t j = 0; j < rids.size(); j++) {
+    Page *page;
+    bufMgr->readPage(file1, rids[j].page_number, page);
+    const std::string data = page->getRecord(rids[j]);
+    bufMgr->unPinPage(file1, rids[j].page_number, false);
+    const int i = reinterpret_cast<const RECORD *>(data.data())->i;
+    if (i > previous) return -1;
+    previous = i;
+  }
+  return (int)rids.size();
+}
+
+void multiRangeScanTests() {
+  for (int bulk = 0; bulk < 2; bulk++) {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, bulk == 1);
+
+    // Ranges open on one end reach to the end of the index
+    int key = 4990;
+    checkPassFail(openScan(&index, &key, GT, NULL, LTE), 9)
+    key = 25;
+    checkPassFail(openScan(&index, NULL, GTE, &key, LT), 25)
+    checkPassFail(openScan(&index, NULL, GT, NULL, LT), relationSize)
+
+    // An IN-list, with some keys that are not in the index, and ranges
+    const int keys[] = {-10, 3, 4, 7, 1000, 1001, 2500, 4999, 6000};
+    std::vector<ScanRange> ranges;
+    for (int r = 0; r < 9; r++) {
+      const ScanRange range = {(void *)&keys[r], GTE, (void *)&keys[r], LTE};
+      ranges.push_back(range);
+    }
+    checkPassFail(rangeScan(&index, ranges), 7)
+    checkPassFail(rangeScan(&index, ranges, 3), 7)
+
+    const int bounds[] = {10, 20, 20, 30, 100, 200, 4000};
+    ranges.clear();
+    const ScanRange first = {(void *)&bounds[0], GTE, (void *)&bounds[1], LT};
+    const ScanRange second = {(void *)&bounds[2], GTE, (void *)&bounds[3],
+                              LTE};
+    const ScanRange third = {(void *)&bounds[4], GT, (void *)&bounds[5], LT};
+    const ScanRange last = {(void *)&bounds[6], GT, NULL, LT};
+    ranges.push_back(first);
+    ranges.push_back(second);
+    ranges.push_back(third);
+    ranges.push_back(last);
+    const int expected = intScan(&index, 10, GTE, 30, LTE) +
+                         intScan(&index, 100, GT, 200, LT) +
+                         intScan(&index, 4000, GT, relationSize, LT);
+    checkPassFail(rangeScan(&index, ranges), expected)
+    checkPassFail(rangeScan(&index, ranges, 16), expected)
+
+    // Ranges close together are scanned along the leaves
+    std::vector<int> near;
+    for (int k = 0; k < 150; k += 3) near.push_back(k);
+    ranges.clear();
+    for (std::size_t r = 0; r < near.size(); r++) {
+      const ScanRange range = {&near[r], GTE, &near[r], LTE};
+      ranges.push_back(range);
+    }
+    checkPassFail(rangeScan(&index, ranges), 50)
+    bufMgr->clearBufStats();
+    RecordId rids[64];
+    index.startScan(ranges);
+    const int found = (int)index.scanNextBatch(rids, 64);
+    index.endScan();
+    checkPassFail(found, 50)
+    const int accesses = (int)bufMgr->getBufStats().accesses.load();
+    std::cout << "Buffer pool accesses for 50 keys: " << accesses << std::endl;
+    bool few = accesses < 10;
+    checkPassFail(few, true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Ranges that are empty, overlap or are out of order are rejected
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    const int bounds[] = {10, 20, 30};
+    const ScanRange low = {(void *)&bounds[0], GTE, (void *)&bounds[1], LTE};
+    const ScanRange high = {(void *)&bounds[1], GTE, (void *)&bounds[2], LT};
+    const ScanRange reversed = {(void *)&bounds[2], GTE, (void *)&bounds[0],
+                                LT};
+    const ScanRange open = {(void *)&bounds[1], GT, (void *)&bounds[2], LT};
+    std::vector<ScanRange> lists[4];
+    lists[0].push_back(low);
+    lists[0].push_back(high);
+    lists[1].push_back(high);
+    lists[1].push_back(low);
+    lists[2].push_back(reversed);
+    int rejected = 0;
+    for (int l = 0; l < 4; l++) {
+      try {
+        index.startScan(lists[l]);
+      } catch (const BadScanrangeException &e) {
+        rejected++;
+      }
+    }
+    checkPassFail(rejected, 4)
+
+    // A range may start where the one before ends if one of them leaves it out
+    std::vector<ScanRange> ranges;
+    ranges.push_back(low);
+    ranges.push_back(open);
+    checkPassFail(rangeScan(&index, ranges), 20)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Open ranges of the other key types
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE, false);
+    double lowDouble = 4000;
+    checkPassFail(openScan(&doubleIndex, &lowDouble, GTE, NULL, LT),
+                  relationSize - 4000)
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING, false);
+    char highString[STRINGSIZE + 1];
+    sprintf(highString, "%05d", 100);
+    checkPassFail(openScan(&stringIndex, NULL, GT, highString, LTE), 100)
+  }
+  File::remove(doubleIndexName);
+  File::remove(stringIndexName);
+}
+
+/**
+ * Runs a scan of several ranges and returns the number of entries it finds, or
+ * -1 if their records do not come in ascending order of i. Entries are
+ * fetched batchSize at a time, or one by one if batchSize is 0.
+ */
+int rangeScan(BTreeIndex *index, const std::vector<ScanRange> &ranges,
+              std::size_t batchSize) {
+  IndexCursor cursor;
+  try {
+    index->startScan(cursor, ranges);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+
+  std::vector<RecordId> rids;
+  if (batchSize == 0) {
+    try {
+      RecordId rid;
+      while (true) {
+        index->scanNext(cursor, rid);
+        rids.push_back(rid);
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+  } else {
+    std::vector<RecordId> batch(batchSize);
+    std::size_t got;
+    while ((got = index->scanNextBatch(cursor, &batch[0], batchSize)) > 0) {
+      rids.insert(rids.end(), batch.begin(), batch.begin() + got);
+    }
+  }
+  index->endScan(cursor);
+
+  int previous = INT_MIN;
+  for (std::size_t j = 0; j < rids.size(); j++) {
+    Page *page;
+    bufMgr->readPage(file1, rids[j].page_number, page);
+    const std::string data = page->getRecord(rids[j]);
+    bufMgr->unPinPage(file1, rids[j].page_number, false);
+    const int i = reinterpret_cast<const RECORD *>(data.data())->i;
+    if (i < previous) return -1;
+    previous = i;
+  }
+  return (int)rids.size();
+}
+
+/**
+ * Returns the number of entries a scan of the range finds, either end of which
+ * may be left open.
+ */
+int openScan(BTreeIndex *index, void *lowVal, Operator lowOp, void *highVal,
+             Operator highOp) {
+  IndexCursor cursor;
+  try {
+    index->startScan(cursor, lowVal, lowOp, highVal, highOp);
+  } catch (const NoSuchKeyFoundException &e) {
+    return 0;
+  }
+  int count = 0;
+  try {
+    RecordId rid;
+    while (true) {
+      index->scanNext(cursor, rid);
+      count++;
+    }
+  } catch (const IndexScanCompletedException &e) {
+  }
+  index->endScan(cursor);
+  return count;
+}
+
+void indexOnlyScanTests() {
+  for (int bulk = 0; bulk < 2; bulk++) {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, bulk == 1);
+
+    // The keys returned with the entries are those of their records
+    checkPassFail(keyedScan(&index, 0, relationSize, false, 0), relationSize)
+    checkPassFail(keyedScan(&index, 100, 2000, false, 64), 1900)
+    checkPassFail(keyedScan(&index, 100, 2000, true, 0), 1900)
+    checkPassFail(keyedScan(&index, 100, 2000, true, 33), 1900)
+
+    // Counts read only the leaves
+    int low = 250;
+    int high = 4321;
+    checkPassFail((int)index.count(&low, GT, &high, LTE),
+                  intScan(&index, 250, GT, 4321, LTE))
+    bufMgr->clearBufStats();
+    const int all = (int)index.count(NULL, GTE, NULL, LTE);
+    const int countAccesses = (int)bufMgr->getBufStats().accesses.load();
+    std::cout << "Buffer pool accesses for count(): " << countAccesses
+              << std::endl;
+    checkPassFail(all, relationSize)
+    bool leavesOnly = countAccesses < 20;
+    checkPassFail(leavesOnly, true)
+    std::vector<ScanRange> ranges;
+    const ScanRange below = {NULL, GTE, &low, LT};
+    const ScanRange above = {&high, GTE, NULL, LT};
+    ranges.push_back(below);
+    ranges.push_back(above);
+    checkPassFail((int)index.count(ranges), relationSize - (high - low))
+
+    // The smallest and largest keys come from one leaf each
+    int key = -1;
+    bufMgr->clearBufStats();
+    bool found = index.min(&key);
+    checkPassFail(found, true)
+    checkPassFail(key, 0)
+    found = index.max(&key);
+    checkPassFail(found, true)
+    checkPassFail(key, relationSize - 1)
+    const int edgeAccesses = (int)bufMgr->getBufStats().accesses.load();
+    bool oneLeafEach = edgeAccesses <= 2;
+    checkPassFail(oneLeafEach, true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Leaves emptied at either end are passed over, and an empty index has
+    // no smallest or largest key
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    for (int key = 0; key < relationSize; key++) {
+      if (key == 1000) key = 4000;
+      RecordId rid;
+      index.lookup(&key, rid);
+      index.deleteEntry(&key, rid);
+    }
+    int key = -1;
+    index.min(&key);
+    checkPassFail(key, 1000)
+    index.max(&key);
+    checkPassFail(key, 3999)
+    checkPassFail((int)index.count(NULL, GT, NULL, LT), 3000)
+    for (int key = 1000; key < 4000; key++) {
+      RecordId rid;
+      index.lookup(&key, rid);
+      index.deleteEntry(&key, rid);
+    }
+    bool found = index.min(&key) || index.max(&key);
+    checkPassFail(found, false)
+    checkPassFail((int)index.count(NULL, GT, NULL, LT), 0)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Keys of the other types
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE, false);
+    double lowDouble = -1;
+    double highDouble = -1;
+    doubleIndex.min(&lowDouble);
+    doubleIndex.max(&highDouble);
+    checkPassFail(lowDouble, 0)
+    checkPassFail(highDouble, relationSize - 1)
+
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING, false);
+    char keys[8][STRINGSIZE];
+    RecordId rids[8];
+    char lowString[STRINGSIZE + 1];
+    sprintf(lowString, "%05d", 42);
+    stringIndex.startScan(lowString, GTE, NULL, LT);
+    const std::size_t got = stringIndex.scanNextBatch(rids, keys, 8);
+    stringIndex.endScan();
+    int mismatches = 0;
+    for (std::size_t j = 0; j < got; j++) {
+      char expected[16];
+      sprintf(expected, "%05d", 42 + (int)j);
+      if (memcmp(keys[j], expected, 5) != 0) mismatches++;
+    }
+    checkPassFail((int)got, 8)
+    checkPassFail(mismatches, 0)
+    stringIndex.max(keys[0]);
+    sprintf(lowString, "%05d", relationSize - 1);
+    checkPassFail(memcmp(keys[0], lowString, 5), 0)
+  }
+  File::remove(doubleIndexName);
+  File::remove(stringIndexName);
+}
+
+void cardinalityTests() {
+  for (int bulk = 0; bulk < 2; bulk++) {
+    {
+      BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER, bulk == 1);
+
+      // Many more entries than the relation has, in no order, so that nodes
+      // split and the counts of their children go out of date in between
+      const int extra = 200000;
+      const int total = relationSize + extra;
+      for (int j = 0; j < extra; j++) {
+        int key = relationSize + (int)(((long long)j * 7919) % extra);
+        RecordId rid = {(PageId)(j + 1), 1, 0};
+        index.insertEntry(&key, rid);
+      }
+
+      const int lows[] = {0, 100, 2500, 60000, 150000};
+      const int highs[] = {10, 4000, 120000, 150001, total};
+      int misses = 0;
+      for (int r = 0; r < 5; r++) {
+        int low = lows[r];
+        int high = highs[r];
+        const int actual = (int)index.count(&low, GTE, &high, LT);
+        const int estimate = (int)index.estimateRange(&low, GTE, &high, LT);
+        std::cout << "Range [" << low << ", " << high << "): " << actual
+                  << " entries, estimated " << estimate << std::endl;
+        if (!withinEstimate(estimate, actual)) misses++;
+      }
+      checkPassFail(misses, 0)
+      bool near = withinEstimate((int)index.estimateRange(NULL, GT, NULL, LT),
+                                 total);
+      checkPassFail(near, true)
+
+      // One descent per bound, whatever the size of the range
+      int low = 1000;
+      int high = 190000;
+      bufMgr->clearBufStats();
+      index.estimateRange(&low, GT, &high, LTE);
+      const int accesses = (int)bufMgr->getBufStats().accesses.load();
+      std::cout << "Buffer pool accesses for estimateRange(): " << accesses
+                << std::endl;
+      bool fewPages = accesses <= 8;
+      checkPassFail(fewPages, true)
+
+      int key = 100000;
+      near = withinEstimate((int)index.estimateRank(&key), key);
+      checkPassFail(near, true)
+      near = nearlyEqual((int)index.estimateRank(&key, true) -
+                             (int)index.estimateRank(&key),
+                         1, 1);
+      checkPassFail(near, true)
+
+      // Quantiles of keys 0 to total - 1, each once
+      bool found = index.estimateQuantile(0.5, &key);
+      checkPassFail(found, true)
+      near = nearlyEqual(key, total / 2, total / 10);
+      checkPassFail(near, true)
+      index.estimateQuantile(0, &key);
+      checkPassFail(key, 0)
+      index.estimateQuantile(1, &key);
+      checkPassFail(key, total - 1)
+    }
+    File::remove(intIndexName);
+  }
+
+  {
+    // Deletes are tallied too, and so many of them set the counts again
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    for (int key = 1000; key < 4000; key++) {
+      RecordId rid;
+      index.lookup(&key, rid);
+      index.deleteEntry(&key, rid);
+    }
+    checkPassFail((int)index.estimateRange(NULL, GT, NULL, LT), 2000)
+    int low = 500;
+    int high = 4500;
+    checkPassFail((int)index.estimateRange(&low, GTE, &high, LT), 1000)
+
+    // Rounds of a few hundred inserts and deletes each, in no order. Between
+    // the estimates that set the counts again, the counts fall behind by no
+    // more than the entries changed since.
+    int entries = 2000;
+    for (int j = 0; j < 48000; j++) {
+      int key = 10000 + (int)(((long long)j * 7919) % 48000);
+      RecordId rid = {(PageId)(j + 1), 1, 0};
+      index.insertEntry(&key, rid);
+      entries++;
+    }
+    int misses = 0;
+    int worst = 0;
+    for (int round = 0; round < 40; round++) {
+      for (int j = 0; j < 300; j++) {
+        const long long n = round * 300 + j;
+        int key = 10000 + (int)((n * 104729) % 48000);
+        RecordId rid;
+        if (index.lookup(&key, rid) && index.deleteEntry(&key, rid)) entries--;
+        key = 58000 + (int)n;
+        RecordId newRid = {(PageId)(j + 1), 1, 0};
+        index.insertEntry(&key, newRid);
+        entries++;
+      }
+      low = 20000;
+      high = 30000 + round * 300;
+      const int bound = entries / STALE_COUNT_DIVISOR + 1;
+      int actual = (int)index.count(&low, GTE, &high, LT);
+      int error = std::abs((int)index.estimateRange(&low, GTE, &high, LT) -
+                           actual);
+      worst = std::max(worst, error);
+      if (error > bound) misses++;
+      actual = (int)index.count(NULL, GT, &high, LT);
+      error = std::abs((int)index.estimateRank(&high) - actual);
+      if (error > bound) misses++;
+    }
+    std::cout << "Largest estimate error after mixed inserts and deletes: "
+              << worst << " of " << entries << " entries" << std::endl;
+    checkPassFail(misses, 0)
+    bool near = withinEstimate((int)index.estimateRange(NULL, GT, NULL, LT),
+                               entries);
+    checkPassFail(near, true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // Keys of the other types
+    BTreeIndex doubleIndex(relationName, doubleIndexName, bufMgr,
+                           offsetof(tuple, d), DOUBLE, false);
+    double lowDouble = 300;
+    double highDouble = 2800;
+    bool near = withinEstimate(
+        (int)doubleIndex.estimateRange(&lowDouble, GT, &highDouble, LTE), 2500);
+    checkPassFail(near, true)
+
+    BTreeIndex stringIndex(relationName, stringIndexName, bufMgr,
+                           offsetof(tuple, s), STRING, false);
+    char lowString[STRINGSIZE + 1];
+    sprintf(lowString, "%05d", 1000);
+    near = withinEstimate(
+        (int)stringIndex.estimateRange(lowString, GTE, NULL, LT), 4000);
+    checkPassFail(near, true)
+    char median[STRINGSIZE];
+    stringIndex.estimateQuantile(0.5, median);
+    near = nearlyEqual(atoi(std::string(median, 5).c_str()), relationSize / 2,
+                       relationSize / 10);
+    checkPassFail(near, true)
+  }
+  File::remove(doubleIndexName);
+  File::remove(stringIndexName);
+}
+
+void heapScanTests() {
+  {
+    // The relation is in random order, so the entries of a range are on pages
+    // all over it
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    int low = 1000;
+    int high = 3000;
+    IndexCursor cursor;
+    index.startScan(cursor, &low, GTE, &high, LT);
+    IndexHeapScan scan(relationName, bufMgr, index, cursor);
+
+    bufMgr->clearBufStats();
+    std::vector<bool> seen(relationSize, false);
+    int found = 0;
+    int outOfOrder = 0;
+    int wrongKeys = 0;
+    RecordId last = {0, 0, 0};
+    try {
+      RecordId rid;
+      while (true) {
+        scan.scanNext(rid);
+        std::size_t length;
+        const RECORD *record =
+            reinterpret_cast<const RECORD *>(scan.getRecordData(length));
+        if (record->i < low || record->i >= high || seen[record->i]) {
+          wrongKeys++;
+        } else {
+          seen[record->i] = true;
+        }
+        if (found > 0 && (rid.page_number < last.page_number ||
+                          (rid.page_number == last.page_number &&
+                           rid.slot_number <= last.slot_number))) {
+          outOfOrder++;
+        }
+        last = rid;
+        found++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+    const int accesses = (int)bufMgr->getBufStats().accesses.load();
+    std::cout << "Records fetched: " << found << " from " << scan.numPages()
+              << " pages, " << accesses << " buffer pool accesses"
+              << std::endl;
+    checkPassFail(found, high - low)
+    checkPassFail(wrongKeys, 0)
+    checkPassFail(outOfOrder, 0)
+    // One access per page, rather than one per record
+    checkPassFail(accesses, (int)scan.numPages())
+
+    // Lookups given in any order, some more than once, and records checked
+    // against conditions
+    std::vector<RecordId> rids;
+    for (int key = 4999; key >= 4000; key--) {
+      RecordId rid;
+      index.lookup(&key, rid);
+      rids.push_back(rid);
+      if (key % 10 == 0) rids.push_back(rid);
+    }
+    std::vector<ScanPredicate> predicates;
+    predicates.push_back(ScanPredicate(offsetof(tuple, i), GTE, 4500));
+    IndexHeapScan lookups(relationName, bufMgr, rids, predicates);
+    found = 0;
+    wrongKeys = 0;
+    try {
+      RecordId rid;
+      while (true) {
+        lookups.scanNext(rid);
+        const std::string data = lookups.getRecord();
+        const int key = reinterpret_cast<const RECORD *>(data.data())->i;
+        if (key < 4500 || key >= 5000) wrongKeys++;
+        found++;
+      }
+    } catch (const EndOfFileException &e) {
+    }
+    checkPassFail(found, 500)
+    checkPassFail(wrongKeys, 0)
+
+    // Nothing to fetch
+    IndexHeapScan empty(relationName, bufMgr, std::vector<RecordId>());
+    bool ended = false;
+    try {
+      RecordId rid;
+      empty.scanNext(rid);
+    } catch (const EndOfFileException &e) {
+      ended = true;
+    }
+    checkPassFail(ended, true)
+  }
+  File::remove(intIndexName);
+}
+
+void hugePageTests() {
+  // More frames than fit in one huge page, so the pool spans several
+  const std::uint32_t frames = 2 * HUGE_PAGE_SIZE / Page::SIZE + 10;
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+    pageNos.push_back(iter.page_number());
+  }
+  {
+    BufMgr hugeBufMgr(frames, DEFAULT_HIGH_DIRTY_RATIO, DEFAULT_LOW_DIRTY_RATIO,
+                      CLOCK, HUGE_PAGES);
+    std::cout << "Reserved huge pages: " << hugeBufMgr.usesReservedHugePages()
+              << std::endl;
+    bool aligned = reinterpret_cast<std::uintptr_t>(hugeBufMgr.bufPool) %
+                       File::DIRECT_ALIGNMENT ==
+                   0;
+    checkPassFail(aligned, true)
+
+    // Every page read in, and the first key of each changed
+    for (std::size_t j = 0; j < pageNos.size(); j++) {
+      Page *page;
+      hugeBufMgr.readPage(file1, pageNos[j], page);
+      RecordId rid = {pageNos[j], 1, 0};
+      std::string data = page->getRecord(rid);
+      reinterpret_cast<RECORD *>(&data[0])->i += 1000000;
+      page->updateRecord(rid, data);
+      hugeBufMgr.unPinPage(file1, pageNos[j], true);
+    }
+    checkPassFail(hugeBufMgr.getNumDirty(), (std::uint32_t)pageNos.size())
+    hugeBufMgr.flushFile(file1);
+  }
+
+  // The changes made it to disk
+  int changed = 0;
+  for (std::size_t j = 0; j < pageNos.size(); j++) {
+    Page *page;
+    bufMgr->readPage(file1, pageNos[j], page);
+    RecordId rid = {pageNos[j], 1, 0};
+    const std::string data = page->getRecord(rid);
+    if (reinterpret_cast<const RECORD *>(data.data())->i >= 1000000) changed++;
+    bufMgr->unPinPage(file1, pageNos[j], false);
+  }
+  checkPassFail(changed, (int)pageNos.size())
+}
+
+void clockTests() {
+  // Frames over three words of bits, the last one partly used
+  const std::uint32_t frames = 150;
+  ClockPolicy clock(frames, frames);
+
+  // Empty frames are suggested in order, and each is given a page
+  int outOfOrder = 0;
+  for (FrameId frame = 0; frame < frames; frame++) {
+    if (clock.nextVictim() != frame) outOfOrder++;
+    clock.loaded(frame, NULL, frame + 1, false);
+  }
+  checkPassFail(outOfOrder, 0)
+
+  // The hand passes over referenced frames to the first one without the bit,
+  // clearing the bits it passes, and wraps around at the end of the pool
+  clock.evicted(70);
+  checkPassFail(clock.nextVictim(), 70u)
+  clock.loaded(70, NULL, 71, false);
+  checkPassFail(clock.nextVictim(), 0u)
+  checkPassFail(clock.nextVictim(), 1u)
+
+  // Pages of scans are given up first, and pinning a page saves it
+  clock.loaded(130, NULL, 131, true);
+  clock.pinned(2, false);
+  checkPassFail(clock.nextVictim(), 3u)
+  checkPassFail(clock.nextVictim(), 4u)
+  for (FrameId frame = 5; frame < frames; frame++) clock.pinned(frame, false);
+  clock.loaded(130, NULL, 131, true);
+  checkPassFail(clock.nextVictim(), 130u)
+
+  // With every bit set, one sweep clears them all
+  for (FrameId frame = 0; frame < frames; frame++) clock.pinned(frame, false);
+  const FrameId frame = clock.nextVictim();
+  checkPassFail(clock.nextVictim(), (frame + 1) % frames)
+
+  std::vector<FrameId> order;
+  clock.victimOrder(order);
+  checkPassFail(order.size(), (std::size_t)frames)
+  checkPassFail(order[0], (frame + 2) % frames)
+}
+
+void resizeTests(ReplacementStrategy strategy) {
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+    pageNos.push_back(iter.page_number());
+  }
+  const std::uint32_t maxFrames = (std::uint32_t)pageNos.size() + 16;
+  BufMgr pool(16, DEFAULT_HIGH_DIRTY_RATIO, DEFAULT_LOW_DIRTY_RATIO, strategy,
+              SMALL_PAGES, maxFrames);
+  checkPassFail(pool.getMaxBufs(), maxFrames)
+
+  // Grown, the pool holds every page pinned at once, and the first key of
+  // each is changed
+  pool.resize(maxFrames);
+  checkPassFail(pool.getNumBufs(), maxFrames)
+  std::vector<Page *> pages(pageNos.size());
+  for (std::size_t j = 0; j < pageNos.size(); j++) {
+    pool.readPage(file1, pageNos[j], pages[j]);
+  }
+  for (std::size_t j = 0; j < pageNos.size(); j++) {
+    RecordId rid = {pageNos[j], 1, 0};
+    std::string data = pages[j]->getRecord(rid);
+    reinterpret_cast<RECORD *>(&data[0])->i += 1000000;
+    pages[j]->updateRecord(rid, data);
+    pool.unPinPage(file1, pageNos[j], true);
+  }
+
+  // Shrunk, the dirty pages of the frames removed are written back, and the
+  // pool only holds as many pages pinned as it has frames left
+  pool.resize(8);
+  checkPassFail(pool.getNumBufs(), 8u)
+  checkPassFail((pool.getNumDirty() <= 8), true)
+  int exceeded = 0;
+  try {
+    for (std::size_t j = 0; j < 9; j++) pool.readPage(file1, pageNos[j], pages[j]);
+  } catch (const BufferExceededException &e) {
+    exceeded++;
+  }
+  checkPassFail(exceeded, 1)
+  for (std::size_t j = 0; j < 8; j++) pool.unPinPage(file1, pageNos[j], false);
+
+  // Pages read back, through frames that were removed and added again while
+  // another thread resizes the pool, have the changes
+  std::atomic<bool> resizing(true);
+  std::thread resizer([&pool, &resizing, maxFrames]() {
+    for (std::uint32_t i = 0; resizing.load(); i++) {
+      pool.resize(i % 2 == 0 ? maxFrames : 8);
+    }
+  });
+  int changed = 0;
+  for (int round = 0; round < 4; round++) {
+    for (std::size_t j = 0; j < pageNos.size(); j++) {
+      Page *page;
+      pool.readPage(file1, pageNos[j], page);
+      RecordId rid = {pageNos[j], 1, 0};
+      const std::string data = page->getRecord(rid);
+      if (reinterpret_cast<const RECORD *>(data.data())->i >= 1000000) changed++;
+      pool.unPinPage(file1, pageNos[j], false);
+    }
+  }
+  resizing = false;
+  resizer.join();
+  checkPassFail(changed, 4 * (int)pageNos.size())
+
+  // Sizes out of range are refused
+  int refused = 0;
+  try {
+    pool.resize(0);
+  } catch (const BufferExceededException &e) {
+    refused++;
+  }
+  try {
+    pool.resize(maxFrames + 1);
+  } catch (const BufferExceededException &e) {
+    refused++;
+  }
+  checkPassFail(refused, 2)
+
+  // Put the keys back for the next strategy
+  pool.resize(maxFrames);
+  for (std::size_t j = 0; j < pageNos.size(); j++) {
+    Page *page;
+    pool.readPage(file1, pageNos[j], page);
+    RecordId rid = {pageNos[j], 1, 0};
+    std::string data = page->getRecord(rid);
+    reinterpret_cast<RECORD *>(&data[0])->i -= 1000000;
+    page->updateRecord(rid, data);
+    pool.unPinPage(file1, pageNos[j], true);
+  }
+  pool.flushFile(file1);
+}
+
+void priorityTests() {
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+    pageNos.push_back(iter.page_number());
+  }
+  const std::size_t hot = 10;
+  BufMgr pool(20);
+
+  // A second File object for the relation stands in for an index. Its pages
+  // stay in the pool while every page of the relation is read through the
+  // other one.
+  PageFile index = PageFile::open(relationName);
+  pool.setFileClass(&index, INDEX_PRIORITY);
+  for (int round = 0; round < 2; round++) {
+    for (std::size_t j = 0; j < hot; j++) {
+      Page *page;
+      pool.readPage(&index, pageNos[j], page);
+      pool.unPinPage(&index, pageNos[j], false);
+    }
+    for (std::size_t j = 0; j < pageNos.size(); j++) {
+      Page *page;
+      pool.readPage(file1, pageNos[j], page);
+      pool.unPinPage(file1, pageNos[j], false);
+    }
+  }
+  const BufStats &stats = pool.getBufStats();
+  checkPassFail(stats.classAccesses[INDEX_PRIORITY].load(), (int)(2 * hot))
+  checkPassFail(stats.classHits[INDEX_PRIORITY].load(), (int)hot)
+  checkPassFail(stats.hitRate(INDEX_PRIORITY), 0.5)
+  checkPassFail(stats.classAccesses[HEAP_PRIORITY].load(),
+                (int)(2 * pageNos.size()))
+  checkPassFail(stats.hitRate(TEMP_PRIORITY), 0.0)
+
+  // A file that has used up its quota only reuses its own frames, so with
+  // all of them pinned it gets no other, though the pool has free frames.
+  // Flushing the file first drops the pages it has in the pool.
+  pool.clearFileClass(&index);
+  pool.flushFile(file1);
+  pool.setFileClass(file1, TEMP_PRIORITY, 4);
+  std::vector<Page *> pages(5);
+  int exceeded = 0;
+  try {
+    for (std::size_t j = 0; j < 5; j++) pool.readPage(file1, pageNos[j], pages[j]);
+  } catch (const BufferExceededException &e) {
+    exceeded++;
+  }
+  checkPassFail(exceeded, 1)
+  for (std::size_t j = 0; j < 4; j++) pool.unPinPage(file1, pageNos[j], false);
+
+  // With its pages unpinned the file keeps reusing its four frames, so the
+  // pages of the other File object are all still there
+  for (std::size_t j = 0; j < hot; j++) {
+    Page *page;
+    pool.readPage(&index, pageNos[j], page);
+    pool.unPinPage(&index, pageNos[j], false);
+  }
+  pool.clearBufStats();
+  for (std::size_t j = 0; j < pageNos.size(); j++) {
+    Page *page;
+    pool.readPage(file1, pageNos[j], page);
+    pool.unPinPage(file1, pageNos[j], false);
+  }
+  for (std::size_t j = 0; j < hot; j++) {
+    Page *page;
+    pool.readPage(&index, pageNos[j], page);
+    pool.unPinPage(&index, pageNos[j], false);
+  }
+  checkPassFail(stats.classHits[INDEX_PRIORITY].load(), (int)hot)
+  pool.clearFileClass(file1);
+}
+
+void telemetryTests() {
+  // Every value is placed within a sixteenth of itself
+  Histogram histogram;
+  for (std::uint64_t value = 1; value <= 1000; value++) histogram.record(value);
+  checkPassFail(histogram.getCount(), 1000u)
+  checkPassFail(histogram.getSum(), 500500u)
+  const std::uint64_t median = histogram.percentile(0.5);
+  checkPassFail((median >= 500 && median <= 500 + 500 / 16), true)
+  checkPassFail(histogram.percentile(1.0), 1023u)
+  checkPassFail(histogram.countAtMost(15), 15u)
+  int misplaced = 0;
+  for (std::uint64_t value = 1; value < (1ULL << 39); value = value * 3 + 1) {
+    const int bucket = Histogram::bucketOf(value);
+    if (Histogram::bucketLimit(bucket) < value) misplaced++;
+    if (bucket > 0 && Histogram::bucketLimit(bucket - 1) >= value) misplaced++;
+  }
+  checkPassFail(misplaced, 0)
+
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+    pageNos.push_back(iter.page_number());
+  }
+  BufMgr pool(10);
+
+  // Pages read twice through a pool too small for them, the first few
+  // changed the first time, so that some evictions write them back
+  for (int round = 0; round < 2; round++) {
+    for (std::size_t j = 0; j < 30; j++) {
+      Page *page;
+      pool.readPage(file1, pageNos[j], page);
+      pool.readPage(file1, pageNos[j], page);
+      pool.unPinPage(file1, pageNos[j], false);
+      pool.unPinPage(file1, pageNos[j], round == 0 && j < 5);
+    }
+  }
+  pool.flushFile(file1);
+
+  BufTelemetrySnapshot snapshot;
+  pool.getTelemetry(snapshot);
+  const FileAccessCounts &counts = snapshot.files[file1->filename()];
+  const BufStats &stats = pool.getBufStats();
+  checkPassFail(counts.hits + counts.misses, (std::uint64_t)stats.accesses.load())
+  checkPassFail(counts.misses, 60u)
+  checkPassFail(snapshot.readLatency.getCount(), 60u)
+  checkPassFail(snapshot.sweepLength.getCount(), 60u)
+  checkPassFail(snapshot.dirtyEvictions, 5u)
+  checkPassFail(snapshot.cleanEvictions, 50u - 5u)
+  checkPassFail(snapshot.writeLatency.getCount(), 5u)
+
+  std::ostringstream metrics;
+  pool.exportMetrics(metrics);
+  const std::string text = metrics.str();
+  const std::string hits = "badgerdb_buffer_file_hits_total{file=\"" +
+                           file1->filename() + "\"} 60\n";
+  checkPassFail((text.find(hits) != std::string::npos), true)
+  checkPassFail(
+      (text.find("badgerdb_buffer_read_seconds_count 60\n") != std::string::npos),
+      true)
+  checkPassFail((text.find("badgerdb_buffer_evictions_total{page=\"dirty\"} 5\n") !=
+                 std::string::npos),
+                true)
+
+  pool.clearBufStats();
+  pool.getTelemetry(snapshot);
+  checkPassFail(snapshot.files.size(), 0u)
+  checkPassFail(snapshot.readLatency.getCount(), 0u)
+}
+
+void btreeStatsTests() {
+  double appendedFill = 0;
+  {
+    // Keys inserted in increasing order are appended, leaving every leaf but
+    // the last full
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    BTreeStats stats = index.getStats();
+    std::cout << "Height " << stats.height << ", " << stats.levelNodes.back()
+              << " leaves, leaf fill " << stats.leafFill << ", internal fill "
+              << stats.internalFill << std::endl;
+    checkPassFail(stats.height, (int)stats.levelNodes.size())
+    checkPassFail(stats.levelNodes.front(), 1u)
+    checkPassFail(stats.entries, (std::size_t)relationSize)
+
+    // Every node but the first leaf came from a split
+    checkPassFail(stats.leafSplits + 1, stats.levelNodes.back())
+    std::size_t internalNodes = 0;
+    for (int l = 0; l + 1 < stats.height; l++) {
+      internalNodes += stats.levelNodes[l];
+    }
+    checkPassFail(stats.internalSplits + stats.rootSplits, internalNodes)
+    checkPassFail(stats.rootSplits, (std::uint64_t)(stats.height - 1))
+    appendedFill = stats.leafFill;
+    checkPassFail((appendedFill > 0.8), true)
+    checkPassFail((stats.internalFill > 0 && stats.internalFill <= 1), true)
+
+    checkPassFail(stats.insert.calls, (std::uint64_t)relationSize)
+    checkPassFail((stats.insert.pagesTouched >= stats.insert.calls), true)
+    checkPassFail((stats.insert.descentDepth >= stats.insert.calls), true)
+    checkPassFail(stats.startScan.calls, 0u)
+
+    // A scan goes down once, then moves along the leaves
+    int low = 100;
+    int high = 3000;
+    index.startScan(&low, GTE, &high, LT);
+    RecordId outRid;
+    for (int j = 0; j < 2000; j++) index.scanNext(outRid);
+    index.endScan();
+    stats = index.getStats();
+    checkPassFail(stats.startScan.calls, 1u)
+    checkPassFail(stats.startScan.descentDepth, (std::uint64_t)stats.height)
+    checkPassFail(stats.scanNext.calls, 2000u)
+    checkPassFail(stats.scanNext.descentDepth, 0u)
+    checkPassFail((stats.scanNext.pagesTouched <= stats.levelNodes.back()),
+                  true)
+  }
+  File::remove(intIndexName);
+
+  {
+    // A bulk load makes no splits
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, true);
+    BTreeStats stats = index.getStats();
+    checkPassFail(stats.entries, (std::size_t)relationSize)
+    checkPassFail(stats.leafSplits, 0u)
+    checkPassFail(stats.insert.calls, 0u)
+  }
+  File::remove(intIndexName);
+
+  // Keys in no order split leaves in the middle, leaving them less full
+  deleteRelation();
+  createRelationRandom();
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, false);
+    BTreeStats stats = index.getStats();
+    std::cout << "Random order: " << stats.levelNodes.back()
+              << " leaves, leaf fill " << stats.leafFill << std::endl;
+    checkPassFail(stats.entries, (std::size_t)relationSize)
+    checkPassFail(stats.leafSplits + 1, stats.levelNodes.back())
+    checkPassFail((stats.leafFill < appendedFill), true)
+    checkPassFail((stats.leafFill > 0.4), true)
+  }
+  File::remove(intIndexName);
+}
+
+/**
+ * Lists the keys of the records of file in the order they are stored, and
+ * returns the number of records that are not the GeneratedRecord of their key.
+ */
+int storedKeys(PageFile *file, std::vector<int> &keys) {
+  keys.clear();
+  int mismatches = 0;
+  std::string expected;
+  for (FileIterator iter = file->begin(); iter != file->end(); ++iter) {
+    Page page = *iter;
+    for (PageIterator it = page.begin(); it != page.end(); ++it) {
+      const std::string record = *it;
+      const int key = *reinterpret_cast<const int *>(record.data());
+      RelationGenerator::makeRecord(key, expected);
+      if (record != expected) mismatches++;
+      keys.push_back(key);
+    }
+  }
+  return mismatches;
+}
+
+void relationGeneratorTests() {
+  // Every key once, in the order keyAt() gives
+  const KeyPattern patterns[] = {FORWARD_KEYS, BACKWARD_KEYS, RANDOM_KEYS};
+  for (int p = 0; p < 3; p++) {
+    RelationSpec spec;
+    spec.pattern = patterns[p];
+    spec.low = -50;
+    spec.high = 20000;
+    spec.seed = 7;
+    RelationGenerator generator(spec, 3);
+    checkPassFail(generator.numRecords(), 20050u)
+    generateRelation(spec);
+
+    std::vector<int> keys;
+    checkPassFail(storedKeys(file1, keys), 0)
+    checkPassFail(keys.size(), (std::size_t)20050)
+    int misplaced = 0;
+    for (std::size_t k = 0; k < keys.size(); k++) {
+      if (keys[k] != generator.keyAt(k)) misplaced++;
+    }
+    checkPassFail(misplaced, 0)
+    std::sort(keys.begin(), keys.end());
+    int missing = 0;
+    for (std::size_t k = 0; k < keys.size(); k++) {
+      if (keys[k] != (int)k - 50) missing++;
+    }
+    checkPassFail(missing, 0)
+
+    // Pages are filled, and an index builds on the relation as on any other
+    std::vector<PageId> used;
+    file1->getUsedPages(used);
+    checkPassFail((used.size() * 90 < keys.size()), true)
+    {
+      BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                       INTEGER);
+      checkPassFail(index.getStats().entries, keys.size())
+    }
+    File::remove(intIndexName);
+    deleteRelation();
+  }
+
+  // Random orders are the same for a seed, and differ between seeds
+  {
+    RelationSpec spec;
+    spec.pattern = RANDOM_KEYS;
+    spec.high = 1000;
+    spec.seed = 7;
+    RelationGenerator first(spec, 1);
+    RelationGenerator again(spec, 4);
+    spec.seed = 8;
+    RelationGenerator other(spec);
+    int same = 0;
+    int differ = 0;
+    for (std::uint64_t k = 0; k < 1000; k++) {
+      if (first.keyAt(k) == again.keyAt(k)) same++;
+      if (first.keyAt(k) != other.keyAt(k)) differ++;
+    }
+    checkPassFail(same, 1000)
+    checkPassFail((differ > 900), true)
+  }
+
+  // Skewed keys repeat the popular ones
+  {
+    RelationSpec spec;
+    spec.pattern = SKEWED_KEYS;
+    spec.high = 1000;
+    spec.records = 20000;
+    generateRelation(spec);
+    std::vector<int> keys;
+    checkPassFail(storedKeys(file1, keys), 0)
+    checkPassFail(keys.size(), (std::size_t)20000)
+    std::vector<int> counts(1000, 0);
+    int outside = 0;
+    for (std::size_t k = 0; k < keys.size(); k++) {
+      if (keys[k] < 0 || keys[k] >= 1000) {
+        outside++;
+      } else {
+        counts[keys[k]]++;
+      }
+    }
+    checkPassFail(outside, 0)
+    const int distinct =
+        (int)(counts.size() - std::count(counts.begin(), counts.end(), 0));
+    const int top = *std::max_element(counts.begin(), counts.end());
+    std::cout << distinct << " distinct keys, the most popular " << top
+              << " times" << std::endl;
+    checkPassFail((distinct < 1000), true)
+    checkPassFail((top > 1000), true)
+    deleteRelation();
+  }
+
+  // Relations of a page per record span several free space map pages, and
+  // a second relation appends to the first
+  {
+    const int count = (int)PageFile::SPACE_MAP_ENTRIES + 500;
+    RelationSpec spec;
+    spec.high = count;
+    spec.makeRecord = [](const int key, std::string &record) {
+      record.assign(5000, 'x');
+      memcpy(&record[0], &key, sizeof(key));
+    };
+    generateRelation(spec);
+    spec.low = count;
+    spec.high = count + 1000;
+    checkPassFail(RelationGenerator(spec, 2).generate(file1), 1000u)
+
+    std::vector<PageId> used;
+    file1->getUsedPages(used);
+    checkPassFail(used.size(), (std::size_t)(count + 1000))
+    int unordered = 0;
+    std::size_t u = 0;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+      if (u >= used.size() || iter.page_number() != used[u] ||
+          (used[u] - 1) % (PageFile::SPACE_MAP_ENTRIES + 1) == 0) {
+        unordered++;
+      }
+      u++;
+    }
+    checkPassFail(unordered, 0)
+    checkPassFail(u, used.size())
+
+    // Pages past a map page read through the buffer pool
+    int wrong = 0;
+    for (int k = count - 10; k < count + 10; k++) {
+      Page *page;
+      bufMgr->readPage(file1, used[k], page);
+      const RecordId rid = {used[k], 1, 0};
+      const std::string record = page->getRecord(rid);
+      if (*reinterpret_cast<const int *>(record.data()) != k) wrong++;
+      bufMgr->unPinPage(file1, used[k], false);
+    }
+    checkPassFail(wrong, 0)
+    checkPassFail(file1->findPageWithSpace(4000), Page::INVALID_NUMBER)
+    deleteRelation();
+  }
+
+  // Records larger than a page fail the whole relation
+  {
+    RelationSpec spec;
+    spec.high = 100;
+    spec.makeRecord = [](const int key, std::string &record) {
+      record.assign(Page::SIZE, 'x');
+    };
+    int failed = 0;
+    try {
+      generateRelation(spec);
+    } catch (const InsufficientSpaceException &e) {
+      failed++;
+    }
+    checkPassFail(failed, 1)
+  }
+}
+
+void traceTests() {
+  // Events recorded directly go into the calling thread's ring, which keeps
+  // the last RING_EVENTS of them
+  Tracer::clear();
+  std::vector<TraceEvent> events;
+  Tracer::snapshot(events);
+  checkPassFail(events.size(), 0u)
+  const std::uint64_t recorded = Tracer::RING_EVENTS + 100;
+  for (std::uint64_t i = 0; i < recorded; i++) {
+    Tracer::record(TRACE_EVICTION, i, 7);
+  }
+  Tracer::snapshot(events);
+  checkPassFail(events.size(), Tracer::RING_EVENTS)
+  checkPassFail(events.front().arg0, 100u)
+  checkPassFail(events.back().arg0, recorded - 1)
+  int outOfOrder = 0;
+  for (std::size_t e = 1; e < events.size(); e++) {
+    if (events[e].nanos < events[e - 1].nanos ||
+        events[e].arg0 != events[e - 1].arg0 + 1 ||
+        events[e].thread != events[0].thread) {
+      outOfOrder++;
+    }
+  }
+  checkPassFail(outOfOrder, 0)
+  const std::uint32_t mainRing = events[0].thread;
+
+  // Other threads record into rings of their own
+  Tracer::clear();
+  std::thread recorder([]() {
+    for (int i = 0; i < 10; i++) Tracer::record(TRACE_PAGE_READ, i, 0);
+  });
+  recorder.join();
+  Tracer::record(TRACE_LEAF_SPLIT, 1, 2);
+  Tracer::snapshot(events);
+  checkPassFail(events.size(), 11u)
+  int otherRing = 0;
+  for (std::size_t e = 0; e < events.size(); e++) {
+    if (events[e].type == TRACE_PAGE_READ && events[e].thread != mainRing) {
+      otherRing++;
+    }
+  }
+  checkPassFail(otherRing, 10)
+  checkPassFail(events.back().type, (std::uint32_t)TRACE_LEAF_SPLIT)
+
+  std::ostringstream chrome;
+  Tracer::writeChromeTrace(chrome, events);
+  const std::string json = chrome.str();
+  checkPassFail(json.compare(0, 16, "{\"traceEvents\":["), 0)
+  int instants = 0;
+  for (std::size_t at = json.find("\"ph\":\"i\""); at != std::string::npos;
+       at = json.find("\"ph\":\"i\"", at + 1)) {
+    instants++;
+  }
+  checkPassFail(instants, 11)
+  checkPassFail((json.find("\"name\":\"leaf_split\"") != std::string::npos),
+                true)
+
+  // An index built one insert at a time in a small pool splits nodes, evicts
+  // pages and reads them back, and writes its file when flushed
+  Tracer::clear();
+  BTreeStats stats;
+  {
+    BufMgr smallBufMgr(30);
+    BTreeIndex index(relationName, intIndexName, &smallBufMgr,
+                     offsetof(tuple, i), INTEGER, false);
+    stats = index.getStats();
+  }
+  File::remove(intIndexName);
+  Tracer::snapshot(events);
+  std::vector<std::uint64_t> counts(NUM_TRACE_EVENTS, 0);
+  for (std::size_t e = 0; e < events.size(); e++) counts[events[e].type]++;
+  std::cout << events.size() << " events: " << counts[TRACE_PAGE_READ]
+            << " page reads, " << counts[TRACE_EVICTION] << " evictions, "
+            << counts[TRACE_BLOB_WRITE] << " index page writes" << std::endl;
+#ifdef BADGERDB_TRACING
+  checkPassFail((events.size() < Tracer::RING_EVENTS), true)
+  checkPassFail(counts[TRACE_LEAF_SPLIT], stats.leafSplits)
+  checkPassFail(counts[TRACE_INTERNAL_SPLIT], stats.internalSplits)
+  checkPassFail(counts[TRACE_ROOT_SPLIT], stats.rootSplits)
+  checkPassFail((counts[TRACE_PAGE_READ] > 0), true)
+  checkPassFail((counts[TRACE_EVICTION] > 0), true)
+  checkPassFail((counts[TRACE_BLOB_WRITE] > 0), true)
+#else
+  // Compiled out
+  checkPassFail(events.size(), 0u)
+  checkPassFail((stats.leafSplits > 0), true)
+#endif
+}
+
+/**
+ * Returns the key of the (i, d) index of the record compositeKeyTests() makes
+ * for key k.
+ */
+CompositeKey tenantKey(BTreeIndex &index, int k) {
+  int i = k % 7 - 3;
+  double d = k * 0.5 - 1000;
+  const void *values[] = {&i, &d};
+  return index.makeKey(values, 2);
+}
+
+void compositeKeyTests() {
+  // Records of seven tenants, -3 to 3, each with its own increasing doubles
+  const int count = 5000;
+  RelationSpec spec;
+  spec.high = count;
+  spec.makeRecord = [](const int key, std::string &record) {
+    RelationGenerator::makeRecord(key, record);
+    RECORD *generated = reinterpret_cast<RECORD *>(&record[0]);
+    generated->i = key % 7 - 3;
+    generated->d = key * 0.5 - 1000;
+  };
+  generateRelation(spec);
+
+  std::vector<KeyColumn> columns(2);
+  columns[0].offset = offsetof(tuple, i);
+  columns[0].type = INTEGER;
+  columns[1].offset = offsetof(tuple, d);
+  columns[1].type = DOUBLE;
+
+  for (int bulk = 0; bulk < 2; bulk++) {
+    std::string indexName;
+    BTreeIndex index(relationName, indexName, bufMgr, columns, bulk == 1);
+    checkPassFail(indexName, relationName + ".0.8")
+    checkPassFail(index.getStats().entries, (std::size_t)count)
+
+    // A prefix scan of a tenant returns its records in the order of d
+    int wrong = 0;
+    IndexCursor cursor;
+    for (int t = -3; t <= 3; t++) {
+      const void *prefix[] = {&t};
+      index.startPrefixScan(cursor, prefix, 1);
+      int k = t + 3;
       try {
-        new_page.insertRecord(new_data);
-        break;
-      } catch (InsufficientSpaceException &e) {
-        file1->writePage(new_page_number, new_page);
-        new_page = file1->allocatePage(new_page_number);
+        while (true) {
+          RecordId rid;
+          CompositeKey key;
+          index.scanNext(cursor, rid, &key);
+          if (k >= count || !(key == tenantKey(index, k))) wrong++;
+          k += 7;
+        }
+      } catch (const IndexScanCompletedException &e) {
+      }
+      if (k < count) wrong++;
+    }
+    checkPassFail(wrong, 0)
+
+    // A range of d within a tenant
+    int t = 2;
+    int expected = 0;
+    for (int k = 1000; k <= 2500; k++) {
+      if (k % 7 - 3 == t) expected++;
+    }
+    CompositeKey low = tenantKey(index, 1000 + (t + 3 - 1000 % 7 + 7) % 7);
+    double highD = 250.0;
+    const void *highValues[] = {&t, &highD};
+    CompositeKey high = index.makeKey(highValues, 2);
+    index.startScan(cursor, &low, GTE, &high, LTE);
+    int found = 0;
+    try {
+      RecordId rid;
+      while (true) {
+        index.scanNext(cursor, rid);
+        found++;
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    checkPassFail(found, expected)
+
+    // A full scan comes out in key order
+    index.startPrefixScan(cursor, NULL, 0);
+    int unordered = 0;
+    found = 0;
+    try {
+      RecordId rid;
+      CompositeKey key, last;
+      while (true) {
+        index.scanNext(cursor, rid, &key);
+        if (found > 0 && key < last) unordered++;
+        last = key;
+        found++;
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    checkPassFail(unordered, 0)
+    checkPassFail(found, count)
+    index.endScan(cursor);
+  }
+
+  {
+    std::string indexName;
+    BTreeIndex index(relationName, indexName, bufMgr, columns);
+
+    // Encodings compare as the values do, negative ones included
+    int a = -1, b = 1, zero = 0;
+    double values[] = {-1.5, -0.5, -0.0, 0.0, 0.5, 1e300};
+    const void *pa[] = {&a};
+    const void *pb[] = {&b};
+    checkPassFail((index.makeKey(pa, 1) < index.makeKey(pb, 1)), true)
+    int unordered = 0;
+    for (int v = 1; v < 6; v++) {
+      const void *before[] = {&zero, &values[v - 1]};
+      const void *after[] = {&zero, &values[v]};
+      const bool equal = values[v - 1] == values[v];
+      if (equal != (index.makeKey(before, 2) == index.makeKey(after, 2)) ||
+          index.makeKey(after, 2) < index.makeKey(before, 2)) {
+        unordered++;
+      }
+    }
+    checkPassFail(unordered, 0)
+
+    // Keys inserted one at a time are found by lookup
+    int tenant = 9;
+    double d = 42.5;
+    const void *inserted[] = {&tenant, &d};
+    CompositeKey key = index.makeKey(inserted, 2);
+    const RecordId newRid = {77, 3, 0};
+    index.insertEntry(&key, newRid);
+    RecordId foundRid;
+    checkPassFail(index.lookup(&key, foundRid), true)
+    checkPassFail(foundRid.page_number, 77u)
+  }
+
+  // An index file opened with other columns, and columns that do not make a
+  // key, are refused
+  int refused = 0;
+  std::vector<KeyColumn> other(columns);
+  other[1].type = INTEGER;
+  std::vector<KeyColumn> one(1, columns[0]);
+  std::vector<KeyColumn> wide(3);
+  for (int c = 0; c < 3; c++) {
+    wide[c].offset = offsetof(tuple, s);
+    wide[c].type = STRING;
+  }
+  std::vector<KeyColumn> *refusedColumns[] = {&other, &one, &wide};
+  for (int r = 0; r < 3; r++) {
+    try {
+      std::string indexName;
+      BTreeIndex index(relationName, indexName, bufMgr, *refusedColumns[r]);
+    } catch (const BadIndexInfoException &e) {
+      refused++;
+    }
+  }
+  File::remove(relationName + ".0.8");
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    int value = 1;
+    const void *values[] = {&value};
+    try {
+      index.makeKey(values, 1);
+    } catch (const BadIndexInfoException &e) {
+      refused++;
+    }
+  }
+  File::remove(intIndexName);
+  checkPassFail(refused, 4)
+}
+
+/**
+ * Returns the number of keys from 0 to count - 1 that index does not find,
+ * or finds the entry of another record for.
+ */
+int hashIndexMisses(HashIndex &index, int count) {
+  int misses = 0;
+  for (int k = 0; k < count; k++) {
+    RecordId found;
+    if (!index.lookup(&k, found)) {
+      misses++;
+      continue;
+    }
+    Page *page;
+    bufMgr->readPage(file1, found.page_number, page);
+    const std::string data = page->getRecord(found);
+    bufMgr->unPinPage(file1, found.page_number, false);
+    if (reinterpret_cast<const RECORD *>(data.data())->i != k) misses++;
+  }
+  return misses;
+}
+
+void hashIndexTests() {
+  // Built from the relation, splitting its single bucket as it fills up
+  std::string indexName;
+  {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                    INTEGER);
+    checkPassFail(indexName, relationName + ".0.hash")
+    const HashIndexStats stats = index.getStats();
+    checkPassFail(stats.entries, (std::size_t)relationSize)
+    checkPassFail((stats.globalDepth > 0), true)
+    checkPassFail(stats.buckets, stats.bucketSplits + 1)
+    checkPassFail(stats.overflowPages, 0u)
+    checkPassFail(hashIndexMisses(index, relationSize), 0)
+    RecordId found;
+    int missing = relationSize;
+    checkPassFail(index.lookup(&missing, found), false)
+    missing = -1;
+    checkPassFail(index.lookup(&missing, found), false)
+  }
+
+  // Reopened from its file, with the directory it was closed with
+  {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                    INTEGER);
+    checkPassFail(index.getStats().bucketSplits, 0u)
+    checkPassFail(hashIndexMisses(index, relationSize), 0)
+
+    // Duplicates of a key outgrow a bucket, and go to overflow pages
+    const int duplicates = 3000;
+    int key = 7;
+    for (int d = 0; d < duplicates; d++) {
+      const RecordId rid = {(PageId)(100000 + d), 1, 0};
+      index.insertEntry(&key, rid);
+    }
+    HashIndexStats stats = index.getStats();
+    checkPassFail((stats.overflowPages > 0), true)
+    checkPassFail((stats.globalDepth <= MAX_GLOBAL_DEPTH), true)
+    std::vector<RecordId> rids;
+    checkPassFail(index.lookupAll(&key, rids), (std::size_t)duplicates + 1)
+
+    // Other keys keep splitting their buckets around them
+    for (int k = relationSize; k < 4 * relationSize; k++) {
+      const RecordId rid = {(PageId)k, 1, 0};
+      index.insertEntry(&k, rid);
+    }
+    stats = index.getStats();
+    checkPassFail(stats.entries,
+                  (std::size_t)(4 * relationSize + duplicates))
+    int misses = 0;
+    for (int k = relationSize; k < 4 * relationSize; k++) {
+      RecordId found;
+      if (!index.lookup(&k, found) || found.page_number != (PageId)k) {
+        misses++;
+      }
+    }
+    checkPassFail(misses, 0)
+    checkPassFail(index.lookupAll(&key, rids), (std::size_t)duplicates + 1)
+
+    // Deleted entries are gone, others with the same key stay
+    const RecordId rid = {100000, 1, 0};
+    checkPassFail(index.deleteEntry(&key, rid), true)
+    checkPassFail(index.deleteEntry(&key, rid), false)
+    checkPassFail(index.lookupAll(&key, rids), (std::size_t)duplicates)
+  }
+  File::remove(indexName);
+
+  // DOUBLE and STRING keys
+  {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, d),
+                    DOUBLE);
+    int misses = 0;
+    for (int k = 0; k < relationSize; k += 7) {
+      double key = k;
+      RecordId found;
+      if (!index.lookup(&key, found)) misses++;
+    }
+    checkPassFail(misses, 0)
+    double negativeZero = -0.0;
+    RecordId found;
+    checkPassFail(index.lookup(&negativeZero, found), true)
+    double half = 0.5;
+    checkPassFail(index.lookup(&half, found), false)
+  }
+  File::remove(indexName);
+  {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, s),
+                    STRING);
+    int misses = 0;
+    for (int k = 0; k < relationSize; k += 7) {
+      char key[64];
+      sprintf(key, "%05d string record", k);
+      RecordId found;
+      if (!index.lookup(key, found)) misses++;
+    }
+    checkPassFail(misses, 0)
+    RecordId found;
+    checkPassFail(index.lookup("zzzzzzzzzz", found), false)
+  }
+  File::remove(indexName);
+
+  // An index file opened as another attribute, and COMPOSITE attributes, are
+  // refused
+  int refused = 0;
+  {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                    INTEGER);
+  }
+  try {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                    DOUBLE);
+  } catch (const BadIndexInfoException &e) {
+    refused++;
+  }
+  try {
+    HashIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                    COMPOSITE);
+  } catch (const BadIndexInfoException &e) {
+    refused++;
+  }
+  checkPassFail(refused, 2)
+  File::remove(relationName + ".0.hash");
+}
+
+/**
+ * Returns the number of keys from low to high - 1 that lookup() finds.
+ */
+int lookupHits(BTreeIndex &index, int low, int high) {
+  int hits = 0;
+  for (int k = low; k < high; k++) {
+    RecordId found;
+    if (index.lookup(&k, found)) hits++;
+  }
+  return hits;
+}
+
+void keyFilterTests() {
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(index.getStats().filterBits, 0u)
+    index.setKeyFilter(2 * relationSize);
+    BTreeStats stats = index.getStats();
+    checkPassFail((stats.filterBits >= (std::size_t)20 * relationSize), true)
+
+    // Every key is found, and most missing keys never reach a leaf
+    checkPassFail(lookupHits(index, 0, relationSize), relationSize)
+    checkPassFail(lookupHits(index, relationSize, 3 * relationSize), 0)
+    stats = index.getStats();
+    std::cout << stats.filterRejects << " of " << 2 * relationSize
+              << " missing keys rejected by the filter" << std::endl;
+    checkPassFail((stats.filterRejects > (std::uint64_t)relationSize * 19 / 10),
+                  true)
+    std::vector<int> keys;
+    for (int k = relationSize - 50; k < relationSize + 50; k++) {
+      keys.push_back(k);
+    }
+    std::vector<RecordId> rids;
+    std::vector<std::size_t> ends;
+    checkPassFail(index.lookupBatch(&keys[0], keys.size(), rids, ends), 50u)
+
+    // Keys inserted one by one, buffered or in a batch are added to it
+    for (int k = 20000; k < 20500; k++) {
+      const RecordId rid = {1, 1, 0};
+      index.insertEntry(&k, rid);
+    }
+    index.setInsertBuffer(100);
+    for (int k = 20500; k < 20550; k++) {
+      const RecordId rid = {1, 1, 0};
+      index.insertEntry(&k, rid);
+    }
+    checkPassFail(lookupHits(index, 20000, 20550), 550)
+    index.setInsertBuffer(0);
+    keys.clear();
+    std::vector<RecordId> batchRids;
+    for (int k = 30000; k < 30100; k++) {
+      keys.push_back(k);
+      const RecordId rid = {1, 1, 0};
+      batchRids.push_back(rid);
+    }
+    index.insertBatch(&keys[0], &batchRids[0], keys.size());
+    checkPassFail(lookupHits(index, 30000, 30100), 100)
+  }
+
+  // The filter is saved with the index and read back when it is reopened,
+  // read-only too
+  std::size_t filterBits;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    filterBits = index.getStats().filterBits;
+    checkPassFail((filterBits > 0), true)
+    checkPassFail(lookupHits(index, 0, relationSize), relationSize)
+    checkPassFail(lookupHits(index, 20000, 20550), 550)
+    checkPassFail(lookupHits(index, 40000, 41000), 0)
+    checkPassFail((index.getStats().filterRejects > 900u), true)
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER, true, DEFAULT_FILL_FACTOR, true);
+    checkPassFail(index.getStats().filterBits, filterBits)
+    checkPassFail(lookupHits(index, 30000, 30100), 100)
+    bool thrown = false;
+    try {
+      index.setKeyFilter(relationSize);
+    } catch (const IndexReadOnlyException &e) {
+      thrown = true;
+    }
+    checkPassFail(thrown, true)
+  }
+
+  // A dropped filter is gone once the index is reopened, and its pages are
+  // reused
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    index.dropKeyFilter();
+    checkPassFail(index.getStats().filterBits, 0u)
+    checkPassFail(lookupHits(index, 0, relationSize), relationSize)
+    checkPassFail(index.getStats().filterRejects, 0u)
+  }
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail(index.getStats().filterBits, 0u)
+    checkPassFail(lookupHits(index, 0, relationSize), relationSize)
+  }
+  File::remove(intIndexName);
+
+  // Keys that compare equal pass the filter alike
+  {
+    BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple, d),
+                     DOUBLE);
+    index.setKeyFilter(relationSize);
+    double negativeZero = -0.0;
+    RecordId found;
+    checkPassFail(index.lookup(&negativeZero, found), true)
+    double half = 0.5;
+    checkPassFail(index.lookup(&half, found), false)
+  }
+  File::remove(doubleIndexName);
+}
+
+/**
+ * Returns the number of entries left in the snapshot scan of cursor, which is
+ * ended, or -1 if they are out of order or one has the rid added.
+ */
+int drainSnapshot(BTreeIndex &index, SnapshotCursor &cursor,
+                  const RecordId &added) {
+  int found = 0;
+  int last = INT_MIN;
+  bool valid = true;
+  try {
+    while (true) {
+      RecordId rid;
+      int key;
+      index.scanNext(cursor, rid, &key);
+      if (key < last || rid == added) valid = false;
+      last = key;
+      found++;
+    }
+  } catch (const IndexScanCompletedException &e) {
+  }
+  index.endScan(cursor);
+  return valid ? found : -1;
+}
+
+void snapshotTests() {
+  const RecordId added = {60000, 1, 0};
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    std::vector<RecordId> rids(relationSize);
+    for (int k = 0; k < relationSize; k++) index.lookup(&k, rids[k]);
+
+    // Inserts split the leaves and deletes empty some of them under an open
+    // snapshot, which still returns every entry it started with
+    SnapshotCursor cursor;
+    int low = 0;
+    index.startSnapshotScan(cursor, &low, GTE, NULL, LTE);
+    RecordId rid;
+    int key;
+    index.scanNext(cursor, rid, &key);
+    checkPassFail(key, 0)
+    for (int k = 1000; k < 2000; k++) index.deleteEntry(&k, rids[k]);
+    index.compact();
+    for (int k = 0; k < relationSize; k++) index.insertEntry(&k, added);
+    BTreeStats stats = index.getStats();
+    checkPassFail(stats.openSnapshots, 1u)
+    checkPassFail((stats.snapshotImages > 0), true)
+    int found = drainSnapshot(index, cursor, added);
+    checkPassFail(found, relationSize - 1)
+    stats = index.getStats();
+    checkPassFail(stats.openSnapshots, 0u)
+    checkPassFail(stats.snapshotImages, 0u)
+
+    // A snapshot started afterwards sees the changes
+    index.startSnapshotScan(cursor, NULL, GT, NULL, LT);
+    RecordId none = {0, 0, 0};
+    found = drainSnapshot(index, cursor, none);
+    checkPassFail(found, 2 * relationSize - 1000)
+    int high = 1500;
+    low = 500;
+    index.startSnapshotScan(cursor, &low, GT, &high, LT);
+    found = drainSnapshot(index, cursor, none);
+    checkPassFail(found, 2 * 999 - 500)
+
+    // Snapshots of different epochs each see their own version of a leaf
+    SnapshotCursor first;
+    SnapshotCursor second;
+    low = 3000;
+    high = 3009;
+    index.startSnapshotScan(first, &low, GTE, &high, LTE);
+    for (int k = 3000; k < 3005; k++) index.deleteEntry(&k, rids[k]);
+    index.startSnapshotScan(second, &low, GTE, &high, LTE);
+    for (int k = 3005; k < 3010; k++) index.deleteEntry(&k, rids[k]);
+    found = drainSnapshot(index, second, none);
+    checkPassFail(found, 15)
+    checkPassFail((index.getStats().snapshotImages > 0), true)
+    found = drainSnapshot(index, first, none);
+    checkPassFail(found, 20)
+    checkPassFail(index.getStats().snapshotImages, 0u)
+
+    // Bad arguments and ranges without a key in the snapshot are refused
+    low = 1200;
+    high = 1300;
+    int thrown = 0;
+    try {
+      index.startSnapshotScan(cursor, &high, GTE, &low, LT);
+    } catch (const BadScanrangeException &e) {
+      thrown++;
+    }
+    try {
+      index.startSnapshotScan(cursor, &low, LT, &high, LT);
+    } catch (const BadOpcodesException &e) {
+      thrown++;
+    }
+    try {
+      index.scanNext(cursor, rid);
+    } catch (const ScanNotInitializedException &e) {
+      thrown++;
+    }
+    low = 2 * relationSize;
+    try {
+      index.startSnapshotScan(cursor, &low, GTE, NULL, LT);
+    } catch (const NoSuchKeyFoundException &e) {
+      thrown++;
+    }
+    checkPassFail(thrown, 4)
+    checkPassFail(index.getStats().openSnapshots, 0u)
+  }
+  File::remove(intIndexName);
+
+  // A scan running beside a writer returns exactly the entries of its
+  // snapshot
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    SnapshotCursor cursor;
+    index.startSnapshotScan(cursor, NULL, GTE, NULL, LTE);
+    std::thread writer([&index, &added]() {
+      for (int k = relationSize - 1; k >= 0; k--) index.insertEntry(&k, added);
+    });
+    const int found = drainSnapshot(index, cursor, added);
+    writer.join();
+    checkPassFail(found, relationSize)
+    checkPassFail(index.getStats().entries, 2u * relationSize)
+  }
+  File::remove(intIndexName);
+}
+
+void partitionedIndexTests() {
+  const std::string directory = relationName + "_parts";
+  mkdir(directory.c_str(), 0755);
+  std::vector<std::string> directories;
+  directories.push_back(".");
+  directories.push_back(directory);
+  std::string indexName;
+  {
+    PartitionedIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                           INTEGER, 4, directories);
+    checkPassFail(indexName, relationName + ".0.parts")
+    checkPassFail(index.numPartitions(), 4)
+    checkPassFail(index.partitionFile(0), "./" + relationName + ".0.p0")
+    checkPassFail(index.partitionFile(3),
+                  directory + "/" + relationName + ".0.p3")
+
+    // The keys are spread evenly over the partitions
+    for (int p = 0; p < index.numPartitions(); p++) {
+      checkPassFail(index.partitionStats(p).entries,
+                    (std::size_t)relationSize / 4)
+    }
+
+    // A scan goes through the partitions in key order
+    int scanned = 0;
+    int outOfOrder = 0;
+    index.startScan(NULL, GTE, NULL, LTE);
+    try {
+      while (true) {
+        RecordId rid;
+        int key;
+        index.scanNext(rid, &key);
+        if (key != scanned) outOfOrder++;
+        scanned++;
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    checkPassFail(scanned, relationSize)
+    checkPassFail(outOfOrder, 0)
+
+    // Ranges that start and end inside partitions, or on their bounds
+    int low = relationSize / 4 - 10;
+    int high = 3 * relationSize / 4;
+    index.startScan(&low, GT, &high, LT);
+    scanned = 0;
+    try {
+      while (true) {
+        RecordId rid;
+        index.scanNext(rid);
+        scanned++;
       }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    checkPassFail(scanned, high - low - 1)
+    low = relationSize / 2;
+    high = relationSize / 2;
+    index.startScan(&low, GTE, &high, LTE);
+    RecordId rid;
+    int key;
+    index.scanNext(rid, &key);
+    checkPassFail(key, relationSize / 2)
+    try {
+      index.scanNext(rid);
+      std::cout << "IndexScanCompletedException Test Failed." << std::endl;
+      checkPassFail(true, false)
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    low = relationSize;
+    try {
+      index.startScan(&low, GTE, NULL, LTE);
+      checkPassFail(true, false)
+    } catch (const NoSuchKeyFoundException &e) {
+    }
+    try {
+      index.scanNext(rid);
+      checkPassFail(true, false)
+    } catch (const ScanNotInitializedException &e) {
+    }
+    low = 10;
+    high = 5;
+    try {
+      index.startScan(&low, GTE, &high, LTE);
+      checkPassFail(true, false)
+    } catch (const BadScanrangeException &e) {
     }
-  }
 
-  file1->writePage(new_page_number, new_page);
-}
+    // Threads insert into the partitions of their keys at once
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.push_back(std::thread([&index, t]() {
+        for (int k = 0; k < relationSize; k += 4) {
+          const int newKey = t * relationSize / 4 + k / 4;
+          const RecordId newRid = {60000, (SlotId)t, 0};
+          index.insertEntry(&newKey, newRid);
+        }
+      }));
+    }
+    for (std::size_t t = 0; t < threads.size(); t++) threads[t].join();
+    for (int p = 0; p < index.numPartitions(); p++) {
+      checkPassFail(index.partitionStats(p).entries,
+                    (std::size_t)relationSize / 2)
+    }
+    key = 7;
+    const RecordId added = {60000, 0, 0};
+    checkPassFail(index.deleteEntry(&key, added), true)
+    checkPassFail(index.deleteEntry(&key, added), false)
+    checkPassFail(index.lookup(&key, rid), true)
+  }
 
-// -----------------------------------------------------------------------------
-// indexTests
-// -----------------------------------------------------------------------------
+  // Reopened with the partitions and split keys it was built with
+  {
+    PartitionedIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                           INTEGER, 2);
+    checkPassFail(index.numPartitions(), 4)
+    int misses = 0;
+    for (int k = 0; k < relationSize; k++) {
+      RecordId found;
+      if (!index.lookup(&k, found)) misses++;
+    }
+    checkPassFail(misses, 0)
+    checkPassFail(index.partitionStats(0).entries,
+                  (std::size_t)relationSize / 2 - 1)
+  }
+  try {
+    PartitionedIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                           DOUBLE);
+    checkPassFail(true, false)
+  } catch (const BadIndexInfoException &e) {
+  }
+  File::remove(indexName);
+  for (int p = 0; p < 4; p++) {
+    std::ostringstream partitionName;
+    partitionName << directories[p % 2] << "/" << relationName << ".0.p" << p;
+    File::remove(partitionName.str());
+  }
 
-void indexTests() {
-  intTests();
+  // STRING keys
+  {
+    PartitionedIndex index(relationName, indexName, bufMgr, offsetof(tuple, s),
+                           STRING, 3);
+    char low[] = "01000";
+    char high[] = "02000";
+    index.startScan(low, GTE, high, LT);
+    int scanned = 0;
+    try {
+      while (true) {
+        RecordId rid;
+        index.scanNext(rid);
+        scanned++;
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    checkPassFail(scanned, 1000)
+  }
+  File::remove(indexName);
+  for (int p = 0; p < 3; p++) {
+    std::ostringstream partitionName;
+    partitionName << relationName << "." << offsetof(tuple, s) << ".p" << p;
+    File::remove(partitionName.str());
+  }
   try {
-    File::remove(intIndexName);
-  } catch (const FileNotFoundException &e) {
+    PartitionedIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                           INTEGER, MAX_PARTITIONS + 1);
+    checkPassFail(true, false)
+  } catch (const BadIndexInfoException &e) {
+  }
+  try {
+    PartitionedIndex index(relationName, indexName, bufMgr, 0, COMPOSITE);
+    checkPassFail(true, false)
+  } catch (const BadIndexInfoException &e) {
   }
+  rmdir(directory.c_str());
 }
 
-// -----------------------------------------------------------------------------
-// intTests
-// -----------------------------------------------------------------------------
+/**
+ * Counts the pairs that do not join a record of the relation with itself.
+ * Pairs with an entry added to the index, on page 60000, are counted in
+ * addedPairs instead.
+ */
+int joinMismatches(const std::vector<JoinPair> &pairs, int &addedPairs) {
+  int mismatches = 0;
+  addedPairs = 0;
+  for (std::size_t p = 0; p < pairs.size(); p++) {
+    if (pairs[p].outer.page_number == 60000 ||
+        pairs[p].inner.page_number == 60000) {
+      addedPairs++;
+    } else if (!(pairs[p].outer == pairs[p].inner)) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
 
-void intTests() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
+void joinTests() {
+  std::string doubleName;
+  {
+    BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+    // A key with several entries in the index
+    int key = 7;
+    const RecordId added = {60000, 1, 0};
+    index.insertEntry(&key, added);
 
-  // run some tests
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-  checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
-  checkPassFail(intScan(&index, 996, GT, 1001, LT), 4)
-  checkPassFail(intScan(&index, 0, GT, 1, LT), 0) 
-  checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
-  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 1000)
+    // Batches of outer records smaller than the relation, and fewer pairs
+    // fetched at a time than a key has
+    const std::size_t batchSizes[] = {JOIN_BATCH_SIZE, 100};
+    for (int b = 0; b < 2; b++) {
+      IndexNestedLoopJoin join(relationName, offsetof(tuple, i), &index,
+                               bufMgr, batchSizes[b]);
+      std::vector<JoinPair> pairs;
+      JoinPair batch[7];
+      std::size_t fetched;
+      do {
+        fetched = join.next(batch, 7);
+        pairs.insert(pairs.end(), batch, batch + fetched);
+      } while (fetched == 7);
+      int addedPairs;
+      checkPassFail(pairs.size(), (std::size_t)relationSize + 1)
+      checkPassFail(joinMismatches(pairs, addedPairs), 0)
+      checkPassFail(addedPairs, 1)
+      fetched = join.next(batch, 7);
+      checkPassFail(fetched, 0u)
+    }
+
+    // Two more entries of the key make three on each side of a self join
+    const RecordId more = {60000, 2, 0};
+    index.insertEntry(&key, more);
+    {
+      MergeJoin join(&index, &index, 10);
+      std::vector<JoinPair> pairs(2 * relationSize);
+      std::size_t fetched = join.next(pairs.data(), 5);
+      std::size_t total = fetched;
+      while (fetched == 5) {
+        fetched = join.next(pairs.data() + total, 5);
+        total += fetched;
+      }
+      pairs.resize(total);
+      int addedPairs;
+      checkPassFail(total, (std::size_t)relationSize - 1 + 9)
+      checkPassFail(joinMismatches(pairs, addedPairs), 0)
+      checkPassFail(addedPairs, 9 - 1)
+    }
+
+    // DOUBLE keys, which do not join with INTEGER ones
+    BTreeIndex doubleIndex(relationName, doubleName, bufMgr,
+                           offsetof(tuple, d), DOUBLE);
+    {
+      MergeJoin join(&doubleIndex, &doubleIndex, 64);
+      std::vector<JoinPair> pairs(relationSize + 1);
+      const std::size_t fetched = join.next(pairs.data(), pairs.size());
+      checkPassFail(fetched, (std::size_t)relationSize)
+    }
+    try {
+      MergeJoin join(&index, &doubleIndex);
+      checkPassFail(true, false)
+    } catch (const BadIndexInfoException &e) {
+    }
+    try {
+      IndexNestedLoopJoin join(relationName, offsetof(tuple, i), &index,
+                               bufMgr, 0);
+      checkPassFail(true, false)
+    } catch (const BadIndexInfoException &e) {
+    }
+  }
+  File::remove(intIndexName);
+  File::remove(doubleName);
 }
-// test for empty tree
-void testEmpty() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
 
-  // run some tests
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 0)
-  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 0)
-  checkPassFail(intScan(&index, -3, GT, 3, LT), 0)
-  checkPassFail(intScan(&index, 996, GT, 1001, LT), 0)
-  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-  checkPassFail(intScan(&index, 300, GT, 400, LT), 0)
-  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+/**
+ * Waits for the reads of the read-ahead threads of pool to stop, and returns
+ * the number of pages it read from disk.
+ */
+int settledReads(BufMgr &pool) {
+  int reads = -1;
+  for (int wait = 0; wait < 250; wait++) {
+    const int now = pool.getBufStats().diskreads.load();
+    if (now == reads) break;
+    reads = now;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return reads;
 }
 
-// test for one leaf
-void intTestsOneLeaf() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
+/**
+ * Counts the pages of a file listed in a warm-up file.
+ */
+int listedPages(const std::string &warmupName, const std::string &fileName) {
+  std::ifstream in(warmupName.c_str());
+  int pages = 0;
+  PageId pageNo;
+  std::string name;
+  while (in >> pageNo) {
+    in.get();
+    std::getline(in, name);
+    if (name == fileName) pages++;
+  }
+  return pages;
+}
 
-  // run some tests
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-  checkPassFail(intScan(&index, -3, GT, 3, LT), 3)
-  checkPassFail(intScan(&index, 996, GT, 1001, LT), 0)
-  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-  checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
-  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+void warmupTests() {
+  const std::string warmupName = relationName + ".warm";
+  std::remove(warmupName.c_str());
+  std::string indexName;
+  {
+    BTreeIndex index(relationName, indexName, bufMgr, offsetof(tuple, i),
+                     INTEGER);
+  }
+
+  // A pool saves the nodes the lookups went through
+  {
+    BufMgr pool(64);
+    pool.setWarmupFile(warmupName, 0);
+    checkPassFail(pool.saveResidentPages(warmupName), false)
+    BTreeIndex index(relationName, indexName, &pool, offsetof(tuple, i),
+                     INTEGER);
+    for (int k = 0; k < relationSize; k += 500) {
+      RecordId rid;
+      index.lookup(&k, rid);
+    }
+    checkPassFail(pool.saveResidentPages(warmupName), true)
+  }
+  const int listed = listedPages(warmupName, indexName);
+  checkPassFail((listed > 1 && listed <= 64), true)
+
+  // Without the list the lookups read their nodes again
+  {
+    BufMgr pool(64);
+    BTreeIndex index(relationName, indexName, &pool, offsetof(tuple, i),
+                     INTEGER);
+    settledReads(pool);
+    pool.clearBufStats();
+    for (int k = 0; k < relationSize; k += 500) {
+      RecordId rid;
+      index.lookup(&k, rid);
+    }
+    checkPassFail((pool.getBufStats().diskreads.load() > 0), true)
+  }
+
+  // With it, opening the index reads them back in the background
+  {
+    BufMgr pool(64);
+    pool.setWarmupFile(warmupName, 0);
+    BTreeIndex index(relationName, indexName, &pool, offsetof(tuple, i),
+                     INTEGER);
+    checkPassFail((settledReads(pool) >= listed), true)
+    pool.clearBufStats();
+    for (int k = 0; k < relationSize; k += 500) {
+      RecordId rid;
+      index.lookup(&k, rid);
+    }
+    checkPassFail(pool.getBufStats().diskreads.load(), 0)
+
+    // The background writer saves the pages on its own once set to
+    std::remove(warmupName.c_str());
+    pool.setWarmupFile(warmupName, 10);
+    for (int wait = 0; wait < 500; wait++) {
+      if (listedPages(warmupName, indexName) > 0) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    checkPassFail((listedPages(warmupName, indexName) > 0), true)
+    pool.setWarmupFile("", 0);
+    checkPassFail(pool.warmUp(NULL), 0u)
+  }
+  std::remove(warmupName.c_str());
+  File::remove(indexName);
 }
 
-// test for negative value
-void testNegative() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
+/**
+ * Returns true if an estimate is within slack of the actual value.
+ */
+bool nearlyEqual(int estimate, int actual, int slack) {
+  return std::abs(estimate - actual) <= slack;
+}
 
-  // run some tests
-  checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
-  checkPassFail(intScan(&index, 20, GTE, 35, LTE), 16)
-  checkPassFail(intScan(&index, -3, GT, 3, LT), 5)
-  checkPassFail(intScan(&index, -1000, GT, 1000, LT), 1999)
-  checkPassFail(intScan(&index, 0, GT, 1, LT), 0)
-  checkPassFail(intScan(&index, 300, GT, 400, LT), 99)
-  checkPassFail(intScan(&index, 3000, GTE, 4000, LT), 0)
+/**
+ * Returns true if an estimate from the counts of non-leaf nodes is as close to
+ * the actual value as they allow. The counts are set again once more than one
+ * in STALE_COUNT_DIVISOR of the entries changed, so they are off by at most
+ * that share.
+ */
+bool withinEstimate(int estimate, int actual) {
+  return nearlyEqual(estimate, actual, actual / STALE_COUNT_DIVISOR + 16);
 }
 
-void testOutOfBounds() {
-  std::cout << "Create a B+ Tree index on the integer field" << std::endl;
-  BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
-                   INTEGER);
+/**
+ * Runs a scan of [lowVal, highVal) that returns keys along with the entries,
+ * batchSize at a time, or one by one if batchSize is 0. Returns the number of
+ * entries found, or -1 if a key is not the one of its record or the keys are
+ * out of order.
+ */
+int keyedScan(BTreeIndex *index, int lowVal, int highVal, bool descending,
+              std::size_t batchSize) {
+  IndexCursor cursor;
+  index->startScan(cursor, &lowVal, GTE, &highVal, LT, descending);
+  std::vector<RecordId> rids;
+  std::vector<int> keys;
+  if (batchSize == 0) {
+    try {
+      RecordId rid;
+      int key;
+      while (true) {
+        index->scanNext(cursor, rid, &key);
+        rids.push_back(rid);
+        keys.push_back(key);
+      }
+    } catch (const IndexScanCompletedException &e) {
+    }
+  } else {
+    std::vector<RecordId> ridBatch(batchSize);
+    std::vector<int> keyBatch(batchSize);
+    std::size_t got;
+    while ((got = index->scanNextBatch(cursor, &ridBatch[0], &keyBatch[0],
+                                       batchSize)) > 0) {
+      rids.insert(rids.end(), ridBatch.begin(), ridBatch.begin() + got);
+      keys.insert(keys.end(), keyBatch.begin(), keyBatch.begin() + got);
+    }
+  }
+  index->endScan(cursor);
 
-  checkPassFail(intScan(&index, 4000, GTE, 6000, LT), 1000);
-  checkPassFail(intScan(&index, 4999, GTE, 5000, LT), 1);
+  for (std::size_t j = 0; j < rids.size(); j++) {
+    Page *page;
+    bufMgr->readPage(file1, rids[j].page_number, page);
+    const std::string data = page->getRecord(rids[j]);
+    bufMgr->unPinPage(file1, rids[j].page_number, false);
+    if (reinterpret_cast<const RECORD *>(data.data())->i != keys[j]) return -1;
+    if (j > 0 && (descending ? keys[j] > keys[j - 1] : keys[j] < keys[j - 1])) {
+      return -1;
+    }
+  }
+  return (int)rids.size();
+}
 
-  checkPassFail(intScan(&index, -20000, GTE, 7099, LT), 5000);
-  checkPassFail(intScan(&index, 4800, GTE, 5050, LTE), 200);
+void hashTableTests() {
+  // A second File object for the same relation is a different key in the table,
+  // though it shares the file's id. Ids of closed files are handed out again.
+  PageFile other = PageFile::open(relationName);
+  checkPassFail(other.id(), file1->id())
+  FileId closedId;
+  {
+    PageFile scratch = PageFile::create("hashTableScratch");
+    closedId = scratch.id();
+    checkPassFail((closedId != file1->id()), true)
+  }
+  {
+    PageFile scratch = PageFile::open("hashTableScratch");
+    checkPassFail(scratch.id(), closedId)
+  }
+  File::remove("hashTableScratch");
+  checkPassFail(File::exists("hashTableScratch"), false)
+  BufHashTbl table(8);
 
-  checkPassFail(intScan(&index, 5500, GTE, 6000, LT), 0);
-  checkPassFail(intScan(&index, 4999, GT, 6000, LT), 0);
-  checkPassFail(intScan(&index, -2000, GT, 0, LT), 0);
+  for (int i = 0; i < hashTestPages; i++) {
+    table.insert(file1, i, 2 * i);
+    table.insert(&other, i, 2 * i + 1);
+  }
+  checkPassFail(hashTableMismatches(table, file1, &other, hashTestPages), 0)
 
-  checkPassFail(intScan(&index, -2000, GT, 0, LTE), 1);
-  checkPassFail(intScan(&index, -2000, GT, 5, LTE), 6);
-  checkPassFail(intScan(&index, -2000, GT, 200, LT), 200);
+  int duplicates = 0;
+  try {
+    table.insert(file1, hashTestPages / 2, 0);
+  } catch (const HashAlreadyPresentException &e) {
+    duplicates++;
+  }
+  checkPassFail(duplicates, 1)
+
+  // Removing every other page leaves holes in the middle of probe runs
+  for (int i = 0; i < hashTestPages; i += 2) {
+    table.remove(file1, i);
+    table.remove(&other, i);
+  }
+  for (int i = 0; i < hashTestPages; i += 2) {
+    table.insert(file1, i, 2 * i);
+    table.insert(&other, i, 2 * i + 1);
+  }
+  checkPassFail(hashTableMismatches(table, file1, &other, hashTestPages), 0)
+
+  for (int i = 0; i < hashTestPages; i++) table.remove(&other, i);
+  int missing = 0;
+  for (int i = 0; i < hashTestPages; i++) {
+    FrameId frameNo;
+    try {
+      table.lookup(&other, i, frameNo);
+    } catch (const HashNotFoundException &e) {
+      missing++;
+    }
+    if (!table.tryLookup(&other, i, frameNo)) missing++;
+    if (!table.tryLookup(file1, i, frameNo) || frameNo != (FrameId)(2 * i)) {
+      missing = -2 * hashTestPages;
+    }
+  }
+  checkPassFail(missing, 2 * hashTestPages)
+}
+
+/**
+ * Looks up pages 0 to numPages - 1 of both files, which are expected to be in
+ * frames 2 * pageNo and 2 * pageNo + 1 respectively.
+ *
+ * @return the number of pages not found in their frame
+ */
+int hashTableMismatches(BufHashTbl &table, File *file, File *other,
+                        int numPages) {
+  int mismatches = 0;
+  for (int i = 0; i < numPages; i++) {
+    FrameId frameNo, otherFrameNo;
+    try {
+      table.lookup(file, i, frameNo);
+      table.lookup(other, i, otherFrameNo);
+    } catch (const HashNotFoundException &e) {
+      mismatches++;
+      continue;
+    }
+    if (frameNo != (FrameId)(2 * i) || otherFrameNo != (FrameId)(2 * i + 1)) {
+      mismatches++;
+    }
+  }
+  return mismatches;
 }
 
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
             Operator highOp) {
-  RecordId scanRid;
-  Page *curPage;
+  std::cout << "Scan for ";
+  if (lowOp == GT) {
+    std::cout << "(";
+  } else {
+    std::cout << "[";
+  }
+
+  std::cout << lowVal << "," << highVal;
+
+  if (highOp == LT) {
+    std::cout << ")";
+  } else {
+    std::cout << "]";
+  }
+
+  std::cout << std::endl;
 
+  return scanResults(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp,
+               double highVal, Operator highOp) {
   std::cout << "Scan for ";
   if (lowOp == GT) {
     std::cout << "(";
@@ -597,10 +6461,48 @@ int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
 
   std::cout << std::endl;
 
+  return scanResults(index, &lowVal, lowOp, &highVal, highOp);
+}
+
+int stringScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal,
+               Operator highOp) {
+  char lowValStr[100];
+  sprintf(lowValStr, "%05d string record", lowVal);
+  char highValStr[100];
+  sprintf(highValStr, "%05d string record", highVal);
+
+  std::cout << "Scan for ";
+  if (lowOp == GT) {
+    std::cout << "(";
+  } else {
+    std::cout << "[";
+  }
+
+  std::cout << lowValStr << "," << highValStr;
+
+  if (highOp == LT) {
+    std::cout << ")";
+  } else {
+    std::cout << "]";
+  }
+
+  std::cout << std::endl;
+
+  return scanResults(index, lowValStr, lowOp, highValStr, highOp);
+}
+
+/**
+ * Runs a scan whose bounds point to keys of the index's type, printing the
+ * first few matching records, and returns the number of matches.
+ */
+int scanResults(BTreeIndex *index, void *lowVal, Operator lowOp,
+                void *highVal, Operator highOp) {
+  RecordId scanRid;
+  Page *curPage;
   int numResults = 0;
 
   try {
-    index->startScan(&lowVal, lowOp, &highVal, highOp);
+    index->startScan(lowVal, lowOp, highVal, highOp);
   } catch (const NoSuchKeyFoundException &e) {
     std::cout << "No Key Found satisfying the scan criteria." << std::endl;
     return 0;
@@ -658,29 +6560,20 @@ void errorTests() {
 
     // initialize all of record1.s to keep purify happy
     memset(record1.s, ' ', sizeof(record1.s));
-    PageId new_page_number;
-    Page new_page = file1->allocatePage(new_page_number);
+    {
+      RelationWriter writer(file1, bufMgr);
 
-    // Insert a bunch of tuples into the relation.
-    for (int i = 0; i < 10; i++) {
-      sprintf(record1.s, "%05d string record", i);
-      record1.i = i;
-      record1.d = (double)i;
-      std::string new_data(reinterpret_cast<char *>(&record1), sizeof(record1));
-
-      while (1) {
-        try {
-          new_page.insertRecord(new_data);
-          break;
-        } catch (const InsufficientSpaceException &e) {
-          file1->writePage(new_page_number, new_page);
-          new_page = file1->allocatePage(new_page_number);
-        }
+      // Insert a bunch of tuples into the relation.
+      for (int i = 0; i < 10; i++) {
+        sprintf(record1.s, "%05d string record", i);
+        record1.i = i;
+        record1.d = (double)i;
+        std::string new_data(reinterpret_cast<char *>(&record1),
+                             sizeof(record1));
+        writer.insertRecord(new_data);
       }
     }
 
-    file1->writePage(new_page_number, new_page);
-
     BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i),
                      INTEGER);
 
@@ -732,6 +6625,31 @@ void errorTests() {
     deleteRelation();
   }
 
+  {
+    // A page whose bytes are not all on disk must not read as a free page
+    PageId pageNo;
+    {
+      PageFile file = PageFile::create(relationName);
+      file.allocatePage(pageNo);
+      file.allocatePage(pageNo);
+    }
+    struct stat status;
+    stat(relationName.c_str(), &status);
+    const int cut =
+        truncate(relationName.c_str(), status.st_size - Page::SIZE / 2);
+    checkPassFail(cut, 0)
+
+    std::cout << "Read a page cut short on disk" << std::endl;
+    try {
+      PageFile file = PageFile::open(relationName);
+      file.readPage(pageNo);
+      std::cout << "IoErrorException Test 1 Failed." << std::endl;
+    } catch (const IoErrorException &e) {
+      std::cout << "IoErrorException Test 1 Passed." << std::endl;
+    }
+    File::remove(relationName);
+  }
+
   try {
     File::remove(intIndexName);
   } catch (const FileNotFoundException &e) {
@@ -10,6 +10,7 @@
  *     <li> @ref prereq_sec
  *     <li> @ref commands_sec
  *     <li> @ref modify_run_main_sec
+ *     <li> @ref bench_sec
  *     <li> @ref documentation_sec
  *   </ol>
  *   <li> @ref api_sec
@@ -68,6 +69,36 @@
  * If you want to edit what <code>badgerdb_main</code> does, edit
  * <code>src/main.cpp</code>.
  *
+ * @subsection bench_sec Running the benchmarks
+ *
+ * The microbenchmarks of the index, the buffer manager and the file layer
+ * need Google Benchmark. To build and run them:
+ * @code
+ *   $ make bench
+ *   $ cd src && ./badgerdb_bench --pool_frames=10000 --max_size=100000000
+ * @endcode
+ * Index and relation sizes go by powers of ten from
+ * <code>--min_size</code> to <code>--max_size</code> (10^4 to 10^6 by
+ * default), and the buffer pool has <code>--pool_frames</code> frames.
+ * Google Benchmark's own flags, such as <code>--benchmark_filter</code>,
+ * work as well.
+ *
+ * The YCSB driver loads a relation and an index on it, then runs one of the
+ * core workloads A to F from several client threads and reports the
+ * throughput and the 50th, 99th and 99.9th percentile latency of each kind
+ * of operation:
+ * @code
+ *   $ make ycsb
+ *   $ cd src && ./badgerdb_ycsb --workload=a --records=1000000 --threads=8
+ * @endcode
+ * Keys are chosen with each workload's distribution unless
+ * <code>--distribution</code> gives one of uniform, zipfian and latest.
+ *
+ * Built with <code>make clean && make TRACE=1 ycsb</code>, the library records
+ * page reads, evictions, index page writes and node splits into per-thread
+ * ring buffers, and <code>--trace=FILE</code> writes the events of the run in
+ * the Chrome trace format. Without TRACE=1 the tracepoints are compiled out.
+ *
  * @subsection documentation_sec Rebuilding the documentation
  *
  * Documentation is generated by using Doxygen.  If you have updated the
@@ -8,8 +8,10 @@
 
 #include "page.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <vector>
 
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
@@ -29,6 +31,9 @@ void Page::initialize() {
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.num_fragmented_bytes = 0;
+  header_.reserved = 0;
+  header_.checksum = 0;
   // data_.assign(DATA_SIZE, char());
   memset(data_, '\0', DATA_SIZE);
 }
@@ -38,18 +43,31 @@ RecordId Page::insertRecord(const std::string& record_data) {
     throw InsufficientSpaceException(page_number(), record_data.length(),
                                      getFreeSpace());
   }
+  // A new slot needs room in the free space too
+  std::size_t record_size = record_data.length();
+  if (header_.num_free_slots == 0) {
+    record_size += sizeof(PageSlot);
+  }
+  if (record_size > getContiguousFreeSpace()) {
+    compact();
+  }
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  std::size_t length;
+  const char* data = getRecordData(record_id, length);
+  return std::string(data, length);
+}
+
+const char* Page::getRecordData(const RecordId& record_id,
+                                std::size_t& length) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-  std::string retStr =
-      std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
-
-  return retStr;
+  length = slot.item_length;
+  return data_ + slot.item_offset;
 }
 
 void Page::updateRecord(const RecordId& record_id,
@@ -84,32 +102,13 @@ void Page::deleteRecord(const RecordId& record_id,
   // data_.replace(slot->item_offset, slot->item_length, slot->item_length,
   // '\0');
 
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset;
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
-  }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move =
-        std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-    for (std::uint16_t i = 0; i < move_bytes; i++)
-      data_[i + move_offset + slot->item_length] = data_to_move[i];
-
-    // data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+  // Only the record next to the free space can be given back right away. Any
+  // other leaves a hole, which is closed once an insert needs the space.
+  if (slot->item_offset == header_.free_space_upper_bound) {
+    header_.free_space_upper_bound += slot->item_length;
+  } else {
+    header_.num_fragmented_bytes += slot->item_length;
   }
-  header_.free_space_upper_bound += slot->item_length;
 
   // Mark slot as unused.
   slot->used = false;
@@ -136,6 +135,42 @@ void Page::deleteRecord(const RecordId& record_id,
     header_.num_free_slots -= num_slots_to_delete;
     header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
   }
+
+  if (header_.num_slots == header_.num_free_slots) {
+    // No records left, so there are no holes between them either
+    header_.free_space_upper_bound = DATA_SIZE;
+    header_.num_fragmented_bytes = 0;
+  }
+}
+
+void Page::compact() {
+  if (header_.num_fragmented_bytes == 0) return;
+
+  // Records are moved towards the end of the data area, the one nearest to it
+  // first, so none is overwritten before it has been moved
+  std::vector<SlotId> slots;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    if (getSlot(i)->used) slots.push_back(i);
+  }
+  std::sort(slots.begin(), slots.end(), [this](SlotId a, SlotId b) {
+    return getSlot(a)->item_offset > getSlot(b)->item_offset;
+  });
+
+  std::uint16_t end = DATA_SIZE;
+  for (std::size_t i = 0; i < slots.size(); ++i) {
+    PageSlot* slot = getSlot(slots[i]);
+    end -= slot->item_length;
+    if (slot->item_offset != end) {
+      memmove(&data_[end], &data_[slot->item_offset], slot->item_length);
+      slot->item_offset = end;
+    }
+  }
+
+  // Old copies of moved records are now part of the free space
+  memset(&data_[header_.free_space_upper_bound], '\0',
+         end - header_.free_space_upper_bound);
+  header_.free_space_upper_bound = end;
+  header_.num_fragmented_bytes = 0;
 }
 
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
@@ -190,6 +225,9 @@ void Page::insertRecordInSlot(const SlotId slot_number,
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
+  if (record_length > getContiguousFreeSpace()) {
+    compact();
+  }
   slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
@@ -34,7 +34,8 @@ struct PageHeader {
 
   /**
    * Upper bound of the free space.  This is the offset of the last unused byte
-   * before the first data record.
+   * before the first data record.  Records above it may have holes between
+   * them, left by deleted records.
    */
   std::uint16_t free_space_upper_bound;
 
@@ -60,6 +61,25 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of bytes in holes between records above the free space upper
+   * bound.  They are reclaimed by compacting the page once an insert needs
+   * them.
+   */
+  std::uint16_t num_fragmented_bytes;
+
+  /**
+   * Unused.  Keeps the header free of padding, so headers can be compared
+   * byte for byte.
+   */
+  std::uint16_t reserved;
+
+  /**
+   * CRC32C of the page as written to disk, if its file keeps checksums.  The
+   * next page number is left out, so linking the page in does not change it.
+   */
+  std::uint32_t checksum;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -152,6 +172,18 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID without copying it.  The returned
+   * pointer is into the page, so it stays valid only as long as the page is
+   * not changed (and, for a page in a buffer pool, stays pinned).
+   *
+   * @param record_id  ID of the record to return.
+   * @param length     Length of the record, returned via this reference.
+   * @return  The first byte of the record.
+   */
+  const char* getRecordData(const RecordId& record_id,
+                            std::size_t& length) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
@@ -163,9 +195,10 @@ class Page {
   void updateRecord(const RecordId& record_id, const std::string& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  The space of the record is left as
+   * a hole between the other records, and reclaimed by compacting the page
+   * when an insert needs it.  Slot array is compacted if the slot deleted is
+   * at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -180,12 +213,14 @@ class Page {
   bool hasSpaceForRecord(const std::string& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, including the holes left by
+   * deleted records.
    *
    * @return  Free space in bytes.
    */
   std::uint16_t getFreeSpace() const {
-    return header_.free_space_upper_bound - header_.free_space_lower_bound;
+    return header_.free_space_upper_bound - header_.free_space_lower_bound +
+           header_.num_fragmented_bytes;
   }
 
   /**
@@ -242,8 +277,8 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
+   * Deletes the record with the given ID.  The space of the record is left as
+   * a hole unless it is next to the free space.  Slot array is compacted if
    * the slot deleted is at the end of the slot array and
    * <allow_slot_compaction> is set.
    *
@@ -274,6 +309,22 @@ class Page {
    */
   const PageSlot& getSlot(const SlotId slot_number) const;
 
+  /**
+   * Moves the records of the page together at the end of the data area,
+   * closing the holes left by deleted records.  Records are moved within the
+   * page, and keep their slot numbers.
+   */
+  void compact();
+
+  /**
+   * Returns the number of free bytes between the slot array and the records.
+   *
+   * @return  Contiguous free space in bytes.
+   */
+  std::uint16_t getContiguousFreeSpace() const {
+    return header_.free_space_upper_bound - header_.free_space_lower_bound;
+  }
+
   /**
    * Returns the slot number of an available slot.  If no slots are available
    * to be reused, allocates a new slot.  Updates available slot count in the
@@ -295,7 +346,8 @@ class Page {
    * in use.  <slot_number> must be less than <header_.num_slots>.
    *
    * Callers are responsible for making sure there is enough space to hold the
-   * record before calling this method.
+   * record before calling this method.  The page is compacted first if the
+   * record only fits into the holes left by deleted records.
    *
    * @param slot_number   Number of slot to insert record into.
    * @param record_data   Bytes that compose the record.
@@ -339,6 +391,7 @@ class Page {
   friend class PageFile;
   friend class BlobFile;
   friend class PageIterator;
+  friend class PaxPage;
 };
 
 static_assert(Page::SIZE > sizeof(PageHeader),
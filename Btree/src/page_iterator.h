@@ -99,6 +99,17 @@ class PageIterator {
     return page_->getRecord(current_record_);
   }
 
+  /**
+   * Returns the current record in the page without copying it, valid while
+   * the page is unchanged.
+   *
+   * @param length  Length of the record, returned via this reference.
+   * @return  The first byte of the record.
+   */
+  inline const char* getRecordData(std::size_t& length) const {
+    return page_->getRecordData(current_record_, length);
+  }
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
@@ -0,0 +1,191 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Reader/writer latch on one B+ tree node. Latches are held for a
+ * single operation on a node, so waiting threads spin and yield instead of
+ * sleeping. Waiting writers keep new readers out, so they cannot be starved.
+ *
+ * Every release of the exclusive latch bumps the version, which lets a scan
+ * that let go of its leaf between calls find out if the leaf changed.
+ */
+class PageLatch {
+ public:
+  PageLatch() : state(0), writersWaiting(0), version(0) {}
+
+  /**
+   * Acquires the latch in shared mode.
+   */
+  void lockShared() {
+    while (true) {
+      if (writersWaiting.load(std::memory_order_relaxed) == 0) {
+        int readers = state.load(std::memory_order_relaxed);
+        if (readers >= 0 &&
+            state.compare_exchange_weak(readers, readers + 1,
+                                        std::memory_order_acquire)) {
+          return;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * Releases the latch held in shared mode.
+   */
+  void unlockShared() { state.fetch_sub(1, std::memory_order_release); }
+
+  /**
+   * Acquires the latch in exclusive mode.
+   */
+  void lock() {
+    writersWaiting.fetch_add(1, std::memory_order_relaxed);
+    int unlatched = 0;
+    while (!state.compare_exchange_weak(unlatched, -1,
+                                        std::memory_order_acquire)) {
+      unlatched = 0;
+      std::this_thread::yield();
+    }
+    writersWaiting.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Releases the latch held in exclusive mode.
+   */
+  void unlock() {
+    version.fetch_add(1, std::memory_order_relaxed);
+    state.store(0, std::memory_order_release);
+  }
+
+  /**
+   * Returns the number of times the exclusive latch has been released. Only
+   * stable while the latch is held.
+   */
+  std::uint32_t getVersion() const {
+    return version.load(std::memory_order_relaxed);
+  }
+
+ private:
+  /**
+   * Number of readers holding the latch, or -1 while a writer holds it.
+   */
+  std::atomic<int> state;
+
+  /**
+   * Number of writers waiting for the latch.
+   */
+  std::atomic<int> writersWaiting;
+
+  /**
+   * Number of times the exclusive latch has been released.
+   */
+  std::atomic<std::uint32_t> version;
+};
+
+/**
+ * @brief Table of one T per page number, allocated in chunks as pages are
+ * first looked up. Two levels of lazily allocated directories cover every page
+ * number, so two pages never share an element. Elements start out value
+ * initialized, and are only freed with the table.
+ */
+template <class T>
+class PageTable {
+ public:
+  PageTable() {
+    for (int i = 0; i < FANOUT; i++) top[i] = NULL;
+  }
+
+  ~PageTable() {
+    for (int i = 0; i < FANOUT; i++) {
+      Directory *dir = top[i].load();
+      if (dir == NULL) continue;
+      for (int j = 0; j < FANOUT; j++) delete[] dir->chunks[j].load();
+      delete dir;
+    }
+  }
+
+  /**
+   * Returns the element of page pageNo.
+   */
+  T &at(const PageId pageNo) {
+    Directory *dir = getOrCreate(top[pageNo >> (DIRBITS + CHUNKBITS)]);
+    T *chunk = getOrCreate(dir->chunks[(pageNo >> CHUNKBITS) & (FANOUT - 1)]);
+    return chunk[pageNo & (CHUNKSIZE - 1)];
+  }
+
+ private:
+  /**
+   * Page numbers are split into 10 bits per directory level and 12 bits within
+   * a chunk.
+   */
+  static const int DIRBITS = 10;
+  static const int CHUNKBITS = 12;
+  static const int FANOUT = 1 << DIRBITS;
+  static const int CHUNKSIZE = 1 << CHUNKBITS;
+
+  struct Directory {
+    std::atomic<T *> chunks[FANOUT];
+    Directory() {
+      for (int i = 0; i < FANOUT; i++) chunks[i] = NULL;
+    }
+  };
+
+  /**
+   * Returns the chunk in slot, allocating it if no thread has yet.
+   */
+  static T *getOrCreate(std::atomic<T *> &slot) {
+    T *chunk = slot.load(std::memory_order_acquire);
+    if (chunk != NULL) return chunk;
+    T *created = new T[CHUNKSIZE]();
+    if (slot.compare_exchange_strong(chunk, created,
+                                     std::memory_order_acq_rel)) {
+      return created;
+    }
+    delete[] created;  // Another thread won the race
+    return chunk;
+  }
+
+  /**
+   * Returns the directory in slot, allocating it if no thread has yet.
+   */
+  static Directory *getOrCreate(std::atomic<Directory *> &slot) {
+    Directory *dir = slot.load(std::memory_order_acquire);
+    if (dir != NULL) return dir;
+    Directory *created = new Directory();
+    if (slot.compare_exchange_strong(dir, created,
+                                     std::memory_order_acq_rel)) {
+      return created;
+    }
+    delete created;  // Another thread won the race
+    return dir;
+  }
+
+  std::atomic<Directory *> top[FANOUT];
+};
+
+/**
+ * @brief Table of PageLatch objects, one per page number.
+ */
+class PageLatchTable : public PageTable<PageLatch> {
+ public:
+  /**
+   * Returns the latch of page pageNo.
+   */
+  PageLatch &latchFor(const PageId pageNo) { return at(pageNo); }
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,428 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "partitioned_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <thread>
+
+#include "exceptions/bad_index_info_exception.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "exceptions/scan_not_initialized_exception.h"
+#include "filescan.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns the bytes of a key of type T, as the split keys are kept.
+ */
+template <class T>
+std::string keyBytes(const T &key) {
+  std::string bytes(STRINGSIZE, '\0');
+  memcpy(&bytes[0], &key, sizeof(key));
+  return bytes;
+}
+
+/**
+ * Returns the bytes of a key, pointer to integer/double/char string.
+ */
+std::string keyBytes(const void *key, const Datatype type) {
+  switch (type) {
+    case INTEGER:
+      return keyBytes(KeyTraits<int>::load(key));
+    case DOUBLE:
+      return keyBytes(KeyTraits<double>::load(key));
+    case STRING:
+      return keyBytes(KeyTraits<StringKey>::load(key));
+    case COMPOSITE:
+      break;
+  }
+  return std::string();
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::PartitionedIndex -- Constructor
+// -----------------------------------------------------------------------------
+
+PartitionedIndex::PartitionedIndex(const std::string &relationName,
+                                   std::string &outIndexName, BufMgr *bufMgrIn,
+                                   const int attrByteOffset,
+                                   const Datatype attrType,
+                                   const int numPartitions,
+                                   const std::vector<std::string> &directories)
+    : file(NULL),
+      bufMgr(bufMgrIn),
+      attributeType(attrType),
+      attrByteOffset(attrByteOffset),
+      scanExecuting(false),
+      scanPartition(0),
+      lastScanPartition(0),
+      lowBounded(false),
+      highBounded(false),
+      lowOp(GTE),
+      highOp(LTE) {
+  std::ostringstream idxStr;
+  idxStr << relationName << "." << attrByteOffset;
+  const std::string baseName = idxStr.str();
+  outIndexName = baseName + ".parts";
+  if (attrType == COMPOSITE) throw BadIndexInfoException(outIndexName);
+
+  try {
+    this->file = new BlobFile(outIndexName, false);
+
+    const PageId headerPageNum = this->file->getFirstPageNo();
+    Page *headerPage;
+    this->bufMgr->readPage(this->file, headerPageNum, headerPage);
+    const PartitionMetaInfo *meta = (const PartitionMetaInfo *)headerPage;
+    const bool valid = relationName == meta->relationName &&
+                       attrType == meta->attrType &&
+                       attrByteOffset == meta->attrByteOffset &&
+                       meta->numPartitions >= 1 &&
+                       meta->numPartitions <= MAX_PARTITIONS;
+    if (valid) {
+      for (int p = 0; p < meta->numPartitions; p++) {
+        this->partitionFiles.push_back(std::string(
+            meta->partitionFiles[p],
+            strnlen(meta->partitionFiles[p], PARTITIONNAMESIZE)));
+        if (p > 0) {
+          this->splitKeys.push_back(
+              std::string(meta->splitKeys[p - 1], STRINGSIZE));
+        }
+      }
+    }
+    this->bufMgr->unPinPage(this->file, headerPageNum, false);
+    if (!valid) {
+      // Closed here, since the destructor does not run
+      this->bufMgr->flushFile(this->file);
+      delete this->file;
+      this->file = NULL;
+      throw BadIndexInfoException(outIndexName);
+    }
+
+    for (std::size_t p = 0; p < this->partitionFiles.size(); p++) {
+      std::string partitionName;
+      this->partitions.push_back(std::unique_ptr<BTreeIndex>(new BTreeIndex(
+          relationName, partitionName, this->bufMgr, attrByteOffset, attrType,
+          std::vector<KeyColumn>(), false, DEFAULT_FILL_FACTOR, false, 1, NULL,
+          &this->partitionFiles[p])));
+    }
+  } catch (FileNotFoundException &e) {
+    if (numPartitions < 1 || numPartitions > MAX_PARTITIONS) {
+      throw BadIndexInfoException(outIndexName);
+    }
+    for (int p = 0; p < numPartitions; p++) {
+      std::ostringstream partStr;
+      if (!directories.empty()) {
+        partStr << directories[p % directories.size()] << "/";
+      }
+      partStr << baseName << ".p" << p;
+      if (partStr.str().size() >= (std::size_t)PARTITIONNAMESIZE) {
+        throw BadIndexInfoException(partStr.str());
+      }
+      this->partitionFiles.push_back(partStr.str());
+    }
+
+    switch (attrType) {
+      case INTEGER:
+        build<int>(relationName, this->partitionFiles);
+        break;
+      case DOUBLE:
+        build<double>(relationName, this->partitionFiles);
+        break;
+      case STRING:
+        build<StringKey>(relationName, this->partitionFiles);
+        break;
+      case COMPOSITE:
+        break;
+    }
+
+    // The routing file is written last, so that an index whose build did
+    // not finish is built again rather than opened
+    this->file = new BlobFile(outIndexName, true);
+    PageId headerPageNum;
+    Page *headerPage;
+    this->bufMgr->allocPage(this->file, headerPageNum, headerPage);
+    PartitionMetaInfo *meta = (PartitionMetaInfo *)headerPage;
+    strncpy(meta->relationName, relationName.c_str(), 20);
+    meta->relationName[19] = 0;
+    meta->attrByteOffset = attrByteOffset;
+    meta->attrType = attrType;
+    meta->numPartitions = numPartitions;
+    for (int p = 0; p < numPartitions; p++) {
+      strncpy(meta->partitionFiles[p], this->partitionFiles[p].c_str(),
+              PARTITIONNAMESIZE);
+      if (p > 0) {
+        memcpy(meta->splitKeys[p - 1], this->splitKeys[p - 1].data(),
+               STRINGSIZE);
+      }
+    }
+    this->bufMgr->unPinPage(this->file, headerPageNum, true);
+    this->bufMgr->flushFile(this->file);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::~PartitionedIndex -- destructor
+// -----------------------------------------------------------------------------
+
+PartitionedIndex::~PartitionedIndex() {
+  if (this->scanExecuting) {
+    try {
+      endScan();
+    } catch (...) {
+    }
+  }
+  this->partitions.clear();
+  if (this->file != NULL) {
+    this->bufMgr->flushFile(this->file);
+    delete this->file;
+    this->file = NULL;
+  }
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::partitionOf
+// -----------------------------------------------------------------------------
+
+template <class T>
+int PartitionedIndex::partitionOfKey(const T &key) const {
+  // The first split key above key ends its partition, so equal keys go right
+  int partition = 0;
+  while (partition < (int)this->splitKeys.size() &&
+         !(key < KeyTraits<T>::load(this->splitKeys[partition].data()))) {
+    partition++;
+  }
+  return partition;
+}
+
+int PartitionedIndex::partitionOf(const void *key) const {
+  switch (this->attributeType) {
+    case INTEGER:
+      return partitionOfKey(KeyTraits<int>::load(key));
+    case DOUBLE:
+      return partitionOfKey(KeyTraits<double>::load(key));
+    case STRING:
+      return partitionOfKey(KeyTraits<StringKey>::load(key));
+    case COMPOSITE:
+      break;
+  }
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::build
+// -----------------------------------------------------------------------------
+
+template <class T>
+void PartitionedIndex::build(const std::string &relationName,
+                             const std::vector<std::string> &partitionFiles) {
+  std::vector<std::pair<T, RecordId> > entries;
+  {
+    FileScan fileScan(relationName, this->bufMgr);
+    RecordId rid;
+    try {
+      while (true) {
+        fileScan.scanNext(rid);
+        std::size_t length;
+        const char *record = fileScan.getRecordData(length);
+        entries.push_back(std::make_pair(
+            KeyTraits<T>::load(record + this->attrByteOffset), rid));
+      }
+    } catch (EndOfFileException &e) {
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const std::pair<T, RecordId> &a,
+                      const std::pair<T, RecordId> &b) {
+                     return a.first < b.first;
+                   });
+
+  // Each partition starts at the key an equal share of the entries in; a key
+  // that repeats across the boundary moves it to its first entry
+  const int numPartitions = (int)partitionFiles.size();
+  this->splitKeys.clear();
+  for (int p = 1; p < numPartitions; p++) {
+    const std::size_t at = entries.size() * p / numPartitions;
+    this->splitKeys.push_back(keyBytes(
+        at < entries.size() ? entries[at].first : KeyTraits<T>::highest()));
+  }
+
+  // Files are opened one at a time, since opening them is not thread-safe.
+  // Those of a build that did not finish are started over.
+  for (int p = 0; p < numPartitions; p++) {
+    if (File::exists(partitionFiles[p])) File::remove(partitionFiles[p]);
+    std::string partitionName;
+    this->partitions.push_back(std::unique_ptr<BTreeIndex>(new BTreeIndex(
+        relationName, partitionName, this->bufMgr, this->attrByteOffset,
+        this->attributeType, std::vector<KeyColumn>(), false,
+        DEFAULT_FILL_FACTOR, false, 1, NULL, &partitionFiles[p])));
+  }
+
+  // The entries of a partition are contiguous once sorted
+  std::vector<std::size_t> begin(numPartitions + 1, entries.size());
+  for (std::size_t e = entries.size(); e-- > 0;) {
+    begin[partitionOfKey(entries[e].first)] = e;
+  }
+  for (int p = numPartitions - 1; p >= 0; p--) {
+    begin[p] = std::min(begin[p], begin[p + 1]);
+  }
+
+  std::vector<std::exception_ptr> errors(numPartitions);
+  std::vector<std::thread> threads;
+  for (int p = 0; p < numPartitions; p++) {
+    threads.push_back(std::thread([this, &entries, &begin, &errors, p]() {
+      try {
+        const std::size_t n = begin[p + 1] - begin[p];
+        std::vector<T> keys(n);
+        std::vector<RecordId> rids(n);
+        for (std::size_t e = 0; e < n; e++) {
+          keys[e] = entries[begin[p] + e].first;
+          rids[e] = entries[begin[p] + e].second;
+        }
+        if (n > 0) this->partitions[p]->insertBatch(keys.data(), rids.data(), n);
+      } catch (...) {
+        errors[p] = std::current_exception();
+      }
+    }));
+  }
+  for (std::size_t t = 0; t < threads.size(); t++) threads[t].join();
+  for (int p = 0; p < numPartitions; p++) {
+    if (errors[p]) std::rethrow_exception(errors[p]);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+void PartitionedIndex::insertEntry(const void *key, const RecordId rid) {
+  this->partitions[partitionOf(key)]->insertEntry(key, rid);
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::lookup
+// -----------------------------------------------------------------------------
+
+bool PartitionedIndex::lookup(const void *key, RecordId &outRid) {
+  return this->partitions[partitionOf(key)]->lookup(key, outRid);
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+bool PartitionedIndex::deleteEntry(const void *key, const RecordId rid) {
+  return this->partitions[partitionOf(key)]->deleteEntry(key, rid);
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::startScan
+// -----------------------------------------------------------------------------
+
+void PartitionedIndex::startScan(const void *lowVal, const Operator lowOp,
+                                 const void *highVal, const Operator highOp) {
+  if (this->scanExecuting) endScan();
+
+  this->lowBounded = lowVal != NULL;
+  this->highBounded = highVal != NULL;
+  if (this->lowBounded) this->lowValue = keyBytes(lowVal, this->attributeType);
+  if (this->highBounded) {
+    this->highValue = keyBytes(highVal, this->attributeType);
+  }
+  this->lowOp = lowOp;
+  this->highOp = highOp;
+
+  const int first = this->lowBounded ? partitionOf(this->lowValue.data()) : 0;
+  this->lastScanPartition = this->highBounded
+                                ? partitionOf(this->highValue.data())
+                                : numPartitions() - 1;
+  // The first partition checks the operators and the range
+  if (!startPartitionScan(std::min(first, this->lastScanPartition))) {
+    throw NoSuchKeyFoundException();
+  }
+  this->scanExecuting = true;
+}
+
+bool PartitionedIndex::startPartitionScan(int partition) {
+  for (; partition <= this->lastScanPartition; partition++) {
+    try {
+      this->partitions[partition]->startScan(
+          this->cursor, this->lowBounded ? &this->lowValue[0] : NULL,
+          this->lowOp, this->highBounded ? &this->highValue[0] : NULL,
+          this->highOp);
+      this->scanPartition = partition;
+      return true;
+    } catch (NoSuchKeyFoundException &e) {
+    }
+  }
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::scanNext
+// -----------------------------------------------------------------------------
+
+void PartitionedIndex::scanNext(RecordId &outRid, void *outKey) {
+  if (!this->scanExecuting) throw ScanNotInitializedException();
+
+  while (true) {
+    if (!this->cursor.isScanning()) throw IndexScanCompletedException();
+    BTreeIndex *partition = this->partitions[this->scanPartition].get();
+    try {
+      if (outKey == NULL) {
+        partition->scanNext(this->cursor, outRid);
+      } else {
+        partition->scanNext(this->cursor, outRid, outKey);
+      }
+      return;
+    } catch (IndexScanCompletedException &e) {
+      partition->endScan(this->cursor);
+      if (!startPartitionScan(this->scanPartition + 1)) throw;
+    }
+  }
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::endScan
+// -----------------------------------------------------------------------------
+
+void PartitionedIndex::endScan() {
+  if (!this->scanExecuting) throw ScanNotInitializedException();
+  if (this->cursor.isScanning()) {
+    this->partitions[this->scanPartition]->endScan(this->cursor);
+  }
+  this->scanExecuting = false;
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::partitionFile
+// -----------------------------------------------------------------------------
+
+const std::string &PartitionedIndex::partitionFile(const int partition) const {
+  return this->partitionFiles[partition];
+}
+
+// -----------------------------------------------------------------------------
+// PartitionedIndex::partitionStats
+// -----------------------------------------------------------------------------
+
+BTreeStats PartitionedIndex::partitionStats(const int partition) {
+  return this->partitions[partition]->getStats();
+}
+
+}  // namespace badgerdb
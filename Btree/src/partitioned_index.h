@@ -0,0 +1,305 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Most partitions a PartitionedIndex can have.
+ */
+const int MAX_PARTITIONS = 16;
+
+/**
+ * @brief Room for the name of the file of a partition, with its directory and
+ * the terminator.
+ */
+const int PARTITIONNAMESIZE = 64;
+
+/**
+ * @brief Structure to store the routing table of a PartitionedIndex in the
+ * header page of its routing file.
+ */
+struct PartitionMetaInfo {
+  /**
+   * Name of base relation.
+   */
+  char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in
+   * pages.
+   */
+  int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+  Datatype attrType;
+
+  /**
+   * Number of partitions.
+   */
+  int numPartitions;
+
+  /**
+   * Name of the index file of each partition.
+   */
+  char partitionFiles[MAX_PARTITIONS][PARTITIONNAMESIZE];
+
+  /**
+   * Lowest key of each partition but the first, in order: an integer, a
+   * double or STRINGSIZE characters. Keys below the first go to partition 0.
+   */
+  char splitKeys[MAX_PARTITIONS - 1][STRINGSIZE];
+};
+
+static_assert(sizeof(double) <= STRINGSIZE, "split key too small");
+static_assert(sizeof(PartitionMetaInfo) <= Page::SIZE,
+              "partition meta page too large");
+
+/**
+ * @brief B+ tree index on an INTEGER, DOUBLE or STRING attribute of a
+ * relation, split by key range into several BTreeIndex partitions, each in a
+ * file of its own.
+ *
+ * The files can be put in different directories, on different devices, so
+ * that the I/O of the index is spread over them, and inserts into different
+ * partitions do not contend on the same root. A routing file, named after the
+ * relation and the attribute's offset such as "rel.0.parts", holds the lowest
+ * key of each partition. The ranges are picked when the index is built, so
+ * that the keys of the relation are spread evenly, with equal keys always in
+ * the same partition; they do not change afterwards.
+ *
+ * Inserts, lookups and deletes go to the one partition of their key, and may
+ * be made from several threads at once, as on a BTreeIndex. A scan visits the
+ * partitions its range overlaps in key order, so entries come back in order
+ * as from a single tree. Like the scan of a BTreeIndex without a cursor, there
+ * is one scan per index.
+ */
+class PartitionedIndex {
+ private:
+  /**
+   * File object for the routing file.
+   */
+  File *file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+  Datatype attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records.
+   */
+  int attrByteOffset;
+
+  /**
+   * Lowest key of each partition but the first, as in the routing file.
+   */
+  std::vector<std::string> splitKeys;
+
+  /**
+   * Name of the index file of each partition.
+   */
+  std::vector<std::string> partitionFiles;
+
+  /**
+   * The partitions, in key order.
+   */
+  std::vector<std::unique_ptr<BTreeIndex> > partitions;
+
+  /**
+   * True if a scan has been started.
+   */
+  bool scanExecuting;
+
+  /**
+   * Partition being scanned, and the last one the scan range overlaps.
+   */
+  int scanPartition;
+  int lastScanPartition;
+
+  /**
+   * Bounds of the scan, to start it again on each partition with.
+   */
+  std::string lowValue;
+  std::string highValue;
+  bool lowBounded;
+  bool highBounded;
+  Operator lowOp;
+  Operator highOp;
+
+  /**
+   * Cursor of the scan on the partition being scanned.
+   */
+  IndexCursor cursor;
+
+  /**
+   * Return the partition whose range holds key.
+   */
+  template <class T>
+  int partitionOfKey(const T &key) const;
+
+  /**
+   * Return the partition whose range holds key, pointer to integer/double/char
+   * string. partitionOfKey() does the work once the type is known.
+   */
+  int partitionOf(const void *key) const;
+
+  /**
+   * Read the keys of the relation, pick the split keys so that each partition
+   * gets as many of them as equal keys allow, create the partitions and fill
+   * them, each from a thread of its own.
+   */
+  template <class T>
+  void build(const std::string &relationName,
+             const std::vector<std::string> &partitionFiles);
+
+  /**
+   * Start the scan on the partitions from partition on, until one has an
+   * entry in the range.
+   * @return  True if one did, false if the scan is done
+   */
+  bool startPartitionScan(int partition);
+
+ public:
+  /**
+   * PartitionedIndex Constructor.
+   * Check to see if the routing file of the index exists. If so, open it and
+   * the partitions it names. If not, build the index from the relation.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of the routing file.
+   * @param bufMgrIn            Buffer Manager Instance
+   * @param attrByteOffset      Offset of attribute, over which index is to be
+   * built, in the record
+   * @param attrType            Datatype of attribute over which index is built
+   * @param numPartitions       Number of partitions of a new index, 1 to
+   * MAX_PARTITIONS
+   * @param directories         Directories the files of the partitions of a
+   * new index go in, partition i in directories[i % directories.size()]. If
+   * empty, they go in the working directory.
+   * @throws  BadIndexInfoException     If the attribute is COMPOSITE, the
+   * number of partitions is out of range, a file name is too long, or the
+   * routing file already exists but values in its metapage (relationName,
+   * attribute byte offset, attribute type) do not match with values received
+   * through constructor parameters.
+   */
+  PartitionedIndex(const std::string &relationName, std::string &outIndexName,
+                   BufMgr *bufMgrIn, const int attrByteOffset,
+                   const Datatype attrType, const int numPartitions = 4,
+                   const std::vector<std::string> &directories =
+                       std::vector<std::string>());
+
+  /**
+   * PartitionedIndex Destructor.
+   * End the scan if one is executing, close the partitions, and flush and
+   * close the routing file. Destructor should not throw any exceptions.
+   */
+  ~PartitionedIndex();
+
+  /**
+   * Insert a new entry into the partition of its key, as
+   * BTreeIndex::insertEntry() does.
+   * @param key     Key to insert, pointer to integer/double/char string
+   * @param rid     Record ID of a record whose entry is getting inserted into
+   *the index.
+   **/
+  void insertEntry(const void *key, const RecordId rid);
+
+  /**
+   * Find an entry with the given key in its partition, as
+   * BTreeIndex::lookup() does.
+   * @param key     Key to look for, pointer to integer/double/char string
+   * @param outRid  RecordId of the first entry with the key, in index order
+   * @return  True if an entry was found, false if the key is not in the index
+   **/
+  bool lookup(const void *key, RecordId &outRid);
+
+  /**
+   * Delete the entry with the given key and record id from its partition, as
+   * BTreeIndex::deleteEntry() does.
+   * @param key     Key of the entry, pointer to integer/double/char string
+   * @param rid     Record ID of the entry
+   * @return True if the entry was found and deleted
+   **/
+  bool deleteEntry(const void *key, const RecordId rid);
+
+  /**
+   * Begin a filtered scan of the index, as BTreeIndex::startScan() does. If
+   * another scan is already executing, it is ended here.
+   * @param lowVal  Low value of range, pointer to integer / double / char
+   *string, or NULL to leave the range open below
+   * @param lowOp   Low operator (GT/GTE)
+   * @param highVal High value of range, pointer to integer / double / char
+   *string, or NULL to leave the range open above
+   * @param highOp  High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of
+   *their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   * @throws  NoSuchKeyFoundException If there is no key in any partition that
+   *satisfies the scan criteria.
+   **/
+  void startScan(const void *lowVal, const Operator lowOp,
+                 const void *highVal, const Operator highOp);
+
+  /**
+   * Fetch the record id, and the key if outKey is not NULL, of the next index
+   * entry that matches the scan, moving on to the next partition once one is
+   * done.
+   * @param outRid  RecordId of next record found that satisfies the scan
+   *criteria returned in this
+   * @param outKey  Receives the key, as for BTreeIndex::scanNext(), if not NULL
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   * @throws IndexScanCompletedException If no more records, satisfying the scan
+   *criteria, are left to be scanned.
+   **/
+  void scanNext(RecordId &outRid, void *outKey = NULL);
+
+  /**
+   * Terminate the current scan.
+   * @throws ScanNotInitializedException If no scan has been initialized.
+   **/
+  void endScan();
+
+  /**
+   * Return the number of partitions.
+   **/
+  int numPartitions() const { return (int)partitions.size(); }
+
+  /**
+   * Return the name of the index file of a partition.
+   * @param partition  0 to numPartitions() - 1
+   **/
+  const std::string &partitionFile(const int partition) const;
+
+  /**
+   * Return the statistics of a partition, as BTreeIndex::getStats() finds
+   * them.
+   * @param partition  0 to numPartitions() - 1
+   **/
+  BTreeStats partitionStats(const int partition);
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,122 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "pax_page.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_record_exception.h"
+
+namespace badgerdb {
+
+PaxSchema::PaxSchema(const std::vector<ByteRange> &attributes,
+                     const std::size_t recordLength)
+    : attributes(attributes), length(recordLength), stored(0) {
+  for (std::size_t i = 0; i < attributes.size(); i++) {
+    stored += attributes[i].length;
+  }
+}
+
+std::size_t PaxSchema::columnAt(const std::size_t offset) const {
+  for (std::size_t i = 0; i < attributes.size(); i++) {
+    if (attributes[i].offset == offset) return i;
+  }
+  return attributes.size();
+}
+
+std::uint16_t PaxPage::capacity(const PaxSchema &schema) {
+  const std::size_t records =
+      (Page::DATA_SIZE - sizeof(PaxHeader)) / std::max<std::size_t>(
+                                                  1, schema.storedLength());
+  return (std::uint16_t)std::min<std::size_t>(records & ~(std::size_t)7,
+                                              UINT16_MAX & ~7);
+}
+
+void PaxPage::initialize() {
+  memset(page->data_, '\0', Page::DATA_SIZE);
+  page->header_.num_slots = 0;
+  page->header_.num_free_slots = 0;
+  page->header_.num_fragmented_bytes = 0;
+
+  PaxHeader &pax = header();
+  pax.num_records = 0;
+  pax.capacity = capacity(*schema);
+  pax.num_columns = (std::uint16_t)schema->numColumns();
+  pax.stored_length = (std::uint16_t)schema->storedLength();
+  updateFreeSpace();
+}
+
+bool PaxPage::matchesSchema() const {
+  const PaxHeader &pax = header();
+  return pax.capacity == capacity(*schema) &&
+         pax.num_columns == schema->numColumns() &&
+         pax.stored_length == schema->storedLength() &&
+         pax.num_records <= pax.capacity;
+}
+
+RecordId PaxPage::insertRecord(const std::string &record) {
+  PaxHeader &pax = header();
+  if (pax.num_records == pax.capacity) {
+    throw InsufficientSpaceException(page->page_number(), record.length(), 0);
+  }
+
+  const std::size_t index = pax.num_records;
+  for (std::size_t k = 0; k < schema->numColumns(); k++) {
+    const ByteRange &attr = schema->attribute(k);
+    char *value = page->data_ + columnOffset(k) + index * attr.length;
+    const std::size_t start = std::min(attr.offset, record.length());
+    const std::size_t end = std::min(attr.offset + attr.length, record.length());
+    memcpy(value, record.data() + start, end - start);
+    memset(value + (end - start), '\0', attr.length - (end - start));
+  }
+  pax.num_records++;
+  updateFreeSpace();
+  return {page->page_number(), (SlotId)(index + 1), 0};
+}
+
+std::string PaxPage::getRecord(const RecordId &record_id) const {
+  if (record_id.page_number != page->page_number() ||
+      record_id.slot_number == Page::INVALID_SLOT ||
+      record_id.slot_number > header().num_records) {
+    throw InvalidRecordException(record_id, page->page_number());
+  }
+
+  const std::size_t index = record_id.slot_number - 1;
+  std::string record(schema->recordLength(), '\0');
+  for (std::size_t k = 0; k < schema->numColumns(); k++) {
+    const ByteRange &attr = schema->attribute(k);
+    record.replace(attr.offset, attr.length,
+                   page->data_ + columnOffset(k) + index * attr.length,
+                   attr.length);
+  }
+  return record;
+}
+
+const char *PaxPage::getColumn(const std::size_t column) const {
+  return page->data_ + columnOffset(column);
+}
+
+std::size_t PaxPage::columnOffset(const std::size_t column) const {
+  std::size_t offset = sizeof(PaxHeader);
+  for (std::size_t k = 0; k < column; k++) {
+    offset += header().capacity * schema->attribute(k).length;
+  }
+  return offset;
+}
+
+void PaxPage::updateFreeSpace() {
+  const PaxHeader &pax = header();
+  page->header_.free_space_lower_bound =
+      sizeof(PaxHeader) + pax.num_records * pax.stored_length;
+  page->header_.free_space_upper_bound =
+      sizeof(PaxHeader) + pax.capacity * pax.stored_length;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,189 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Attributes of the records of a relation stored in PAX pages.
+ *
+ * Records are fixed length. Each attribute is a range of bytes of the record,
+ * and is stored in a column of its own. Bytes of a record outside every
+ * attribute, such as padding, are not stored and read back as zero.
+ */
+class PaxSchema {
+ public:
+  /**
+   * @param attributes    Bytes of the record stored in each column, in column
+   * order
+   * @param recordLength  Length of every record
+   */
+  PaxSchema(const std::vector<ByteRange> &attributes,
+            const std::size_t recordLength);
+
+  /**
+   * Returns the number of columns.
+   */
+  std::size_t numColumns() const { return attributes.size(); }
+
+  /**
+   * Returns the bytes of the record stored in a column.
+   */
+  const ByteRange &attribute(const std::size_t column) const {
+    return attributes[column];
+  }
+
+  /**
+   * Returns the length of every record.
+   */
+  std::size_t recordLength() const { return length; }
+
+  /**
+   * Returns the number of bytes a page takes to store one record.
+   */
+  std::size_t storedLength() const { return stored; }
+
+  /**
+   * Returns the column of the attribute starting at a byte offset of the
+   * record, or numColumns() if there is none.
+   */
+  std::size_t columnAt(const std::size_t offset) const;
+
+ private:
+  std::vector<ByteRange> attributes;
+  std::size_t length;
+  std::size_t stored;
+};
+
+/**
+ * @brief Header of the data area of a PAX page.
+ */
+struct PaxHeader {
+  /**
+   * Number of records on the page.
+   */
+  std::uint16_t num_records;
+
+  /**
+   * Number of records the page has room for.
+   */
+  std::uint16_t capacity;
+
+  /**
+   * Number of columns and bytes stored per record, as a check that the page
+   * is read with the schema it was written with.
+   */
+  std::uint16_t num_columns;
+  std::uint16_t stored_length;
+};
+
+/**
+ * @brief View of a page holding records in the PAX layout.
+ *
+ * Instead of slots, the data area of the page is split into one minipage per
+ * column. Minipage k holds attribute k of every record of the page back to
+ * back, so a scan of one attribute reads only its minipage. Records are
+ * appended, and record i of the page has slot number i + 1.
+ *
+ * The free space bounds of the page header are kept so that the free space of
+ * the page is the room left for records, which keeps the free space map of the
+ * file accurate. The slot array is empty, so a PageIterator sees no records.
+ *
+ * @warning This class is not threadsafe.
+ */
+class PaxPage {
+ public:
+  /**
+   * @param page    Page holding the records
+   * @param schema  Schema the page is laid out for, which has to outlive the
+   * view
+   */
+  PaxPage(Page *page, const PaxSchema &schema) : page(page), schema(&schema) {}
+
+  /**
+   * Returns the number of records of the schema a page has room for. Rounded
+   * down to a multiple of 8, so every minipage starts on an 8 byte boundary of
+   * the data area.
+   */
+  static std::uint16_t capacity(const PaxSchema &schema);
+
+  /**
+   * Lays out an empty PAX page. The page number and the next page number are
+   * kept.
+   */
+  void initialize();
+
+  /**
+   * Returns true if the page was laid out for a schema like this one.
+   */
+  bool matchesSchema() const;
+
+  /**
+   * Returns the number of records on the page.
+   */
+  std::uint16_t numRecords() const { return header().num_records; }
+
+  /**
+   * Returns true if the page has no room for another record.
+   */
+  bool isFull() const { return header().num_records == header().capacity; }
+
+  /**
+   * Appends a record to the page, splitting it up into the minipages.
+   * Attribute bytes past the end of a short record are stored as zero.
+   *
+   * @param record  Data of the record
+   * @return  ID of the record
+   * @throws  InsufficientSpaceException  If the page is full
+   */
+  RecordId insertRecord(const std::string &record);
+
+  /**
+   * Returns a copy of the record with the given ID, put back together from
+   * the minipages.
+   *
+   * @throws  InvalidRecordException  If the ID is not of a record of the page
+   */
+  std::string getRecord(const RecordId &record_id) const;
+
+  /**
+   * Returns the minipage of a column: its attribute of every record of the
+   * page, back to back. The pointer is into the page, so it stays valid only
+   * as long as the page is not changed.
+   */
+  const char *getColumn(const std::size_t column) const;
+
+ private:
+  PaxHeader &header() { return *reinterpret_cast<PaxHeader *>(page->data_); }
+  const PaxHeader &header() const {
+    return *reinterpret_cast<const PaxHeader *>(page->data_);
+  }
+
+  /**
+   * Returns the offset in the data area of the minipage of a column.
+   */
+  std::size_t columnOffset(const std::size_t column) const;
+
+  /**
+   * Sets the free space bounds of the page header from the record count.
+   */
+  void updateFreeSpace();
+
+  Page *page;
+  const PaxSchema *schema;
+};
+
+}  // namespace badgerdb
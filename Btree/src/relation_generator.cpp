@@ -0,0 +1,253 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "relation_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "page.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Returns the sum of 1 / i^theta for i from 1 to n.
+ */
+double zeta(const std::uint64_t n, const double theta) {
+  double sum = 0;
+  for (std::uint64_t i = 1; i <= n; i++) sum += 1 / std::pow((double)i, theta);
+  return sum;
+}
+
+/**
+ * Scrambles the bits of value (the finalizer of SplitMix64).
+ */
+std::uint64_t mix(std::uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+}  // namespace
+
+// -----------------------------------------------------------------------------
+// ZipfianGenerator
+// -----------------------------------------------------------------------------
+
+ZipfianGenerator::ZipfianGenerator(const std::uint64_t items,
+                                   const double theta)
+    : items(items), theta(theta) {
+  zetaN = zeta(items, theta);
+  alpha = 1 / (1 - theta);
+  eta = (1 - std::pow(2.0 / items, 1 - theta)) / (1 - zeta(2, theta) / zetaN);
+}
+
+std::uint64_t ZipfianGenerator::rank(const double u) const {
+  const double uz = u * zetaN;
+  if (uz < 1) return 0;
+  if (uz < 1 + std::pow(0.5, theta)) {
+    return std::min<std::uint64_t>(1, items - 1);
+  }
+  const std::uint64_t rank =
+      (std::uint64_t)(items * std::pow(eta * u - eta + 1, alpha));
+  return std::min(rank, items - 1);
+}
+
+std::uint64_t fnvHash(std::uint64_t value) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < 8; i++) {
+    hash ^= value & 0xff;
+    hash *= 1099511628211ULL;
+    value >>= 8;
+  }
+  return hash;
+}
+
+// -----------------------------------------------------------------------------
+// RelationGenerator
+// -----------------------------------------------------------------------------
+
+const std::uint64_t RelationGenerator::BATCH_RECORDS;
+
+RelationGenerator::RelationGenerator(const RelationSpec &spec,
+                                     const std::size_t threads)
+    : spec(spec), threads(threads), halfBits(1) {
+  if (this->threads == 0) {
+    this->threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  const std::uint64_t keys =
+      spec.high > spec.low ? (std::uint64_t)((std::int64_t)spec.high - spec.low)
+                           : 0;
+  records = spec.pattern == SKEWED_KEYS && keys > 0 ? spec.records : keys;
+  while ((std::uint64_t)1 << (2 * halfBits) < records) halfBits++;
+  if (spec.pattern == SKEWED_KEYS && records > 0) {
+    zipfian.reset(new ZipfianGenerator(keys, spec.theta));
+  }
+  if (!this->spec.makeRecord) this->spec.makeRecord = makeRecord;
+}
+
+std::uint64_t RelationGenerator::permute(std::uint64_t position) const {
+  const std::uint64_t mask = ((std::uint64_t)1 << halfBits) - 1;
+  // Positions the network takes past the end are walked on until they land
+  // back in range, which keeps it a permutation of the range
+  do {
+    std::uint64_t left = position >> halfBits;
+    std::uint64_t right = position & mask;
+    for (std::uint64_t round = 0; round < 4; round++) {
+      const std::uint64_t next =
+          left ^ (mix(right ^ mix(spec.seed + round)) & mask);
+      left = right;
+      right = next;
+    }
+    position = (left << halfBits) | right;
+  } while (position >= records);
+  return position;
+}
+
+int RelationGenerator::keyAt(const std::uint64_t position) const {
+  switch (spec.pattern) {
+    case BACKWARD_KEYS:
+      return (int)(spec.high - 1 - (std::int64_t)position);
+    case RANDOM_KEYS:
+      return (int)(spec.low + (std::int64_t)permute(position));
+    case SKEWED_KEYS: {
+      const double u = (double)(mix(spec.seed ^ mix(position)) >> 11) /
+                       (double)(1ULL << 53);
+      const std::uint64_t keys =
+          (std::uint64_t)((std::int64_t)spec.high - spec.low);
+      return (int)(spec.low +
+                   (std::int64_t)(fnvHash(zipfian->rank(u)) % keys));
+    }
+    case FORWARD_KEYS:
+    default:
+      return (int)(spec.low + (std::int64_t)position);
+  }
+}
+
+std::uint64_t RelationGenerator::batchRecords() const {
+  if (records == 0) return 1;
+  std::string record;
+  spec.makeRecord(keyAt(0), record);
+  Page page;
+  std::uint64_t perPage = 0;
+  while (page.hasSpaceForRecord(record)) {
+    page.insertRecord(record);
+    perPage++;
+  }
+  if (perPage == 0) return 1;  // Fails in the workers
+  return std::max<std::uint64_t>(1, BATCH_RECORDS / perPage) * perPage;
+}
+
+PageId RelationGenerator::generate(PageFile *file) const {
+  const std::uint64_t batch = batchRecords();
+  const std::uint64_t numBatches = (records + batch - 1) / batch;
+  const std::size_t numWorkers =
+      (std::size_t)std::min<std::uint64_t>(threads, numBatches);
+
+  // Batches filled and not yet appended, at most two per worker
+  std::mutex latch;
+  std::condition_variable changed;
+  std::map<std::uint64_t, std::vector<Page> > filled;
+  std::uint64_t nextBatch = 0;
+  std::uint64_t appended = 0;
+  bool stop = false;
+  std::exception_ptr error;
+
+  std::vector<std::thread> workers;
+  for (std::size_t w = 0; w < numWorkers; w++) {
+    workers.push_back(std::thread([&]() {
+      std::string record;
+      while (true) {
+        std::uint64_t b;
+        {
+          std::unique_lock<std::mutex> lock(latch);
+          changed.wait(lock, [&]() {
+            return stop || nextBatch < appended + 2 * numWorkers;
+          });
+          if (stop || nextBatch == numBatches) return;
+          b = nextBatch++;
+        }
+        try {
+          std::vector<Page> pages(1);
+          const std::uint64_t end = std::min(records, (b + 1) * batch);
+          for (std::uint64_t position = b * batch; position < end; position++) {
+            spec.makeRecord(keyAt(position), record);
+            if (!pages.back().hasSpaceForRecord(record)) pages.emplace_back();
+            pages.back().insertRecord(record);
+          }
+          std::lock_guard<std::mutex> lock(latch);
+          filled[b].swap(pages);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(latch);
+          if (!error) error = std::current_exception();
+          stop = true;
+        }
+        changed.notify_all();
+      }
+    }));
+  }
+
+  PageId numPages = 0;
+  try {
+    while (appended < numBatches) {
+      std::vector<Page> pages;
+      {
+        std::unique_lock<std::mutex> lock(latch);
+        changed.wait(lock,
+                     [&]() { return stop || filled.count(appended) > 0; });
+        if (stop) break;
+        filled[appended].swap(pages);
+        filled.erase(appended);
+      }
+      file->appendPages(&pages[0], (PageId)pages.size());
+      numPages += (PageId)pages.size();
+      {
+        std::lock_guard<std::mutex> lock(latch);
+        appended++;
+      }
+      changed.notify_all();
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(latch);
+    if (!error) error = std::current_exception();
+    stop = true;
+  }
+  {
+    std::lock_guard<std::mutex> lock(latch);
+    stop = true;
+  }
+  changed.notify_all();
+  for (std::size_t w = 0; w < workers.size(); w++) workers[w].join();
+  if (error) std::rethrow_exception(error);
+  return numPages;
+}
+
+void RelationGenerator::makeRecord(const int key, std::string &record) {
+  GeneratedRecord generated;
+  memset(&generated, 0, sizeof(generated));
+  memset(generated.s, ' ', sizeof(generated.s));
+  snprintf(generated.s, sizeof(generated.s), "%05d string record", key);
+  generated.i = key;
+  generated.d = key;
+  record.assign(reinterpret_cast<char *>(&generated), sizeof(generated));
+}
+
+}  // namespace badgerdb
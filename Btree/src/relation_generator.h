@@ -0,0 +1,230 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "file.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Ranks from 0 to items - 1 drawn with the Zipfian distribution of
+ * parameter theta, rank 0 the most popular, as Gray et al. generate them in
+ * "Quickly Generating Billion-Record Synthetic Databases".
+ */
+class ZipfianGenerator {
+ public:
+  /**
+   * Sets up the distribution, which takes time linear in items.
+   *
+   * @param items  Number of ranks, at least 1
+   * @param theta  Skew, from 0 (uniform) up to but not including 1
+   */
+  ZipfianGenerator(const std::uint64_t items, const double theta = 0.99);
+
+  /**
+   * Returns the rank a uniform draw u from [0, 1) maps to.
+   */
+  std::uint64_t rank(const double u) const;
+
+  /**
+   * Returns a rank drawn with rng.
+   */
+  template <class Random>
+  std::uint64_t next(Random &rng) const {
+    return rank(std::uniform_real_distribution<double>(0, 1)(rng));
+  }
+
+ private:
+  std::uint64_t items;
+  double theta;
+  double zetaN;
+  double alpha;
+  double eta;
+};
+
+/**
+ * Returns a hash of value, the 64-bit FNV-1a of its bytes, which YCSB uses to
+ * scatter Zipfian ranks over the key space.
+ */
+std::uint64_t fnvHash(std::uint64_t value);
+
+/**
+ * @brief Orders the keys of a generated relation come in.
+ */
+enum KeyPattern {
+  /**
+   * Each key once, from the lowest up
+   */
+  FORWARD_KEYS,
+
+  /**
+   * Each key once, from the highest down
+   */
+  BACKWARD_KEYS,
+
+  /**
+   * Each key once, in an order that only depends on the seed
+   */
+  RANDOM_KEYS,
+
+  /**
+   * Keys drawn with a Zipfian distribution, the popular ones scattered over
+   * the range, so some come many times and most never
+   */
+  SKEWED_KEYS
+};
+
+/**
+ * @brief Record of the relations the tests and benchmarks generate: the key,
+ * as an int, a double and a string.
+ */
+struct GeneratedRecord {
+  int i;
+  double d;
+  char s[64];
+};
+
+/**
+ * @brief Relation a RelationGenerator writes.
+ */
+struct RelationSpec {
+  RelationSpec()
+      : pattern(FORWARD_KEYS),
+        low(0),
+        high(0),
+        records(0),
+        theta(0.99),
+        seed(1) {}
+
+  /**
+   * Order of the keys
+   */
+  KeyPattern pattern;
+
+  /**
+   * Keys go from low up to, and not including, high
+   */
+  int low;
+  int high;
+
+  /**
+   * Number of records of SKEWED_KEYS. The other patterns have one per key.
+   */
+  std::uint64_t records;
+
+  /**
+   * Skew of SKEWED_KEYS
+   */
+  double theta;
+
+  /**
+   * Seed of RANDOM_KEYS and SKEWED_KEYS. The same seed gives the same keys.
+   */
+  std::uint64_t seed;
+
+  /**
+   * Makes the record of a key, a GeneratedRecord by makeRecord() if empty.
+   * Called from several threads at once.
+   */
+  std::function<void(const int key, std::string &record)> makeRecord;
+};
+
+/**
+ * @brief Writes relations for tests and benchmarks straight into their files.
+ *
+ * Worker threads each fill a batch of pages in memory at a time, with the
+ * records of consecutive positions in the key order, and the calling thread
+ * appends the batches to the file in order with PageFile::appendPages(), a few
+ * writes per batch. The buffer pool is bypassed altogether, so records come
+ * out in key order at the rate the disk writes sequentially.
+ *
+ * Record i of the relation has keyAt(i), which any thread can work out on its
+ * own: RANDOM_KEYS permutes the positions with a small Feistel network, and
+ * SKEWED_KEYS draws each record's rank from a hash of its position.
+ */
+class RelationGenerator {
+ public:
+  /**
+   * Records each worker puts into a batch, rounded down to whole pages
+   */
+  static const std::uint64_t BATCH_RECORDS = 64 * 1024;
+
+  /**
+   * Constructs a generator of the relation spec describes.
+   *
+   * @param spec     Relation to generate
+   * @param threads  Number of worker threads, or 0 for one per hardware thread
+   */
+  explicit RelationGenerator(const RelationSpec &spec,
+                             const std::size_t threads = 0);
+
+  /**
+   * Returns the number of records of the relation.
+   */
+  std::uint64_t numRecords() const { return records; }
+
+  /**
+   * Returns the key of record position of the relation, in the order they are
+   * written.
+   */
+  int keyAt(const std::uint64_t position) const;
+
+  /**
+   * Appends the records of the relation to file. No buffer pool may hold a
+   * page of the file changed since it was read.
+   *
+   * @param file  File of the relation, usually new
+   * @return  Number of pages appended
+   * @throws  InsufficientSpaceException  If a record does not fit into an
+   * empty page
+   */
+  PageId generate(PageFile *file) const;
+
+  /**
+   * Makes the GeneratedRecord of key, with the key written out as "%05d
+   * string record" and the rest of the string blank, as main.cpp does.
+   */
+  static void makeRecord(const int key, std::string &record);
+
+ private:
+  /**
+   * Returns position through a permutation of 0 to records - 1.
+   */
+  std::uint64_t permute(std::uint64_t position) const;
+
+  /**
+   * Returns the number of records that fill whole pages closest to
+   * BATCH_RECORDS, going by the size of the first record.
+   */
+  std::uint64_t batchRecords() const;
+
+  RelationSpec spec;
+  std::size_t threads;
+  std::uint64_t records;
+
+  /**
+   * Bits in each half of the Feistel network, which permutes
+   * 2^(2 * halfBits) positions at least as many as records
+   */
+  int halfBits;
+
+  /**
+   * Ranks of SKEWED_KEYS, NULL for the other patterns
+   */
+  std::shared_ptr<ZipfianGenerator> zipfian;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,96 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "relation_writer.h"
+
+#include "exceptions/insufficient_space_exception.h"
+
+namespace badgerdb {
+
+IndexBuildLog::IndexBuildLog(PageFile *relation) : relation(relation) {}
+
+void IndexBuildLog::append(const RecordId &rid, const std::string &record) {
+  if (forward) {
+    forward(rid, record);
+  } else {
+    records.push_back(std::make_pair(rid, record));
+  }
+}
+
+RelationWriter::RelationWriter(PageFile *file, BufMgr *bufMgr,
+                               const PaxSchema *schema)
+    : file(file),
+      bufMgr(bufMgr),
+      schema(schema),
+      curPage(NULL),
+      curPageNo(Page::INVALID_NUMBER),
+      searchFrom(file->getFirstPageNo()),
+      buildLog(NULL) {}
+
+RelationWriter::~RelationWriter() {
+  if (curPage != NULL) bufMgr->unPinPage(file, curPageNo, true);
+  bufMgr->flushFile(file);
+}
+
+RecordId RelationWriter::insertRecord(const std::string &record) {
+  std::unique_lock<std::mutex> lock;
+  if (buildLog != NULL) lock = std::unique_lock<std::mutex>(buildLog->latch);
+
+  if (curPage == NULL || !hasRoom(curPage, record)) {
+    nextPage(record);
+  }
+  const RecordId rid = schema != NULL
+                           ? PaxPage(curPage, *schema).insertRecord(record)
+                           : curPage->insertRecord(record);
+  if (buildLog != NULL) buildLog->append(rid, record);
+  return rid;
+}
+
+bool RelationWriter::hasRoom(Page *page, const std::string &record) const {
+  if (schema != NULL) return !PaxPage(page, *schema).isFull();
+  return page->hasSpaceForRecord(record);
+}
+
+void RelationWriter::nextPage(const std::string &record) {
+  const std::size_t size =
+      schema != NULL ? schema->storedLength() : record.length();
+  if (schema != NULL ? PaxPage::capacity(*schema) == 0
+                     : size + sizeof(PageSlot) > Page::DATA_SIZE) {
+    throw InsufficientSpaceException(Page::INVALID_NUMBER, size,
+                                     Page::DATA_SIZE);
+  }
+  if (curPage != NULL) {
+    bufMgr->unPinPage(file, curPageNo, true);
+    curPage = NULL;
+  }
+
+  // The map does not know about the pages filled since, so pages it names
+  // are checked, and each is only tried once
+  while (searchFrom != Page::INVALID_NUMBER) {
+    const PageId pageNo = file->findPageWithSpace(size, searchFrom);
+    if (pageNo == Page::INVALID_NUMBER) {
+      searchFrom = Page::INVALID_NUMBER;
+      break;
+    }
+    searchFrom = pageNo + 1;
+
+    Page *page;
+    bufMgr->readPage(file, pageNo, page);
+    if (hasRoom(page, record)) {
+      curPage = page;
+      curPageNo = pageNo;
+      return;
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+  }
+
+  bufMgr->allocPage(file, curPageNo, curPage);
+  if (schema != NULL) PaxPage(curPage, *schema).initialize();
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,185 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "pax_page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class BTreeIndex;
+
+/**
+ * @brief Side log of the records inserted into a relation while an index on
+ * it is built online.
+ *
+ * Writers given the log insert each record under its latch and add the record
+ * to it. The build reads the relation's pages under the same latch, so every
+ * page it reads is between two inserts, and no writer waits for more than one
+ * page. Once the build has caught up with the log, it switches over, and from
+ * then on writers insert their records into the index instead.
+ */
+class IndexBuildLog {
+  friend class BTreeIndex;
+  friend class RelationWriter;
+
+ public:
+  /**
+   * Constructs an empty log of the records inserted into relation.
+   *
+   * @param relation  File of the relation, the one its writers insert into.
+   * Has to outlive the log.
+   */
+  explicit IndexBuildLog(PageFile *relation);
+
+  /**
+   * Returns the file of the relation.
+   */
+  PageFile *getRelation() const { return relation; }
+
+ private:
+  /**
+   * Adds a record just inserted into the relation, with the latch held.
+   */
+  void append(const RecordId &rid, const std::string &record);
+
+  // No copying
+  IndexBuildLog(const IndexBuildLog &);
+  IndexBuildLog &operator=(const IndexBuildLog &);
+
+  /**
+   * File of the relation.
+   */
+  PageFile *relation;
+
+  /**
+   * Held by writers for each insert, and by the build for each page it reads
+   */
+  std::mutex latch;
+
+  /**
+   * Records inserted since the log was given to the writers, in the order
+   * they were inserted
+   */
+  std::vector<std::pair<RecordId, std::string> > records;
+
+  /**
+   * Once set by the build, takes every record instead of the log
+   */
+  std::function<void(const RecordId &, const std::string &)> forward;
+};
+
+/**
+ * @brief This class is used to insert records into a relation.
+ *
+ * Records go into pages of the buffer pool. Each page is filled before the
+ * writer moves on, and only reaches the disk once, when the buffer manager
+ * writes it back. Pages the free space map lists with room are filled first,
+ * in page number order, and new pages are allocated after that.
+ *
+ * Given a schema, the writer stores the records in PAX pages instead of slotted
+ * pages. All pages of a relation have to be of the same kind.
+ *
+ * All pages of the file are flushed when the writer is destroyed, so other
+ * File objects for the relation see the records from then on.
+ */
+class RelationWriter {
+ public:
+  /**
+   * Constructs a writer adding records to file.
+   *
+   * @param file      File of the relation, which has to outlive the writer
+   * @param bufMgr    Buffer Manager instance
+   * @param schema    Schema of the records if the relation is stored in PAX
+   * pages, or NULL for slotted pages. Has to outlive the writer.
+   */
+  RelationWriter(PageFile *file, BufMgr *bufMgr,
+                 const PaxSchema *schema = NULL);
+
+  ~RelationWriter();
+
+  /**
+   * Inserts a record into the relation.
+   *
+   * @param record  Data of the record
+   * @return  RecordId of the inserted record
+   * @throws  InsufficientSpaceException  If the record does not fit even into
+   * an empty page
+   */
+  RecordId insertRecord(const std::string &record);
+
+  /**
+   * Has every record inserted from now on added to a side log, for an index
+   * being built online. Every writer of the relation has to be given the log
+   * before the build starts.
+   *
+   * @param log  Log of the relation, which has to outlive the writer, or NULL
+   */
+  void setBuildLog(IndexBuildLog *log) { buildLog = log; }
+
+ private:
+  /**
+   * Moves on to a page with room for the record, unpinning the current one.
+   *
+   * @param record  Data of the record
+   */
+  void nextPage(const std::string &record);
+
+  /**
+   * Returns true if the page has room for the record.
+   */
+  bool hasRoom(Page *page, const std::string &record) const;
+
+  /**
+   * File records are inserted into.
+   */
+  PageFile *file;
+
+  /**
+   * Buffer Manager instance used to read/write pages into/from buffer pool.
+   */
+  BufMgr *bufMgr;
+
+  /**
+   * Schema of the records of a PAX relation, or NULL.
+   */
+  const PaxSchema *schema;
+
+  /**
+   * Page records are inserted into, pinned, or NULL before the first record.
+   */
+  Page *curPage;
+
+  /**
+   * Number of curPage.
+   */
+  PageId curPageNo;
+
+  /**
+   * Number of the page the free space map is searched from next, or
+   * Page::INVALID_NUMBER once it lists no more pages with room.
+   */
+  PageId searchFrom;
+
+  /**
+   * Side log records are added to, or NULL.
+   */
+  IndexBuildLog *buildLog;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,296 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "replacement_policy.h"
+
+#include <algorithm>
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementStrategy strategy,
+                                             const std::uint32_t numBufs,
+                                             const std::uint32_t maxBufs) {
+  switch (strategy) {
+    case TWO_QUEUE:
+      return new TwoQueuePolicy(numBufs, maxBufs);
+    case CLOCK:
+    default:
+      return new ClockPolicy(numBufs, maxBufs);
+  }
+}
+
+//----------------------------------------
+// ClockPolicy
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t numBufs,
+                         const std::uint32_t maxBufs)
+    : numBufs(numBufs),
+      clockHand(numBufs - 1),
+      refbits(new std::atomic<std::uint64_t>[(maxBufs + 63) / 64]) {
+  for (std::uint32_t i = 0; i < (maxBufs + 63) / 64; i++) refbits[i] = 0;
+}
+
+void ClockPolicy::setReferenced(const FrameId frame, const bool referenced) {
+  std::atomic<std::uint64_t>& word = refbits[frame / 64];
+  const std::uint64_t bit = 1ULL << (frame % 64);
+
+  // Hot pages keep their bit set, so the word is only written if it changes
+  const bool set = (word.load(std::memory_order_relaxed) & bit) != 0;
+  if (set == referenced) return;
+  if (referenced) {
+    word.fetch_or(bit, std::memory_order_relaxed);
+  } else {
+    word.fetch_and(~bit, std::memory_order_relaxed);
+  }
+}
+
+FrameId ClockPolicy::advanceClock() {
+  const std::uint32_t n = numBufs.load(std::memory_order_relaxed);
+  FrameId hand = clockHand.load(std::memory_order_relaxed);
+  FrameId next;
+  do {
+    next = (hand + 1) % n;
+  } while (!clockHand.compare_exchange_weak(hand, next,
+                                            std::memory_order_relaxed));
+  return next;
+}
+
+void ClockPolicy::loaded(const FrameId frame, const File* file,
+                         const PageId pageNo, const bool sequential) {
+  // Pages of scans are given up at the clock's first visit
+  setReferenced(frame, !sequential);
+}
+
+void ClockPolicy::pinned(const FrameId frame, const bool sequential) {
+  if (!sequential) setReferenced(frame, true);
+}
+
+void ClockPolicy::evicted(const FrameId frame) { setReferenced(frame, false); }
+
+FrameId ClockPolicy::nextVictim() {
+  // Each call sweeps the pool at most once, since other threads may keep
+  // setting the bits
+  const std::uint32_t n = numBufs.load(std::memory_order_relaxed);
+  std::uint32_t swept = 0;
+  FrameId hand = clockHand.load(std::memory_order_relaxed);
+  while (swept < n) {
+    // Frames of the word after the hand, up to the end of the pool
+    const FrameId start = (hand + 1) % n;
+    const std::uint32_t first = start % 64;
+    const std::uint32_t span = std::min(64 - first, n - start);
+    const std::uint64_t frames =
+        (span == 64 ? ~0ULL : (1ULL << span) - 1) << first;
+    std::atomic<std::uint64_t>& word = refbits[start / 64];
+    const std::uint64_t unreferenced =
+        ~word.load(std::memory_order_relaxed) & frames;
+
+    // The hand moves to the first frame without the bit, or past the word
+    const std::uint32_t last = unreferenced != 0
+                                   ? (std::uint32_t)__builtin_ctzll(unreferenced)
+                                   : first + span - 1;
+    const FrameId end = start - first + last;
+    if (!clockHand.compare_exchange_weak(hand, end,
+                                         std::memory_order_relaxed)) {
+      continue;
+    }
+    swept += end - start + 1;
+    hand = end;
+
+    // has been referenced, the bits are cleared now. A frame referenced since
+    // the word was read is not taken.
+    const std::uint64_t passed = frames & ((2ULL << last) - 1);
+    const std::uint64_t bits =
+        word.fetch_and(~passed, std::memory_order_relaxed);
+    if (unreferenced != 0 && (bits & (1ULL << last)) == 0) return end;
+  }
+  return advanceClock();
+}
+
+void ClockPolicy::victimOrder(std::vector<FrameId>& frames) {
+  const std::uint32_t n = numBufs.load(std::memory_order_relaxed);
+  const FrameId hand = clockHand.load(std::memory_order_relaxed);
+  frames.clear();
+  for (std::uint32_t i = 1; i <= n; i++) frames.push_back((hand + i) % n);
+}
+
+void ClockPolicy::resize(const std::uint32_t numBufs) {
+  // Frames coming or going are empty and start without the bit. Sweeps
+  // already under way may still pass frames removed, which are never claimed.
+  const std::uint32_t old = this->numBufs.load(std::memory_order_relaxed);
+  for (FrameId i = std::min(old, numBufs); i < std::max(old, numBufs); i++) {
+    setReferenced(i, false);
+  }
+  this->numBufs.store(numBufs, std::memory_order_relaxed);
+}
+
+//----------------------------------------
+// TwoQueuePolicy
+//----------------------------------------
+
+std::size_t TwoQueuePolicy::GhostKeyHash::operator()(
+    const GhostKey& key) const {
+  std::uint64_t h = reinterpret_cast<std::uintptr_t>(key.file) ^
+                    ((std::uint64_t)key.pageNo << 32) ^ key.pageNo;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (std::size_t)h;
+}
+
+TwoQueuePolicy::TwoQueuePolicy(const std::uint32_t numBufs,
+                               const std::uint32_t maxBufs)
+    : numBufs(numBufs),
+      maxBufs(maxBufs),
+      maxIn(numBufs / 4 > 0 ? numBufs / 4 : 1),
+      maxOut(numBufs / 2 > 0 ? numBufs / 2 : 1),
+      prev(maxBufs + NUM_LISTS),
+      next(maxBufs + NUM_LISTS),
+      listOf(maxBufs, FREE),
+      pageOf(maxBufs),
+      scanned(maxBufs, false),
+      ghostCount(0) {
+  for (int list = 0; list < NUM_LISTS; list++) {
+    const FrameId head = maxBufs + list;
+    prev[head] = next[head] = head;
+    listSize[list] = 0;
+  }
+  for (FrameId i = 0; i < numBufs; i++) pushBack(FREE, i);
+}
+
+void TwoQueuePolicy::unlink(const FrameId frame) {
+  next[prev[frame]] = next[frame];
+  prev[next[frame]] = prev[frame];
+  listSize[listOf[frame]]--;
+}
+
+void TwoQueuePolicy::pushFront(const FrameList to, const FrameId frame) {
+  const FrameId head = maxBufs + to;
+  prev[frame] = head;
+  next[frame] = next[head];
+  prev[next[head]] = frame;
+  next[head] = frame;
+  listOf[frame] = to;
+  listSize[to]++;
+}
+
+void TwoQueuePolicy::pushBack(const FrameList to, const FrameId frame) {
+  const FrameId head = maxBufs + to;
+  next[frame] = head;
+  prev[frame] = prev[head];
+  next[prev[head]] = frame;
+  prev[head] = frame;
+  listOf[frame] = to;
+  listSize[to]++;
+}
+
+void TwoQueuePolicy::remember(const GhostKey& key) {
+  ghosts[key] = ++ghostCount;
+  ghostQueue.push_back(std::make_pair(key, ghostCount));
+
+  // Forget the oldest pages, and stale entries, once there are too many
+  while (ghosts.size() > maxOut || ghostQueue.size() > 2 * maxOut) {
+    const std::pair<GhostKey, std::uint64_t> oldest = ghostQueue.front();
+    ghostQueue.pop_front();
+    std::unordered_map<GhostKey, std::uint64_t, GhostKeyHash>::iterator it =
+        ghosts.find(oldest.first);
+    if (it != ghosts.end() && it->second == oldest.second) ghosts.erase(it);
+  }
+}
+
+void TwoQueuePolicy::loaded(const FrameId frame, const File* file,
+                            const PageId pageNo, const bool sequential) {
+  std::lock_guard<std::mutex> lock(latch);
+  const GhostKey key = {file, pageNo};
+  unlink(frame);
+  pageOf[frame] = key;
+  scanned[frame] = sequential;
+  if (sequential) {
+    pushBack(A1IN, frame);
+  } else if (ghosts.erase(key) > 0) {
+    // Referenced again not long after it was pushed out of A1in
+    pushFront(AM, frame);
+  } else {
+    pushFront(A1IN, frame);
+  }
+}
+
+void TwoQueuePolicy::pinned(const FrameId frame, const bool sequential) {
+  if (sequential) return;
+  std::lock_guard<std::mutex> lock(latch);
+  if (listOf[frame] == AM) {
+    unlink(frame);
+    pushFront(AM, frame);
+  } else if (listOf[frame] == A1IN && scanned[frame]) {
+    // Wanted by more than the scan after all, so it is treated as a new page
+    scanned[frame] = false;
+    unlink(frame);
+    pushFront(A1IN, frame);
+  }
+}
+
+void TwoQueuePolicy::evicted(const FrameId frame) {
+  std::lock_guard<std::mutex> lock(latch);
+  if (listOf[frame] == A1IN && !scanned[frame]) remember(pageOf[frame]);
+  scanned[frame] = false;
+  unlink(frame);
+  pushBack(FREE, frame);
+}
+
+FrameId TwoQueuePolicy::nextVictim() {
+  std::lock_guard<std::mutex> lock(latch);
+  FrameList from;
+  if (listSize[FREE] > 0) {
+    from = FREE;
+  } else if (listSize[A1IN] > maxIn || listSize[AM] == 0) {
+    from = A1IN;
+  } else {
+    from = AM;
+  }
+
+  // Free frames come off the front, pages off the back. Whichever it is goes
+  // to the other end, so that the next call suggests another frame if this
+  // one cannot be claimed.
+  FrameId frame;
+  if (from == FREE) {
+    frame = next[maxBufs + FREE];
+    unlink(frame);
+    pushBack(FREE, frame);
+  } else {
+    frame = prev[maxBufs + from];
+    unlink(frame);
+    pushFront(from, frame);
+  }
+  return frame;
+}
+
+void TwoQueuePolicy::victimOrder(std::vector<FrameId>& frames) {
+  std::lock_guard<std::mutex> lock(latch);
+  frames.clear();
+  const FrameList order[] = {A1IN, AM};
+  for (int i = 0; i < 2; i++) {
+    const FrameId head = maxBufs + order[i];
+    for (FrameId frame = prev[head]; frame != head; frame = prev[frame]) {
+      frames.push_back(frame);
+    }
+  }
+}
+
+void TwoQueuePolicy::resize(const std::uint32_t numBufs) {
+  std::lock_guard<std::mutex> lock(latch);
+  for (FrameId i = this->numBufs; i < numBufs; i++) {
+    scanned[i] = false;
+    pushBack(FREE, i);
+  }
+  for (FrameId i = numBufs; i < this->numBufs; i++) unlink(i);
+  this->numBufs = numBufs;
+  maxIn = numBufs / 4 > 0 ? numBufs / 4 : 1;
+  maxOut = numBufs / 2 > 0 ? numBufs / 2 : 1;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,285 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Page replacement strategies a BufMgr can be created with.
+ */
+enum ReplacementStrategy {
+  /**
+   * Clock algorithm. Cheap, but a scan through more pages than the pool holds
+   * pushes everything else out.
+   */
+  CLOCK,
+
+  /**
+   * Simplified 2Q. Pages seen once go through a short FIFO queue, and only
+   * pages referenced again after leaving it make it into the main LRU list,
+   * so scans cannot push out the pages used over and over.
+   */
+  TWO_QUEUE
+};
+
+/**
+ * @brief Decides which frame of a buffer pool to reuse next.
+ *
+ * The buffer manager tells the policy about pages given a frame, pinned and
+ * taken out of the pool, and asks it for frames to evict. The policy does not
+ * know which frames are pinned. Frames it suggests that the buffer manager
+ * cannot claim are passed over, and suggested again later.
+ *
+ * All methods may be called from several threads at once, with latches of the
+ * buffer manager held, so a policy never calls back into the buffer manager.
+ */
+class ReplacementPolicy {
+ public:
+  /**
+   * Creates a policy for a pool of numBufs frames.
+   *
+   * @param strategy  Strategy of the policy
+   * @param numBufs   Number of frames in the buffer pool
+   * @param maxBufs   Number of frames the pool may be resized to, at least
+   * numBufs
+   */
+  static ReplacementPolicy* create(const ReplacementStrategy strategy,
+                                   const std::uint32_t numBufs,
+                                   const std::uint32_t maxBufs);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * Records that a frame was given a page.
+   *
+   * @param frame       Frame holding the page
+   * @param file        File of the page
+   * @param pageNo      Number of the page
+   * @param sequential  True if the page is read by a sequential scan, and is
+   * not likely to be needed again soon
+   */
+  virtual void loaded(const FrameId frame, const File* file,
+                      const PageId pageNo, const bool sequential) = 0;
+
+  /**
+   * Records that the page in a frame was pinned again.
+   *
+   * @param frame       Frame holding the page
+   * @param sequential  True if the page is pinned by a sequential scan
+   */
+  virtual void pinned(const FrameId frame, const bool sequential) = 0;
+
+  /**
+   * Records that a frame no longer holds a page.
+   *
+   * @param frame  Frame that was emptied
+   */
+  virtual void evicted(const FrameId frame) = 0;
+
+  /**
+   * Returns the next frame to try to evict.
+   */
+  virtual FrameId nextVictim() = 0;
+
+  /**
+   * Lists the frames holding pages in roughly the order they will be evicted.
+   *
+   * @param frames  Frames, replaced via this reference
+   */
+  virtual void victimOrder(std::vector<FrameId>& frames) = 0;
+
+  /**
+   * Changes the number of frames in the pool. Frames added are empty. Frames
+   * removed have been emptied, and are claimed by the buffer manager for
+   * good, so the policy is not told about them again.
+   *
+   * @param numBufs   New number of frames, at most the policy's maxBufs
+   */
+  virtual void resize(const std::uint32_t numBufs) = 0;
+};
+
+/**
+ * @brief Clock replacement. Every frame has a referenced bit that pinning
+ * sets. The clock hand sweeps the pool clearing the bits, and suggests the
+ * frames it finds without one.
+ *
+ * The bits are packed 64 to a word, and the hand moves a word at a time: it
+ * finds the first frame without the bit by scanning the word's bits, and
+ * clears the bits of the frames it passes over at once.
+ */
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  ClockPolicy(const std::uint32_t numBufs, const std::uint32_t maxBufs);
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo,
+              const bool sequential) override;
+  void pinned(const FrameId frame, const bool sequential) override;
+  void evicted(const FrameId frame) override;
+  FrameId nextVictim() override;
+  void victimOrder(std::vector<FrameId>& frames) override;
+  void resize(const std::uint32_t numBufs) override;
+
+ private:
+  /**
+   * Advance clock to next frame in the buffer pool
+   *
+   * @return  Frame the clock now points at
+   */
+  FrameId advanceClock();
+
+  /**
+   * Number of frames in the buffer pool. A pool resized while the hand
+   * sweeps it is swept in its old size until the next sweep.
+   */
+  std::atomic<std::uint32_t> numBufs;
+
+  /**
+   * Current position of clockhand in our buffer pool
+   */
+  std::atomic<FrameId> clockHand;
+
+  /**
+   * Has the page in each frame been referenced recently, one bit per frame the
+   * pool may be resized to
+   */
+  std::unique_ptr<std::atomic<std::uint64_t>[]> refbits;
+
+  /**
+   * Sets or clears the referenced bit of a frame.
+   */
+  void setReferenced(const FrameId frame, const bool referenced);
+};
+
+/**
+ * @brief Simplified 2Q replacement (Johnson and Shasha, VLDB 1994).
+ *
+ * Pages read in go to the front of the A1in FIFO queue. While it holds more
+ * than a quarter of the pool, victims come from its back; otherwise from the
+ * least recently used end of the Am list. Pages pushed out of A1in are
+ * remembered in the A1out list of page numbers, up to half the pool's worth,
+ * and a page read in again while remembered there goes straight to Am.
+ *
+ * Pages of sequential scans go to the back of A1in and are not remembered
+ * in A1out, so a scan mostly reuses its own frames.
+ */
+class TwoQueuePolicy : public ReplacementPolicy {
+ public:
+  TwoQueuePolicy(const std::uint32_t numBufs, const std::uint32_t maxBufs);
+
+  void loaded(const FrameId frame, const File* file, const PageId pageNo,
+              const bool sequential) override;
+  void pinned(const FrameId frame, const bool sequential) override;
+  void evicted(const FrameId frame) override;
+  FrameId nextVictim() override;
+  void victimOrder(std::vector<FrameId>& frames) override;
+  void resize(const std::uint32_t numBufs) override;
+
+ private:
+  /**
+   * Lists a frame can be on. Every frame is on exactly one.
+   */
+  enum FrameList { FREE = 0, A1IN = 1, AM = 2, NUM_LISTS = 3 };
+
+  /**
+   * A page remembered in A1out
+   */
+  struct GhostKey {
+    const File* file;
+    PageId pageNo;
+    bool operator==(const GhostKey& rhs) const {
+      return file == rhs.file && pageNo == rhs.pageNo;
+    }
+  };
+
+  struct GhostKeyHash {
+    std::size_t operator()(const GhostKey& key) const;
+  };
+
+  /**
+   * Takes a frame off its list.
+   */
+  void unlink(const FrameId frame);
+
+  /**
+   * Puts a frame at the front or the back of a list.
+   */
+  void pushFront(const FrameList to, const FrameId frame);
+  void pushBack(const FrameList to, const FrameId frame);
+
+  /**
+   * Remembers a page pushed out of A1in, forgetting the oldest one if A1out is
+   * full.
+   */
+  void remember(const GhostKey& key);
+
+  /**
+   * Number of frames in the buffer pool, and the number it may be resized to
+   */
+  std::uint32_t numBufs;
+  std::uint32_t maxBufs;
+
+  /**
+   * Number of frames A1in may hold before victims come from it, and number of
+   * pages A1out remembers
+   */
+  std::uint32_t maxIn;
+  std::uint32_t maxOut;
+
+  /**
+   * Protects all of the lists
+   */
+  std::mutex latch;
+
+  /**
+   * Doubly linked lists through the frames. Elements maxBufs + list are the
+   * head of each list.
+   */
+  std::vector<FrameId> prev;
+  std::vector<FrameId> next;
+
+  /**
+   * List each frame is on, and the length of each list
+   */
+  std::vector<FrameList> listOf;
+  std::uint32_t listSize[NUM_LISTS];
+
+  /**
+   * Page held by each frame
+   */
+  std::vector<GhostKey> pageOf;
+
+  /**
+   * True for frames holding a page read by a sequential scan and not pinned
+   * by anything else since
+   */
+  std::vector<bool> scanned;
+
+  /**
+   * Pages remembered in A1out, each with the number it was remembered under,
+   * and the order they were remembered in. Entries of the queue whose number
+   * does not match the map are stale.
+   */
+  std::unordered_map<GhostKey, std::uint64_t, GhostKeyHash> ghosts;
+  std::deque<std::pair<GhostKey, std::uint64_t> > ghostQueue;
+  std::uint64_t ghostCount;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,162 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace badgerdb {
+
+const std::size_t Tracer::RING_EVENTS;
+
+thread_local Tracer::Ring *Tracer::threadRing = NULL;
+
+namespace {
+
+std::uint64_t steadyNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/**
+ * Storage of every ring handed out, and the latch of the list
+ */
+std::mutex ringsLatch;
+std::vector<std::unique_ptr<char[]> > rings;
+
+/**
+ * Ticks and steady clock nanoseconds read together when the first ring was
+ * handed out, to convert ticks to nanoseconds with
+ */
+std::uint64_t baseTicks = 0;
+std::uint64_t baseNanos = 0;
+
+/**
+ * Gives a thread's ring back when the thread exits
+ */
+struct RingOwner {
+  std::atomic<bool> *owned;
+  ~RingOwner() {
+    if (owned != NULL) owned->store(false, std::memory_order_release);
+  }
+};
+
+thread_local RingOwner ringOwner = {NULL};
+
+const char *EVENT_NAMES[NUM_TRACE_EVENTS] = {
+    "page_read",      "eviction",       "blob_write",
+    "leaf_split",     "internal_split", "root_split"};
+
+}  // namespace
+
+Tracer::Ring *Tracer::attach() {
+  std::lock_guard<std::mutex> lock(ringsLatch);
+  Ring *ring = NULL;
+  for (std::size_t r = 0; r < rings.size() && ring == NULL; r++) {
+    Ring *candidate = reinterpret_cast<Ring *>(rings[r].get());
+    bool owned = false;
+    if (candidate->owned.compare_exchange_strong(owned, true)) ring = candidate;
+  }
+  if (ring == NULL) {
+    if (rings.empty()) {
+      baseTicks = ticks();
+      baseNanos = steadyNanos();
+    }
+    rings.push_back(std::unique_ptr<char[]>(new char[sizeof(Ring)]));
+    ring = new (rings.back().get()) Ring;
+    ring->head = 0;
+    ring->cleared = 0;
+    ring->id = (std::uint32_t)(rings.size() - 1);
+    ring->owned = true;
+  }
+  ringOwner.owned = &ring->owned;
+  threadRing = ring;
+  return ring;
+}
+
+void Tracer::snapshot(std::vector<TraceEvent> &events) {
+  events.clear();
+  std::lock_guard<std::mutex> lock(ringsLatch);
+  if (rings.empty()) return;
+
+  for (std::size_t r = 0; r < rings.size(); r++) {
+    const Ring *ring = reinterpret_cast<const Ring *>(rings[r].get());
+    const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+    const std::uint64_t cleared = ring->cleared.load();
+    std::uint64_t first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+    first = std::max(first, cleared);
+    const std::size_t size = events.size();
+    for (std::uint64_t e = first; e < head; e++) {
+      events.push_back(ring->events[e & (RING_EVENTS - 1)]);
+    }
+
+    // The thread may have overwritten the oldest events meanwhile, and be
+    // writing over the next one, unless it is this thread or has exited
+    if (ring == threadRing || !ring->owned.load()) continue;
+    const std::uint64_t now = ring->head.load(std::memory_order_acquire);
+    if (now >= RING_EVENTS && now - RING_EVENTS + 1 > first) {
+      const std::uint64_t lost =
+          std::min(now - RING_EVENTS + 1 - first, head - first);
+      events.erase(events.begin() + size, events.begin() + size + lost);
+    }
+  }
+
+  // Ticks to nanoseconds, by the rate the counter ran at since the first ring
+#ifdef BADGERDB_TRACE_TSC
+  std::uint64_t nowTicks = ticks();
+  std::uint64_t nowNanos = steadyNanos();
+  while (nowNanos - baseNanos < 1000000) {
+    nowTicks = ticks();
+    nowNanos = steadyNanos();
+  }
+  const long double nanosPerTick =
+      (long double)(nowNanos - baseNanos) / (nowTicks - baseTicks);
+  for (std::size_t e = 0; e < events.size(); e++) {
+    const std::int64_t ticksSince =
+        (std::int64_t)(events[e].nanos - baseTicks);
+    events[e].nanos = baseNanos + (std::int64_t)(ticksSince * nanosPerTick);
+  }
+#endif
+  std::stable_sort(events.begin(), events.end(),
+                   [](const TraceEvent &a, const TraceEvent &b) {
+                     return a.nanos < b.nanos;
+                   });
+}
+
+void Tracer::clear() {
+  std::lock_guard<std::mutex> lock(ringsLatch);
+  for (std::size_t r = 0; r < rings.size(); r++) {
+    Ring *ring = reinterpret_cast<Ring *>(rings[r].get());
+    ring->cleared.store(ring->head.load());
+  }
+}
+
+const char *Tracer::eventName(const std::uint32_t type) {
+  return type < NUM_TRACE_EVENTS ? EVENT_NAMES[type] : "unknown";
+}
+
+void Tracer::writeChromeTrace(std::ostream &out,
+                              const std::vector<TraceEvent> &events) {
+  out << "{\"traceEvents\":[";
+  for (std::size_t e = 0; e < events.size(); e++) {
+    const TraceEvent &event = events[e];
+    out << (e == 0 ? "\n" : ",\n") << "{\"name\":\""
+        << eventName(event.type) << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":"
+        << event.nanos / 1000 << "." << event.nanos / 100 % 10
+        << ",\"pid\":1,\"tid\":" << event.thread << ",\"args\":{\"arg0\":"
+        << event.arg0 << ",\"arg1\":" << event.arg1 << "}}";
+  }
+  out << "\n]}\n";
+}
+
+}  // namespace badgerdb
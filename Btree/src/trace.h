@@ -0,0 +1,208 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BADGERDB_TRACE_TSC
+#else
+#include <chrono>
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief Events traced by BADGERDB_TRACE(), and what their two arguments are.
+ */
+enum TraceEventType {
+  /**
+   * A page read into the buffer pool, by a readPage() miss or read-ahead:
+   * page number, nanoseconds the read took
+   */
+  TRACE_PAGE_READ,
+
+  /**
+   * A frame given up by allocBuf(): page number it held, 1 if it was dirty
+   */
+  TRACE_EVICTION,
+
+  /**
+   * A page written by BlobFile::writePage(): page number, 1 if the file
+   * stores it compressed
+   */
+  TRACE_BLOB_WRITE,
+
+  /**
+   * A B+tree node split in two: page number of the node, of the new node
+   */
+  TRACE_LEAF_SPLIT,
+  TRACE_INTERNAL_SPLIT,
+
+  /**
+   * A new root above the old one: page number of the old root, of the new
+   */
+  TRACE_ROOT_SPLIT,
+
+  NUM_TRACE_EVENTS
+};
+
+/**
+ * @brief An event recorded by Tracer::record().
+ */
+struct TraceEvent {
+  /**
+   * Time of the event, in nanoseconds of the steady clock once snapshot() has
+   * converted it
+   */
+  std::uint64_t nanos;
+
+  /**
+   * TraceEventType of the event
+   */
+  std::uint32_t type;
+
+  /**
+   * Ring the event was recorded into, the same for all events of a thread
+   */
+  std::uint32_t thread;
+
+  std::uint64_t arg0;
+  std::uint64_t arg1;
+};
+
+/**
+ * @brief Lock-free ring buffers of trace events, one per thread.
+ *
+ * A thread records into its own ring, which it takes from a shared list the
+ * first time and gives back when it exits, so recording is a few stores and
+ * a read of the time stamp counter. Each ring keeps the last RING_EVENTS
+ * events of the threads that had it. Rings are never freed.
+ *
+ * The events of the library are only recorded when it is built with
+ * BADGERDB_TRACING defined (make TRACE=1). Otherwise BADGERDB_TRACE() expands
+ * to nothing and snapshot() finds no events but those recorded directly.
+ */
+class Tracer {
+ public:
+  /**
+   * Events each ring keeps, a power of two
+   */
+  static const std::size_t RING_EVENTS = 4096;
+
+  /**
+   * Records an event into the calling thread's ring.
+   */
+  static void record(const TraceEventType type, const std::uint64_t arg0,
+                     const std::uint64_t arg1) {
+    Ring *ring = threadRing;
+    if (ring == NULL) ring = attach();
+    const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent &event = ring->events[head & (RING_EVENTS - 1)];
+    event.nanos = ticks();
+    event.type = (std::uint32_t)type;
+    event.thread = ring->id;
+    event.arg0 = arg0;
+    event.arg1 = arg1;
+    ring->head.store(head + 1, std::memory_order_release);
+  }
+
+  /**
+   * Collects the events of all rings recorded since the last clear(), in time
+   * order. Events overwritten while they are copied are left out.
+   *
+   * @param events  Events, replaced via this reference
+   */
+  static void snapshot(std::vector<TraceEvent> &events);
+
+  /**
+   * Drops the events recorded so far from later snapshots.
+   */
+  static void clear();
+
+  /**
+   * Returns the name of an event type, such as "page_read".
+   */
+  static const char *eventName(const std::uint32_t type);
+
+  /**
+   * Writes events as instant events of the Chrome trace event format, which
+   * chrome://tracing and Perfetto open, a track per ring.
+   */
+  static void writeChromeTrace(std::ostream &out,
+                               const std::vector<TraceEvent> &events);
+
+ private:
+  struct Ring {
+    /**
+     * Number of events recorded into the ring, only written by its thread
+     */
+    std::atomic<std::uint64_t> head;
+
+    /**
+     * head at the last clear()
+     */
+    std::atomic<std::uint64_t> cleared;
+
+    std::uint32_t id;
+
+    /**
+     * Set while a thread records into the ring
+     */
+    std::atomic<bool> owned;
+
+    TraceEvent events[RING_EVENTS];
+  };
+
+  /**
+   * Gives the calling thread a ring, one given back by an exited thread if
+   * there is one.
+   */
+  static Ring *attach();
+
+  /**
+   * Returns the time stamp counter, or the steady clock's nanoseconds where
+   * there is none.
+   */
+  static std::uint64_t ticks() {
+#ifdef BADGERDB_TRACE_TSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  /**
+   * Ring of the calling thread, NULL until it records its first event
+   */
+  static thread_local Ring *threadRing;
+};
+
+}  // namespace badgerdb
+
+/**
+ * Records a trace event in builds with BADGERDB_TRACING defined, and is
+ * compiled out, arguments and all, in others.
+ */
+#ifdef BADGERDB_TRACING
+#define BADGERDB_TRACE(type, arg0, arg1)                         \
+  ::badgerdb::Tracer::record((type), (std::uint64_t)(arg0), \
+                             (std::uint64_t)(arg1))
+#else
+#define BADGERDB_TRACE(type, arg0, arg1) \
+  do {                                   \
+  } while (0)
+#endif
@@ -25,6 +25,29 @@ typedef std::uint16_t SlotId;
  */
 typedef std::uint32_t FrameId;
 
+/**
+ * @brief Identifier of an open file, the same for every File object open on
+ * it and reused once all of them are closed.
+ */
+typedef std::uint32_t FileId;
+
+/**
+ * @brief Datatype enumeration type. COMPOSITE is the type of B+ tree keys over
+ * several attributes, not of attributes.
+ */
+enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2, COMPOSITE = 3 };
+
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() and
+ * used in the predicates of a FileScan.
+ */
+enum Operator {
+  LT,  /* Less Than */
+  LTE, /* Less Than or Equal to */
+  GTE, /* Greater Than or Equal to */
+  GT   /* Greater Than */
+};
+
 /**
  * @brief Identifier for a record in a page.
  */
@@ -66,4 +89,13 @@ struct RecordId {
   }
 };
 
+/**
+ * @brief Range of bytes of a record, such as an attribute, or the bytes kept by
+ * the projection of a scan.
+ */
+struct ByteRange {
+  std::size_t offset;
+  std::size_t length;
+};
+
 }  // namespace badgerdb
@@ -0,0 +1,511 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "btree.h"
+#include "buffer_telemetry.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/no_such_key_found_exception.h"
+#include "page_latch.h"
+#include "relation_generator.h"
+#include "relation_writer.h"
+#include "trace.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Relation the workload runs on. The index on it is RELATION + ".0".
+ */
+const std::string RELATION = "ycsb_rel";
+
+/**
+ * Record of the relation. The index is on i, and updates rewrite d and s.
+ */
+typedef GeneratedRecord Record;
+
+/**
+ * Kinds of operations, as YCSB names them
+ */
+enum Operation {
+  READ,
+  UPDATE,
+  INSERT,
+  SCAN,
+  READ_MODIFY_WRITE,
+  NUM_OPERATIONS
+};
+
+const char *OPERATION_NAMES[NUM_OPERATIONS] = {"READ", "UPDATE", "INSERT",
+                                               "SCAN", "READ-MODIFY-WRITE"};
+
+/**
+ * How the keys of reads, updates and scans are chosen
+ */
+enum Distribution { UNIFORM, ZIPFIAN, LATEST };
+
+/**
+ * Share of each kind of operation in a workload, and the distribution YCSB
+ * gives it
+ */
+struct Workload {
+  double mix[NUM_OPERATIONS];
+  Distribution distribution;
+};
+
+/**
+ * Returns the core workload of the given letter, A to F.
+ */
+bool coreWorkload(const char letter, Workload &workload) {
+  memset(workload.mix, 0, sizeof(workload.mix));
+  workload.distribution = ZIPFIAN;
+  switch (letter) {
+    case 'a':  // Update heavy
+      workload.mix[READ] = 0.5;
+      workload.mix[UPDATE] = 0.5;
+      return true;
+    case 'b':  // Read mostly
+      workload.mix[READ] = 0.95;
+      workload.mix[UPDATE] = 0.05;
+      return true;
+    case 'c':  // Read only
+      workload.mix[READ] = 1;
+      return true;
+    case 'd':  // Read latest
+      workload.mix[READ] = 0.95;
+      workload.mix[INSERT] = 0.05;
+      workload.distribution = LATEST;
+      return true;
+    case 'e':  // Short ranges
+      workload.mix[SCAN] = 0.95;
+      workload.mix[INSERT] = 0.05;
+      return true;
+    case 'f':  // Read-modify-write
+      workload.mix[READ] = 0.5;
+      workload.mix[READ_MODIFY_WRITE] = 0.5;
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Settings given on the command line
+ */
+struct Options {
+  char workload;
+  std::uint64_t records;
+  std::uint64_t operations;
+  int threads;
+  int maxScan;
+  std::uint32_t poolFrames;
+  std::uint64_t seed;
+  bool distributionGiven;
+  Distribution distribution;
+
+  /**
+   * File the trace events of the run go to, in the Chrome trace format, or
+   * empty
+   */
+  std::string traceFile;
+};
+
+/**
+ * State the client threads share
+ */
+struct Driver {
+  Driver(const Options &options, const Workload &workload, BufMgr *pool,
+         PageFile *relation, BTreeIndex *index)
+      : options(options),
+        workload(workload),
+        pool(pool),
+        relation(relation),
+        index(index),
+        writer(relation, pool),
+        zipfian(options.records),
+        nextKey(options.records),
+        insertedKeys(options.records),
+        misses(0) {}
+
+  const Options &options;
+  const Workload &workload;
+  BufMgr *pool;
+  PageFile *relation;
+  BTreeIndex *index;
+
+  /**
+   * Appends the records of inserts, one at a time
+   */
+  RelationWriter writer;
+  std::mutex writerLatch;
+
+  /**
+   * Held in shared mode by reads and updates of records, and exclusively by
+   * inserts, which may add to a page others are reading. Each page's latch
+   * is held too, exclusively by updates.
+   */
+  PageLatch relationLatch;
+  PageLatchTable pageLatches;
+
+  ZipfianGenerator zipfian;
+
+  /**
+   * Key the next insert takes, and the number of keys inserted up to the
+   * first one an insert still under way has taken
+   */
+  std::atomic<std::uint64_t> nextKey;
+  std::atomic<std::uint64_t> insertedKeys;
+
+  /**
+   * Reads, updates and scans that found no entry
+   */
+  std::atomic<std::uint64_t> misses;
+};
+
+/**
+ * Latencies of one client thread, in nanoseconds, by operation
+ */
+struct ClientStats {
+  Histogram latency[NUM_OPERATIONS];
+};
+
+/**
+ * Returns the key of a read, update or scan: one of those inserted, by the
+ * workload's distribution.
+ */
+template <class Random>
+int chooseKey(Driver &driver, Random &rng) {
+  const std::uint64_t keys = driver.insertedKeys.load();
+  switch (driver.options.distributionGiven ? driver.options.distribution
+                                           : driver.workload.distribution) {
+    case UNIFORM:
+      return (int)std::uniform_int_distribution<std::uint64_t>(0, keys - 1)(
+          rng);
+    case LATEST: {
+      // The most recently inserted keys are the most popular
+      const std::uint64_t rank = driver.zipfian.next(rng);
+      return (int)(rank < keys ? keys - 1 - rank : 0);
+    }
+    case ZIPFIAN:
+    default:
+      return (int)(fnvHash(driver.zipfian.next(rng)) % keys);
+  }
+}
+
+/**
+ * Reads the record rid, and if update is set rewrites its other fields.
+ */
+void accessRecord(Driver &driver, const RecordId &rid, const bool update,
+                  std::mt19937_64 &rng) {
+  driver.relationLatch.lockShared();
+  PageLatch &latch = driver.pageLatches.latchFor(rid.page_number);
+  if (update) {
+    latch.lock();
+  } else {
+    latch.lockShared();
+  }
+  Page *page;
+  driver.pool->readPage(driver.relation, rid.page_number, page);
+  std::string data = page->getRecord(rid);
+  if (update) {
+    Record record;
+    memcpy(&record, data.data(), std::min(data.size(), sizeof(record)));
+    record.d = (double)rng();
+    snprintf(record.s, sizeof(record.s), "%016llx updated",
+             (unsigned long long)rng());
+    data.assign(reinterpret_cast<char *>(&record), sizeof(record));
+    page->updateRecord(rid, data);
+  }
+  driver.pool->unPinPage(driver.relation, rid.page_number, update);
+  if (update) {
+    latch.unlock();
+  } else {
+    latch.unlockShared();
+  }
+  driver.relationLatch.unlockShared();
+}
+
+/**
+ * Runs one operation of the given kind.
+ */
+void runOperation(Driver &driver, const Operation operation,
+                  IndexCursor &cursor,
+                  std::vector<RecordId> &scanned, std::mt19937_64 &rng) {
+  if (operation == INSERT) {
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.i = (int)driver.nextKey++;
+    record.d = record.i;
+    snprintf(record.s, sizeof(record.s), "%010d string record", record.i);
+    RecordId rid;
+    {
+      std::lock_guard<std::mutex> lock(driver.writerLatch);
+      driver.relationLatch.lock();
+      rid = driver.writer.insertRecord(
+          std::string(reinterpret_cast<char *>(&record), sizeof(record)));
+      driver.relationLatch.unlock();
+    }
+    driver.index->insertEntry(&record.i, rid);
+
+    // Keys become readable in order, once every earlier insert is done
+    std::uint64_t expected = (std::uint64_t)record.i;
+    while (!driver.insertedKeys.compare_exchange_weak(expected,
+                                                      expected + 1)) {
+      expected = (std::uint64_t)record.i;
+      std::this_thread::yield();
+    }
+    return;
+  }
+
+  int key = chooseKey(driver, rng);
+  if (operation == SCAN) {
+    const int length = std::uniform_int_distribution<int>(
+        1, driver.options.maxScan)(rng);
+    try {
+      driver.index->startScan(cursor, &key, GTE, NULL, LT);
+      driver.index->scanNextBatch(cursor, &scanned[0], length);
+      driver.index->endScan(cursor);
+    } catch (const NoSuchKeyFoundException &) {
+      driver.misses++;
+    }
+    return;
+  }
+
+  RecordId rid;
+  if (!driver.index->lookup(&key, rid)) {
+    driver.misses++;
+    return;
+  }
+  if (operation == READ_MODIFY_WRITE) accessRecord(driver, rid, false, rng);
+  accessRecord(driver, rid, operation != READ, rng);
+}
+
+/**
+ * Runs operations operations of the workload's mix, timing each.
+ */
+void runClient(Driver &driver, const std::uint64_t operations, const int client,
+               ClientStats &stats) {
+  std::mt19937_64 rng(driver.options.seed + client);
+  std::uniform_real_distribution<double> pick(0, 1);
+  IndexCursor cursor;
+  std::vector<RecordId> scanned(driver.options.maxScan);
+  for (std::uint64_t n = 0; n < operations; n++) {
+    double p = pick(rng);
+    int operation = 0;
+    while (operation + 1 < NUM_OPERATIONS &&
+           p >= driver.workload.mix[operation]) {
+      p -= driver.workload.mix[operation];
+      operation++;
+    }
+
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    runOperation(driver, (Operation)operation, cursor, scanned, rng);
+    stats.latency[operation].record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+  }
+}
+
+void removeFile(const std::string &name) {
+  try {
+    File::remove(name);
+  } catch (const FileNotFoundException &) {
+  }
+}
+
+/**
+ * Writes the relation with a record for each of the keys 0 to records - 1,
+ * in random order.
+ */
+void load(const Options &options, PageFile *relation) {
+  RelationSpec spec;
+  spec.pattern = RANDOM_KEYS;
+  spec.high = (int)options.records;
+  spec.seed = options.seed;
+  RelationGenerator(spec).generate(relation);
+}
+
+/**
+ * Takes the value of "--name=value" if argument is that flag.
+ */
+bool flagValue(const char *argument, const char *name, std::string &value) {
+  const std::size_t length = strlen(name);
+  if (strncmp(argument, name, length) != 0 || argument[length] != '=') {
+    return false;
+  }
+  value = argument + length + 1;
+  return true;
+}
+
+void usage() {
+  std::cerr
+      << "Usage: badgerdb_ycsb [--workload=a|b|c|d|e|f] [--records=N]\n"
+         "         [--operations=N] [--threads=N] [--max_scan=N]\n"
+         "         [--distribution=uniform|zipfian|latest] [--pool_frames=N]\n"
+         "         [--seed=N] [--trace=FILE]"
+      << std::endl;
+}
+
+void printLatency(const char *name, const Histogram &latency) {
+  std::cout << std::left << std::setw(18) << name << std::right
+            << " count " << std::setw(10) << latency.getCount() << "  p50 "
+            << std::setw(9) << latency.percentile(0.5) / 1e3 << " us  p99 "
+            << std::setw(9) << latency.percentile(0.99) / 1e3 << " us  p999 "
+            << std::setw(9) << latency.percentile(0.999) / 1e3 << " us"
+            << std::endl;
+}
+
+}  // namespace
+
+/**
+ * Loads a relation and an index on it, then runs a YCSB core workload on them
+ * from several client threads and reports the throughput and the latency
+ * percentiles of each kind of operation.
+ */
+int main(int argc, char **argv) {
+  Options options;
+  options.workload = 'a';
+  options.records = 100000;
+  options.operations = 100000;
+  options.threads = 4;
+  options.maxScan = 100;
+  options.poolFrames = 10000;
+  options.seed = 1;
+  options.distributionGiven = false;
+  options.distribution = ZIPFIAN;
+
+  for (int a = 1; a < argc; a++) {
+    std::string value;
+    if (flagValue(argv[a], "--workload", value) && value.size() == 1) {
+      options.workload = (char)tolower(value[0]);
+    } else if (flagValue(argv[a], "--records", value)) {
+      options.records = std::strtoull(value.c_str(), NULL, 10);
+    } else if (flagValue(argv[a], "--operations", value)) {
+      options.operations = std::strtoull(value.c_str(), NULL, 10);
+    } else if (flagValue(argv[a], "--threads", value)) {
+      options.threads = std::max(1, atoi(value.c_str()));
+    } else if (flagValue(argv[a], "--max_scan", value)) {
+      options.maxScan = std::max(1, atoi(value.c_str()));
+    } else if (flagValue(argv[a], "--pool_frames", value)) {
+      options.poolFrames = (std::uint32_t)std::strtoul(value.c_str(), NULL, 10);
+    } else if (flagValue(argv[a], "--trace", value)) {
+      options.traceFile = value;
+    } else if (flagValue(argv[a], "--seed", value)) {
+      options.seed = std::strtoull(value.c_str(), NULL, 10);
+    } else if (flagValue(argv[a], "--distribution", value) &&
+               (value == "uniform" || value == "zipfian" ||
+                value == "latest")) {
+      options.distributionGiven = true;
+      options.distribution = value == "uniform"   ? UNIFORM
+                             : value == "zipfian" ? ZIPFIAN
+                                                  : LATEST;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  Workload workload;
+  if (!coreWorkload(options.workload, workload) || options.records == 0 ||
+      options.records + options.operations > (std::uint64_t)INT_MAX) {
+    usage();
+    return 1;
+  }
+
+  BufMgr *pool = new BufMgr(options.poolFrames);
+  removeFile(RELATION);
+  PageFile *relation = new PageFile(RELATION, true);
+  std::string indexName;
+  BTreeIndex *index;
+  {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    load(options, relation);
+    removeFile(RELATION + ".0");
+    index = new BTreeIndex(RELATION, indexName, pool, offsetof(Record, i),
+                           INTEGER, true);
+    std::cout << "Loaded " << options.records << " records in "
+              << std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << " s" << std::endl;
+  }
+
+  std::vector<ClientStats> stats(options.threads);
+  double seconds;
+  std::uint64_t misses;
+  {
+    Driver driver(options, workload, pool, relation, index);
+    Tracer::clear();
+    std::vector<std::thread> clients;
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int t = 0; t < options.threads; t++) {
+      const std::uint64_t operations =
+          options.operations / options.threads +
+          ((std::uint64_t)t < options.operations % options.threads);
+      clients.push_back(std::thread(runClient, std::ref(driver), operations, t,
+                                    std::ref(stats[t])));
+    }
+    for (int t = 0; t < options.threads; t++) clients[t].join();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start)
+                  .count();
+    misses = driver.misses.load();
+  }
+  if (!options.traceFile.empty()) {
+    // Only has events if the library was built with make TRACE=1
+    std::vector<TraceEvent> events;
+    Tracer::snapshot(events);
+    std::ofstream out(options.traceFile.c_str());
+    Tracer::writeChromeTrace(out, events);
+    std::cout << "Wrote " << events.size() << " trace events to "
+              << options.traceFile << std::endl;
+  }
+
+  std::cout << "Workload " << (char)toupper(options.workload) << ": "
+            << options.operations << " operations, " << options.threads
+            << " threads" << std::endl;
+  std::cout << "Run time " << seconds << " s, throughput "
+            << options.operations / seconds << " ops/s, " << misses
+            << " keys not found" << std::endl;
+  Histogram total;
+  for (int op = 0; op < NUM_OPERATIONS; op++) {
+    Histogram latency;
+    for (int t = 0; t < options.threads; t++) {
+      latency.merge(stats[t].latency[op]);
+    }
+    total.merge(latency);
+    if (latency.getCount() > 0) printLatency(OPERATION_NAMES[op], latency);
+  }
+  printLatency("ALL", total);
+
+  delete index;
+  pool->flushFile(relation);
+  delete relation;
+  removeFile(indexName);
+  removeFile(RELATION);
+  delete pool;
+  return 0;
+}